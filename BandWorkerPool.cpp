@@ -0,0 +1,120 @@
+/***********************************************************************
+BandWorkerPool - Class for a persistent pool of helper threads sharing
+jobs that are split into one band of work per thread.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "BandWorkerPool.h"
+
+/*******************************
+Methods of class BandWorkerPool:
+*******************************/
+
+void* BandWorkerPool::helperThreadMethod(unsigned int helperIndex)
+	{
+	unsigned int lastJobIndex=0;
+	while(true)
+		{
+		Job* currentJob;
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		
+		/* Wait until a new job is dispatched or the pool shuts down: */
+		while(runHelperThreads&&lastJobIndex==jobIndex)
+			jobCond.wait(jobLock);
+		
+		/* Bail out if the pool is shutting down: */
+		if(!runHelperThreads)
+			break;
+		
+		lastJobIndex=jobIndex;
+		currentJob=job;
+		}
+		
+		/* Process this thread's band; band 0 belongs to the calling thread: */
+		currentJob->runBand(helperIndex+1);
+		
+		/* Signal the calling thread if this was the last outstanding band: */
+		Threads::MutexCond::Lock doneLock(doneCond);
+		if(--numPendingBands==0)
+			doneCond.signal();
+		}
+	
+	return 0;
+	}
+
+BandWorkerPool::BandWorkerPool(unsigned int numThreads)
+	:numHelperThreads(numThreads>1?numThreads-1:0),helperThreads(0),
+	 runHelperThreads(true),jobIndex(0),job(0),numPendingBands(0)
+	{
+	/* Start the helper threads: */
+	if(numHelperThreads>0)
+		{
+		helperThreads=new Threads::Thread[numHelperThreads];
+		for(unsigned int i=0;i<numHelperThreads;++i)
+			helperThreads[i].start(this,&BandWorkerPool::helperThreadMethod,i);
+		}
+	}
+
+BandWorkerPool::~BandWorkerPool(void)
+	{
+	if(numHelperThreads>0)
+		{
+		/* Signal all helper threads to shut down: */
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		runHelperThreads=false;
+		jobCond.broadcast();
+		}
+		
+		/* Wait for all helper threads to terminate: */
+		for(unsigned int i=0;i<numHelperThreads;++i)
+			helperThreads[i].join();
+		delete[] helperThreads;
+		}
+	}
+
+void BandWorkerPool::run(BandWorkerPool::Job& newJob)
+	{
+	if(numHelperThreads>0)
+		{
+		/* Dispatch the job to the helper threads: */
+		{
+		Threads::MutexCond::Lock doneLock(doneCond);
+		numPendingBands=numHelperThreads;
+		}
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		job=&newJob;
+		++jobIndex;
+		jobCond.broadcast();
+		}
+		}
+	
+	/* Process the first band in the calling thread: */
+	newJob.runBand(0);
+	
+	if(numHelperThreads>0)
+		{
+		/* Wait for the helper threads to finish their bands: */
+		Threads::MutexCond::Lock doneLock(doneCond);
+		while(numPendingBands>0)
+			doneCond.wait(doneLock);
+		}
+	}
@@ -0,0 +1,76 @@
+/***********************************************************************
+BandWorkerPool - Class for a persistent pool of helper threads sharing
+jobs that are split into one band of work per thread.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef BANDWORKERPOOL_INCLUDED
+#define BANDWORKERPOOL_INCLUDED
+
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
+
+class BandWorkerPool
+	{
+	/* Embedded classes: */
+	public:
+	class Job // Base class for work split into one band per thread
+		{
+		/* Constructors and destructors: */
+		public:
+		virtual ~Job(void)
+			{
+			}
+		
+		/* Methods: */
+		virtual void runBand(unsigned int bandIndex) =0; // Processes the band of the given index; called concurrently for different bands
+		};
+	
+	/* Elements: */
+	private:
+	unsigned int numHelperThreads; // Number of helper threads supporting the calling thread
+	Threads::Thread* helperThreads; // Array of helper threads
+	Threads::MutexCond jobCond; // Condition variable to signal the helper threads that a new job is ready
+	volatile bool runHelperThreads; // Flag to keep the helper threads running
+	unsigned int jobIndex; // Sequence number of the most recently dispatched job
+	Job* job; // The most recently dispatched job
+	Threads::MutexCond doneCond; // Condition variable to signal the calling thread that all helper threads finished their bands
+	unsigned int numPendingBands; // Number of bands of the current job still being processed by helper threads
+	
+	/* Private methods: */
+	void* helperThreadMethod(unsigned int helperIndex); // Method for a helper thread processing one band of each job
+	
+	/* Constructors and destructors: */
+	public:
+	BandWorkerPool(unsigned int numThreads); // Creates a pool for jobs split among the given number of threads, including the thread running the jobs
+	private:
+	BandWorkerPool(const BandWorkerPool& source); // Prohibit copy constructor
+	BandWorkerPool& operator=(const BandWorkerPool& source); // Prohibit assignment operator
+	public:
+	~BandWorkerPool(void); // Shuts down the helper threads
+	
+	/* Methods: */
+	unsigned int getNumThreads(void) const // Returns the number of bands into which jobs are split
+		{
+		return numHelperThreads+1;
+		}
+	void run(Job& newJob); // Processes band 0 of the given job in the calling thread and all other bands on the helper threads, and returns when all bands are finished
+	};
+
+#endif
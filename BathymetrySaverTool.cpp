@@ -22,7 +22,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "BathymetrySaverTool.h"
 
+#include <string.h>
 #include <stdexcept>
+#include <vector>
 #include <iomanip>
 #include <Misc/PrintInteger.h>
 #include <Misc/ThrowStdErr.h>
@@ -36,6 +38,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Math/Math.h>
 
 #include "WaterTable2.h"
+#include "GridReadback.h"
+#include "GridCodec.h"
 #include "Sandbox.h"
 
 /**********************************************************
@@ -46,7 +50,10 @@ BathymetrySaverToolFactory::Configuration::Configuration(void)
 	:saveFileName("BathymetrySaverTool.dem"),
 	 postUpdate(false),postUpdatePort(80),postUpdatePage(""),
 	 postUpdateMessage("app.GenerateTileCache();"),
-	 gridScale(1.0)
+	 gridScale(1.0),
+	 tiledFormat(false),tileSize(64),compressTiles(false),
+	 saveWaterLevel(false),saveSnow(false),
+	 postUpdateFile(false)
 	{
 	}
 
@@ -59,6 +66,14 @@ void BathymetrySaverToolFactory::Configuration::read(const Misc::ConfigurationFi
 	postUpdatePage=cfs.retrieveString("./postUpdatePage",postUpdatePage);
 	postUpdateMessage=cfs.retrieveString("./postUpdateMessage",postUpdateMessage);
 	gridScale=cfs.retrieveValue<double>("./gridScale",gridScale);
+	tiledFormat=cfs.retrieveValue<bool>("./tiledFormat",tiledFormat);
+	tileSize=cfs.retrieveValue<unsigned int>("./tileSize",tileSize);
+	if(tileSize<1)
+		tileSize=1;
+	compressTiles=cfs.retrieveValue<bool>("./compressTiles",compressTiles);
+	saveWaterLevel=cfs.retrieveValue<bool>("./saveWaterLevel",saveWaterLevel);
+	saveSnow=cfs.retrieveValue<bool>("./saveSnow",saveSnow);
+	postUpdateFile=cfs.retrieveValue<bool>("./postUpdateFile",postUpdateFile);
 	}
 
 void BathymetrySaverToolFactory::Configuration::write(Misc::ConfigurationFileSection& cfs) const
@@ -70,6 +85,12 @@ void BathymetrySaverToolFactory::Configuration::write(Misc::ConfigurationFileSec
 	cfs.storeString("./postUpdatePage",postUpdatePage);
 	cfs.storeString("./postUpdateMessage",postUpdateMessage);
 	cfs.storeValue<double>("./gridScale",gridScale);
+	cfs.storeValue<bool>("./tiledFormat",tiledFormat);
+	cfs.storeValue<unsigned int>("./tileSize",tileSize);
+	cfs.storeValue<bool>("./compressTiles",compressTiles);
+	cfs.storeValue<bool>("./saveWaterLevel",saveWaterLevel);
+	cfs.storeValue<bool>("./saveSnow",saveSnow);
+	cfs.storeValue<bool>("./postUpdateFile",postUpdateFile);
 	}
 
 /*******************************************
@@ -84,6 +105,7 @@ BathymetrySaverToolFactory::BathymetrySaverToolFactory(WaterTable2* sWaterTable,
 	for(int i=0;i<2;++i)
 		{
 		gridSize[i]=waterTable->getBathymetrySize(i);
+		quantitySize[i]=waterTable->getSize()[i];
 		cellSize[i]=waterTable->getCellSize()[i];
 		}
 	
@@ -205,10 +227,41 @@ std::ostream& printFloat8(std::ostream& os,double value)
 	return os;
 	}
 
+void writeString(Comm::NetPipe& pipe,const char* string)
+	{
+	pipe.writeRaw(string,strlen(string));
+	}
+
+void writeChunk(Comm::NetPipe& pipe,const void* data,size_t dataSize)
+	{
+	/* Write the chunk size in hexadecimal: */
+	char sizeString[2*sizeof(size_t)+3];
+	char* ssPtr=sizeString+sizeof(sizeString);
+	*(--ssPtr)='\n';
+	*(--ssPtr)='\r';
+	size_t size=dataSize;
+	do
+		{
+		*(--ssPtr)="0123456789abcdef"[size&0xfU];
+		size>>=4;
+		}
+	while(size!=0);
+	pipe.writeRaw(ssPtr,(sizeString+sizeof(sizeString))-ssPtr);
+	
+	/* Write the chunk data and footer: */
+	pipe.writeRaw(data,dataSize);
+	pipe.writeRaw("\r\n",2);
+	}
+
+const char tiledFileSignature[8]={'S','B','X','G','R','I','D','\0'};
+const Misc::UInt32 tiledFileVersion=1U;
+
 }
 
-void BathymetrySaverTool::writeDEMFile(void) const
+void BathymetrySaverTool::writeDEMFile(const BathymetrySaverTool::GridBuffers& grids) const
 	{
+	const GLfloat* bathymetryBuffer=grids.bathymetry;
+	
 	/* Open the output file as a std::ostream: */
 	IO::OStream demFile(IO::openFile(configuration.saveFileName.c_str(),IO::File::WriteOnly));
 	
@@ -378,44 +431,139 @@ void BathymetrySaverTool::writeDEMFile(void) const
 		demFile<<' ';
 	}
 
+void BathymetrySaverTool::writeTiledLayer(IO::File& file,Misc::UInt32 layerType,const GLfloat* grid,const GLsizei size[2]) const
+	{
+	/* Calculate the layer's scaled value range: */
+	GLfloat gs=GLfloat(configuration.gridScale);
+	GLfloat min,max;
+	min=max=grid[0];
+	const GLfloat* gPtr=grid+1;
+	for(size_t count=size_t(size[1])*size_t(size[0])-1;count>0;--count,++gPtr)
+		{
+		if(min>*gPtr)
+			min=*gPtr;
+		if(max<*gPtr)
+			max=*gPtr;
+		}
+	min*=gs;
+	max*=gs;
+	
+	/* Write the layer header: */
+	file.write<Misc::UInt32>(layerType);
+	for(int i=0;i<2;++i)
+		file.write<Misc::UInt32>(Misc::UInt32(size[i]));
+	file.write<Misc::Float32>(min);
+	file.write<Misc::Float32>(max);
+	
+	/* Write all tiles in row-major order: */
+	GLsizei ts=GLsizei(configuration.tileSize);
+	std::vector<Misc::Float32> tileValues;
+	std::vector<GridCodec::Value> quantizedValues;
+	GridCodec::Buffer encodedTile;
+	float quantScale=max>min?65535.0f/(max-min):0.0f;
+	for(GLsizei tileY=0;tileY<size[1];tileY+=ts)
+		for(GLsizei tileX=0;tileX<size[0];tileX+=ts)
+			{
+			/* Gather the tile's scaled values: */
+			GLsizei tileWidth=Math::min(ts,size[0]-tileX);
+			GLsizei tileHeight=Math::min(ts,size[1]-tileY);
+			tileValues.clear();
+			for(GLsizei y=0;y<tileHeight;++y)
+				{
+				const GLfloat* rowPtr=grid+(size_t(tileY+y)*size_t(size[0])+size_t(tileX));
+				for(GLsizei x=0;x<tileWidth;++x)
+					tileValues.push_back(Misc::Float32(rowPtr[x]*gs));
+				}
+			
+			if(configuration.compressTiles)
+				{
+				/* Quantize the tile's values to the layer's range and encode them as a key frame: */
+				quantizedValues.resize(tileValues.size());
+				for(size_t i=0;i<tileValues.size();++i)
+					quantizedValues[i]=GridCodec::Value(Math::floor((tileValues[i]-min)*quantScale+0.5f));
+				encodedTile.clear();
+				GridCodec::encodeKeyFrame(&quantizedValues[0],quantizedValues.size(),encodedTile);
+				file.write<Misc::UInt32>(Misc::UInt32(encodedTile.size()));
+				file.write(&encodedTile[0],encodedTile.size());
+				}
+			else
+				file.write(&tileValues[0],tileValues.size());
+			}
+	}
+
+void BathymetrySaverTool::writeTiledFile(const BathymetrySaverTool::GridBuffers& grids) const
+	{
+	/* Open the output file: */
+	IO::FilePtr file=IO::openFile(configuration.saveFileName.c_str(),IO::File::WriteOnly);
+	file->setEndianness(Misc::LittleEndian);
+	
+	/* Write the file header: */
+	Misc::UInt32 numLayers=1U;
+	if(configuration.saveWaterLevel)
+		++numLayers;
+	if(configuration.saveSnow)
+		++numLayers;
+	file->write(tiledFileSignature,8);
+	file->write<Misc::UInt32>(tiledFileVersion);
+	file->write<Misc::UInt32>(numLayers);
+	for(int i=0;i<2;++i)
+		file->write<Misc::Float64>(double(factory->cellSize[i])*configuration.gridScale);
+	file->write<Misc::UInt32>(configuration.tileSize);
+	file->write<Misc::UInt32>(configuration.compressTiles?1U:0U);
+	
+	/* Write the configured layers: */
+	writeTiledLayer(*file,0U,grids.bathymetry,factory->gridSize);
+	if(configuration.saveWaterLevel)
+		writeTiledLayer(*file,1U,grids.waterLevel,factory->quantitySize);
+	if(configuration.saveSnow)
+		writeTiledLayer(*file,2U,grids.snow,factory->quantitySize);
+	}
+
 void BathymetrySaverTool::postUpdate(void) const
 	{
 	/* Connect to the HTTP server: */
 	Comm::NetPipePtr pipe=new Comm::TCPPipe(configuration.postUpdateHostName.c_str(),configuration.postUpdatePort);
 	
-	/* Assemble the PUT request: */
-	std::string request;
-	request.append("PUT");
-	request.push_back(' ');
-	request.push_back('/');
-	request.append(configuration.postUpdatePage.c_str());
-	request.push_back(' ');
-	request.append("HTTP/1.1\r\n");
-	
-	request.append("Host: ");
-	request.append(configuration.postUpdateHostName.c_str());
-	request.push_back(':');
-	char portString[6];
-	request.append(Misc::print(configuration.postUpdatePort,portString+5));
-	request.append("\r\n");
-	
-	request.append("Accept: */*\r\n");
+	/* Send the PUT request header: */
+	writeString(*pipe,"PUT /");
+	writeString(*pipe,configuration.postUpdatePage.c_str());
+	writeString(*pipe," HTTP/1.1\r\n");
 	
-	request.append("Content-Length: ");
-	char contentLengthString[6];
-	request.append(Misc::print(configuration.postUpdateMessage.size(),contentLengthString+5));
-	request.append("\r\n");
+	writeString(*pipe,"Host: ");
+	writeString(*pipe,configuration.postUpdateHostName.c_str());
+	writeString(*pipe,":");
+	char portString[6];
+	writeString(*pipe,Misc::print(configuration.postUpdatePort,portString+5));
+	writeString(*pipe,"\r\n");
 	
-	request.append("Content-Type: application/x-www-form-urlencoded\r\n");
+	writeString(*pipe,"Accept: */*\r\n");
+	writeString(*pipe,"Transfer-Encoding: chunked\r\n");
+	if(configuration.postUpdateFile)
+		writeString(*pipe,"Content-Type: application/octet-stream\r\n");
+	else
+		writeString(*pipe,"Content-Type: application/x-www-form-urlencoded\r\n");
 	
 	/* Finish the request header: */
-	request.append("\r\n");
+	writeString(*pipe,"\r\n");
 	
-	/* Assemble the PUT request content: */
-	request.append(configuration.postUpdateMessage);
+	/* Stream the PUT request content in chunks: */
+	if(configuration.postUpdateFile)
+		{
+		/* Send the saved file one buffer at a time: */
+		IO::FilePtr savedFile=IO::openFile(configuration.saveFileName.c_str());
+		char buffer[65536];
+		while(!savedFile->eof())
+			{
+			size_t readSize=savedFile->readUpTo(buffer,sizeof(buffer));
+			if(readSize>0)
+				writeChunk(*pipe,buffer,readSize);
+			}
+		}
+	else if(!configuration.postUpdateMessage.empty())
+		writeChunk(*pipe,configuration.postUpdateMessage.data(),configuration.postUpdateMessage.size());
 	
-	/* Send the PUT request: */
-	pipe->writeRaw(request.data(),request.size());
+	/* Send the last chunk and an empty trailer: */
+	writeString(*pipe,"0\r\n\r\n");
 	pipe->flush();
 	
 	/* Parse the reply header: */
@@ -579,25 +727,70 @@ void BathymetrySaverTool::postUpdate(void) const
 	// std::cout<<std::endl;
 	}
 
-void BathymetrySaverTool::readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData)
+void* BathymetrySaverTool::exportThreadMethod(void)
 	{
-	BathymetrySaverTool* thisPtr=static_cast<BathymetrySaverTool*>(userData);
-	
-	try
+	while(true)
 		{
-		/* Export the bathymetry grid: */
-		thisPtr->writeDEMFile();
+		/* Wait for the next grid buffer to save: */
+		{
+		Threads::MutexCond::Lock exportLock(exportCond);
+		while(runExportThread&&pendingBuffer<0)
+			exportCond.wait(exportLock);
+		if(!runExportThread)
+			break;
+		exportingBuffer=pendingBuffer;
+		pendingBuffer=-1;
+		}
 		
-		if(thisPtr->configuration.postUpdate)
+		try
 			{
-			/* Send an update message to the configured web server: */
-			thisPtr->postUpdate();
+			/* Export the grids: */
+			if(configuration.tiledFormat)
+				writeTiledFile(gridBuffers[exportingBuffer]);
+			else
+				writeDEMFile(gridBuffers[exportingBuffer]);
+			
+			if(configuration.postUpdate)
+				{
+				/* Send an update message to the configured web server: */
+				postUpdate();
+				}
 			}
-		}
-	catch(const std::runtime_error& err)
+		catch(const std::runtime_error& err)
+			{
+			Misc::formattedUserError("Save Bathymetry: Unable to save bathymetry due to exception \"%s\"",err.what());
+			}
+		
+		/* Release the grid buffer: */
 		{
-		Misc::formattedUserError("Save Bathymetry: Unable to save bathymetry due to exception \"%s\"",err.what());
+		Threads::MutexCond::Lock exportLock(exportCond);
+		exportingBuffer=-1;
+		}
 		}
+	
+	return 0;
+	}
+
+void BathymetrySaverTool::readBackCallback(const GLfloat* bathymetry,const GLfloat* waterLevel,const GLfloat* snow,void* userData)
+	{
+	BathymetrySaverTool* thisPtr=static_cast<BathymetrySaverTool*>(userData);
+	
+	{
+	Threads::MutexCond::Lock exportLock(thisPtr->exportCond);
+	
+	/* Copy the grids into the buffer not being saved, replacing any grids still waiting to be saved: */
+	GridBuffers& gb=thisPtr->gridBuffers[thisPtr->exportingBuffer==0?1:0];
+	memcpy(gb.bathymetry,bathymetry,size_t(factory->gridSize[1])*size_t(factory->gridSize[0])*sizeof(GLfloat));
+	size_t quantitySize=size_t(factory->quantitySize[1])*size_t(factory->quantitySize[0])*sizeof(GLfloat);
+	if(waterLevel!=0)
+		memcpy(gb.waterLevel,waterLevel,quantitySize);
+	if(snow!=0)
+		memcpy(gb.snow,snow,quantitySize);
+	
+	/* Wake up the export thread: */
+	thisPtr->pendingBuffer=thisPtr->exportingBuffer==0?1:0;
+	thisPtr->exportCond.signal();
+	}
 	}
 
 BathymetrySaverToolFactory* BathymetrySaverTool::initClass(WaterTable2* sWaterTable,Vrui::ToolManager& toolManager)
@@ -613,13 +806,39 @@ BathymetrySaverToolFactory* BathymetrySaverTool::initClass(WaterTable2* sWaterTa
 BathymetrySaverTool::BathymetrySaverTool(const Vrui::ToolFactory* factory,const Vrui::ToolInputAssignment& inputAssignment)
 	:Vrui::Tool(factory,inputAssignment),
 	 configuration(BathymetrySaverTool::factory->configuration),
-	 bathymetryBuffer(new GLfloat[BathymetrySaverTool::factory->gridSize[1]*BathymetrySaverTool::factory->gridSize[0]])
+	 pendingBuffer(-1),exportingBuffer(-1),
+	 runExportThread(true)
 	{
+	/* Allocate the double-buffered grids: */
+	size_t bathymetrySize=size_t(BathymetrySaverTool::factory->gridSize[1])*size_t(BathymetrySaverTool::factory->gridSize[0]);
+	size_t quantitySize=size_t(BathymetrySaverTool::factory->quantitySize[1])*size_t(BathymetrySaverTool::factory->quantitySize[0]);
+	for(int i=0;i<2;++i)
+		{
+		gridBuffers[i].bathymetry=new GLfloat[bathymetrySize];
+		gridBuffers[i].waterLevel=new GLfloat[quantitySize];
+		gridBuffers[i].snow=new GLfloat[quantitySize];
+		}
+	
+	/* Start the export thread: */
+	exportThread.start(this,&BathymetrySaverTool::exportThreadMethod);
 	}
 
 BathymetrySaverTool::~BathymetrySaverTool(void)
 	{
-	delete[] bathymetryBuffer;
+	/* Shut down the export thread after it finishes the current file: */
+	{
+	Threads::MutexCond::Lock exportLock(exportCond);
+	runExportThread=false;
+	exportCond.signal();
+	}
+	exportThread.join();
+	
+	for(int i=0;i<2;++i)
+		{
+		delete[] gridBuffers[i].bathymetry;
+		delete[] gridBuffers[i].waterLevel;
+		delete[] gridBuffers[i].snow;
+		}
 	}
 
 void BathymetrySaverTool::configure(const Misc::ConfigurationFileSection& configFileSection)
@@ -643,7 +862,12 @@ void BathymetrySaverTool::buttonCallback(int buttonSlotIndex,Vrui::InputDevice::
 	{
 	if(cbData->newButtonState)
 		{
-		/* Request a bathymetry grid from the water table: */
-		application->gridRequest.requestGrids(bathymetryBuffer,0,&BathymetrySaverTool::readBackCallback,this);
+		/* Request the grids to be saved from the water table: */
+		int grids=GridReadback::BATHYMETRY;
+		if(configuration.tiledFormat&&configuration.saveWaterLevel)
+			grids|=GridReadback::WATERLEVEL;
+		if(configuration.tiledFormat&&configuration.saveSnow)
+			grids|=GridReadback::SNOW;
+		application->gridReadback->request(grids,&BathymetrySaverTool::readBackCallback,this);
 		}
 	}
@@ -20,10 +20,30 @@ with the Augmented Reality Sandbox; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 ***********************************************************************/
 
+/***********************************************************************
+Tiled grid files are little-endian and consist of a header followed by
+one or more layers:
+- Header: 8-byte signature "SBXGRID\0", UInt32 format version, UInt32
+  number of layers, Float64 cell width and height, UInt32 tile size,
+  UInt32 compression flag.
+- Layer: UInt32 layer type (0: bathymetry, 1: water level, 2: snow),
+  UInt32 layer width and height, Float32 minimum and maximum value,
+  followed by the layer's tiles in row-major order. Tiles along the
+  right and bottom edges are clipped to the layer size. Uncompressed
+  tiles are arrays of Float32 values in row-major order. Compressed
+  tiles are a UInt32 encoded size followed by a GridCodec key frame of
+  the tile's values, quantized to 16 bits between the layer's minimum
+  and maximum value.
+All horizontal and vertical values are scaled by the tool's grid scale.
+***********************************************************************/
+
 #ifndef BATHYMETRYSAVERTOOL_INCLUDED
 #define BATHYMETRYSAVERTOOL_INCLUDED
 
 #include <string>
+#include <Misc/SizedTypes.h>
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
 #include <GL/gl.h>
 #include <Vrui/Tool.h>
 #include <Vrui/Application.h>
@@ -31,6 +51,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "Types.h"
 
 /* Forward declarations: */
+namespace IO {
+class File;
+}
 class WaterTable2;
 class Sandbox;
 class BathymetrySaverTool;
@@ -52,6 +75,12 @@ class BathymetrySaverToolFactory:public Vrui::ToolFactory
 		std::string postUpdatePage; // Name of page on web server to which update messages are posted
 		std::string postUpdateMessage; // The message to send to the web server
 		double gridScale; // Overall scale factor to applied to grids on export
+		bool tiledFormat; // Flag whether to save grids in the binary tiled grid format instead of USGS DEM format
+		unsigned int tileSize; // Width and height of tiles in the tiled grid format
+		bool compressTiles; // Flag whether to quantize and compress tiles in the tiled grid format
+		bool saveWaterLevel; // Flag whether to add the water level grid to files in the tiled grid format
+		bool saveSnow; // Flag whether to add the snow grid to files in the tiled grid format
+		bool postUpdateFile; // Flag whether to upload the saved file as the body of the update message instead of the configured message
 		
 		/* Constructors and destructors: */
 		Configuration(void); // Creates default configuration
@@ -66,6 +95,7 @@ class BathymetrySaverToolFactory:public Vrui::ToolFactory
 	Configuration configuration; // Default configuration for all tools
 	WaterTable2* waterTable; // Pointer to water table object from which to request bathymetry grids
 	GLsizei gridSize[2]; // Width and height of the water table's bathymetry grid
+	GLsizei quantitySize[2]; // Width and height of the water table's water level and snow grids
 	GLfloat cellSize[2]; // Width and height of each water table cell
 	
 	/* Constructors and destructors: */
@@ -84,16 +114,34 @@ class BathymetrySaverTool:public Vrui::Tool,public Vrui::Application::Tool<Sandb
 	{
 	friend class BathymetrySaverToolFactory;
 	
-	/* Elements: */
+	/* Embedded classes: */
 	private:
+	struct GridBuffers // Structure holding one set of read-back grids to be saved
+		{
+		/* Elements: */
+		public:
+		GLfloat* bathymetry; // Bathymetry grid
+		GLfloat* waterLevel; // Water level grid
+		GLfloat* snow; // Snow amount grid
+		};
+	
+	/* Elements: */
 	static BathymetrySaverToolFactory* factory; // Pointer to the factory object for this class
 	BathymetrySaverToolFactory::Configuration configuration; // Configuration of this tool
-	GLfloat* bathymetryBuffer; // Bathymetry grid buffer
+	GridBuffers gridBuffers[2]; // Double buffer of grids, so a new read-back can arrive while the previous one is being saved
+	Threads::MutexCond exportCond; // Condition variable protecting the grid buffer states and signaling the export thread
+	int pendingBuffer; // Index of the grid buffer waiting to be saved, or -1
+	int exportingBuffer; // Index of the grid buffer currently being saved, or -1
+	volatile bool runExportThread; // Flag to keep the export thread running
+	Threads::Thread exportThread; // Thread saving grids and posting update messages
 	
 	/* Private methods: */
-	void writeDEMFile(void) const; // Writes the bathymetry grid to a file in USGS DEM format
+	void writeDEMFile(const GridBuffers& grids) const; // Writes the bathymetry grid to a file in USGS DEM format
+	void writeTiledLayer(IO::File& file,Misc::UInt32 layerType,const GLfloat* grid,const GLsizei size[2]) const; // Writes a grid as a layer of a tiled grid file
+	void writeTiledFile(const GridBuffers& grids) const; // Writes the configured grids to a file in the tiled grid format
 	void postUpdate(void) const; // Sends an update message to a web server
-	static void readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData); // Callback when a grid has been read back from the GPU
+	void* exportThreadMethod(void); // Method saving grids in the background
+	static void readBackCallback(const GLfloat* bathymetry,const GLfloat* waterLevel,const GLfloat* snow,void* userData); // Callback when grids have been read back from the GPU; called from the grid read-back's completion thread
 	
 	/* Constructors and destructors: */
 	public:
@@ -140,13 +140,313 @@ void CalibrateProjector::diskExtractionCallback(const Kinect::DiskExtractor::Dis
 	Vrui::requestUpdate();
 	}
 
+bool CalibrateProjector::calcHomography(const std::vector<CalibrateProjector::TiePoint>& tiePoints,const std::vector<size_t>& indices,Math::Matrix& hom)
+	{
+	/* Create the least-squares system: */
+	Math::Matrix a(12,12,0.0);
+	
+	/* Process all selected tie points: */
+	for(std::vector<size_t>::const_iterator iIt=indices.begin();iIt!=indices.end();++iIt)
+		{
+		const TiePoint& tp=tiePoints[*iIt];
+		
+		/* Create the tie point's associated two linear equations: */
+		double eq[2][12];
+		eq[0][0]=tp.o[0];
+		eq[0][1]=tp.o[1];
+		eq[0][2]=tp.o[2];
+		eq[0][3]=1.0;
+		eq[0][4]=0.0;
+		eq[0][5]=0.0;
+		eq[0][6]=0.0;
+		eq[0][7]=0.0;
+		eq[0][8]=-tp.p[0]*tp.o[0];
+		eq[0][9]=-tp.p[0]*tp.o[1];
+		eq[0][10]=-tp.p[0]*tp.o[2];
+		eq[0][11]=-tp.p[0];
+		
+		eq[1][0]=0.0;
+		eq[1][1]=0.0;
+		eq[1][2]=0.0;
+		eq[1][3]=0.0;
+		eq[1][4]=tp.o[0];
+		eq[1][5]=tp.o[1];
+		eq[1][6]=tp.o[2];
+		eq[1][7]=1.0;
+		eq[1][8]=-tp.p[1]*tp.o[0];
+		eq[1][9]=-tp.p[1]*tp.o[1];
+		eq[1][10]=-tp.p[1]*tp.o[2];
+		eq[1][11]=-tp.p[1];
+		
+		/* Insert the two equations into the least-squares system: */
+		for(int row=0;row<2;++row)
+			{
+			for(unsigned int i=0;i<12;++i)
+				for(unsigned int j=0;j<12;++j)
+					a(i,j)+=eq[row][i]*eq[row][j];
+			}
+		}
+	
+	/* Find the least square system's smallest eigenvalue: */
+	std::pair<Math::Matrix,Math::Matrix> qe=a.jacobiIteration();
+	unsigned int minEIndex=0;
+	double minE=Math::abs(qe.second(0,0));
+	for(unsigned int i=1;i<12;++i)
+		{
+		if(minE>Math::abs(qe.second(i,0)))
+			{
+			minEIndex=i;
+			minE=Math::abs(qe.second(i,0));
+			}
+		}
+	
+	/* Create the initial unscaled homography: */
+	for(int i=0;i<3;++i)
+		for(int j=0;j<4;++j)
+			hom(i,j)=qe.first(i*4+j,minEIndex);
+	
+	/* Scale the homography such that projected weights are positive distance from projector: */
+	double wLen=Math::sqrt(Math::sqr(hom(2,0))+Math::sqr(hom(2,1))+Math::sqr(hom(2,2)));
+	size_t numNegativeWeights=0;
+	for(std::vector<size_t>::const_iterator iIt=indices.begin();iIt!=indices.end();++iIt)
+		{
+		/* Calculate the object-space tie point's projected weight: */
+		double w=hom(2,3);
+		for(int j=0;j<3;++j)
+			w+=hom(2,j)*tiePoints[*iIt].o[j];
+		if(w<0.0)
+			++numNegativeWeights;
+		}
+	if(numNegativeWeights!=0&&numNegativeWeights!=indices.size())
+		return false;
+	if(numNegativeWeights>0)
+		wLen=-wLen;
+	for(int i=0;i<3;++i)
+		for(int j=0;j<4;++j)
+			hom(i,j)/=wLen;
+	
+	return true;
+	}
+
+double CalibrateProjector::calcReprojectionError(const Math::Matrix& hom,const CalibrateProjector::TiePoint& tiePoint)
+	{
+	/* Project the object-space point with the homography: */
+	double pp[3];
+	for(int i=0;i<3;++i)
+		{
+		pp[i]=hom(i,3);
+		for(int j=0;j<3;++j)
+			pp[i]+=hom(i,j)*tiePoint.o[j];
+		}
+	
+	return Math::sqrt(Math::sqr(pp[0]/pp[2]-tiePoint.p[0])+Math::sqr(pp[1]/pp[2]-tiePoint.p[1]));
+	}
+
+Math::Interval<double> CalibrateProjector::calcProjection(const Math::Matrix& hom,const std::vector<CalibrateProjector::TiePoint>& tiePoints,const std::vector<size_t>& indices,Math::Matrix& newProjection) const
+	{
+	/* Calculate the full projector projection matrix: */
+	for(unsigned int i=0;i<2;++i)
+		for(unsigned int j=0;j<4;++j)
+			newProjection(i,j)=hom(i,j);
+	for(unsigned int j=0;j<3;++j)
+		newProjection(2,j)=0.0;
+	newProjection(2,3)=-1.0;
+	for(unsigned int j=0;j<4;++j)
+		newProjection(3,j)=hom(2,j);
+	
+	/* Calculate the z range of all tie points: */
+	Math::Interval<double> zRange=Math::Interval<double>::empty;
+	for(std::vector<size_t>::const_iterator iIt=indices.begin();iIt!=indices.end();++iIt)
+		{
+		/* Transform the object-space tie point with the projection matrix: */
+		Math::Matrix op(4,1);
+		for(int i=0;i<3;++i)
+			op(i)=double(tiePoints[*iIt].o[i]);
+		op(3)=1.0;
+		Math::Matrix pp=newProjection*op;
+		zRange.addValue(pp(2)/pp(3));
+		}
+	
+	/* Double the size of the range to include a safety margin on either side: */
+	Math::Interval<double> clipRange(zRange.getMin()*2.0,zRange.getMax()*0.5);
+	
+	/* Pre-multiply the projection matrix with the inverse viewport matrix to go to clip coordinates: */
+	Math::Matrix invViewport(4,4,1.0);
+	invViewport(0,0)=2.0/double(imageSize[0]);
+	invViewport(0,3)=-1.0;
+	invViewport(1,1)=2.0/double(imageSize[1]);
+	invViewport(1,3)=-1.0;
+	invViewport(2,2)=2.0/(clipRange.getSize());
+	invViewport(2,3)=-2.0*clipRange.getMin()/(clipRange.getSize())-1.0;
+	newProjection=invViewport*newProjection;
+	
+	return zRange;
+	}
+
+void CalibrateProjector::saveProjection(void) const
+	{
+	/* Write the projection matrix to a file: */
+	IO::FilePtr projFile=IO::openFile(projectionMatrixFileName.c_str(),IO::File::WriteOnly);
+	projFile->setEndianness(Misc::LittleEndian);
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+			projFile->write<double>(projection(i,j));
+	}
+
+void CalibrateProjector::solveCalibration(const std::vector<CalibrateProjector::TiePoint>& tiePoints,Math::Matrix& hom,bool haveHom,unsigned int& randomSeed,CalibrateProjector::CalibrationResult& result) const
+	{
+	static const size_t sampleSize=8; // Number of tie points at distinct projector positions in each random sample; six determine a homography
+	
+	/* Start from the previous homography, which makes the solve incremental as tie points accumulate: */
+	size_t numTiePoints=tiePoints.size();
+	std::vector<bool> inliers(numTiePoints,false);
+	size_t numInliers=0;
+	if(haveHom)
+		{
+		for(size_t i=0;i<numTiePoints;++i)
+			if((inliers[i]=calcReprojectionError(hom,tiePoints[i])<=ransacThreshold))
+				++numInliers;
+		}
+	
+	/* Test random hypotheses from samples of tie points at distinct projector positions: */
+	Math::Matrix sampleHom(3,4);
+	std::vector<size_t> sample;
+	std::vector<bool> sampleInliers(numTiePoints);
+	for(unsigned int iteration=0;iteration<numRansacIterations&&numTiePoints>=sampleSize;++iteration)
+		{
+		/* Draw a sample, giving up if there are not enough distinct projector positions: */
+		sample.clear();
+		for(unsigned int draw=0;draw<sampleSize*10&&sample.size()<sampleSize;++draw)
+			{
+			size_t candidate=size_t(rand_r(&randomSeed))%numTiePoints;
+			bool distinct=true;
+			for(std::vector<size_t>::iterator sIt=sample.begin();sIt!=sample.end()&&distinct;++sIt)
+				distinct=tiePoints[*sIt].p[0]!=tiePoints[candidate].p[0]||tiePoints[*sIt].p[1]!=tiePoints[candidate].p[1];
+			if(distinct)
+				sample.push_back(candidate);
+			}
+		if(sample.size()<sampleSize||!calcHomography(tiePoints,sample,sampleHom))
+			continue;
+		
+		/* Count the tie points consistent with the hypothesis: */
+		size_t numSampleInliers=0;
+		for(size_t i=0;i<numTiePoints;++i)
+			if((sampleInliers[i]=calcReprojectionError(sampleHom,tiePoints[i])<=ransacThreshold))
+				++numSampleInliers;
+		if(numInliers<numSampleInliers)
+			{
+			hom=sampleHom;
+			inliers.swap(sampleInliers);
+			numInliers=numSampleInliers;
+			}
+		}
+	
+	result.valid=numInliers>=sampleSize;
+	if(result.valid)
+		{
+		/* Refine the best hypothesis by least squares over its consistent tie points, and update the consistent set: */
+		std::vector<size_t> inlierIndices;
+		for(int pass=0;pass<2&&result.valid;++pass)
+			{
+			inlierIndices.clear();
+			for(size_t i=0;i<numTiePoints;++i)
+				if(inliers[i])
+					inlierIndices.push_back(i);
+			result.valid=calcHomography(tiePoints,inlierIndices,sampleHom);
+			if(result.valid)
+				{
+				hom=sampleHom;
+				numInliers=0;
+				for(size_t i=0;i<numTiePoints;++i)
+					if((inliers[i]=calcReprojectionError(hom,tiePoints[i])<=ransacThreshold))
+						++numInliers;
+				result.valid=numInliers>=sampleSize;
+				}
+			}
+		}
+	
+	if(result.valid)
+		{
+		/* Calculate the RMS reprojection error of the consistent tie points: */
+		std::vector<size_t> inlierIndices;
+		double res=0.0;
+		for(size_t i=0;i<numTiePoints;++i)
+			if(inliers[i])
+				{
+				inlierIndices.push_back(i);
+				res+=Math::sqr(calcReprojectionError(hom,tiePoints[i]));
+				}
+		result.residual=Math::sqrt(res/double(inlierIndices.size()));
+		result.numInliers=inlierIndices.size();
+		
+		/* Calculate the projection matrix: */
+		Math::Matrix newProjection(4,4);
+		calcProjection(hom,tiePoints,inlierIndices,newProjection);
+		for(int i=0;i<4;++i)
+			for(int j=0;j<4;++j)
+				result.projection[i][j]=newProjection(i,j);
+		}
+	else
+		{
+		result.residual=0.0;
+		result.numInliers=0;
+		}
+	result.tiePoints=tiePoints;
+	result.inliers.swap(inliers);
+	}
+
+void* CalibrateProjector::solverThreadMethod(void)
+	{
+	/* Keep the most recent homography across solves: */
+	Math::Matrix hom(3,4);
+	bool haveHom=false;
+	unsigned int randomSeed=1U;
+	
+	while(true)
+		{
+		/* Wait for new tie points: */
+		std::vector<TiePoint> tiePoints;
+		{
+		Threads::Mutex::Lock solverLock(solverMutex);
+		while(runSolverThread&&!solverHaveNewTiePoints)
+			solverCond.wait(solverMutex);
+		if(!runSolverThread)
+			break;
+		tiePoints.swap(solverTiePoints);
+		solverHaveNewTiePoints=false;
+		}
+		
+		/* Solve for a new calibration and hand it to the main thread: */
+		CalibrationResult& result=calibrationResults.startNewValue();
+		solveCalibration(tiePoints,hom,haveHom,randomSeed,result);
+		haveHom=haveHom||result.valid;
+		calibrationResults.postNewValue();
+		Vrui::requestUpdate();
+		}
+	
+	return 0;
+	}
+
+void CalibrateProjector::postTiePoints(void)
+	{
+	/* Replace the background solver's tie points and wake it up: */
+	Threads::Mutex::Lock solverLock(solverMutex);
+	solverTiePoints=tiePoints;
+	solverHaveNewTiePoints=true;
+	solverCond.signal();
+	}
+
 CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 	:Vrui::Application(argc,argv),
 	 numTiePointFrames(60),numBackgroundFrames(120),
 	 camera(0),diskExtractor(0),projector(0),
 	 capturingBackground(false),capturingTiePoint(false),numCaptureFrames(0),
+	 continuousCapture(false),numDwellFrames(10),maxDwellMotion(0.5),minTargetDistance(5.0),
+	 numStableFrames(0),lastDiskCenter(OPoint::origin),haveLastTiePoint(false),lastTiePointCenter(OPoint::origin),
 	 tiePointIndex(0),
-	 haveProjection(false),projection(4,4)
+	 haveProjection(false),projection(4,4),
+	 numRansacIterations(200),ransacThreshold(3.0),
+	 solverHaveNewTiePoints(false),runSolverThread(true)
 	{
 	/* Register the custom tool class: */
 	CaptureToolFactory* toolFactory1=new CaptureToolFactory("CaptureTool","Capture",0,*Vrui::getToolManager());
@@ -238,6 +538,14 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 				if(i<argc)
 					projectionMatrixFileName=argv[i];
 				}
+			else if(strcasecmp(argv[i]+1,"cc")==0)
+				continuousCapture=true;
+			else if(strcasecmp(argv[i]+1,"rt")==0)
+				{
+				++i;
+				if(i<argc)
+					ransacThreshold=atof(argv[i]);
+				}
 			}
 		}
 	
@@ -274,6 +582,14 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 		std::cout<<"  -pmf <projection matrix file name>"<<std::endl;
 		std::cout<<"     Saves the calibration matrix to the file of the given name"<<std::endl;
 		std::cout<<"     Default: "<<CONFIG_CONFIGDIR<<'/'<<CONFIG_DEFAULTPROJECTIONMATRIXFILENAME<<std::endl;
+		std::cout<<"  -cc"<<std::endl;
+		std::cout<<"     Captures tie points continuously: a tie point is captured whenever"<<std::endl;
+		std::cout<<"     the disk comes to rest away from the previous one, and a robust"<<std::endl;
+		std::cout<<"     calibration is solved in the background after every tie point"<<std::endl;
+		std::cout<<"  -rt <reprojection threshold>"<<std::endl;
+		std::cout<<"     Maximum reprojection error in projector pixels of tie points"<<std::endl;
+		std::cout<<"     considered consistent by the continuous capture mode's solver"<<std::endl;
+		std::cout<<"     Default: 3.0"<<std::endl;
 		}
 	
 	/* Read the sandbox layout file: */
@@ -385,6 +701,14 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 	#endif
 	camera->startStreaming(Misc::createFunctionCall(projector,&Kinect::ProjectorType::setColorFrame),Misc::createFunctionCall(this,&CalibrateProjector::depthStreamingCallback));
 	
+	if(continuousCapture)
+		{
+		/* Start the background solver and hand it any initial tie points: */
+		solverThread.start(this,&CalibrateProjector::solverThreadMethod);
+		if(!tiePoints.empty())
+			postTiePoints();
+		}
+	
 	/* Start capturing the initial background frame: */
 	startBackgroundCapture();
 	}
@@ -395,6 +719,17 @@ CalibrateProjector::~CalibrateProjector(void)
 	camera->stopStreaming();
 	diskExtractor->stopStreaming();
 	
+	if(continuousCapture)
+		{
+		{
+		/* Shut down the background solver: */
+		Threads::Mutex::Lock solverLock(solverMutex);
+		runSolverThread=false;
+		solverCond.signal();
+		}
+		solverThread.join();
+		}
+	
 	/* Clean up: */
 	delete diskExtractor;
 	delete projector;
@@ -403,20 +738,18 @@ CalibrateProjector::~CalibrateProjector(void)
 
 void CalibrateProjector::frame(void)
 	{
-	/* Check if we are capturing a tie point and there is a new list of extracted disks: */
-	if(diskList.lockNewValue()&&capturingTiePoint&&diskList.getLockedValue().size()==1)
+	/* Check if there is a new list of extracted disks: */
+	if(diskList.lockNewValue())
 		{
-		/* Access the only extracted disk: */
-		const Kinect::DiskExtractor::Disk& disk=diskList.getLockedValue().front();
-		
-		/* Check if there is a real disk center position: */
-		bool diskValid=true;
-		for(int i=0;i<3;++i)
-			diskValid=diskValid&&Math::isFinite(disk.center[i]);
+		/* Check if there is exactly one extracted disk with a real center position: */
+		bool diskValid=diskList.getLockedValue().size()==1;
+		for(int i=0;i<3&&diskValid;++i)
+			diskValid=Math::isFinite(diskList.getLockedValue().front().center[i]);
 		
 		#if 0
 		
 		/* Check if the disk is inside the sandbox area: */
+		const Kinect::DiskExtractor::Disk& disk=diskList.getLockedValue().front();
 		diskValid=diskValid&&(basePlane.getNormal()^(basePlaneCorners[1]-basePlaneCorners[0]))*(disk.center-basePlaneCorners[0])>=0.0;
 		diskValid=diskValid&&(basePlane.getNormal()^(basePlaneCorners[3]-basePlaneCorners[1]))*(disk.center-basePlaneCorners[1])>=0.0;
 		diskValid=diskValid&&(basePlane.getNormal()^(basePlaneCorners[2]-basePlaneCorners[3]))*(disk.center-basePlaneCorners[3])>=0.0;
@@ -424,8 +757,11 @@ void CalibrateProjector::frame(void)
 		
 		#endif
 		
-		if(diskValid)
+		if(diskValid&&capturingTiePoint)
 			{
+			/* Access the only extracted disk: */
+			const Kinect::DiskExtractor::Disk& disk=diskList.getLockedValue().front();
+			
 			/* Store the just-captured tie point: */
 			TiePoint tp;
 			int xIndex=tiePointIndex%numTiePoints[0];
@@ -445,14 +781,57 @@ void CalibrateProjector::frame(void)
 				capturingTiePoint=false;
 				++tiePointIndex;
 				
-				/* Check if the calibration is complete: */
-				if(tiePointIndex>=numTiePoints[0]*numTiePoints[1])
+				if(continuousCapture)
+					{
+					/* Wait for the disk to move on to the next target, and update the calibration in the background: */
+					haveLastTiePoint=true;
+					lastTiePointCenter=disk.center;
+					numStableFrames=0;
+					postTiePoints();
+					}
+				else if(tiePointIndex>=numTiePoints[0]*numTiePoints[1])
 					{
 					/* Calculate the calibration transformation: */
 					calcCalibration();
 					}
 				}
 			}
+		else if(diskValid&&continuousCapture&&!capturingBackground)
+			{
+			/* Check if the disk is at rest away from the most recently captured tie point: */
+			const Kinect::DiskExtractor::Disk& disk=diskList.getLockedValue().front();
+			bool atRest=Geometry::dist(disk.center,lastDiskCenter)<=maxDwellMotion;
+			lastDiskCenter=disk.center;
+			if(!atRest||(haveLastTiePoint&&Geometry::dist(disk.center,lastTiePointCenter)<minTargetDistance))
+				numStableFrames=0;
+			else if(++numStableFrames>=numDwellFrames)
+				{
+				/* Capture a tie point at the current target: */
+				numStableFrames=0;
+				startTiePointCapture();
+				}
+			}
+		else
+			numStableFrames=0;
+		}
+	
+	/* Check if the background solver produced a new calibration: */
+	if(continuousCapture&&calibrationResults.lockNewValue())
+		{
+		const CalibrationResult& result=calibrationResults.getLockedValue();
+		if(result.valid)
+			{
+			/* Install the new projection matrix: */
+			for(int i=0;i<4;++i)
+				for(int j=0;j<4;++j)
+					projection(i,j)=result.projection[i][j];
+			haveProjection=true;
+			std::cout<<"CalibrateProjector: "<<result.numInliers<<" of "<<result.tiePoints.size()<<" tie points consistent, RMS reprojection error "<<result.residual<<" pixels"<<std::endl;
+			
+			/* Save the calibration once tie points have been captured at all target positions: */
+			if(tiePointIndex>=numTiePoints[0]*numTiePoints[1])
+				saveProjection();
+			}
 		}
 	
 	/* Update the projector: */
@@ -576,6 +955,27 @@ void CalibrateProjector::display(GLContextData& contextData) const
 		glVertex2f(float(x)+0.5f,float(imageSize[1]));
 		glEnd();
 		
+		if(continuousCapture&&haveProjection)
+			{
+			/* Draw the reprojection errors of the tie points used by the most recent background calibration, green if consistent and red otherwise: */
+			const CalibrationResult& result=calibrationResults.getLockedValue();
+			glBegin(GL_LINES);
+			for(size_t i=0;i<result.tiePoints.size();++i)
+				{
+				const TiePoint& tp=result.tiePoints[i];
+				double pp[4];
+				for(int j=0;j<4;++j)
+					pp[j]=projection(j,0)*tp.o[0]+projection(j,1)*tp.o[1]+projection(j,2)*tp.o[2]+projection(j,3);
+				if(result.inliers[i])
+					glColor3f(0.0f,1.0f,0.0f);
+				else
+					glColor3f(1.0f,0.0f,0.0f);
+				glVertex2d(tp.p[0],tp.p[1]);
+				glVertex2d((pp[0]/pp[3]+1.0)*double(imageSize[0])/2.0,(pp[1]/pp[3]+1.0)*double(imageSize[1])/2.0);
+				}
+			glEnd();
+			}
+		
 		if(haveProjection)
 			{
 			/* Draw all currently extracted disks using the current calibration: */
@@ -639,92 +1039,13 @@ void CalibrateProjector::startTiePointCapture(void)
 
 void CalibrateProjector::calcCalibration(void)
 	{
-	/* Create the least-squares system: */
-	Math::Matrix a(12,12,0.0);
-	
-	/* Process all tie points: */
-	for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
-		{
-		// DEBUGGING
-		// std::cout<<"Tie point: "<<tpIt->p[0]<<", "<<tpIt->p[1]<<", "<<tpIt->o[0]<<", "<<tpIt->o[1]<<", "<<tpIt->o[2]<<std::endl;
-		
-		/* Create the tie point's associated two linear equations: */
-		double eq[2][12];
-		eq[0][0]=tpIt->o[0];
-		eq[0][1]=tpIt->o[1];
-		eq[0][2]=tpIt->o[2];
-		eq[0][3]=1.0;
-		eq[0][4]=0.0;
-		eq[0][5]=0.0;
-		eq[0][6]=0.0;
-		eq[0][7]=0.0;
-		eq[0][8]=-tpIt->p[0]*tpIt->o[0];
-		eq[0][9]=-tpIt->p[0]*tpIt->o[1];
-		eq[0][10]=-tpIt->p[0]*tpIt->o[2];
-		eq[0][11]=-tpIt->p[0];
-		
-		eq[1][0]=0.0;
-		eq[1][1]=0.0;
-		eq[1][2]=0.0;
-		eq[1][3]=0.0;
-		eq[1][4]=tpIt->o[0];
-		eq[1][5]=tpIt->o[1];
-		eq[1][6]=tpIt->o[2];
-		eq[1][7]=1.0;
-		eq[1][8]=-tpIt->p[1]*tpIt->o[0];
-		eq[1][9]=-tpIt->p[1]*tpIt->o[1];
-		eq[1][10]=-tpIt->p[1]*tpIt->o[2];
-		eq[1][11]=-tpIt->p[1];
-		
-		/* Insert the two equations into the least-squares system: */
-		for(int row=0;row<2;++row)
-			{
-			for(unsigned int i=0;i<12;++i)
-				for(unsigned int j=0;j<12;++j)
-					a(i,j)+=eq[row][i]*eq[row][j];
-			}
-		}
-	
-	/* Find the least square system's smallest eigenvalue: */
-	std::pair<Math::Matrix,Math::Matrix> qe=a.jacobiIteration();
-	unsigned int minEIndex=0;
-	double minE=Math::abs(qe.second(0,0));
-	for(unsigned int i=1;i<12;++i)
-		{
-		if(minE>Math::abs(qe.second(i,0)))
-			{
-			minEIndex=i;
-			minE=Math::abs(qe.second(i,0));
-			}
-		}
-	
-	/* Create the initial unscaled homography: */
+	/* Calculate the homography from all tie points: */
+	std::vector<size_t> indices;
+	for(size_t i=0;i<tiePoints.size();++i)
+		indices.push_back(i);
 	Math::Matrix hom(3,4);
-	for(int i=0;i<3;++i)
-		for(int j=0;j<4;++j)
-			hom(i,j)=qe.first(i*4+j,minEIndex);
-	
-	/* Scale the homography such that projected weights are positive distance from projector: */
-	double wLen=Math::sqrt(Math::sqr(hom(2,0))+Math::sqr(hom(2,1))+Math::sqr(hom(2,2)));
-	int numNegativeWeights=0;
-	for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
+	if(calcHomography(tiePoints,indices,hom))
 		{
-		/* Calculate the object-space tie point's projected weight: */
-		double w=hom(2,3);
-		for(int j=0;j<3;++j)
-			w+=hom(2,j)*tpIt->o[j];
-		if(w<0.0)
-			++numNegativeWeights;
-		}
-	if(numNegativeWeights==0||numNegativeWeights==int(tiePoints.size()))
-		{
-		/* Scale the homography: */
-		if(numNegativeWeights>0)
-			wLen=-wLen;
-		for(int i=0;i<3;++i)
-			for(int j=0;j<4;++j)
-				hom(i,j)/=wLen;
-		
 		/* Print the scaled homography: */
 		for(int i=0;i<3;++i)
 			{
@@ -737,67 +1058,16 @@ void CalibrateProjector::calcCalibration(void)
 		/* Calculate the calibration residual: */
 		double res=0.0;
 		for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
-			{
-			Math::Matrix op(4,1);
-			for(int i=0;i<3;++i)
-				op(i)=tpIt->o[i];
-			op(3)=1.0;
-			
-			Math::Matrix pp=hom*op;
-			for(int i=0;i<2;++i)
-				pp(i)/=pp(2);
-			
-			res+=Math::sqr(pp(0)-tpIt->p[0])+Math::sqr(pp(1)-tpIt->p[1]);
-			}
+			res+=Math::sqr(calcReprojectionError(hom,*tpIt));
 		res=Math::sqrt(res/double(tiePoints.size()));
 		std::cout<<"RMS calibration residual: "<<res<<std::endl;
 		
 		/* Calculate the full projector projection matrix: */
-		for(unsigned int i=0;i<2;++i)
-			for(unsigned int j=0;j<4;++j)
-				projection(i,j)=hom(i,j);
-		for(unsigned int j=0;j<3;++j)
-			projection(2,j)=0.0;
-		projection(2,3)=-1.0;
-		for(unsigned int j=0;j<4;++j)
-			projection(3,j)=hom(2,j);
-		
-		/* Calculate the z range of all tie points: */
-		Math::Interval<double> zRange=Math::Interval<double>::empty;
-		int numNegativeWeights=0;
-		for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
-			{
-			/* Transform the object-space tie point with the projection matrix: */
-			Math::Matrix op(4,1);
-			for(int i=0;i<3;++i)
-				op(i)=double(tpIt->o[i]);
-			op(3)=1.0;
-			Math::Matrix pp=projection*op;
-			if(pp(3)<0.0)
-				++numNegativeWeights;
-			zRange.addValue(pp(2)/pp(3));
-			}
+		Math::Interval<double> zRange=calcProjection(hom,tiePoints,indices,projection);
 		std::cout<<"Z range of collected tie points: ["<<zRange.getMin()<<", "<<zRange.getMax()<<"]"<<std::endl;
 		
-		/* Double the size of the range to include a safety margin on either side: */
-		zRange=Math::Interval<double>(zRange.getMin()*2.0,zRange.getMax()*0.5);
-		
-		/* Pre-multiply the projection matrix with the inverse viewport matrix to go to clip coordinates: */
-		Math::Matrix invViewport(4,4,1.0);
-		invViewport(0,0)=2.0/double(imageSize[0]);
-		invViewport(0,3)=-1.0;
-		invViewport(1,1)=2.0/double(imageSize[1]);
-		invViewport(1,3)=-1.0;
-		invViewport(2,2)=2.0/(zRange.getSize());
-		invViewport(2,3)=-2.0*zRange.getMin()/(zRange.getSize())-1.0;
-		projection=invViewport*projection;
-		
 		/* Write the projection matrix to a file: */
-		IO::FilePtr projFile=IO::openFile(projectionMatrixFileName.c_str(),IO::File::WriteOnly);
-		projFile->setEndianness(Misc::LittleEndian);
-		for(int i=0;i<4;++i)
-			for(int j=0;j<4;++j)
-				projFile->write<double>(projection(i,j));
+		saveProjection();
 		
 		haveProjection=true;
 		}
@@ -24,7 +24,11 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #define CALIBRATEPROJECTOR_INCLUDED
 
 #include <vector>
+#include <Threads/Mutex.h>
+#include <Threads/Cond.h>
+#include <Threads/Thread.h>
 #include <Threads/TripleBuffer.h>
+#include <Math/Interval.h>
 #include <Math/Matrix.h>
 #include <Geometry/Point.h>
 #include <Geometry/Vector.h>
@@ -66,6 +70,24 @@ class CalibrateProjector:public Vrui::Application
 		OPoint o; // Object-space point
 		};
 	
+	struct CalibrationResult // Result of a robust calibration solved in the background
+		{
+		/* Elements: */
+		public:
+		bool valid; // Flag whether the solve produced a calibration
+		size_t numInliers; // Number of tie points consistent with the calibration
+		double residual; // RMS reprojection error of the consistent tie points in projector pixels
+		double projection[4][4]; // Projection matrix from camera space into projector clip space
+		std::vector<TiePoint> tiePoints; // Tie points that were used by the solve
+		std::vector<bool> inliers; // Flags whether each tie point is consistent with the calibration
+		
+		/* Constructors and destructors: */
+		CalibrationResult(void)
+			:valid(false),numInliers(0),residual(0.0)
+			{
+			}
+		};
+	
 	class CaptureTool;
 	typedef Vrui::GenericToolFactory<CaptureTool> CaptureToolFactory; // Tool class uses the generic factory class
 	
@@ -104,6 +126,14 @@ class CalibrateProjector:public Vrui::Application
 	bool capturingBackground; // Flag if the 3D camera is currently capturing a background frame
 	bool capturingTiePoint; // Flag whether the main thread is currently capturing a tie point
 	unsigned int numCaptureFrames; // Number of background or tie point frames still to capture
+	bool continuousCapture; // Flag whether tie points are captured automatically whenever the disk comes to rest at a new position
+	unsigned int numDwellFrames; // Number of consecutive frames the disk must be at rest before a tie point is captured automatically
+	Scalar maxDwellMotion; // Maximum distance the disk center may move between frames while at rest
+	Scalar minTargetDistance; // Minimum distance the disk must move away from the last captured tie point before the next one is captured automatically
+	unsigned int numStableFrames; // Number of consecutive frames the disk has been at rest
+	OPoint lastDiskCenter; // Disk center in the most recent frame
+	bool haveLastTiePoint; // Flag whether a tie point has been captured automatically
+	OPoint lastTiePointCenter; // Disk center of the most recently captured tie point
 	
 	Threads::TripleBuffer<Kinect::DiskExtractor::DiskList> diskList; // Triple buffer of lists of extracted disks
 	std::vector<TiePoint> tiePoints; // List of collected calibration tie points
@@ -111,6 +141,16 @@ class CalibrateProjector:public Vrui::Application
 	bool haveProjection; // Flag if a projection matrix has been computed
 	Math::Matrix projection; // The current projection matrix
 	
+	unsigned int numRansacIterations; // Number of random hypotheses tested by each background calibration solve
+	double ransacThreshold; // Maximum reprojection error in projector pixels of a tie point consistent with a calibration
+	Threads::Mutex solverMutex; // Mutex protecting the background solver's input state
+	Threads::Cond solverCond; // Condition variable to wake up the background solver when new tie points arrive
+	std::vector<TiePoint> solverTiePoints; // Most recent set of tie points handed to the background solver
+	bool solverHaveNewTiePoints; // Flag whether the background solver has not yet seen the most recent tie points
+	bool runSolverThread; // Flag to shut down the background solver
+	Threads::Thread solverThread; // Thread solving for calibrations in the background
+	Threads::TripleBuffer<CalibrationResult> calibrationResults; // Triple buffer of background calibration results
+	
 	std::string projectionMatrixFileName; // Name of the file to which the projection matrix is saved
 	
 	/* Private methods: */
@@ -120,6 +160,13 @@ class CalibrateProjector:public Vrui::Application
 	#endif
 	void backgroundCaptureCompleteCallback(Kinect::DirectFrameSource& camera); // Callback when the 3D camera is done capturing a background image
 	void diskExtractionCallback(const Kinect::DiskExtractor::DiskList& disks); // Called when a new list of disks has been extracted
+	static bool calcHomography(const std::vector<TiePoint>& tiePoints,const std::vector<size_t>& indices,Math::Matrix& hom); // Calculates a least-squares 3x4 homography from the tie points of the given indices; returns false if tie points lie on both sides of the projector
+	static double calcReprojectionError(const Math::Matrix& hom,const TiePoint& tiePoint); // Returns the distance in projector pixels between the tie point's projection-space point and its reprojected object-space point
+	Math::Interval<double> calcProjection(const Math::Matrix& hom,const std::vector<TiePoint>& tiePoints,const std::vector<size_t>& indices,Math::Matrix& newProjection) const; // Calculates a projection matrix into clip space from the given homography and returns the z range of the tie points of the given indices
+	void saveProjection(void) const; // Writes the current projection matrix to the projection matrix file
+	void solveCalibration(const std::vector<TiePoint>& tiePoints,Math::Matrix& hom,bool haveHom,unsigned int& randomSeed,CalibrationResult& result) const; // Robustly calculates a calibration from the given tie points, starting from and updating the given homography
+	void* solverThreadMethod(void); // Thread method solving for calibrations whenever new tie points arrive
+	void postTiePoints(void); // Hands the current set of tie points to the background solver
 	
 	/* Constructors and destructors: */
 	public:
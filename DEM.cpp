@@ -22,6 +22,14 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "DEM.h"
 
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <Misc/ThrowStdErr.h>
+#include <Math/Math.h>
 #include <IO/File.h>
 #include <IO/OpenFile.h>
 #include <GL/gl.h>
@@ -32,12 +40,30 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <Geometry/Matrix.h>
 
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+template <class ValueParam>
+inline ValueParam readValue(const unsigned char*& dataPtr)
+	{
+	/* Read an unaligned little-endian value; tiled DEM files are only mapped on little-endian hosts: */
+	ValueParam result;
+	memcpy(&result,dataPtr,sizeof(ValueParam));
+	dataPtr+=sizeof(ValueParam);
+	return result;
+	}
+
+}
+
 /******************************
 Methods of class DEM::DataItem:
 ******************************/
 
 DEM::DataItem::DataItem(void)
-	:textureObjectId(0)
+	:textureObjectId(0),textureVersion(0)
 	{
 	/* Check for and initialize all required OpenGL extensions: */
 	GLARBTextureFloat::initExtension();
@@ -55,10 +81,167 @@ DEM::DataItem::~DataItem(void)
 	glDeleteTextures(1,&textureObjectId);
 	}
 
+/****************************
+Static elements of class DEM:
+****************************/
+
+const char DEM::tiledFileSignature[8]={'S','B','X','T','D','E','M','\0'};
+
 /********************
 Methods of class DEM:
 ********************/
 
+void DEM::release(void)
+	{
+	/* Release a plain DEM: */
+	delete[] dem;
+	dem=0;
+	
+	/* Release a memory-mapped tiled DEM: */
+	if(fileData!=0)
+		munmap(const_cast<unsigned char*>(fileData),fileSize);
+	fileData=0;
+	fileSize=0;
+	if(fd>=0)
+		close(fd);
+	fd=-1;
+	levels.clear();
+	
+	demSize[0]=demSize[1]=0;
+	textureSize[0]=textureSize[1]=0;
+	}
+
+void DEM::loadTiled(const char* demFileName)
+	{
+	/* Open and map the tiled DEM file: */
+	fd=open(demFileName,O_RDONLY);
+	if(fd<0)
+		Misc::throwStdErr("DEM: Unable to open DEM file %s",demFileName);
+	struct stat fileStats;
+	if(fstat(fd,&fileStats)<0||size_t(fileStats.st_size)<tiledHeaderSize)
+		{
+		release();
+		Misc::throwStdErr("DEM: %s is not a tiled DEM file",demFileName);
+		}
+	fileSize=size_t(fileStats.st_size);
+	void* mapping=mmap(0,fileSize,PROT_READ,MAP_PRIVATE,fd,0);
+	if(mapping==MAP_FAILED)
+		{
+		release();
+		Misc::throwStdErr("DEM: Unable to map DEM file %s",demFileName);
+		}
+	fileData=static_cast<const unsigned char*>(mapping);
+	
+	/* Check the file header: */
+	const unsigned char* dataPtr=fileData+8;
+	if(readValue<Misc::UInt32>(dataPtr)!=tiledFileVersion)
+		{
+		release();
+		Misc::throwStdErr("DEM: %s is not a tiled DEM file of a supported version",demFileName);
+		}
+	
+	/* Read the grid layout and the precomputed elevation statistics: */
+	for(int i=0;i<2;++i)
+		demSize[i]=int(readValue<Misc::UInt32>(dataPtr));
+	for(int i=0;i<4;++i)
+		demBox[i]=Scalar(readValue<Misc::Float64>(dataPtr));
+	tileSize=int(readValue<Misc::UInt32>(dataPtr));
+	unsigned int numLevels=readValue<Misc::UInt32>(dataPtr);
+	for(int i=0;i<2;++i)
+		elevationRange[i]=readValue<Misc::Float32>(dataPtr);
+	averageElevation=float(readValue<Misc::Float64>(dataPtr));
+	if(tileSize<1||numLevels<1||fileSize<tiledHeaderSize+size_t(numLevels)*tiledLevelSize)
+		{
+		release();
+		Misc::throwStdErr("DEM: Malformed header in tiled DEM file %s",demFileName);
+		}
+	
+	/* Read the level table and check that all levels' tiles are inside the file: */
+	size_t tileDataSize=size_t(tileSize)*size_t(tileSize)*sizeof(float);
+	for(unsigned int level=0;level<numLevels;++level)
+		{
+		Level l;
+		for(int i=0;i<2;++i)
+			{
+			l.size[i]=int(readValue<Misc::UInt32>(dataPtr));
+			l.numTiles[i]=(l.size[i]+tileSize-1)/tileSize;
+			}
+		size_t offset=size_t(readValue<Misc::UInt64>(dataPtr));
+		size_t levelDataSize=size_t(l.numTiles[1])*size_t(l.numTiles[0])*tileDataSize;
+		if(l.size[0]<2||l.size[1]<2||offset%sizeof(float)!=0||offset>fileSize||levelDataSize>fileSize-offset)
+			{
+			release();
+			Misc::throwStdErr("DEM: Malformed level %u in tiled DEM file %s",level,demFileName);
+			}
+		l.tiles=reinterpret_cast<const float*>(fileData+offset);
+		levels.push_back(l);
+		}
+	if(levels[0].size[0]!=demSize[0]||levels[0].size[1]!=demSize[1])
+		{
+		release();
+		Misc::throwStdErr("DEM: Mismatching full-resolution level in tiled DEM file %s",demFileName);
+		}
+	}
+
+void DEM::setTextureWindow(unsigned int newLevel,const int newOrigin[2],const int newSize[2])
+	{
+	textureLevel=newLevel;
+	for(int i=0;i<2;++i)
+		{
+		/* Calculate the corner coordinates of the window's first and last grid vertices: */
+		int levelSize=levels.empty()?demSize[i]:levels[textureLevel].size[i];
+		Scalar cellSize=(demBox[2+i]-demBox[i])/Scalar(levelSize-1);
+		textureOrigin[i]=newOrigin[i];
+		textureSize[i]=newSize[i];
+		textureBox[i]=demBox[i]+Scalar(textureOrigin[i])*cellSize;
+		textureBox[2+i]=demBox[i]+Scalar(textureOrigin[i]+textureSize[i]-1)*cellSize;
+		}
+	
+	/* Invalidate the texture objects in all OpenGL contexts: */
+	++textureVersion;
+	
+	/* Update the DEM transformation: */
+	calcMatrix();
+	}
+
+void DEM::uploadTexture(void) const
+	{
+	if(dem!=0)
+		{
+		/* Upload the plain DEM array in one go: */
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,textureSize[0],textureSize[1],0,GL_LUMINANCE,GL_FLOAT,dem);
+		}
+	else if(!levels.empty())
+		{
+		/* Allocate the texture image and upload all tiles overlapping the texture window directly from the memory-mapped file: */
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,textureSize[0],textureSize[1],0,GL_LUMINANCE,GL_FLOAT,0);
+		const Level& l=levels[textureLevel];
+		glPixelStorei(GL_UNPACK_ROW_LENGTH,tileSize);
+		int tileEnd[2];
+		for(int i=0;i<2;++i)
+			tileEnd[i]=(textureOrigin[i]+textureSize[i]-1)/tileSize+1;
+		for(int ty=textureOrigin[1]/tileSize;ty<tileEnd[1];++ty)
+			{
+			int y0=Math::max(ty*tileSize,textureOrigin[1]);
+			int y1=Math::min((ty+1)*tileSize,textureOrigin[1]+textureSize[1]);
+			glPixelStorei(GL_UNPACK_SKIP_ROWS,y0-ty*tileSize);
+			for(int tx=textureOrigin[0]/tileSize;tx<tileEnd[0];++tx)
+				{
+				int x0=Math::max(tx*tileSize,textureOrigin[0]);
+				int x1=Math::min((tx+1)*tileSize,textureOrigin[0]+textureSize[0]);
+				glPixelStorei(GL_UNPACK_SKIP_PIXELS,x0-tx*tileSize);
+				const float* tile=l.tiles+(size_t(ty)*size_t(l.numTiles[0])+size_t(tx))*size_t(tileSize)*size_t(tileSize);
+				glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,x0-textureOrigin[0],y0-textureOrigin[1],x1-x0,y1-y0,GL_LUMINANCE,GL_FLOAT,tile);
+				}
+			}
+		
+		/* Reset the pixel transfer parameters: */
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS,0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS,0);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH,0);
+		}
+	}
+
 void DEM::calcMatrix(void)
 	{
 	/* Convert the DEM transformation into a projective transformation matrix: */
@@ -67,10 +250,10 @@ void DEM::calcMatrix(void)
 	
 	/* Pre-multiply the projective transformation matrix with the DEM space to DEM pixel space transformation: */
 	PTransform dem;
-	dem.getMatrix()(0,0)=Scalar(demSize[0]-1)/(demBox[2]-demBox[0]);
-	dem.getMatrix()(0,3)=Scalar(0.5)-Scalar(demSize[0]-1)/(demBox[2]-demBox[0])*demBox[0];
-	dem.getMatrix()(1,1)=Scalar(demSize[1]-1)/(demBox[3]-demBox[1]);
-	dem.getMatrix()(1,3)=Scalar(0.5)-Scalar(demSize[1]-1)/(demBox[3]-demBox[1])*demBox[1];
+	dem.getMatrix()(0,0)=Scalar(textureSize[0]-1)/(textureBox[2]-textureBox[0]);
+	dem.getMatrix()(0,3)=Scalar(0.5)-Scalar(textureSize[0]-1)/(textureBox[2]-textureBox[0])*textureBox[0];
+	dem.getMatrix()(1,1)=Scalar(textureSize[1]-1)/(textureBox[3]-textureBox[1]);
+	dem.getMatrix()(1,3)=Scalar(0.5)-Scalar(textureSize[1]-1)/(textureBox[3]-textureBox[1])*textureBox[1];
 	dem.getMatrix()(2,2)=Scalar(1)/verticalScale;
 	dem.getMatrix()(2,3)=verticalScaleBase-verticalScaleBase/verticalScale;
 	demTransform.leftMultiply(dem);
@@ -84,15 +267,20 @@ void DEM::calcMatrix(void)
 
 DEM::DEM(void)
 	:dem(0),
+	 fd(-1),fileSize(0),fileData(0),tileSize(0),
+	 averageElevation(0.0f),
+	 textureLevel(0),textureVersion(0),
 	 transform(OGTransform::identity),
 	 verticalScale(1),verticalScaleBase(0)
 	{
 	demSize[0]=demSize[1]=0;
+	elevationRange[0]=elevationRange[1]=0.0f;
+	textureSize[0]=textureSize[1]=0;
 	}
 
 DEM::~DEM(void)
 	{
-	delete[] dem;
+	release();
 	}
 
 void DEM::initContext(GLContextData& contextData) const
@@ -101,20 +289,38 @@ void DEM::initContext(GLContextData& contextData) const
 	DataItem* dataItem=new DataItem;
 	contextData.addDataItem(this,dataItem);
 	
-	/* Upload the DEM array into the texture object: */
+	/* Upload the current DEM window into the texture object: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->textureObjectId);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,demSize[0],demSize[1],0,GL_LUMINANCE,GL_FLOAT,dem);
+	uploadTexture();
+	dataItem->textureVersion=textureVersion;
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	}
 
 void DEM::load(const char* demFileName)
 	{
-	/* Read the DEM file: */
+	/* Release a previously loaded DEM: */
+	release();
+	
+	/* Check whether the DEM file is a tiled DEM file: */
 	IO::FilePtr demFile=IO::openFile(demFileName);
+	char signature[8];
+	demFile->read<char>(signature,8);
+	int origin[2]={0,0};
+	if(memcmp(signature,tiledFileSignature,8)==0)
+		{
+		/* Map the tiled DEM file and start out with its full-resolution level: */
+		demFile=0;
+		loadTiled(demFileName);
+		setTextureWindow(0,origin,demSize);
+		return;
+		}
+	
+	/* Read the plain DEM file: */
+	demFile=IO::openFile(demFileName);
 	demFile->setEndianness(Misc::LittleEndian);
 	demFile->read<int>(demSize,2);
 	dem=new float[demSize[1]*demSize[0]];
@@ -122,20 +328,63 @@ void DEM::load(const char* demFileName)
 		demBox[i]=double(demFile->read<float>());
 	demFile->read<float>(dem,demSize[1]*demSize[0]);
 	
-	/* Update the DEM transformation: */
-	calcMatrix();
-	}
-
-float DEM::calcAverageElevation(void) const
-	{
-	/* Sum all elevation measurements: */
+	/* Calculate the DEM's elevation statistics: */
 	double elevSum=0.0;
+	elevationRange[0]=elevationRange[1]=dem[0];
 	const float* demPtr=dem;
 	for(int i=demSize[1]*demSize[0];i>0;--i,++demPtr)
+		{
 		elevSum+=double(*demPtr);
+		elevationRange[0]=Math::min(elevationRange[0],*demPtr);
+		elevationRange[1]=Math::max(elevationRange[1],*demPtr);
+		}
+	averageElevation=float(elevSum/double(demSize[1]*demSize[0]));
 	
-	/* Return the average elevation: */
-	return float(elevSum/double(demSize[1]*demSize[0]));
+	/* Upload the entire DEM: */
+	setTextureWindow(0,origin,demSize);
+	}
+
+void DEM::setFootprint(const Scalar footprint[4],unsigned int resolution)
+	{
+	/* Plain DEMs are always uploaded in full: */
+	if(levels.empty())
+		return;
+	
+	/* Find the coarsest level that still has the requested number of samples along the footprint's longer side: */
+	int axis=footprint[3]-footprint[1]>footprint[2]-footprint[0]?1:0;
+	Scalar footprintSize=footprint[2+axis]-footprint[axis];
+	unsigned int newLevel=0;
+	for(unsigned int level=1;level<levels.size();++level)
+		{
+		Scalar cellSize=(demBox[2+axis]-demBox[axis])/Scalar(levels[level].size[axis]-1);
+		if(footprintSize<Scalar(resolution)*cellSize)
+			break;
+		newLevel=level;
+		}
+	
+	/* Crop the level's grid to the footprint, with a one-sample margin for interpolation: */
+	int newOrigin[2],newSize[2];
+	for(int i=0;i<2;++i)
+		{
+		int levelSize=levels[newLevel].size[i];
+		Scalar cellSize=(demBox[2+i]-demBox[i])/Scalar(levelSize-1);
+		int first=int(Math::floor((footprint[i]-demBox[i])/cellSize))-1;
+		int last=int(Math::ceil((footprint[2+i]-demBox[i])/cellSize))+1;
+		first=Math::max(first,0);
+		last=Math::min(last,levelSize-1);
+		if(last<=first)
+			{
+			/* Footprint does not overlap the DEM; upload the entire level: */
+			first=0;
+			last=levelSize-1;
+			}
+		newOrigin[i]=first;
+		newSize[i]=last-first+1;
+		}
+	
+	/* Update the texture window if it changed: */
+	if(newLevel!=textureLevel||newOrigin[0]!=textureOrigin[0]||newOrigin[1]!=textureOrigin[1]||newSize[0]!=textureSize[0]||newSize[1]!=textureSize[1])
+		setTextureWindow(newLevel,newOrigin,newSize);
 	}
 
 void DEM::setTransform(const OGTransform& newTransform,Scalar newVerticalScale,Scalar newVerticalScaleBase)
@@ -155,6 +404,13 @@ void DEM::bindTexture(GLContextData& contextData) const
 	
 	/* Bind the DEM texture: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->textureObjectId);
+	
+	/* Re-upload the DEM texture if a different DEM, level, or window was selected since the last upload: */
+	if(dataItem->textureVersion!=textureVersion)
+		{
+		uploadTexture();
+		dataItem->textureVersion=textureVersion;
+		}
 	}
 
 void DEM::uploadDemTransform(GLint location) const
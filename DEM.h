@@ -20,9 +20,35 @@ with the Augmented Reality Sandbox; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 ***********************************************************************/
 
+/***********************************************************************
+DEM reads two file formats. Plain DEM files are little-endian and hold
+an Int32 width and height, four Float32 lower-left x, lower-left y,
+upper-right x, upper-right y corner coordinates, and width*height
+Float32 elevations in row-major order, starting from the lower-left
+corner. Tiled DEM files, as written by MakeTiledDEM, are little-endian
+and are memory-mapped instead of read:
+- Header: 8-byte signature "SBXTDEM\0", UInt32 format version, UInt32
+  width and height of the full-resolution grid, four Float64 corner
+  coordinates as above, UInt32 tile size, UInt32 number of pyramid
+  levels, Float32 minimum and maximum and Float64 average elevation of
+  the full-resolution grid.
+- Level table: per pyramid level, from full resolution down, UInt32
+  grid width and height and UInt64 file offset of the level's first
+  tile. Each level spans the same corner coordinates; a level's width
+  and height are (w+1)/2 and (h+1)/2 of the previous level's.
+- Tiles: per level, ceil(width/tile size)*ceil(height/tile size) tiles
+  in row-major order starting from the lower-left tile, each holding
+  tile size*tile size Float32 elevations in row-major order. Tiles
+  overlapping the grid's right or top edges are padded by repeating
+  the last column or row.
+***********************************************************************/
+
 #ifndef DEM_INCLUDED
 #define DEM_INCLUDED
 
+#include <stddef.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
 #include <GL/gl.h>
 #include <GL/GLObject.h>
 
@@ -31,12 +57,28 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 class DEM:public GLObject
 	{
 	/* Embedded classes: */
+	public:
+	static const char tiledFileSignature[8]; // Signature at the beginning of tiled DEM files
+	static const Misc::UInt32 tiledFileVersion=1U; // Current tiled DEM file format version
+	static const unsigned int tiledHeaderSize=8+3*4+4*8+2*4+2*4+8; // Size of a tiled DEM file header without the level table
+	static const unsigned int tiledLevelSize=2*4+8; // Size of an entry in a tiled DEM file's level table
+	
 	private:
+	struct Level // Structure describing one pyramid level of a tiled DEM file
+		{
+		/* Elements: */
+		public:
+		int size[2]; // Width and height of the level's grid
+		int numTiles[2]; // Number of tiles in x and y
+		const float* tiles; // Pointer to the level's first tile in the memory-mapped file
+		};
+	
 	struct DataItem:public GLObject::DataItem
 		{
 		/* Elements: */
 		public:
 		GLuint textureObjectId; // ID of texture object holding digital elevation model
+		unsigned int textureVersion; // Version of the DEM window currently uploaded into the texture object
 		
 		/* Constructors and destructors: */
 		DataItem(void);
@@ -47,7 +89,19 @@ class DEM:public GLObject
 	private:
 	int demSize[2]; // Width and height of the DEM grid
 	Scalar demBox[4]; // Lower-left and upper-right corner coordinates of the DEM
-	float* dem; // Array of DEM elevation measurements
+	float* dem; // Array of DEM elevation measurements read from a plain DEM file
+	int fd; // File descriptor of a memory-mapped tiled DEM file, or -1
+	size_t fileSize; // Size of the memory-mapped tiled DEM file in bytes
+	const unsigned char* fileData; // Memory-mapped contents of a tiled DEM file
+	int tileSize; // Width and height of tiles in a tiled DEM file
+	std::vector<Level> levels; // Pyramid levels of a tiled DEM file, from full resolution down
+	float elevationRange[2]; // Minimum and maximum elevation of the DEM
+	float averageElevation; // Average elevation of the DEM
+	unsigned int textureLevel; // Pyramid level from which the DEM texture is uploaded
+	int textureOrigin[2]; // Index of the level's grid vertex at the lower-left corner of the DEM texture
+	int textureSize[2]; // Width and height of the DEM texture
+	Scalar textureBox[4]; // Lower-left and upper-right corner coordinates of the DEM texture
+	unsigned int textureVersion; // Version number of the DEM texture's level and window, to update textures in all OpenGL contexts
 	OGTransform transform; // Transformation from camera space to DEM space (z up)
 	Scalar verticalScale; // Vertical scale (exaggeration) factor
 	Scalar verticalScaleBase; // Base elevation around which vertical scale is applied
@@ -55,6 +109,10 @@ class DEM:public GLObject
 	GLfloat demTransformMatrix[16]; // Full transformation matrix from camera space to DEM pixel space to upload to OpenGL
 	
 	/* Private methods: */
+	void release(void); // Releases a previously loaded DEM
+	void loadTiled(const char* demFileName); // Memory-maps a tiled DEM file after its signature has been matched
+	void setTextureWindow(unsigned int newLevel,const int newOrigin[2],const int newSize[2]); // Selects the pyramid level and grid window to upload into the DEM texture
+	void uploadTexture(void) const; // Uploads the current DEM texture window into the currently bound texture object
 	void calcMatrix(void); // Calculates the camera space to DEM pixel space transformation
 	
 	/* Constructors and destructors: */
@@ -66,12 +124,24 @@ class DEM:public GLObject
 	virtual void initContext(GLContextData& contextData) const;
 	
 	/* New methods: */
-	void load(const char* demFileName); // Loads the DEM from the given file
+	void load(const char* demFileName); // Loads the DEM from the given plain or tiled DEM file
 	const Scalar* getDemBox(void) const // Returns the DEM's bounding box as lower-left x, lower-left y, upper-right x, upper-right y
 		{
 		return demBox;
 		}
-	float calcAverageElevation(void) const; // Calculates the average elevation of the DEM
+	const float* getElevationRange(void) const // Returns the DEM's minimum and maximum elevation
+		{
+		return elevationRange;
+		}
+	float calcAverageElevation(void) const // Returns the average elevation of the DEM
+		{
+		return averageElevation;
+		}
+	void setFootprint(const Scalar footprint[4],unsigned int resolution); // Uploads the coarsest pyramid level of a tiled DEM that has at least the given number of samples along the longer side of the given DEM-space footprint, cropped to the footprint
+	size_t getTextureMemorySize(void) const // Returns the size of the DEM texture in bytes
+		{
+		return size_t(textureSize[0])*size_t(textureSize[1])*sizeof(GLfloat);
+		}
 	void setTransform(const OGTransform& newTransform,Scalar newVerticalScale,Scalar newVerticalScaleBase); // Sets the DEM transformation
 	const PTransform& getDemTransform(void) const // Returns the full transformation from camera space to vertically-scaled DEM pixel space
 		{
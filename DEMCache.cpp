@@ -0,0 +1,83 @@
+/***********************************************************************
+DEMCache - Class to keep a set of loaded digital elevation models
+resident for instant switching, evicting least-recently used DEMs when
+their textures exceed a memory budget.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "DEMCache.h"
+
+#include "DEM.h"
+
+/*************************
+Methods of class DEMCache:
+*************************/
+
+DEMCache::DEMCache(size_t sMemoryBudget)
+	:memoryBudget(sMemoryBudget),memorySize(0),
+	 useCounter(0)
+	{
+	}
+
+DEMCache::~DEMCache(void)
+	{
+	/* Destroy all cached DEMs: */
+	for(std::vector<Entry>::iterator eIt=entries.begin();eIt!=entries.end();++eIt)
+		delete eIt->dem;
+	}
+
+DEM* DEMCache::find(const char* demFileName)
+	{
+	/* Find the DEM among the cached ones: */
+	for(std::vector<Entry>::iterator eIt=entries.begin();eIt!=entries.end();++eIt)
+		if(eIt->demFileName==demFileName)
+			{
+			eIt->lastUse=++useCounter;
+			return eIt->dem;
+			}
+	
+	return 0;
+	}
+
+void DEMCache::insert(const char* demFileName,DEM* dem,const DEM* activeDem)
+	{
+	/* Add the new DEM as the most recently used one: */
+	Entry newEntry;
+	newEntry.demFileName=demFileName;
+	newEntry.dem=dem;
+	newEntry.memorySize=dem->getTextureMemorySize();
+	newEntry.lastUse=++useCounter;
+	entries.push_back(newEntry);
+	memorySize+=newEntry.memorySize;
+	
+	/* Evict least-recently used DEMs until the cache fits its budget or only the new and active DEMs are left: */
+	while(memorySize>memoryBudget)
+		{
+		std::vector<Entry>::iterator lruIt=entries.end();
+		for(std::vector<Entry>::iterator eIt=entries.begin();eIt!=entries.end();++eIt)
+			if(eIt->dem!=dem&&eIt->dem!=activeDem&&(lruIt==entries.end()||eIt->lastUse<lruIt->lastUse))
+				lruIt=eIt;
+		if(lruIt==entries.end())
+			break;
+		
+		memorySize-=lruIt->memorySize;
+		delete lruIt->dem;
+		entries.erase(lruIt);
+		}
+	}
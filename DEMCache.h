@@ -0,0 +1,72 @@
+/***********************************************************************
+DEMCache - Class to keep a set of loaded digital elevation models
+resident for instant switching, evicting least-recently used DEMs when
+their textures exceed a memory budget.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef DEMCACHE_INCLUDED
+#define DEMCACHE_INCLUDED
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* Forward declarations: */
+class DEM;
+
+class DEMCache
+	{
+	/* Embedded classes: */
+	private:
+	struct Entry // Structure for a cached DEM
+		{
+		/* Elements: */
+		public:
+		std::string demFileName; // Name of the file from which the DEM was loaded
+		DEM* dem; // The loaded and fitted DEM, owned by the cache
+		size_t memorySize; // Size of the DEM's texture in bytes
+		unsigned int lastUse; // Value of the use counter when the DEM was last inserted or found
+		};
+	
+	/* Elements: */
+	size_t memoryBudget; // Maximum total size of cached DEMs' textures in bytes
+	size_t memorySize; // Current total size of cached DEMs' textures in bytes
+	unsigned int useCounter; // Counter to order DEM uses for least-recently used eviction
+	std::vector<Entry> entries; // List of cached DEMs
+	
+	/* Constructors and destructors: */
+	public:
+	DEMCache(size_t sMemoryBudget); // Creates an empty DEM cache with the given memory budget in bytes
+	private:
+	DEMCache(const DEMCache& source); // Prohibit copy constructor
+	DEMCache& operator=(const DEMCache& source); // Prohibit assignment operator
+	public:
+	~DEMCache(void); // Destroys all cached DEMs
+	
+	/* Methods: */
+	size_t getMemorySize(void) const // Returns the current total size of cached DEMs' textures in bytes
+		{
+		return memorySize;
+		}
+	DEM* find(const char* demFileName); // Returns the cached DEM loaded from the given file and marks it as most recently used, or null
+	void insert(const char* demFileName,DEM* dem,const DEM* activeDem); // Adopts the given DEM loaded from the given file, then evicts least-recently used DEMs other than the new and the given active one until the cache fits its budget
+	};
+
+#endif
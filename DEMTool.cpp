@@ -93,45 +93,8 @@ void DEMTool::loadDEMFile(const char* demFileName)
 	/* Load the selected DEM file: */
 	load(demFileName);
 	
-	OGTransform demT;
-	if(haveDemTransform)
-		demT=demTransform;
-	else
-		{
-		/* Calculate an appropriate DEM transformation to fit the DEM into the sandbox's domain: */
-		const Scalar* demBox=getDemBox();
-		Scalar demSx=demBox[2]-demBox[0];
-		Scalar demSy=demBox[3]-demBox[1];
-		Scalar boxSx=application->bbox.getSize(0);
-		Scalar boxSy=application->bbox.getSize(1);
-		
-		/* Shift the DEM's center to the box's center: */
-		Point demCenter;
-		demCenter[0]=Math::mid(demBox[0],demBox[2]);
-		demCenter[1]=Math::mid(demBox[1],demBox[3]);
-		demCenter[2]=Scalar(calcAverageElevation());
-		demT=OGTransform::translateFromOriginTo(demCenter);
-		
-		/* Determine whether the DEM should be rotated: */
-		Scalar scale=Math::min(demSx/boxSx,demSy/boxSy);
-		Scalar scaleRot=Math::min(demSx/boxSy,demSy/boxSx);
-		
-		if(scale<scaleRot)
-			{
-			/* Scale and rotate DEM: */
-			demT*=OGTransform::rotate(OGTransform::Rotation::rotateZ(Math::rad(Scalar(90))));
-			scale=scaleRot;
-			}
-		
-		/* Scale DEM without rotation: */
-		demT*=OGTransform::scale(scale);
-		}
-	
-	/* Shift the DEM vertically: */
-	demT*=OGTransform::translate(Vector(0,0,demVerticalShift/demVerticalScale));
-	
-	/* Set the DEM transformation: */
-	setTransform(demT*OGTransform(application->boxTransform),demVerticalScale,demT.getOrigin()[2]);
+	/* Place the DEM into the sandbox: */
+	application->fitDem(*this,haveDemTransform?&demTransform:0,demVerticalShift,demVerticalScale,demResolution);
 	}
 
 void DEMTool::loadDEMFileCallback(GLMotif::FileSelectionDialog::OKCallbackData* cbData)
@@ -153,7 +116,8 @@ DEMToolFactory* DEMTool::initClass(Vrui::ToolManager& toolManager)
 DEMTool::DEMTool(const Vrui::ToolFactory* factory,const Vrui::ToolInputAssignment& inputAssignment)
 	:Vrui::Tool(factory,inputAssignment),
 	 haveDemTransform(false),demTransform(OGTransform::identity),
-	 demVerticalShift(0),demVerticalScale(1)
+	 demVerticalShift(0),demVerticalScale(1),
+	 demResolution(1024)
 	{
 	}
 
@@ -175,6 +139,7 @@ void DEMTool::configure(const Misc::ConfigurationFileSection& configFileSection)
 	
 	demVerticalShift=configFileSection.retrieveValue<Scalar>("./demVerticalShift",demVerticalShift);
 	demVerticalScale=configFileSection.retrieveValue<Scalar>("./demVerticalScale",demVerticalScale);
+	demResolution=configFileSection.retrieveValue<unsigned int>("./demResolution",demResolution);
 	}
 
 void DEMTool::initialize(void)
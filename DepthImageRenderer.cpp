@@ -23,23 +23,122 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "DepthImageRenderer.h"
 
+#include <string.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <Math/Math.h>
+#include <Math/Constants.h>
 #include <GL/gl.h>
 #include <GL/GLVertexArrayParts.h>
 #include <GL/GLContextData.h>
+#include <GL/Extensions/GLARBDrawBuffers.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
 #include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
 #include <GL/Extensions/GLARBTextureRectangle.h>
 #include <GL/Extensions/GLARBTextureRg.h>
 #include <GL/Extensions/GLARBVertexBufferObject.h>
 #include <GL/Extensions/GLARBVertexShader.h>
+#include <GL/Extensions/GLEXTFramebufferObject.h>
+#include <GL/GLExtensionManager.h>
 #include <GL/GLTransformationWrappers.h>
 
+#include "FrameFilter.h"
 #include "ShaderHelper.h"
 #include <iostream>
 #include <fstream>
 
+/* Buffer storage constants of OpenGL 4.4, in case the system's OpenGL headers predate them: */
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_HALF_FLOAT_ARB
+#define GL_HALF_FLOAT_ARB 0x140B
+#endif
+
+namespace {
+
+/***************************************
+Persistent buffer mapping entry points:
+***************************************/
+
+typedef void (APIENTRY * BufferStorageProc)(GLenum target,GLsizeiptrARB size,const void* data,GLbitfield flags);
+typedef void* (APIENTRY * MapBufferRangeProc)(GLenum target,GLintptrARB offset,GLsizeiptrARB length,GLbitfield access);
+
+BufferStorageProc bufferStorageProc=0;
+MapBufferRangeProc mapBufferRangeProc=0;
+
+/****************
+Helper functions:
+****************/
+
+bool initPersistentMapping(void)
+	{
+	/* Check for the required extensions; fences guard the persistently mapped buffers: */
+	if(!GLExtensionManager::isExtensionSupported("GL_ARB_buffer_storage")||!initFenceSync())
+		return false;
+	
+	/* Retrieve the entry points: */
+	bufferStorageProc=GLExtensionManager::getFunction<BufferStorageProc>("glBufferStorage");
+	mapBufferRangeProc=GLExtensionManager::getFunction<MapBufferRangeProc>("glMapBufferRange");
+	return bufferStorageProc!=0&&mapBufferRangeProc!=0;
+	}
+
+inline GLushort floatToHalf(GLfloat value)
+	{
+	/* Split the single-precision value into its components: */
+	Misc::UInt32 bits;
+	memcpy(&bits,&value,sizeof(Misc::UInt32));
+	Misc::UInt32 sign=(bits>>16)&0x8000U;
+	int exponent=int((bits>>23)&0xffU)-127+15;
+	Misc::UInt32 mantissa=bits&0x007fffffU;
+	
+	if(exponent>=31)
+		{
+		/* Map NaNs to NaN, and overflows and infinities to infinity: */
+		if(((bits>>23)&0xffU)==0xffU&&mantissa!=0U)
+			return GLushort(sign|0x7e00U);
+		return GLushort(sign|0x7c00U);
+		}
+	else if(exponent<=0)
+		{
+		/* Flush values below the smallest half-float denormal to zero, and round the rest to denormals: */
+		if(exponent<-10)
+			return GLushort(sign);
+		mantissa|=0x00800000U;
+		int shift=14-exponent;
+		Misc::UInt32 result=mantissa>>shift;
+		if((mantissa>>(shift-1))&0x1U)
+			++result;
+		return GLushort(sign|result);
+		}
+	else
+		{
+		/* Round the mantissa to nearest; a carry correctly propagates into the exponent: */
+		Misc::UInt32 result=sign|(Misc::UInt32(exponent)<<10)|(mantissa>>13);
+		if(mantissa&0x00001000U)
+			++result;
+		return GLushort(result);
+		}
+	}
+
+inline unsigned int countMeshSamples(unsigned int v0,unsigned int v1,unsigned int stride)
+	{
+	/* Sample the vertex range at the given stride, always including its last vertex: */
+	return (v1-v0+stride-1)/stride+1;
+	}
+
+inline unsigned int getMeshSample(unsigned int v0,unsigned int v1,unsigned int stride,unsigned int index)
+	{
+	return Math::min(v0+index*stride,v1);
+	}
+
+}
+
 /*********************************************
 Methods of class DepthImageRenderer::DataItem:
 *********************************************/
@@ -47,17 +146,39 @@ Methods of class DepthImageRenderer::DataItem:
 DepthImageRenderer::DataItem::DataItem(void)
 	:vertexBuffer(0),indexBuffer(0),
 	 depthTexture(0),depthTextureVersion(0),
-	 depthShader(0),elevationShader(0)
+	 filterFramebufferObject(0),
+	 rawDepthTexture(0),depthCorrectionTexture(0),
+	 numAveragingTextures(0),averagingTextures(0),averagingSlotIndex(0),
+	 currentState(0),temporalFilterFramebufferObject(0),
+	 uploadFormat(UPLOAD_FLOAT32),uploadBufferSize(0),persistentUploadBuffers(false),nextUploadBuffer(0),
+	 fixedDepthTexture(0),expandFramebufferObject(0),
+	 depthShader(0),elevationShader(0),spatialFilterShader(0),temporalFilterShader(0),expandShader(0)
 	{
+	for(int i=0;i<2;++i)
+		{
+		filterTextures[i]=0;
+		statTextures[i]=0;
+		validTextures[i]=0;
+		}
+	for(unsigned int i=0;i<numUploadBuffers;++i)
+		{
+		uploadBuffers[i]=0;
+		uploadBufferPtrs[i]=0;
+		uploadFences[i]=0;
+		}
+	
 	/* Initialize all required extensions: */
+	GLARBDrawBuffers::initExtension();
 	GLARBFragmentShader::initExtension();
 	GLARBMultitexture::initExtension();
+	GLARBPixelBufferObject::initExtension();
 	GLARBShaderObjects::initExtension();
 	GLARBTextureFloat::initExtension();
 	GLARBTextureRectangle::initExtension();
 	GLARBTextureRg::initExtension();
 	GLARBVertexBufferObject::initExtension();
 	GLARBVertexShader::initExtension();
+	GLEXTFramebufferObject::initExtension();
 	
 	/* Allocate the buffers and textures: */
 	glGenBuffersARB(1,&vertexBuffer);
@@ -71,20 +192,610 @@ DepthImageRenderer::DataItem::~DataItem(void)
 	glDeleteBuffersARB(1,&vertexBuffer);
 	glDeleteBuffersARB(1,&indexBuffer);
 	glDeleteTextures(1,&depthTexture);
+	glDeleteTextures(2,filterTextures);
+	if(filterFramebufferObject!=0)
+		glDeleteFramebuffersEXT(1,&filterFramebufferObject);
+	glDeleteTextures(1,&rawDepthTexture);
+	glDeleteTextures(1,&depthCorrectionTexture);
+	if(averagingTextures!=0)
+		glDeleteTextures(numAveragingTextures,averagingTextures);
+	delete[] averagingTextures;
+	glDeleteTextures(2,statTextures);
+	glDeleteTextures(2,validTextures);
+	if(temporalFilterFramebufferObject!=0)
+		glDeleteFramebuffersEXT(1,&temporalFilterFramebufferObject);
+	
+	/* Delete the upload buffers, which implicitly unmaps persistently mapped buffers, and any pending fences: */
+	glDeleteBuffersARB(numUploadBuffers,uploadBuffers);
+	for(unsigned int i=0;i<numUploadBuffers;++i)
+		if(uploadFences[i]!=0)
+			deleteSync(uploadFences[i]);
+	glDeleteTextures(1,&fixedDepthTexture);
+	if(expandFramebufferObject!=0)
+		glDeleteFramebuffersEXT(1,&expandFramebufferObject);
+	
 	glDeleteObjectARB(depthShader);
 	glDeleteObjectARB(elevationShader);
+	glDeleteObjectARB(spatialFilterShader);
+	glDeleteObjectARB(temporalFilterShader);
+	glDeleteObjectARB(expandShader);
 	}
 
 /***********************************
 Methods of class DepthImageRenderer:
 ***********************************/
 
+void DepthImageRenderer::runTemporalFilter(DepthImageRenderer::DataItem* dataItem,GLuint outputTexture) const
+	{
+	/* Stream the new raw depth frame through the next upload buffer: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->rawDepthTexture);
+	void* bufferPtr=mapUploadBuffer(dataItem);
+	if(bufferPtr!=0)
+		{
+		memcpy(bufferPtr,depthImage.getData<GLushort>(),depthImageSize[1]*depthImageSize[0]*sizeof(GLushort));
+		unmapUploadBuffer(dataItem);
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_UNSIGNED_SHORT,0);
+		}
+	releaseUploadBuffer(dataItem);
+	
+	/* Attach the spare averaging slot, the next filter state, and the output texture to the temporal filter frame buffer: */
+	int nextState=1-dataItem->currentState;
+	GLuint spareTexture=dataItem->averagingTextures[numAveragingSlots];
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->temporalFilterFramebufferObject);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,spareTexture,0);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT1_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->statTextures[nextState],0);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT2_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->validTextures[nextState],0);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT3_EXT,GL_TEXTURE_RECTANGLE_ARB,outputTexture,0);
+	static const GLenum drawBuffers[4]={GL_COLOR_ATTACHMENT0_EXT,GL_COLOR_ATTACHMENT1_EXT,GL_COLOR_ATTACHMENT2_EXT,GL_COLOR_ATTACHMENT3_EXT};
+	glDrawBuffersARB(4,drawBuffers);
+	glViewport(0,0,depthImageSize[0],depthImageSize[1]);
+	glDisable(GL_BLEND);
+	
+	/* Set up the temporal filter shader: */
+	glUseProgramObjectARB(dataItem->temporalFilterShader);
+	glUniform1iARB(dataItem->temporalFilterShaderUniforms[0],0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthCorrectionTexture);
+	glUniform1iARB(dataItem->temporalFilterShaderUniforms[1],1);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->averagingTextures[dataItem->averagingSlotIndex]);
+	glUniform1iARB(dataItem->temporalFilterShaderUniforms[2],2);
+	glActiveTextureARB(GL_TEXTURE3_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->statTextures[dataItem->currentState]);
+	glUniform1iARB(dataItem->temporalFilterShaderUniforms[3],3);
+	glActiveTextureARB(GL_TEXTURE4_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->validTextures[dataItem->currentState]);
+	glUniform1iARB(dataItem->temporalFilterShaderUniforms[4],4);
+	glUniformARB<4>(dataItem->temporalFilterShaderUniforms[5],1,minPlane);
+	glUniformARB<4>(dataItem->temporalFilterShaderUniforms[6],1,maxPlane);
+	glUniform1fARB(dataItem->temporalFilterShaderUniforms[7],minNumSamples);
+	glUniform1fARB(dataItem->temporalFilterShaderUniforms[8],maxVariance);
+	glUniform1fARB(dataItem->temporalFilterShaderUniforms[9],hysteresis);
+	glUniform1iARB(dataItem->temporalFilterShaderUniforms[10],retainValids?1:0);
+	glUniform1fARB(dataItem->temporalFilterShaderUniforms[11],instableValue);
+	
+	/* Run the temporal filter over the entire depth image: */
+	glBegin(GL_QUADS);
+	glVertex2i(0,0);
+	glVertex2i(depthImageSize[0],0);
+	glVertex2i(depthImageSize[0],depthImageSize[1]);
+	glVertex2i(0,depthImageSize[1]);
+	glEnd();
+	
+	/* Unbind all textures: */
+	for(int unit=4;unit>=0;--unit)
+		{
+		glActiveTextureARB(GL_TEXTURE0_ARB+unit);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		}
+	
+	/* Swap the spare texture, now holding the new samples, into the replaced averaging slot and advance the filter state: */
+	dataItem->averagingTextures[numAveragingSlots]=dataItem->averagingTextures[dataItem->averagingSlotIndex];
+	dataItem->averagingTextures[dataItem->averagingSlotIndex]=spareTexture;
+	if(++dataItem->averagingSlotIndex==numAveragingSlots)
+		dataItem->averagingSlotIndex=0;
+	dataItem->currentState=nextState;
+	}
+
+void DepthImageRenderer::runSpatialFilter(DepthImageRenderer::DataItem* dataItem) const
+	{
+	/* Set up the spatial filter frame buffer and shader: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->filterFramebufferObject);
+	glViewport(0,0,depthImageSize[0],depthImageSize[1]);
+	glDisable(GL_BLEND);
+	glUseProgramObjectARB(dataItem->spatialFilterShader);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glUniform1iARB(dataItem->spatialFilterShaderUniforms[0],0);
+	glUniformARB<2>(dataItem->spatialFilterShaderUniforms[2],1,depthImageSizeF);
+	
+	/* Run two passes of a separable 1-2-1 low-pass filter, each first along columns and then along rows, ending in the depth texture: */
+	static const GLfloat passSteps[4][2]={{0.0f,1.0f},{1.0f,0.0f},{0.0f,1.0f},{1.0f,0.0f}};
+	static const int passSources[4]={0,1,0,1};
+	static const int passTargets[4]={1,0,1,2};
+	for(int pass=0;pass<4;++pass)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->filterTextures[passSources[pass]]);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+passTargets[pass]);
+		glUniformARB<2>(dataItem->spatialFilterShaderUniforms[1],1,passSteps[pass]);
+		glBegin(GL_QUADS);
+		glVertex2i(0,0);
+		glVertex2i(depthImageSize[0],0);
+		glVertex2i(depthImageSize[0],depthImageSize[1]);
+		glVertex2i(0,depthImageSize[1]);
+		glEnd();
+		}
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	}
+
+void* DepthImageRenderer::mapUploadBuffer(DepthImageRenderer::DataItem* dataItem) const
+	{
+	/* Bind the next upload buffer in the ring: */
+	unsigned int index=dataItem->nextUploadBuffer;
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,dataItem->uploadBuffers[index]);
+	
+	if(dataItem->persistentUploadBuffers)
+		{
+		/* Wait until the GPU has finished reading the buffer's previous contents, which normally happened frames ago: */
+		if(dataItem->uploadFences[index]!=0)
+			{
+			clientWaitSync(dataItem->uploadFences[index],1000000000ULL);
+			deleteSync(dataItem->uploadFences[index]);
+			dataItem->uploadFences[index]=0;
+			}
+		
+		return dataItem->uploadBufferPtrs[index];
+		}
+	else
+		{
+		/* Orphan the buffer's previous contents so that mapping it does not wait for a pending transfer: */
+		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,dataItem->uploadBufferSize,0,GL_STREAM_DRAW_ARB);
+		return glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,GL_WRITE_ONLY_ARB);
+		}
+	}
+
+void DepthImageRenderer::unmapUploadBuffer(DepthImageRenderer::DataItem* dataItem) const
+	{
+	/* Persistently mapped buffers are coherent and stay mapped: */
+	if(!dataItem->persistentUploadBuffers)
+		glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+	}
+
+void DepthImageRenderer::releaseUploadBuffer(DepthImageRenderer::DataItem* dataItem) const
+	{
+	/* Protect a persistently mapped buffer from being overwritten while the GPU is still reading from it: */
+	if(dataItem->persistentUploadBuffers)
+		dataItem->uploadFences[dataItem->nextUploadBuffer]=fenceSync();
+	
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+	if(++dataItem->nextUploadBuffer==numUploadBuffers)
+		dataItem->nextUploadBuffer=0;
+	}
+
+void DepthImageRenderer::writeUploadPixels(const DepthImageRenderer::DataItem* dataItem,void* buffer,const unsigned int rect[4]) const
+	{
+	/* Write each row of the sub-rectangle at its position in the full depth image: */
+	for(unsigned int y=rect[1];y<rect[3];++y)
+		{
+		size_t offset=size_t(y)*size_t(depthImageSize[0])+size_t(rect[0]);
+		const GLfloat* diPtr=depthImage.getData<GLfloat>()+offset;
+		unsigned int width=rect[2]-rect[0];
+		switch(dataItem->uploadFormat)
+			{
+			case UPLOAD_FLOAT32:
+				memcpy(static_cast<GLfloat*>(buffer)+offset,diPtr,width*sizeof(GLfloat));
+				break;
+			
+			case UPLOAD_FLOAT16:
+				{
+				GLushort* bPtr=static_cast<GLushort*>(buffer)+offset;
+				for(unsigned int x=0;x<width;++x)
+					bPtr[x]=floatToHalf(diPtr[x]);
+				break;
+				}
+			
+			case UPLOAD_FIXED16:
+				{
+				/* Quantize depth values to the fixed-point range, mapping invalid values to zero: */
+				GLfloat scale=65535.0f/fixedDepthRange;
+				GLushort* bPtr=static_cast<GLushort*>(buffer)+offset;
+				for(unsigned int x=0;x<width;++x)
+					{
+					GLfloat value=diPtr[x]*scale+0.5f;
+					bPtr[x]=value>0.0f?(value<65535.0f?GLushort(value):GLushort(65535U)):GLushort(0U);
+					}
+				break;
+				}
+			}
+		}
+	}
+
+void DepthImageRenderer::expandFixedDepthImage(DepthImageRenderer::DataItem* dataItem,GLuint outputTexture) const
+	{
+	/* Attach the output texture to the expansion frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->expandFramebufferObject);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,outputTexture,0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	glViewport(0,0,depthImageSize[0],depthImageSize[1]);
+	glDisable(GL_BLEND);
+	
+	/* Set up the expansion shader: */
+	glUseProgramObjectARB(dataItem->expandShader);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->fixedDepthTexture);
+	glUniform1iARB(dataItem->expandShaderUniforms[0],0);
+	glUniform1fARB(dataItem->expandShaderUniforms[1],fixedDepthRange);
+	
+	/* Expand the entire depth image: */
+	glBegin(GL_QUADS);
+	glVertex2i(0,0);
+	glVertex2i(depthImageSize[0],0);
+	glVertex2i(depthImageSize[0],depthImageSize[1]);
+	glVertex2i(0,depthImageSize[1]);
+	glEnd();
+	
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	}
+
+void DepthImageRenderer::uploadDepthImage(DepthImageRenderer::DataItem* dataItem,GLuint texture) const
+	{
+	/* Collect the sub-rectangles of the depth image that changed since the texture was last updated: */
+	std::vector<unsigned int> rects;
+	unsigned int numChangedTiles=0;
+	for(unsigned int i=0;i<numTiles[1]*numTiles[0];++i)
+		if(tileVersions[i]>dataItem->depthTextureVersion)
+			++numChangedTiles;
+	if(numChangedTiles==numTiles[1]*numTiles[0])
+		{
+		/* Upload the entire depth image: */
+		rects.push_back(0);
+		rects.push_back(0);
+		rects.push_back(depthImageSize[0]);
+		rects.push_back(depthImageSize[1]);
+		}
+	else if(numChangedTiles>0)
+		{
+		/* Upload each horizontal run of changed tiles as one sub-rectangle of the depth image: */
+		const unsigned int* tvPtr=tileVersions;
+		for(unsigned int ty=0;ty<numTiles[1];++ty,tvPtr+=numTiles[0])
+			{
+			unsigned int y0=ty*tileSize;
+			unsigned int y1=Math::min(y0+tileSize,depthImageSize[1]);
+			unsigned int tx=0;
+			while(tx<numTiles[0])
+				{
+				/* Skip unchanged tiles: */
+				while(tx<numTiles[0]&&tvPtr[tx]<=dataItem->depthTextureVersion)
+					++tx;
+				if(tx==numTiles[0])
+					break;
+				
+				/* Find the end of the run of changed tiles: */
+				unsigned int runStart=tx;
+				while(tx<numTiles[0]&&tvPtr[tx]>dataItem->depthTextureVersion)
+					++tx;
+				rects.push_back(runStart*tileSize);
+				rects.push_back(y0);
+				rects.push_back(Math::min(tx*tileSize,depthImageSize[0]));
+				rects.push_back(y1);
+				}
+			}
+		}
+	if(rects.empty())
+		return;
+	
+	/* Write the changed sub-rectangles into the next upload buffer at their positions in the depth image: */
+	void* bufferPtr=mapUploadBuffer(dataItem);
+	if(bufferPtr!=0)
+		{
+		for(size_t i=0;i<rects.size();i+=4)
+			writeUploadPixels(dataItem,bufferPtr,&rects[i]);
+		unmapUploadBuffer(dataItem);
+		
+		/* Update the texture from the upload buffer, which lets the transfer overlap with subsequent rendering: */
+		GLenum pixelType=GL_FLOAT;
+		size_t pixelSize=sizeof(GLfloat);
+		if(dataItem->uploadFormat==UPLOAD_FLOAT16)
+			{
+			pixelType=GL_HALF_FLOAT_ARB;
+			pixelSize=sizeof(GLushort);
+			}
+		else if(dataItem->uploadFormat==UPLOAD_FIXED16)
+			{
+			pixelType=GL_UNSIGNED_SHORT;
+			pixelSize=sizeof(GLushort);
+			}
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,texture);
+		glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH,depthImageSize[0]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+		for(size_t i=0;i<rects.size();i+=4)
+			{
+			const unsigned int* r=&rects[i];
+			const GLubyte* offset=static_cast<const GLubyte*>(0)+(size_t(r[1])*size_t(depthImageSize[0])+size_t(r[0]))*pixelSize;
+			glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,r[0],r[1],r[2]-r[0],r[3]-r[1],GL_LUMINANCE,pixelType,offset);
+			}
+		glPopClientAttrib();
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		}
+	releaseUploadBuffer(dataItem);
+	}
+
+bool DepthImageRenderer::getChangedPixelBox(unsigned int sinceVersion,unsigned int box[4]) const
+	{
+	/* Calculate the bounding box of all tiles that changed after the given version: */
+	unsigned int tileBox[4]={numTiles[0],numTiles[1],0,0};
+	const unsigned int* tvPtr=tileVersions;
+	for(unsigned int ty=0;ty<numTiles[1];++ty)
+		for(unsigned int tx=0;tx<numTiles[0];++tx,++tvPtr)
+			if(*tvPtr>sinceVersion)
+				{
+				tileBox[0]=Math::min(tileBox[0],tx);
+				tileBox[1]=Math::min(tileBox[1],ty);
+				tileBox[2]=Math::max(tileBox[2],tx+1);
+				tileBox[3]=Math::max(tileBox[3],ty+1);
+				}
+	if(tileBox[0]>=tileBox[2])
+		return false;
+	
+	/* Convert the tile box to a pixel box: */
+	for(int i=0;i<2;++i)
+		{
+		box[i]=tileBox[i]*tileSize;
+		box[2+i]=Math::min(tileBox[2+i]*tileSize,depthImageSize[i]);
+		}
+	
+	return true;
+	}
+
+void DepthImageRenderer::updateDepthTexture(DepthImageRenderer::DataItem* dataItem) const
+	{
+	/* Check if the texture is outdated: */
+	if(dataItem->depthTextureVersion!=depthImageVersion)
+		{
+		if(numAveragingSlots>0||spatialFilter||dataItem->uploadFormat==UPLOAD_FIXED16)
+			{
+			/* Save relevant OpenGL state: */
+			glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
+			GLint currentFrameBuffer;
+			glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+			GLhandleARB currentShader=glGetHandleARB(GL_PROGRAM_OBJECT_ARB);
+			GLint currentActiveTexture;
+			glGetIntegerv(GL_ACTIVE_TEXTURE_ARB,&currentActiveTexture);
+			glMatrixMode(GL_PROJECTION);
+			glPushMatrix();
+			glLoadIdentity();
+			glOrtho(0.0,GLdouble(depthImageSize[0]),0.0,GLdouble(depthImageSize[1]),-1.0,1.0);
+			glMatrixMode(GL_MODELVIEW);
+			glPushMatrix();
+			glLoadIdentity();
+			
+			if(numAveragingSlots>0)
+				{
+				/* Filter the new raw depth frame into the unfiltered depth texture if there is a subsequent spatial filter, or directly into the depth texture: */
+				runTemporalFilter(dataItem,spatialFilter?dataItem->filterTextures[0]:dataItem->depthTexture);
+				}
+			else if(dataItem->uploadFormat==UPLOAD_FIXED16)
+				{
+				/* Upload the changed parts of the new fixed-point depth image, and expand it into the unfiltered depth texture if there is a subsequent spatial filter, or directly into the depth texture: */
+				uploadDepthImage(dataItem,dataItem->fixedDepthTexture);
+				expandFixedDepthImage(dataItem,spatialFilter?dataItem->filterTextures[0]:dataItem->depthTexture);
+				}
+			else
+				{
+				/* Upload the new depth image into the unfiltered depth texture: */
+				uploadDepthImage(dataItem,dataItem->filterTextures[0]);
+				}
+			
+			if(spatialFilter)
+				{
+				/* Low-pass filter the unfiltered depth texture into the depth texture: */
+				runSpatialFilter(dataItem);
+				}
+			
+			/* Restore OpenGL state: */
+			glPopMatrix();
+			glMatrixMode(GL_PROJECTION);
+			glPopMatrix();
+			glMatrixMode(GL_MODELVIEW);
+			glActiveTextureARB(currentActiveTexture);
+			glUseProgramObjectARB(currentShader);
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+			glPopAttrib();
+			}
+		else
+			{
+			/* Upload the changed parts of the new depth texture: */
+			uploadDepthImage(dataItem,dataItem->depthTexture);
+			}
+		
+		/* Mark the depth texture as current: */
+		dataItem->depthTextureVersion=depthImageVersion;
+		}
+	}
+
+void DepthImageRenderer::getMeshBlockBox(unsigned int bx,unsigned int by,unsigned int box[4]) const
+	{
+	unsigned int b[2]={bx,by};
+	for(int i=0;i<2;++i)
+		{
+		box[i]=b[i]*meshBlockSize;
+		box[2+i]=Math::min((b[i]+1)*meshBlockSize,depthImageSize[i]-1);
+		}
+	}
+
+bool DepthImageRenderer::isMeshBlockVisible(const PTransform::Matrix& pmvdp,unsigned int bx,unsigned int by) const
+	{
+	/* Get the block's vertex range, grown by some slack for lens distortion correction: */
+	unsigned int box[4];
+	getMeshBlockBox(bx,by,box);
+	Scalar bx0=Scalar(box[0])-Scalar(1.5);
+	Scalar by0=Scalar(box[1])-Scalar(1.5);
+	Scalar bx1=Scalar(box[2])+Scalar(2.5);
+	Scalar by1=Scalar(box[3])+Scalar(2.5);
+	
+	/* Project the block's corners along their viewing rays at the depths where the rays cross the near and far planes: */
+	Scalar min[2],max[2];
+	bool haveProjection=false;
+	for(int iy=0;iy<2;++iy)
+		for(int ix=0;ix<2;++ix)
+			{
+			Scalar px=ix==0?bx0:bx1;
+			Scalar py=iy==0?by0:by1;
+			if(!lensDistortion.isIdentity())
+				{
+				/* Undistort the image point like the surface template's vertices: */
+				Kinect::LensDistortion::Point up=lensDistortion.undistortPixel(Kinect::LensDistortion::Point(Kinect::LensDistortion::Scalar(px),Kinect::LensDistortion::Scalar(py)));
+				px=Scalar(up[0]);
+				py=Scalar(up[1]);
+				}
+			
+			/* Clip-space position of the image point at depth zero and its change per unit of depth: */
+			Scalar a[4],b[4];
+			for(int i=0;i<4;++i)
+				{
+				a[i]=pmvdp(i,0)*px+pmvdp(i,1)*py+pmvdp(i,3);
+				b[i]=pmvdp(i,2);
+				}
+			for(int plane=-1;plane<=1;plane+=2)
+				{
+				/* Consider the block visible if a ray does not cross a plane in front of the viewer: */
+				Scalar denom=b[2]-Scalar(plane)*b[3];
+				if(denom==Scalar(0))
+					return true;
+				Scalar d=(Scalar(plane)*a[3]-a[2])/denom;
+				Scalar w=a[3]+d*b[3];
+				if(w<=Scalar(0))
+					return true;
+				for(int i=0;i<2;++i)
+					{
+					Scalar ndc=(a[i]+d*b[i])/w;
+					min[i]=haveProjection?Math::min(min[i],ndc):ndc;
+					max[i]=haveProjection?Math::max(max[i],ndc):ndc;
+					}
+				haveProjection=true;
+				}
+			}
+	
+	/* The block is visible unless its projection lies entirely outside the view volume: */
+	return min[0]<=Scalar(1)&&max[0]>=Scalar(-1)&&min[1]<=Scalar(1)&&max[1]>=Scalar(-1);
+	}
+
+Scalar DepthImageRenderer::calcMeshBlockDensity(const PTransform::Matrix& pmvdp,const GLint viewport[4],unsigned int bx,unsigned int by) const
+	{
+	/* Get the block's center pixel: */
+	unsigned int box[4];
+	getMeshBlockBox(bx,by,box);
+	Scalar px=Math::mid(Scalar(box[0]),Scalar(box[2]))+Scalar(0.5);
+	Scalar py=Math::mid(Scalar(box[1]),Scalar(box[3]))+Scalar(0.5);
+	
+	/* Project the center pixel and its horizontal and vertical neighbors on the base plane into window space: */
+	Scalar win[3][2];
+	for(int n=0;n<3;++n)
+		{
+		Scalar x=n==1?px+Scalar(1):px;
+		Scalar y=n==2?py+Scalar(1):py;
+		Scalar d=-(x*basePlaneDicEq[0]+y*basePlaneDicEq[1]+basePlaneDicEq[3])/basePlaneDicEq[2];
+		Scalar c[4];
+		for(int i=0;i<4;++i)
+			c[i]=pmvdp(i,0)*x+pmvdp(i,1)*y+pmvdp(i,2)*d+pmvdp(i,3);
+		
+		/* Request full detail for blocks reaching behind the viewer: */
+		if(c[3]<=Scalar(0))
+			return Math::Constants<Scalar>::max;
+		for(int i=0;i<2;++i)
+			win[n][i]=c[i]/c[3]*Scalar(0.5)*Scalar(viewport[2+i]);
+		}
+	
+	/* Return the larger of the projected pixel sizes: */
+	Scalar dx2=Math::sqr(win[1][0]-win[0][0])+Math::sqr(win[1][1]-win[0][1]);
+	Scalar dy2=Math::sqr(win[2][0]-win[0][0])+Math::sqr(win[2][1]-win[0][1]);
+	return Math::sqrt(Math::max(dx2,dy2));
+	}
+
+void DepthImageRenderer::drawSurface(const PTransform& projectionModelviewDepthProjection,bool reduceDetail) const
+	{
+	GLVertexArrayParts::enable(Vertex::getPartsMask());
+	glVertexPointer(static_cast<const Vertex*>(0));
+	
+	unsigned int numBlocks=numMeshBlocks[1]*numMeshBlocks[0];
+	if(lodCellSize>0.0f)
+		{
+		/* Find the mesh blocks that might be visible: */
+		const PTransform::Matrix& m=projectionModelviewDepthProjection.getMatrix();
+		std::vector<bool> visibles(numBlocks);
+		std::vector<bool>::iterator vIt=visibles.begin();
+		for(unsigned int by=0;by<numMeshBlocks[1];++by)
+			for(unsigned int bx=0;bx<numMeshBlocks[0];++bx,++vIt)
+				*vIt=isMeshBlockVisible(m,bx,by);
+		
+		unsigned int level=0;
+		if(reduceDetail)
+			{
+			/* Find the projected size of depth image pixels in the visible block closest to the viewer: */
+			GLint viewport[4];
+			glGetIntegerv(GL_VIEWPORT,viewport);
+			Scalar maxDensity(0);
+			vIt=visibles.begin();
+			for(unsigned int by=0;by<numMeshBlocks[1];++by)
+				for(unsigned int bx=0;bx<numMeshBlocks[0];++bx,++vIt)
+					if(*vIt)
+						maxDensity=Math::max(maxDensity,calcMeshBlockDensity(m,viewport,bx,by));
+			
+			/* Use the coarsest level whose cells do not exceed the target projected size anywhere, so that all blocks share one level and the mesh has no cracks: */
+			while(level+1<numMeshLevels&&Scalar(1U<<(level+1))*maxDensity<=Scalar(lodCellSize))
+				++level;
+			}
+		
+		/* Draw each run of consecutive visible blocks as one piece of the level's triangle strip: */
+		const unsigned int* levelIndices=meshBlockIndices+level*numBlocks*2;
+		unsigned int block=0;
+		while(block<numBlocks)
+			{
+			/* Skip invisible blocks: */
+			while(block<numBlocks&&!visibles[block])
+				++block;
+			if(block==numBlocks)
+				break;
+			
+			/* Find the end of the run of visible blocks: */
+			unsigned int runStart=block;
+			while(block<numBlocks&&visibles[block])
+				++block;
+			glDrawElements(GL_TRIANGLE_STRIP,levelIndices[block*2-1]-levelIndices[runStart*2],GL_UNSIGNED_INT,static_cast<const GLuint*>(0)+levelIndices[runStart*2]);
+			}
+		}
+	else
+		{
+		/* Draw the full-detail level as a single triangle strip: */
+		glDrawElements(GL_TRIANGLE_STRIP,meshBlockIndices[numBlocks*2-1],GL_UNSIGNED_INT,static_cast<const GLuint*>(0));
+		}
+	
+	GLVertexArrayParts::disable(Vertex::getPartsMask());
+	}
+
 DepthImageRenderer::DepthImageRenderer(const unsigned int sDepthImageSize[2])
-	:depthImageVersion(0)
+	:spatialFilter(false),
+	 numAveragingSlots(0),pixelDepthCorrection(0),
+	 minNumSamples(0.0f),maxVariance(0.0f),hysteresis(0.0f),retainValids(true),instableValue(0.0f),
+	 depthUploadFormat(UPLOAD_FLOAT32),fixedDepthRange(2048.0f),
+	 lodCellSize(0.0f),meshBlockIndices(0),
+	 depthImageVersion(0),
+	 tileSize(FrameFilter::tileSize),tileVersions(0),filterFrameIndex(0)
 	{
 	/* Copy the depth image size: */
 	for(int i=0;i<2;++i)
+		{
 		depthImageSize[i]=sDepthImageSize[i];
+		depthImageSizeF[i]=GLfloat(depthImageSize[i]);
+		}
+	
+	/* Initialize the GPU temporal filter's valid depth planes: */
+	for(int i=0;i<4;++i)
+		{
+		minPlane[i]=0.0f;
+		maxPlane[i]=0.0f;
+		}
 	
 	/* Initialize the depth image: */
 	depthImage=Kinect::FrameBuffer(depthImageSize[0],depthImageSize[1],depthImageSize[1]*depthImageSize[0]*sizeof(float));
@@ -93,6 +804,45 @@ DepthImageRenderer::DepthImageRenderer(const unsigned int sDepthImageSize[2])
 		for(unsigned int x=0;x<depthImageSize[0];++x,++diPtr)
 			*diPtr=0.0f;
 	++depthImageVersion;
+	
+	/* Initialize the change tracking tiles: */
+	for(int i=0;i<2;++i)
+		numTiles[i]=(depthImageSize[i]+tileSize-1)/tileSize;
+	tileVersions=new unsigned int[numTiles[1]*numTiles[0]];
+	for(unsigned int i=0;i<numTiles[1]*numTiles[0];++i)
+		tileVersions[i]=depthImageVersion;
+	
+	/* Calculate the index ranges of the template mesh's blocks in all levels of detail; each level is one triangle strip whose rows and blocks are joined by degenerate triangles: */
+	for(int i=0;i<2;++i)
+		numMeshBlocks[i]=(depthImageSize[i]-1+meshBlockSize-1)/meshBlockSize;
+	meshBlockIndices=new unsigned int[numMeshLevels*numMeshBlocks[1]*numMeshBlocks[0]*2];
+	unsigned int* mbiPtr=meshBlockIndices;
+	unsigned int numIndices=0;
+	for(unsigned int level=0;level<numMeshLevels;++level)
+		{
+		unsigned int stride=1U<<level;
+		for(unsigned int by=0;by<numMeshBlocks[1];++by)
+			for(unsigned int bx=0;bx<numMeshBlocks[0];++bx,mbiPtr+=2)
+				{
+				/* Account for the degenerate triangles joining the block to the previous block of the same level: */
+				if(bx>0||by>0)
+					numIndices+=2;
+				
+				unsigned int box[4];
+				getMeshBlockBox(bx,by,box);
+				unsigned int nx=countMeshSamples(box[0],box[2],stride);
+				unsigned int ny=countMeshSamples(box[1],box[3],stride);
+				mbiPtr[0]=numIndices;
+				numIndices+=(ny-1)*nx*2+(ny-2)*2;
+				mbiPtr[1]=numIndices;
+				}
+		}
+	}
+
+DepthImageRenderer::~DepthImageRenderer(void)
+	{
+	delete[] tileVersions;
+	delete[] meshBlockIndices;
 	}
 
 void DepthImageRenderer::initContext(GLContextData& contextData) const
@@ -133,28 +883,240 @@ void DepthImageRenderer::initContext(GLContextData& contextData) const
 	glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
 	
-	/* Upload the surface's triangle indices into the index buffer: */
+	/* Upload the triangle strips of all mesh blocks in all levels of detail into the index buffer: */
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
-	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,(depthImageSize[1]-1)*depthImageSize[0]*2*sizeof(GLuint),0,GL_STATIC_DRAW_ARB);
+	unsigned int numIndices=meshBlockIndices[numMeshLevels*numMeshBlocks[1]*numMeshBlocks[0]*2-1];
+	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,numIndices*sizeof(GLuint),0,GL_STATIC_DRAW_ARB);
 	GLuint* iPtr=static_cast<GLuint*>(glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,GL_WRITE_ONLY_ARB));
-	for(unsigned int y=1;y<depthImageSize[1];++y)
-		for(unsigned int x=0;x<depthImageSize[0];++x,iPtr+=2)
-			{
-			iPtr[0]=GLuint(y*depthImageSize[0]+x);
-			iPtr[1]=GLuint((y-1)*depthImageSize[0]+x);
-			}
+	GLuint lastIndex=0;
+	for(unsigned int level=0;level<numMeshLevels;++level)
+		{
+		unsigned int stride=1U<<level;
+		for(unsigned int by=0;by<numMeshBlocks[1];++by)
+			for(unsigned int bx=0;bx<numMeshBlocks[0];++bx)
+				{
+				unsigned int box[4];
+				getMeshBlockBox(bx,by,box);
+				unsigned int nx=countMeshSamples(box[0],box[2],stride);
+				unsigned int ny=countMeshSamples(box[1],box[3],stride);
+				for(unsigned int j=1;j<ny;++j)
+					{
+					unsigned int y0=getMeshSample(box[1],box[3],stride,j-1);
+					unsigned int y1=getMeshSample(box[1],box[3],stride,j);
+					GLuint firstIndex=GLuint(y1*depthImageSize[0]+box[0]);
+					if(j>1||bx>0||by>0)
+						{
+						/* Join the row of quads to the previous one by repeating the previous row's last index and this row's first index: */
+						iPtr[0]=lastIndex;
+						iPtr[1]=firstIndex;
+						iPtr+=2;
+						}
+					
+					/* Store the row of quads as pairs of upper and lower vertices: */
+					for(unsigned int i=0;i<nx;++i,iPtr+=2)
+						{
+						unsigned int x=getMeshSample(box[0],box[2],stride,i);
+						iPtr[0]=GLuint(y1*depthImageSize[0]+x);
+						iPtr[1]=GLuint(y0*depthImageSize[0]+x);
+						}
+					lastIndex=GLuint(y0*depthImageSize[0]+box[2]);
+					}
+				}
+		}
 	glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,0);
 	
-	/* Initialize the depth image texture: */
+	/* Determine the format in which to stream depth images; raw depth frames for the GPU temporal filter are always streamed as 16-bit integers: */
+	size_t uploadPixelSize=sizeof(GLushort);
+	if(numAveragingSlots==0)
+		{
+		dataItem->uploadFormat=depthUploadFormat;
+		if(dataItem->uploadFormat==UPLOAD_FLOAT16&&!GLExtensionManager::isExtensionSupported("GL_ARB_half_float_pixel"))
+			dataItem->uploadFormat=UPLOAD_FLOAT32;
+		if(dataItem->uploadFormat==UPLOAD_FLOAT32)
+			uploadPixelSize=sizeof(GLfloat);
+		}
+	dataItem->uploadBufferSize=size_t(depthImageSize[1])*size_t(depthImageSize[0])*uploadPixelSize;
+	
+	/* Create the ring of upload buffers, persistently mapped if the context supports it: */
+	dataItem->persistentUploadBuffers=initPersistentMapping();
+	glGenBuffersARB(numUploadBuffers,dataItem->uploadBuffers);
+	for(unsigned int i=0;i<numUploadBuffers;++i)
+		{
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,dataItem->uploadBuffers[i]);
+		if(dataItem->persistentUploadBuffers)
+			{
+			bufferStorageProc(GL_PIXEL_UNPACK_BUFFER_ARB,dataItem->uploadBufferSize,0,GL_MAP_WRITE_BIT|GL_MAP_PERSISTENT_BIT|GL_MAP_COHERENT_BIT);
+			dataItem->uploadBufferPtrs[i]=mapBufferRangeProc(GL_PIXEL_UNPACK_BUFFER_ARB,0,dataItem->uploadBufferSize,GL_MAP_WRITE_BIT|GL_MAP_PERSISTENT_BIT|GL_MAP_COHERENT_BIT);
+			}
+		else
+			glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,dataItem->uploadBufferSize,0,GL_STREAM_DRAW_ARB);
+		}
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+	
+	/* Initialize the depth image texture, which must be renderable if it is written by a filter or expansion pass: */
+	bool renderDepthTexture=numAveragingSlots>0||spatialFilter||dataItem->uploadFormat==UPLOAD_FIXED16;
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_FLOAT,0);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,renderDepthTexture?GL_R32F:GL_LUMINANCE32F_ARB,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_FLOAT,0);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
+	if(dataItem->uploadFormat==UPLOAD_FIXED16)
+		{
+		/* Initialize the fixed-point depth image texture: */
+		glGenTextures(1,&dataItem->fixedDepthTexture);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->fixedDepthTexture);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R16,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_UNSIGNED_SHORT,0);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		
+		/* Create the expansion frame buffer; its attachment is set for every frame: */
+		glGenFramebuffersEXT(1,&dataItem->expandFramebufferObject);
+		
+		/* Create the expansion shader: */
+		dataItem->expandShader=compileFragmentShader("DepthExpandShader");
+		dataItem->expandShaderUniforms[0]=glGetUniformLocationARB(dataItem->expandShader,"fixedDepthSampler");
+		dataItem->expandShaderUniforms[1]=glGetUniformLocationARB(dataItem->expandShader,"depthRange");
+		}
+	
+	if(spatialFilter)
+		{
+		/* Initialize the unfiltered and intermediate depth image textures, which must be renderable: */
+		glGenTextures(2,dataItem->filterTextures);
+		for(int i=0;i<2;++i)
+			{
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->filterTextures[i]);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+			glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_FLOAT,0);
+			}
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		
+		/* Save the currently bound frame buffer: */
+		GLint currentFrameBuffer;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+		
+		/* Create the spatial filter frame buffer and attach the intermediate and final depth textures: */
+		glGenFramebuffersEXT(1,&dataItem->filterFramebufferObject);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->filterFramebufferObject);
+		for(int i=0;i<2;++i)
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->filterTextures[i],0);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+2,GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture,0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+		glReadBuffer(GL_NONE);
+		
+		/* Restore the previously bound frame buffer: */
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+		
+		/* Create the spatial filter shader: */
+		dataItem->spatialFilterShader=compileFragmentShader("DepthSpatialFilterShader");
+		dataItem->spatialFilterShaderUniforms[0]=glGetUniformLocationARB(dataItem->spatialFilterShader,"depthSampler");
+		dataItem->spatialFilterShaderUniforms[1]=glGetUniformLocationARB(dataItem->spatialFilterShader,"filterStep");
+		dataItem->spatialFilterShaderUniforms[2]=glGetUniformLocationARB(dataItem->spatialFilterShader,"imageSize");
+		}
+	
+	if(numAveragingSlots>0)
+		{
+		/* Initialize the raw depth frame texture: */
+		glGenTextures(1,&dataItem->rawDepthTexture);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->rawDepthTexture);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R16,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_UNSIGNED_SHORT,0);
+		
+		/* Upload the per-pixel depth correction coefficients: */
+		glGenTextures(1,&dataItem->depthCorrectionTexture);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthCorrectionTexture);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		GLfloat* dcBuffer=new GLfloat[depthImageSize[1]*depthImageSize[0]*2];
+		GLfloat* dcPtr=dcBuffer;
+		const PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
+		for(unsigned int i=depthImageSize[1]*depthImageSize[0];i>0;--i,dcPtr+=2,++pdcPtr)
+			{
+			dcPtr[0]=pdcPtr->scale;
+			dcPtr[1]=pdcPtr->offset;
+			}
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RG32F,depthImageSize[0],depthImageSize[1],0,GL_RG,GL_FLOAT,dcBuffer);
+		delete[] dcBuffer;
+		
+		/* Initialize the averaging slot textures, which must be renderable, with invalid samples: */
+		dataItem->numAveragingTextures=numAveragingSlots+1;
+		dataItem->averagingTextures=new GLuint[dataItem->numAveragingTextures];
+		glGenTextures(dataItem->numAveragingTextures,dataItem->averagingTextures);
+		GLushort* invalidBuffer=new GLushort[depthImageSize[1]*depthImageSize[0]];
+		for(unsigned int i=0;i<depthImageSize[1]*depthImageSize[0];++i)
+			invalidBuffer[i]=GLushort(65535U);
+		for(unsigned int i=0;i<dataItem->numAveragingTextures;++i)
+			{
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->averagingTextures[i]);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+			glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R16,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_UNSIGNED_SHORT,invalidBuffer);
+			}
+		delete[] invalidBuffer;
+		dataItem->averagingSlotIndex=0;
+		
+		/* Initialize the statistics textures with empty statistics, and the stable value textures with the base plane: */
+		GLfloat* stateBuffer=new GLfloat[depthImageSize[1]*depthImageSize[0]*4];
+		for(unsigned int i=0;i<depthImageSize[1]*depthImageSize[0]*4;++i)
+			stateBuffer[i]=0.0f;
+		glGenTextures(2,dataItem->statTextures);
+		for(int i=0;i<2;++i)
+			{
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->statTextures[i]);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+			glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGBA32F_ARB,depthImageSize[0],depthImageSize[1],0,GL_RGBA,GL_FLOAT,stateBuffer);
+			}
+		GLfloat* sbPtr=stateBuffer;
+		for(unsigned int y=0;y<depthImageSize[1];++y)
+			for(unsigned int x=0;x<depthImageSize[0];++x,++sbPtr)
+				*sbPtr=-((GLfloat(x)+0.5f)*basePlaneDicEq[0]+(GLfloat(y)+0.5f)*basePlaneDicEq[1]+basePlaneDicEq[3])/basePlaneDicEq[2];
+		glGenTextures(2,dataItem->validTextures);
+		for(int i=0;i<2;++i)
+			{
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->validTextures[i]);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+			glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+			glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_FLOAT,stateBuffer);
+			}
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		delete[] stateBuffer;
+		dataItem->currentState=0;
+		
+		/* Create the temporal filter frame buffer; its attachments are set for every frame: */
+		glGenFramebuffersEXT(1,&dataItem->temporalFilterFramebufferObject);
+		
+		/* Create the temporal filter shader: */
+		dataItem->temporalFilterShader=compileFragmentShader("DepthTemporalFilterShader");
+		static const char* uniformNames[12]=
+			{
+			"rawDepthSampler","depthCorrectionSampler","oldSampleSampler","statSampler","validSampler",
+			"minPlane","maxPlane","minNumSamples","maxVariance","hysteresis","retainValids","instableValue"
+			};
+		for(int i=0;i<12;++i)
+			dataItem->temporalFilterShaderUniforms[i]=glGetUniformLocationARB(dataItem->temporalFilterShader,uniformNames[i]);
+		}
+	
 	/* Create the depth rendering shader: */
 	dataItem->depthShader=linkVertexAndFragmentShader("SurfaceDepthShader");
 	dataItem->depthShaderUniforms[0]=glGetUniformLocationARB(dataItem->depthShader,"depthSampler");
@@ -222,11 +1184,84 @@ void DepthImageRenderer::setBasePlane(const Plane& newBasePlane)
 		basePlaneDicEq[i]=GLfloat(dpm(0,i)*bpn[0]+dpm(1,i)*bpn[1]+dpm(2,i)*bpn[2]-dpm(3,i)*bpo);
 	}
 
+void DepthImageRenderer::setSpatialFilter(bool newSpatialFilter)
+	{
+	spatialFilter=newSpatialFilter;
+	}
+
+void DepthImageRenderer::setTemporalFilter(unsigned int newNumAveragingSlots,const DepthImageRenderer::PixelDepthCorrection* newPixelDepthCorrection)
+	{
+	numAveragingSlots=newNumAveragingSlots;
+	pixelDepthCorrection=newPixelDepthCorrection;
+	}
+
+void DepthImageRenderer::setValidElevationInterval(double newMinElevation,double newMaxElevation)
+	{
+	/* Calculate the valid depth planes in depth image space the same way as the CPU-side frame filter: */
+	FrameFilter::calcValidElevationPlanes(depthProjection,basePlane,newMinElevation,newMaxElevation,minPlane,maxPlane);
+	}
+
+void DepthImageRenderer::setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance)
+	{
+	minNumSamples=GLfloat(newMinNumSamples);
+	maxVariance=GLfloat(newMaxVariance);
+	}
+
+void DepthImageRenderer::setHysteresis(float newHysteresis)
+	{
+	hysteresis=newHysteresis;
+	}
+
+void DepthImageRenderer::setRetainValids(bool newRetainValids)
+	{
+	retainValids=newRetainValids;
+	}
+
+void DepthImageRenderer::setInstableValue(float newInstableValue)
+	{
+	instableValue=newInstableValue;
+	}
+
+void DepthImageRenderer::setDepthUploadFormat(DepthImageRenderer::DepthUploadFormat newDepthUploadFormat,float newFixedDepthRange)
+	{
+	depthUploadFormat=newDepthUploadFormat;
+	fixedDepthRange=newFixedDepthRange;
+	}
+
+void DepthImageRenderer::setSurfaceLod(float newLodCellSize)
+	{
+	lodCellSize=newLodCellSize;
+	}
+
 void DepthImageRenderer::setDepthImage(const Kinect::FrameBuffer& newDepthImage)
 	{
 	/* Update the depth image: */
 	depthImage=newDepthImage;
 	++depthImageVersion;
+	
+	/* Mark all tiles as changed: */
+	for(unsigned int i=0;i<numTiles[1]*numTiles[0];++i)
+		tileVersions[i]=depthImageVersion;
+	}
+
+void DepthImageRenderer::setDepthImage(const Kinect::FrameBuffer& newDepthImage,const unsigned int* newTileVersions,unsigned int newFrameIndex)
+	{
+	/* Update the depth image; unchanged tiles hold the same values as before: */
+	depthImage=newDepthImage;
+	
+	/* Mark all tiles that changed since the previously received output frame, including in any output frames that were skipped: */
+	bool changed=false;
+	for(unsigned int i=0;i<numTiles[1]*numTiles[0];++i)
+		if(newTileVersions[i]>filterFrameIndex)
+			{
+			tileVersions[i]=depthImageVersion+1;
+			changed=true;
+			}
+	filterFrameIndex=newFrameIndex;
+	
+	/* Only create a new depth image version if anything changed, so that consumers can skip idle frames: */
+	if(changed)
+		++depthImageVersion;
 	}
 
 Scalar DepthImageRenderer::intersectLine(const Point& p0,const Point& p1,Scalar elevationMin,Scalar elevationMax) const
@@ -255,6 +1290,80 @@ Scalar DepthImageRenderer::intersectLine(const Point& p0,const Point& p1,Scalar
 	return Scalar(2);
 	}
 
+bool DepthImageRenderer::calcChangedRect(unsigned int sinceVersion,const PTransform& projectionModelview,const unsigned int viewportSize[2],int rect[4]) const
+	{
+	/* Get the box of changed pixels, and grow it by the GPU spatial filter's footprint, the surface triangles connecting it to its neighbors, and some slack for lens distortion correction: */
+	unsigned int box[4];
+	if(!getChangedPixelBox(sinceVersion,box))
+		return false;
+	Scalar bx0=Scalar(box[0])-Scalar(4);
+	Scalar by0=Scalar(box[1])-Scalar(4);
+	Scalar bx1=Scalar(box[2])+Scalar(4);
+	Scalar by1=Scalar(box[3])+Scalar(4);
+	
+	/* Calculate the combined projection, modelview, and depth projection matrix: */
+	PTransform pmvdp=projectionModelview;
+	pmvdp*=depthProjection;
+	const PTransform::Matrix& m=pmvdp.getMatrix();
+	
+	/* Project the box's corners and edge midpoints along their viewing rays at the depths where the rays cross the near and far planes: */
+	Scalar min[2],max[2];
+	bool haveProjection=false;
+	for(int iy=0;iy<3;++iy)
+		for(int ix=0;ix<3;++ix)
+			{
+			Scalar px=ix==0?bx0:(ix==1?Math::mid(bx0,bx1):bx1);
+			Scalar py=iy==0?by0:(iy==1?Math::mid(by0,by1):by1);
+			if(!lensDistortion.isIdentity())
+				{
+				/* Undistort the image point like the surface template's vertices: */
+				Kinect::LensDistortion::Point up=lensDistortion.undistortPixel(Kinect::LensDistortion::Point(Kinect::LensDistortion::Scalar(px),Kinect::LensDistortion::Scalar(py)));
+				px=Scalar(up[0]);
+				py=Scalar(up[1]);
+				}
+			
+			/* Clip-space position of the image point at depth zero and its change per unit of depth: */
+			Scalar a[4],b[4];
+			for(int i=0;i<4;++i)
+				{
+				a[i]=m(i,0)*px+m(i,1)*py+m(i,3);
+				b[i]=m(i,2);
+				}
+			for(int plane=-1;plane<=1;plane+=2)
+				{
+				Scalar denom=b[2]-Scalar(plane)*b[3];
+				if(denom==Scalar(0))
+					continue;
+				Scalar d=(Scalar(plane)*a[3]-a[2])/denom;
+				Scalar w=a[3]+d*b[3];
+				if(w<=Scalar(0))
+					continue;
+				for(int i=0;i<2;++i)
+					{
+					Scalar win=((a[i]+d*b[i])/w+Scalar(1))*Scalar(0.5)*Scalar(viewportSize[i]);
+					min[i]=haveProjection?Math::min(min[i],win):win;
+					max[i]=haveProjection?Math::max(max[i],win):win;
+					}
+				haveProjection=true;
+				}
+			}
+	
+	/* Convert the window-space bounding box to a pixel rectangle with a one-pixel margin and clamp it to the viewport: */
+	for(int i=0;i<2;++i)
+		{
+		if(!haveProjection)
+			{
+			/* Fall back to the entire viewport: */
+			min[i]=Scalar(0);
+			max[i]=Scalar(viewportSize[i]);
+			}
+		rect[i]=Math::max(int(Math::floor(min[i]))-1,0);
+		rect[2+i]=Math::min(int(Math::ceil(max[i]))+1,int(viewportSize[i]));
+		}
+	
+	return rect[0]<rect[2]&&rect[1]<rect[3];
+	}
+
 void DepthImageRenderer::uploadDepthProjection(GLint location) const
 	{
 	/* Upload the matrix to OpenGL: */
@@ -266,21 +1375,14 @@ void DepthImageRenderer::bindDepthTexture(GLContextData& contextData) const
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
+	/* Update the depth image texture: */
+	updateDepthTexture(dataItem);
+	
 	/* Bind the depth image texture: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
-	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
 	}
 
-void DepthImageRenderer::renderSurfaceTemplate(GLContextData& contextData) const
+void DepthImageRenderer::renderSurfaceTemplate(const PTransform& projectionModelviewDepthProjection,GLContextData& contextData) const
 	{
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
@@ -290,12 +1392,7 @@ void DepthImageRenderer::renderSurfaceTemplate(GLContextData& contextData) const
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
 	
 	/* Draw the surface template: */
-	GLVertexArrayParts::enable(Vertex::getPartsMask());
-	glVertexPointer(static_cast<const Vertex*>(0));
-	GLuint* indexPtr=0;
-	for(unsigned int y=1;y<depthImageSize[1];++y,indexPtr+=depthImageSize[0]*2)
-		glDrawElements(GL_QUAD_STRIP,depthImageSize[0]*2,GL_UNSIGNED_INT,indexPtr);
-	GLVertexArrayParts::disable(Vertex::getPartsMask());
+	drawSurface(projectionModelviewDepthProjection,true);
 	
 	/* Unbind the vertex and index buffers: */
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
@@ -307,6 +1404,9 @@ void DepthImageRenderer::renderDepth(const PTransform& projectionModelview,GLCon
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
+	/* Update the depth image texture: */
+	updateDepthTexture(dataItem);
+	
 	/* Bind the depth rendering shader: */
 	glUseProgramObjectARB(dataItem->depthShader);
 	
@@ -318,15 +1418,6 @@ void DepthImageRenderer::renderDepth(const PTransform& projectionModelview,GLCon
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
 	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
 	glUniform1iARB(dataItem->depthShaderUniforms[0],0); // Tell the shader that the depth texture is in texture unit 0
 	
 	/* Upload the combined projection, modelview, and depth projection matrix: */
@@ -335,12 +1426,7 @@ void DepthImageRenderer::renderDepth(const PTransform& projectionModelview,GLCon
 	glUniformARB(dataItem->depthShaderUniforms[1],pmvdp);
 	
 	/* Draw the surface: */
-	GLVertexArrayParts::enable(Vertex::getPartsMask());
-	glVertexPointer(static_cast<const Vertex*>(0));
-	GLuint* indexPtr=0;
-	for(unsigned int y=1;y<depthImageSize[1];++y,indexPtr+=depthImageSize[0]*2)
-		glDrawElements(GL_QUAD_STRIP,depthImageSize[0]*2,GL_UNSIGNED_INT,indexPtr);
-	GLVertexArrayParts::disable(Vertex::getPartsMask());
+	drawSurface(pmvdp,true);
 	
 	/* Unbind all textures and buffers: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
@@ -356,6 +1442,9 @@ void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,G
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
+	/* Update the depth image texture: */
+	updateDepthTexture(dataItem);
+	
 	/* Bind the elevation rendering shader: */
 	glUseProgramObjectARB(dataItem->elevationShader);
 	
@@ -363,15 +1452,6 @@ void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,G
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
 	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
 	glUniform1iARB(dataItem->elevationShaderUniforms[0],0); // Tell the shader that the depth texture is in texture unit 0
 	
 	/* Upload the base plane equation in depth image space: */
@@ -389,13 +1469,8 @@ void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,G
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB,dataItem->vertexBuffer);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
 	
-	/* Draw the surface: */
-	GLVertexArrayParts::enable(Vertex::getPartsMask());
-	glVertexPointer(static_cast<const Vertex*>(0));
-	GLuint* indexPtr=0;
-	for(unsigned int y=1;y<depthImageSize[1];++y,indexPtr+=depthImageSize[0]*2)
-		glDrawElements(GL_QUAD_STRIP,depthImageSize[0]*2,GL_UNSIGNED_INT,indexPtr);
-	GLVertexArrayParts::disable(Vertex::getPartsMask());
+	/* Draw the surface at full detail, as elevation images are resampled by the water table and contour line renderer: */
+	drawSurface(pmvdp,false);
 	
 	/* Unbind all textures and buffers: */
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
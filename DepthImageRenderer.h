@@ -32,12 +32,26 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Kinect/FrameSource.h>
 
 #include "Types.h"
+#include "ShaderHelper.h"
 
 class DepthImageRenderer:public GLObject
 	{
 	/* Embedded classes: */
+	public:
+	typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
+	
+	enum DepthUploadFormat // Enumerated type for pixel formats in which filtered depth images are streamed to the GPU
+		{
+		UPLOAD_FLOAT32, // Full-precision 32-bit floating-point depth values
+		UPLOAD_FLOAT16, // 16-bit half-float depth values
+		UPLOAD_FIXED16 // 16-bit fixed-point depth values over a fixed depth range, expanded to floating-point on the GPU
+		};
+	
 	private:
 	typedef GLGeometry::Vertex<void,0,void,0,void,GLfloat,2> Vertex; // Type for template vertices
+	static const unsigned int meshBlockSize=32; // Width and height of the square blocks of template mesh cells that are culled together
+	static const unsigned int numMeshLevels=4; // Number of levels of detail of the template mesh, with vertex strides of 1, 2, 4, and 8 pixels
+	static const unsigned int numUploadBuffers=3; // Number of pixel buffer objects in the depth image upload ring
 	
 	struct DataItem:public GLObject::DataItem // Structure storing per-context OpenGL state
 		{
@@ -46,15 +60,41 @@ class DepthImageRenderer:public GLObject
 		
 		/* OpenGL state management: */
 		GLuint vertexBuffer; // ID of vertex buffer object holding surface's template vertices
-		GLuint indexBuffer; // ID of index buffer object holding surface's triangles
+		GLuint indexBuffer; // ID of index buffer object holding surface's triangle strips for all mesh blocks and levels of detail
 		GLuint depthTexture; // ID of texture object holding surface's vertex elevations in depth image space
 		unsigned int depthTextureVersion; // Version number of the depth image texture
+		GLuint filterTextures[2]; // IDs of texture objects holding the unfiltered and intermediate depth images for GPU spatial filtering
+		GLuint filterFramebufferObject; // ID of frame buffer object used to run the spatial filter passes
+		GLuint rawDepthTexture; // ID of texture object holding the most recent raw depth frame for GPU temporal filtering
+		GLuint depthCorrectionTexture; // ID of texture object holding per-pixel depth correction coefficients
+		unsigned int numAveragingTextures; // Number of averaging slot textures, including one spare texture
+		GLuint* averagingTextures; // Array of IDs of texture objects holding the temporal filter's averaging slots, followed by a spare
+		unsigned int averagingSlotIndex; // Index of averaging slot in which to store the next frame's depth values
+		GLuint statTextures[2]; // IDs of texture objects holding per-pixel sample statistics
+		GLuint validTextures[2]; // IDs of texture objects holding the most recent stable depth value of each pixel
+		int currentState; // Index of the statistics and valid textures holding the current temporal filter state
+		GLuint temporalFilterFramebufferObject; // ID of frame buffer object used to run the temporal filter
+		DepthUploadFormat uploadFormat; // Pixel format in which filtered depth images are streamed into this context
+		size_t uploadBufferSize; // Size of each upload buffer in bytes
+		bool persistentUploadBuffers; // Flag whether the upload buffers are persistently mapped
+		GLuint uploadBuffers[numUploadBuffers]; // IDs of the ring of pixel buffer objects through which depth images are streamed to the GPU
+		void* uploadBufferPtrs[numUploadBuffers]; // Persistent mappings of the upload buffers, or null if buffers are mapped for each upload
+		GLsync uploadFences[numUploadBuffers]; // Fences signalled when the GPU has finished reading from each persistently mapped upload buffer
+		unsigned int nextUploadBuffer; // Index of the upload buffer to be written next
+		GLuint fixedDepthTexture; // ID of texture object receiving fixed-point depth images before expansion
+		GLuint expandFramebufferObject; // ID of frame buffer object used to expand fixed-point depth images
 		
 		/* GLSL shader management: */
 		GLhandleARB depthShader; // Shader program to render the surface's depth only
 		GLint depthShaderUniforms[2]; // Locations of the depth shader's uniform variables
 		GLhandleARB elevationShader; // Shader program to render the surface's elevation relative to a plane
 		GLint elevationShaderUniforms[4]; // Locations of the elevation shader's uniform variables
+		GLhandleARB spatialFilterShader; // Shader program to run one pass of the spatial low-pass filter
+		GLint spatialFilterShaderUniforms[3]; // Locations of the spatial filter shader's uniform variables
+		GLhandleARB temporalFilterShader; // Shader program to run the temporal filter on a raw depth frame
+		GLint temporalFilterShaderUniforms[12]; // Locations of the temporal filter shader's uniform variables
+		GLhandleARB expandShader; // Shader program to expand fixed-point depth images to floating-point
+		GLint expandShaderUniforms[2]; // Locations of the expansion shader's uniform variables
 		
 		/* Constructors and destructors: */
 		DataItem(void);
@@ -63,20 +103,57 @@ class DepthImageRenderer:public GLObject
 	
 	/* Elements: */
 	unsigned int depthImageSize[2]; // Size of depth image texture
+	GLfloat depthImageSizeF[2]; // Same, in GLSL-compatible format
 	Kinect::LensDistortion lensDistortion; // 2D lens distortion parameters
 	PTransform depthProjection; // Projection matrix from depth image space into 3D camera space
 	GLfloat depthProjectionMatrix[16]; // Same, in GLSL-compatible format
 	GLfloat weightDicEq[4]; // Equation to calculate the weight of a depth image-space point in 3D camera space
 	Plane basePlane; // Base plane to calculate surface elevation
 	GLfloat basePlaneDicEq[4]; // Base plane equation in depth image space in GLSL-compatible format
+	bool spatialFilter; // Flag whether to apply a spatial low-pass filter to depth images while uploading them
+	unsigned int numAveragingSlots; // Number of averaging slots of the GPU temporal filter; 0 if depth images are filtered elsewhere
+	const PixelDepthCorrection* pixelDepthCorrection; // Buffer of per-pixel depth correction coefficients for the GPU temporal filter
+	GLfloat minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
+	GLfloat maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
+	GLfloat minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
+	GLfloat maxVariance; // Maximum variance to consider a pixel stable
+	GLfloat hysteresis; // Amount by which a new filtered value has to differ from the current value to update
+	bool retainValids; // Flag whether to retain previous stable values if a new pixel in instable, or reset to a default value
+	GLfloat instableValue; // Value to assign to instable pixels if retainValids is false
+	DepthUploadFormat depthUploadFormat; // Requested pixel format in which filtered depth images are streamed to the GPU
+	GLfloat fixedDepthRange; // Depth value represented by the largest fixed-point value if depth images are streamed as fixed-point
+	GLfloat lodCellSize; // Projected size of template mesh cells in window pixels up to which the mesh's level of detail is reduced; 0 disables culling and level of detail
+	unsigned int numMeshBlocks[2]; // Number of template mesh blocks horizontally and vertically
+	unsigned int* meshBlockIndices; // Array of index ranges of the triangle strip of each mesh block in each level of detail, as first index and end index
 	
 	/* Transient state: */
-	Kinect::FrameBuffer depthImage; // The most recent float-pixel depth image
+	Kinect::FrameBuffer depthImage; // The most recent float-pixel depth image, or raw depth frame if the GPU temporal filter is enabled
 	unsigned int depthImageVersion; // Version number of the depth image
+	unsigned int tileSize; // Width and height of the square pixel tiles in which depth image changes are tracked
+	unsigned int numTiles[2]; // Number of change tracking tiles horizontally and vertically
+	unsigned int* tileVersions; // Version number of the depth image in which each tile last changed
+	unsigned int filterFrameIndex; // Index of the most recent frame filter output frame received
+	
+	/* Private methods: */
+	void* mapUploadBuffer(DataItem* dataItem) const; // Binds the next upload buffer as the pixel unpack buffer and returns a pointer to write its contents, or null on failure
+	void unmapUploadBuffer(DataItem* dataItem) const; // Finishes writing into the bound upload buffer before textures are updated from it
+	void releaseUploadBuffer(DataItem* dataItem) const; // Fences the bound upload buffer after textures were updated from it, unbinds it, and advances the upload ring
+	void writeUploadPixels(const DataItem* dataItem,void* buffer,const unsigned int rect[4]) const; // Converts the given sub-rectangle of the current depth image into the given upload buffer in the data item's upload format
+	void expandFixedDepthImage(DataItem* dataItem,GLuint outputTexture) const; // Expands the fixed-point depth texture into the given floating-point texture
+	void runTemporalFilter(DataItem* dataItem,GLuint outputTexture) const; // Enters the current raw depth frame into the GPU temporal filter and writes the filtered depth image into the given texture
+	void runSpatialFilter(DataItem* dataItem) const; // Low-pass filters the unfiltered depth texture into the depth texture
+	void uploadDepthImage(DataItem* dataItem,GLuint texture) const; // Uploads all tiles of the current depth image that changed since the data item's texture version into the given texture
+	bool getChangedPixelBox(unsigned int sinceVersion,unsigned int box[4]) const; // Returns the bounding box of pixels in tiles that changed after the given depth image version as min x, min y, max x, max y (exclusive); returns false if no tiles changed
+	void updateDepthTexture(DataItem* dataItem) const; // Uploads the current depth image into the depth texture if the texture is outdated
+	void getMeshBlockBox(unsigned int bx,unsigned int by,unsigned int box[4]) const; // Returns the range of template vertices covered by the given mesh block as min x, min y, max x, max y (inclusive)
+	bool isMeshBlockVisible(const PTransform::Matrix& pmvdp,unsigned int bx,unsigned int by) const; // Returns true if the given mesh block might be visible under the given combined projection, modelview, and depth projection matrix
+	Scalar calcMeshBlockDensity(const PTransform::Matrix& pmvdp,const GLint viewport[4],unsigned int bx,unsigned int by) const; // Returns the projected size of one depth image pixel at the center of the given mesh block in window pixels
+	void drawSurface(const PTransform& projectionModelviewDepthProjection,bool reduceDetail) const; // Draws the template mesh from the bound vertex and index buffers, culled against the view frustum and optionally at reduced detail if level of detail is enabled
 	
 	/* Constructors and destructors: */
 	public:
 	DepthImageRenderer(const unsigned int sDepthImageSize[2]); // Creates an elevation renderer for the given depth image size
+	virtual ~DepthImageRenderer(void); // Destroys the elevation renderer
 	
 	/* Methods from GLObject: */
 	virtual void initContext(GLContextData& contextData) const;
@@ -101,15 +178,38 @@ class DepthImageRenderer:public GLObject
 	void setDepthProjection(const PTransform& newDepthProjection); // Sets a new depth unprojection matrix
 	void setIntrinsics(const Kinect::FrameSource::IntrinsicParameters& ips); // Sets a new depth unprojection matrix and, if present, 2D lens distortion parameters
 	void setBasePlane(const Plane& newBasePlane); // Sets a new base plane for elevation rendering
-	void setDepthImage(const Kinect::FrameBuffer& newDepthImage); // Sets a new depth image for subsequent surface rendering
+	void setSpatialFilter(bool newSpatialFilter); // Sets whether depth images are low-pass filtered on the GPU; must be called before the renderer's OpenGL context is initialized
+	void setTemporalFilter(unsigned int newNumAveragingSlots,const PixelDepthCorrection* newPixelDepthCorrection); // Enables the GPU temporal filter with the given running average length, counted in rendered frames as only the most recent depth frame is filtered when a context renders; depth frames must have 16-bit pixels; must be called before the renderer's OpenGL context is initialized
+	void setValidElevationInterval(double newMinElevation,double newMaxElevation); // Sets the interval of elevations relative to the base plane considered by the GPU temporal filter
+	void setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance); // Sets the statistical properties to consider a pixel stable in the GPU temporal filter
+	void setHysteresis(float newHysteresis); // Sets the GPU temporal filter's stable value hysteresis envelope
+	void setRetainValids(bool newRetainValids); // Sets whether the GPU temporal filter retains previous stable values for instable pixels
+	void setInstableValue(float newInstableValue); // Sets the depth value the GPU temporal filter assigns to instable pixels
+	void setDepthUploadFormat(DepthUploadFormat newDepthUploadFormat,float newFixedDepthRange); // Sets the pixel format in which filtered depth images are streamed to the GPU, and the depth range covered by fixed-point values; must be called before the renderer's OpenGL context is initialized
+	void setSurfaceLod(float newLodCellSize); // Enables view frustum culling and reduced detail of the template mesh up to the given projected cell size in window pixels; 0 disables both
+	void setDepthImage(const Kinect::FrameBuffer& newDepthImage); // Sets a new depth image, or a new raw depth frame if the GPU temporal filter is enabled, for subsequent surface rendering
+	void setDepthImage(const Kinect::FrameBuffer& newDepthImage,const unsigned int* newTileVersions,unsigned int newFrameIndex); // Sets a new filtered depth image whose per-tile output frame indices of last change are given in the frame filter's tile layout; only updates changed tiles
 	Scalar intersectLine(const Point& p0,const Point& p1,Scalar elevationMin,Scalar elevationMax) const; // Intersects a line segment with the current depth image in camera space; returns intersection point's parameter along line
 	unsigned int getDepthImageVersion(void) const // Returns the version number of the current depth image
 		{
 		return depthImageVersion;
 		}
+	unsigned int getTileSize(void) const // Returns the width and height of the square pixel tiles in which depth image changes are tracked
+		{
+		return tileSize;
+		}
+	const unsigned int* getNumTiles(void) const // Returns the number of change tracking tiles horizontally and vertically
+		{
+		return numTiles;
+		}
+	const unsigned int* getTileVersions(void) const // Returns the version number of the depth image in which each tile last changed, in row-major order
+		{
+		return tileVersions;
+		}
+	bool calcChangedRect(unsigned int sinceVersion,const PTransform& projectionModelview,const unsigned int viewportSize[2],int rect[4]) const; // Calculates the rectangle of the given viewport covered by those parts of the surface that changed after the given depth image version under the given projection as min x, min y, max x, max y (exclusive); returns false if the rectangle is empty
 	void uploadDepthProjection(GLint location) const; // Uploads the depth unprojection matrix into the GLSL 4x4 matrix at the given uniform location
 	void bindDepthTexture(GLContextData& contextData) const; // Binds the up-to-date depth texture image to the currently active texture unit
-	void renderSurfaceTemplate(GLContextData& contextData) const; // Renders the template quad strip mesh using current OpenGL settings
+	void renderSurfaceTemplate(const PTransform& projectionModelviewDepthProjection,GLContextData& contextData) const; // Renders the template mesh using current OpenGL settings and the given combined projection, modelview, and depth projection matrix
 	void renderDepth(const PTransform& projectionModelview,GLContextData& contextData) const; // Renders the surface into a pure depth buffer, for early z culling or shadow passes etc.
 	void renderElevation(const PTransform& projectionModelview,GLContextData& contextData) const; // Renders the surface's elevation relative to the base plane into the current one-component floating-point valued frame buffer
 	};
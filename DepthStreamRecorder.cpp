@@ -0,0 +1,122 @@
+/***********************************************************************
+DepthStreamRecorder - Class to record raw depth frames, together with
+the camera and sandbox metadata needed to process them, into a chunked
+depth stream file for later replay.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "DepthStreamRecorder.h"
+
+#include <IO/OpenFile.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void writeMatrix(IO::File& file,const PTransform& transform)
+	{
+	/* Write the transformation's matrix in row-major order: */
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+			file.write<Misc::Float64>(transform.getMatrix()(i,j));
+	}
+
+}
+
+/********************************************
+Static elements of class DepthStreamRecorder:
+********************************************/
+
+const char DepthStreamRecorder::fileSignature[8]={'S','B','X','D','E','P','T','H'};
+
+/************************************
+Methods of class DepthStreamRecorder:
+************************************/
+
+DepthStreamRecorder::DepthStreamRecorder(const char* fileName,const unsigned int sFrameSize[2],FrameFilter::DepthPixelType depthPixelType,const Kinect::FrameSource::IntrinsicParameters& ips,const Plane& basePlane,const DepthStreamRecorder::PixelDepthCorrection* pixelDepthCorrection)
+	:file(IO::openFile(fileName,IO::File::WriteOnly)),
+	 numFrames(0),lastTimeStamp(0.0)
+	{
+	/* Remember the frame size: */
+	for(int i=0;i<2;++i)
+		frameSize[i]=sFrameSize[i];
+	unsigned int bytesPerPixel=getBytesPerPixel(depthPixelType);
+	frameDataSize=size_t(frameSize[1])*size_t(frameSize[0])*bytesPerPixel;
+	
+	/* Write the file header: */
+	file->setEndianness(Misc::LittleEndian);
+	file->write(fileSignature,8);
+	file->write<Misc::UInt32>(fileVersion);
+	for(int i=0;i<2;++i)
+		file->write<Misc::UInt32>(frameSize[i]);
+	file->write<Misc::UInt32>(Misc::UInt32(depthPixelType));
+	file->write<Misc::UInt32>(bytesPerPixel);
+	writeMatrix(*file,ips.depthProjection);
+	writeMatrix(*file,ips.colorProjection);
+	for(int i=0;i<3;++i)
+		file->write<Misc::Float64>(basePlane.getNormal()[i]);
+	file->write<Misc::Float64>(basePlane.getOffset());
+	
+	/* Write the per-pixel depth correction coefficients: */
+	const PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
+	for(unsigned int i=0;i<frameSize[1]*frameSize[0];++i,++pdcPtr)
+		{
+		file->write<Misc::Float32>(pdcPtr->scale);
+		file->write<Misc::Float32>(pdcPtr->offset);
+		}
+	}
+
+DepthStreamRecorder::~DepthStreamRecorder(void)
+	{
+	/* Nothing to do; the file is closed when its last reference goes away */
+	}
+
+unsigned int DepthStreamRecorder::getBytesPerPixel(FrameFilter::DepthPixelType depthPixelType)
+	{
+	return depthPixelType==FrameFilter::FLOAT_DEPTH?sizeof(Misc::Float32):sizeof(Misc::UInt16);
+	}
+
+void DepthStreamRecorder::receiveRawFrame(const Kinect::FrameBuffer& frame)
+	{
+	/* Write the frame chunk's header: */
+	file->write<Misc::UInt32>(frameChunkType);
+	file->write<Misc::UInt32>(Misc::UInt32(frameDataSize));
+	file->write<Misc::Float64>(frame.timeStamp);
+	
+	/* Write the frame's pixels: */
+	size_t numPixels=size_t(frameSize[1])*size_t(frameSize[0]);
+	if(frameDataSize==numPixels*sizeof(Misc::Float32))
+		file->write(frame.getData<Misc::Float32>(),numPixels);
+	else
+		file->write(frame.getData<Misc::UInt16>(),numPixels);
+	
+	++numFrames;
+	lastTimeStamp=frame.timeStamp;
+	}
+
+void DepthStreamRecorder::writeNumDroppedFrames(unsigned int numDroppedFrames)
+	{
+	/* Write a dropped frames chunk stamped with the last recorded frame's time: */
+	file->write<Misc::UInt32>(droppedFramesChunkType);
+	file->write<Misc::UInt32>(Misc::UInt32(sizeof(Misc::UInt32)));
+	file->write<Misc::Float64>(lastTimeStamp);
+	file->write<Misc::UInt32>(Misc::UInt32(numDroppedFrames));
+	}
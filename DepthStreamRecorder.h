@@ -0,0 +1,91 @@
+/***********************************************************************
+DepthStreamRecorder - Class to record raw depth frames, together with
+the camera and sandbox metadata needed to process them, into a chunked
+depth stream file for later replay.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+/***********************************************************************
+Depth stream files are little-endian and consist of a fixed-size header
+followed by a sequence of chunks:
+- Header: 8-byte signature "SBXDEPTH", UInt32 format version, UInt32
+  frame width and height, UInt32 depth pixel type (FrameFilter::
+  DepthPixelType), UInt32 bytes per pixel, 16 Float64 depth projection
+  and 16 Float64 color projection matrix entries in row-major order,
+  4 Float64 base plane equation coefficients (normal and offset), and
+  width*height Float32 (scale, offset) per-pixel depth correction pairs.
+- Chunk: UInt32 chunk type, UInt32 payload size, Float64 time stamp,
+  followed by the payload. Frame chunks hold one raw depth frame of
+  width*height pixels. A dropped frames chunk at the end of the file
+  holds the UInt32 number of frames that were lost before they could be
+  recorded. Readers skip chunks of unknown types.
+***********************************************************************/
+
+#ifndef DEPTHSTREAMRECORDER_INCLUDED
+#define DEPTHSTREAMRECORDER_INCLUDED
+
+#include <Misc/SizedTypes.h>
+#include <IO/File.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+
+#include "Types.h"
+#include "FrameFilter.h"
+
+class DepthStreamRecorder
+	{
+	/* Embedded classes: */
+	public:
+	typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
+	
+	static const char fileSignature[8]; // Signature at the beginning of depth stream files
+	static const Misc::UInt32 fileVersion=1U; // Current depth stream file format version
+	static const unsigned int headerSize=8+5*4+(16+16+4)*8; // Size of a depth stream file header without the per-pixel depth correction pairs
+	static const Misc::UInt32 frameChunkType=0x4d415246U; // Type of chunks holding one raw depth frame ("FRAM" in file order)
+	static const Misc::UInt32 droppedFramesChunkType=0x504f5244U; // Type of chunks holding the number of frames that were not recorded ("DROP" in file order)
+	static const unsigned int chunkHeaderSize=2*4+8; // Size of a chunk header preceding the chunk's payload
+	
+	/* Elements: */
+	private:
+	IO::FilePtr file; // The depth stream file
+	unsigned int frameSize[2]; // Width and height of recorded frames
+	size_t frameDataSize; // Size of a recorded frame's pixel data in bytes
+	unsigned int numFrames; // Number of frames recorded so far
+	double lastTimeStamp; // Time stamp of the most recently recorded frame
+	
+	/* Constructors and destructors: */
+	public:
+	DepthStreamRecorder(const char* fileName,const unsigned int sFrameSize[2],FrameFilter::DepthPixelType depthPixelType,const Kinect::FrameSource::IntrinsicParameters& ips,const Plane& basePlane,const PixelDepthCorrection* pixelDepthCorrection); // Creates a depth stream file of the given name and writes the given metadata into its header
+	private:
+	DepthStreamRecorder(const DepthStreamRecorder& source); // Prohibit copy constructor
+	DepthStreamRecorder& operator=(const DepthStreamRecorder& source); // Prohibit assignment operator
+	public:
+	~DepthStreamRecorder(void); // Closes the depth stream file
+	
+	/* Methods: */
+	static unsigned int getBytesPerPixel(FrameFilter::DepthPixelType depthPixelType); // Returns the size of raw depth pixels of the given type
+	unsigned int getNumFrames(void) const // Returns the number of frames recorded so far
+		{
+		return numFrames;
+		}
+	void receiveRawFrame(const Kinect::FrameBuffer& frame); // Appends the given raw depth frame to the depth stream file; must not be called concurrently
+	void writeNumDroppedFrames(unsigned int numDroppedFrames); // Appends the number of frames that were dropped before they reached the recorder to the depth stream file; must be called after the last frame was recorded
+	};
+
+#endif
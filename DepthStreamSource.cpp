@@ -0,0 +1,239 @@
+/***********************************************************************
+DepthStreamSource - Class to replay raw depth frames from a memory-mapped
+depth stream file written by DepthStreamRecorder, at recorded or maximum
+speed.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "DepthStreamSource.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <Misc/SizedTypes.h>
+#include <Misc/FunctionCalls.h>
+#include <Misc/ThrowStdErr.h>
+#include <Kinect/FrameBuffer.h>
+
+#include "DepthStreamRecorder.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+template <class ValueParam>
+inline ValueParam readValue(const unsigned char*& dataPtr)
+	{
+	/* Read an unaligned little-endian value; depth stream files are only replayed on little-endian hosts: */
+	ValueParam result;
+	memcpy(&result,dataPtr,sizeof(ValueParam));
+	dataPtr+=sizeof(ValueParam);
+	return result;
+	}
+
+PTransform readMatrix(const unsigned char*& dataPtr)
+	{
+	/* Read a transformation's matrix in row-major order: */
+	Misc::Float64 matrix[16];
+	for(int i=0;i<16;++i)
+		matrix[i]=readValue<Misc::Float64>(dataPtr);
+	return PTransform::fromRowMajor(matrix);
+	}
+
+double getMonotonicTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)/1.0e9;
+	}
+
+}
+
+/**********************************
+Methods of class DepthStreamSource:
+**********************************/
+
+void* DepthStreamSource::streamingThreadMethod(void)
+	{
+	/* Replay all frames once, starting the recorded clock at the first frame: */
+	double replayStart=getMonotonicTime();
+	for(size_t i=0;i<frameOffsets.size()&&runStreamingThread;++i)
+		{
+		/* Wait until the frame's recorded time relative to the first frame, in short naps to stay responsive to shutdown: */
+		while(!maxSpeed&&runStreamingThread)
+			{
+			double delay=(frameTimeStamps[i]-frameTimeStamps[0])-(getMonotonicTime()-replayStart);
+			if(delay<=0.0)
+				break;
+			usleep(useconds_t((delay<0.1?delay:0.1)*1.0e6));
+			}
+		if(!runStreamingThread)
+			break;
+		
+		/* Copy the frame's pixels out of the mapped file and pass them to the callback: */
+		Kinect::FrameBuffer frame(frameSize[0],frameSize[1],frameDataSize);
+		memcpy(frame.getData<unsigned char>(),fileData+frameOffsets[i],frameDataSize);
+		frame.timeStamp=frameTimeStamps[i];
+		(*depthStreamingCallback)(frame);
+		}
+	
+	return 0;
+	}
+
+DepthStreamSource::DepthStreamSource(const char* fileName)
+	:fd(-1),fileSize(0),fileData(0),
+	 pixelDepthCorrection(0),
+	 maxSpeed(false),
+	 depthStreamingCallback(0),runStreamingThread(false)
+	{
+	/* Open and map the depth stream file: */
+	fd=open(fileName,O_RDONLY);
+	if(fd<0)
+		Misc::throwStdErr("DepthStreamSource: Unable to open depth stream file %s",fileName);
+	struct stat fileStats;
+	if(fstat(fd,&fileStats)<0||size_t(fileStats.st_size)<DepthStreamRecorder::headerSize)
+		{
+		close(fd);
+		Misc::throwStdErr("DepthStreamSource: %s is not a depth stream file",fileName);
+		}
+	fileSize=size_t(fileStats.st_size);
+	void* mapping=mmap(0,fileSize,PROT_READ,MAP_PRIVATE,fd,0);
+	if(mapping==MAP_FAILED)
+		{
+		close(fd);
+		Misc::throwStdErr("DepthStreamSource: Unable to map depth stream file %s",fileName);
+		}
+	fileData=static_cast<const unsigned char*>(mapping);
+	
+	/* Check the file header: */
+	const unsigned char* dataPtr=fileData;
+	bool signatureMatches=memcmp(dataPtr,DepthStreamRecorder::fileSignature,8)==0;
+	dataPtr+=8;
+	if(!signatureMatches||readValue<Misc::UInt32>(dataPtr)!=DepthStreamRecorder::fileVersion)
+		{
+		munmap(mapping,fileSize);
+		close(fd);
+		Misc::throwStdErr("DepthStreamSource: %s is not a depth stream file of a supported version",fileName);
+		}
+	
+	/* Read the frame layout: */
+	for(int i=0;i<2;++i)
+		frameSize[i]=readValue<Misc::UInt32>(dataPtr);
+	depthPixelType=FrameFilter::DepthPixelType(readValue<Misc::UInt32>(dataPtr));
+	unsigned int bytesPerPixel=readValue<Misc::UInt32>(dataPtr);
+	frameDataSize=size_t(frameSize[1])*size_t(frameSize[0])*bytesPerPixel;
+	
+	/* Read the recorded metadata: */
+	ips.depthProjection=readMatrix(dataPtr);
+	ips.colorProjection=readMatrix(dataPtr);
+	Plane::Vector normal;
+	for(int i=0;i<3;++i)
+		normal[i]=readValue<Misc::Float64>(dataPtr);
+	basePlane=Plane(normal,readValue<Misc::Float64>(dataPtr));
+	size_t numPixels=size_t(frameSize[1])*size_t(frameSize[0]);
+	if(fileSize<DepthStreamRecorder::headerSize+numPixels*2*sizeof(Misc::Float32))
+		{
+		munmap(mapping,fileSize);
+		close(fd);
+		Misc::throwStdErr("DepthStreamSource: Truncated depth stream file %s",fileName);
+		}
+	pixelDepthCorrection=new PixelDepthCorrection[numPixels];
+	for(size_t i=0;i<numPixels;++i)
+		{
+		pixelDepthCorrection[i].scale=readValue<Misc::Float32>(dataPtr);
+		pixelDepthCorrection[i].offset=readValue<Misc::Float32>(dataPtr);
+		}
+	
+	/* Index all complete frame chunks, skipping chunks of unknown types: */
+	size_t offset=dataPtr-fileData;
+	while(offset+DepthStreamRecorder::chunkHeaderSize<=fileSize)
+		{
+		const unsigned char* chunkPtr=fileData+offset;
+		Misc::UInt32 chunkType=readValue<Misc::UInt32>(chunkPtr);
+		size_t payloadSize=readValue<Misc::UInt32>(chunkPtr);
+		double timeStamp=readValue<Misc::Float64>(chunkPtr);
+		offset+=DepthStreamRecorder::chunkHeaderSize;
+		if(offset+payloadSize>fileSize)
+			break;
+		if(chunkType==DepthStreamRecorder::frameChunkType&&payloadSize==frameDataSize)
+			{
+			frameOffsets.push_back(offset);
+			frameTimeStamps.push_back(timeStamp);
+			}
+		offset+=payloadSize;
+		}
+	}
+
+DepthStreamSource::~DepthStreamSource(void)
+	{
+	stopStreaming();
+	
+	/* Release the memory-mapped file: */
+	munmap(const_cast<unsigned char*>(fileData),fileSize);
+	close(fd);
+	delete[] pixelDepthCorrection;
+	}
+
+DepthStreamSource::IntrinsicParameters DepthStreamSource::getIntrinsicParameters(void)
+	{
+	return ips;
+	}
+
+const unsigned int* DepthStreamSource::getActualFrameSize(int sensor) const
+	{
+	/* Depth stream files do not contain color frames; report the depth frame size for both sensors: */
+	return frameSize;
+	}
+
+void DepthStreamSource::startStreaming(Kinect::FrameSource::StreamingCallback* newColorStreamingCallback,Kinect::FrameSource::StreamingCallback* newDepthStreamingCallback)
+	{
+	/* Depth stream files do not contain color frames: */
+	delete newColorStreamingCallback;
+	
+	/* Start the replay thread if there is a callback to receive frames: */
+	depthStreamingCallback=newDepthStreamingCallback;
+	if(depthStreamingCallback!=0)
+		{
+		runStreamingThread=true;
+		streamingThread.start(this,&DepthStreamSource::streamingThreadMethod);
+		}
+	}
+
+void DepthStreamSource::stopStreaming(void)
+	{
+	/* Shut down the replay thread: */
+	if(runStreamingThread)
+		{
+		runStreamingThread=false;
+		streamingThread.join();
+		}
+	delete depthStreamingCallback;
+	depthStreamingCallback=0;
+	}
+
+void DepthStreamSource::setMaxSpeed(bool newMaxSpeed)
+	{
+	maxSpeed=newMaxSpeed;
+	}
@@ -0,0 +1,97 @@
+/***********************************************************************
+DepthStreamSource - Class to replay raw depth frames from a memory-mapped
+depth stream file written by DepthStreamRecorder, at recorded or maximum
+speed.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef DEPTHSTREAMSOURCE_INCLUDED
+#define DEPTHSTREAMSOURCE_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Threads/Thread.h>
+#include <Kinect/FrameSource.h>
+
+#include "Types.h"
+#include "FrameFilter.h"
+
+class DepthStreamSource:public Kinect::FrameSource
+	{
+	/* Embedded classes: */
+	public:
+	typedef DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
+	
+	/* Elements: */
+	private:
+	int fd; // File descriptor of the depth stream file
+	size_t fileSize; // Size of the depth stream file in bytes
+	const unsigned char* fileData; // Memory-mapped contents of the depth stream file
+	unsigned int frameSize[2]; // Width and height of recorded frames
+	FrameFilter::DepthPixelType depthPixelType; // Pixel type of recorded frames
+	size_t frameDataSize; // Size of a recorded frame's pixel data in bytes
+	IntrinsicParameters ips; // Recorded intrinsic camera parameters
+	Plane basePlane; // Recorded base plane equation in camera space
+	PixelDepthCorrection* pixelDepthCorrection; // Recorded per-pixel depth correction coefficients
+	std::vector<size_t> frameOffsets; // Offsets of all frame chunks' pixel data in the memory-mapped file
+	std::vector<double> frameTimeStamps; // Time stamps of all frames
+	bool maxSpeed; // Flag whether to replay frames as fast as possible instead of at recorded speed
+	StreamingCallback* depthStreamingCallback; // Callback receiving replayed depth frames
+	volatile bool runStreamingThread; // Flag to keep the replay thread running
+	Threads::Thread streamingThread; // Thread replaying depth frames
+	
+	/* Private methods: */
+	void* streamingThreadMethod(void); // Method for the replay thread
+	
+	/* Constructors and destructors: */
+	public:
+	DepthStreamSource(const char* fileName); // Opens and memory-maps the depth stream file of the given name
+	private:
+	DepthStreamSource(const DepthStreamSource& source); // Prohibit copy constructor
+	DepthStreamSource& operator=(const DepthStreamSource& source); // Prohibit assignment operator
+	public:
+	virtual ~DepthStreamSource(void);
+	
+	/* Methods from Kinect::FrameSource: */
+	virtual IntrinsicParameters getIntrinsicParameters(void);
+	virtual const unsigned int* getActualFrameSize(int sensor) const;
+	virtual void startStreaming(StreamingCallback* newColorStreamingCallback,StreamingCallback* newDepthStreamingCallback);
+	virtual void stopStreaming(void);
+	
+	/* New methods: */
+	FrameFilter::DepthPixelType getDepthPixelType(void) const // Returns the pixel type of recorded frames
+		{
+		return depthPixelType;
+		}
+	const PixelDepthCorrection* getPixelDepthCorrection(void) const // Returns the recorded per-pixel depth correction coefficients
+		{
+		return pixelDepthCorrection;
+		}
+	const Plane& getBasePlane(void) const // Returns the recorded base plane equation
+		{
+		return basePlane;
+		}
+	size_t getNumFrames(void) const // Returns the number of recorded frames
+		{
+		return frameOffsets.size();
+		}
+	void setMaxSpeed(bool newMaxSpeed); // Sets whether to replay frames as fast as possible instead of at recorded speed; must be called before streaming starts
+	};
+
+#endif
@@ -30,6 +30,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/gl.h>
 #include <GL/GLContextData.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/Extensions/GLEXTTextureArray.h>
 
 #include "Types.h"
 #include "DepthImageRenderer.h"
@@ -40,24 +41,16 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 Methods of class ElevationColorMap:
 **********************************/
 
-ElevationColorMap::ElevationColorMap(const char* heightMapName)
-	{
-	/* Load the given height map: */
-	load(heightMapName);
-	}
-
-void ElevationColorMap::initContext(GLContextData& contextData) const
+unsigned int ElevationColorMap::cacheMap(const char* heightMapName)
 	{
-	/* Initialize required OpenGL extensions: */
-	GLARBShaderObjects::initExtension();
+	/* Check if the height map is already cached: */
+	for(unsigned int i=0;i<cachedMaps.size();++i)
+		if(cachedMaps[i].heightMapName==heightMapName)
+			{
+			cachedMaps[i].lastUse=++useCounter;
+			return i;
+			}
 	
-	/* Create the data item and associate it with this object: */
-	DataItem* dataItem=new DataItem;
-	contextData.addDataItem(this,dataItem);
-	}
-
-void ElevationColorMap::load(const char* heightMapName)
-	{
 	/* Open the height map file: */
 	std::string fullHeightMapName;
 	if(heightMapName[0]=='/')
@@ -126,15 +119,92 @@ void ElevationColorMap::load(const char* heightMapName)
 			}
 		}
 	
-	/* Create the color map: */
-	setColors(heightMapKeys.size(),&heightMapColors[0],&heightMapKeys[0],256);
+	/* Create the color map and store its entries: */
+	GLColorMap colorMap(heightMapKeys.size(),&heightMapColors[0],&heightMapKeys[0],256);
+	CachedMap newMap;
+	newMap.heightMapName=heightMapName;
+	newMap.entries.insert(newMap.entries.end(),colorMap.getColors(),colorMap.getColors()+colorMap.getNumEntries());
+	newMap.scalarRange[0]=colorMap.getScalarRangeMin();
+	newMap.scalarRange[1]=colorMap.getScalarRangeMax();
+	newMap.lastUse=++useCounter;
 	
-	/* Invalidate the color map texture object: */
+	/* Evict the least-recently used height map other than the selected one if the cache is full: */
+	if(cachedMaps.size()>=maxNumCachedMaps&&cachedMaps.size()>1)
+		{
+		unsigned int lruIndex=currentMap==0?1:0;
+		for(unsigned int i=0;i<cachedMaps.size();++i)
+			if(i!=currentMap&&cachedMaps[i].lastUse<cachedMaps[lruIndex].lastUse)
+				lruIndex=i;
+		cachedMaps.erase(cachedMaps.begin()+lruIndex);
+		if(currentMap>lruIndex)
+			--currentMap;
+		}
+	cachedMaps.push_back(newMap);
+	
+	/* Invalidate the color map texture array object: */
 	++textureVersion;
+	
+	return cachedMaps.size()-1;
 	}
 
-void ElevationColorMap::calcTexturePlane(const Plane& basePlane)
+ElevationColorMap::ElevationColorMap(const char* heightMapName)
+	:haveBasePlane(false),
+	 maxNumCachedMaps(16),useCounter(0),currentMap(0),
+	 scalarRangeScale(1)
+	{
+	/* Load the given height map: */
+	load(heightMapName);
+	}
+
+void ElevationColorMap::initContext(GLContextData& contextData) const
 	{
+	/* Initialize required OpenGL extensions: */
+	GLARBShaderObjects::initExtension();
+	GLEXTTextureArray::initExtension();
+	
+	/* Create the data item and associate it with this object: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	}
+
+void ElevationColorMap::setScalarRangeScale(GLdouble newScalarRangeScale)
+	{
+	/* Rescale the selected height map's scalar range: */
+	scalarRangeScale=newScalarRangeScale;
+	const CachedMap& map=cachedMaps[currentMap];
+	setScalarRange(map.scalarRange[0]*scalarRangeScale,map.scalarRange[1]*scalarRangeScale);
+	}
+
+void ElevationColorMap::setMaxNumCachedMaps(unsigned int newMaxNumCachedMaps)
+	{
+	maxNumCachedMaps=newMaxNumCachedMaps>0?newMaxNumCachedMaps:1;
+	}
+
+void ElevationColorMap::preload(const char* heightMapName)
+	{
+	/* Parse the height map into the cache: */
+	cacheMap(heightMapName);
+	}
+
+void ElevationColorMap::load(const char* heightMapName)
+	{
+	/* Find or parse the height map and select it: */
+	currentMap=cacheMap(heightMapName);
+	const CachedMap& map=cachedMaps[currentMap];
+	setColors(map.entries.size(),&map.entries[0]);
+	setScalarRange(map.scalarRange[0]*scalarRangeScale,map.scalarRange[1]*scalarRangeScale);
+	
+	/* Recalculate the texture mapping plane for the selected height map's scalar range: */
+	if(haveBasePlane)
+		calcTexturePlane(basePlane);
+	}
+
+void ElevationColorMap::calcTexturePlane(const Plane& newBasePlane)
+	{
+	/* Remember the base plane for later height map switches: */
+	haveBasePlane=true;
+	basePlane=newBasePlane;
+	
 	/* Scale and offset the camera-space base plane equation: */
 	const Plane::Vector& bpn=basePlane.getNormal();
 	Scalar bpo=basePlane.getOffset();
@@ -157,16 +227,23 @@ void ElevationColorMap::bindTexture(GLContextData& contextData) const
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
 	/* Bind the texture object: */
-	glBindTexture(GL_TEXTURE_1D,dataItem->textureObjectId);
+	glBindTexture(GL_TEXTURE_1D_ARRAY_EXT,dataItem->textureObjectId);
 	
-	/* Check if the color map texture is outdated: */
+	/* Check if the color map texture array is outdated: */
 	if(dataItem->textureObjectVersion!=textureVersion)
 		{
-		/* Upload the color map entries as a 1D texture: */
-		glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-		glTexImage1D(GL_TEXTURE_1D,0,GL_RGB8,getNumEntries(),0,GL_RGBA,GL_FLOAT,getColors());
+		/* Pack the entries of all cached height maps into one array: */
+		GLsizei numEntries=GLsizei(cachedMaps[0].entries.size());
+		std::vector<Color> layers;
+		layers.reserve(cachedMaps.size()*numEntries);
+		for(std::vector<CachedMap>::const_iterator cmIt=cachedMaps.begin();cmIt!=cachedMaps.end();++cmIt)
+			layers.insert(layers.end(),cmIt->entries.begin(),cmIt->entries.end());
+		
+		/* Upload the packed entries as a 1D texture array with one layer per height map: */
+		glTexParameteri(GL_TEXTURE_1D_ARRAY_EXT,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_1D_ARRAY_EXT,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_1D_ARRAY_EXT,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_1D_ARRAY_EXT,0,GL_RGB8,numEntries,GLsizei(cachedMaps.size()),0,GL_RGBA,GL_FLOAT,&layers[0]);
 		
 		dataItem->textureObjectVersion=textureVersion;
 		}
@@ -177,3 +254,9 @@ void ElevationColorMap::uploadTexturePlane(GLint location) const
 	/* Upload the texture mapping plane equation: */
 	glUniformARB<4>(location,1,texturePlaneEq);
 	}
+
+void ElevationColorMap::uploadTextureLayer(GLint location) const
+	{
+	/* Upload the selected height map's texture array layer: */
+	glUniform1fARB(location,GLfloat(currentMap));
+	}
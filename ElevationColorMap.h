@@ -23,6 +23,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef ELEVATIONCOLORMAP_INCLUDED
 #define ELEVATIONCOLORMAP_INCLUDED
 
+#include <string>
+#include <vector>
 #include <GL/gl.h>
 #include <GL/GLColorMap.h>
 #include <GL/GLTextureObject.h>
@@ -34,9 +36,31 @@ class DepthImageRenderer;
 
 class ElevationColorMap:public GLColorMap,public GLTextureObject
 	{
+	/* Embedded classes: */
+	private:
+	struct CachedMap // Structure for a parsed height map kept as one layer of the color map texture array
+		{
+		/* Elements: */
+		public:
+		std::string heightMapName; // Name under which the height map was loaded
+		std::vector<Color> entries; // The height map's color map entries
+		GLdouble scalarRange[2]; // The height map's scalar range
+		unsigned int lastUse; // Value of the use counter when the height map was last selected or preloaded
+		};
+	
 	/* Elements: */
 	private:
 	GLfloat texturePlaneEq[4]; // Texture mapping plane equation in GLSL-compatible format
+	bool haveBasePlane; // Flag whether a base plane was given to calculate the texture mapping plane
+	Plane basePlane; // Most recently given base plane, to recalculate the texture mapping plane when switching height maps
+	std::vector<CachedMap> cachedMaps; // Parsed height maps, in texture array layer order
+	unsigned int maxNumCachedMaps; // Maximum number of height maps to keep in the texture array
+	unsigned int useCounter; // Counter to order height map uses for least-recently used eviction
+	unsigned int currentMap; // Index of the currently selected height map
+	GLdouble scalarRangeScale; // Scale factor from height map units to camera-space units applied to all height maps' scalar ranges
+	
+	/* Private methods: */
+	unsigned int cacheMap(const char* heightMapName); // Returns the index of the given height map, parsing it and evicting the least-recently used other height map if it is not yet cached
 	
 	/* Constructors and destructors: */
 	public:
@@ -46,11 +70,15 @@ class ElevationColorMap:public GLColorMap,public GLTextureObject
 	virtual void initContext(GLContextData& contextData) const;
 	
 	/* New methods: */
-	void load(const char* heightMapName); // Overrides elevation color map by loading the given height map file
-	void calcTexturePlane(const Plane& basePlane); // Calculates the texture mapping plane for the given base plane equation
+	void setScalarRangeScale(GLdouble newScalarRangeScale); // Sets the scale factor from height map units to camera-space units for the selected and all later selected height maps
+	void setMaxNumCachedMaps(unsigned int newMaxNumCachedMaps); // Sets the maximum number of height maps to keep in the texture array
+	void preload(const char* heightMapName); // Parses the given height map file into the texture array without selecting it
+	void load(const char* heightMapName); // Overrides elevation color map by selecting the given height map, parsing it only if it is not yet cached
+	void calcTexturePlane(const Plane& newBasePlane); // Calculates the texture mapping plane for the given base plane equation
 	void calcTexturePlane(const DepthImageRenderer* depthImageRenderer); // Calculates the texture mapping plane for the given depth image renderer
-	void bindTexture(GLContextData& contextData) const; // Binds the elevation color map texture object to the currently active texture unit
+	void bindTexture(GLContextData& contextData) const; // Binds the elevation color map texture array object to the currently active texture unit
 	void uploadTexturePlane(GLint location) const; // Uploads the texture mapping plane equation into the GLSL 4-vector at the given uniform location
+	void uploadTextureLayer(GLint location) const; // Uploads the texture array layer of the selected height map into the GLSL float at the given uniform location
 	};
 
 #endif
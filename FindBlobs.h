@@ -25,6 +25,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <vector>
 
+#include "BandWorkerPool.h"
+
 template <class PixelParam>
 class BlobProperty // Class to accumulate additional pixel properties along with blobs
 	{
@@ -69,9 +71,15 @@ class PixelProperty // Class to check whether a pixel should be considered part
 		}
 	};
 
+template <class PixelParam,class PixelPropertyParam>
+void classifyPixelRow(const PixelPropertyParam& property,unsigned int y,unsigned int width,const PixelParam* row,unsigned char* mask); // Sets mask entries to 1 for pixels of the given frame row that have the given property and to 0 otherwise; overload for property classes that can test entire rows faster
+
 template <class PixelParam,class PixelPropertyParam>
 std::vector<Blob<PixelParam> > findBlobs(const unsigned int size[2],const PixelParam* frame,const PixelPropertyParam& property); // Extracts all connected blobs from the given frame whose pixels have the given property
 
+template <class PixelParam,class PixelPropertyParam>
+std::vector<Blob<PixelParam> > findBlobs(const unsigned int size[2],const PixelParam* frame,const PixelPropertyParam& property,BandWorkerPool& workerPool); // Ditto, labeling one horizontal band of the frame on each thread of the given worker pool and merging blobs across band boundaries
+
 #ifndef FINDBLOBS_IMPLEMENTATION
 #include "FindBlobs.icpp"
 #endif
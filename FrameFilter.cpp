@@ -24,223 +24,599 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "FrameFilter.h"
 
 #include <Misc/FunctionCalls.h>
+#include <Math/Math.h>
 #include <Geometry/HVector.h>
 #include <Geometry/Matrix.h>
 
+#include "BandWorkerPool.h"
+#include "StageTimers.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define FRAMEFILTER_SIMD 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRAMEFILTER_SIMD 1
+#else
+#define FRAMEFILTER_SIMD 0
+#endif
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+#if FRAMEFILTER_SIMD
+
+#if defined(__SSE2__)
+typedef __m128 Float4;
+#else
+typedef float32x4_t Float4;
+#endif
+
+inline Float4 load4(const Misc::UInt16* ifPtr)
+	{
+	/* Convert four consecutive 16-bit depth values to float: */
+	#if defined(__SSE2__)
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ifPtr)),_mm_setzero_si128()));
+	#else
+	return vcvtq_f32_u32(vmovl_u16(vld1_u16(ifPtr)));
+	#endif
+	}
+
+inline Float4 load4(const float* ifPtr)
+	{
+	/* Load four consecutive floating-point depth values: */
+	#if defined(__SSE2__)
+	return _mm_loadu_ps(ifPtr);
+	#else
+	return vld1q_f32(ifPtr);
+	#endif
+	}
+
+inline unsigned int correctAndTest4(Float4 raw,const FrameFilter::PixelDepthCorrection* pdcPtr,float px,float py,const float minPlane[4],const float maxPlane[4])
+	{
+	/* Depth-correct four consecutive raw depth values, and return their validity as a bit mask; relies on PixelCorrection being a tightly packed (scale, offset) pair: */
+	#if defined(__SSE2__)
+	
+	/* De-interleave the four pixels' correction coefficients: */
+	__m128 c01=_mm_loadu_ps(&pdcPtr[0].scale);
+	__m128 c23=_mm_loadu_ps(&pdcPtr[2].scale);
+	__m128 scale=_mm_shuffle_ps(c01,c23,_MM_SHUFFLE(2,0,2,0));
+	__m128 offset=_mm_shuffle_ps(c01,c23,_MM_SHUFFLE(3,1,3,1));
+	
+	/* Depth-correct the raw values: */
+	__m128 cVal=_mm_add_ps(_mm_mul_ps(raw,scale),offset);
+	
+	/* Plug the depth-corrected values into the minimum and maximum plane equations, summing the terms in the same order as the scalar path: */
+	__m128 pxs=_mm_add_ps(_mm_set1_ps(px),_mm_set_ps(3.0f,2.0f,1.0f,0.0f));
+	__m128 minD=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(minPlane[0]),pxs),_mm_set1_ps(minPlane[1]*py)),_mm_mul_ps(_mm_set1_ps(minPlane[2]),cVal)),_mm_set1_ps(minPlane[3]));
+	__m128 maxD=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(maxPlane[0]),pxs),_mm_set1_ps(maxPlane[1]*py)),_mm_mul_ps(_mm_set1_ps(maxPlane[2]),cVal)),_mm_set1_ps(maxPlane[3]));
+	__m128 zero=_mm_setzero_ps();
+	return (unsigned int)(_mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(minD,zero),_mm_cmple_ps(maxD,zero))));
+	
+	#else
+	
+	/* De-interleave the four pixels' correction coefficients: */
+	float32x4x2_t coeffs=vld2q_f32(&pdcPtr[0].scale);
+	
+	/* Depth-correct the raw values: */
+	float32x4_t cVal=vaddq_f32(vmulq_f32(raw,coeffs.val[0]),coeffs.val[1]);
+	
+	/* Plug the depth-corrected values into the minimum and maximum plane equations, summing the terms in the same order as the scalar path: */
+	static const float xOffsets[4]={0.0f,1.0f,2.0f,3.0f};
+	float32x4_t pxs=vaddq_f32(vdupq_n_f32(px),vld1q_f32(xOffsets));
+	float32x4_t minD=vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(pxs,minPlane[0]),vdupq_n_f32(minPlane[1]*py)),vmulq_n_f32(cVal,minPlane[2])),vdupq_n_f32(minPlane[3]));
+	float32x4_t maxD=vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(pxs,maxPlane[0]),vdupq_n_f32(maxPlane[1]*py)),vmulq_n_f32(cVal,maxPlane[2])),vdupq_n_f32(maxPlane[3]));
+	float32x4_t zero=vdupq_n_f32(0.0f);
+	static const uint32_t laneBits[4]={1U,2U,4U,8U};
+	uint32x4_t bits=vandq_u32(vandq_u32(vcgeq_f32(minD,zero),vcleq_f32(maxD,zero)),vld1q_u32(laneBits));
+	uint32x2_t pair=vorr_u32(vget_low_u32(bits),vget_high_u32(bits));
+	return vget_lane_u32(pair,0)|vget_lane_u32(pair,1);
+	
+	#endif
+	}
+
+#endif
+
+inline void lowpassColumns(const float* prevRow,const float* row,const float* nextRow,float* outRow,unsigned int width)
+	{
+	/* Apply a 1-2-1 low-pass filter across three adjacent rows; a missing row denotes the frame boundary: */
+	if(prevRow==0)
+		{
+		for(unsigned int x=0;x<width;++x)
+			outRow[x]=(row[x]*2.0f+nextRow[x])/3.0f;
+		}
+	else if(nextRow==0)
+		{
+		for(unsigned int x=0;x<width;++x)
+			outRow[x]=(prevRow[x]+row[x]*2.0f)/3.0f;
+		}
+	else
+		{
+		for(unsigned int x=0;x<width;++x)
+			outRow[x]=(prevRow[x]+row[x]*2.0f+nextRow[x])*0.25f;
+		}
+	}
+
+inline void lowpassRow(float* rowPtr,unsigned int width)
+	{
+	/* Filter the first pixel in the row: */
+	float lastVal=*rowPtr;
+	*rowPtr=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
+	++rowPtr;
+	
+	/* Filter the interior pixels in the row: */
+	for(unsigned int x=1;x<width-1;++x,++rowPtr)
+		{
+		/* Filter the pixel: */
+		float nextLastVal=*rowPtr;
+		*rowPtr=(lastVal+rowPtr[0]*2.0f+rowPtr[1])*0.25f;
+		lastVal=nextLastVal;
+		}
+	
+	/* Filter the last pixel in the row: */
+	*rowPtr=(lastVal+rowPtr[0]*2.0f)/3.0f;
+	}
+
+}
+
+/******************************************
+Declaration of class FrameFilter::FilterJob:
+******************************************/
+
+class FrameFilter::FilterJob:public BandWorkerPool::Job
+	{
+	/* Elements: */
+	private:
+	const FrameFilter& frameFilter; // The frame filter
+	const void* inputFrame; // The raw depth frame to filter
+	float* outputFrame; // The output frame to write
+	unsigned int numBands; // Number of bands into which the frame is split
+	
+	/* Constructors and destructors: */
+	public:
+	FilterJob(const FrameFilter& sFrameFilter,const void* sInputFrame,float* sOutputFrame,unsigned int sNumBands)
+		:frameFilter(sFrameFilter),inputFrame(sInputFrame),outputFrame(sOutputFrame),numBands(sNumBands)
+		{
+		}
+	
+	/* Methods from BandWorkerPool::Job: */
+	virtual void runBand(unsigned int bandIndex)
+		{
+		/* Filter the band's horizontal slice of rows: */
+		unsigned int height=frameFilter.size[1];
+		(frameFilter.*frameFilter.filterRowsMethod)((height*bandIndex)/numBands,(height*(bandIndex+1))/numBands,inputFrame,outputFrame,bandIndex);
+		}
+	};
+
 /****************************
 Methods of class FrameFilter:
 ****************************/
 
-void* FrameFilter::filterThreadMethod(void)
+inline void FrameFilter::addSample(unsigned int pixelIndex,int value) const
 	{
-	unsigned int lastInputFrameVersion=0;
-	
-	while(true)
+	++statCounts[pixelIndex]; // Number of valid samples
+	statSums[pixelIndex]+=value; // Sum of valid samples
+	statSquareSums[pixelIndex]+=Misc::SInt64(value)*Misc::SInt64(value); // Sum of squares of valid samples
+	}
+
+inline void FrameFilter::removeSample(unsigned int pixelIndex,int value) const
+	{
+	--statCounts[pixelIndex]; // Number of valid samples
+	statSums[pixelIndex]-=value; // Sum of valid samples
+	statSquareSums[pixelIndex]-=Misc::SInt64(value)*Misc::SInt64(value); // Sum of squares of valid samples
+	}
+
+void FrameFilter::resetPixel(unsigned int pixelIndex,unsigned int newVal) const
+	{
+	/* Mark all of the pixel's averaging slots as invalid: */
+	unsigned int frameSize=size[1]*size[0];
+	if(averagingDeltas!=0)
 		{
-		Kinect::FrameBuffer frame;
+		signed char* adPtr=averagingDeltas+pixelIndex;
+		for(unsigned int i=0;i<numAveragingSlots;++i,adPtr+=frameSize)
+			*adPtr=invalidDelta;
+		baseBuffer[pixelIndex]=RawDepth(newVal);
+		}
+	else
 		{
-		Threads::MutexCond::Lock inputLock(inputCond);
-		
-		/* Wait until a new frame arrives or the program shuts down: */
-		while(runFilterThread&&lastInputFrameVersion==inputFrameVersion)
-			inputCond.wait(inputLock);
+		RawDepth* abPtr=averagingBuffer+pixelIndex;
+		for(unsigned int i=0;i<numAveragingSlots;++i,abPtr+=frameSize)
+			*abPtr=invalidSample;
+		}
+	
+	/* Clear the pixel's statistics: */
+	statCounts[pixelIndex]=0;
+	statSums[pixelIndex]=0;
+	statSquareSums[pixelIndex]=0;
+	}
+
+void FrameFilter::rebasePixel(unsigned int pixelIndex,unsigned int newVal) const
+	{
+	/* Find the range of the valid samples in the pixel's averaging slots, including the new value: */
+	unsigned int frameSize=size[1]*size[0];
+	int base=int(baseBuffer[pixelIndex]);
+	int minVal=int(newVal);
+	int maxVal=int(newVal);
+	signed char* adPtr=averagingDeltas+pixelIndex;
+	for(unsigned int i=0;i<numAveragingSlots;++i,adPtr+=frameSize)
+		if(*adPtr!=invalidDelta)
+			{
+			int val=base+int(*adPtr);
+			if(minVal>val)
+				minVal=val;
+			if(maxVal<val)
+				maxVal=val;
+			}
+	
+	if(maxVal-minVal<=2*127)
+		{
+		/* Center the pixel's base value on the range of its valid samples: */
+		int newBase=(minVal+maxVal)/2;
+		int shift=newBase-base;
 		
-		/* Bail out if the program is shutting down: */
-		if(!runFilterThread)
-			break;
+		/* Re-encode the valid samples against the new base value: */
+		adPtr=averagingDeltas+pixelIndex;
+		for(unsigned int i=0;i<numAveragingSlots;++i,adPtr+=frameSize)
+			if(*adPtr!=invalidDelta)
+				*adPtr=(signed char)(int(*adPtr)-shift);
 		
-		/* Work on the new frame: */
-		frame=inputFrame;
-		lastInputFrameVersion=inputFrameVersion;
+		/* Shift the pixel's statistics to the new base value: */
+		Misc::SInt64 n=statCounts[pixelIndex];
+		Misc::SInt64 oldSum=statSums[pixelIndex];
+		statSums[pixelIndex]=int(oldSum-n*shift);
+		statSquareSums[pixelIndex]+=n*Misc::SInt64(shift)*Misc::SInt64(shift)-2*Misc::SInt64(shift)*oldSum;
+		baseBuffer[pixelIndex]=RawDepth(newBase);
 		}
+	else
+		{
+		/* The pixel's valid samples can not be represented relative to any common base value; start over from the new value: */
+		resetPixel(pixelIndex,newVal);
+		}
+	}
+
+bool FrameFilter::trackMotion(unsigned int pixelIndex,unsigned int newVal) const
+	{
+	/* Bail out if the pixel has no running mean to compare against: */
+	int n=int(statCounts[pixelIndex]);
+	if(n==0)
+		return true;
+	
+	/* Compare the new value's distance from the pixel's running mean against the motion threshold, without dividing: */
+	int value=int(newVal);
+	if(averagingDeltas!=0)
+		value-=int(baseBuffer[pixelIndex]);
+	unsigned char& state=motionStates[pixelIndex];
+	if(Math::abs(value*n-statSums[pixelIndex])>int(motionThreshold)*n)
+		{
+		/* Start or continue a streak of motion samples; a streak only continues while its samples agree with each other: */
+		if(motionAges[pixelIndex]==0U)
+			motionAges[pixelIndex]=1U;
+		unsigned int streak=state&motionStreakMask;
+		if(streak>0U&&Math::abs(int(newVal)-int(motionValues[pixelIndex]))>int(motionThreshold))
+			streak=0U;
+		motionValues[pixelIndex]=RawDepth(newVal);
+		++streak;
+		if(streak>=motionNumOutlierFrames)
+			{
+			/* Discard the pixel's averaging window to converge quickly on the new surface: */
+			resetPixel(pixelIndex,newVal);
+			state=motionRecoveringFlag;
+			return true;
+			}
 		
-		/* Prepare a new output frame: */
-		Kinect::FrameBuffer& newOutputFrame=outputFrames.startNewValue();
+		/* Skip the outlier until it is confirmed as motion, so that isolated outliers do not disturb the window: */
+		state=(state&motionRecoveringFlag)|(unsigned char)(streak);
+		return false;
+		}
+	else
+		{
+		/* End the streak; isolated outliers are noise and keep the long window: */
+		state&=motionRecoveringFlag;
+		if(state==0U)
+			motionAges[pixelIndex]=0U;
+		return true;
+		}
+	}
+
+inline void FrameFilter::enterSample(unsigned int pixelIndex,unsigned int newVal,bool valid) const
+	{
+	if(motionThreshold>0)
+		{
+		/* Age the pixel's motion, and check the new value for motion; leave the pixel alone if the value is an unconfirmed outlier: */
+		if(motionAges[pixelIndex]!=0U&&motionAges[pixelIndex]<255U)
+			++motionAges[pixelIndex];
+		if(valid&&!trackMotion(pixelIndex,newVal))
+			return;
+		}
+	
+	/* Bail out if the new value is invalid and the pixel's previous samples are to be retained: */
+	if(!valid&&retainValids)
+		return;
+	
+	unsigned int slotIndex=averagingSlotIndex*size[1]*size[0]+pixelIndex;
+	if(averagingDeltas!=0)
+		{
+		/* Remove the previous value in the averaging slot from the pixel's statistics if it was valid: */
+		signed char& slot=averagingDeltas[slotIndex];
+		if(slot!=invalidDelta)
+			removeSample(pixelIndex,int(slot));
+		slot=invalidDelta;
 		
-		/* Enter the new frame into the averaging buffer and calculate the output frame's pixel values: */
-		const RawDepth* ifPtr=inputFrame.getData<RawDepth>();
-		RawDepth* abPtr=averagingBuffer+averagingSlotIndex*size[1]*size[0];
-		unsigned int* sPtr=statBuffer;
-		float* ofPtr=validBuffer;
-		float* nofPtr=newOutputFrame.getData<float>();
-		const PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
-		for(unsigned int y=0;y<size[1];++y)
+		if(valid)
 			{
-			float py=float(y)+0.5f;
-			for(unsigned int x=0;x<size[0];++x,++ifPtr,++pdcPtr,++abPtr,sPtr+=3,++ofPtr,++nofPtr)
+			/* Re-encode the pixel's samples against a new base value if the new value is out of range: */
+			int delta=int(newVal)-int(baseBuffer[pixelIndex]);
+			if(delta<-127||delta>127)
 				{
-				float px=float(x)+0.5f;
-				
-				unsigned int oldVal=*abPtr;
-				unsigned int newVal=*ifPtr;
-				
-				/* Depth-correct the new value: */
-				float newCVal=pdcPtr->correct(newVal);
-				
-				/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
-				float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
-				float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
-				if(minD>=0.0f&&maxD<=0.0f)
-					{
-					/* Store the new input value: */
-					*abPtr=newVal;
-					
-					/* Update the pixel's statistics: */
-					++sPtr[0]; // Number of valid samples
-					sPtr[1]+=newVal; // Sum of valid samples
-					sPtr[2]+=newVal*newVal; // Sum of squares of valid samples
-					
-					/* Check if the previous value in the averaging buffer was valid: */
-					if(oldVal!=2048U)
-						{
-						--sPtr[0]; // Number of valid samples
-						sPtr[1]-=oldVal; // Sum of valid samples
-						sPtr[2]-=oldVal*oldVal; // Sum of squares of valid samples
-						}
-					}
-				else if(!retainValids)
-					{
-					/* Store an invalid input value: */
-					*abPtr=2048U;
-					
-					/* Check if the previous value in the averaging buffer was valid: */
-					if(oldVal!=2048U)
-						{
-						--sPtr[0]; // Number of valid samples
-						sPtr[1]-=oldVal; // Sum of valid samples
-						sPtr[2]-=oldVal*oldVal; // Sum of squares of valid samples
-						}
-					}
-				
-				/* Check if the pixel is considered "stable": */
-				if(sPtr[0]>=minNumSamples&&sPtr[2]*sPtr[0]<=maxVariance*sPtr[0]*sPtr[0]+sPtr[1]*sPtr[1])
-					{
-					/* Check if the new depth-corrected running mean is outside the previous value's envelope: */
-					float newFiltered=pdcPtr->correct(float(sPtr[1])/float(sPtr[0]));
-					if(Math::abs(newFiltered-*ofPtr)>=hysteresis)
-						{
-						/* Set the output pixel value to the depth-corrected running mean: */
-						*nofPtr=*ofPtr=newFiltered;
-						}
-					else
-						{
-						/* Leave the pixel at its previous value: */
-						*nofPtr=*ofPtr;
-						}
-					}
-				else if(retainValids)
-					{
-					/* Leave the pixel at its previous value: */
-					*nofPtr=*ofPtr;
-					}
-				else
-					{
-					/* Assign default value to instable pixels: */
-					*nofPtr=instableValue;
-					}
+				rebasePixel(pixelIndex,newVal);
+				delta=int(newVal)-int(baseBuffer[pixelIndex]);
 				}
+			
+			/* Store the new input value: */
+			slot=(signed char)delta;
+			addSample(pixelIndex,delta);
+			}
+		}
+	else
+		{
+		/* Remove the previous value in the averaging slot from the pixel's statistics if it was valid: */
+		RawDepth& slot=averagingBuffer[slotIndex];
+		if(slot!=invalidSample)
+			removeSample(pixelIndex,int(slot));
+		
+		if(valid)
+			{
+			/* Store the new input value: */
+			slot=RawDepth(newVal);
+			addSample(pixelIndex,int(newVal));
+			}
+		else
+			{
+			/* Store an invalid input value: */
+			slot=invalidSample;
+			}
+		}
+	}
+
+inline bool FrameFilter::updateOutput(unsigned int pixelIndex,const FrameFilter::PixelDepthCorrection* pdcPtr,float* ofPtr,float* nofPtr,unsigned int* latencyCounts) const
+	{
+	/* Pixels converging after a motion reset need fewer samples to be considered "stable": */
+	bool recovering=motionThreshold>0&&(motionStates[pixelIndex]&motionRecoveringFlag)!=0U;
+	Misc::SInt64 requiredNumSamples=recovering?motionMinNumSamples:minNumSamples;
+	
+	/* Check if the pixel is considered "stable": */
+	Misc::SInt64 n=statCounts[pixelIndex];
+	Misc::SInt64 sum=statSums[pixelIndex];
+	if(n>=requiredNumSamples&&statSquareSums[pixelIndex]*n<=Misc::SInt64(maxVariance)*n*n+sum*sum)
+		{
+		if(recovering)
+			{
+			/* Record the number of frames from the onset of motion to convergence: */
+			unsigned int latency=motionAges[pixelIndex];
+			++latencyCounts[latency<numLatencyBins-1?latency:numLatencyBins-1];
+			motionStates[pixelIndex]&=motionStreakMask;
+			if(motionStates[pixelIndex]==0U)
+				motionAges[pixelIndex]=0U;
+			}
+		
+		/* Calculate the pixel's running mean in raw depth units: */
+		if(averagingDeltas!=0)
+			sum+=Misc::SInt64(baseBuffer[pixelIndex])*n;
+		
+		/* Check if the new depth-corrected running mean is outside the previous value's envelope: */
+		float newFiltered=pdcPtr->correct(float(sum)/float(n));
+		if(Math::abs(newFiltered-*ofPtr)>=hysteresis)
+			{
+			/* Set the output pixel value to the depth-corrected running mean: */
+			*nofPtr=*ofPtr=newFiltered;
+			return true;
+			}
+		else
+			{
+			/* Leave the pixel at its previous value: */
+			*nofPtr=*ofPtr;
 			}
+		}
+	else if(retainValids)
+		{
+		/* Leave the pixel at its previous value: */
+		*nofPtr=*ofPtr;
+		}
+	else
+		{
+		/* Assign default value to instable pixels: */
+		*nofPtr=instableValue;
+		}
+	
+	return false;
+	}
+
+inline void FrameFilter::markChangedPixel(unsigned char* changedTiles,unsigned int x,unsigned int y) const
+	{
+	/* Flag all tiles touched by the pixel's footprint, which the spatial filter spreads by two pixels in each direction: */
+	unsigned int radius=spatialFilter?2U:0U;
+	unsigned int tx0=(x>=radius?x-radius:0U)/tileSize;
+	unsigned int tx1=(x+radius<size[0]?x+radius:size[0]-1U)/tileSize;
+	unsigned int ty0=(y>=radius?y-radius:0U)/tileSize;
+	unsigned int ty1=(y+radius<size[1]?y+radius:size[1]-1U)/tileSize;
+	for(unsigned int ty=ty0;ty<=ty1;++ty)
+		for(unsigned int tx=tx0;tx<=tx1;++tx)
+			changedTiles[ty*numTiles[0]+tx]=1U;
+	}
+
+void FrameFilter::allocateBandBuffers(unsigned int numBands)
+	{
+	delete[] bandChangedTiles;
+	bandChangedTiles=new unsigned char[numBands*numTiles[1]*numTiles[0]];
+	delete[] bandLatencyCounts;
+	bandLatencyCounts=new unsigned int[numBands*numLatencyBins];
+	}
+
+template <class DepthPixelsParam>
+void FrameFilter::filterRows(unsigned int rowBegin,unsigned int rowEnd,const void* inputFrame,float* outputFrame,unsigned int bandIndex) const
+	{
+	typedef typename DepthPixelsParam::Pixel Pixel;
+	
+	/* Clear the band's changed tile flags and latency histogram: */
+	unsigned char* changedTiles=bandChangedTiles+bandIndex*numTiles[1]*numTiles[0];
+	for(unsigned int i=0;i<numTiles[1]*numTiles[0];++i)
+		changedTiles[i]=0U;
+	unsigned int* latencyCounts=bandLatencyCounts+bandIndex*numLatencyBins;
+	for(unsigned int i=0;i<numLatencyBins;++i)
+		latencyCounts[i]=0U;
+	
+	/* Enter the new frame's rows into the averaging buffer and calculate the output frame's pixel values: */
+	unsigned int pixelIndex=rowBegin*size[0];
+	const Pixel* ifPtr=static_cast<const Pixel*>(inputFrame)+pixelIndex;
+	float* ofPtr=validBuffer+pixelIndex;
+	float* nofPtr=outputFrame+pixelIndex;
+	const PixelDepthCorrection* pdcPtr=pixelDepthCorrection+pixelIndex;
+	for(unsigned int y=rowBegin;y<rowEnd;++y)
+		{
+		float py=float(y)+0.5f;
+		unsigned int x=0;
 		
-		/* Go to the next averaging slot: */
-		if(++averagingSlotIndex==numAveragingSlots)
-			averagingSlotIndex=0U;
+		#if FRAMEFILTER_SIMD
 		
-		/* Apply a spatial filter if requested: */
-		if(spatialFilter)
+		/* Depth-correct and validate groups of four pixels at once: */
+		for(;x+4<=size[0];x+=4,pixelIndex+=4,ifPtr+=4,pdcPtr+=4,ofPtr+=4,nofPtr+=4)
 			{
-			for(int filterPass=0;filterPass<2;++filterPass)
+			unsigned int validMask=correctAndTest4(load4(ifPtr),pdcPtr,float(x)+0.5f,py,minPlane,maxPlane);
+			for(unsigned int i=0;i<4;++i)
 				{
-				/* Low-pass filter the entire output frame in-place: */
-				for(unsigned int x=0;x<size[0];++x)
-					{
-					/* Get a pointer to the current column: */
-					float* colPtr=newOutputFrame.getData<float>()+x;
-					
-					/* Filter the first pixel in the column: */
-					float lastVal=*colPtr;
-					*colPtr=(colPtr[0]*2.0f+colPtr[size[0]])/3.0f;
-					colPtr+=size[0];
-					
-					/* Filter the interior pixels in the column: */
-					for(unsigned int y=1;y<size[1]-1;++y,colPtr+=size[0])
-						{
-						/* Filter the pixel: */
-						float nextLastVal=*colPtr;
-						*colPtr=(lastVal+colPtr[0]*2.0f+colPtr[size[0]])*0.25f;
-						lastVal=nextLastVal;
-						}
-					
-					/* Filter the last pixel in the column: */
-					*colPtr=(lastVal+colPtr[0]*2.0f)/3.0f;
-					}
-				float* rowPtr=newOutputFrame.getData<float>();
-				for(unsigned int y=0;y<size[1];++y)
-					{
-					/* Filter the first pixel in the row: */
-					float lastVal=*rowPtr;
-					*rowPtr=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
-					++rowPtr;
-					
-					/* Filter the interior pixels in the row: */
-					for(unsigned int x=1;x<size[0]-1;++x,++rowPtr)
-						{
-						/* Filter the pixel: */
-						float nextLastVal=*rowPtr;
-						*rowPtr=(lastVal+rowPtr[0]*2.0f+rowPtr[1])*0.25f;
-						lastVal=nextLastVal;
-						}
-					
-					/* Filter the last pixel in the row: */
-					*rowPtr=(lastVal+rowPtr[0]*2.0f)/3.0f;
-					++rowPtr;
-					}
+				enterSample(pixelIndex+i,DepthPixelsParam::toSample(ifPtr[i]),(validMask&(1U<<i))!=0U&&DepthPixelsParam::isValid(ifPtr[i]));
+				if(updateOutput(pixelIndex+i,pdcPtr+i,ofPtr+i,nofPtr+i,latencyCounts))
+					markChangedPixel(changedTiles,x+i,y);
 				}
 			}
 		
-		/* Finalize the new output frame in the output buffer: */
-		outputFrames.postNewValue();
+		#endif
+		
+		/* Process the remaining pixels one at a time: */
+		for(;x<size[0];++x,++pixelIndex,++ifPtr,++pdcPtr,++ofPtr,++nofPtr)
+			{
+			float px=float(x)+0.5f;
+			
+			/* Depth-correct the new value: */
+			float newCVal=pdcPtr->correct(float(*ifPtr));
+			
+			/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
+			float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
+			float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
+			enterSample(pixelIndex,DepthPixelsParam::toSample(*ifPtr),minD>=0.0f&&maxD<=0.0f&&DepthPixelsParam::isValid(*ifPtr));
+			if(updateOutput(pixelIndex,pdcPtr,ofPtr,nofPtr,latencyCounts))
+				markChangedPixel(changedTiles,x,y);
+			}
+		}
+	}
+
+void FrameFilter::applySpatialFilter(float* frame) const
+	{
+	/*********************************************************************
+	Apply two passes of a separable 1-2-1 low-pass filter, each first
+	along columns and then along rows, in a single top-to-bottom sweep.
+	The intermediate result of the first pass is held in a ring of three
+	row buffers, so that the frame is only ever traversed row by row.
+	*********************************************************************/
+	
+	unsigned int width=size[0];
+	unsigned int height=size[1];
+	float* ring[3];
+	for(int i=0;i<3;++i)
+		ring[i]=spatialFilterBuffer+i*width;
+	
+	/* Run the first pass on the first row of the frame: */
+	lowpassColumns(0,frame,frame+width,ring[0],width);
+	lowpassRow(ring[0],width);
+	
+	float* rowPtr=frame;
+	for(unsigned int y=0;y<height;++y,rowPtr+=width)
+		{
+		/* Run the first pass on the next row, while the frame's rows y to y+2 are still unmodified: */
+		float* nextRing=0;
+		if(y+1<height)
+			{
+			nextRing=ring[(y+1)%3];
+			lowpassColumns(rowPtr,rowPtr+width,y+2<height?rowPtr+2*width:0,nextRing,width);
+			lowpassRow(nextRing,width);
+			}
 		
-		/* Pass the new output frame to the registered receiver: */
-		if(outputFrameFunction!=0)
-			(*outputFrameFunction)(newOutputFrame);
+		/* Run the second pass on the current row and write the result back into the frame: */
+		lowpassColumns(y>0?ring[(y+2)%3]:0,ring[y%3],nextRing,rowPtr,width);
+		lowpassRow(rowPtr,width);
 		}
+	}
+
+void FrameFilter::startWorkerPool(unsigned int numThreads)
+	{
+	/* Shut down the current worker pool: */
+	delete workerPool;
+	workerPool=0;
+	
+	/* Allocate changed tile flags and latency histograms for each band: */
+	allocateBandBuffers(numThreads);
 	
-	return 0;
+	/* Start a new worker pool if the thread delivering raw frames needs help: */
+	if(numThreads>1)
+		workerPool=new BandWorkerPool(numThreads);
 	}
 
-FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const FrameFilter::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane)
+FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,bool compactAveraging,const FrameFilter::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane)
 	:pixelDepthCorrection(sPixelDepthCorrection),
-	 averagingBuffer(0),
-	 statBuffer(0),
-	 outputFrameFunction(0)
+	 numFilterThreads(1),workerPool(0),filterRowsMethod(&FrameFilter::filterRows<RawDepthPixels>),
+	 bandChangedTiles(0),bandLatencyCounts(0),tileVersions(0),outputFrameIndex(0),
+	 averagingBuffer(0),averagingDeltas(0),baseBuffer(0),
+	 statCounts(0),statSums(0),statSquareSums(0),
+	 motionThreshold(0),motionNumOutlierFrames(2),motionMinNumSamples(3),
+	 motionStates(0),motionAges(0),motionValues(0),
+	 firstFrameTime(0.0),lastFrameTime(0.0),numLatencyFrames(0),
+	 spatialFilterBuffer(0),
+	 outputFrameFunction(0),
+	 stageTimers(0)
 	{
 	/* Remember the frame size: */
 	for(int i=0;i<2;++i)
 		size[i]=sSize[i];
 	
-	/* Initialize the input frame slot: */
-	inputFrameVersion=0;
-	
 	/* Initialize the valid depth range: */
 	setValidDepthInterval(0U,2046U);
 	
 	/* Initialize the averaging buffer: */
 	numAveragingSlots=sNumAveragingSlots;
-	averagingBuffer=new RawDepth[numAveragingSlots*size[1]*size[0]];
-	RawDepth* abPtr=averagingBuffer;
-	for(unsigned int i=0;i<numAveragingSlots;++i)
-		for(unsigned int y=0;y<size[1];++y)
-			for(unsigned int x=0;x<size[0];++x,++abPtr)
-				*abPtr=2048U; // Mark sample as invalid
+	unsigned int frameSize=size[1]*size[0];
+	if(compactAveraging)
+		{
+		/* Store samples as 8-bit differences to per-pixel base values: */
+		averagingDeltas=new signed char[numAveragingSlots*frameSize];
+		signed char* adPtr=averagingDeltas;
+		for(unsigned int i=0;i<numAveragingSlots*frameSize;++i,++adPtr)
+			*adPtr=invalidDelta; // Mark sample as invalid
+		baseBuffer=new RawDepth[frameSize];
+		for(unsigned int i=0;i<frameSize;++i)
+			baseBuffer[i]=0U;
+		}
+	else
+		{
+		averagingBuffer=new RawDepth[numAveragingSlots*frameSize];
+		RawDepth* abPtr=averagingBuffer;
+		for(unsigned int i=0;i<numAveragingSlots*frameSize;++i,++abPtr)
+			*abPtr=invalidSample; // Mark sample as invalid
+		}
 	averagingSlotIndex=0U;
 	
-	/* Initialize the statistics buffer: */
-	statBuffer=new unsigned int[size[1]*size[0]*3];
-	unsigned int* sbPtr=statBuffer;
-	for(unsigned int y=0;y<size[1];++y)
-		for(unsigned int x=0;x<size[0];++x)
-			for(int i=0;i<3;++i,++sbPtr)
-				*sbPtr=0;
+	/* Initialize the statistics buffers: */
+	statCounts=new unsigned int[frameSize];
+	statSums=new int[frameSize];
+	statSquareSums=new Misc::SInt64[frameSize];
+	for(unsigned int i=0;i<frameSize;++i)
+		{
+		statCounts[i]=0;
+		statSums[i]=0;
+		statSquareSums[i]=0;
+		}
 	
 	/* Initialize the stability criterion: */
 	minNumSamples=(numAveragingSlots+1)/2;
@@ -249,8 +625,22 @@ FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingS
 	retainValids=true;
 	instableValue=0.0;
 	
+	/* Initialize the motion adaptation state: */
+	motionStates=new unsigned char[frameSize];
+	motionAges=new unsigned char[frameSize];
+	motionValues=new RawDepth[frameSize];
+	for(unsigned int i=0;i<frameSize;++i)
+		{
+		motionStates[i]=0U;
+		motionAges[i]=0U;
+		motionValues[i]=0U;
+		}
+	for(unsigned int i=0;i<numLatencyBins;++i)
+		latencyCounts[i]=0U;
+	
 	/* Enable spatial filtering: */
 	spatialFilter=true;
+	spatialFilterBuffer=new float[3*size[0]];
 	
 	/* Convert the base plane equation from camera space to depth-image space: */
 	PTransform::HVector basePlaneCc(basePlane.getNormal());
@@ -265,32 +655,67 @@ FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingS
 		for(unsigned int x=0;x<size[0];++x,++vbPtr)
 			*vbPtr=float(-((double(x)+0.5)*basePlaneDic[0]+(double(y)+0.5)*basePlaneDic[1]+basePlaneDic[3])/basePlaneDic[2]);
 	
+	/* Initialize the change tracking tiles, marking all as changed in the first output frame: */
+	for(int i=0;i<2;++i)
+		numTiles[i]=(size[i]+tileSize-1)/tileSize;
+	allocateBandBuffers(1);
+	tileVersions=new unsigned int[numTiles[1]*numTiles[0]];
+	for(unsigned int i=0;i<numTiles[1]*numTiles[0];++i)
+		tileVersions[i]=1U;
+	
 	/* Initialize the output frame buffer: */
 	for(int i=0;i<3;++i)
-		outputFrames.getBuffer(i)=Kinect::FrameBuffer(size[0],size[1],size[1]*size[0]*sizeof(float));
+		{
+		OutputFrame& of=outputFrames.getBuffer(i);
+		of.depthImage=Kinect::FrameBuffer(size[0],size[1],size[1]*size[0]*sizeof(float));
+		of.tileVersions=Kinect::FrameBuffer(numTiles[0],numTiles[1],numTiles[1]*numTiles[0]*sizeof(unsigned int));
+		of.frameIndex=0;
+		}
 	
-	/* Start the filtering thread: */
-	runFilterThread=true;
-	filterThread.start(this,&FrameFilter::filterThreadMethod);
 	}
 
 FrameFilter::~FrameFilter(void)
 	{
-	/* Shut down the filtering thread: */
-	{
-	Threads::MutexCond::Lock inputLock(inputCond);
-	runFilterThread=false;
-	inputCond.signal();
-	}
-	filterThread.join();
+	/* Shut down the worker pool: */
+	delete workerPool;
 	
 	/* Release all allocated buffers: */
 	delete[] averagingBuffer;
-	delete[] statBuffer;
+	delete[] averagingDeltas;
+	delete[] baseBuffer;
+	delete[] statCounts;
+	delete[] statSums;
+	delete[] statSquareSums;
 	delete[] validBuffer;
+	delete[] spatialFilterBuffer;
+	delete[] bandChangedTiles;
+	delete[] bandLatencyCounts;
+	delete[] tileVersions;
+	delete[] motionStates;
+	delete[] motionAges;
+	delete[] motionValues;
 	delete outputFrameFunction;
 	}
 
+void FrameFilter::setDepthPixelType(FrameFilter::DepthPixelType newDepthPixelType)
+	{
+	/* Select the filter kernel specialized for the new pixel type: */
+	switch(newDepthPixelType)
+		{
+		case RAW_DEPTH:
+			filterRowsMethod=&FrameFilter::filterRows<RawDepthPixels>;
+			break;
+		
+		case UINT16_DEPTH:
+			filterRowsMethod=&FrameFilter::filterRows<UInt16DepthPixels>;
+			break;
+		
+		case FLOAT_DEPTH:
+			filterRowsMethod=&FrameFilter::filterRows<FloatDepthPixels>;
+			break;
+		}
+	}
+
 void FrameFilter::setValidDepthInterval(unsigned int newMinDepth,unsigned int newMaxDepth)
 	{
 	/* Set the equations for the minimum and maximum plane in depth image space: */
@@ -304,13 +729,13 @@ void FrameFilter::setValidDepthInterval(unsigned int newMinDepth,unsigned int ne
 	maxPlane[3]=-float(newMaxDepth)-0.5f;
 	}
 
-void FrameFilter::setValidElevationInterval(const PTransform& depthProjection,const Plane& basePlane,double newMinElevation,double newMaxElevation)
+void FrameFilter::calcValidElevationPlanes(const PTransform& depthProjection,const Plane& basePlane,double minElevation,double maxElevation,float minPlane[4],float maxPlane[4])
 	{
 	/* Calculate the equations of the minimum and maximum elevation planes in camera space: */
 	PTransform::HVector minPlaneCc(basePlane.getNormal());
-	minPlaneCc[3]=-(basePlane.getOffset()+newMinElevation*basePlane.getNormal().mag());
+	minPlaneCc[3]=-(basePlane.getOffset()+minElevation*basePlane.getNormal().mag());
 	PTransform::HVector maxPlaneCc(basePlane.getNormal());
-	maxPlaneCc[3]=-(basePlane.getOffset()+newMaxElevation*basePlane.getNormal().mag());
+	maxPlaneCc[3]=-(basePlane.getOffset()+maxElevation*basePlane.getNormal().mag());
 	
 	/* Transform the plane equations to depth image space and flip and swap the min and max planes because elevation increases opposite to raw depth: */
 	PTransform::HVector minPlaneDic(depthProjection.getMatrix().transposeMultiply(minPlaneCc));
@@ -323,6 +748,11 @@ void FrameFilter::setValidElevationInterval(const PTransform& depthProjection,co
 		minPlane[i]=float(maxPlaneDic[i]*maxPlaneScale);
 	}
 
+void FrameFilter::setValidElevationInterval(const PTransform& depthProjection,const Plane& basePlane,double newMinElevation,double newMaxElevation)
+	{
+	calcValidElevationPlanes(depthProjection,basePlane,newMinElevation,newMaxElevation,minPlane,maxPlane);
+	}
+
 void FrameFilter::setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance)
 	{
 	minNumSamples=newMinNumSamples;
@@ -344,25 +774,117 @@ void FrameFilter::setInstableValue(float newInstableValue)
 	instableValue=newInstableValue;
 	}
 
+void FrameFilter::setMotionAdaptation(unsigned int newMotionThreshold,unsigned int newMotionNumOutlierFrames,unsigned int newMotionMinNumSamples)
+	{
+	motionThreshold=newMotionThreshold;
+	
+	/* Limit the number of outlier frames to the streak counts a pixel's motion state can hold: */
+	motionNumOutlierFrames=Math::clamp(newMotionNumOutlierFrames,1U,(unsigned int)(motionStreakMask));
+	motionMinNumSamples=Math::max(newMotionMinNumSamples,1U);
+	}
+
+void FrameFilter::getLatencyStatistics(unsigned int histogram[FrameFilter::numLatencyBins],double& meanFrameInterval) const
+	{
+	Threads::Mutex::Lock latencyLock(latencyMutex);
+	for(unsigned int i=0;i<numLatencyBins;++i)
+		histogram[i]=latencyCounts[i];
+	meanFrameInterval=numLatencyFrames>1?(lastFrameTime-firstFrameTime)/double(numLatencyFrames-1):0.0;
+	}
+
 void FrameFilter::setSpatialFilter(bool newSpatialFilter)
 	{
 	spatialFilter=newSpatialFilter;
 	}
 
+void FrameFilter::setNumFilterThreads(unsigned int newNumFilterThreads)
+	{
+	/* Always use at least the thread delivering raw frames; the filter thread reads the request under the same lock: */
+	Threads::Mutex::Lock numFilterThreadsLock(numFilterThreadsMutex);
+	numFilterThreads=newNumFilterThreads>0?newNumFilterThreads:1;
+	}
+
 void FrameFilter::setOutputFrameFunction(FrameFilter::OutputFrameFunction* newOutputFrameFunction)
 	{
 	delete outputFrameFunction;
 	outputFrameFunction=newOutputFrameFunction;
 	}
 
-void FrameFilter::receiveRawFrame(const Kinect::FrameBuffer& newFrame)
+void FrameFilter::setStageTimers(const StageTimers* newStageTimers)
 	{
-	Threads::MutexCond::Lock inputLock(inputCond);
+	stageTimers=newStageTimers;
+	}
+
+void FrameFilter::receiveRawFrame(const Kinect::FrameBuffer& frame)
+	{
+	/* Measure filtering the new frame: */
+	StageTimers::CPUTimer filterTimer(stageTimers,StageTimers::FRAMEFILTER);
+	
+	/* Adjust the worker pool if the requested number of filter threads changed: */
+	unsigned int newNumFilterThreads;
+	{
+	Threads::Mutex::Lock numFilterThreadsLock(numFilterThreadsMutex);
+	newNumFilterThreads=numFilterThreads;
+	}
+	unsigned int numBands=workerPool!=0?workerPool->getNumThreads():1;
+	if(numBands!=newNumFilterThreads)
+		{
+		startWorkerPool(newNumFilterThreads);
+		numBands=newNumFilterThreads;
+		}
+	
+	/* Prepare a new output frame: */
+	OutputFrame& newOutputFrame=outputFrames.startNewValue();
+	const void* ifPtr=frame.getData<unsigned char>();
+	float* nofPtr=newOutputFrame.depthImage.getData<float>();
+	
+	/* Filter the first band of the new frame in this thread and the remaining bands on the worker pool: */
+	FilterJob job(*this,ifPtr,nofPtr,numBands);
+	if(workerPool!=0)
+		workerPool->run(job);
+	else
+		job.runBand(0);
+	
+	/* Go to the next averaging slot: */
+	if(++averagingSlotIndex==numAveragingSlots)
+		averagingSlotIndex=0U;
+	
+	/* Apply a spatial filter if requested: */
+	if(spatialFilter)
+		applySpatialFilter(nofPtr);
+	
+	/* Merge the bands' changed tile flags into the tile versions; changes of instable pixels are not tracked, so all tiles change if those are not retained: */
+	++outputFrameIndex;
+	unsigned int numTilesTotal=numTiles[1]*numTiles[0];
+	for(unsigned int i=0;i<numTilesTotal;++i)
+		{
+		bool changed=!retainValids;
+		for(unsigned int band=0;band<numBands&&!changed;++band)
+			changed=bandChangedTiles[band*numTilesTotal+i]!=0U;
+		if(changed)
+			tileVersions[i]=outputFrameIndex;
+		}
+	unsigned int* tvPtr=newOutputFrame.tileVersions.getData<unsigned int>();
+	for(unsigned int i=0;i<numTilesTotal;++i)
+		tvPtr[i]=tileVersions[i];
+	newOutputFrame.frameIndex=outputFrameIndex;
+	
+	if(motionThreshold>0)
+		{
+		/* Merge the bands' latency histograms into the latency statistics: */
+		Threads::Mutex::Lock latencyLock(latencyMutex);
+		for(unsigned int band=0;band<numBands;++band)
+			for(unsigned int i=0;i<numLatencyBins;++i)
+				latencyCounts[i]+=bandLatencyCounts[band*numLatencyBins+i];
+		if(numLatencyFrames==0)
+			firstFrameTime=frame.timeStamp;
+		lastFrameTime=frame.timeStamp;
+		++numLatencyFrames;
+		}
 	
-	/* Store the new buffer in the input buffer: */
-	inputFrame=newFrame;
-	++inputFrameVersion;
+	/* Finalize the new output frame in the output buffer: */
+	outputFrames.postNewValue();
 	
-	/* Signal the background thread: */
-	inputCond.signal();
+	/* Pass the new output frame to the registered receiver: */
+	if(outputFrameFunction!=0)
+		(*outputFrameFunction)(newOutputFrame);
 	}
@@ -24,8 +24,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef FRAMEFILTER_INCLUDED
 #define FRAMEFILTER_INCLUDED
 
-#include <Threads/Thread.h>
-#include <Threads/MutexCond.h>
+#include <Misc/SizedTypes.h>
+#include <Threads/Mutex.h>
 #include <Threads/TripleBuffer.h>
 #include <Kinect/FrameBuffer.h>
 #include <Kinect/FrameSource.h>
@@ -37,64 +37,183 @@ namespace Misc {
 template <class ParameterParam>
 class FunctionCall;
 }
+class BandWorkerPool;
+class StageTimers;
 
 class FrameFilter
 	{
 	/* Embedded classes: */
 	public:
-	typedef unsigned short RawDepth; // Data type for raw depth values
+	typedef unsigned short RawDepth; // Data type for raw depth samples in the averaging buffer
 	typedef float FilteredDepth; // Data type for filtered depth values
-	typedef Misc::FunctionCall<const Kinect::FrameBuffer&> OutputFrameFunction; // Type for functions called when a new output frame is ready
+	
+	enum DepthPixelType // Enumerated type for the pixel formats of incoming depth frames
+		{
+		RAW_DEPTH, // 11-bit raw disparity values from first-generation Kinect cameras, with 2048 marking invalid pixels
+		UINT16_DEPTH, // 16-bit depth values, with 0 marking invalid pixels
+		FLOAT_DEPTH // Floating-point depth values, with non-positive or NaN values marking invalid pixels
+		};
+	
+	struct RawDepthPixels // Sentinel policy for RAW_DEPTH frames
+		{
+		/* Embedded classes: */
+		public:
+		typedef Misc::UInt16 Pixel; // Type of depth frame pixels
+		
+		/* Methods: */
+		static bool isValid(Pixel pixel) // Returns true if the given pixel holds a depth measurement
+			{
+			return pixel<2048U;
+			}
+		static unsigned int toSample(Pixel pixel) // Converts the given pixel to a raw depth sample
+			{
+			return pixel;
+			}
+		};
+	
+	struct UInt16DepthPixels // Sentinel policy for UINT16_DEPTH frames
+		{
+		/* Embedded classes: */
+		public:
+		typedef Misc::UInt16 Pixel; // Type of depth frame pixels
+		
+		/* Methods: */
+		static bool isValid(Pixel pixel) // Returns true if the given pixel holds a depth measurement; the largest value is reserved as the averaging buffer's sentinel
+			{
+			return pixel!=0U&&pixel!=0xffffU;
+			}
+		static unsigned int toSample(Pixel pixel) // Converts the given pixel to a raw depth sample
+			{
+			return pixel;
+			}
+		};
+	
+	struct FloatDepthPixels // Sentinel policy for FLOAT_DEPTH frames
+		{
+		/* Embedded classes: */
+		public:
+		typedef float Pixel; // Type of depth frame pixels
+		
+		/* Methods: */
+		static bool isValid(Pixel pixel) // Returns true if the given pixel holds a depth measurement that can be represented as a raw depth sample
+			{
+			return pixel>0.0f&&pixel<65534.5f;
+			}
+		static unsigned int toSample(Pixel pixel) // Rounds the given pixel to a raw depth sample; returns 0 for invalid pixels
+			{
+			return pixel>0.0f?(pixel<65534.0f?(unsigned int)(pixel+0.5f):65534U):0U;
+			}
+		};
+	
+	static const unsigned int tileSize=32; // Width and height of the square pixel tiles in which changes between output frames are tracked
+	static const unsigned int numLatencyBins=32; // Number of bins in the shaping latency histogram; the last bin collects all longer latencies
+	
+	struct OutputFrame // Structure for filtered depth frames and the tiles that changed in them
+		{
+		/* Elements: */
+		public:
+		Kinect::FrameBuffer depthImage; // The filtered depth image
+		Kinect::FrameBuffer tileVersions; // Grid of unsigned ints holding, for each tile, the index of the output frame in which any of its pixels last changed
+		unsigned int frameIndex; // Index of this output frame; starts at 1
+		};
+	
+	typedef Misc::FunctionCall<const OutputFrame&> OutputFrameFunction; // Type for functions called when a new output frame is ready
 	typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
 	
-	/* Elements: */
 	private:
+	typedef void (FrameFilter::*FilterRowsMethod)(unsigned int rowBegin,unsigned int rowEnd,const void* inputFrame,float* outputFrame,unsigned int bandIndex) const; // Type for filter kernels specialized for a depth pixel type
+	class FilterJob; // Helper class to filter the bands of a frame on the worker pool
+	
+	/* Elements: */
 	unsigned int size[2]; // Width and height of processed frames
 	const PixelDepthCorrection* pixelDepthCorrection; // Buffer of per-pixel depth correction coefficients
-	Threads::MutexCond inputCond; // Condition variable to signal arrival of a new input frame
-	Kinect::FrameBuffer inputFrame; // The most recent input frame
-	unsigned int inputFrameVersion; // Version number of input frame
-	volatile bool runFilterThread; // Flag to keep the background filtering thread running
-	Threads::Thread filterThread; // The background filtering thread
+	mutable Threads::Mutex numFilterThreadsMutex; // Mutex protecting the requested number of filter threads
+	unsigned int numFilterThreads; // Requested number of threads, including the thread delivering raw frames, sharing the work on each frame; protected by numFilterThreadsMutex
+	BandWorkerPool* workerPool; // Pool of worker threads helping the thread delivering raw frames by each filtering one horizontal band of every frame, or null if there are no worker threads
+	FilterRowsMethod filterRowsMethod; // Filter kernel specialized for the pixel type of incoming depth frames
+	unsigned int numTiles[2]; // Number of change tracking tiles horizontally and vertically
+	unsigned char* bandChangedTiles; // Per-band arrays of flags for tiles changed by the current frame, one array for each thread sharing the work
+	unsigned int* bandLatencyCounts; // Per-band shaping latency histograms of the current frame, one for each thread sharing the work
+	unsigned int* tileVersions; // Index of the output frame in which each tile last changed
+	unsigned int outputFrameIndex; // Index of the most recent output frame
 	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
 	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
 	unsigned int numAveragingSlots; // Number of slots in each pixel's averaging buffer
 	RawDepth* averagingBuffer; // Buffer to calculate running averages of each pixel's depth value
+	signed char* averagingDeltas; // Compact alternative to the averaging buffer, storing differences to each pixel's base value
+	RawDepth* baseBuffer; // Buffer of per-pixel base values against which compact averaging slots are encoded
 	unsigned int averagingSlotIndex; // Index of averaging slot in which to store the next frame's depth values
-	unsigned int* statBuffer; // Buffer retaining the running means and variances of each pixel's depth value
+	unsigned int* statCounts; // Buffer retaining the number of valid samples of each pixel
+	int* statSums; // Buffer retaining the sum of valid samples of each pixel, relative to the pixel's base value in compact mode
+	Misc::SInt64* statSquareSums; // Buffer retaining the sum of squares of valid samples of each pixel, relative to the pixel's base value in compact mode
 	unsigned int minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
 	unsigned int maxVariance; // Maximum variance to consider a pixel stable
 	float hysteresis; // Amount by which a new filtered value has to differ from the current value to update
 	bool retainValids; // Flag whether to retain previous stable values if a new pixel in instable, or reset to a default value
 	float instableValue; // Value to assign to instable pixels if retainValids is false
+	unsigned int motionThreshold; // Distance in raw depth units from a pixel's running mean beyond which a new sample is considered motion; 0 disables motion adaptation
+	unsigned int motionNumOutlierFrames; // Number of consecutive motion samples after which a pixel's averaging window is discarded
+	unsigned int motionMinNumSamples; // Minimum number of valid samples needed to consider a pixel stable after its averaging window was discarded
+	unsigned char* motionStates; // Per-pixel number of consecutive motion samples, and flag whether the pixel is converging after a reset
+	unsigned char* motionAges; // Per-pixel number of frames since the onset of motion, or 0 if the pixel is not in motion
+	RawDepth* motionValues; // Per-pixel most recent motion sample, which the next motion sample must agree with to continue a streak
+	mutable Threads::Mutex latencyMutex; // Mutex protecting the shaping latency statistics
+	unsigned int latencyCounts[numLatencyBins]; // Histogram of the number of frames from the onset of motion to convergence for all reset pixels
+	double firstFrameTime; // Time stamp of the first frame entered into the latency statistics
+	double lastFrameTime; // Time stamp of the most recent frame entered into the latency statistics
+	unsigned int numLatencyFrames; // Number of frames entered into the latency statistics
 	bool spatialFilter; // Flag whether to apply a spatial filter to time-averaged depth values
+	float* spatialFilterBuffer; // Ring of three rows holding intermediate results of the spatial filter
 	float* validBuffer; // Buffer holding the most recent stable depth value for each pixel
-	Threads::TripleBuffer<Kinect::FrameBuffer> outputFrames; // Triple buffer of output frames
+	Threads::TripleBuffer<OutputFrame> outputFrames; // Triple buffer of output frames
 	OutputFrameFunction* outputFrameFunction; // Function called when a new output frame is ready
+	const StageTimers* stageTimers; // Timer set measuring frame filtering, or null
 	
 	/* Private methods: */
-	void* filterThreadMethod(void); // Method for the background filtering thread
+	static const RawDepth invalidSample=0xffffU; // Marker for invalid samples in the averaging buffer
+	static const signed char invalidDelta=-128; // Marker for invalid samples in the compact averaging buffer
+	static const unsigned char motionStreakMask=0x7fU; // Mask for the number of consecutive motion samples in a pixel's motion state
+	static const unsigned char motionRecoveringFlag=0x80U; // Flag in a pixel's motion state indicating that it is converging after a reset
+	void addSample(unsigned int pixelIndex,int value) const; // Adds a sample to a pixel's statistics
+	void removeSample(unsigned int pixelIndex,int value) const; // Removes a sample from a pixel's statistics
+	void resetPixel(unsigned int pixelIndex,unsigned int newVal) const; // Discards all of a pixel's samples; new value becomes the pixel's base value in compact mode
+	void rebasePixel(unsigned int pixelIndex,unsigned int newVal) const; // Re-encodes a pixel's compact averaging slots against a base value from which the given new value can be encoded
+	bool trackMotion(unsigned int pixelIndex,unsigned int newVal) const; // Compares a valid new depth value against the pixel's running mean, and resets the pixel after sustained motion; returns false if the new value is an outlier to be skipped
+	void enterSample(unsigned int pixelIndex,unsigned int newVal,bool valid) const; // Enters a new depth value into a pixel's averaging slot and statistics
+	bool updateOutput(unsigned int pixelIndex,const PixelDepthCorrection* pdcPtr,float* ofPtr,float* nofPtr,unsigned int* latencyCounts) const; // Calculates a pixel's output value from its statistics and records the latency of converging reset pixels; returns true if the pixel's stable value changed
+	void markChangedPixel(unsigned char* changedTiles,unsigned int x,unsigned int y) const; // Flags all tiles whose output is affected by a change of the given pixel
+	void allocateBandBuffers(unsigned int numBands); // Allocates the per-band changed tile flags and latency histograms for the given number of bands
+	template <class DepthPixelsParam>
+	void filterRows(unsigned int rowBegin,unsigned int rowEnd,const void* inputFrame,float* outputFrame,unsigned int bandIndex) const; // Filters the given half-open range of rows of the given raw depth frame into the given output frame, and records changed tiles and latencies in the given band's buffers; specialized for the given depth pixel sentinel policy
+	void applySpatialFilter(float* frame) const; // Applies the spatial low-pass filter to the given output frame in-place
+	void startWorkerPool(unsigned int numThreads); // Replaces the current worker pool with a pool splitting each frame into the given number of bands, including the band filtered by the thread delivering raw frames
 	
 	/* Constructors and destructors: */
 	public:
-	FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane); // Creates a filter for frames of the given size and the given running average length
+	FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,bool compactAveraging,const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane); // Creates a filter for frames of the given size and the given running average length; stores averaging slots as 8-bit differences if compactAveraging is true
 	~FrameFilter(void); // Destroys the frame filter
 	
 	/* Methods: */
+	static void calcValidElevationPlanes(const PTransform& depthProjection,const Plane& basePlane,double minElevation,double maxElevation,float minPlane[4],float maxPlane[4]); // Calculates depth image-space plane equations bounding the given elevation interval relative to the given base plane
+	void setDepthPixelType(DepthPixelType newDepthPixelType); // Selects the filter kernel for the pixel type of incoming depth frames; must be called before the first frame arrives
 	void setValidDepthInterval(unsigned int newMinDepth,unsigned int newMaxDepth); // Sets the interval of depth values considered by the depth image filter
 	void setValidElevationInterval(const PTransform& depthProjection,const Plane& basePlane,double newMinElevation,double newMaxElevation); // Sets the interval of elevations relative to the given base plane considered by the depth image filter
 	void setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance); // Sets the statistical properties to consider a pixel stable
 	void setHysteresis(float newHysteresis); // Sets the stable value hysteresis envelope
 	void setRetainValids(bool newRetainValids); // Sets whether the filter retains previous stable values for instable pixels
 	void setInstableValue(float newInstableValue); // Sets the depth value to assign to instable pixels
+	void setMotionAdaptation(unsigned int newMotionThreshold,unsigned int newMotionNumOutlierFrames,unsigned int newMotionMinNumSamples); // Sets the motion threshold in raw depth units, the number of consecutive motion samples that reset a pixel (clamped to 1 to 127), and the number of samples needed to converge after a reset; a threshold of 0 disables motion adaptation
+	void getLatencyStatistics(unsigned int histogram[numLatencyBins],double& meanFrameInterval) const; // Returns the histogram of shaping latencies in frames, and the mean time between filtered frames in seconds
 	void setSpatialFilter(bool newSpatialFilter); // Sets the spatial filtering flag
+	void setNumFilterThreads(unsigned int newNumFilterThreads); // Sets the number of threads sharing the work of filtering each frame; takes effect with the next frame
 	void setOutputFrameFunction(OutputFrameFunction* newOutputFrameFunction); // Sets the output function; adopts given functor object
-	void receiveRawFrame(const Kinect::FrameBuffer& newFrame); // Called to receive a new raw depth frame
+	void setStageTimers(const StageTimers* newStageTimers); // Measures the CPU time of frame filtering with the given timer set, or stops measuring if null
+	void receiveRawFrame(const Kinect::FrameBuffer& frame); // Filters the given raw depth frame in the calling thread and passes the result to the output function; must not be called concurrently
 	bool lockNewFrame(void) // Locks the most recently produced output frame for reading; returns true if the locked frame is new
 		{
 		return outputFrames.lockNewValue();
 		}
-	const Kinect::FrameBuffer& getLockedFrame(void) const // Returns the most recently locked output frame
+	const OutputFrame& getLockedFrame(void) const // Returns the most recently locked output frame
 		{
 		return outputFrames.getLockedValue();
 		}
@@ -0,0 +1,169 @@
+/***********************************************************************
+FramePipeline - Class to distribute depth frames from a single source to
+several processing stages sharing one pool of worker threads.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "FramePipeline.h"
+
+#include <iostream>
+#include <Misc/FunctionCalls.h>
+
+/******************************
+Methods of class FramePipeline:
+******************************/
+
+void* FramePipeline::workerThreadMethod(void)
+	{
+	while(true)
+		{
+		/* Take the next queued stage and its pending frame: */
+		unsigned int stageIndex;
+		Kinect::FrameBuffer frame;
+		{
+		Threads::MutexCond::Lock queueLock(queueCond);
+		
+		/* Wait until a stage is queued or the pipeline shuts down: */
+		while(runWorkerThreads&&readyStages.empty())
+			queueCond.wait(queueLock);
+		
+		/* Bail out if the pipeline is shutting down: */
+		if(!runWorkerThreads)
+			break;
+		
+		stageIndex=readyStages.front();
+		readyStages.pop_front();
+		Stage& stage=stages[stageIndex];
+		frame=stage.pendingFrames.front();
+		stage.pendingFrames.pop_front();
+		}
+		
+		/* Process the frame outside the lock; the stage stays busy, so no other worker thread can enter it: */
+		(*stages[stageIndex].function)(frame);
+		
+		{
+		Threads::MutexCond::Lock queueLock(queueCond);
+		
+		/* Re-queue the stage at the end of the queue if a newer frame arrived in the meantime, or mark it idle: */
+		Stage& stage=stages[stageIndex];
+		if(!stage.pendingFrames.empty())
+			readyStages.push_back(stageIndex);
+		else
+			{
+			stage.busy=false;
+			stage.overflowing=false;
+			}
+		
+		/* Wake up other worker threads and a destructor waiting for the stage to become idle: */
+		queueCond.broadcast();
+		}
+		}
+	
+	return 0;
+	}
+
+FramePipeline::FramePipeline(unsigned int sNumWorkerThreads)
+	:runWorkerThreads(true),
+	 numWorkerThreads(sNumWorkerThreads>0?sNumWorkerThreads:1),workerThreads(0)
+	{
+	/* Start the worker threads: */
+	workerThreads=new Threads::Thread[numWorkerThreads];
+	for(unsigned int i=0;i<numWorkerThreads;++i)
+		workerThreads[i].start(this,&FramePipeline::workerThreadMethod);
+	}
+
+FramePipeline::~FramePipeline(void)
+	{
+	/* Shut down the worker threads once all queued stages have processed their pending frames: */
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	while(true)
+		{
+		bool draining=false;
+		for(std::vector<Stage>::iterator sIt=stages.begin();sIt!=stages.end();++sIt)
+			draining=draining||(sIt->maxPendingFrames>1&&sIt->busy);
+		if(!draining)
+			break;
+		queueCond.wait(queueLock);
+		}
+	runWorkerThreads=false;
+	queueCond.broadcast();
+	}
+	for(unsigned int i=0;i<numWorkerThreads;++i)
+		workerThreads[i].join();
+	delete[] workerThreads;
+	
+	/* Destroy all stages: */
+	for(std::vector<Stage>::iterator sIt=stages.begin();sIt!=stages.end();++sIt)
+		delete sIt->function;
+	}
+
+unsigned int FramePipeline::addStage(FramePipeline::StageFunction* newFunction,unsigned int maxPendingFrames)
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	
+	/* Append a new idle stage: */
+	Stage newStage;
+	newStage.function=newFunction;
+	newStage.maxPendingFrames=maxPendingFrames>0?maxPendingFrames:1;
+	newStage.busy=false;
+	newStage.overflowing=false;
+	newStage.numDroppedFrames=0;
+	stages.push_back(newStage);
+	
+	return stages.size()-1;
+	}
+
+void FramePipeline::publishFrame(const Kinect::FrameBuffer& frame)
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	
+	for(unsigned int i=0;i<stages.size();++i)
+		{
+		/* Append the frame to the stage's pending frames, dropping the oldest frame if the stage's queue is full: */
+		Stage& stage=stages[i];
+		if(stage.pendingFrames.size()>=stage.maxPendingFrames)
+			{
+			stage.pendingFrames.pop_front();
+			++stage.numDroppedFrames;
+			
+			/* Warn once per overflow if the stage is supposed to process every frame: */
+			if(stage.maxPendingFrames>1&&!stage.overflowing)
+				{
+				std::cerr<<"FramePipeline: Stage "<<i<<" cannot keep up with incoming frames; dropping frames"<<std::endl;
+				stage.overflowing=true;
+				}
+			}
+		stage.pendingFrames.push_back(frame);
+		
+		/* Queue the stage if it is idle: */
+		if(!stage.busy)
+			{
+			stage.busy=true;
+			readyStages.push_back(i);
+			queueCond.broadcast();
+			}
+		}
+	}
+
+unsigned int FramePipeline::getNumDroppedFrames(unsigned int stageIndex) const
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	return stages[stageIndex].numDroppedFrames;
+	}
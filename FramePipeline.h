@@ -0,0 +1,83 @@
+/***********************************************************************
+FramePipeline - Class to distribute depth frames from a single source to
+several processing stages sharing one pool of worker threads.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef FRAMEPIPELINE_INCLUDED
+#define FRAMEPIPELINE_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
+#include <Kinect/FrameBuffer.h>
+
+/* Forward declarations: */
+namespace Misc {
+template <class ParameterParam>
+class FunctionCall;
+}
+
+class FramePipeline
+	{
+	/* Embedded classes: */
+	public:
+	typedef Misc::FunctionCall<const Kinect::FrameBuffer&> StageFunction; // Type for functions processing frames in a pipeline stage
+	
+	private:
+	struct Stage // Structure for consumers of published frames
+		{
+		/* Elements: */
+		public:
+		StageFunction* function; // Function processing the stage's frames
+		std::deque<Kinect::FrameBuffer> pendingFrames; // Published frames not yet taken up by a worker thread, in publication order
+		unsigned int maxPendingFrames; // Maximum number of pending frames; publishing to a full stage drops its oldest pending frame
+		bool busy; // Flag whether the stage is queued or being processed; each stage processes one frame at a time, in publication order
+		bool overflowing; // Flag whether a queued stage has dropped frames since its queue last ran empty
+		unsigned int numDroppedFrames; // Number of frames that were dropped before the stage could process them
+		};
+	
+	/* Elements: */
+	mutable Threads::MutexCond queueCond; // Condition variable protecting the stage states and signaling queued stages to the worker threads and idle stages to the destructor
+	std::vector<Stage> stages; // List of registered stages
+	std::deque<unsigned int> readyStages; // Queue of indices of stages with a pending frame that are not currently being processed
+	volatile bool runWorkerThreads; // Flag to keep the worker threads running
+	unsigned int numWorkerThreads; // Number of worker threads in the pool
+	Threads::Thread* workerThreads; // Array of worker threads processing queued stages
+	
+	/* Private methods: */
+	void* workerThreadMethod(void); // Method for a worker thread
+	
+	/* Constructors and destructors: */
+	public:
+	FramePipeline(unsigned int sNumWorkerThreads); // Creates a pipeline processing its stages on the given number of worker threads
+	private:
+	FramePipeline(const FramePipeline& source); // Prohibit copy constructor
+	FramePipeline& operator=(const FramePipeline& source); // Prohibit assignment operator
+	public:
+	~FramePipeline(void); // Lets all queued stages process their pending frames, then shuts down the worker threads and destroys all stages
+	
+	/* Methods: */
+	unsigned int addStage(StageFunction* newFunction,unsigned int maxPendingFrames =1); // Adds a processing stage calling the given function and keeping up to the given number of unprocessed frames; a stage keeping one frame only processes the most recent frame, and a stage keeping more processes all frames unless its queue overflows; adopts functor object; must be called before the first frame is published; returns the new stage's index
+	void publishFrame(const Kinect::FrameBuffer& frame); // Shares the given frame with all stages without copying it; drops the oldest frame a stage has not started processing yet if the stage's queue is full
+	unsigned int getNumDroppedFrames(unsigned int stageIndex) const; // Returns the number of frames the given stage skipped because it was still busy with older frames
+	};
+
+#endif
@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Vrui/ToolManager.h>
 
 #include "WaterTable2.h"
+#include "SimulationParameterStore.h"
 #include "Sandbox.h"
 
 /****************************************
@@ -88,6 +89,6 @@ void GlobalWaterTool::buttonCallback(int buttonSlotIndex,Vrui::InputDevice::Butt
 		waterAmount=-waterAmounts[buttonSlotIndex];
 		}
 	
-	/* Add water amount to water table: */
-	application->waterTable->setWaterDeposit(application->waterTable->getWaterDeposit()+waterAmount);
+	/* Add water amount to the simulation parameters: */
+	application->parameterStore->addWaterDeposit(waterAmount);
 	}
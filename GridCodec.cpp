@@ -0,0 +1,236 @@
+/***********************************************************************
+GridCodec - Class to compress sequences of quantized bathymetry and
+water level grids for streaming between an AR Sandbox and remote
+clients, using temporal or spatial prediction and byte-oriented run-
+length and variable-length coding of prediction residuals.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridCodec.h"
+
+#include <string.h>
+#include <stdexcept>
+
+/*****************************************************************
+Encoded frames are byte streams of codes for prediction residuals,
+which are mapped to unsigned values by zig-zag encoding:
+0x00-0x7e      : Run of 1-127 zero residuals
+0x7f, lo, hi   : Run of 128-65663 zero residuals
+0x80-0xbf      : Single residual 1-64
+0xc0-0xfe, lo  : Single residual 65-16192
+0xff, lo, hi   : Single residual 0-65535
+*****************************************************************/
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline GridCodec::Value zigZag(GridCodec::Value residual)
+	{
+	return GridCodec::Value((residual<<1)^((residual&0x8000U)!=0?0xffffU:0x0000U));
+	}
+
+inline GridCodec::Value unZigZag(GridCodec::Value code)
+	{
+	return GridCodec::Value((code>>1)^((code&0x1U)!=0?0xffffU:0x0000U));
+	}
+
+void writeRun(GridCodec::Buffer& frame,size_t runLength)
+	{
+	/* Write long runs in chunks: */
+	while(runLength>=128)
+		{
+		size_t chunk=runLength-128;
+		if(chunk>65535)
+			chunk=65535;
+		frame.push_back(0x7fU);
+		frame.push_back(Misc::UInt8(chunk&0xffU));
+		frame.push_back(Misc::UInt8(chunk>>8));
+		runLength-=chunk+128;
+		}
+	
+	/* Write the remaining short run: */
+	if(runLength>0)
+		frame.push_back(Misc::UInt8(runLength-1));
+	}
+
+inline void writeResidual(GridCodec::Buffer& frame,GridCodec::Value code)
+	{
+	if(code<=64U)
+		frame.push_back(Misc::UInt8(0x80U+(code-1U)));
+	else if(code<=16192U)
+		{
+		unsigned int c=code-65U;
+		frame.push_back(Misc::UInt8(0xc0U+(c>>8)));
+		frame.push_back(Misc::UInt8(c&0xffU));
+		}
+	else
+		{
+		frame.push_back(0xffU);
+		frame.push_back(Misc::UInt8(code&0xffU));
+		frame.push_back(Misc::UInt8(code>>8));
+		}
+	}
+
+void encodeValues(const GridCodec::Value* newValues,const GridCodec::Value* values,size_t numValues,GridCodec::Buffer& frame)
+	{
+	/* Encode the residuals of all new values against the given values, or against their predecessors if there are no given values: */
+	GridCodec::Value prediction=0;
+	size_t runLength=0;
+	for(size_t i=0;i<numValues;++i)
+		{
+		if(values!=0)
+			prediction=values[i];
+		GridCodec::Value code=zigZag(GridCodec::Value(newValues[i]-prediction));
+		if(values==0)
+			prediction=newValues[i];
+		
+		if(code==0U)
+			++runLength;
+		else
+			{
+			/* Finish the current run of zero residuals and write the residual: */
+			if(runLength>0)
+				{
+				writeRun(frame,runLength);
+				runLength=0;
+				}
+			writeResidual(frame,code);
+			}
+		}
+	
+	/* Finish the last run of zero residuals: */
+	if(runLength>0)
+		writeRun(frame,runLength);
+	}
+
+void decodeValues(const Misc::UInt8* frame,size_t frameSize,GridCodec::Value* values,size_t numValues,bool keyFrame)
+	{
+	const Misc::UInt8* fPtr=frame;
+	const Misc::UInt8* fEnd=frame+frameSize;
+	GridCodec::Value prediction=0;
+	size_t i=0;
+	while(fPtr!=fEnd)
+		{
+		unsigned int code=*(fPtr++);
+		if(code<0x80U)
+			{
+			/* Read a run of zero residuals: */
+			size_t runLength=code+1;
+			if(code==0x7fU)
+				{
+				if(fEnd-fPtr<2)
+					throw std::runtime_error("GridCodec: Truncated frame");
+				runLength=128+(size_t(fPtr[0])|(size_t(fPtr[1])<<8));
+				fPtr+=2;
+				}
+			if(runLength>numValues-i)
+				throw std::runtime_error("GridCodec: Frame too long");
+			
+			/* Repeat the prediction: */
+			if(keyFrame)
+				for(size_t end=i+runLength;i<end;++i)
+					values[i]=prediction;
+			else
+				i+=runLength;
+			}
+		else
+			{
+			/* Read a single residual: */
+			GridCodec::Value residual;
+			if(code<0xc0U)
+				residual=GridCodec::Value(code-0x80U+1U);
+			else if(code<0xffU)
+				{
+				if(fEnd-fPtr<1)
+					throw std::runtime_error("GridCodec: Truncated frame");
+				residual=GridCodec::Value((((code-0xc0U)<<8)|fPtr[0])+65U);
+				fPtr+=1;
+				}
+			else
+				{
+				if(fEnd-fPtr<2)
+					throw std::runtime_error("GridCodec: Truncated frame");
+				residual=GridCodec::Value(fPtr[0]|(fPtr[1]<<8));
+				fPtr+=2;
+				}
+			if(i==numValues)
+				throw std::runtime_error("GridCodec: Frame too long");
+			
+			/* Add the residual to the prediction: */
+			if(keyFrame)
+				{
+				prediction=GridCodec::Value(prediction+unZigZag(residual));
+				values[i]=prediction;
+				}
+			else
+				values[i]=GridCodec::Value(values[i]+unZigZag(residual));
+			++i;
+			}
+		}
+	
+	if(i!=numValues)
+		throw std::runtime_error("GridCodec: Frame too short");
+	}
+
+}
+
+/**************************
+Methods of class GridCodec:
+**************************/
+
+GridCodec::GridCodec(size_t sNumValues)
+	:numValues(sNumValues),values(new Value[numValues])
+	{
+	/* Start from an all-zero frame: */
+	memset(values,0,numValues*sizeof(Value));
+	}
+
+GridCodec::~GridCodec(void)
+	{
+	delete[] values;
+	}
+
+void GridCodec::encode(const GridCodec::Value* newValues,GridCodec::FrameType frameType,GridCodec::Buffer& frame) const
+	{
+	frame.clear();
+	encodeValues(newValues,frameType==DELTAFRAME?values:0,numValues,frame);
+	}
+
+void GridCodec::setValues(const GridCodec::Value* newValues)
+	{
+	memcpy(values,newValues,numValues*sizeof(Value));
+	}
+
+void GridCodec::decode(GridCodec::FrameType frameType,const Misc::UInt8* frame,size_t frameSize)
+	{
+	decodeValues(frame,frameSize,values,numValues,frameType==KEYFRAME);
+	}
+
+void GridCodec::encodeKeyFrame(const GridCodec::Value* newValues,size_t numValues,GridCodec::Buffer& frame)
+	{
+	encodeValues(newValues,0,numValues,frame);
+	}
+
+void GridCodec::decodeKeyFrame(const Misc::UInt8* frame,size_t frameSize,GridCodec::Value* values,size_t numValues)
+	{
+	decodeValues(frame,frameSize,values,numValues,true);
+	}
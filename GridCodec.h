@@ -0,0 +1,75 @@
+/***********************************************************************
+GridCodec - Class to compress sequences of quantized bathymetry and
+water level grids for streaming between an AR Sandbox and remote
+clients, using temporal or spatial prediction and byte-oriented run-
+length and variable-length coding of prediction residuals.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDCODEC_INCLUDED
+#define GRIDCODEC_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
+
+class GridCodec
+	{
+	/* Embedded classes: */
+	public:
+	enum FrameType // Enumerated type for encoded frames
+		{
+		KEYFRAME=0, // Frame predicting each value from its predecessor in the same frame; can be decoded on its own
+		DELTAFRAME // Frame predicting each value from the same value in the previous frame
+		};
+	
+	typedef Misc::UInt16 Value; // Type for quantized grid values
+	typedef std::vector<Misc::UInt8> Buffer; // Type for buffers holding encoded frames
+	
+	/* Elements: */
+	private:
+	size_t numValues; // Number of values in each frame
+	Value* values; // Most recently encoded or decoded frame, serving as prediction for the next delta frame
+	
+	/* Constructors and destructors: */
+	public:
+	GridCodec(size_t sNumValues); // Creates a codec for frames of the given number of values, starting from an all-zero frame
+	private:
+	GridCodec(const GridCodec& source); // Prohibit copy constructor
+	GridCodec& operator=(const GridCodec& source); // Prohibit assignment operator
+	public:
+	~GridCodec(void);
+	
+	/* Methods: */
+	size_t getNumValues(void) const // Returns the number of values in each frame
+		{
+		return numValues;
+		}
+	const Value* getValues(void) const // Returns the most recently encoded or decoded frame
+		{
+		return values;
+		}
+	void encode(const Value* newValues,FrameType frameType,Buffer& frame) const; // Encodes the given new frame as a key frame or as a delta frame against the most recent frame into the given buffer
+	void setValues(const Value* newValues); // Makes the given new frame the most recent frame after it has been encoded
+	void decode(FrameType frameType,const Misc::UInt8* frame,size_t frameSize); // Decodes the given encoded frame into the most recent frame; throws an exception if the frame is malformed
+	static void encodeKeyFrame(const Value* newValues,size_t numValues,Buffer& frame); // Appends the given array of values, encoded as a key frame, to the given buffer
+	static void decodeKeyFrame(const Misc::UInt8* frame,size_t frameSize,Value* values,size_t numValues); // Decodes the given encoded key frame into the given array of values; throws an exception if the frame is malformed
+	};
+
+#endif
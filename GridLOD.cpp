@@ -0,0 +1,261 @@
+/***********************************************************************
+GridLOD - Class to split quantized bathymetry and water level grids into
+a coarse full-extent grid and full-resolution tiles, to stream only the
+parts of the grids a remote viewer can see in full detail.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridLOD.h"
+
+#include <stdexcept>
+#include <Math/Math.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline GLsizei getCoarseSize(GLsizei size)
+	{
+	/* Coarse samples are every coarseFactor-th full sample, plus the last full sample: */
+	return (size-1+GridLOD::coarseFactor-1)/GridLOD::coarseFactor+1;
+	}
+
+void getInterpolation(GLsizei size,GLsizei coarseSize,GLsizei index,GLsizei& coarseIndex0,GLsizei& coarseIndex1,GLfloat& weight)
+	{
+	/* Find the coarse interval containing the full-resolution index: */
+	coarseIndex0=index/GridLOD::coarseFactor;
+	if(coarseIndex0>=coarseSize-1)
+		{
+		/* The index is the last full sample: */
+		coarseIndex0=coarseSize-1;
+		coarseIndex1=coarseIndex0;
+		weight=0.0f;
+		}
+	else
+		{
+		coarseIndex1=coarseIndex0+1;
+		GLsizei i0=coarseIndex0*GridLOD::coarseFactor;
+		GLsizei i1=Math::min(coarseIndex1*GridLOD::coarseFactor,size-1);
+		weight=GLfloat(index-i0)/GLfloat(i1-i0);
+		}
+	}
+
+}
+
+/********************************
+Static elements of class GridLOD:
+********************************/
+
+const GLsizei GridLOD::tileSize;
+const GLsizei GridLOD::coarseFactor;
+
+/************************
+Methods of class GridLOD:
+************************/
+
+size_t GridLOD::getTileValues(unsigned int tileIndex,GLsizei tileRange[2][2][2]) const
+	{
+	/* Calculate the tile's index range in both grids: */
+	unsigned int tile[2];
+	tile[0]=tileIndex%numTiles[0];
+	tile[1]=tileIndex/numTiles[0];
+	size_t result=0;
+	for(int g=0;g<2;++g)
+		{
+		size_t numGridValues=1;
+		for(int i=0;i<2;++i)
+			{
+			tileRange[g][i][0]=Math::min(GLsizei(tile[i])*tileSize,sizes[g][i]);
+			tileRange[g][i][1]=Math::min(GLsizei(tile[i]+1)*tileSize,sizes[g][i]);
+			numGridValues*=size_t(tileRange[g][i][1]-tileRange[g][i][0]);
+			}
+		result+=numGridValues;
+		}
+	
+	return result;
+	}
+
+GridLOD::GridLOD(const GLsizei gridSize[2])
+	{
+	/* Calculate the layouts of the full-resolution and coarse grids: */
+	numValues=0;
+	numCoarseValues=0;
+	for(int g=0;g<2;++g)
+		{
+		for(int i=0;i<2;++i)
+			{
+			sizes[g][i]=g==0?gridSize[i]-1:gridSize[i];
+			coarseSizes[g][i]=getCoarseSize(sizes[g][i]);
+			}
+		offsets[g]=numValues;
+		numValues+=size_t(sizes[g][0])*size_t(sizes[g][1]);
+		coarseOffsets[g]=numCoarseValues;
+		numCoarseValues+=size_t(coarseSizes[g][0])*size_t(coarseSizes[g][1]);
+		}
+	
+	/* Cover the water level grid, and with it the bathymetry grid, with tiles: */
+	for(int i=0;i<2;++i)
+		numTiles[i]=(gridSize[i]+tileSize-1)/tileSize;
+	}
+
+void GridLOD::downsample(const GridCodec::Value* values,GridCodec::Value* coarseValues) const
+	{
+	for(int g=0;g<2;++g)
+		{
+		/* Pick every coarseFactor-th sample, and the last sample, in each dimension: */
+		const GridCodec::Value* gridValues=values+offsets[g];
+		GridCodec::Value* cPtr=coarseValues+coarseOffsets[g];
+		for(GLsizei cy=0;cy<coarseSizes[g][1];++cy)
+			{
+			const GridCodec::Value* rowValues=gridValues+size_t(Math::min(cy*coarseFactor,sizes[g][1]-1))*size_t(sizes[g][0]);
+			for(GLsizei cx=0;cx<coarseSizes[g][0];++cx,++cPtr)
+				*cPtr=rowValues[Math::min(cx*coarseFactor,sizes[g][0]-1)];
+			}
+		}
+	}
+
+void GridLOD::upsample(const GridCodec::Value* coarseValues,GridCodec::Value* values) const
+	{
+	for(int g=0;g<2;++g)
+		{
+		/* Calculate the horizontal interpolation parameters of all columns: */
+		GLsizei width=sizes[g][0];
+		std::vector<GLsizei> cx0s(width),cx1s(width);
+		std::vector<GLfloat> wxs(width);
+		for(GLsizei x=0;x<width;++x)
+			getInterpolation(width,coarseSizes[g][0],x,cx0s[x],cx1s[x],wxs[x]);
+		
+		/* Bilinearly interpolate each row: */
+		const GridCodec::Value* coarseGrid=coarseValues+coarseOffsets[g];
+		GridCodec::Value* vPtr=values+offsets[g];
+		for(GLsizei y=0;y<sizes[g][1];++y)
+			{
+			GLsizei cy0,cy1;
+			GLfloat wy;
+			getInterpolation(sizes[g][1],coarseSizes[g][1],y,cy0,cy1,wy);
+			const GridCodec::Value* row0=coarseGrid+size_t(cy0)*size_t(coarseSizes[g][0]);
+			const GridCodec::Value* row1=coarseGrid+size_t(cy1)*size_t(coarseSizes[g][0]);
+			for(GLsizei x=0;x<width;++x,++vPtr)
+				{
+				GLfloat v0=GLfloat(row0[cx0s[x]])*(1.0f-wxs[x])+GLfloat(row0[cx1s[x]])*wxs[x];
+				GLfloat v1=GLfloat(row1[cx0s[x]])*(1.0f-wxs[x])+GLfloat(row1[cx1s[x]])*wxs[x];
+				*vPtr=GridCodec::Value(v0*(1.0f-wy)+v1*wy+0.5f);
+				}
+			}
+		}
+	}
+
+void GridLOD::encodeTile(const GridCodec::Value* values,unsigned int tileIndex,GridCodec::Buffer& tileFrame) const
+	{
+	/* Gather the tile's values from both grids: */
+	GLsizei tileRange[2][2][2];
+	std::vector<GridCodec::Value> tileValues;
+	tileValues.reserve(getTileValues(tileIndex,tileRange));
+	for(int g=0;g<2;++g)
+		for(GLsizei y=tileRange[g][1][0];y<tileRange[g][1][1];++y)
+			{
+			const GridCodec::Value* rowValues=values+offsets[g]+size_t(y)*size_t(sizes[g][0]);
+			tileValues.insert(tileValues.end(),rowValues+tileRange[g][0][0],rowValues+tileRange[g][0][1]);
+			}
+	
+	/* Encode the tile's values: */
+	tileFrame.clear();
+	if(!tileValues.empty())
+		GridCodec::encodeKeyFrame(&tileValues.front(),tileValues.size(),tileFrame);
+	}
+
+void GridLOD::decodeTile(const Misc::UInt8* tileFrame,size_t tileFrameSize,unsigned int tileIndex,GridCodec::Value* values) const
+	{
+	if(tileIndex>=getNumTiles())
+		throw std::runtime_error("GridLOD: Invalid tile index");
+	
+	/* Decode the tile's values: */
+	GLsizei tileRange[2][2][2];
+	std::vector<GridCodec::Value> tileValues(getTileValues(tileIndex,tileRange));
+	if(!tileValues.empty())
+		GridCodec::decodeKeyFrame(tileFrame,tileFrameSize,&tileValues.front(),tileValues.size());
+	
+	/* Scatter the tile's values into both grids: */
+	const GridCodec::Value* tvPtr=tileValues.empty()?0:&tileValues.front();
+	for(int g=0;g<2;++g)
+		for(GLsizei y=tileRange[g][1][0];y<tileRange[g][1][1];++y)
+			{
+			GridCodec::Value* rowValues=values+offsets[g]+size_t(y)*size_t(sizes[g][0]);
+			for(GLsizei x=tileRange[g][0][0];x<tileRange[g][0][1];++x,++tvPtr)
+				rowValues[x]=*tvPtr;
+			}
+	}
+
+void GridLOD::selectTiles(const GLfloat cellSize[2],const GLfloat position[2],const GLfloat direction[2],GLfloat nearRadius,GLfloat farRadius,GLfloat cosHalfAngle,std::vector<unsigned int>& tiles) const
+	{
+	tiles.clear();
+	
+	/* Project the viewing direction into the grid plane: */
+	GLfloat dirLen=GLfloat(Math::sqrt(direction[0]*direction[0]+direction[1]*direction[1]));
+	bool haveDirection=dirLen>1.0e-3f;
+	GLfloat dir[2]={0.0f,0.0f};
+	if(haveDirection)
+		for(int i=0;i<2;++i)
+			dir[i]=direction[i]/dirLen;
+	
+	unsigned int tileIndex=0;
+	for(unsigned int ty=0;ty<numTiles[1];++ty)
+		for(unsigned int tx=0;tx<numTiles[0];++tx,++tileIndex)
+			{
+			/* Calculate the tile's extent in grid space and its distance from the position: */
+			unsigned int tile[2]={tx,ty};
+			GLfloat delta[2];
+			GLfloat centerDelta[2];
+			for(int i=0;i<2;++i)
+				{
+				GLfloat min=GLfloat(GLsizei(tile[i])*tileSize)*cellSize[i];
+				GLfloat max=GLfloat(Math::min(GLsizei(tile[i]+1)*tileSize,sizes[1][i]))*cellSize[i];
+				delta[i]=Math::max(Math::max(min-position[i],position[i]-max),0.0f);
+				centerDelta[i]=(min+max)*0.5f-position[i];
+				}
+			GLfloat dist2=delta[0]*delta[0]+delta[1]*delta[1];
+			
+			/* Select the tile if it is close, or farther away but inside the view cone: */
+			if(dist2<=nearRadius*nearRadius)
+				tiles.push_back(tileIndex);
+			else if(haveDirection&&dist2<=farRadius*farRadius)
+				{
+				GLfloat centerDist=GLfloat(Math::sqrt(centerDelta[0]*centerDelta[0]+centerDelta[1]*centerDelta[1]));
+				if(centerDelta[0]*dir[0]+centerDelta[1]*dir[1]>=cosHalfAngle*centerDist)
+					tiles.push_back(tileIndex);
+				}
+			}
+	}
+
+void GridLOD::writeUInt32(GridCodec::Buffer& frame,Misc::UInt32 value)
+	{
+	for(int i=0;i<4;++i,value>>=8)
+		frame.push_back(Misc::UInt8(value&0xffU));
+	}
+
+Misc::UInt32 GridLOD::readUInt32(const Misc::UInt8*& framePtr,const Misc::UInt8* frameEnd)
+	{
+	if(frameEnd-framePtr<4)
+		throw std::runtime_error("GridLOD: Truncated frame");
+	Misc::UInt32 result=Misc::UInt32(framePtr[0])|(Misc::UInt32(framePtr[1])<<8)|(Misc::UInt32(framePtr[2])<<16)|(Misc::UInt32(framePtr[3])<<24);
+	framePtr+=4;
+	return result;
+	}
@@ -0,0 +1,86 @@
+/***********************************************************************
+GridLOD - Class to split quantized bathymetry and water level grids into
+a coarse full-extent grid and full-resolution tiles, to stream only the
+parts of the grids a remote viewer can see in full detail.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDLOD_INCLUDED
+#define GRIDLOD_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <GL/gl.h>
+
+#include "GridCodec.h"
+
+class GridLOD
+	{
+	/* Embedded classes: */
+	public:
+	enum FrameType // Enumerated type for level-of-detail frames, continuing GridCodec's frame types
+		{
+		LODKEYFRAME=2, // Frame containing a coarse grid encoded as a key frame and full-resolution tiles
+		LODDELTAFRAME // Frame containing a coarse grid encoded as a delta frame and full-resolution tiles
+		};
+	
+	static const GLsizei tileSize=32; // Width and height of full-resolution tiles in water level grid cells
+	static const GLsizei coarseFactor=4; // Subsampling factor of the coarse grids
+	
+	/* Elements: */
+	private:
+	GLsizei sizes[2][2]; // Sizes of the bathymetry and water level grids
+	size_t offsets[2]; // Offsets of the bathymetry and water level grids in arrays holding both grids back-to-back
+	size_t numValues; // Total number of values in both grids
+	GLsizei coarseSizes[2][2]; // Sizes of the coarse bathymetry and water level grids
+	size_t coarseOffsets[2]; // Offsets of the coarse bathymetry and water level grids in arrays holding both coarse grids back-to-back
+	size_t numCoarseValues; // Total number of values in both coarse grids
+	unsigned int numTiles[2]; // Number of tiles covering the grids horizontally and vertically
+	
+	/* Private methods: */
+	size_t getTileValues(unsigned int tileIndex,GLsizei tileRange[2][2][2]) const; // Returns the index ranges of the given tile in both grids, and its total number of values
+	
+	/* Constructors and destructors: */
+	public:
+	GridLOD(const GLsizei gridSize[2]); // Creates a level-of-detail scheme for the given water level grid size; the bathymetry grid is one smaller in each dimension
+	
+	/* Methods: */
+	size_t getNumValues(void) const // Returns the total number of values in both full-resolution grids
+		{
+		return numValues;
+		}
+	size_t getNumCoarseValues(void) const // Returns the total number of values in both coarse grids
+		{
+		return numCoarseValues;
+		}
+	unsigned int getNumTiles(void) const // Returns the total number of tiles
+		{
+		return numTiles[0]*numTiles[1];
+		}
+	void downsample(const GridCodec::Value* values,GridCodec::Value* coarseValues) const; // Subsamples both full-resolution grids into coarse grids
+	void upsample(const GridCodec::Value* coarseValues,GridCodec::Value* values) const; // Interpolates both coarse grids into full-resolution grids
+	void encodeTile(const GridCodec::Value* values,unsigned int tileIndex,GridCodec::Buffer& tileFrame) const; // Encodes the given tile of both full-resolution grids as a key frame into the given buffer
+	void decodeTile(const Misc::UInt8* tileFrame,size_t tileFrameSize,unsigned int tileIndex,GridCodec::Value* values) const; // Decodes the given encoded tile into both full-resolution grids; throws an exception if the tile is malformed
+	void selectTiles(const GLfloat cellSize[2],const GLfloat position[2],const GLfloat direction[2],GLfloat nearRadius,GLfloat farRadius,GLfloat cosHalfAngle,std::vector<unsigned int>& tiles) const; // Selects all tiles within the near radius around the given grid-space position, or within the far radius inside the view cone around the given viewing direction
+	static void writeUInt32(GridCodec::Buffer& frame,Misc::UInt32 value); // Appends a little-endian 32-bit value to the given frame
+	static Misc::UInt32 readUInt32(const Misc::UInt8*& framePtr,const Misc::UInt8* frameEnd); // Reads a little-endian 32-bit value from the given frame position; throws an exception if the frame is truncated
+	};
+
+#endif
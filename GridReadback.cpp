@@ -0,0 +1,558 @@
+/***********************************************************************
+GridReadback - Class to read back the water table's bathymetry and water
+level grids from the GPU asynchronously through pixel buffer objects,
+and to hand them to any number of subscribers on a background thread.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridReadback.h"
+
+#include <string.h>
+#include <Math/Math.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
+#include <GL/Extensions/GLARBTextureRectangle.h>
+#include <GL/Extensions/GLARBVertexBufferObject.h>
+#include <GL/GLContextData.h>
+
+#include "WaterTable2.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+bool copyBuffer(GLuint bufferObject,GLfloat* grid,size_t gridSize)
+	{
+	/* Copy the contents of the given pixel buffer object into the given grid: */
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,bufferObject);
+	const GLfloat* bufferPtr=static_cast<const GLfloat*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+	if(bufferPtr==0)
+		return false;
+	memcpy(grid,bufferPtr,gridSize*sizeof(GLfloat));
+	return glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB)!=GL_FALSE;
+	}
+
+void resampleGrid(const GLfloat* source,const GLsizei sourceSize[2],GLfloat* dest,const GLsizei destSize[2],const double scale[2],double offset,int numComponents)
+	{
+	/* Bilinearly interpolate each destination sample from the source grid, whose samples sit at the same domain positions scaled by the given factors: */
+	for(GLsizei y=0;y<destSize[1];++y)
+		{
+		double sy=Math::clamp((double(y)+offset)*scale[1]-offset,0.0,double(sourceSize[1]-1));
+		GLsizei y0=Math::min(GLsizei(sy),sourceSize[1]-2>0?sourceSize[1]-2:0);
+		GLsizei y1=Math::min(y0+1,sourceSize[1]-1);
+		GLfloat wy=GLfloat(sy-double(y0));
+		for(GLsizei x=0;x<destSize[0];++x)
+			{
+			double sx=Math::clamp((double(x)+offset)*scale[0]-offset,0.0,double(sourceSize[0]-1));
+			GLsizei x0=Math::min(GLsizei(sx),sourceSize[0]-2>0?sourceSize[0]-2:0);
+			GLsizei x1=Math::min(x0+1,sourceSize[0]-1);
+			GLfloat wx=GLfloat(sx-double(x0));
+			const GLfloat* s00=source+(size_t(y0)*size_t(sourceSize[0])+size_t(x0))*numComponents;
+			const GLfloat* s01=source+(size_t(y0)*size_t(sourceSize[0])+size_t(x1))*numComponents;
+			const GLfloat* s10=source+(size_t(y1)*size_t(sourceSize[0])+size_t(x0))*numComponents;
+			const GLfloat* s11=source+(size_t(y1)*size_t(sourceSize[0])+size_t(x1))*numComponents;
+			for(int i=0;i<numComponents;++i,++dest)
+				*dest=(s00[i]*(1.0f-wx)+s01[i]*wx)*(1.0f-wy)+(s10[i]*(1.0f-wx)+s11[i]*wx)*wy;
+			}
+		}
+	}
+
+}
+
+/************************************
+Methods of class GridReadback::Frame:
+************************************/
+
+GridReadback::Frame::Frame(const GLsizei gridSize[2])
+	:bathymetry(new GLfloat[(gridSize[1]-1)*(gridSize[0]-1)]),
+	 waterLevel(new GLfloat[gridSize[1]*gridSize[0]]),
+	 snow(new GLfloat[gridSize[1]*gridSize[0]]),
+	 quantity(0),snowState(0),
+	 readBuffer(0),
+	 grids(0)
+	{
+	for(int i=0;i<2;++i)
+		readSize[i]=gridSize[i];
+	}
+
+GridReadback::Frame::~Frame(void)
+	{
+	delete[] bathymetry;
+	delete[] waterLevel;
+	delete[] snow;
+	delete[] quantity;
+	delete[] snowState;
+	delete[] readBuffer;
+	}
+
+/***************************************
+Methods of class GridReadback::DataItem:
+***************************************/
+
+GridReadback::DataItem::DataItem(void)
+	:haveFenceSync(false)
+	{
+	for(int i=0;i<3;++i)
+		{
+		for(int j=0;j<5;++j)
+			slots[i].bufferObjects[j]=0;
+		slots[i].fence=0;
+		slots[i].age=0;
+		slots[i].frame=0;
+		}
+	
+	/* Initialize all required OpenGL extensions: */
+	GLARBPixelBufferObject::initExtension();
+	GLARBTextureRectangle::initExtension();
+	GLARBVertexBufferObject::initExtension();
+	}
+
+GridReadback::DataItem::~DataItem(void)
+	{
+	/* Delete all buffers, fences, and read-backs in flight: */
+	for(int i=0;i<3;++i)
+		{
+		glDeleteBuffersARB(5,slots[i].bufferObjects);
+		if(slots[i].fence!=0)
+			deleteSync(slots[i].fence);
+		delete slots[i].frame;
+		}
+	}
+
+/*****************************
+Methods of class GridReadback:
+*****************************/
+
+GridReadback::Frame* GridReadback::getFrame(void) const
+	{
+	/* Reuse a pooled frame, or allocate a new one: */
+	Frame* result;
+	if(!freeFrames.empty())
+		{
+		result=freeFrames.back();
+		freeFrames.pop_back();
+		}
+	else
+		result=new Frame(gridSize);
+	result->grids=0;
+	result->subscribers.clear();
+	return result;
+	}
+
+void GridReadback::releaseFrame(GridReadback::Frame* frame) const
+	{
+	Threads::Mutex::Lock pendingLock(pendingMutex);
+	freeFrames.push_back(frame);
+	}
+
+void GridReadback::dropFrame(GridReadback::Frame* frame) const
+	{
+	Threads::Mutex::Lock pendingLock(pendingMutex);
+	retrySubscribers.insert(retrySubscribers.end(),frame->subscribers.begin(),frame->subscribers.end());
+	freeFrames.push_back(frame);
+	}
+
+void GridReadback::completeSlot(GridReadback::Slot& slot) const
+	{
+	/* Retire the slot's fence: */
+	if(slot.fence!=0)
+		{
+		deleteSync(slot.fence);
+		slot.fence=0;
+		}
+	
+	/* Copy the read-back grids out of the buffer objects; this only waits for the GPU if the read-back has not finished yet: */
+	Frame* frame=slot.frame;
+	slot.frame=0;
+	static const int gridMasks[5]={BATHYMETRY,WATERLEVEL,SNOW,QUANTITY,SNOWSTATE};
+	GLfloat** destPtr[5]={&frame->bathymetry,&frame->waterLevel,&frame->snow,&frame->quantity,&frame->snowState};
+	bool ok=true;
+	for(int grid=0;grid<5;++grid)
+		{
+		/* Skip grids that were not read back: */
+		if((frame->grids&gridMasks[grid])==0)
+			continue;
+		
+		/* Get the grid's layout; bathymetry grids are one smaller in each dimension: */
+		int numComponents=grid>=3?3:1;
+		int sizeOffset=grid==0?1:0;
+		GLsizei destSize[2],readSize[2];
+		for(int i=0;i<2;++i)
+			{
+			destSize[i]=gridSize[i]-sizeOffset;
+			readSize[i]=frame->readSize[i]-sizeOffset;
+			}
+		size_t destNumValues=size_t(destSize[1])*size_t(destSize[0])*numComponents;
+		if(*destPtr[grid]==0)
+			*destPtr[grid]=new GLfloat[destNumValues];
+		
+		if(readSize[0]==destSize[0]&&readSize[1]==destSize[1])
+			{
+			/* Copy the grid directly: */
+			ok=copyBuffer(slot.bufferObjects[grid],*destPtr[grid],destNumValues)&&ok;
+			}
+		else
+			{
+			/* Copy the reduced grid the quality governor left in the water table into the read buffer: */
+			if(frame->readBuffer==0)
+				frame->readBuffer=new GLfloat[size_t(gridSize[1])*size_t(gridSize[0])*3];
+			if(copyBuffer(slot.bufferObjects[grid],frame->readBuffer,size_t(readSize[1])*size_t(readSize[0])*numComponents))
+				{
+				/* Resample the reduced grid to the full size subscribers expect; cell-centered samples sit at half-integer positions, and bathymetry samples at cell corners: */
+				double scale[2];
+				for(int i=0;i<2;++i)
+					scale[i]=double(frame->readSize[i])/double(gridSize[i]);
+				resampleGrid(frame->readBuffer,readSize,*destPtr[grid],destSize,scale,grid==0?1.0:0.5,numComponents);
+				}
+			else
+				ok=false;
+			}
+		}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	
+	if(ok)
+		{
+		/* Queue the frame for delivery to its subscribers: */
+		Threads::Mutex::Lock completedFramesLock(completedFramesMutex);
+		completedFrames.push_back(frame);
+		completedFramesCond.signal();
+		}
+	else
+		{
+		/* Drop the frame, as its buffer objects were corrupted, and have its subscribers read back again: */
+		dropFrame(frame);
+		}
+	}
+
+void* GridReadback::completionThreadMethod(void)
+	{
+	while(true)
+		{
+		/* Wait for the next completed frame: */
+		Frame* frame;
+		{
+		Threads::Mutex::Lock completedFramesLock(completedFramesMutex);
+		while(runCompletionThread&&completedFrames.empty())
+			completedFramesCond.wait(completedFramesMutex);
+		if(!runCompletionThread)
+			break;
+		frame=completedFrames.front();
+		completedFrames.pop_front();
+		}
+		
+		{
+		/* Hold off unsubscribing until the frame has been delivered: */
+		Threads::Mutex::Lock deliveryLock(deliveryMutex);
+		
+		/* Collect all of the frame's subscribers that are still subscribed, and retire one-time subscribers: */
+		std::vector<Subscriber> recipients;
+		{
+		Threads::Mutex::Lock subscribersLock(subscribersMutex);
+		for(std::vector<SubscriberID>::iterator fsIt=frame->subscribers.begin();fsIt!=frame->subscribers.end();++fsIt)
+			for(std::vector<Subscriber>::iterator sIt=subscribers.begin();sIt!=subscribers.end();++sIt)
+				if(sIt->id==*fsIt)
+					{
+					recipients.push_back(*sIt);
+					if(sIt->oneShot)
+						subscribers.erase(sIt);
+					break;
+					}
+		}
+		
+		/* Deliver the frame without blocking the main thread's access to the subscriber list: */
+		for(std::vector<Subscriber>::iterator rIt=recipients.begin();rIt!=recipients.end();++rIt)
+			{
+			const GLfloat* waterLevel=(rIt->grids&QUANTITY)?frame->quantity:((rIt->grids&WATERLEVEL)?frame->waterLevel:0);
+			const GLfloat* snow=(rIt->grids&SNOWSTATE)?frame->snowState:((rIt->grids&SNOW)?frame->snow:0);
+			(*rIt->callback)((rIt->grids&BATHYMETRY)?frame->bathymetry:0,waterLevel,snow,rIt->callbackData);
+			}
+		}
+		
+		/* Return the frame to the pool: */
+		releaseFrame(frame);
+		}
+	
+	return 0;
+	}
+
+GridReadback::GridReadback(const WaterTable2* sWaterTable)
+	:waterTable(sWaterTable),
+	 nextSubscriberId(1),
+	 pendingFrame(0),
+	 runCompletionThread(true)
+	{
+	/* Retrieve the water table's full grid size: */
+	for(int i=0;i<2;++i)
+		gridSize[i]=waterTable->getSize()[i];
+	
+	/* Start the completion thread: */
+	completionThread.start(this,&GridReadback::completionThreadMethod);
+	}
+
+GridReadback::~GridReadback(void)
+	{
+	{
+	/* Shut down the completion thread: */
+	Threads::Mutex::Lock completedFramesLock(completedFramesMutex);
+	runCompletionThread=false;
+	completedFramesCond.signal();
+	}
+	completionThread.join();
+	
+	/* Delete all frames: */
+	for(std::deque<Frame*>::iterator cfIt=completedFrames.begin();cfIt!=completedFrames.end();++cfIt)
+		delete *cfIt;
+	delete pendingFrame;
+	for(std::vector<Frame*>::iterator ffIt=freeFrames.begin();ffIt!=freeFrames.end();++ffIt)
+		delete *ffIt;
+	}
+
+void GridReadback::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	
+	/* Retrieve the fence sync entry points used to detect finished read-backs: */
+	dataItem->haveFenceSync=initFenceSync();
+	
+	/* Create the pixel buffer objects of all read-back slots: */
+	size_t gridSizes[3]={size_t(gridSize[1]-1)*size_t(gridSize[0]-1),size_t(gridSize[1])*size_t(gridSize[0]),size_t(gridSize[1])*size_t(gridSize[0])};
+	for(int i=0;i<3;++i)
+		{
+		glGenBuffersARB(3,dataItem->slots[i].bufferObjects);
+		for(int j=0;j<3;++j)
+			{
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->slots[i].bufferObjects[j]);
+			glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,gridSizes[j]*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+			}
+		}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	}
+
+GridReadback::SubscriberID GridReadback::subscribe(int grids,double interval,GridReadback::CallbackFunction callback,void* callbackData)
+	{
+	Threads::Mutex::Lock subscribersLock(subscribersMutex);
+	
+	/* Add a new periodic subscriber: */
+	Subscriber newSubscriber;
+	newSubscriber.id=nextSubscriberId++;
+	newSubscriber.grids=grids;
+	newSubscriber.interval=interval;
+	newSubscriber.nextTime=0.0;
+	newSubscriber.oneShot=false;
+	newSubscriber.due=false;
+	newSubscriber.callback=callback;
+	newSubscriber.callbackData=callbackData;
+	subscribers.push_back(newSubscriber);
+	
+	return newSubscriber.id;
+	}
+
+void GridReadback::setInterval(GridReadback::SubscriberID subscriberId,double newInterval)
+	{
+	Threads::Mutex::Lock subscribersLock(subscribersMutex);
+	
+	for(std::vector<Subscriber>::iterator sIt=subscribers.begin();sIt!=subscribers.end();++sIt)
+		if(sIt->id==subscriberId)
+			{
+			sIt->interval=newInterval;
+			break;
+			}
+	}
+
+void GridReadback::unsubscribe(GridReadback::SubscriberID subscriberId)
+	{
+	/* Wait for a delivery in progress: */
+	Threads::Mutex::Lock deliveryLock(deliveryMutex);
+	Threads::Mutex::Lock subscribersLock(subscribersMutex);
+	
+	for(std::vector<Subscriber>::iterator sIt=subscribers.begin();sIt!=subscribers.end();++sIt)
+		if(sIt->id==subscriberId)
+			{
+			subscribers.erase(sIt);
+			break;
+			}
+	}
+
+void GridReadback::request(int grids,GridReadback::CallbackFunction callback,void* callbackData)
+	{
+	Threads::Mutex::Lock subscribersLock(subscribersMutex);
+	
+	/* Add a one-time subscriber that is due at the next frame: */
+	Subscriber newSubscriber;
+	newSubscriber.id=nextSubscriberId++;
+	newSubscriber.grids=grids;
+	newSubscriber.interval=0.0;
+	newSubscriber.nextTime=0.0;
+	newSubscriber.oneShot=true;
+	newSubscriber.due=true;
+	newSubscriber.callback=callback;
+	newSubscriber.callbackData=callbackData;
+	subscribers.push_back(newSubscriber);
+	}
+
+bool GridReadback::hasPendingRequests(void)
+	{
+	Threads::Mutex::Lock subscribersLock(subscribersMutex);
+	
+	for(std::vector<Subscriber>::iterator sIt=subscribers.begin();sIt!=subscribers.end();++sIt)
+		if(sIt->oneShot)
+			return true;
+	return false;
+	}
+
+void GridReadback::frame(double applicationTime)
+	{
+	Threads::Mutex::Lock subscribersLock(subscribersMutex);
+	
+	/* Check which periodic subscribers are due: */
+	for(std::vector<Subscriber>::iterator sIt=subscribers.begin();sIt!=subscribers.end();++sIt)
+		if(sIt->interval>0.0&&applicationTime>=sIt->nextTime)
+			{
+			sIt->due=true;
+			sIt->nextTime=(Math::floor(applicationTime/sIt->interval)+1.0)*sIt->interval;
+			}
+	
+	/* Mark the subscribers of dropped read-backs that are still subscribed as due again: */
+	Threads::Mutex::Lock pendingLock(pendingMutex);
+	for(std::vector<SubscriberID>::iterator rsIt=retrySubscribers.begin();rsIt!=retrySubscribers.end();++rsIt)
+		for(std::vector<Subscriber>::iterator sIt=subscribers.begin();sIt!=subscribers.end();++sIt)
+			if(sIt->id==*rsIt)
+				{
+				sIt->due=true;
+				break;
+				}
+	retrySubscribers.clear();
+	
+	/* Add all due subscribers to the pending read-back, so that all of them share a single read-back: */
+	for(std::vector<Subscriber>::iterator sIt=subscribers.begin();sIt!=subscribers.end();++sIt)
+		if(sIt->due)
+			{
+			if(pendingFrame==0)
+				pendingFrame=getFrame();
+			pendingFrame->grids|=sIt->grids;
+			pendingFrame->subscribers.push_back(sIt->id);
+			sIt->due=false;
+			}
+	}
+
+void GridReadback::readGrids(GLContextData& contextData) const
+	{
+	/* Get the data item, and create it if this OpenGL context was not initialized through the regular path: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	if(dataItem==0)
+		{
+		initContext(contextData);
+		dataItem=contextData.retrieveDataItem<DataItem>(this);
+		}
+	
+	/* Deliver all read-backs that have finished, or have had two frames to finish if fences are not supported: */
+	Slot* freeSlot=0;
+	for(int i=0;i<3;++i)
+		{
+		Slot& slot=dataItem->slots[i];
+		if(slot.frame!=0)
+			{
+			++slot.age;
+			bool finished;
+			if(dataItem->haveFenceSync)
+				{
+				GLenum waitResult=clientWaitSync(slot.fence,0);
+				finished=waitResult==GL_ALREADY_SIGNALED||waitResult==GL_CONDITION_SATISFIED;
+				}
+			else
+				finished=slot.age>=2;
+			if(finished)
+				completeSlot(slot);
+			}
+		if(slot.frame==0&&freeSlot==0)
+			freeSlot=&slot;
+		}
+	
+	/* Bail out if there is no free slot: */
+	if(freeSlot==0)
+		return;
+	
+	/* Take the pending read-back: */
+	Frame* frame;
+	{
+	Threads::Mutex::Lock pendingLock(pendingMutex);
+	frame=pendingFrame;
+	pendingFrame=0;
+	}
+	if(frame==0)
+		return;
+	
+	/* Retrieve the size of this context's grids, which is reduced while the quality governor lowers the water grid resolution: */
+	waterTable->bindQuantityTexture(contextData);
+	GLint readSize[2];
+	glGetTexLevelParameteriv(GL_TEXTURE_RECTANGLE_ARB,0,GL_TEXTURE_WIDTH,&readSize[0]);
+	glGetTexLevelParameteriv(GL_TEXTURE_RECTANGLE_ARB,0,GL_TEXTURE_HEIGHT,&readSize[1]);
+	for(int i=0;i<2;++i)
+		frame->readSize[i]=GLsizei(readSize[i]);
+	
+	/* Start reading back the requested grids into the free slot's buffer objects without waiting for the GPU: */
+	if(frame->grids&BATHYMETRY)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,freeSlot->bufferObjects[0]);
+		waterTable->bindBathymetryTexture(contextData);
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,0);
+		}
+	if(frame->grids&WATERLEVEL)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,freeSlot->bufferObjects[1]);
+		waterTable->bindQuantityTexture(contextData);
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,0);
+		}
+	if(frame->grids&SNOW)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,freeSlot->bufferObjects[2]);
+		waterTable->bindSnowTexture(contextData);
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,0);
+		}
+	for(int i=0;i<2;++i)
+		if(frame->grids&(i==0?QUANTITY:SNOWSTATE))
+			{
+			/* Create the slot's buffer object for full three-component grids on first use: */
+			GLuint& bufferObject=freeSlot->bufferObjects[3+i];
+			if(bufferObject==0)
+				{
+				glGenBuffersARB(1,&bufferObject);
+				glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,bufferObject);
+				glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,size_t(gridSize[1])*size_t(gridSize[0])*3*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+				}
+			else
+				glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,bufferObject);
+			if(i==0)
+				waterTable->bindQuantityTexture(contextData);
+			else
+				waterTable->bindSnowTexture(contextData);
+			glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB,GL_FLOAT,0);
+			}
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	
+	/* Fence the read-back: */
+	if(dataItem->haveFenceSync)
+		freeSlot->fence=fenceSync();
+	freeSlot->age=0;
+	freeSlot->frame=frame;
+	}
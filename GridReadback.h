@@ -0,0 +1,161 @@
+/***********************************************************************
+GridReadback - Class to read back the water table's bathymetry and water
+level grids from the GPU asynchronously through pixel buffer objects,
+and to hand them to any number of subscribers on a background thread.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDREADBACK_INCLUDED
+#define GRIDREADBACK_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <Threads/Mutex.h>
+#include <Threads/Cond.h>
+#include <Threads/Thread.h>
+#include <GL/gl.h>
+#include <GL/GLObject.h>
+
+#include "ShaderHelper.h"
+
+/* Forward declarations: */
+class GLContextData;
+class WaterTable2;
+
+class GridReadback:public GLObject
+	{
+	/* Embedded classes: */
+	public:
+	enum Grids // Enumerated type for grids that can be read back
+		{
+		BATHYMETRY=0x1,WATERLEVEL=0x2,SNOW=0x4,
+		QUANTITY=0x8, // Full three-component conserved quantity grid (w, hu, hv), delivered in place of the water level grid
+		SNOWSTATE=0x10 // Full three-component snow grid, delivered in place of the snow amount grid
+		};
+	
+	typedef void (*CallbackFunction)(const GLfloat* bathymetry,const GLfloat* waterLevel,const GLfloat* snow,void* userData); // Type for callback functions receiving read-back grids; grids are only valid during the call, and grids that were not requested are null
+	typedef unsigned int SubscriberID; // Type for keys identifying subscribers
+	
+	private:
+	struct Subscriber // Structure representing a consumer of read-back grids
+		{
+		/* Elements: */
+		public:
+		SubscriberID id; // Subscriber's unique key
+		int grids; // Bit mask of grids requested by the subscriber
+		double interval; // Application time between periodic read-backs, or zero if the subscriber is paused
+		double nextTime; // Application time of the subscriber's next periodic read-back
+		bool oneShot; // Flag whether the subscriber is removed after its first read-back
+		bool due; // Flag whether the subscriber is waiting for the next read-back to start
+		CallbackFunction callback; // Function receiving read-back grids
+		void* callbackData; // Additional data element passed to the callback function
+		};
+	
+	struct Frame // Structure holding a pair of read-back grids on their way to the subscribers
+		{
+		/* Elements: */
+		public:
+		GLfloat* bathymetry; // Read-back bathymetry grid at full size
+		GLfloat* waterLevel; // Read-back water level grid at full size
+		GLfloat* snow; // Read-back snow amount grid at full size
+		GLfloat* quantity; // Read-back three-component conserved quantity grid, or null if never requested
+		GLfloat* snowState; // Read-back three-component snow grid, or null if never requested
+		GLfloat* readBuffer; // Buffer receiving reduced grids before they are resampled to the full size, or null if never needed
+		GLsizei readSize[2]; // Size of the water table grids from which the frame was read back
+		int grids; // Bit mask of grids contained in the frame
+		std::vector<SubscriberID> subscribers; // Subscribers waiting for the frame
+		
+		/* Constructors and destructors: */
+		Frame(const GLsizei gridSize[2]); // Allocates grids of the given water table size
+		~Frame(void);
+		};
+	
+	struct Slot // Structure representing a read-back in flight in an OpenGL context
+		{
+		/* Elements: */
+		public:
+		GLuint bufferObjects[5]; // Pixel buffer objects receiving the bathymetry, water level, snow amount, conserved quantity, and snow grids; the latter two are created on first use
+		GLsync fence; // Fence signalled when the grids have been written into the buffer objects
+		unsigned int age; // Number of times the slot has been polled since its read-back started
+		Frame* frame; // Frame describing the read-back, or null if the slot is free
+		};
+	
+	struct DataItem:public GLObject::DataItem // Structure holding per-context state
+		{
+		/* Elements: */
+		public:
+		bool haveFenceSync; // Flag whether this OpenGL context supports fence sync objects
+		Slot slots[3]; // Ring of read-backs in flight
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
+	/* Elements: */
+	const WaterTable2* waterTable; // The water table whose grids are read back
+	GLsizei gridSize[2]; // Full size of the water table's cell-centered quantity grid
+	Threads::Mutex deliveryMutex; // Mutex held while callbacks run, serializing them against unsubscribing
+	Threads::Mutex subscribersMutex; // Mutex serializing access to the subscriber list
+	std::vector<Subscriber> subscribers; // List of current subscribers
+	SubscriberID nextSubscriberId; // Key for the next new subscriber
+	mutable Threads::Mutex pendingMutex; // Mutex protecting the pending read-back, the frame pool, and the list of subscribers to retry
+	mutable Frame* pendingFrame; // Read-back selected by the main thread that has not yet been started by an OpenGL context, or null
+	mutable std::vector<Frame*> freeFrames; // Pool of unused frames
+	mutable std::vector<SubscriberID> retrySubscribers; // Subscribers of dropped read-backs that are due again at the next frame
+	mutable Threads::Mutex completedFramesMutex; // Mutex protecting the completed frame queue
+	mutable Threads::Cond completedFramesCond; // Condition variable to wake up the completion thread
+	mutable std::deque<Frame*> completedFrames; // Queue of read-back frames waiting for delivery to their subscribers
+	volatile bool runCompletionThread; // Flag to keep the completion thread running
+	Threads::Thread completionThread; // Thread delivering read-back frames to their subscribers
+	
+	/* Private methods: */
+	Frame* getFrame(void) const; // Returns an unused frame from the pool; must be called with pendingMutex locked
+	void releaseFrame(Frame* frame) const; // Returns the given frame to the pool
+	void dropFrame(Frame* frame) const; // Returns the given frame to the pool without delivering it, and retries its subscribers at the next frame
+	void completeSlot(Slot& slot) const; // Copies the read-back grids of the given slot out of its buffer objects, resamples them to the full size if necessary, and queues them for delivery
+	void* completionThreadMethod(void); // Method delivering read-back frames to their subscribers
+	
+	/* Constructors and destructors: */
+	public:
+	GridReadback(const WaterTable2* sWaterTable); // Creates a read-back manager for the given water table's grids at its current size
+	private:
+	GridReadback(const GridReadback& source); // Prohibit copy constructor
+	GridReadback& operator=(const GridReadback& source); // Prohibit assignment operator
+	public:
+	virtual ~GridReadback(void);
+	
+	/* Methods from GLObject: */
+	virtual void initContext(GLContextData& contextData) const;
+	
+	/* New methods: */
+	const GLsizei* getGridSize(void) const // Returns the size of read-back water level and snow grids; bathymetry grids are one smaller in each dimension
+		{
+		return gridSize;
+		}
+	SubscriberID subscribe(int grids,double interval,CallbackFunction callback,void* callbackData); // Adds a subscriber receiving the given grids every given application time interval
+	void setInterval(SubscriberID subscriberId,double newInterval); // Changes the given subscriber's read-back interval; zero pauses the subscriber
+	void unsubscribe(SubscriberID subscriberId); // Removes the given subscriber; its callback will not be called after this method returns; must not be called from a callback
+	void request(int grids,CallbackFunction callback,void* callbackData); // Requests the given grids once
+	bool hasPendingRequests(void); // Returns true if a one-time request has not been delivered yet
+	void frame(double applicationTime); // Selects the subscribers due for a read-back; called once per frame from the main thread
+	void readGrids(GLContextData& contextData) const; // Delivers finished read-backs of the given OpenGL context and starts a pending read-back; grids read back while the water table has a reduced size are delivered at full size
+	};
+
+#endif
@@ -27,6 +27,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Math/Interval.h>
 #include <Geometry/Vector.h>
 
+#include "BandWorkerPool.h"
+#include "StageTimers.h"
+
 // DEBUGGING
 #include <iostream>
 
@@ -216,6 +219,46 @@ void drawCircle(Images::RGBImage& image,const Point2& center,float radius,const
 
 }
 
+/***************************************************
+Declaration of struct HandExtractor::ScratchBuffers:
+***************************************************/
+
+struct HandExtractor::ScratchBuffers
+	{
+	/* Elements: */
+	public:
+	std::vector<Span> spans; // Foreground spans of the searched region
+	std::vector<BlobOrigin> blobOrigins; // Origin points of the searched region's valid blobs
+	std::vector<EdgePixel> snake; // Pixels of the corner detection "snake"
+	std::vector<Corner> corners; // Corners of the blob currently being walked
+	};
+
+/****************************************************
+Declaration of class HandExtractor::RegionSearchJob:
+****************************************************/
+
+class HandExtractor::RegionSearchJob:public BandWorkerPool::Job
+	{
+	/* Elements: */
+	private:
+	HandExtractor& handExtractor; // The hand extractor whose search regions to search
+	const DepthPixel* depthFrame; // The depth frame to search
+	
+	/* Constructors and destructors: */
+	public:
+	RegionSearchJob(HandExtractor& sHandExtractor,const DepthPixel* sDepthFrame)
+		:handExtractor(sHandExtractor),depthFrame(sDepthFrame)
+		{
+		}
+	
+	/* Methods from BandWorkerPool::Job: */
+	virtual void runBand(unsigned int bandIndex)
+		{
+		/* Claim and search regions with the temporary buffers of this band's thread; band 0 belongs to the thread delivering raw frames: */
+		handExtractor.searchRegions(depthFrame,bandIndex==0?*handExtractor.scratchBuffers:handExtractor.workerScratchBuffers[bandIndex-1]);
+		}
+	};
+
 /**************************************
 Static elements of class HandExtractor:
 **************************************/
@@ -228,55 +271,18 @@ const int HandExtractor::walkDy[8]={ 0, 1, 1, 1, 0,-1,-1,-1};
 Methods of class HandExtractor:
 ******************************/
 
-void* HandExtractor::extractorThreadMethod(void)
-	{
-	unsigned int lastInputFrameVersion=0;
-	
-	while(true)
-		{
-		Kinect::FrameBuffer frame;
-		{
-		Threads::MutexCond::Lock inputLock(inputCond);
-		
-		/* Wait until a new frame arrives or the program shuts down: */
-		while(runExtractorThread&&lastInputFrameVersion==inputFrameVersion)
-			inputCond.wait(inputLock);
-		
-		/* Bail out if the program is shutting down: */
-		if(!runExtractorThread)
-			break;
-		
-		/* Work on the new frame: */
-		frame=inputFrame;
-		lastInputFrameVersion=inputFrameVersion;
-		}
-		
-		/* Prepare a new output hand list: */
-		HandList& newHandList=extractedHands.startNewValue();
-		
-		/* Extract hands from the new input frame: */
-		extractHands(frame.getData<DepthPixel>(),newHandList,0);
-		
-		/* Finalize the new extracted hands list in the output buffer: */
-		extractedHands.postNewValue();
-		
-		/* Pass the new output frame to the registered receiver: */
-		if(handsExtractedFunction!=0)
-			(*handsExtractedFunction)(newHandList);
-		}
-	
-	return 0;
-	}
-
 HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExtractor::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection)
 	:pixelDepthCorrection(sPixelDepthCorrection),depthProjection(sDepthProjection),
-	 inputFrameVersion(0),runExtractorThread(false),
 	 maxFgDepth(0x07ffU-1U),maxDepthDist(1),minBlobSize(1500),maxBlobSize(150000),
 	 blobIdImage(0),
-	 snakeLength(50),snake(0),
+	 snakeLength(50),
 	 maxCornerEnterDist(28),minCenterDist(10),minCornerExitDist(32),
 	 minHandProbability(0.15f),
-	 handsExtractedFunction(0)
+	 scratchBuffers(new ScratchBuffers),
+	 fullFrameInterval(0),roiScale(2.0f),roiMargin(16),numTrackedFrames(0),
+	 numTrackingThreads(1),workerPool(0),workerScratchBuffers(0),nextRegionIndex(0),
+	 handsExtractedFunction(0),
+	 stageTimers(0)
 	{
 	/* Copy the depth frame size: */
 	for(int i=0;i<2;++i)
@@ -300,27 +306,16 @@ HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExt
 	/* Calculate the array of edge walking pointer offsets: */
 	for(int i=0;i<8;++i)
 		walkOffsets[i]=walkDy[i]*biStride+walkDx[i];
-	
-	/* Initialize the edge walking snake: */
-	setSnakeLength(snakeLength);
-	
-	/* Start the hand extraction thread: */
-	runExtractorThread=true;
-	extractorThread.start(this,&HandExtractor::extractorThreadMethod);
 	}
 
 HandExtractor::~HandExtractor(void)
 	{
-	/* Shut down the extraction thread: */
-	{
-	Threads::MutexCond::Lock inputLock(inputCond);
-	runExtractorThread=false;
-	inputCond.signal();
-	}
-	extractorThread.join();
+	/* Shut down the worker pool: */
+	delete workerPool;
+	delete[] workerScratchBuffers;
 	
 	delete[] blobIdImage;
-	delete[] snake;
+	delete scratchBuffers;
 	}
 
 void HandExtractor::setMaxFgDepth(DepthPixel newMaxFgDepth)
@@ -341,11 +336,8 @@ void HandExtractor::setBlobSizeRange(unsigned int newMinBlobSize,unsigned int ne
 
 void HandExtractor::setSnakeLength(unsigned int newSnakeLength)
 	{
+	/* Snake arrays are resized by each thread before walking blob edges: */
 	snakeLength=newSnakeLength;
-	
-	/* Re-allocate the snake array: */
-	delete[] snake;
-	snake=new EdgePixel[snakeLength];
 	}
 
 void HandExtractor::setCornerDists(int newMaxCornerEnterDist,int newMinCenterDist,int newMinCornerExitDist)
@@ -355,32 +347,29 @@ void HandExtractor::setCornerDists(int newMaxCornerEnterDist,int newMinCenterDis
 	minCornerExitDist=newMinCornerExitDist;
 	}
 
-void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,HandExtractor::HandList& hands,Images::RGBImage* blobImage)
+void HandExtractor::extractRegion(const HandExtractor::DepthPixel* depthFrame,const HandExtractor::Region& region,HandExtractor::ScratchBuffers& buffers,HandExtractor::RegionResult& result,Images::RGBImage* blobImage)
 	{
 	Images::RGBImage::Color* imgPtr=0;
 	if(blobImage!=0)
-		{
-		/* Create the result image: */
-		blobImage->clear(Images::RGBImage::Color(0,0,0));
 		imgPtr=blobImage->replacePixels();
-		}
 	
-	/* Extract all four-connected foreground blobs from the given depth frame: */
-	std::vector<Span> spans;
+	/* Extract all four-connected foreground blobs from the given region of the depth frame: */
+	std::vector<Span>& spans=buffers.spans;
+	spans.clear();
 	unsigned int numSpans=0;
 	unsigned int lastRowSpan=0;
-	const DepthPixel* dfRowPtr=depthFrame;
-	for(unsigned int y=0;y<depthFrameSize[1];++y,dfRowPtr+=depthFrameSize[0])
+	const DepthPixel* dfRowPtr=depthFrame+region.min[1]*depthFrameSize[0];
+	for(unsigned int y=region.min[1];y<region.max[1];++y,dfRowPtr+=depthFrameSize[0])
 		{
-		const DepthPixel* dfPtr=dfRowPtr;
+		const DepthPixel* dfPtr=dfRowPtr+region.min[0];
 		unsigned int rowSpan=numSpans;
-		unsigned int x=0;
+		unsigned int x=region.min[0];
 		while(true)
 			{
 			/* Find the beginning of the next foreground span: */
-			for(;x<depthFrameSize[0]&&*dfPtr>maxFgDepth;++x,++dfPtr)
+			for(;x<region.max[0]&&*dfPtr>maxFgDepth;++x,++dfPtr)
 				;
-			if(x>=depthFrameSize[0])
+			if(x>=region.max[0])
 				break;
 			
 			/* Start a new foreground span: */
@@ -392,7 +381,7 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 			DepthPixel lastDepth=*dfPtr;
 			++x;
 			++dfPtr;
-			for(;x<depthFrameSize[0]&&*dfPtr<=maxFgDepth&&*dfPtr+maxDepthDist>=lastDepth&&*dfPtr<=lastDepth+maxDepthDist;++x,++dfPtr)
+			for(;x<region.max[0]&&*dfPtr<=maxFgDepth&&*dfPtr+maxDepthDist>=lastDepth&&*dfPtr<=lastDepth+maxDepthDist;++x,++dfPtr)
 				lastDepth=*dfPtr;
 			
 			/* Finalize and store the new foreground span: */
@@ -519,22 +508,38 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 	#endif
 	
 	/* Create an array of blob origin points: */
-	BlobOrigin* blobOrigins=new BlobOrigin[nextBlobId];
+	std::vector<BlobOrigin>& blobOrigins=buffers.blobOrigins;
+	blobOrigins.resize(nextBlobId);
 	for(unsigned int i=0;i<nextBlobId;++i)
 		blobOrigins[i].assigned=false;
 	
-	/* Create the blob ID image: */
-	unsigned short* biRowPtr=blobIdImage+biStride+1;
+	/* Surround the region with invalid blob IDs so that edge walks cannot leave it; the full frame's surround is the blob ID image's border: */
+	unsigned short* biCornerPtr=blobIdImage+region.min[1]*biStride+region.min[0];
+	unsigned int regionWidth=region.max[0]-region.min[0];
+	unsigned int regionHeight=region.max[1]-region.min[1];
+	for(unsigned int x=0;x<regionWidth+2;++x)
+		{
+		biCornerPtr[x]=invalidBlobId;
+		biCornerPtr[(regionHeight+1)*biStride+x]=invalidBlobId;
+		}
+	for(unsigned int y=1;y<regionHeight+1;++y)
+		{
+		biCornerPtr[y*biStride]=invalidBlobId;
+		biCornerPtr[y*biStride+regionWidth+1]=invalidBlobId;
+		}
+	
+	/* Create the region's part of the blob ID image: */
+	unsigned short* biRowPtr=blobIdImage+(region.min[1]+1)*biStride+(region.min[0]+1);
 	unsigned int spanIndex=0;
-	for(unsigned int y=0;y<depthFrameSize[1];++y,biRowPtr+=biStride)
+	for(unsigned int y=region.min[1];y<region.max[1];++y,biRowPtr+=biStride)
 		{
 		/* Process all spans and spaces between spans in the current row: */
-		unsigned int x=0;
+		unsigned int x=region.min[0];
 		unsigned short* biPtr=biRowPtr;
 		while(true)
 			{
 			/* Find the start of the next span in the current row: */
-			unsigned int nextSpanStart=depthFrameSize[0];
+			unsigned int nextSpanStart=region.max[0];
 			if(spanIndex<numSpans&&spans[spanIndex].y==y)
 				nextSpanStart=spans[spanIndex].start;
 			
@@ -543,7 +548,7 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 				*biPtr=invalidBlobId;
 			
 			/* Bail out if the current row is done: */
-			if(x==depthFrameSize[0])
+			if(x==region.max[0])
 				break;
 			
 			/* Check if the current span's blob is valid, and encountered for the first time: */
@@ -566,16 +571,19 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 			}
 		}
 	
-	/* Initialize the result list: */
-	hands.clear();
+	/* Initialize the result lists: */
+	result.hands.clear();
+	result.trackedHands.clear();
 	
 	/* Walk around the edges of all foreground blobs in counter-clockwise order and decide whether they are hand-shaped: */
+	buffers.snake.resize(snakeLength);
+	EdgePixel* snake=&buffers.snake[0];
 	EdgePixel* snakeEnd=snake+snakeLength;
 	int enterDist2=Math::sqr(maxCornerEnterDist);
 	int centerDist2=Math::sqr(minCenterDist);
 	int exitDist2=Math::sqr(minCornerExitDist);
-	std::vector<Corner> corners;
-	corners.reserve(10);
+	std::vector<Corner>& corners=buffers.corners;
+	corners.clear();
 	for(unsigned int blobId=0;blobId<nextBlobId;++blobId)
 		{
 		/* Initialize the edge-walking snake: */
@@ -872,7 +880,17 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 			Hand newHand;
 			newHand.center=depthProjection.transform(Point(center[0],center[1],depth));
 			newHand.radius=Geometry::dist(newHand.center,depthProjection.transform(Point(center[0]+radius,center[1],depth)));
-			hands.push_back(newHand);
+			result.hands.push_back(newHand);
+			
+			/* Remember the hand in depth frame space to predict the next frame's search region: */
+			TrackedHand newTrackedHand;
+			for(int i=0;i<2;++i)
+				{
+				newTrackedHand.center[i]=center[i];
+				newTrackedHand.velocity[i]=0.0f;
+				}
+			newTrackedHand.radius=radius;
+			result.trackedHands.push_back(newTrackedHand);
 			
 			// DEBUGGING
 			// std::cout<<"Hand in camera space: "<<newHand.center[0]<<", "<<newHand.center[1]<<", "<<newHand.center[2]<<", "<<newHand.radius<<std::endl;
@@ -881,9 +899,144 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 		/* Clean up: */
 		corners.clear();
 		}
+	}
+
+void HandExtractor::predictRegions(void)
+	{
+	/* Create a search region around each tracked hand's predicted position: */
+	regions.clear();
+	for(std::vector<TrackedHand>::const_iterator thIt=trackedHands.begin();thIt!=trackedHands.end();++thIt)
+		{
+		Region r;
+		for(int i=0;i<2;++i)
+			{
+			/* Widen the region by the hand's velocity to allow for acceleration: */
+			float predicted=thIt->center[i]+thIt->velocity[i];
+			float halfSize=thIt->radius*roiScale+float(roiMargin)+Math::abs(thIt->velocity[i]);
+			int min=int(Math::floor(predicted-halfSize));
+			int max=int(Math::ceil(predicted+halfSize));
+			r.min[i]=min>0?(unsigned int)(min):0U;
+			r.max[i]=max<int(depthFrameSize[i])?(unsigned int)(max):depthFrameSize[i];
+			}
+		if(r.min[0]<r.max[0]&&r.min[1]<r.max[1])
+			regions.push_back(r);
+		}
 	
-	/* Clean up: */
-	delete[] blobOrigins;
+	/* Merge regions until no two regions or their borders of invalid blob IDs touch, so that threads can search them independently: */
+	bool merged=true;
+	while(merged)
+		{
+		merged=false;
+		for(size_t i=0;i<regions.size()&&!merged;++i)
+			for(size_t j=i+1;j<regions.size()&&!merged;++j)
+				{
+				Region& r0=regions[i];
+				const Region& r1=regions[j];
+				if(r0.min[0]<r1.max[0]+2&&r1.min[0]<r0.max[0]+2&&r0.min[1]<r1.max[1]+2&&r1.min[1]<r0.max[1]+2)
+					{
+					for(int k=0;k<2;++k)
+						{
+						r0.min[k]=Misc::min(r0.min[k],r1.min[k]);
+						r0.max[k]=Misc::max(r0.max[k],r1.max[k]);
+						}
+					regions.erase(regions.begin()+j);
+					merged=true;
+					}
+				}
+		}
+	}
+
+void HandExtractor::searchRegions(const HandExtractor::DepthPixel* depthFrame,HandExtractor::ScratchBuffers& buffers)
+	{
+	while(true)
+		{
+		/* Claim the next unsearched region: */
+		unsigned int regionIndex;
+		{
+		Threads::Mutex::Lock regionLock(regionMutex);
+		if(nextRegionIndex>=regions.size())
+			break;
+		regionIndex=nextRegionIndex;
+		++nextRegionIndex;
+		}
+		
+		/* Search the region: */
+		extractRegion(depthFrame,regions[regionIndex],buffers,regionResults[regionIndex],0);
+		}
+	}
+
+void HandExtractor::updateTracking(const std::vector<HandExtractor::TrackedHand>& newTrackedHands)
+	{
+	/* Estimate each new hand's velocity from the closest previously tracked hand that is within its radius: */
+	std::vector<TrackedHand> updatedHands=newTrackedHands;
+	for(std::vector<TrackedHand>::iterator uhIt=updatedHands.begin();uhIt!=updatedHands.end();++uhIt)
+		{
+		float minDist2=Math::sqr(uhIt->radius);
+		for(std::vector<TrackedHand>::const_iterator thIt=trackedHands.begin();thIt!=trackedHands.end();++thIt)
+			{
+			float dist2=Math::sqr(uhIt->center[0]-thIt->center[0])+Math::sqr(uhIt->center[1]-thIt->center[1]);
+			if(minDist2>dist2)
+				{
+				minDist2=dist2;
+				for(int i=0;i<2;++i)
+					uhIt->velocity[i]=uhIt->center[i]-thIt->center[i];
+				}
+			}
+		}
+	
+	trackedHands.swap(updatedHands);
+	}
+
+void HandExtractor::startWorkerPool(unsigned int numThreads)
+	{
+	/* Shut down the current worker pool: */
+	delete workerPool;
+	workerPool=0;
+	delete[] workerScratchBuffers;
+	workerScratchBuffers=0;
+	
+	if(numThreads>1)
+		{
+		/* Start a new worker pool with temporary buffers for each worker thread: */
+		workerScratchBuffers=new ScratchBuffers[numThreads-1];
+		workerPool=new BandWorkerPool(numThreads);
+		}
+	}
+
+void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,HandExtractor::HandList& hands,Images::RGBImage* blobImage)
+	{
+	if(blobImage!=0)
+		{
+		/* Create the result image: */
+		blobImage->clear(Images::RGBImage::Color(0,0,0));
+		}
+	
+	/* Search the entire depth frame: */
+	Region fullFrame;
+	for(int i=0;i<2;++i)
+		{
+		fullFrame.min[i]=0;
+		fullFrame.max[i]=depthFrameSize[i];
+		}
+	RegionResult result;
+	extractRegion(depthFrame,fullFrame,*scratchBuffers,result,blobImage);
+	hands.swap(result.hands);
+	
+	/* Restart tracking from the detected hands: */
+	updateTracking(result.trackedHands);
+	numTrackedFrames=0;
+	}
+
+void HandExtractor::setTracking(unsigned int newFullFrameInterval,float newRoiScale,unsigned int newRoiMargin)
+	{
+	fullFrameInterval=newFullFrameInterval;
+	roiScale=newRoiScale;
+	roiMargin=newRoiMargin;
+	}
+
+void HandExtractor::setNumTrackingThreads(unsigned int newNumTrackingThreads)
+	{
+	numTrackingThreads=newNumTrackingThreads>0?newNumTrackingThreads:1;
 	}
 
 void HandExtractor::setHandsExtractedFunction(HandExtractor::HandsExtractedFunction* newHandsExtractedFunction)
@@ -892,14 +1045,69 @@ void HandExtractor::setHandsExtractedFunction(HandExtractor::HandsExtractedFunct
 	handsExtractedFunction=newHandsExtractedFunction;
 	}
 
-void HandExtractor::receiveRawFrame(const Kinect::FrameBuffer& newFrame)
+void HandExtractor::setStageTimers(const StageTimers* newStageTimers)
+	{
+	stageTimers=newStageTimers;
+	}
+
+void HandExtractor::receiveRawFrame(const Kinect::FrameBuffer& frame)
+	{
+	/* Prepare a new output hand list: */
+	HandList& newHandList=extractedHands.startNewValue();
+	
 	{
-	Threads::MutexCond::Lock inputLock(inputCond);
+	/* Extract hands from the new input frame: */
+	StageTimers::CPUTimer extractTimer(stageTimers,StageTimers::HANDEXTRACTOR);
+	const DepthPixel* depthFrame=frame.getData<DepthPixel>();
+	bool tracked=false;
+	if(fullFrameInterval>0&&!trackedHands.empty()&&numTrackedFrames<fullFrameInterval)
+		{
+		/* Adjust the worker pool if the requested number of tracking threads changed: */
+		if((workerPool!=0?workerPool->getNumThreads():1)!=numTrackingThreads)
+			startWorkerPool(numTrackingThreads);
+		
+		/* Search only around the predicted positions of the hands detected in the previous frame: */
+		predictRegions();
+		regionResults.resize(regions.size());
+		nextRegionIndex=0;
+		if(workerPool!=0&&regions.size()>1)
+			{
+			/* Share the regions between this thread and the worker threads, and wait until all regions are searched: */
+			RegionSearchJob job(*this,depthFrame);
+			workerPool->run(job);
+			}
+		else
+			searchRegions(depthFrame,*scratchBuffers);
+		
+		/* Collect the hands found in all regions: */
+		newHandList.clear();
+		std::vector<TrackedHand> newTrackedHands;
+		for(std::vector<RegionResult>::iterator rrIt=regionResults.begin();rrIt!=regionResults.end();++rrIt)
+			{
+			newHandList.insert(newHandList.end(),rrIt->hands.begin(),rrIt->hands.end());
+			newTrackedHands.insert(newTrackedHands.end(),rrIt->trackedHands.begin(),rrIt->trackedHands.end());
+			}
+		
+		/* Keep tracking unless a hand was lost, in which case the full frame is searched again right away: */
+		if(newTrackedHands.size()>=trackedHands.size())
+			{
+			updateTracking(newTrackedHands);
+			++numTrackedFrames;
+			tracked=true;
+			}
+		}
+	
+	if(!tracked)
+		{
+		/* Search the entire frame: */
+		extractHands(depthFrame,newHandList,0);
+		}
+	}
 	
-	/* Store the new buffer in the input buffer: */
-	inputFrame=newFrame;
-	++inputFrameVersion;
+	/* Finalize the new extracted hands list in the output buffer: */
+	extractedHands.postNewValue();
 	
-	/* Signal the background thread: */
-	inputCond.signal();
+	/* Pass the new output frame to the registered receiver: */
+	if(handsExtractedFunction!=0)
+		(*handsExtractedFunction)(newHandList);
 	}
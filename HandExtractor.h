@@ -25,8 +25,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <stddef.h>
 #include <vector>
 #include <Misc/SizedTypes.h>
-#include <Threads/Thread.h>
-#include <Threads/MutexCond.h>
+#include <Threads/Mutex.h>
 #include <Threads/TripleBuffer.h>
 #include <Images/RGBImage.h>
 #include <Kinect/FrameBuffer.h>
@@ -39,6 +38,8 @@ namespace Misc {
 template <class ParameterParam>
 class FunctionCall;
 }
+class BandWorkerPool;
+class StageTimers;
 
 class HandExtractor
 	{
@@ -66,6 +67,34 @@ class HandExtractor
 		int x,y; // Position of edge pixel in depth frame
 		const unsigned short* biPtr; // Pointer to edge pixel in blob ID image
 		};
+	
+	struct Region // Helper structure describing a rectangular part of the depth frame to search for hands
+		{
+		/* Elements: */
+		public:
+		unsigned int min[2]; // Inclusive lower corner of the region in depth frame pixels
+		unsigned int max[2]; // Exclusive upper corner of the region in depth frame pixels
+		};
+	
+	struct TrackedHand // Helper structure to predict where a previously detected hand will be in the next frame
+		{
+		/* Elements: */
+		public:
+		float center[2]; // Hand's center in depth frame pixels
+		float velocity[2]; // Hand's motion since the previous frame in depth frame pixels
+		float radius; // Hand's approximate radius in depth frame pixels
+		};
+	
+	struct RegionResult // Helper structure holding the hands found in one search region
+		{
+		/* Elements: */
+		public:
+		HandList hands; // Detected hands in camera space
+		std::vector<TrackedHand> trackedHands; // Detected hands in depth frame space
+		};
+	
+	struct ScratchBuffers; // Helper structure holding one thread's temporary buffers for blob extraction
+	class RegionSearchJob; // Helper class to search the regions of a frame on the worker pool
 
 	/* Elements: */
 	private:
@@ -73,12 +102,6 @@ class HandExtractor
 	const PixelDepthCorrection* pixelDepthCorrection; // Buffer of per-pixel depth correction coefficients
 	PTransform depthProjection; // Projective transformation from depth image space to camera space
 	
-	Threads::MutexCond inputCond; // Condition variable to signal arrival of a new input frame
-	Kinect::FrameBuffer inputFrame; // The most recent input frame
-	unsigned int inputFrameVersion; // Version number of input frame
-	volatile bool runExtractorThread; // Flag to keep the background extraction thread running
-	Threads::Thread extractorThread; // The background filtering thread
-	
 	DepthPixel maxFgDepth; // Maximum depth value for foreground blobs
 	unsigned int maxDepthDist; // Maximum depth distance between adjacent pixels to belong to the same foreground blob
 	unsigned int minBlobSize,maxBlobSize; // Minimum and maximum number of pixels to consider a blob a hand candidate
@@ -89,17 +112,35 @@ class HandExtractor
 	static const int walkDy[8]; // Array of edge walking steps in clockwise order in y
 	ptrdiff_t walkOffsets[8]; // Array of pointer offsets for edge walking steps in clockwise order
 	unsigned int snakeLength; // Length of the "snake" walking around blobs' edges to detect corners
-	EdgePixel* snake; // Array of snake's pixels
 	int maxCornerEnterDist; // Maximum distance between snake's head and tail to enter corner state
 	int minCenterDist; // Minimum distance from snake's center to line defined by its head and tail to enter corner state
 	int minCornerExitDist; // Minimum distance between snake's head and tail to leave corner state
 	float minHandProbability; // Minimum probability rating at which to accept a blob as a hand
+	ScratchBuffers* scratchBuffers; // Temporary blob extraction buffers for the thread calling extractHands
+	
+	unsigned int fullFrameInterval; // Number of frames between full-frame searches while tracking hands; 0 disables tracking
+	float roiScale; // Ratio between a tracked hand's search region half-size and its radius
+	unsigned int roiMargin; // Additional margin around a tracked hand's search region in depth frame pixels
+	std::vector<TrackedHand> trackedHands; // Hands detected in the most recent frame, in depth frame space
+	unsigned int numTrackedFrames; // Number of frames processed since the most recent full-frame search
+	unsigned int numTrackingThreads; // Requested number of threads, including the thread delivering raw frames, sharing the search regions of each frame
+	BandWorkerPool* workerPool; // Pool of worker threads helping the thread delivering raw frames search regions of interest, or null if there are no worker threads
+	ScratchBuffers* workerScratchBuffers; // Temporary blob extraction buffers, one for each worker thread
+	Threads::Mutex regionMutex; // Mutex protecting the index of the next unclaimed search region
+	std::vector<Region> regions; // Search regions of the current frame
+	std::vector<RegionResult> regionResults; // Hands found in each search region of the current frame
+	unsigned int nextRegionIndex; // Index of the next search region not yet claimed by a thread; protected by regionMutex
 	
 	Threads::TripleBuffer<HandList> extractedHands; // Triple buffer of lists of extracted hands
 	HandsExtractedFunction* handsExtractedFunction; // Function called when a new list of extracted hands is ready
+	const StageTimers* stageTimers; // Timer set measuring hand extraction, or null
 	
 	/* Private methods: */
-	void* extractorThreadMethod(void); // Method for the background hand extraction thread
+	void extractRegion(const DepthPixel* depthFrame,const Region& region,ScratchBuffers& buffers,RegionResult& result,Images::RGBImage* blobImage); // Extracts hands from the given region of the given depth frame using the given temporary buffers
+	void predictRegions(void); // Calculates non-overlapping search regions around the predicted positions of all tracked hands
+	void searchRegions(const DepthPixel* depthFrame,ScratchBuffers& buffers); // Claims and searches regions of the current frame until none are left
+	void updateTracking(const std::vector<TrackedHand>& newTrackedHands); // Matches newly detected hands against tracked hands to estimate their velocities
+	void startWorkerPool(unsigned int numThreads); // Replaces the current worker pool with a pool sharing search regions among the given number of threads, including the thread delivering raw frames
 	
 	/* Constructors and destructors: */
 	public:
@@ -149,8 +190,15 @@ class HandExtractor
 		}
 	void setCornerDists(int newMaxCornerEnterDist,int newMinCenterDist,int newMinCornerExitDist); // Sets distances between snake's head and tail to enter and exit corner state, respectively
 	void extractHands(const DepthPixel* depthFrame,HandList& hands,Images::RGBImage* blobImage); // Extracts hands from the given depth frame
+	unsigned int getFullFrameInterval(void) const // Returns the number of frames between full-frame searches while tracking hands
+		{
+		return fullFrameInterval;
+		}
+	void setTracking(unsigned int newFullFrameInterval,float newRoiScale,unsigned int newRoiMargin); // Searches only around previously detected hands, and the full frame every given number of frames or when a hand is lost; an interval of 0 searches the full frame every time
+	void setNumTrackingThreads(unsigned int newNumTrackingThreads); // Sets the number of threads sharing the search regions of each frame while tracking; takes effect with the next frame
 	void setHandsExtractedFunction(HandsExtractedFunction* newHandsExtractedFunction); // Sets the output function; adopts given functor object
-	void receiveRawFrame(const Kinect::FrameBuffer& newFrame); // Called to receive a new raw depth frame
+	void setStageTimers(const StageTimers* newStageTimers); // Measures the CPU time of hand extraction with the given timer set, or stops measuring if null
+	void receiveRawFrame(const Kinect::FrameBuffer& frame); // Extracts hands from the given raw depth frame in the calling thread, using the tracking state of previous frames, and passes them to the output function; must not be called concurrently
 	bool lockNewExtractedHands(void) // Locks the most recently produced output list of extracted hands for reading; returns true if the locked list is new
 		{
 		return extractedHands.lockNewValue();
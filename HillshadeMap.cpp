@@ -0,0 +1,298 @@
+/***********************************************************************
+HillshadeMap - Class to maintain a cached map of sun visibility and
+ambient occlusion of the current surface in depth image space, which is
+only recalculated for tiles whose bathymetry changed and when the sun
+moves.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "HillshadeMap.h"
+
+#include <stdio.h>
+#include <vector>
+#include <Math/Math.h>
+#include <Geometry/Matrix.h>
+#include <GL/gl.h>
+#include <GL/GLContextData.h>
+#include <GL/Extensions/GLARBFragmentShader.h>
+#include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/Extensions/GLARBTextureRectangle.h>
+#include <GL/Extensions/GLARBTextureRg.h>
+#include <GL/Extensions/GLARBVertexShader.h>
+#include <GL/Extensions/GLEXTFramebufferObject.h>
+#include <GL/GLTransformationWrappers.h>
+
+#include "DepthImageRenderer.h"
+#include "ShaderHelper.h"
+
+/***************************************
+Methods of class HillshadeMap::DataItem:
+***************************************/
+
+HillshadeMap::DataItem::DataItem(void)
+	:hillshadeTextureObject(0),hillshadeFramebufferObject(0),
+	 hillshadeShader(0),
+	 depthImageVersion(0),sunVersion(0)
+	{
+	/* Initialize all required extensions: */
+	GLARBFragmentShader::initExtension();
+	GLARBMultitexture::initExtension();
+	GLARBShaderObjects::initExtension();
+	GLARBTextureRectangle::initExtension();
+	GLARBTextureRg::initExtension();
+	GLARBVertexShader::initExtension();
+	GLEXTFramebufferObject::initExtension();
+	}
+
+HillshadeMap::DataItem::~DataItem(void)
+	{
+	/* Release all allocated textures, buffers, and shaders: */
+	glDeleteTextures(1,&hillshadeTextureObject);
+	glDeleteFramebuffersEXT(1,&hillshadeFramebufferObject);
+	glDeleteObjectARB(hillshadeShader);
+	}
+
+/*****************************
+Methods of class HillshadeMap:
+*****************************/
+
+void HillshadeMap::updateReach(void)
+	{
+	/* Intersect the viewing rays of two adjacent pixels at the center of the depth image with the base plane to estimate the size of a pixel on the surface: */
+	const PTransform::Matrix& dp=depthImageRenderer->getDepthProjection().getMatrix();
+	const Plane& basePlane=depthImageRenderer->getBasePlane();
+	Point ps[2];
+	for(int i=0;i<2;++i)
+		{
+		/* Get the viewing ray in homogeneous camera space as a function of depth image-space depth: */
+		Scalar px=Scalar(depthImageRenderer->getDepthImageSize(0)/2+i)+Scalar(0.5);
+		Scalar py=Scalar(depthImageRenderer->getDepthImageSize(1)/2)+Scalar(0.5);
+		Scalar a[4],b[4];
+		for(int j=0;j<4;++j)
+			{
+			a[j]=dp(j,0)*px+dp(j,1)*py+dp(j,3);
+			b[j]=dp(j,2);
+			}
+		
+		/* Solve for the depth at which the ray crosses the base plane: */
+		Scalar fa=basePlane.getNormal()*Vector(a)-basePlane.getOffset()*a[3];
+		Scalar fb=basePlane.getNormal()*Vector(b)-basePlane.getOffset()*b[3];
+		Scalar d=fb!=Scalar(0)?-fa/fb:Scalar(0);
+		for(int j=0;j<3;++j)
+			ps[i][j]=(a[j]+d*b[j])/(a[3]+d*b[3]);
+		}
+	Scalar pixelSize=Geometry::dist(ps[0],ps[1]);
+	
+	/* Add the GPU spatial filter's footprint and round up to whole tiles: */
+	Scalar reach=Math::max(pixelSize>Scalar(0)?shadowDistance/pixelSize:Scalar(0),Scalar(aoRadius))+Scalar(4);
+	unsigned int tileSize=depthImageRenderer->getTileSize();
+	reachTiles=(unsigned int)(Math::ceil(reach/Scalar(tileSize)));
+	}
+
+HillshadeMap::HillshadeMap(const DepthImageRenderer* sDepthImageRenderer)
+	:depthImageRenderer(sDepthImageRenderer),
+	 shadowDistance(20),aoRadius(8.0f),reachTiles(1),
+	 sunDirection(0,0,1),sunVersion(1)
+	{
+	updateReach();
+	}
+
+void HillshadeMap::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	
+	/* Create the hillshade texture: */
+	const unsigned int* size=depthImageRenderer->getDepthImageSize();
+	glGenTextures(1,&dataItem->hillshadeTextureObject);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->hillshadeTextureObject);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RG8,size[0],size[1],0,GL_RG,GL_UNSIGNED_BYTE,0);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	
+	/* Save the currently bound frame buffer: */
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	/* Create the hillshade frame buffer and attach the hillshade texture: */
+	glGenFramebuffersEXT(1,&dataItem->hillshadeFramebufferObject);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->hillshadeFramebufferObject);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->hillshadeTextureObject,0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	glReadBuffer(GL_NONE);
+	
+	/* Restore the previously bound frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	
+	/* Create a simple vertex shader to render quads in pixel space: */
+	static const char* vertexShaderSourceTemplate="void main(){gl_Position=vec4(gl_Vertex.x*%f-1.0,gl_Vertex.y*%f-1.0,0.0,1.0);}";
+	char vertexShaderSource[256];
+	snprintf(vertexShaderSource,sizeof(vertexShaderSource),vertexShaderSourceTemplate,2.0/double(size[0]),2.0/double(size[1]));
+	
+	/* Create the hillshade shader: */
+	dataItem->hillshadeShader=linkVertexStringAndFragmentShader(vertexShaderSource,"HillshadeMapShader");
+	dataItem->hillshadeShaderUniforms[0]=glGetUniformLocationARB(dataItem->hillshadeShader,"depthSampler");
+	dataItem->hillshadeShaderUniforms[1]=glGetUniformLocationARB(dataItem->hillshadeShader,"depthImageSize");
+	dataItem->hillshadeShaderUniforms[2]=glGetUniformLocationARB(dataItem->hillshadeShader,"depthProjection");
+	dataItem->hillshadeShaderUniforms[3]=glGetUniformLocationARB(dataItem->hillshadeShader,"depthProjectionInverse");
+	dataItem->hillshadeShaderUniforms[4]=glGetUniformLocationARB(dataItem->hillshadeShader,"basePlane");
+	dataItem->hillshadeShaderUniforms[5]=glGetUniformLocationARB(dataItem->hillshadeShader,"sunDirection");
+	dataItem->hillshadeShaderUniforms[6]=glGetUniformLocationARB(dataItem->hillshadeShader,"shadowDistance");
+	dataItem->hillshadeShaderUniforms[7]=glGetUniformLocationARB(dataItem->hillshadeShader,"aoRadius");
+	}
+
+void HillshadeMap::setShadowDistance(Scalar newShadowDistance)
+	{
+	shadowDistance=newShadowDistance;
+	updateReach();
+	
+	/* Invalidate the hillshade map: */
+	++sunVersion;
+	}
+
+void HillshadeMap::setAoRadius(GLfloat newAoRadius)
+	{
+	aoRadius=newAoRadius;
+	updateReach();
+	
+	/* Invalidate the hillshade map: */
+	++sunVersion;
+	}
+
+void HillshadeMap::setSunDirection(const Vector& newSunDirection)
+	{
+	/* Ignore changes too small to move any shadow edge noticeably: */
+	Vector newDir=newSunDirection;
+	newDir.normalize();
+	if(newDir*sunDirection<Scalar(0.99999))
+		{
+		sunDirection=newDir;
+		++sunVersion;
+		}
+	}
+
+void HillshadeMap::update(GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Bail out if neither the bathymetry nor the sun changed since the last update: */
+	unsigned int depthImageVersion=depthImageRenderer->getDepthImageVersion();
+	bool sunMoved=dataItem->sunVersion!=sunVersion;
+	if(!sunMoved&&dataItem->depthImageVersion==depthImageVersion)
+		return;
+	
+	/* Flag the tiles to update, which are all tiles if the sun moved, or all tiles within reach of a changed tile: */
+	unsigned int tileSize=depthImageRenderer->getTileSize();
+	const unsigned int* numTiles=depthImageRenderer->getNumTiles();
+	std::vector<unsigned char> updateTiles(numTiles[1]*numTiles[0],sunMoved?1:0);
+	if(!sunMoved)
+		{
+		const unsigned int* tvPtr=depthImageRenderer->getTileVersions();
+		for(unsigned int ty=0;ty<numTiles[1];++ty)
+			for(unsigned int tx=0;tx<numTiles[0];++tx,++tvPtr)
+				if(*tvPtr>dataItem->depthImageVersion)
+					{
+					unsigned int ty0=ty>reachTiles?ty-reachTiles:0;
+					unsigned int ty1=Math::min(ty+reachTiles+1,numTiles[1]);
+					unsigned int tx0=tx>reachTiles?tx-reachTiles:0;
+					unsigned int tx1=Math::min(tx+reachTiles+1,numTiles[0]);
+					for(unsigned int uy=ty0;uy<ty1;++uy)
+						for(unsigned int ux=tx0;ux<tx1;++ux)
+							updateTiles[uy*numTiles[0]+ux]=1;
+					}
+		}
+	
+	/* Bring the depth texture up to date before binding the hillshade frame buffer, as doing so might run the GPU depth filters: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	depthImageRenderer->bindDepthTexture(contextData);
+	
+	/* Save relevant OpenGL state: */
+	glPushAttrib(GL_VIEWPORT_BIT);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	GLhandleARB currentShader=glGetHandleARB(GL_PROGRAM_OBJECT_ARB);
+	
+	/* Bind the hillshade frame buffer and shader: */
+	const unsigned int* size=depthImageRenderer->getDepthImageSize();
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->hillshadeFramebufferObject);
+	glViewport(0,0,size[0],size[1]);
+	glUseProgramObjectARB(dataItem->hillshadeShader);
+	const GLint* ulPtr=dataItem->hillshadeShaderUniforms;
+	glUniform1iARB(*(ulPtr++),0);
+	glUniformARB(*(ulPtr++),GLfloat(size[0]),GLfloat(size[1]));
+	depthImageRenderer->uploadDepthProjection(*(ulPtr++));
+	glUniformARB(*(ulPtr++),Geometry::invert(depthImageRenderer->getDepthProjection()));
+	
+	/* Upload the base plane equation with a normalized normal vector: */
+	const Plane& basePlane=depthImageRenderer->getBasePlane();
+	Scalar normalMag=basePlane.getNormal().mag();
+	GLfloat planeEq[4];
+	for(int i=0;i<3;++i)
+		planeEq[i]=GLfloat(basePlane.getNormal()[i]/normalMag);
+	planeEq[3]=GLfloat(-basePlane.getOffset()/normalMag);
+	glUniformARB<4>(*(ulPtr++),1,planeEq);
+	
+	/* Upload the sun direction and the shadow and ambient occlusion extents: */
+	glUniformARB(*(ulPtr++),GLfloat(sunDirection[0]),GLfloat(sunDirection[1]),GLfloat(sunDirection[2]));
+	glUniform1fARB(*(ulPtr++),GLfloat(shadowDistance));
+	glUniform1fARB(*(ulPtr++),aoRadius);
+	
+	/* Recalculate all flagged tiles: */
+	glBegin(GL_QUADS);
+	const unsigned char* utPtr=&updateTiles.front();
+	for(unsigned int ty=0;ty<numTiles[1];++ty)
+		for(unsigned int tx=0;tx<numTiles[0];++tx,++utPtr)
+			if(*utPtr)
+				{
+				GLint x0=tx*tileSize;
+				GLint y0=ty*tileSize;
+				GLint x1=Math::min((tx+1)*tileSize,size[0]);
+				GLint y1=Math::min((ty+1)*tileSize,size[1]);
+				glVertex2i(x0,y0);
+				glVertex2i(x1,y0);
+				glVertex2i(x1,y1);
+				glVertex2i(x0,y1);
+				}
+	glEnd();
+	
+	/* Restore OpenGL state: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glUseProgramObjectARB(currentShader);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	glPopAttrib();
+	
+	/* Mark the hillshade map as up-to-date: */
+	dataItem->depthImageVersion=depthImageVersion;
+	dataItem->sunVersion=sunVersion;
+	}
+
+void HillshadeMap::bindTexture(GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Bind the hillshade texture: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->hillshadeTextureObject);
+	}
@@ -0,0 +1,87 @@
+/***********************************************************************
+HillshadeMap - Class to maintain a cached map of sun visibility and
+ambient occlusion of the current surface in depth image space, which is
+only recalculated for tiles whose bathymetry changed and when the sun
+moves.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef HILLSHADEMAP_INCLUDED
+#define HILLSHADEMAP_INCLUDED
+
+#include <GL/gl.h>
+#include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/GLObject.h>
+
+#include "Types.h"
+
+/* Forward declarations: */
+class DepthImageRenderer;
+
+class HillshadeMap:public GLObject
+	{
+	/* Embedded classes: */
+	private:
+	struct DataItem:public GLObject::DataItem // Structure storing per-context OpenGL state
+		{
+		/* Elements: */
+		public:
+		GLuint hillshadeTextureObject; // Two-component texture holding the sun visibility and ambient occlusion of each depth image pixel
+		GLuint hillshadeFramebufferObject; // Frame buffer to update the hillshade texture
+		GLhandleARB hillshadeShader; // Shader to calculate sun visibility and ambient occlusion
+		GLint hillshadeShaderUniforms[8]; // Locations of the hillshade shader's uniform variables
+		unsigned int depthImageVersion; // Version of the depth image for which the hillshade texture was calculated
+		unsigned int sunVersion; // Version of the sun direction for which the hillshade texture was calculated
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
+	/* Elements: */
+	const DepthImageRenderer* depthImageRenderer; // Renderer providing the depth image and its change tracking tiles
+	Scalar shadowDistance; // Maximum distance from a surface point to a shadow caster in camera-space units
+	GLfloat aoRadius; // Radius of the ambient occlusion neighborhood in depth image pixels
+	unsigned int reachTiles; // Number of tiles around a changed tile whose hillshade values can be affected by the change
+	Vector sunDirection; // Normalized direction towards the sun in camera space
+	unsigned int sunVersion; // Version number of the sun direction
+	
+	/* Private methods: */
+	void updateReach(void); // Recalculates the number of tiles affected by a change of a tile's bathymetry
+	
+	/* Constructors and destructors: */
+	public:
+	HillshadeMap(const DepthImageRenderer* sDepthImageRenderer); // Creates a hillshade map for the given depth image renderer
+	
+	/* Methods from GLObject: */
+	virtual void initContext(GLContextData& contextData) const;
+	
+	/* New methods: */
+	const Vector& getSunDirection(void) const // Returns the direction towards the sun in camera space
+		{
+		return sunDirection;
+		}
+	void setShadowDistance(Scalar newShadowDistance); // Sets the maximum distance from a surface point to a shadow caster in camera-space units
+	void setAoRadius(GLfloat newAoRadius); // Sets the radius of the ambient occlusion neighborhood in depth image pixels
+	void setSunDirection(const Vector& newSunDirection); // Sets the direction towards the sun in camera space; invalidates the hillshade map if the direction changed noticeably
+	void update(GLContextData& contextData) const; // Recalculates the hillshade map on tiles affected by bathymetry changes since the last update, or entirely if the sun moved
+	void bindTexture(GLContextData& contextData) const; // Binds the hillshade texture, holding sun visibility in its red and ambient occlusion in its green component, to the active texture unit
+	};
+
+#endif
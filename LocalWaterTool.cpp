@@ -42,6 +42,20 @@ LocalWaterToolFactory* LocalWaterTool::factory=0;
 Methods of class LocalWaterTool:
 *******************************/
 
+void LocalWaterTool::updateRainDisk(void)
+	{
+	/* Get the current rain disk position and size in navigational coordinates: */
+	Vrui::Point newCenter=Vrui::getInverseNavigationTransformation().transform(getButtonDevicePosition(0));
+	Vrui::Scalar newRadius=Vrui::getPointPickDistance()*Vrui::Scalar(3);
+	GLfloat newRate=adding/application->waterSpeed;
+	
+	/* Publish the new snapshot: */
+	Threads::Mutex::Lock rainDiskLock(rainDiskMutex);
+	rainDiskCenter=newCenter;
+	rainDiskRadius=newRadius;
+	rainDiskRate=newRate;
+	}
+
 LocalWaterToolFactory* LocalWaterTool::initClass(Vrui::ToolManager& toolManager)
 	{
 	/* Create the tool factory: */
@@ -60,7 +74,8 @@ LocalWaterToolFactory* LocalWaterTool::initClass(Vrui::ToolManager& toolManager)
 LocalWaterTool::LocalWaterTool(const Vrui::ToolFactory* factory,const Vrui::ToolInputAssignment& inputAssignment)
 	:Vrui::Tool(factory,inputAssignment),
 	 addWaterFunction(0),
-	 adding(0.0f)
+	 adding(0.0f),
+	 rainDiskCenter(Vrui::Point::origin),rainDiskRadius(0),rainDiskRate(0.0f)
 	{
 	}
 
@@ -100,6 +115,21 @@ void LocalWaterTool::buttonCallback(int buttonSlotIndex,Vrui::InputDevice::Butto
 	if(buttonSlotIndex==1)
 		waterAmount=-waterAmount;
 	adding+=waterAmount;
+	
+	/* Start or stop rendering the rain disk into the water table: */
+	updateRainDisk();
+	if(application->waterTable!=0)
+		application->waterTable->updateWaterSources();
+	}
+
+void LocalWaterTool::frame(void)
+	{
+	/* Re-render the rain disk into the water table while it is active, as the tool might have moved: */
+	if(adding!=0.0f&&application->waterTable!=0)
+		{
+		updateRainDisk();
+		application->waterTable->updateWaterSources();
+		}
 	}
 
 void LocalWaterTool::initContext(GLContextData& contextData) const
@@ -170,15 +200,22 @@ void LocalWaterTool::glRenderActionTransparent(GLContextData& contextData) const
 
 void LocalWaterTool::addWater(GLContextData& contextData) const
 	{
-	if(adding!=0.0f)
+	/* Get the rain disk as of the most recent frame; this function can run on the simulation thread, which must not query Vrui's state: */
+	Vrui::Point rainPos;
+	Vrui::Scalar rainRadius;
+	GLfloat rainRate;
+	{
+	Threads::Mutex::Lock rainDiskLock(rainDiskMutex);
+	rainPos=rainDiskCenter;
+	rainRadius=rainDiskRadius;
+	rainRate=rainDiskRate;
+	}
+	
+	if(rainRate!=0.0f)
 		{
 		glPushAttrib(GL_ENABLE_BIT);
 		glDisable(GL_CULL_FACE);
 		
-		/* Get the current rain disk position and size in camera coordinates: */
-		Vrui::Point rainPos=Vrui::getInverseNavigationTransformation().transform(getButtonDevicePosition(0));
-		Vrui::Scalar rainRadius=Vrui::getPointPickDistance()*Vrui::Scalar(3);
-		
 		/* Render the rain disk: */
 		Vrui::Vector z=application->waterTable->getBaseTransform().inverseTransform(Vrui::Vector(0,0,1));
 		Vrui::Vector x=Geometry::normal(z);
@@ -186,7 +223,7 @@ void LocalWaterTool::addWater(GLContextData& contextData) const
 		x*=rainRadius/Geometry::mag(x);
 		y*=rainRadius/Geometry::mag(y);
 		
-		glVertexAttrib1fARB(1,adding/application->waterSpeed);
+		glVertexAttrib1fARB(1,rainRate);
 		glBegin(GL_POLYGON);
 		for(int i=0;i<32;++i)
 			{
@@ -23,8 +23,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef LOCALWATERTOOL_INCLUDED
 #define LOCALWATERTOOL_INCLUDED
 
+#include <Threads/Mutex.h>
 #include <GL/gl.h>
 #include <GL/GLObject.h>
+#include <Vrui/Geometry.h>
 #include <Vrui/Tool.h>
 #include <Vrui/GenericToolFactory.h>
 #include <Vrui/TransparentObject.h>
@@ -51,6 +53,13 @@ class LocalWaterTool:public Vrui::Tool,public Vrui::Application::Tool<Sandbox>,p
 	
 	const AddWaterFunction* addWaterFunction; // Render function registered with the water table
 	GLfloat adding; // Amount of data added or removed from the water table
+	mutable Threads::Mutex rainDiskMutex; // Mutex protecting the rain disk snapshot, which is read by the water simulation, possibly on a background thread
+	Vrui::Point rainDiskCenter; // Center of the rain disk in navigational coordinates as of the most recent frame
+	Vrui::Scalar rainDiskRadius; // Radius of the rain disk in navigational coordinates as of the most recent frame
+	GLfloat rainDiskRate; // Water rate rendered by the rain disk, or zero if the tool is inactive
+	
+	/* Private methods: */
+	void updateRainDisk(void); // Takes a snapshot of the rain disk from Vrui's current state; must be called from the main thread
 	
 	/* Constructors and destructors: */
 	public:
@@ -63,6 +72,7 @@ class LocalWaterTool:public Vrui::Tool,public Vrui::Application::Tool<Sandbox>,p
 	virtual void deinitialize(void);
 	virtual const Vrui::ToolFactory* getFactory(void) const;
 	virtual void buttonCallback(int buttonSlotIndex,Vrui::InputDevice::ButtonCallbackData* cbData);
+	virtual void frame(void);
 	
 	/* Methods from class GLObject: */
 	virtual void initContext(GLContextData& contextData) const;
@@ -0,0 +1,256 @@
+/***********************************************************************
+MakeTiledDEM - Utility to convert plain DEM files into tiled, pyramid-
+organized DEM files that the Augmented Reality Sandbox can memory-map
+and upload to the GPU at the resolution needed for the sandbox's
+footprint.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+#include <Misc/SizedTypes.h>
+#include <Misc/ThrowStdErr.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+#include <Math/Math.h>
+
+#include "DEM.h"
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+struct Grid // Structure for one pyramid level of a DEM
+	{
+	/* Elements: */
+	public:
+	int size[2]; // Width and height of the grid
+	std::vector<float> elevations; // Grid elevations in row-major order
+	
+	/* Methods: */
+	float operator()(int x,int y) const // Returns the elevation at the given grid vertex, clamped to the grid
+		{
+		x=Math::clamp(x,0,size[0]-1);
+		y=Math::clamp(y,0,size[1]-1);
+		return elevations[size_t(y)*size_t(size[0])+size_t(x)];
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+void loadDem(const char* demFileName,Grid& grid,double box[4])
+	{
+	/* Read the plain DEM file in the same format as DEM::load: */
+	IO::FilePtr demFile=IO::openFile(demFileName);
+	demFile->setEndianness(Misc::LittleEndian);
+	demFile->read<int>(grid.size,2);
+	if(grid.size[0]<2||grid.size[1]<2)
+		Misc::throwStdErr("MakeTiledDEM: DEM file %s is too small",demFileName);
+	for(int i=0;i<4;++i)
+		box[i]=double(demFile->read<float>());
+	grid.elevations.resize(size_t(grid.size[1])*size_t(grid.size[0]));
+	demFile->read<float>(&grid.elevations[0],grid.elevations.size());
+	}
+
+void downsample(const Grid& fine,Grid& coarse)
+	{
+	/* Smooth the fine grid with a separable 1-2-1 filter to avoid aliasing: */
+	Grid smooth;
+	smooth.size[0]=fine.size[0];
+	smooth.size[1]=fine.size[1];
+	smooth.elevations.resize(fine.elevations.size());
+	Grid rows=smooth;
+	for(int y=0;y<fine.size[1];++y)
+		for(int x=0;x<fine.size[0];++x)
+			rows.elevations[size_t(y)*size_t(fine.size[0])+size_t(x)]=(fine(x-1,y)+2.0f*fine(x,y)+fine(x+1,y))*0.25f;
+	for(int y=0;y<fine.size[1];++y)
+		for(int x=0;x<fine.size[0];++x)
+			smooth.elevations[size_t(y)*size_t(fine.size[0])+size_t(x)]=(rows(x,y-1)+2.0f*rows(x,y)+rows(x,y+1))*0.25f;
+	
+	/* Sample the smoothed grid at the coarse grid's vertices, which span the same corner coordinates: */
+	for(int i=0;i<2;++i)
+		coarse.size[i]=(fine.size[i]+1)/2;
+	coarse.elevations.resize(size_t(coarse.size[1])*size_t(coarse.size[0]));
+	float* cPtr=&coarse.elevations[0];
+	for(int y=0;y<coarse.size[1];++y)
+		{
+		double fy=double(y)*double(fine.size[1]-1)/double(coarse.size[1]-1);
+		int iy=Math::min(int(fy),fine.size[1]-2);
+		float wy=float(fy-double(iy));
+		for(int x=0;x<coarse.size[0];++x,++cPtr)
+			{
+			double fx=double(x)*double(fine.size[0]-1)/double(coarse.size[0]-1);
+			int ix=Math::min(int(fx),fine.size[0]-2);
+			float wx=float(fx-double(ix));
+			float e0=smooth(ix,iy)*(1.0f-wx)+smooth(ix+1,iy)*wx;
+			float e1=smooth(ix,iy+1)*(1.0f-wx)+smooth(ix+1,iy+1)*wx;
+			*cPtr=e0*(1.0f-wy)+e1*wy;
+			}
+		}
+	}
+
+size_t getLevelDataSize(const Grid& grid,int tileSize)
+	{
+	size_t numTilesX=size_t((grid.size[0]+tileSize-1)/tileSize);
+	size_t numTilesY=size_t((grid.size[1]+tileSize-1)/tileSize);
+	return numTilesY*numTilesX*size_t(tileSize)*size_t(tileSize)*sizeof(Misc::Float32);
+	}
+
+void writeTiles(IO::File& file,const Grid& grid,int tileSize)
+	{
+	/* Write all tiles in row-major order, padding tiles at the right and top edges by clamping: */
+	std::vector<Misc::Float32> tile(size_t(tileSize)*size_t(tileSize));
+	for(int ty=0;ty*tileSize<grid.size[1];++ty)
+		for(int tx=0;tx*tileSize<grid.size[0];++tx)
+			{
+			Misc::Float32* tPtr=&tile[0];
+			for(int y=0;y<tileSize;++y)
+				for(int x=0;x<tileSize;++x,++tPtr)
+					*tPtr=grid(tx*tileSize+x,ty*tileSize+y);
+			file.write<Misc::Float32>(&tile[0],tile.size());
+			}
+	}
+
+void printUsage(void)
+	{
+	std::cout<<"Usage: MakeTiledDEM [option 1] ... [option n] <input DEM file name> <output tiled DEM file name>"<<std::endl;
+	std::cout<<"  Options:"<<std::endl;
+	std::cout<<"  -h"<<std::endl;
+	std::cout<<"     Prints this help message"<<std::endl;
+	std::cout<<"  -tileSize <tile size>"<<std::endl;
+	std::cout<<"     Width and height of tiles in grid vertices; pyramid levels are"<<std::endl;
+	std::cout<<"     added until a level fits into a single tile"<<std::endl;
+	std::cout<<"     Default: 256"<<std::endl;
+	}
+
+}
+
+/*************
+Main function:
+*************/
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* inputFileName=0;
+	const char* outputFileName=0;
+	int tileSize=256;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				printUsage();
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"tileSize")==0)
+				{
+				++i;
+				if(i<argc)
+					tileSize=atoi(argv[i]);
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line switch "<<argv[i]<<std::endl;
+			}
+		else if(inputFileName==0)
+			inputFileName=argv[i];
+		else if(outputFileName==0)
+			outputFileName=argv[i];
+		else
+			std::cerr<<"Ignoring extra command line argument "<<argv[i]<<std::endl;
+		}
+	if(inputFileName==0||outputFileName==0)
+		{
+		printUsage();
+		return 1;
+		}
+	if(tileSize<1)
+		tileSize=1;
+	
+	try
+		{
+		/* Load the full-resolution grid and calculate its elevation statistics: */
+		std::vector<Grid> levels(1);
+		double box[4];
+		loadDem(inputFileName,levels[0],box);
+		float minElevation=levels[0].elevations[0];
+		float maxElevation=levels[0].elevations[0];
+		double elevSum=0.0;
+		for(std::vector<float>::const_iterator eIt=levels[0].elevations.begin();eIt!=levels[0].elevations.end();++eIt)
+			{
+			minElevation=Math::min(minElevation,*eIt);
+			maxElevation=Math::max(maxElevation,*eIt);
+			elevSum+=double(*eIt);
+			}
+		double averageElevation=elevSum/double(levels[0].elevations.size());
+		
+		/* Build the pyramid until a level fits into a single tile or cannot be halved any more: */
+		while((levels.back().size[0]>tileSize||levels.back().size[1]>tileSize)&&levels.back().size[0]>=3&&levels.back().size[1]>=3)
+			{
+			levels.push_back(Grid());
+			downsample(levels[levels.size()-2],levels.back());
+			}
+		
+		/* Write the file header: */
+		IO::FilePtr file=IO::openFile(outputFileName,IO::File::WriteOnly);
+		file->setEndianness(Misc::LittleEndian);
+		file->write<char>(DEM::tiledFileSignature,8);
+		file->write<Misc::UInt32>(Misc::UInt32(DEM::tiledFileVersion));
+		for(int i=0;i<2;++i)
+			file->write<Misc::UInt32>(Misc::UInt32(levels[0].size[i]));
+		for(int i=0;i<4;++i)
+			file->write<Misc::Float64>(box[i]);
+		file->write<Misc::UInt32>(Misc::UInt32(tileSize));
+		file->write<Misc::UInt32>(Misc::UInt32(levels.size()));
+		file->write<Misc::Float32>(minElevation);
+		file->write<Misc::Float32>(maxElevation);
+		file->write<Misc::Float64>(averageElevation);
+		
+		/* Write the level table: */
+		Misc::UInt64 offset=DEM::tiledHeaderSize+levels.size()*DEM::tiledLevelSize;
+		for(std::vector<Grid>::iterator lIt=levels.begin();lIt!=levels.end();++lIt)
+			{
+			for(int i=0;i<2;++i)
+				file->write<Misc::UInt32>(Misc::UInt32(lIt->size[i]));
+			file->write<Misc::UInt64>(offset);
+			offset+=getLevelDataSize(*lIt,tileSize);
+			}
+		
+		/* Write all levels' tiles: */
+		for(std::vector<Grid>::iterator lIt=levels.begin();lIt!=levels.end();++lIt)
+			writeTiles(*file,*lIt,tileSize);
+		
+		std::cout<<"Wrote "<<levels.size()<<" pyramid levels of "<<tileSize<<"x"<<tileSize<<" tiles to "<<outputFileName<<std::endl;
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"MakeTiledDEM: Terminated due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
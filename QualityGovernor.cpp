@@ -0,0 +1,158 @@
+/***********************************************************************
+QualityGovernor - Class to hold a target frame rate by trading water
+simulation quality for speed, based on measured frame and simulation
+times.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "QualityGovernor.h"
+
+namespace {
+
+/***********************
+Governor tuning factors:
+***********************/
+
+const double smoothing=0.1; // Weight of each new measurement in the smoothed frame and simulation times
+const double overloadFactor=1.05; // Frame time relative to the target above which the governor lowers quality
+const double minSimulationShare=0.2; // Share of the frame time the simulation must take for lowering quality to help
+const double restoreMargin=0.8; // Fraction of the overload simulation time below which the governor restores quality
+const double lowerHoldTime=1.0; // Minimum time between quality changes before lowering quality in seconds
+const double restoreHoldTime=3.0; // Minimum time between quality changes before restoring quality in seconds
+const unsigned int minMaxSteps=4; // Lowest maximum number of water simulation steps per frame
+const double gridScales[QualityGovernor::numGridLevels+1]={1.0,0.75,0.5}; // Water grid resolution factors of the grid levels
+
+}
+
+/********************************
+Methods of class QualityGovernor:
+********************************/
+
+unsigned int QualityGovernor::getLowestLevel(void) const
+	{
+	return gridScaling?maxLevel:numStepLevels+numSnowLevels;
+	}
+
+double QualityGovernor::getCostRatio(unsigned int level)
+	{
+	if(level<=numStepLevels)
+		{
+		/* Each step level allows three quarters of the steps: */
+		return 0.75;
+		}
+	else if(level<=numStepLevels+numSnowLevels)
+		{
+		/* Snow updates are a minor part of each step: */
+		return 0.9;
+		}
+	else
+		{
+		/* The number of cells, and the number of steps needed to cover the frame time, both scale with the resolution: */
+		unsigned int gridLevel=level-numStepLevels-numSnowLevels;
+		double scaleRatio=gridScales[gridLevel]/gridScales[gridLevel-1];
+		return scaleRatio*scaleRatio*scaleRatio;
+		}
+	}
+
+QualityGovernor::QualityGovernor(double sTargetFrameRate)
+	:targetFrameTime(1.0/sTargetFrameRate),gridScaling(true),
+	 level(0),numSamples(0),frameTime(0.0),simulationTime(0.0),
+	 lastChangeTime(0.0)
+	{
+	for(unsigned int i=0;i<=maxLevel;++i)
+		overloadSimulationTimes[i]=0.0;
+	}
+
+void QualityGovernor::setTargetFrameRate(double newTargetFrameRate)
+	{
+	targetFrameTime=1.0/newTargetFrameRate;
+	}
+
+void QualityGovernor::setGridScaling(bool newGridScaling)
+	{
+	gridScaling=newGridScaling;
+	}
+
+bool QualityGovernor::update(double applicationTime,double newFrameTime,double newSimulationTime)
+	{
+	/* Smooth the measurements: */
+	if(numSamples==0)
+		{
+		frameTime=newFrameTime;
+		simulationTime=newSimulationTime;
+		lastChangeTime=applicationTime;
+		}
+	else
+		{
+		frameTime+=(newFrameTime-frameTime)*smoothing;
+		simulationTime+=(newSimulationTime-simulationTime)*smoothing;
+		}
+	++numSamples;
+	
+	/* Restore the full grid resolution immediately if grid scaling was forbidden: */
+	if(level>getLowestLevel())
+		{
+		level=getLowestLevel();
+		lastChangeTime=applicationTime;
+		return true;
+		}
+	
+	/* Lower quality if the target frame rate is missed and the simulation takes a significant share of the frame: */
+	if(frameTime>targetFrameTime*overloadFactor&&simulationTime>frameTime*minSimulationShare&&level<getLowestLevel()&&applicationTime-lastChangeTime>=lowerHoldTime)
+		{
+		++level;
+		overloadSimulationTimes[level]=simulationTime;
+		lastChangeTime=applicationTime;
+		return true;
+		}
+	
+	/* Restore quality if the simulation at the next higher level would fit into the frame, or cost clearly less than when it overloaded it: */
+	if(level>0&&applicationTime-lastChangeTime>=restoreHoldTime)
+		{
+		double restoredSimulationTime=simulationTime/getCostRatio(level);
+		bool fitsFrame=frameTime-simulationTime+restoredSimulationTime<targetFrameTime*restoreMargin;
+		bool belowOverload=frameTime<=targetFrameTime*overloadFactor&&restoredSimulationTime<overloadSimulationTimes[level]*restoreMargin;
+		if(fitsFrame||belowOverload)
+			{
+			--level;
+			lastChangeTime=applicationTime;
+			return true;
+			}
+		}
+	
+	return false;
+	}
+
+unsigned int QualityGovernor::getMaxSteps(unsigned int requestedMaxSteps) const
+	{
+	/* Reduce the requested maximum to three quarters per step level, but not below the lowest maximum: */
+	unsigned int stepLevel=level<numStepLevels?level:numStepLevels;
+	unsigned int maxSteps=requestedMaxSteps;
+	for(unsigned int i=0;i<stepLevel;++i)
+		maxSteps=(maxSteps*3U)/4U;
+	if(maxSteps<minMaxSteps)
+		maxSteps=requestedMaxSteps<minMaxSteps?requestedMaxSteps:minMaxSteps;
+	return maxSteps;
+	}
+
+double QualityGovernor::getGridScale(void) const
+	{
+	unsigned int gridLevel=level>numStepLevels+numSnowLevels?level-numStepLevels-numSnowLevels:0U;
+	return gridScales[gridLevel];
+	}
@@ -0,0 +1,90 @@
+/***********************************************************************
+QualityGovernor - Class to hold a target frame rate by trading water
+simulation quality for speed, based on measured frame and simulation
+times.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef QUALITYGOVERNOR_INCLUDED
+#define QUALITYGOVERNOR_INCLUDED
+
+class QualityGovernor
+	{
+	/* Embedded classes: */
+	public:
+	static const unsigned int numStepLevels=4; // Number of levels reducing the maximum number of water simulation steps per frame
+	static const unsigned int numSnowLevels=3; // Number of levels doubling the snow update interval
+	static const unsigned int numGridLevels=2; // Number of levels reducing the water grid resolution
+	static const unsigned int maxLevel=numStepLevels+numSnowLevels+numGridLevels; // Lowest quality level
+	
+	/* Elements: */
+	private:
+	double targetFrameTime; // Frame time to hold in seconds
+	bool gridScaling; // Flag whether the governor may reduce the water grid resolution
+	unsigned int level; // Current quality level; 0 is full quality
+	unsigned int numSamples; // Number of frames measured so far
+	double frameTime; // Smoothed frame time in seconds
+	double simulationTime; // Smoothed time spent in the water simulation per frame in seconds
+	double overloadSimulationTimes[maxLevel+1]; // Smoothed simulation times that made the governor lower quality into each level
+	double lastChangeTime; // Application time of the last quality level change
+	
+	/* Private methods: */
+	unsigned int getLowestLevel(void) const; // Returns the lowest quality level currently allowed
+	static double getCostRatio(unsigned int level); // Returns the estimated simulation cost of the given quality level relative to the next higher one
+	
+	/* Constructors and destructors: */
+	public:
+	QualityGovernor(double sTargetFrameRate); // Creates a governor at full quality for the given target frame rate in Hz
+	
+	/* Methods: */
+	double getTargetFrameRate(void) const // Returns the target frame rate in Hz
+		{
+		return 1.0/targetFrameTime;
+		}
+	void setTargetFrameRate(double newTargetFrameRate); // Sets the target frame rate in Hz
+	bool getGridScaling(void) const // Returns true if the governor may reduce the water grid resolution
+		{
+		return gridScaling;
+		}
+	void setGridScaling(bool newGridScaling); // Allows or forbids reducing the water grid resolution; the next update restores the full resolution if forbidden
+	unsigned int getLevel(void) const // Returns the current quality level
+		{
+		return level;
+		}
+	double getFrameRate(void) const // Returns the smoothed frame rate in Hz
+		{
+		return 1.0/frameTime;
+		}
+	double getSimulationTime(void) const // Returns the smoothed time spent in the water simulation per frame in seconds
+		{
+		return simulationTime;
+		}
+	bool update(double applicationTime,double newFrameTime,double newSimulationTime); // Measures one frame of the given frame time and simulation time; returns true if the quality level changed
+	unsigned int getMaxSteps(unsigned int requestedMaxSteps) const; // Returns the maximum number of water simulation steps per frame at the current quality level
+	unsigned int getSnowIntervalFactor(void) const // Returns the factor by which the snow update interval is stretched at the current quality level
+		{
+		unsigned int snowLevel=level>numStepLevels?level-numStepLevels:0U;
+		if(snowLevel>numSnowLevels)
+			snowLevel=numSnowLevels;
+		return 1U<<snowLevel;
+		}
+	double getGridScale(void) const; // Returns the factor by which the water grid resolution is reduced at the current quality level
+	};
+
+#endif
@@ -196,18 +196,44 @@ class ValidPixelProperty // Functor class to identify valid pixels in raw depth
 		
 		#endif
 		}
+	template <class DepthPixelParam>
+	void classifyRow(unsigned int y,unsigned int width,const DepthPixelParam* row,unsigned char* mask) const // Applies the plane test of operator() to an entire row in a loop the compiler can vectorize; must be changed along with operator() if the color test is enabled
+		{
+		float py=float(y)+0.5f;
+		for(unsigned int x=0;x<width;++x)
+			{
+			float px=float(x)+0.5f;
+			float pz=float(row[x]);
+			float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*pz+minPlane[3];
+			float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*pz+maxPlane[3];
+			mask[x]=(unsigned char)((minD>=0.0f)&(maxD<=0.0f));
+			}
+		}
 	};
 
+template <class DepthPixelParam>
+inline
+void
+classifyPixelRow(
+	const ValidPixelProperty& property,
+	unsigned int y,
+	unsigned int width,
+	const DepthPixelParam* row,
+	unsigned char* mask)
+	{
+	property.classifyRow(y,width,row,mask);
+	}
+
 /**************************
 Methods of class RainMaker:
 **************************/
 
 template <class DepthPixelParam>
 inline
-void RainMaker::extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,RainMaker::BlobList& blobsCc)
+void RainMaker::extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BandWorkerPool& blobWorkerPool,RainMaker::BlobList& blobsCc)
 	{
 	/* Extract raw blobs from the depth frame: */
-	std::vector< ::Blob<DepthPixelParam> > blobsDic=findBlobs(depthSize,depthFrame.getData<DepthPixelParam>(),vpp);
+	std::vector< ::Blob<DepthPixelParam> > blobsDic=findBlobs(depthSize,depthFrame.getData<DepthPixelParam>(),vpp,blobWorkerPool);
 	
 	/* Transform all blobs larger than the threshold to camera space: */
 	blobsCc.reserve(blobsDic.size());
@@ -241,9 +267,13 @@ void* RainMaker::detectionThreadMethod(void)
 	/* Create a pixel validity decider: */
 	ValidPixelProperty vpp(minPlane,maxPlane,colorDepthHomography,colorSize);
 	
+	/* The pool of threads labeling bands of each depth frame, created when the first frames arrive: */
+	BandWorkerPool* blobWorkerPool=0;
+	
 	while(true)
 		{
 		Kinect::FrameBuffer depthFrame,colorFrame;
+		unsigned int newNumBlobThreads;
 		{
 		Threads::MutexCond::Lock inputLock(inputCond);
 		
@@ -260,8 +290,16 @@ void* RainMaker::detectionThreadMethod(void)
 		colorFrame=inputColorFrame;
 		lastInputDepthFrameVersion=inputDepthFrameVersion;
 		lastInputColorFrameVersion=inputColorFrameVersion;
+		newNumBlobThreads=numBlobThreads;
 		}
 		
+		/* Replace the worker pool if the requested number of threads changed: */
+		if(blobWorkerPool==0||blobWorkerPool->getNumThreads()!=newNumBlobThreads)
+			{
+			delete blobWorkerPool;
+			blobWorkerPool=new BandWorkerPool(newNumBlobThreads);
+			}
+		
 		if(outputBlobsFunction!=0)
 			{
 			/* Set the most recent color frame in the pixel validator: */
@@ -270,20 +308,24 @@ void* RainMaker::detectionThreadMethod(void)
 			/* Detect all objects in the depth frame between the min and max planes: */
 			BlobList blobsCc;
 			if(depthIsFloat)
-				extractBlobs<float>(depthFrame,vpp,blobsCc);
+				extractBlobs<float>(depthFrame,vpp,*blobWorkerPool,blobsCc);
 			else
-				extractBlobs<unsigned short>(depthFrame,vpp,blobsCc);
+				extractBlobs<unsigned short>(depthFrame,vpp,*blobWorkerPool,blobsCc);
 			
 			/* Call the callback function: */
 			(*outputBlobsFunction)(blobsCc);
 			}
 		}
 	
+	/* Shut down the worker pool: */
+	delete blobWorkerPool;
+	
 	return 0;
 	}
 
 RainMaker::RainMaker(const unsigned int sDepthSize[2],const unsigned int sColorSize[2],const RainMaker::PTransform& sDepthProjection,const RainMaker::PTransform& sColorProjection,const RainMaker::Plane& basePlane,double minElevation,double maxElevation,int sMinBlobSize)
 	:depthIsFloat(false),
+	 numBlobThreads(1),
 	 outputBlobsFunction(0)
 	{
 	/* Remember the frame sizes: */
@@ -354,6 +396,12 @@ void RainMaker::setDepthIsFloat(bool newDepthIsFloat)
 	depthIsFloat=newDepthIsFloat;
 	}
 
+void RainMaker::setNumBlobThreads(unsigned int newNumBlobThreads)
+	{
+	Threads::MutexCond::Lock inputLock(inputCond);
+	numBlobThreads=newNumBlobThreads>0?newNumBlobThreads:1;
+	}
+
 void RainMaker::setOutputBlobsFunction(RainMaker::OutputBlobsFunction* newOutputBlobsFunction)
 	{
 	delete outputBlobsFunction;
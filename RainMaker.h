@@ -32,6 +32,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Kinect/FrameBuffer.h>
 
 /* Forward declarations: */
+class BandWorkerPool;
 namespace Misc {
 template <class ParameterParam>
 class FunctionCall;
@@ -73,6 +74,7 @@ class RainMaker
 	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
 	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
 	int minBlobSize; // Minimum size of objects to be detected
+	unsigned int numBlobThreads; // Number of threads labeling bands of each depth frame; protected by inputCond
 	Threads::MutexCond inputCond; // Condition variable to signal arrival of a new input frame
 	Kinect::FrameBuffer inputDepthFrame; // The most recent input depth frame
 	unsigned int inputDepthFrameVersion; // Version number of input depth frame
@@ -84,7 +86,7 @@ class RainMaker
 	
 	/* Private methods: */
 	template <class DepthPixelParam>
-	void extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobList& blobsCc);
+	void extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BandWorkerPool& blobWorkerPool,BlobList& blobsCc);
 	void* detectionThreadMethod(void); // Method for the object detection thread
 	
 	/* Constructors and destructors: */
@@ -94,6 +96,7 @@ class RainMaker
 	
 	/* Methods: */
 	void setDepthIsFloat(bool newDepthIsFloat); // Sets whether incoming depth frames have float pixel values
+	void setNumBlobThreads(unsigned int newNumBlobThreads); // Sets the number of threads labeling bands of each depth frame; takes effect with the next frame
 	void setOutputBlobsFunction(OutputBlobsFunction* newOutputBlobsFunction); // Sets the output function; adopts given functor object
 	void receiveRawDepthFrame(const Kinect::FrameBuffer& newDepthFrame); // Called to receive a new raw depth frame
 	void receiveRawColorFrame(const Kinect::FrameBuffer& newColorFrame); // Called to receive a new raw color frame
@@ -22,7 +22,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "RemoteServer.h"
 
+#include <string.h>
+#include <errno.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
 #include <Misc/SizedTypes.h>
 #include <Misc/MessageLogger.h>
 #include <Math/Math.h>
@@ -34,6 +39,32 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "WaterTable2.h"
 #include "Sandbox.h"
+#include "StageTimers.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline GridCodec::Value quantize(GLfloat scaledElevation)
+	{
+	if(scaledElevation<=0.0f)
+		return 0U;
+	else if(scaledElevation>=65535.0f)
+		return 65535U;
+	else
+		return GridCodec::Value(scaledElevation);
+	}
+
+double getMonotonicTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)/1.0e9;
+	}
+
+}
 
 /*************************************
 Methods of class RemoteServer::Client:
@@ -42,8 +73,28 @@ Methods of class RemoteServer::Client:
 RemoteServer::Client::Client(RemoteServer* sServer)
 	:server(sServer),
 	 clientPipe(server->listenSocket),
-	 state(START)
+	 state(START),needKeyFrame(true),
+	 lod(false),lodCosHalfAngle(1.0f),
+	 sendOffset(0),writeListening(false),
+	 windowStart(getMonotonicTime()),windowBytes(0)
 	{
+	/* Initialize the client's statistics: */
+	stats.address=clientPipe.getPeerAddress();
+	stats.bytesSent=0;
+	stats.framesSent=0;
+	stats.framesDropped=0;
+	stats.queueLength=0;
+	stats.throughput=0.0;
+	stats.lag=0.0;
+	for(int i=0;i<2;++i)
+		lodRadii[i]=0.0f;
+	}
+
+RemoteServer::Client::~Client(void)
+	{
+	/* Release all queued frames: */
+	for(std::deque<QueuedFrame>::iterator sqIt=sendQueue.begin();sqIt!=sendQueue.end();++sqIt)
+		sqIt->frame->unref();
 	}
 
 /*****************************
@@ -126,6 +177,22 @@ bool RemoteServer::clientMessageCallback(Threads::EventDispatcher::ListenerKey e
 	Client* client=static_cast<Client*>(userData);
 	RemoteServer* server=client->server;
 	
+	if(eventType&Threads::EventDispatcher::Write)
+		{
+		/* Continue sending the client's queued frames: */
+		if(!server->sendFrames(client))
+			{
+			server->disconnectClient(client,false);
+			
+			/* Stop listening on the client's socket: */
+			return true;
+			}
+		
+		/* Bail out if there is no incoming message: */
+		if(!(eventType&Threads::EventDispatcher::Read))
+			return false;
+		}
+	
 	try
 		{
 		/* Handle incoming message based on the client's state: */
@@ -161,6 +228,21 @@ bool RemoteServer::clientMessageCallback(Threads::EventDispatcher::ListenerKey e
 						client->direction=Vrui::Vector(dir);
 						break;
 					
+					case 1: // Level-of-detail request message
+						{
+						/* Read the detail radii and view cone angle; a non-positive far radius requests full-resolution grids: */
+						Misc::Float32 lodParams[3];
+						client->clientPipe.read(lodParams,3);
+						client->lod=lodParams[1]>0.0f;
+						for(int i=0;i<2;++i)
+							client->lodRadii[i]=lodParams[i];
+						client->lodCosHalfAngle=GLfloat(Math::cos(lodParams[2]));
+						
+						/* Start the new mode with a key frame: */
+						client->needKeyFrame=true;
+						break;
+						}
+					
 					default:
 						throw std::runtime_error("Invalid client message");
 					}
@@ -181,6 +263,144 @@ bool RemoteServer::clientMessageCallback(Threads::EventDispatcher::ListenerKey e
 	return false;
 	}
 
+RemoteServer::Frame* RemoteServer::getWritableFrame(RemoteServer::Frame*& frame)
+	{
+	/* Replace the frame if any client's send queue still references it: */
+	if(frame->refCount>1)
+		{
+		frame->unref();
+		frame=new Frame;
+		}
+	
+	return frame;
+	}
+
+void RemoteServer::dropUnsentFrames(RemoteServer::Client* client)
+	{
+	/* Keep a partially sent front frame to keep the stream intact: */
+	std::deque<QueuedFrame>::iterator firstDropIt=client->sendQueue.begin();
+	if(client->sendOffset>0)
+		++firstDropIt;
+	
+	/* Drop all other frames: */
+	for(std::deque<QueuedFrame>::iterator sqIt=firstDropIt;sqIt!=client->sendQueue.end();++sqIt)
+		{
+		sqIt->frame->unref();
+		++client->stats.framesDropped;
+		}
+	client->sendQueue.erase(firstDropIt,client->sendQueue.end());
+	
+	/* Skipped delta frames break the client's decoding chain; resynchronize with a key frame: */
+	client->needKeyFrame=true;
+	}
+
+bool RemoteServer::sendFrames(RemoteServer::Client* client)
+	{
+	int fd=client->clientPipe.getFd();
+	while(!client->sendQueue.empty())
+		{
+		/* Gather the unsent parts of the front frame's header and encoded grids: */
+		Frame* frame=client->sendQueue.front().frame;
+		struct iovec iov[2];
+		int iovCount=0;
+		size_t offset=client->sendOffset;
+		if(offset<sizeof(frame->header))
+			{
+			iov[iovCount].iov_base=reinterpret_cast<char*>(frame->header)+offset;
+			iov[iovCount].iov_len=sizeof(frame->header)-offset;
+			++iovCount;
+			offset=0;
+			}
+		else
+			offset-=sizeof(frame->header);
+		if(offset<frame->data.size())
+			{
+			iov[iovCount].iov_base=&frame->data[offset];
+			iov[iovCount].iov_len=frame->data.size()-offset;
+			++iovCount;
+			}
+		
+		/* Send as much as the socket accepts without blocking: */
+		struct msghdr message;
+		memset(&message,0,sizeof(struct msghdr));
+		message.msg_iov=iov;
+		message.msg_iovlen=iovCount;
+		ssize_t written=sendmsg(fd,&message,MSG_DONTWAIT);
+		if(written<0)
+			{
+			if(errno==EINTR)
+				continue;
+			if(errno==EAGAIN||errno==EWOULDBLOCK)
+				break;
+			Misc::formattedConsoleWarning("RemoteServer: Disconnecting client due to error %s",strerror(errno));
+			return false;
+			}
+		client->sendOffset+=size_t(written);
+		client->stats.bytesSent+=Misc::UInt64(written);
+		client->windowBytes+=size_t(written);
+		
+		/* Retire the front frame if it has been sent completely: */
+		if(client->sendOffset==frame->getSize())
+			{
+			client->stats.lag=getMonotonicTime()-client->sendQueue.front().queueTime;
+			++client->stats.framesSent;
+			frame->unref();
+			client->sendQueue.pop_front();
+			client->sendOffset=0;
+			}
+		}
+	
+	/* Listen for write events on the client's socket while there are queued frames: */
+	bool listenWrite=!client->sendQueue.empty();
+	if(client->writeListening!=listenWrite)
+		{
+		dispatcher.setIOEventListenerEventTypes(client->listenerKey,listenWrite?Threads::EventDispatcher::Read|Threads::EventDispatcher::Write:Threads::EventDispatcher::Read);
+		client->writeListening=listenWrite;
+		}
+	
+	return true;
+	}
+
+RemoteServer::Frame* RemoteServer::createLodFrame(RemoteServer::Client* client)
+	{
+	Frame* frame=new Frame;
+	
+	/* Add the shared coarse grids: */
+	const GridCodec::Buffer& coarseFrame=client->needKeyFrame?coarseKeyFrame:coarseDeltaFrame;
+	GridLOD::writeUInt32(frame->data,Misc::UInt32(coarseFrame.size()));
+	frame->data.insert(frame->data.end(),coarseFrame.begin(),coarseFrame.end());
+	
+	/* Select the full-resolution tiles around the client's position and inside its view cone: */
+	GLfloat position[2],direction[2];
+	for(int i=0;i<2;++i)
+		{
+		position[i]=GLfloat(client->position[i]);
+		direction[i]=GLfloat(client->direction[i]);
+		}
+	lod->selectTiles(cellSize,position,direction,client->lodRadii[0],client->lodRadii[1],client->lodCosHalfAngle,selectedTiles);
+	
+	/* Add the selected tiles, encoding each tile at most once per update: */
+	GridLOD::writeUInt32(frame->data,Misc::UInt32(selectedTiles.size()));
+	for(std::vector<unsigned int>::iterator stIt=selectedTiles.begin();stIt!=selectedTiles.end();++stIt)
+		{
+		if(tileFrameVersions[*stIt]!=tileFramesVersion)
+			{
+			lod->encodeTile(&quantizedGrids.front(),*stIt,tileFrames[*stIt]);
+			tileFrameVersions[*stIt]=tileFramesVersion;
+			}
+		const GridCodec::Buffer& tileFrame=tileFrames[*stIt];
+		GridLOD::writeUInt32(frame->data,Misc::UInt32(*stIt));
+		GridLOD::writeUInt32(frame->data,Misc::UInt32(tileFrame.size()));
+		frame->data.insert(frame->data.end(),tileFrame.begin(),tileFrame.end());
+		}
+	
+	/* Finish the frame header: */
+	frame->header[0]=client->needKeyFrame?GridLOD::LODKEYFRAME:GridLOD::LODDELTAFRAME;
+	frame->header[1]=Misc::UInt32(frame->data.size());
+	
+	return frame;
+	}
+
 void* RemoteServer::communicationThreadMethod(void)
 	{
 	/* Dispatch events on the communications socket(s) until stopped by the main thread: */
@@ -199,61 +419,109 @@ void* RemoteServer::communicationThreadMethod(void)
 				}
 		clientPositions.postNewValue();
 		
+		/* Check if it's time to publish new client statistics: */
+		double statsTime=getMonotonicTime();
+		if(statsTime>=nextStatsTime)
+			{
+			/* Update the throughput of all connected clients in streaming state and publish their statistics: */
+			std::vector<ClientStats>& stats=clientStats.startNewValue();
+			stats.clear();
+			for(std::vector<Client*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
+				if((*cIt)->state==Client::STREAMING)
+					{
+					Client& c=**cIt;
+					c.stats.throughput=double(c.windowBytes)/(statsTime-c.windowStart);
+					c.stats.queueLength=c.sendQueue.size();
+					c.windowStart=statsTime;
+					c.windowBytes=0;
+					stats.push_back(c.stats);
+					}
+			clientStats.postNewValue();
+			nextStatsTime=statsTime+1.0;
+			}
+		
 		/* Check if there is a new grid pair: */
 		if(grids.lockNewValue())
 			{
-			/* Send the new grid pair to all connected clients in streaming state: */
+			/* Measure quantizing, encoding, and queueing the new grid pair: */
+			StageTimers::CPUTimer encodeTimer(sandbox->stageTimers,StageTimers::REMOTESERVER);
+			
+			/* Quantize the new grid pair once for all clients: */
+			GLfloat eScale=65535.0f/(elevationRange[1]-elevationRange[0]);
+			GLfloat eOffset=0.5f-elevationRange[0]*eScale;
+			GridCodec::Value* qPtr=&quantizedGrids.front();
+			const GLfloat* bPtr=grids.getLockedValue().bathymetry;
+			for(size_t count=size_t(gridSize[1]-1)*size_t(gridSize[0]-1);count>0;--count,++bPtr,++qPtr)
+				*qPtr=quantize(*bPtr*eScale+eOffset);
+			const GLfloat* wlPtr=grids.getLockedValue().waterLevel;
+			for(size_t count=size_t(gridSize[1])*size_t(gridSize[0]);count>0;--count,++wlPtr,++qPtr)
+				*qPtr=quantize(*wlPtr*eScale+eOffset);
+			
+			/* Drop the unsent frames of all clients that could not keep up, and make them skip to the next key frame: */
+			bool needKeyFrame[2]={false,false};
+			bool needDeltaFrame[2]={false,false};
+			for(std::vector<Client*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
+				if((*cIt)->state==Client::STREAMING)
+					{
+					if(!(*cIt)->needKeyFrame&&(*cIt)->getNumUnsentFrames()>=maxQueuedFrames)
+						dropUnsentFrames(*cIt);
+					int mode=(*cIt)->lod?1:0;
+					if((*cIt)->needKeyFrame)
+						needKeyFrame[mode]=true;
+					else
+						needDeltaFrame[mode]=true;
+					}
+			
+			/* Encode the new grid pair once as a key frame for newly streaming or resynchronizing clients and as a delta frame for all others: */
+			if(needKeyFrame[0])
+				{
+				Frame* frame=getWritableFrame(keyFrame);
+				codec->encode(&quantizedGrids.front(),GridCodec::KEYFRAME,frame->data);
+				frame->header[0]=GridCodec::KEYFRAME;
+				frame->header[1]=Misc::UInt32(frame->data.size());
+				}
+			if(needDeltaFrame[0])
+				{
+				Frame* frame=getWritableFrame(deltaFrame);
+				codec->encode(&quantizedGrids.front(),GridCodec::DELTAFRAME,frame->data);
+				frame->header[0]=GridCodec::DELTAFRAME;
+				frame->header[1]=Misc::UInt32(frame->data.size());
+				}
+			codec->setValues(&quantizedGrids.front());
+			
+			if(needKeyFrame[1]||needDeltaFrame[1])
+				{
+				/* Encode the new coarse grid pair once for all level-of-detail clients: */
+				lod->downsample(&quantizedGrids.front(),&coarseGrids.front());
+				if(needKeyFrame[1])
+					coarseCodec->encode(&coarseGrids.front(),GridCodec::KEYFRAME,coarseKeyFrame);
+				if(needDeltaFrame[1])
+					coarseCodec->encode(&coarseGrids.front(),GridCodec::DELTAFRAME,coarseDeltaFrame);
+				coarseCodec->setValues(&coarseGrids.front());
+				
+				/* Invalidate all encoded tiles: */
+				++tileFramesVersion;
+				}
+			
+			/* Queue the encoded grid pair for all connected clients in streaming state and send as much as their sockets accept: */
+			double now=getMonotonicTime();
 			std::vector<Client*> deadClients;
-			const GLfloat* bathymetry=grids.getLockedValue().bathymetry;
-			const GLfloat* waterLevel=grids.getLockedValue().waterLevel;
 			for(std::vector<Client*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
 				if((*cIt)->state==Client::STREAMING)
 					{
-					/* Calculate elevation quantization factors: */
-					GLfloat eScale=65535.0f/(elevationRange[1]-elevationRange[0]);
-					GLfloat eOffset=0.5f-elevationRange[0]*eScale;
-					
-					try
+					QueuedFrame qf;
+					if((*cIt)->lod)
+						qf.frame=createLodFrame(*cIt);
+					else
 						{
-						Comm::TCPPipe& clientPipe=(*cIt)->clientPipe;
-						
-						/* Send the bathymetry grid: */
-						const GLfloat* bPtr=bathymetry;
-						for(GLsizei y=0;y<gridSize[1]-1;++y)
-							for(GLsizei x=0;x<gridSize[0]-1;++x,++bPtr)
-								{
-								GLfloat se=*bPtr*eScale+eOffset;
-								if(se<=0.0f)
-									clientPipe.write<Misc::UInt16>(0U);
-								else if(se>=65535.0f)
-									clientPipe.write<Misc::UInt16>(65535U);
-								else
-									clientPipe.write<Misc::UInt16>(Misc::UInt16(se));
-								}
-						
-						/* Send the water level grid: */
-						const GLfloat* wlPtr=waterLevel;
-						for(GLsizei y=0;y<gridSize[1];++y)
-							for(GLsizei x=0;x<gridSize[0];++x,++wlPtr)
-								{
-								GLfloat se=*wlPtr*eScale+eOffset;
-								if(se<=0.0f)
-									clientPipe.write<Misc::UInt16>(0U);
-								else if(se>=65535.0f)
-									clientPipe.write<Misc::UInt16>(65535U);
-								else
-									clientPipe.write<Misc::UInt16>(Misc::UInt16(se));
-								}
-						
-						/* Finish the message: */
-						clientPipe.flush();
+						qf.frame=(*cIt)->needKeyFrame?keyFrame:deltaFrame;
+						qf.frame->ref();
 						}
-					catch(const std::runtime_error& err)
-						{
-						/* Disconnect the client: */
-						Misc::formattedConsoleWarning("RemoteServer: Disconnecting client due to exception %s",err.what());
+					qf.queueTime=now;
+					(*cIt)->sendQueue.push_back(qf);
+					(*cIt)->needKeyFrame=false;
+					if(!sendFrames(*cIt))
 						deadClients.push_back(*cIt);
-						}
 					}
 			
 			/* Disconnect all dead clients: */
@@ -265,10 +533,15 @@ void* RemoteServer::communicationThreadMethod(void)
 	return 0;
 	}
 
-void RemoteServer::readBackCallback(GLfloat*,GLfloat*,void* userData)
+void RemoteServer::readBackCallback(const GLfloat* bathymetry,const GLfloat* waterLevel,const GLfloat*,void* userData)
 	{
 	RemoteServer* thisPtr=static_cast<RemoteServer*>(userData);
 	
+	/* Copy the new grids into the grid triple buffer: */
+	GridBuffers& gb=thisPtr->grids.startNewValue();
+	memcpy(gb.bathymetry,bathymetry,size_t(thisPtr->gridSize[1]-1)*size_t(thisPtr->gridSize[0]-1)*sizeof(GLfloat));
+	memcpy(gb.waterLevel,waterLevel,size_t(thisPtr->gridSize[1])*size_t(thisPtr->gridSize[0])*sizeof(GLfloat));
+	
 	/* Post the new grids to the grid triple buffer and wake up the communication thread: */
 	thisPtr->grids.postNewValue();
 	thisPtr->dispatcher.interrupt();
@@ -278,7 +551,10 @@ RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInt
 	:sandbox(sSandbox),
 	 listenSocket(listenPortId,0),
 	 numClients(0),
-	 requestInterval(sRequestInterval),nextRequestTime(0.0)
+	 requestInterval(sRequestInterval),gridSubscriberId(0),streaming(false),
+	 codec(0),keyFrame(new Frame),deltaFrame(new Frame),
+	 lod(0),coarseCodec(0),tileFramesVersion(0),
+	 maxQueuedFrames(2),nextStatsTime(0.0)
 	{
 	/* Ignore SIGPIPE and leave handling of pipe errors to TCP sockets: */
 	struct sigaction sigPipeAction;
@@ -288,10 +564,10 @@ RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInt
 	sigPipeAction.sa_flags=0x0;
 	sigaction(SIGPIPE,&sigPipeAction,0);
 	
-	/* Retrieve the water table's grid and cell sizes: */
+	/* Retrieve the water table's full grid size and cell sizes: */
 	for(int i=0;i<2;++i)
 		{
-		gridSize[i]=sandbox->waterTable->getSize()[i];
+		gridSize[i]=sandbox->gridReadback->getGridSize()[i];
 		cellSize[i]=sandbox->waterTable->getCellSize()[i];
 		}
 	
@@ -305,6 +581,21 @@ RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInt
 	for(int i=0;i<3;++i)
 		grids.getBuffer(i).init(gridSize);
 	
+	/* Create a codec for the quantized bathymetry and water level grids, which are encoded back-to-back: */
+	size_t numValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1)+size_t(gridSize[1])*size_t(gridSize[0]);
+	quantizedGrids.resize(numValues);
+	codec=new GridCodec(numValues);
+	
+	/* Create the level-of-detail scheme, a codec for the coarse grids, and a cache of encoded full-resolution tiles: */
+	lod=new GridLOD(gridSize);
+	coarseGrids.resize(lod->getNumCoarseValues());
+	coarseCodec=new GridCodec(lod->getNumCoarseValues());
+	tileFrames.resize(lod->getNumTiles());
+	tileFrameVersions.resize(lod->getNumTiles(),tileFramesVersion);
+	
+	/* Subscribe to bathymetry and water level grids, paused until the first client starts streaming: */
+	gridSubscriberId=sandbox->gridReadback->subscribe(GridReadback::BATHYMETRY|GridReadback::WATERLEVEL,0.0,&RemoteServer::readBackCallback,this);
+	
 	/* Start listening for incoming connections on the listening sockets: */
 	dispatcher.addIOEventListener(listenSocket.getFd(),Threads::EventDispatcher::Read,newConnectionCallback,this);
 	communicationThread.start(this,&RemoteServer::communicationThreadMethod);
@@ -312,6 +603,9 @@ RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInt
 
 RemoteServer::~RemoteServer(void)
 	{
+	/* Stop receiving grids: */
+	sandbox->gridReadback->unsubscribe(gridSubscriberId);
+	
 	/* Shut down the communication thread: */
 	dispatcher.stop();
 	communicationThread.join();
@@ -319,6 +613,12 @@ RemoteServer::~RemoteServer(void)
 	/* Disconnect all clients: */
 	for(std::vector<Client*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
 		delete *cIt;
+	
+	delete codec;
+	delete lod;
+	delete coarseCodec;
+	keyFrame->unref();
+	deltaFrame->unref();
 	}
 
 void RemoteServer::frame(double applicationTime)
@@ -326,19 +626,22 @@ void RemoteServer::frame(double applicationTime)
 	/* Lock the most recent list of client positions: */
 	clientPositions.lockNewValue();
 	
-	/* Check if it's time to request a new set of grids: */
-	if(numClients>0&&applicationTime>=nextRequestTime)
+	/* Resume or pause the grid subscription when the first client starts or the last client stops streaming: */
+	bool newStreaming=numClients>0;
+	if(streaming!=newStreaming)
 		{
-		/* Request new grids: */
-		GridBuffers& gb=grids.startNewValue();
-		if(sandbox->gridRequest.requestGrids(gb.bathymetry,gb.waterLevel,&RemoteServer::readBackCallback,this))
-			{
-			/* Push the next request time forward: */
-			nextRequestTime=(Math::floor(applicationTime/requestInterval)+1.0)*requestInterval;
-			}
+		sandbox->gridReadback->setInterval(gridSubscriberId,newStreaming?requestInterval:0.0);
+		streaming=newStreaming;
 		}
 	}
 
+const std::vector<RemoteServer::ClientStats>& RemoteServer::getClientStats(void)
+	{
+	/* Return the most recent client statistics: */
+	clientStats.lockNewValue();
+	return clientStats.getLockedValue();
+	}
+
 void RemoteServer::glRenderAction(GLContextData& contextData) const
 	{
 	/* Draw icons for all connected clients: */
@@ -23,7 +23,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef REMOTESERVER_INCLUDED
 #define REMOTESERVER_INCLUDED
 
+#include <string>
 #include <vector>
+#include <deque>
+#include <Misc/SizedTypes.h>
 #include <Threads/Thread.h>
 #include <Threads/TripleBuffer.h>
 #include <Threads/EventDispatcher.h>
@@ -35,6 +38,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/gl.h>
 #include <Vrui/Geometry.h>
 
+#include "GridReadback.h"
+#include "GridCodec.h"
+#include "GridLOD.h"
+
 /* Forward declarations: */
 class GLContextData;
 class Sandbox;
@@ -42,7 +49,59 @@ class Sandbox;
 class RemoteServer
 	{
 	/* Embedded classes: */
+	public:
+	struct ClientStats // Structure reporting the streaming state of a connected client
+		{
+		/* Elements: */
+		public:
+		std::string address; // Client's network address
+		Misc::UInt64 bytesSent; // Total number of bytes sent to the client
+		unsigned int framesSent; // Number of frames completely sent to the client
+		unsigned int framesDropped; // Number of frames dropped because the client could not keep up
+		unsigned int queueLength; // Number of frames currently waiting in the client's send queue
+		double throughput; // Bytes per second sent to the client over the most recent second
+		double lag; // Time in seconds between queueing and completely sending the client's most recent frame
+		};
+	
 	private:
+	struct Frame // Structure representing an encoded grid update shared by the send queues of any number of clients
+		{
+		/* Elements: */
+		public:
+		Misc::UInt32 header[2]; // Frame type and size of the encoded grids
+		GridCodec::Buffer data; // Encoded grids
+		unsigned int refCount; // Number of references to the frame
+		
+		/* Constructors and destructors: */
+		Frame(void)
+			:refCount(1)
+			{
+			}
+		
+		/* Methods: */
+		void ref(void) // Adds a reference to the frame
+			{
+			++refCount;
+			}
+		void unref(void) // Removes a reference from the frame and deletes it when the last reference is gone
+			{
+			if(--refCount==0)
+				delete this;
+			}
+		size_t getSize(void) const // Returns the total number of bytes to send for the frame
+			{
+			return sizeof(header)+data.size();
+			}
+		};
+	
+	struct QueuedFrame // Structure representing a frame in a client's send queue
+		{
+		/* Elements: */
+		public:
+		Frame* frame; // The queued frame
+		double queueTime; // Time at which the frame was queued
+		};
+	
 	struct GridBuffers // Structure representing a pair of grids
 		{
 		/* Elements: */
@@ -85,9 +144,26 @@ class RemoteServer
 		ClientStates state; // Client's protocol state
 		Vrui::Point position; // Client's current position in grid space
 		Vrui::Vector direction; // Client's current viewing direction in grid space
+		bool needKeyFrame; // Flag whether the client needs a key frame before it can decode delta frames
+		bool lod; // Flag whether the client receives coarse grids and full-resolution tiles around its view instead of full-resolution grids
+		GLfloat lodRadii[2]; // Radius around the client's position, and radius inside the client's view cone, within which tiles are sent at full resolution
+		GLfloat lodCosHalfAngle; // Cosine of the half opening angle of the client's view cone
+		std::deque<QueuedFrame> sendQueue; // Queue of frames waiting to be sent to the client; the front frame may have been sent partially
+		size_t sendOffset; // Number of bytes of the front frame that have already been sent
+		bool writeListening; // Flag whether the client is listening for write events on its socket
+		ClientStats stats; // Client's streaming statistics
+		double windowStart; // Start time of the current throughput measurement window
+		size_t windowBytes; // Number of bytes sent in the current throughput measurement window
 		
 		/* Constructors and destructors: */
 		Client(RemoteServer* sServer); // Connects a remote client from a pending incoming connection on the listening socket
+		~Client(void); // Releases all queued frames
+		
+		/* Methods: */
+		unsigned int getNumUnsentFrames(void) const // Returns the number of queued frames of which nothing has been sent yet
+			{
+			return sendQueue.size()-(sendOffset>0?1:0);
+			}
 		};
 	
 	/* Elements: */
@@ -102,15 +178,36 @@ class RemoteServer
 	unsigned int numClients; // Number of connected clients in streaming state
 	Threads::TripleBuffer<std::vector<Vrui::ONTransform> > clientPositions; // Triple buffer of lists of positions/orientations of connected clients
 	double requestInterval; // Time interval between requests fro new bathymetry and water level grids
-	double nextRequestTime; // Application time at which to request the next bathymetry and water level grids
+	GridReadback::SubscriberID gridSubscriberId; // Key with which the remote server subscribes to bathymetry and water level grids
+	bool streaming; // Flag whether the remote server's grid subscription is currently active
 	Threads::TripleBuffer<GridBuffers> grids; // Triple buffer of arrays to receive bathymetry and water level grids
+	std::vector<GridCodec::Value> quantizedGrids; // Bathymetry and water level grids quantized once per update for all clients
+	GridCodec* codec; // Codec encoding each update against the previous one
+	Frame* keyFrame; // Most recent update encoded as a key frame for newly streaming clients
+	Frame* deltaFrame; // Most recent update encoded as a delta frame against the previous update
+	GridLOD* lod; // Level-of-detail scheme splitting the grids into coarse grids and full-resolution tiles
+	std::vector<GridCodec::Value> coarseGrids; // Coarse bathymetry and water level grids of the most recent update
+	GridCodec* coarseCodec; // Codec encoding each update's coarse grids against the previous ones
+	GridCodec::Buffer coarseKeyFrame; // Most recent coarse grids encoded as a key frame
+	GridCodec::Buffer coarseDeltaFrame; // Most recent coarse grids encoded as a delta frame
+	std::vector<GridCodec::Buffer> tileFrames; // Cache of encoded full-resolution tiles of the most recent update
+	std::vector<unsigned int> tileFrameVersions; // Update versions of the cached encoded tiles
+	unsigned int tileFramesVersion; // Update version of the current encoded tiles
+	std::vector<unsigned int> selectedTiles; // List of tiles selected for the current level-of-detail client
+	unsigned int maxQueuedFrames; // Maximum number of unsent frames in a client's send queue before the client skips to the next key frame
+	double nextStatsTime; // Time at which to publish the next client statistics
+	Threads::TripleBuffer<std::vector<ClientStats> > clientStats; // Triple buffer of lists of statistics of connected clients in streaming state
 	
 	/* Private methods: */
 	void disconnectClient(Client* client,bool removeListener); // Disconnects the given client after a communications error
 	static bool newConnectionCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a connection attempt is made at the listening socket
-	static bool clientMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a message is received from a connected client
+	static bool clientMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a message is received from a connected client, or when a client's socket can accept more data
+	static Frame* getWritableFrame(Frame*& frame); // Replaces the given server-held frame with a new one if it is still queued for any client, and returns it
+	void dropUnsentFrames(Client* client); // Drops all unsent frames from the given client's send queue and makes it skip to the next key frame
+	Frame* createLodFrame(Client* client); // Creates a level-of-detail frame of the most recent update for the given client
+	bool sendFrames(Client* client); // Sends as much of the given client's send queue as its socket accepts without blocking; returns false on a communication error
 	void* communicationThreadMethod(void); // Method handling communication with connected clients in the background
-	static void readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData); // Callback called when new property grids have been read back from the GPU
+	static void readBackCallback(const GLfloat* bathymetry,const GLfloat* waterLevel,const GLfloat* snow,void* userData); // Callback called when new property grids have been read back from the GPU
 	
 	/* Constructors and destructors: */
 	public:
@@ -120,6 +217,7 @@ class RemoteServer
 	/* Methods: */
 	void frame(double applicationTime); // Called from the AR Sandbox's frame method
 	void glRenderAction(GLContextData& contextData) const; // Renders the remote server's current state
+	const std::vector<ClientStats>& getClientStats(void); // Returns the most recent statistics of all connected clients in streaming state; must be called from the main thread
 	};
 
 #endif
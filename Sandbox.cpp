@@ -22,8 +22,11 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "Sandbox.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -33,6 +36,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <stdexcept>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <Misc/SizedTypes.h>
 #include <Misc/SelfDestructPointer.h>
 #include <Misc/FixedArray.h>
@@ -41,6 +45,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Misc/FileNameExtensions.h>
 #include <Misc/StandardValueCoders.h>
 #include <Misc/ArrayValueCoders.h>
+#include <Misc/CompoundValueCoders.h>
 #include <Misc/ConfigurationFile.h>
 #include <IO/File.h>
 #include <IO/ValueSource.h>
@@ -91,6 +96,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Kinect/FileFrameSource.h>
 #include <Kinect/MultiplexedFrameSource.h>
 #include <Kinect/DirectFrameSource.h>
+#include <Kinect/Camera.h>
 #include <Kinect/OpenDirectFrameSource.h>
 
 #define SAVEDEPTH 0
@@ -100,17 +106,29 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Images/WriteImageFile.h>
 #endif
 
+#include "FramePipeline.h"
+#include "DepthStreamRecorder.h"
+#include "DepthStreamSource.h"
 #include "FrameFilter.h"
 #include "DepthImageRenderer.h"
+#include "HillshadeMap.h"
 #include "ElevationColorMap.h"
 #include "DEM.h"
 #include "SurfaceRenderer.h"
 #include "WaterTable2.h"
+#include "SimulationThread.h"
+#include "GridReadback.h"
+#include "SimulationCheckpoint.h"
+#include "SimulationParameterStore.h"
+#include "QualityGovernor.h"
 #include "HandExtractor.h"
 #include "RemoteServer.h"
 #include "WaterRenderer.h"
+#include "StageTimers.h"
+#include "ShaderHelper.h"
 #include "GlobalWaterTool.h"
 #include "LocalWaterTool.h"
+#include "DEMCache.h"
 #include "DEMTool.h"
 #include "BathymetrySaverTool.h"
 
@@ -121,8 +139,7 @@ Methods of class Sandbox::DataItem:
 **********************************/
 
 Sandbox::DataItem::DataItem(void)
-	:waterTableTime(0.0),
-	 shadowFramebufferObject(0),shadowDepthTextureObject(0)
+	:waterTableTime(0.0),numQueuedWaterSteps(0)
 	{
 	/* Check if all required extensions are supported: */
 	bool supported=GLEXTFramebufferObject::isSupported();
@@ -151,9 +168,6 @@ Sandbox::DataItem::DataItem(void)
 
 Sandbox::DataItem::~DataItem(void)
 	{
-	/* Delete all shaders, buffers, and texture objects: */
-	glDeleteFramebuffersEXT(1,&shadowFramebufferObject);
-	glDeleteTextures(1,&shadowDepthTextureObject);
 	}
 
 /****************************************
@@ -250,17 +264,31 @@ Methods of class Sandbox:
 
 void Sandbox::rawDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer)
 	{
-	/* Pass the received frame to the frame filter and the hand extractor: */
-	if(frameFilter!=0&&!pauseUpdates)
+	/* Pass the received frame directly to the depth image renderer if it filters on the GPU: */
+	if(gpuTemporalFilter&&!pauseUpdates)
+		{
+		/* Forward the raw frame as an output frame without change tracking: */
+		FrameFilter::OutputFrame rawFrame;
+		rawFrame.depthImage=frameBuffer;
+		rawFrame.frameIndex=0;
+		receiveFilteredFrame(rawFrame);
+		}
+	
+	/* Share the received frame with the frame filter and the hand extractor: */
+	if(framePipeline!=0)
+		framePipeline->publishFrame(frameBuffer);
+	}
+
+void Sandbox::filterRawFrame(const Kinect::FrameBuffer& frameBuffer)
+	{
+	if(!pauseUpdates)
 		frameFilter->receiveRawFrame(frameBuffer);
-	if(handExtractor!=0)
-		handExtractor->receiveRawFrame(frameBuffer);
 	}
 
-void Sandbox::receiveFilteredFrame(const Kinect::FrameBuffer& frameBuffer)
+void Sandbox::receiveFilteredFrame(const FrameFilter::OutputFrame& outputFrame)
 	{
 	/* Put the new frame into the frame input buffer: */
-	filteredFrames.postNewValue(frameBuffer);
+	filteredFrames.postNewValue(outputFrame);
 	
 	/* Wake up the foreground thread: */
 	Vrui::requestUpdate();
@@ -286,10 +314,90 @@ void Sandbox::toggleDEM(DEM* dem)
 			rsIt->surfaceRenderer->setDem(activeDem);
 	}
 
+void Sandbox::fitDem(DEM& dem,const OGTransform* demTransform,Scalar demVerticalShift,Scalar demVerticalScale,unsigned int demResolution) const
+	{
+	OGTransform demT;
+	if(demTransform!=0)
+		demT=*demTransform;
+	else
+		{
+		/* Calculate an appropriate DEM transformation to fit the DEM into the sandbox's domain: */
+		const Scalar* demBox=dem.getDemBox();
+		Scalar demSx=demBox[2]-demBox[0];
+		Scalar demSy=demBox[3]-demBox[1];
+		Scalar boxSx=bbox.getSize(0);
+		Scalar boxSy=bbox.getSize(1);
+		
+		/* Shift the DEM's center to the box's center: */
+		Point demCenter;
+		demCenter[0]=Math::mid(demBox[0],demBox[2]);
+		demCenter[1]=Math::mid(demBox[1],demBox[3]);
+		demCenter[2]=Scalar(dem.calcAverageElevation());
+		demT=OGTransform::translateFromOriginTo(demCenter);
+		
+		/* Determine whether the DEM should be rotated: */
+		Scalar scale=Math::min(demSx/boxSx,demSy/boxSy);
+		Scalar scaleRot=Math::min(demSx/boxSy,demSy/boxSx);
+		
+		if(scale<scaleRot)
+			{
+			/* Scale and rotate DEM: */
+			demT*=OGTransform::rotate(OGTransform::Rotation::rotateZ(Math::rad(Scalar(90))));
+			scale=scaleRot;
+			}
+		
+		/* Scale DEM without rotation: */
+		demT*=OGTransform::scale(scale);
+		}
+	
+	/* Shift the DEM vertically: */
+	demT*=OGTransform::translate(Vector(0,0,demVerticalShift/demVerticalScale));
+	
+	/* Set the DEM transformation: */
+	OGTransform t=demT*OGTransform(boxTransform);
+	dem.setTransform(t,demVerticalScale,demT.getOrigin()[2]);
+	
+	/* Calculate the sandbox's footprint in DEM space to select the resolution and area of tiled DEMs: */
+	Scalar footprint[4];
+	for(int i=0;i<2;++i)
+		{
+		footprint[i]=Math::Constants<Scalar>::max;
+		footprint[2+i]=-Math::Constants<Scalar>::max;
+		}
+	for(int v=0;v<8;++v)
+		{
+		Point p=t.transform(bbox.getVertex(v));
+		for(int i=0;i<2;++i)
+			{
+			footprint[i]=Math::min(footprint[i],p[i]);
+			footprint[2+i]=Math::max(footprint[2+i],p[i]);
+			}
+		}
+	dem.setFootprint(footprint,demResolution);
+	}
+
+DEM* Sandbox::getCachedDem(const char* demFileName)
+	{
+	/* Return the cached DEM if there is one: */
+	DEM* dem=demCache->find(demFileName);
+	if(dem==0)
+		{
+		/* Load the DEM, fit it into the sandbox, and add it to the cache: */
+		Misc::SelfDestructPointer<DEM> newDem(new DEM);
+		newDem->load(demFileName);
+		fitDem(*newDem,0,Scalar(0),Scalar(1),demResolution);
+		dem=newDem.releaseTarget();
+		demCache->insert(demFileName,dem,activeDem);
+		}
+	
+	return dem;
+	}
+
 void Sandbox::addWater(GLContextData& contextData) const
 	{
-	/* Check if the most recent rain object list is not empty: */
-	if(handExtractor!=0&&!handExtractor->getLockedExtractedHands().empty())
+	/* Check if the rain disk list of the simulation's parameter snapshot is not empty; the hand extractor's own list belongs to the main thread: */
+	const std::vector<SimulationParameters::RainDisk>& rainDisks=parameterStore->getSnapshot().rainDisks;
+	if(!rainDisks.empty())
 		{
 		/* Render all rain objects into the water table: */
 		glPushAttrib(GL_ENABLE_BIT);
@@ -303,14 +411,14 @@ void Sandbox::addWater(GLContextData& contextData) const
 		y.normalize();
 		
 		glVertexAttrib1fARB(1,rainStrength/waterSpeed);
-		for(HandExtractor::HandList::const_iterator hIt=handExtractor->getLockedExtractedHands().begin();hIt!=handExtractor->getLockedExtractedHands().end();++hIt)
+		for(std::vector<SimulationParameters::RainDisk>::const_iterator rdIt=rainDisks.begin();rdIt!=rainDisks.end();++rdIt)
 			{
 			/* Render a rain disk approximating the hand: */
 			glBegin(GL_POLYGON);
 			for(int i=0;i<32;++i)
 				{
 				Scalar angle=Scalar(2)*Math::Constants<Scalar>::pi*Scalar(i)/Scalar(32);
-				glVertex(hIt->center+x*(Math::cos(angle)*hIt->radius*0.75)+y*(Math::sin(angle)*hIt->radius*0.75));
+				glVertex(rdIt->center+x*(Math::cos(angle)*rdIt->radius*0.75)+y*(Math::sin(angle)*rdIt->radius*0.75));
 				}
 			glEnd();
 			}
@@ -353,6 +461,239 @@ void Sandbox::addWater(GLContextData& contextData) const
 
 	}
 
+void Sandbox::applySimulationParameters(void)
+	{
+	if(parameterStore->lockNewSnapshot())
+		{
+		const SimulationParameters& sp=parameterStore->getSnapshot();
+		waterSpeed=sp.waterSpeed;
+		waterMaxSteps=sp.waterMaxSteps;
+		if(waterTable!=0)
+			{
+			/* Re-render the water sources, whose rates depend on the water speed: */
+			waterTable->updateWaterSources();
+			waterTable->setAttenuation(sp.attenuation);
+			waterTable->setWaterDeposit(sp.waterDeposit);
+			waterTable->setSnowParameters(sp.criticalHeight,sp.meltRate);
+			}
+		}
+	}
+
+void Sandbox::runWaterSimulation(GLfloat totalTimeStep,unsigned int& numQueuedWaterSteps,GLContextData& contextData) const
+	{
+	/* Get the maximum number of steps at the quality governor's current level: */
+	unsigned int maxSteps=qualityGovernor!=0?qualityGovernor->getMaxSteps(waterMaxSteps):waterMaxSteps;
+	
+	{
+	/* Update the water table's bathymetry grid while the depth image cannot change: */
+	Threads::Mutex::Lock depthImageLock(depthImageMutex);
+	waterTable->updateBathymetry(contextData);
+	}
+	
+	/* Run the water flow simulation's main pass: */
+	if(queueWaterSteps)
+		{
+		/* Queue the number of steps the previous frame needed plus some headroom, without waiting for the GPU: */
+		if(numQueuedWaterSteps==0||numQueuedWaterSteps>maxSteps-1U)
+			numQueuedWaterSteps=maxSteps-1U;
+		waterTable->setMaxStepSize(totalTimeStep);
+		GLfloat lastRemainingTime;
+		unsigned int lastNumSteps;
+		if(waterTable->queueSimulationSteps(totalTimeStep,numQueuedWaterSteps,contextData,lastRemainingTime,lastNumSteps))
+			{
+			/* Adapt the number of queued steps to the previous frame's result: */
+			if(lastRemainingTime>1.0e-8f)
+				{
+				if(lastNumSteps>=maxSteps-1U)
+					std::cout<<"Ran out of time by "<<lastRemainingTime<<std::endl;
+				numQueuedWaterSteps=Math::min(lastNumSteps*2U+1U,maxSteps-1U);
+				}
+			else
+				numQueuedWaterSteps=Math::min(lastNumSteps+2U,maxSteps-1U);
+			}
+		}
+	else
+		{
+		unsigned int numSteps=0;
+		while(numSteps<maxSteps-1U&&totalTimeStep>1.0e-8f)
+			{
+			/* Run with a self-determined time step to maintain stability: */
+			waterTable->setMaxStepSize(totalTimeStep);
+			GLfloat timeStep=waterTable->runSimulationStep(false,contextData);
+			totalTimeStep-=timeStep;
+			++numSteps;
+			}
+		#if 0
+		if(totalTimeStep>1.0e-8f)
+			{
+			std::cout<<'.'<<std::flush;
+			/* Force the final step to avoid simulation slow-down: */
+			waterTable->setMaxStepSize(totalTimeStep);
+			GLfloat timeStep=waterTable->runSimulationStep(true,contextData);
+			totalTimeStep-=timeStep;
+			++numSteps;
+			}
+		#else
+		if(totalTimeStep>1.0e-8f)
+			std::cout<<"Ran out of time by "<<totalTimeStep<<std::endl;
+		#endif
+		}
+	
+	/* Retrieve the previous simulation run's water volumes and queue their next reduction: */
+	GLfloat lastVolumes[3];
+	if(waterTable->queueVolumeReduction(contextData,lastVolumes))
+		{
+		Threads::Mutex::Lock waterVolumesLock(waterVolumesMutex);
+		for(int i=0;i<3;++i)
+			waterVolumes[i]=lastVolumes[i];
+		waterVolumesValid=true;
+		}
+	
+	/* Deliver finished grid read-backs and start a pending one: */
+	gridReadback->readGrids(contextData);
+	}
+
+void Sandbox::simulationTick(GLContextData& contextData)
+	{
+	/* Apply the most recent run-time changes to the simulation parameters once per tick: */
+	applySimulationParameters();
+	
+	/* Advance the water simulation by one tick's worth of simulation time: */
+	runWaterSimulation(GLfloat(simulationThread->getTickInterval()*waterSpeed),numQueuedTickSteps,contextData);
+	}
+
+void Sandbox::setTargetFrameRate(double newTargetFrameRate)
+	{
+	/* The simulation thread runs at its own fixed rate independent of the frame rate: */
+	if(simulationThread!=0)
+		{
+		std::cerr<<"Sandbox: Ignoring target frame rate as the water simulation runs on a background thread"<<std::endl;
+		return;
+		}
+	
+	if(newTargetFrameRate>0.0)
+		{
+		/* Create a quality governor or change its target frame rate: */
+		if(qualityGovernor==0)
+			{
+			qualityGovernor=new QualityGovernor(newTargetFrameRate);
+			qualityGovernor->setGridScaling(waterGridScaling);
+			}
+		else
+			qualityGovernor->setTargetFrameRate(newTargetFrameRate);
+		}
+	else
+		{
+		/* Disable the quality governor: */
+		delete qualityGovernor;
+		qualityGovernor=0;
+		}
+	
+	/* Apply the resulting quality level: */
+	applyQualityLevel();
+	}
+
+void Sandbox::applyQualityLevel(void)
+	{
+	/* Stretch the snow cadence: */
+	unsigned int snowIntervalFactor=qualityGovernor!=0?qualityGovernor->getSnowIntervalFactor():1U;
+	waterTable->setSnowStepInterval(snowStepInterval*snowIntervalFactor);
+	waterTable->setSnowUpdateInterval(snowUpdateInterval*double(snowIntervalFactor));
+	
+	/* Resize the water grid if its resolution changed: */
+	double gridScale=qualityGovernor!=0?qualityGovernor->getGridScale():1.0;
+	GLsizei gridSize[2];
+	for(int i=0;i<2;++i)
+		gridSize[i]=Math::max(GLsizei(Math::floor(double(waterTableSize[i])*gridScale+0.5)),GLsizei(2));
+	if(gridSize[0]!=waterTable->getSize()[0]||gridSize[1]!=waterTable->getSize()[1])
+		waterTable->setGridSize(gridSize[0],gridSize[1]);
+	}
+
+std::string Sandbox::getQualityLevelDescription(void) const
+	{
+	std::ostringstream description;
+	if(qualityGovernor!=0)
+		{
+		description<<"level "<<qualityGovernor->getLevel()<<" of "<<QualityGovernor::maxLevel<<" at "<<qualityGovernor->getFrameRate()<<" fps of target "<<qualityGovernor->getTargetFrameRate()<<" fps, "<<qualityGovernor->getSimulationTime()*1000.0<<" ms simulation per frame: ";
+		description<<qualityGovernor->getMaxSteps(waterMaxSteps)<<" max steps, snow interval x"<<qualityGovernor->getSnowIntervalFactor()<<", "<<waterTable->getSize()[0]<<'x'<<waterTable->getSize()[1]<<" grid";
+		}
+	else
+		description<<"off";
+	
+	return description.str();
+	}
+
+void Sandbox::writeStatus(const std::string& status)
+	{
+	/* Open the status pipe once a process reads from it; opening a pipe for writing in non-blocking mode fails while there is no reader: */
+	if(statusPipeFd<0&&!statusPipeName.empty())
+		statusPipeFd=open(statusPipeName.c_str(),O_WRONLY|O_NONBLOCK);
+	
+	if(statusPipeFd>=0)
+		{
+		/* Write the status line, and close the pipe if the reader went away so that it is opened again for the next status: */
+		std::string line=status;
+		line.push_back('\n');
+		if(write(statusPipeFd,line.data(),line.size())<0&&errno!=EAGAIN)
+			{
+			close(statusPipeFd);
+			statusPipeFd=-1;
+			}
+		}
+	}
+
+void Sandbox::printStageStatistics(void) const
+	{
+	if(stageTimers!=0)
+		{
+		std::cout<<"Stage times (last / mean / max over recent measurements in ms):"<<std::endl;
+		for(int stage=0;stage<StageTimers::NUM_STAGES;++stage)
+			{
+			StageTimers::Statistics stats=stageTimers->getStatistics(StageTimers::Stage(stage));
+			if(stats.numSamples>0)
+				std::cout<<"  "<<StageTimers::getStageName(StageTimers::Stage(stage))<<": "<<stats.last*1000.0<<" / "<<stats.mean*1000.0<<" / "<<stats.max*1000.0<<" ("<<stats.numSamples<<" measurements)"<<std::endl;
+			}
+		}
+	else
+		std::cout<<"Stage times: off"<<std::endl;
+	
+	/* Print the most recently reduced water volumes: */
+	Threads::Mutex::Lock waterVolumesLock(waterVolumesMutex);
+	if(waterVolumesValid)
+		std::cout<<"Water volumes (cm^3): snowpack "<<waterVolumes[0]<<", melt water "<<waterVolumes[1]<<", free water "<<waterVolumes[2]<<std::endl;
+	else
+		std::cout<<"Water volumes: not yet available"<<std::endl;
+	}
+
+void Sandbox::updateQualityGovernor(void)
+	{
+	/* Restore the full water grid while a one-time grid read-back request is pending, as requesters expect grids of the full size: */
+	qualityGovernor->setGridScaling(waterGridScaling&&!gridReadback->hasPendingRequests());
+	
+	/* Queued water steps return before the GPU runs them; measure their cost with the timestamp queries enclosing the simulation instead, whose results arrive a few frames late: */
+	double simulationTime=waterSimulationTime;
+	if(queueWaterSteps&&stageTimers!=0)
+		{
+		StageTimers::Statistics stats=stageTimers->getStatistics(StageTimers::SIMULATION);
+		if(stats.numSamples>0)
+			simulationTime=stats.last;
+		}
+	
+	/* Measure the most recent frame: */
+	unsigned int oldLevel=qualityGovernor->getLevel();
+	if(qualityGovernor->update(Vrui::getApplicationTime(),Vrui::getCurrentFrameTime(),simulationTime))
+		{
+		/* Apply and report the new quality level on the console and the status pipe: */
+		applyQualityLevel();
+		std::string status="Quality governor: ";
+		status.append(qualityGovernor->getLevel()>oldLevel?"Lowered":"Raised");
+		status.append(" water simulation quality to ");
+		status.append(getQualityLevelDescription());
+		std::cout<<status<<std::endl;
+		writeStatus(status);
+		}
+	}
+
 void Sandbox::pauseUpdatesCallback(GLMotif::ToggleButton::ValueChangedCallbackData* cbData)
 	{
 	pauseUpdates=cbData->set;
@@ -365,17 +706,17 @@ void Sandbox::showWaterControlDialogCallback(Misc::CallbackData* cbData)
 
 void Sandbox::waterSpeedSliderCallback(GLMotif::TextFieldSlider::ValueChangedCallbackData* cbData)
 	{
-	waterSpeed=cbData->value;
+	parameterStore->setWaterSpeed(cbData->value);
 	}
 
 void Sandbox::waterMaxStepsSliderCallback(GLMotif::TextFieldSlider::ValueChangedCallbackData* cbData)
 	{
-	waterMaxSteps=int(Math::floor(cbData->value+0.5));
+	parameterStore->setWaterMaxSteps((unsigned int)(Math::floor(cbData->value+0.5)));
 	}
 
 void Sandbox::waterAttenuationSliderCallback(GLMotif::TextFieldSlider::ValueChangedCallbackData* cbData)
 	{
-	waterTable->setAttenuation(GLfloat(1.0-cbData->value));
+	parameterStore->setAttenuation(GLfloat(1.0-cbData->value));
 	}
 
 GLMotif::PopupMenu* Sandbox::createMainMenu(void)
@@ -457,6 +798,42 @@ GLMotif::PopupWindow* Sandbox::createWaterControlDialog(void)
 	
 	frameRateMargin->manageChild();
 	
+	new GLMotif::Label("QualityLevelLabel",waterControlDialog,"Quality Level");
+	
+	GLMotif::Margin* qualityLevelMargin=new GLMotif::Margin("QualityLevelMargin",waterControlDialog,false);
+	qualityLevelMargin->setAlignment(GLMotif::Alignment::LEFT);
+	
+	qualityLevelTextField=new GLMotif::TextField("QualityLevelTextField",qualityLevelMargin,8);
+	qualityLevelTextField->setFieldWidth(7);
+	qualityLevelTextField->setPrecision(0);
+	qualityLevelTextField->setFloatFormat(GLMotif::TextField::FIXED);
+	qualityLevelTextField->setString("Off");
+	
+	qualityLevelMargin->manageChild();
+	
+	if(stageTimers!=0)
+		{
+		/* Show the mean time of each measured stage: */
+		for(int stage=0;stage<StageTimers::NUM_STAGES;++stage)
+			{
+			std::string stageLabel=StageTimers::getStageName(StageTimers::Stage(stage));
+			stageLabel.append(" (ms)");
+			new GLMotif::Label("StageTimeLabel",waterControlDialog,stageLabel.c_str());
+			
+			GLMotif::Margin* stageTimeMargin=new GLMotif::Margin("StageTimeMargin",waterControlDialog,false);
+			stageTimeMargin->setAlignment(GLMotif::Alignment::LEFT);
+			
+			GLMotif::TextField* stageTimeTextField=new GLMotif::TextField("StageTimeTextField",stageTimeMargin,8);
+			stageTimeTextField->setFieldWidth(7);
+			stageTimeTextField->setPrecision(3);
+			stageTimeTextField->setFloatFormat(GLMotif::TextField::FIXED);
+			stageTimeTextField->setString("-");
+			stageTimeTextFields.push_back(stageTimeTextField);
+			
+			stageTimeMargin->manageChild();
+			}
+		}
+	
 	new GLMotif::Label("WaterAttenuationLabel",waterControlDialog,"Attenuation");
 	
 	waterAttenuationSlider=new GLMotif::TextFieldSlider("WaterAttenuationSlider",waterControlDialog,8,ss.fontHeight*10.0f);
@@ -480,6 +857,13 @@ namespace {
 Helper functions:
 ****************/
 
+double getMonotonicTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)/1.0e9;
+	}
+
 void printUsage(void)
 	{
 	std::cout<<"Usage: SARndbox [option 1] ... [option n]"<<std::endl;
@@ -496,6 +880,15 @@ void printUsage(void)
 	std::cout<<"  -f <frame file name prefix>"<<std::endl;
 	std::cout<<"     Reads a pre-recorded 3D video stream from a pair of color/depth"<<std::endl;
 	std::cout<<"     files of the given file name prefix"<<std::endl;
+	std::cout<<"  -replay <depth stream file name>"<<std::endl;
+	std::cout<<"     Replays raw depth frames and their camera metadata and base plane"<<std::endl;
+	std::cout<<"     from a depth stream file recorded with -record"<<std::endl;
+	std::cout<<"  -replayMaxSpeed"<<std::endl;
+	std::cout<<"     Replays depth stream files as fast as possible instead of at"<<std::endl;
+	std::cout<<"     recorded speed"<<std::endl;
+	std::cout<<"  -record <depth stream file name>"<<std::endl;
+	std::cout<<"     Records raw depth frames and their camera metadata and base plane"<<std::endl;
+	std::cout<<"     into a depth stream file"<<std::endl;
 	std::cout<<"  -s <scale factor>"<<std::endl;
 	std::cout<<"     Scale factor from real sandbox to simulated terrain"<<std::endl;
 	std::cout<<"     Default: 100.0 (1:100 scale, 1cm in sandbox is 1m in terrain"<<std::endl;
@@ -512,6 +905,9 @@ void printUsage(void)
 	std::cout<<"     Sets the number of averaging slots in the frame filter; latency is"<<std::endl;
 	std::cout<<"     <num averaging slots> * 1/30 s"<<std::endl;
 	std::cout<<"     Default: 30"<<std::endl;
+	std::cout<<"  -cab"<<std::endl;
+	std::cout<<"     Stores the frame filter's averaging slots as 8-bit differences to"<<std::endl;
+	std::cout<<"     per-pixel base values to reduce memory bandwidth"<<std::endl;
 	std::cout<<"  -sp <min num samples> <max variance>"<<std::endl;
 	std::cout<<"     Sets the frame filter parameters minimum number of valid samples"<<std::endl;
 	std::cout<<"     and maximum sample variance before convergence"<<std::endl;
@@ -519,6 +915,52 @@ void printUsage(void)
 	std::cout<<"  -he <hysteresis envelope>"<<std::endl;
 	std::cout<<"     Sets the size of the hysteresis envelope used for jitter removal"<<std::endl;
 	std::cout<<"     Default: 0.1"<<std::endl;
+	std::cout<<"  -ma <motion threshold> <num outlier frames> <min num samples>"<<std::endl;
+	std::cout<<"     Resets a pixel's running average after the given number of"<<std::endl;
+	std::cout<<"     consecutive samples further than the motion threshold from its mean,"<<std::endl;
+	std::cout<<"     and considers it stable again after the given number of samples;"<<std::endl;
+	std::cout<<"     the number of outlier frames must be between 1 and 127; reports the"<<std::endl;
+	std::cout<<"     resulting shaping latency distribution on exit"<<std::endl;
+	std::cout<<"     Default: 0 2 3 (disabled)"<<std::endl;
+	std::cout<<"  -nft <num filter threads>"<<std::endl;
+	std::cout<<"     Sets the number of threads sharing the work of the frame filter"<<std::endl;
+	std::cout<<"     Default: 1"<<std::endl;
+	std::cout<<"  -npt <num pipeline threads>"<<std::endl;
+	std::cout<<"     Sets the number of worker threads shared by the frame filter and"<<std::endl;
+	std::cout<<"     the hand extractor to process incoming depth frames"<<std::endl;
+	std::cout<<"     Default: 2"<<std::endl;
+	std::cout<<"  -ht <full frame interval> <num tracking threads>"<<std::endl;
+	std::cout<<"     Searches for hands only around the hands detected in the previous"<<std::endl;
+	std::cout<<"     frame, and in the full frame every given number of frames or when a"<<std::endl;
+	std::cout<<"     hand is lost; search regions are shared by the given number of threads"<<std::endl;
+	std::cout<<"     Default: 0 1 (search the full frame every time)"<<std::endl;
+	std::cout<<"  -gsf"<<std::endl;
+	std::cout<<"     Applies the frame filter's spatial low-pass filter on the GPU while"<<std::endl;
+	std::cout<<"     uploading depth images"<<std::endl;
+	std::cout<<"  -gtf"<<std::endl;
+	std::cout<<"     Runs the frame filter's temporal filter on the GPU in every rendering"<<std::endl;
+	std::cout<<"     context instead of in a background thread; the averaging window counts"<<std::endl;
+	std::cout<<"     rendered frames, skipping depth frames that arrive between two rendered"<<std::endl;
+	std::cout<<"     frames, and only 16-bit depth frames are supported"<<std::endl;
+	std::cout<<"  -slod <cell size>"<<std::endl;
+	std::cout<<"     Culls the surface mesh against each window's view and reduces its"<<std::endl;
+	std::cout<<"     resolution until mesh cells cover up to the given number of pixels"<<std::endl;
+	std::cout<<"     Default: 0 (disabled)"<<std::endl;
+	std::cout<<"  -wlod <cell size>"<<std::endl;
+	std::cout<<"     Reduces the resolution of each tile of water surface geometry until its"<<std::endl;
+	std::cout<<"     grid cells cover up to the given number of pixels"<<std::endl;
+	std::cout<<"     Default: 0 (disabled)"<<std::endl;
+	std::cout<<"  -pbd <program binary directory>"<<std::endl;
+	std::cout<<"     Stores linked shader programs in the given directory to skip shader"<<std::endl;
+	std::cout<<"     compilation on subsequent runs; an empty name disables this"<<std::endl;
+	std::cout<<"     Default: $HOME/.cache/SARndbox/ProgramBinaries"<<std::endl;
+	std::cout<<"  -st"<<std::endl;
+	std::cout<<"     Measures the time spent in each water simulation, rendering, and input"<<std::endl;
+	std::cout<<"     processing stage, and shows it in the water control dialog and through"<<std::endl;
+	std::cout<<"     the stats control pipe command"<<std::endl;
+	std::cout<<"  -stf <stage trace file name>"<<std::endl;
+	std::cout<<"     Measures stage times as with -st, and writes the times measured in each"<<std::endl;
+	std::cout<<"     frame to a CSV file of the given name"<<std::endl;
 	std::cout<<"  -wts <water grid width> <water grid height>"<<std::endl;
 	std::cout<<"     Sets the width and height of the water flow simulation grid"<<std::endl;
 	std::cout<<"     Default: 640 480"<<std::endl;
@@ -526,6 +968,42 @@ void printUsage(void)
 	std::cout<<"     Sets the relative speed of the water simulation and the maximum"<<std::endl;
 	std::cout<<"     number of simulation steps per frame"<<std::endl;
 	std::cout<<"     Default: 1.0 30"<<std::endl;
+	std::cout<<"  -qws"<<std::endl;
+	std::cout<<"     Queues all water simulation steps of a frame on the GPU without"<<std::endl;
+	std::cout<<"     waiting for each step's size; time left over is reported a frame late"<<std::endl;
+	std::cout<<"  -ssi <snow step interval>"<<std::endl;
+	std::cout<<"     Updates snow accumulation and melt every given number of water"<<std::endl;
+	std::cout<<"     simulation steps"<<std::endl;
+	std::cout<<"     Default: 1"<<std::endl;
+	std::cout<<"  -sui <snow update interval>"<<std::endl;
+	std::cout<<"     Updates snow accumulation and melt at most once per given wall-clock"<<std::endl;
+	std::cout<<"     time in seconds instead of every snow step interval steps"<<std::endl;
+	std::cout<<"     Default: 0.0 (use snow step interval)"<<std::endl;
+	std::cout<<"  -nfss"<<std::endl;
+	std::cout<<"     Updates snow in separate passes after the water simulation's"<<std::endl;
+	std::cout<<"     integration step instead of in the same pass"<<std::endl;
+	std::cout<<"  -wcs"<<std::endl;
+	std::cout<<"     Runs the water simulation on OpenGL 4.3 compute shaders; falls back"<<std::endl;
+	std::cout<<"     to fragment shaders if the OpenGL context does not support them"<<std::endl;
+	std::cout<<"  -whf"<<std::endl;
+	std::cout<<"     Stores the water simulation's conserved quantities, derivatives, and"<<std::endl;
+	std::cout<<"     snow in 16-bit floating-point textures to reduce memory bandwidth"<<std::endl;
+	std::cout<<"  -nsws"<<std::endl;
+	std::cout<<"     Simulates water flow on the entire water table instead of only on"<<std::endl;
+	std::cout<<"     tiles containing or adjacent to water, snow, or rain"<<std::endl;
+	std::cout<<"  -wsr <water simulation rate>"<<std::endl;
+	std::cout<<"     Runs the water simulation at the given number of ticks per second on"<<std::endl;
+	std::cout<<"     a background thread with its own OpenGL context, instead of once per"<<std::endl;
+	std::cout<<"     frame in the render contexts; all windows must share one OpenGL"<<std::endl;
+	std::cout<<"     context"<<std::endl;
+	std::cout<<"     Default: 0.0 (simulate once per frame)"<<std::endl;
+	std::cout<<"  -tfr <target frame rate>"<<std::endl;
+	std::cout<<"     Holds the given frame rate in Hz by reducing the maximum number of"<<std::endl;
+	std::cout<<"     water simulation steps per frame, the snow cadence, and, if needed,"<<std::endl;
+	std::cout<<"     the water grid resolution while the simulation is too slow"<<std::endl;
+	std::cout<<"     Default: 0.0 (full quality)"<<std::endl;
+	std::cout<<"  -nwgs"<<std::endl;
+	std::cout<<"     Keeps the full water grid resolution when holding a target frame rate"<<std::endl;
 	std::cout<<"  -rer <min rain elevation> <max rain elevation>"<<std::endl;
 	std::cout<<"     Sets the elevation range of the rain cloud level relative to the"<<std::endl;
 	std::cout<<"     ground plane in cm"<<std::endl;
@@ -555,7 +1033,7 @@ void printUsage(void)
 	std::cout<<"  -ns"<<std::endl;
 	std::cout<<"     Disables shadows"<<std::endl;
 	std::cout<<"  -us"<<std::endl;
-	std::cout<<"     Enables shadows"<<std::endl;
+	std::cout<<"     Enables shadows cast by a fixed sun light source; requires hill shading"<<std::endl;
 	std::cout<<"  -nhm"<<std::endl;
 	std::cout<<"     Disables elevation color mapping"<<std::endl;
 	std::cout<<"  -uhm [elevation color map file name]"<<std::endl;
@@ -577,6 +1055,10 @@ void printUsage(void)
 	std::cout<<"     Default: 2.0"<<std::endl;
 	std::cout<<"  -cp <control pipe name>"<<std::endl;
 	std::cout<<"     Sets the name of a named POSIX pipe from which to read control commands"<<std::endl;
+	std::cout<<"  -statusPipe <status pipe name>"<<std::endl;
+	std::cout<<"     Sets the name of a named POSIX pipe to which to write quality governor"<<std::endl;
+	std::cout<<"     decisions and answers to qualityLevel control commands, once another"<<std::endl;
+	std::cout<<"     process reads from it"<<std::endl;
 	}
 
 }
@@ -585,15 +1067,16 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	:Vrui::Application(argc,argv),
 	 remoteServer(0),
 	 camera(0),pixelDepthCorrection(0),
-	 frameFilter(0),pauseUpdates(false),
-	 depthImageRenderer(0),
-	 waterTable(0),
-	 handExtractor(0),addWaterFunction(0),addWaterFunctionRegistered(false),
+	 framePipeline(0),depthStreamRecorder(0),depthStreamRecorderStage(0),frameFilter(0),gpuTemporalFilter(false),pauseUpdates(false),
+	 depthImageRenderer(0),hillshadeMap(0),
+	 waterTable(0),parameterStore(0),simulationThread(0),numQueuedTickSteps(0),
+	 qualityGovernor(0),waterGridScaling(true),waterSimulationTime(0.0),waterVolumesValid(false),
+	 handExtractor(0),addWaterFunction(0),addWaterFunctionRegistered(false),gridReadback(0),stageTimers(0),
 	 sun(0),
-	 activeDem(0),
+	 activeDem(0),demCache(0),demResolution(1024),
 	 mainMenu(0),pauseUpdatesToggle(0),waterControlDialog(0),
-	 waterSpeedSlider(0),waterMaxStepsSlider(0),frameRateTextField(0),waterAttenuationSlider(0),
-	 controlPipeFd(-1)
+	 waterSpeedSlider(0),waterMaxStepsSlider(0),frameRateTextField(0),qualityLevelTextField(0),waterAttenuationSlider(0),
+	 controlPipeFd(-1),statusPipeFd(-1)
 	{
 	/* Read the sandbox's default configuration parameters: */
 	std::string sandboxConfigFileName=CONFIG_CONFIGDIR;
@@ -603,6 +1086,7 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	Misc::ConfigurationFileSection cfg=sandboxConfigFile.getSection("/SARndbox");
 	unsigned int cameraIndex=cfg.retrieveValue<int>("./cameraIndex",0);
 	std::string cameraConfiguration=cfg.retrieveString("./cameraConfiguration","Camera");
+	std::string depthPixelTypeName=cfg.retrieveString("./depthPixelType","Auto");
 	double scale=cfg.retrieveValue<double>("./scaleFactor",100.0);
 	std::string sandboxLayoutFileName=CONFIG_CONFIGDIR;
 	sandboxLayoutFileName.push_back('/');
@@ -614,24 +1098,71 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	if(haveHeightMapPlane)
 		heightMapPlane=cfg.retrieveValue<Plane>("./heightMapPlane");
 	unsigned int numAveragingSlots=cfg.retrieveValue<unsigned int>("./numAveragingSlots",30);
+	bool compactAveraging=cfg.retrieveValue<bool>("./compactAveraging",false);
 	unsigned int minNumSamples=cfg.retrieveValue<unsigned int>("./minNumSamples",10);
 	unsigned int maxVariance=cfg.retrieveValue<unsigned int>("./maxVariance",2);
 	float hysteresis=cfg.retrieveValue<float>("./hysteresis",0.1f);
+	bool retainValids=cfg.retrieveValue<bool>("./retainValids",true);
+	float instableValue=cfg.retrieveValue<float>("./instableValue",0.0f);
+	unsigned int motionThreshold=cfg.retrieveValue<unsigned int>("./motionThreshold",0);
+	unsigned int motionNumOutlierFrames=cfg.retrieveValue<unsigned int>("./motionNumOutlierFrames",2);
+	unsigned int motionMinNumSamples=cfg.retrieveValue<unsigned int>("./motionMinNumSamples",3);
+	unsigned int numFilterThreads=cfg.retrieveValue<unsigned int>("./numFilterThreads",1);
+	unsigned int numPipelineThreads=cfg.retrieveValue<unsigned int>("./numPipelineThreads",2);
+	unsigned int handTrackingInterval=cfg.retrieveValue<unsigned int>("./handTrackingInterval",0);
+	unsigned int numHandTrackingThreads=cfg.retrieveValue<unsigned int>("./numHandTrackingThreads",1);
+	bool gpuSpatialFilter=cfg.retrieveValue<bool>("./gpuSpatialFilter",false);
+	gpuTemporalFilter=cfg.retrieveValue<bool>("./gpuTemporalFilter",false);
+	float surfaceLodCellSize=cfg.retrieveValue<float>("./surfaceLodCellSize",0.0f);
+	std::string depthUploadFormatName=cfg.retrieveString("./depthUploadFormat","Float32");
+	float depthUploadRange=cfg.retrieveValue<float>("./depthUploadRange",0.0f);
+	float waterLodCellSize=cfg.retrieveValue<float>("./waterLodCellSize",0.0f);
+	std::string programBinaryDirectory;
+	const char* homeDirectory=getenv("HOME");
+	if(homeDirectory!=0&&homeDirectory[0]!='\0')
+		{
+		programBinaryDirectory=homeDirectory;
+		programBinaryDirectory.append("/.cache/SARndbox/ProgramBinaries");
+		}
+	programBinaryDirectory=cfg.retrieveString("./programBinaryDirectory",programBinaryDirectory);
+	bool stageTiming=cfg.retrieveValue<bool>("./stageTiming",false);
+	std::string stageTraceFileName=cfg.retrieveString("./stageTraceFileName","");
+	Scalar shadowDistance=cfg.retrieveValue<Scalar>("./shadowDistance",20.0);
+	float aoRadius=cfg.retrieveValue<float>("./aoRadius",8.0f);
 	Misc::FixedArray<unsigned int,2> wtSize;
 	wtSize[0]=640;
 	wtSize[1]=480;
 	wtSize=cfg.retrieveValue<Misc::FixedArray<unsigned int,2> >("./waterTableSize",wtSize);
 	waterSpeed=cfg.retrieveValue<double>("./waterSpeed",1.0);
 	waterMaxSteps=cfg.retrieveValue<unsigned int>("./waterMaxSteps",30U);
+	queueWaterSteps=cfg.retrieveValue<bool>("./queueWaterSteps",false);
+	snowStepInterval=cfg.retrieveValue<unsigned int>("./snowStepInterval",1U);
+	snowUpdateInterval=cfg.retrieveValue<double>("./snowUpdateInterval",0.0);
+	bool fuseSnowStep=cfg.retrieveValue<bool>("./fuseSnowStep",true);
+	bool waterComputeShaders=cfg.retrieveValue<bool>("./waterComputeShaders",false);
+	bool waterHalfFloat=cfg.retrieveValue<bool>("./waterHalfFloat",false);
+	bool waterSparseSimulation=cfg.retrieveValue<bool>("./waterSparseSimulation",true);
+	double waterSimulationRate=cfg.retrieveValue<double>("./waterSimulationRate",0.0);
+	double targetFrameRate=cfg.retrieveValue<double>("./targetFrameRate",0.0);
+	waterGridScaling=cfg.retrieveValue<bool>("./waterGridScaling",waterGridScaling);
 	Math::Interval<double> rainElevationRange=cfg.retrieveValue<Math::Interval<double> >("./rainElevationRange",Math::Interval<double>(-1000.0,1000.0));
 	rainStrength=cfg.retrieveValue<GLfloat>("./rainStrength",0.25f);
 	double evaporationRate=cfg.retrieveValue<double>("./evaporationRate",0.0);
 	float demDistScale=cfg.retrieveValue<float>("./demDistScale",1.0f);
+	unsigned int demCacheSize=cfg.retrieveValue<unsigned int>("./demCacheSize",256);
+	demResolution=cfg.retrieveValue<unsigned int>("./demResolution",demResolution);
+	std::vector<std::string> preloadDems=cfg.retrieveValue<std::vector<std::string> >("./preloadDems",std::vector<std::string>());
+	unsigned int colorMapCacheSize=cfg.retrieveValue<unsigned int>("./colorMapCacheSize",16);
+	std::vector<std::string> preloadColorMaps=cfg.retrieveValue<std::vector<std::string> >("./preloadColorMaps",std::vector<std::string>());
 	std::string controlPipeName=cfg.retrieveString("./controlPipeName","");
+	statusPipeName=cfg.retrieveString("./statusPipeName","");
 	
 	/* Process command line parameters: */
 	bool printHelp=false;
 	const char* frameFilePrefix=0;
+	const char* replayFileName=0;
+	bool replayMaxSpeed=false;
+	const char* recordFileName=0;
 	const char* kinectServerName=0;
 	bool useRemoteServer=false;
 	int remoteServerPortId=26000;
@@ -664,6 +1195,18 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				frameFilePrefix=argv[i];
 				}
+			else if(strcasecmp(argv[i]+1,"replay")==0)
+				{
+				++i;
+				replayFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"replayMaxSpeed")==0)
+				replayMaxSpeed=true;
+			else if(strcasecmp(argv[i]+1,"record")==0)
+				{
+				++i;
+				recordFileName=argv[i];
+				}
 			else if(strcasecmp(argv[i]+1,"p")==0)
 				{
 				++i;
@@ -705,6 +1248,8 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				numAveragingSlots=atoi(argv[i]);
 				}
+			else if(strcasecmp(argv[i]+1,"cab")==0)
+				compactAveraging=true;
 			else if(strcasecmp(argv[i]+1,"sp")==0)
 				{
 				++i;
@@ -717,6 +1262,58 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				hysteresis=float(atof(argv[i]));
 				}
+			else if(strcasecmp(argv[i]+1,"ma")==0)
+				{
+				++i;
+				motionThreshold=atoi(argv[i]);
+				++i;
+				motionNumOutlierFrames=atoi(argv[i]);
+				++i;
+				motionMinNumSamples=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"nft")==0)
+				{
+				++i;
+				numFilterThreads=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"npt")==0)
+				{
+				++i;
+				numPipelineThreads=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"ht")==0)
+				{
+				++i;
+				handTrackingInterval=atoi(argv[i]);
+				++i;
+				numHandTrackingThreads=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"gsf")==0)
+				gpuSpatialFilter=true;
+			else if(strcasecmp(argv[i]+1,"gtf")==0)
+				gpuTemporalFilter=true;
+			else if(strcasecmp(argv[i]+1,"slod")==0)
+				{
+				++i;
+				surfaceLodCellSize=float(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"wlod")==0)
+				{
+				++i;
+				waterLodCellSize=float(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"pbd")==0)
+				{
+				++i;
+				programBinaryDirectory=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"st")==0)
+				stageTiming=true;
+			else if(strcasecmp(argv[i]+1,"stf")==0)
+				{
+				++i;
+				stageTraceFileName=argv[i];
+				}
 			else if(strcasecmp(argv[i]+1,"wts")==0)
 				{
 				for(int j=0;j<2;++j)
@@ -732,6 +1329,38 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				waterMaxSteps=atoi(argv[i]);
 				}
+			else if(strcasecmp(argv[i]+1,"qws")==0)
+				queueWaterSteps=true;
+			else if(strcasecmp(argv[i]+1,"ssi")==0)
+				{
+				++i;
+				snowStepInterval=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"sui")==0)
+				{
+				++i;
+				snowUpdateInterval=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"nfss")==0)
+				fuseSnowStep=false;
+			else if(strcasecmp(argv[i]+1,"wcs")==0)
+				waterComputeShaders=true;
+			else if(strcasecmp(argv[i]+1,"whf")==0)
+				waterHalfFloat=true;
+			else if(strcasecmp(argv[i]+1,"nsws")==0)
+				waterSparseSimulation=false;
+			else if(strcasecmp(argv[i]+1,"wsr")==0)
+				{
+				++i;
+				waterSimulationRate=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"tfr")==0)
+				{
+				++i;
+				targetFrameRate=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"nwgs")==0)
+				waterGridScaling=false;
 			else if(strcasecmp(argv[i]+1,"rer")==0)
 				{
 				++i;
@@ -830,6 +1459,11 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				controlPipeName=argv[i];
 				}
+			else if(strcasecmp(argv[i]+1,"statusPipe")==0)
+				{
+				++i;
+				statusPipeName=argv[i];
+				}
 			else
 				std::cerr<<"Ignoring unrecognized command line switch "<<argv[i]<<std::endl;
 			}
@@ -839,7 +1473,17 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	if(printHelp)
 		printUsage();
 	
-	if(frameFilePrefix!=0)
+	FrameFilter::DepthPixelType depthPixelType=FrameFilter::RAW_DEPTH; // Pre-recorded files and remote servers stream first-generation Kinect raw depth
+	DepthStreamSource* replaySource=0;
+	if(replayFileName!=0)
+		{
+		/* Replay raw depth frames and their camera and sandbox metadata from a depth stream file: */
+		replaySource=new DepthStreamSource(replayFileName);
+		replaySource->setMaxSpeed(replayMaxSpeed);
+		depthPixelType=replaySource->getDepthPixelType();
+		camera=replaySource;
+		}
+	else if(frameFilePrefix!=0)
 		{
 		/* Open the selected pre-recorded 3D video files: */
 		std::string colorFileName=frameFilePrefix;
@@ -883,13 +1527,41 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		Misc::ConfigurationFileSection cameraConfigurationSection=cfg.getSection(cameraConfiguration.c_str());
 		realCamera->configure(cameraConfigurationSection);
 		camera=realCamera;
+		
+		/* Only first-generation Kinect cameras deliver 11-bit raw disparity values: */
+		if(dynamic_cast<Kinect::Camera*>(realCamera)==0)
+			depthPixelType=FrameFilter::UINT16_DEPTH;
+		}
+	
+	/* Override the camera's depth pixel type if requested: */
+	if(strcasecmp(depthPixelTypeName.c_str(),"Raw")==0)
+		depthPixelType=FrameFilter::RAW_DEPTH;
+	else if(strcasecmp(depthPixelTypeName.c_str(),"UInt16")==0)
+		depthPixelType=FrameFilter::UINT16_DEPTH;
+	else if(strcasecmp(depthPixelTypeName.c_str(),"Float")==0)
+		depthPixelType=FrameFilter::FLOAT_DEPTH;
+	else if(strcasecmp(depthPixelTypeName.c_str(),"Auto")!=0)
+		Misc::throwStdErr("Sandbox: Unknown depth pixel type %s",depthPixelTypeName.c_str());
+	if(gpuTemporalFilter&&depthPixelType==FrameFilter::FLOAT_DEPTH)
+		{
+		/* The GPU temporal filter only handles 16-bit raw depth frames: */
+		std::cerr<<"Sandbox: GPU temporal filter does not support floating-point depth frames; filtering in a background thread instead"<<std::endl;
+		gpuTemporalFilter=false;
 		}
 	for(int i=0;i<2;++i)
 		frameSize[i]=camera->getActualFrameSize(Kinect::FrameSource::DEPTH)[i];
 	
 	/* Get the camera's per-pixel depth correction parameters and evaluate it on the depth frame's pixel grid: */
 	Kinect::FrameSource::DepthCorrection* depthCorrection=camera->getDepthCorrectionParameters();
-	if(depthCorrection!=0)
+	if(replaySource!=0)
+		{
+		/* Copy the recorded per-pixel depth correction parameters: */
+		pixelDepthCorrection=new PixelDepthCorrection[frameSize[1]*frameSize[0]];
+		const PixelDepthCorrection* rpdcPtr=replaySource->getPixelDepthCorrection();
+		for(unsigned int i=0;i<frameSize[1]*frameSize[0];++i)
+			pixelDepthCorrection[i]=rpdcPtr[i];
+		}
+	else if(depthCorrection!=0)
 		{
 		pixelDepthCorrection=depthCorrection->getPixelCorrection(frameSize);
 		delete depthCorrection;
@@ -922,6 +1594,10 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	basePlane=Misc::ValueCoder<Geometry::Plane<double,3> >::decode(s.c_str(),s.c_str()+s.length());
 	basePlane.normalize();
 	
+	/* Use the base plane against which a replayed depth stream was recorded: */
+	if(replaySource!=0)
+		basePlane=replaySource->getBasePlane();
+	
 	/* Read the corners of the base quadrilateral and project them into the base plane: */
 	for(int i=0;i<4;++i)
 		{
@@ -931,6 +1607,12 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		}
 	}
 	
+	if(recordFileName!=0)
+		{
+		/* Create a recorder saving raw depth frames with the unscaled camera and sandbox metadata: */
+		depthStreamRecorder=new DepthStreamRecorder(recordFileName,frameSize,depthPixelType,cameraIps,basePlane,pixelDepthCorrection);
+		}
+	
 	/* Limit the valid elevation range to the intersection of the extents of all height color maps: */
 	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
 		if(rsIt->elevationColorMap!=0)
@@ -955,7 +1637,7 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
 		{
 		if(rsIt->elevationColorMap!=0)
-			rsIt->elevationColorMap->setScalarRange(rsIt->elevationColorMap->getScalarRangeMin()*sf,rsIt->elevationColorMap->getScalarRangeMax()*sf);
+			rsIt->elevationColorMap->setScalarRangeScale(sf);
 		rsIt->contourLineSpacing*=sf;
 		rsIt->waterOpacity/=sf;
 		for(int i=0;i<4;++i)
@@ -965,27 +1647,109 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	evaporationRate*=sf;
 	demDistScale*=sf;
 	
-	/* Create the frame filter object: */
-	frameFilter=new FrameFilter(frameSize,numAveragingSlots,pixelDepthCorrection,cameraIps.depthProjection,basePlane);
-	frameFilter->setValidElevationInterval(cameraIps.depthProjection,basePlane,elevationRange.getMin(),elevationRange.getMax());
-	frameFilter->setStableParameters(minNumSamples,maxVariance);
-	frameFilter->setHysteresis(hysteresis);
-	frameFilter->setSpatialFilter(true);
-	frameFilter->setOutputFrameFunction(Misc::createFunctionCall(this,&Sandbox::receiveFilteredFrame));
+	if(stageTiming||!stageTraceFileName.empty()||queueWaterSteps)
+		{
+		/* Create the stage timer set; the quality governor needs it to measure the GPU cost of queued water steps: */
+		stageTimers=new StageTimers;
+		if(!stageTraceFileName.empty())
+			{
+			try
+				{
+				stageTimers->openTraceFile(stageTraceFileName.c_str());
+				}
+			catch(const std::runtime_error& err)
+				{
+				Misc::formattedConsoleWarning("Sandbox: Unable to write stage trace file %s due to exception %s",stageTraceFileName.c_str(),err.what());
+				}
+			}
+		}
+	
+	if(!gpuTemporalFilter)
+		{
+		/* Create the frame filter object: */
+		frameFilter=new FrameFilter(frameSize,numAveragingSlots,compactAveraging,pixelDepthCorrection,cameraIps.depthProjection,basePlane);
+		frameFilter->setDepthPixelType(depthPixelType);
+		frameFilter->setValidElevationInterval(cameraIps.depthProjection,basePlane,elevationRange.getMin(),elevationRange.getMax());
+		frameFilter->setStableParameters(minNumSamples,maxVariance);
+		frameFilter->setHysteresis(hysteresis);
+		frameFilter->setRetainValids(retainValids);
+		frameFilter->setInstableValue(instableValue);
+		if(motionThreshold>0U&&(motionNumOutlierFrames<1U||motionNumOutlierFrames>127U))
+			std::cerr<<"Sandbox: Clamping number of motion outlier frames "<<motionNumOutlierFrames<<" to the range 1 to 127"<<std::endl;
+		frameFilter->setMotionAdaptation(motionThreshold,motionNumOutlierFrames,motionMinNumSamples);
+		frameFilter->setSpatialFilter(!gpuSpatialFilter);
+		frameFilter->setNumFilterThreads(numFilterThreads);
+		frameFilter->setOutputFrameFunction(Misc::createFunctionCall(this,&Sandbox::receiveFilteredFrame));
+		frameFilter->setStageTimers(stageTimers);
+		}
 	
 	if(waterSpeed>0.0)
 		{
 		/* Create the hand extractor object: */
 		handExtractor=new HandExtractor(frameSize,pixelDepthCorrection,cameraIps.depthProjection);
+		handExtractor->setTracking(handTrackingInterval,2.0f,16);
+		handExtractor->setNumTrackingThreads(numHandTrackingThreads);
+		handExtractor->setStageTimers(stageTimers);
+		}
+	
+	if(depthStreamRecorder!=0||frameFilter!=0||handExtractor!=0)
+		{
+		/* Create the frame pipeline and register the frame consumers as its stages: */
+		framePipeline=new FramePipeline(numPipelineThreads);
+		if(depthStreamRecorder!=0)
+			{
+			/* Give the recorder a deep queue so that it records every frame through short disk stalls: */
+			depthStreamRecorderStage=framePipeline->addStage(Misc::createFunctionCall(depthStreamRecorder,&DepthStreamRecorder::receiveRawFrame),60);
+			}
+		if(frameFilter!=0)
+			framePipeline->addStage(Misc::createFunctionCall(this,&Sandbox::filterRawFrame));
+		if(handExtractor!=0)
+			framePipeline->addStage(Misc::createFunctionCall(handExtractor,&HandExtractor::receiveRawFrame));
 		}
 	
 	/* Start streaming depth frames: */
 	camera->startStreaming(0,Misc::createFunctionCall(this,&Sandbox::rawDepthFrameDispatcher));
 	
+	/* Store linked shader programs for subsequent runs: */
+	if(!setProgramBinaryDirectory(programBinaryDirectory.c_str()))
+		Misc::formattedConsoleWarning("Sandbox: Unable to create program binary directory %s; shader programs will not be stored",programBinaryDirectory.c_str());
+	
 	/* Create the depth image renderer: */
 	depthImageRenderer=new DepthImageRenderer(frameSize);
 	depthImageRenderer->setIntrinsics(cameraIps);
 	depthImageRenderer->setBasePlane(basePlane);
+	depthImageRenderer->setSpatialFilter(gpuSpatialFilter||gpuTemporalFilter);
+	depthImageRenderer->setSurfaceLod(surfaceLodCellSize);
+	if(strcasecmp(depthUploadFormatName.c_str(),"Float16")==0)
+		depthImageRenderer->setDepthUploadFormat(DepthImageRenderer::UPLOAD_FLOAT16,0.0f);
+	else if(strcasecmp(depthUploadFormatName.c_str(),"Fixed16")==0)
+		{
+		/* Default the fixed-point range to the range of the camera's depth values: */
+		if(depthUploadRange<=0.0f)
+			depthUploadRange=depthPixelType==FrameFilter::RAW_DEPTH?2048.0f:65535.0f;
+		depthImageRenderer->setDepthUploadFormat(DepthImageRenderer::UPLOAD_FIXED16,depthUploadRange);
+		}
+	else if(strcasecmp(depthUploadFormatName.c_str(),"Float32")!=0)
+		Misc::throwStdErr("Sandbox: Unknown depth upload format %s",depthUploadFormatName.c_str());
+	if(gpuTemporalFilter)
+		{
+		/* Let the depth image renderer filter raw depth frames on the GPU, including the spatial filter the frame filter would have applied: */
+		depthImageRenderer->setTemporalFilter(numAveragingSlots,pixelDepthCorrection);
+		depthImageRenderer->setValidElevationInterval(elevationRange.getMin(),elevationRange.getMax());
+		depthImageRenderer->setStableParameters(minNumSamples,maxVariance);
+		depthImageRenderer->setHysteresis(hysteresis);
+		depthImageRenderer->setRetainValids(retainValids);
+		depthImageRenderer->setInstableValue(instableValue);
+		}
+	
+	/* Create a hillshade map if any window renders shadows: */
+	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
+		if(rsIt->hillshade&&rsIt->useShadows&&hillshadeMap==0)
+			{
+			hillshadeMap=new HillshadeMap(depthImageRenderer);
+			hillshadeMap->setShadowDistance(shadowDistance);
+			hillshadeMap->setAoRadius(aoRadius);
+			}
 	
 	{
 	/* Calculate the transformation from camera space to sandbox space: */
@@ -1010,17 +1774,65 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		bbox.addPoint(basePlaneCorners[i]+basePlane.getNormal()*elevationRange.getMax());
 		}
 	
+	/* Create the DEM cache and preload the configured DEMs: */
+	demCache=new DEMCache(size_t(demCacheSize)*1024*1024);
+	for(std::vector<std::string>::iterator pdIt=preloadDems.begin();pdIt!=preloadDems.end();++pdIt)
+		{
+		try
+			{
+			getCachedDem(pdIt->c_str());
+			}
+		catch(const std::runtime_error& err)
+			{
+			std::cerr<<"Ignoring preloaded DEM "<<*pdIt<<" due to exception "<<err.what()<<std::endl;
+			}
+		}
+	
 	if(waterSpeed>0.0)
 		{
 		/* Initialize the water flow simulator: */
 		waterTable=new WaterTable2(wtSize[0],wtSize[1],depthImageRenderer,basePlaneCorners);
+		for(int i=0;i<2;++i)
+			waterTableSize[i]=wtSize[i];
 		waterTable->setElevationRange(elevationRange.getMin(),rainElevationRange.getMax());
 		waterTable->setWaterDeposit(evaporationRate);
+		waterTable->setSnowStepInterval(snowStepInterval);
+		waterTable->setSnowUpdateInterval(snowUpdateInterval);
+		waterTable->setFuseSnowStep(fuseSnowStep);
+		waterTable->setUseComputeShaders(waterComputeShaders);
+		waterTable->setStorageFormat(waterHalfFloat?WaterTable2::FLOAT16:WaterTable2::FLOAT32);
+		waterTable->setSparseSimulation(waterSparseSimulation);
+		waterTable->setStageTimers(stageTimers);
+		
+		/* Create an object to read back the water table's grids for the remote server and tools: */
+		gridReadback=new GridReadback(waterTable);
 		
 		/* Register a render function with the water table: */
 		addWaterFunction=Misc::createFunctionCall(this,&Sandbox::addWater);
 		waterTable->addRenderFunction(addWaterFunction);
 		addWaterFunctionRegistered=true;
+		
+		if(waterSimulationRate>0.0)
+			{
+			/* Create a water simulation thread; it starts once the first render context exists: */
+			simulationThread=new SimulationThread(depthImageRenderer,waterTable,waterSimulationRate,Misc::createFunctionCall(this,&Sandbox::simulationTick));
+			}
+		}
+	
+	/* Create the store collecting run-time changes to the simulation parameters: */
+	SimulationParameters sp;
+	sp.waterSpeed=waterSpeed;
+	sp.waterMaxSteps=waterMaxSteps;
+	sp.attenuation=waterTable!=0?waterTable->getAttenuation():GLfloat(127)/GLfloat(128);
+	sp.waterDeposit=GLfloat(evaporationRate);
+	sp.criticalHeight=0.0f;
+	sp.meltRate=0.0f;
+	parameterStore=new SimulationParameterStore(sp);
+	
+	if(waterTable!=0)
+		{
+		/* Read the snow parameters from the snow configuration file, and watch it for changes in the background: */
+		parameterStore->watchSnowConfigFile((std::string(CONFIG_CONFIGDIR)+"/snowConfig.cfg").c_str());
 		}
 	
 	if(useRemoteServer)
@@ -1042,6 +1854,20 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		/* Calculate the texture mapping plane for this renderer's height map: */
 		if(rsIt->elevationColorMap!=0)
 			{
+			/* Preload the configured height maps into the renderer's color map texture array: */
+			rsIt->elevationColorMap->setMaxNumCachedMaps(colorMapCacheSize);
+			for(std::vector<std::string>::iterator pcmIt=preloadColorMaps.begin();pcmIt!=preloadColorMaps.end();++pcmIt)
+				{
+				try
+					{
+					rsIt->elevationColorMap->preload(pcmIt->c_str());
+					}
+				catch(const std::runtime_error& err)
+					{
+					std::cerr<<"Ignoring preloaded height map "<<*pcmIt<<" due to exception "<<err.what()<<std::endl;
+					}
+				}
+			
 			if(haveHeightMapPlane)
 				rsIt->elevationColorMap->calcTexturePlane(heightMapPlane);
 			else
@@ -1054,12 +1880,17 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		rsIt->surfaceRenderer->setContourLineDistance(rsIt->contourLineSpacing);
 		rsIt->surfaceRenderer->setElevationColorMap(rsIt->elevationColorMap);
 		rsIt->surfaceRenderer->setIlluminate(rsIt->hillshade);
+		rsIt->surfaceRenderer->setStageTimers(stageTimers);
+		if(rsIt->hillshade&&rsIt->useShadows)
+			rsIt->surfaceRenderer->setHillshadeMap(hillshadeMap);
 		if(waterTable!=0)
 			{
 			if(rsIt->renderWaterSurface)
 				{
 				/* Create a water renderer: */
 				rsIt->waterRenderer=new WaterRenderer(waterTable);
+				rsIt->waterRenderer->setLod(waterLodCellSize);
+				rsIt->waterRenderer->setStageTimers(stageTimers);
 				}
 			else
 				{
@@ -1071,14 +1902,29 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		rsIt->surfaceRenderer->setDemDistScale(demDistScale);
 		}
 	
-	#if 0
-	/* Create a fixed-position light source: */
-	sun=Vrui::getLightsourceManager()->createLightsource(true);
-	for(int i=0;i<Vrui::getNumViewers();++i)
-		Vrui::getViewer(i)->setHeadlightState(false);
-	sun->enable();
-	sun->getLight().position=GLLight::Position(1,0,1,0);
-	#endif
+	if(waterTable!=0)
+		{
+		/* Remote clients and water renderers keep the water grid size they were created for: */
+		if(remoteServer!=0)
+			waterGridScaling=false;
+		for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
+			if(rsIt->waterRenderer!=0)
+				waterGridScaling=false;
+		
+		/* Create a quality governor to hold the target frame rate: */
+		if(targetFrameRate>0.0)
+			setTargetFrameRate(targetFrameRate);
+		}
+	
+	if(hillshadeMap!=0)
+		{
+		/* Create a fixed-position light source to cast the shadows: */
+		sun=Vrui::getLightsourceManager()->createLightsource(true);
+		for(int i=0;i<Vrui::getNumViewers();++i)
+			Vrui::getViewer(i)->setHeadlightState(false);
+		sun->enable();
+		sun->getLight().position=GLLight::Position(1,0,1,0);
+		}
 	
 	/* Create the GUI: */
 	mainMenu=createMainMenu();
@@ -1102,6 +1948,12 @@ Sandbox::Sandbox(int& argc,char**& argv)
 			std::cerr<<"Unable to open control pipe "<<controlPipeName<<"; ignoring"<<std::endl;
 		}
 	
+	if(!statusPipeName.empty())
+		{
+		/* Keep the AR Sandbox running if a reader closes the status pipe while it is being written: */
+		signal(SIGPIPE,SIG_IGN);
+		}
+	
 	/* Inhibit the screen saver: */
 	Vrui::inhibitScreenSaver();
 	
@@ -1111,23 +1963,68 @@ Sandbox::Sandbox(int& argc,char**& argv)
 
 Sandbox::~Sandbox(void)
 	{
+	/* Stop the water simulation thread: */
+	delete simulationThread;
+	
 	/* Stop streaming depth frames: */
 	camera->stopStreaming();
 	delete camera;
+	unsigned int numDroppedRecorderFrames=depthStreamRecorder!=0?framePipeline->getNumDroppedFrames(depthStreamRecorderStage):0;
+	delete framePipeline;
+	if(depthStreamRecorder!=0)
+		{
+		/* Store the number of frames the recorder could not keep up with in the file, and report it: */
+		depthStreamRecorder->writeNumDroppedFrames(numDroppedRecorderFrames);
+		std::cout<<"Recorded "<<depthStreamRecorder->getNumFrames()<<" depth frames";
+		if(numDroppedRecorderFrames>0)
+			std::cout<<", dropped "<<numDroppedRecorderFrames<<" depth frames";
+		std::cout<<std::endl;
+		delete depthStreamRecorder;
+		}
+	if(frameFilter!=0)
+		{
+		/* Report the frame filter's shaping latency distribution if any pixels were reset by motion adaptation: */
+		unsigned int histogram[FrameFilter::numLatencyBins];
+		double frameInterval;
+		frameFilter->getLatencyStatistics(histogram,frameInterval);
+		unsigned int numPixels=0;
+		for(unsigned int i=0;i<FrameFilter::numLatencyBins;++i)
+			numPixels+=histogram[i];
+		if(numPixels>0)
+			{
+			std::cout<<"Shaping latency distribution of "<<numPixels<<" reset pixels at "<<frameInterval*1000.0<<" ms per frame:"<<std::endl;
+			unsigned int cumulative=0;
+			for(unsigned int i=0;i<FrameFilter::numLatencyBins;++i)
+				if(histogram[i]>0)
+					{
+					cumulative+=histogram[i];
+					std::cout<<(i<FrameFilter::numLatencyBins-1?"  ":" >")<<i<<" frames ("<<double(i)*frameInterval*1000.0<<" ms): ";
+					std::cout<<histogram[i]<<" pixels, "<<double(cumulative)*100.0/double(numPixels)<<"% cumulative"<<std::endl;
+					}
+			}
+		}
 	delete frameFilter;
 	
 	/* Delete helper objects: */
+	delete parameterStore;
+	delete qualityGovernor;
 	delete waterTable;
+	delete hillshadeMap;
 	delete depthImageRenderer;
 	delete handExtractor;
 	delete addWaterFunction;
 	delete[] pixelDepthCorrection;
 	delete remoteServer;
+	delete gridReadback;
+	delete stageTimers;
+	delete demCache;
 	
 	delete mainMenu;
 	delete waterControlDialog;
 	
 	close(controlPipeFd);
+	if(statusPipeFd>=0)
+		close(statusPipeFd);
 	}
 
 void Sandbox::toolDestructionCallback(Vrui::ToolManager::ToolDestructionCallbackData* cbData)
@@ -1142,10 +2039,38 @@ void Sandbox::toolDestructionCallback(Vrui::ToolManager::ToolDestructionCallback
 
 namespace {
 
+/**************
+Helper classes:
+**************/
+
+struct CheckpointRequest // Structure describing a simulation checkpoint waiting for its grids to be read back
+	{
+	/* Elements: */
+	public:
+	std::string checkpointFileName; // Name of the checkpoint file to write
+	int gridSize[2]; // Width and height of the water table's grids
+	};
+
 /****************
 Helper functions:
 ****************/
 
+void saveCheckpointCallback(const GLfloat* bathymetry,const GLfloat* quantity,const GLfloat* snow,void* userData)
+	{
+	/* Write the read-back simulation state on the grid read-back's completion thread: */
+	CheckpointRequest* request=static_cast<CheckpointRequest*>(userData);
+	try
+		{
+		SimulationCheckpoint checkpoint(request->gridSize,bathymetry,quantity,snow);
+		checkpoint.save(request->checkpointFileName.c_str());
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"Cannot write simulation checkpoint "<<request->checkpointFileName<<" due to exception "<<err.what()<<std::endl;
+		}
+	delete request;
+	}
+
 std::vector<std::string> tokenizeLine(const char*& buffer)
 	{
 	std::vector<std::string> result;
@@ -1191,21 +2116,55 @@ bool isToken(const std::string& token,const char* pattern)
 
 void Sandbox::frame(void)
 	{
+	/* Apply the most recent run-time changes to the simulation parameters once per frame, unless the simulation thread applies them once per tick: */
+	if(simulationThread==0)
+		applySimulationParameters();
+	
 	/* Call the remote server's frame method: */
 	if(remoteServer!=0)
 		remoteServer->frame(Vrui::getApplicationTime());
 	
+	/* Schedule grid read-backs for all due subscribers: */
+	if(gridReadback!=0)
+		gridReadback->frame(Vrui::getApplicationTime());
+	
 	/* Check if the filtered frame has been updated: */
 	if(filteredFrames.lockNewValue())
 		{
-		/* Update the depth image renderer's depth image: */
-		depthImageRenderer->setDepthImage(filteredFrames.getLockedValue());
+		/* Update the depth image renderer's depth image, and only its changed tiles if the frame filter tracked them: */
+		const FrameFilter::OutputFrame& outputFrame=filteredFrames.getLockedValue();
+		Threads::Mutex::Lock depthImageLock(depthImageMutex);
+		if(outputFrame.frameIndex!=0)
+			depthImageRenderer->setDepthImage(outputFrame.depthImage,outputFrame.tileVersions.getData<unsigned int>(),outputFrame.frameIndex);
+		else
+			depthImageRenderer->setDepthImage(outputFrame.depthImage);
+		}
+	
+	if(sun!=0&&hillshadeMap!=0)
+		{
+		/* Update the hillshade map's sun direction from the sun's physical-space direction; the map only recomputes if it moved: */
+		const GLLight::Position& sunPos=sun->getLight().position;
+		Vrui::Vector sunDir=Vrui::getInverseNavigationTransformation().transform(Vrui::Vector(sunPos[0],sunPos[1],sunPos[2]));
+		hillshadeMap->setSunDirection(Vector(sunDir[0],sunDir[1],sunDir[2]));
 		}
 	
 	if(handExtractor!=0)
 		{
-		/* Lock the most recent extracted hand list: */
-		handExtractor->lockNewExtractedHands();
+		/* Lock the most recent extracted hand list, and hand a copy of it to the simulation if it changed; applying the snapshot re-renders the water sources: */
+		if(handExtractor->lockNewExtractedHands()&&waterTable!=0)
+			{
+			const HandExtractor::HandList& hands=handExtractor->getLockedExtractedHands();
+			std::vector<SimulationParameters::RainDisk> rainDisks;
+			rainDisks.reserve(hands.size());
+			for(HandExtractor::HandList::const_iterator hIt=hands.begin();hIt!=hands.end();++hIt)
+				{
+				SimulationParameters::RainDisk rd;
+				rd.center=hIt->center;
+				rd.radius=Scalar(hIt->radius);
+				rainDisks.push_back(rd);
+				}
+			parameterStore->setRainDisks(rainDisks);
+			}
 		
 		#if 0
 		
@@ -1223,9 +2182,13 @@ void Sandbox::frame(void)
 		#endif
 		}
 	
-	/* Update all surface renderers: */
+	/* Update all surface and water renderers: */
 	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
+		{
 		rsIt->surfaceRenderer->setAnimationTime(Vrui::getApplicationTime());
+		if(rsIt->waterRenderer!=0)
+			rsIt->waterRenderer->frame();
+		}
 	
 	/* Check if there is a control command on the control pipe: */
 	if(controlPipeFd>=0)
@@ -1251,9 +2214,10 @@ void Sandbox::frame(void)
 					{
 					if(tokens.size()==2)
 						{
-						waterSpeed=atof(tokens[1].c_str());
+						double newWaterSpeed=atof(tokens[1].c_str());
+						parameterStore->setWaterSpeed(newWaterSpeed);
 						if(waterSpeedSlider!=0)
-							waterSpeedSlider->setValue(waterSpeed);
+							waterSpeedSlider->setValue(newWaterSpeed);
 						}
 					else
 						std::cerr<<"Wrong number of arguments for waterSpeed control pipe command"<<std::endl;
@@ -1262,20 +2226,66 @@ void Sandbox::frame(void)
 					{
 					if(tokens.size()==2)
 						{
-						waterMaxSteps=atoi(tokens[1].c_str());
+						unsigned int newWaterMaxSteps=atoi(tokens[1].c_str());
+						parameterStore->setWaterMaxSteps(newWaterMaxSteps);
 						if(waterMaxStepsSlider!=0)
-							waterMaxStepsSlider->setValue(waterMaxSteps);
+							waterMaxStepsSlider->setValue(newWaterMaxSteps);
 						}
 					else
 						std::cerr<<"Wrong number of arguments for waterMaxSteps control pipe command"<<std::endl;
 					}
+				else if(isToken(tokens[0],"targetFrameRate"))
+					{
+					if(tokens.size()==2)
+						{
+						if(waterTable!=0)
+							setTargetFrameRate(atof(tokens[1].c_str()));
+						}
+					else
+						std::cerr<<"Wrong number of arguments for targetFrameRate control pipe command"<<std::endl;
+					}
+				else if(isToken(tokens[0],"qualityLevel"))
+					{
+					if(tokens.size()==1)
+						{
+						std::string status="Quality governor: "+getQualityLevelDescription();
+						std::cout<<status<<std::endl;
+						writeStatus(status);
+						}
+					else
+						std::cerr<<"Wrong number of arguments for qualityLevel control pipe command"<<std::endl;
+					}
+				else if(isToken(tokens[0],"remoteClients"))
+					{
+					if(tokens.size()==1)
+						{
+						if(remoteServer!=0)
+							{
+							/* Print the streaming statistics of all remote clients: */
+							const std::vector<RemoteServer::ClientStats>& stats=remoteServer->getClientStats();
+							std::cout<<"Remote server: "<<stats.size()<<" streaming clients"<<std::endl;
+							for(std::vector<RemoteServer::ClientStats>::const_iterator sIt=stats.begin();sIt!=stats.end();++sIt)
+								std::cout<<"  "<<sIt->address<<": "<<sIt->throughput/1024.0<<" KB/s, lag "<<sIt->lag*1000.0<<" ms, "<<sIt->queueLength<<" queued, "<<sIt->framesSent<<" sent, "<<sIt->framesDropped<<" dropped, "<<sIt->bytesSent<<" bytes total"<<std::endl;
+							}
+						else
+							std::cout<<"Remote server: off"<<std::endl;
+						}
+					else
+						std::cerr<<"Wrong number of arguments for remoteClients control pipe command"<<std::endl;
+					}
+				else if(isToken(tokens[0],"stats"))
+					{
+					if(tokens.size()==1)
+						printStageStatistics();
+					else
+						std::cerr<<"Wrong number of arguments for stats control pipe command"<<std::endl;
+					}
 				else if(isToken(tokens[0],"waterAttenuation"))
 					{
 					if(tokens.size()==2)
 						{
 						double attenuation=atof(tokens[1].c_str());
-						if(waterTable!=0)
-							waterTable->setAttenuation(GLfloat(1.0-attenuation));
+						parameterStore->setAttenuation(GLfloat(1.0-attenuation));
 						if(waterAttenuationSlider!=0)
 							waterAttenuationSlider->setValue(attenuation);
 						}
@@ -1301,6 +2311,79 @@ void Sandbox::frame(void)
 					else
 						std::cerr<<"Wrong number of arguments for colorMap control pipe command"<<std::endl;
 					}
+				else if(isToken(tokens[0],"dem"))
+					{
+					if(tokens.size()==2)
+						{
+						if(isToken(tokens[1],"off"))
+							{
+							/* Deactivate the currently active DEM: */
+							if(activeDem!=0)
+								toggleDEM(activeDem);
+							}
+						else
+							{
+							try
+								{
+								/* Activate the cached DEM, loading it on a cache miss: */
+								DEM* dem=getCachedDem(tokens[1].c_str());
+								if(dem!=activeDem)
+									toggleDEM(dem);
+								}
+							catch(const std::runtime_error& err)
+								{
+								std::cerr<<"Cannot read DEM "<<tokens[1]<<" due to exception "<<err.what()<<std::endl;
+								}
+							}
+						}
+					else
+						std::cerr<<"Wrong number of arguments for dem control pipe command"<<std::endl;
+					}
+				else if(isToken(tokens[0],"saveState"))
+					{
+					if(tokens.size()==2)
+						{
+						if(waterTable!=0)
+							{
+							/* Read back the complete simulation state asynchronously, and write it to the checkpoint file once it arrives: */
+							CheckpointRequest* request=new CheckpointRequest;
+							request->checkpointFileName=tokens[1];
+							for(int i=0;i<2;++i)
+								request->gridSize[i]=int(gridReadback->getGridSize()[i]);
+							gridReadback->request(GridReadback::BATHYMETRY|GridReadback::QUANTITY|GridReadback::SNOWSTATE,saveCheckpointCallback,request);
+							}
+						}
+					else
+						std::cerr<<"Wrong number of arguments for saveState control pipe command"<<std::endl;
+					}
+				else if(isToken(tokens[0],"loadState"))
+					{
+					if(tokens.size()==2)
+						{
+						if(waterTable!=0)
+							{
+							try
+								{
+								/* Read the checkpoint file and hand its simulation state to the water table: */
+								SimulationCheckpoint checkpoint;
+								checkpoint.load(tokens[1].c_str());
+								if(checkpoint.getSize()[0]==int(waterTableSize[0])&&checkpoint.getSize()[1]==int(waterTableSize[1]))
+									{
+									GLsizei stateSize[2]={GLsizei(checkpoint.getSize()[0]),GLsizei(checkpoint.getSize()[1])};
+									waterTable->restoreState(stateSize,checkpoint.getBathymetry(),checkpoint.getQuantity(),checkpoint.getSnow());
+									}
+								else
+									std::cerr<<"Simulation checkpoint "<<tokens[1]<<" has size "<<checkpoint.getSize()[0]<<" x "<<checkpoint.getSize()[1]<<" instead of water table size "<<waterTableSize[0]<<" x "<<waterTableSize[1]<<std::endl;
+								}
+							catch(const std::runtime_error& err)
+								{
+								std::cerr<<"Cannot read simulation checkpoint "<<tokens[1]<<" due to exception "<<err.what()<<std::endl;
+								}
+							}
+						}
+					else
+						std::cerr<<"Wrong number of arguments for loadState control pipe command"<<std::endl;
+					}
 				else if(isToken(tokens[0],"heightMapPlane"))
 					{
 					if(tokens.size()==5)
@@ -1424,10 +2507,33 @@ void Sandbox::frame(void)
 			}
 		}
 	
+	if(qualityGovernor!=0)
+		{
+		/* Let the quality governor react to the most recent frame's timings: */
+		updateQualityGovernor();
+		}
+	waterSimulationTime=0.0;
+	
+	/* Finish measuring stage times for the most recent frame: */
+	if(stageTimers!=0)
+		stageTimers->frame(Vrui::getApplicationTime(),Vrui::getCurrentFrameTime());
+	
 	if(frameRateTextField!=0&&Vrui::getWidgetManager()->isVisible(waterControlDialog))
 		{
-		/* Update the frame rate display: */
+		/* Update the frame rate and quality level displays: */
 		frameRateTextField->setValue(1.0/Vrui::getCurrentFrameTime());
+		if(qualityGovernor!=0)
+			qualityLevelTextField->setValue(qualityGovernor->getLevel());
+		else
+			qualityLevelTextField->setString("Off");
+		
+		/* Update the stage time displays: */
+		for(size_t stage=0;stage<stageTimeTextFields.size();++stage)
+			{
+			StageTimers::Statistics stats=stageTimers->getStatistics(StageTimers::Stage(stage));
+			if(stats.numSamples>0)
+				stageTimeTextFields[stage]->setValue(stats.mean*1000.0);
+			}
 		}
 	
 	if(pauseUpdates)
@@ -1450,60 +2556,22 @@ void Sandbox::display(GLContextData& contextData) const
 	/* Check if the water simulation state needs to be updated: */
 	if(waterTable!=0&&dataItem->waterTableTime!=Vrui::getApplicationTime())
 		{
-		/* Retrieve a potential pending grid read-back request: */
-		GridRequest::Request request=gridRequest.getRequest();
-		
-		/* Update the water table's bathymetry grid: */
-		waterTable->updateBathymetry(contextData);
-		
-		/* Check if the grid request is active and wants bathymetry data: */
-		if(request.isActive()&&request.bathymetryBuffer!=0)
+		if(simulationThread!=0&&simulationThread->sharesCurrentContext())
 			{
-			/* Read back the current bathymetry grid: */
-			waterTable->bindBathymetryTexture(contextData);
-			glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,request.bathymetryBuffer);
-			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			/* Pick up the most recent state completed by the simulation thread: */
+			waterTable->lockNewPublishedState(contextData);
 			}
-		
-		/* Run the water flow simulation's main pass: */
-		GLfloat totalTimeStep=GLfloat(Vrui::getFrameTime()*waterSpeed);
-		unsigned int numSteps=0;
-		while(numSteps<waterMaxSteps-1U&&totalTimeStep>1.0e-8f)
+		else
 			{
-			/* Run with a self-determined time step to maintain stability: */
-			waterTable->setMaxStepSize(totalTimeStep);
-			GLfloat timeStep=waterTable->runSimulationStep(false,contextData);
-			totalTimeStep-=timeStep;
-			++numSteps;
-			}
-		#if 0
-		if(totalTimeStep>1.0e-8f)
+			/* Run the water simulation in this context for the duration of the frame, and measure its cost for the quality governor; this only happens without a simulation thread: */
+			double simulationStart=getMonotonicTime();
 			{
-			std::cout<<'.'<<std::flush;
-			/* Force the final step to avoid simulation slow-down: */
-			waterTable->setMaxStepSize(totalTimeStep);
-			GLfloat timeStep=waterTable->runSimulationStep(true,contextData);
-			totalTimeStep-=timeStep;
-			++numSteps;
+			StageTimers::GPUSpanTimer simulationTimer(stageTimers,StageTimers::SIMULATION,contextData);
+			runWaterSimulation(GLfloat(Vrui::getFrameTime()*waterSpeed),dataItem->numQueuedWaterSteps,contextData);
 			}
-		#else
-		if(totalTimeStep>1.0e-8f)
-			std::cout<<"Ran out of time by "<<totalTimeStep<<std::endl;
-		#endif
-		
-		/* Check if the grid request is active and wants water level data: */
-		if(request.isActive()&&request.waterLevelBuffer!=0)
-			{
-			/* Read back the current water level grid: */
-			waterTable->bindQuantityTexture(contextData);
-			glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,request.waterLevelBuffer);
-			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			waterSimulationTime+=getMonotonicTime()-simulationStart;
 			}
 		
-		/* Finish an active grid request: */
-		if(request.isActive())
-			request.complete();
-		
 		/* Mark the water simulation state as up-to-date for this frame: */
 		dataItem->waterTableTime=Vrui::getApplicationTime();
 		}
@@ -1525,176 +2593,8 @@ void Sandbox::display(GLContextData& contextData) const
 		glMaterial(GLMaterialEnums::FRONT,rs.surfaceMaterial);
 		}
 	
-	#if 0
-	if(rs.hillshade&&rs.useShadows)
-		{
-		/* Set up OpenGL state: */
-		glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_ENABLE_BIT|GL_POLYGON_BIT);
-		
-		GLLightTracker& lt=*contextData.getLightTracker();
-		
-		/* Save the currently-bound frame buffer and viewport: */
-		GLint currentFrameBuffer;
-		glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
-		GLint currentViewport[4];
-		glGetIntegerv(GL_VIEWPORT,currentViewport);
-		
-		/*******************************************************************
-		First rendering pass: Global ambient illumination only
-		*******************************************************************/
-		
-		/* Draw the surface mesh: */
-		surfaceRenderer->glRenderGlobalAmbientHeightMap(dataItem->heightColorMapObject,contextData);
-		
-		/*******************************************************************
-		Second rendering pass: Add local illumination for every light source
-		*******************************************************************/
-		
-		/* Enable additive rendering: */
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_ONE,GL_ONE);
-		glDepthFunc(GL_LEQUAL);
-		glDepthMask(GL_FALSE);
-		
-		for(int lightSourceIndex=0;lightSourceIndex<lt.getMaxNumLights();++lightSourceIndex)
-			if(lt.getLightState(lightSourceIndex).isEnabled())
-				{
-				/***************************************************************
-				First step: Render to the light source's shadow map
-				***************************************************************/
-				
-				/* Set up OpenGL state to render to the shadow map: */
-				glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->shadowFramebufferObject);
-				glViewport(0,0,dataItem->shadowBufferSize[0],dataItem->shadowBufferSize[1]);
-				glDepthMask(GL_TRUE);
-				glClear(GL_DEPTH_BUFFER_BIT);
-				glCullFace(GL_FRONT);
-				
-				/*************************************************************
-				Calculate the shadow projection matrix:
-				*************************************************************/
-				
-				/* Get the light source position in eye space: */
-				Geometry::HVector<float,3> lightPosEc;
-				glGetLightfv(GL_LIGHT0+lightSourceIndex,GL_POSITION,lightPosEc.getComponents());
-				
-				/* Transform the light source position to camera space: */
-				Vrui::ONTransform::HVector lightPosCc=Vrui::getDisplayState(contextData).modelviewNavigational.inverseTransform(Vrui::ONTransform::HVector(lightPosEc));
-				
-				/* Calculate the direction vector from the center of the bounding box to the light source: */
-				Point bboxCenter=Geometry::mid(bbox.min,bbox.max);
-				Vrui::Vector lightDirCc=Vrui::Vector(lightPosCc.getComponents())-Vrui::Vector(bboxCenter.getComponents())*lightPosCc[3];
-				
-				/* Build a transformation that aligns the light direction with the positive z axis: */
-				Vrui::ONTransform shadowModelview=Vrui::ONTransform::rotate(Vrui::Rotation::rotateFromTo(lightDirCc,Vrui::Vector(0,0,1)));
-				shadowModelview*=Vrui::ONTransform::translateToOriginFrom(bboxCenter);
-				
-				/* Create a projection matrix, based on whether the light is positional or directional: */
-				PTransform shadowProjection(0.0);
-				if(lightPosEc[3]!=0.0f)
-					{
-					/* Modify the modelview transformation such that the light source is at the origin: */
-					shadowModelview.leftMultiply(Vrui::ONTransform::translate(Vrui::Vector(0,0,-lightDirCc.mag())));
-					
-					/***********************************************************
-					Create a perspective projection:
-					***********************************************************/
-					
-					/* Calculate the perspective bounding box of the surface bounding box in eye space: */
-					Box pBox=Box::empty;
-					for(int i=0;i<8;++i)
-						{
-						Point bc=shadowModelview.transform(bbox.getVertex(i));
-						pBox.addPoint(Point(-bc[0]/bc[2],-bc[1]/bc[2],-bc[2]));
-						}
-					
-					/* Upload the frustum matrix: */
-					double l=pBox.min[0]*pBox.min[2];
-					double r=pBox.max[0]*pBox.min[2];
-					double b=pBox.min[1]*pBox.min[2];
-					double t=pBox.max[1]*pBox.min[2];
-					double n=pBox.min[2];
-					double f=pBox.max[2];
-					shadowProjection.getMatrix()(0,0)=2.0*n/(r-l);
-					shadowProjection.getMatrix()(0,2)=(r+l)/(r-l);
-					shadowProjection.getMatrix()(1,1)=2.0*n/(t-b);
-					shadowProjection.getMatrix()(1,2)=(t+b)/(t-b);
-					shadowProjection.getMatrix()(2,2)=-(f+n)/(f-n);
-					shadowProjection.getMatrix()(2,3)=-2.0*f*n/(f-n);
-					shadowProjection.getMatrix()(3,2)=-1.0;
-					}
-				else
-					{
-					/***********************************************************
-					Create a perspective projection:
-					***********************************************************/
-					
-					/* Transform the bounding box with the modelview transformation: */
-					Box bboxEc=bbox;
-					bboxEc.transform(shadowModelview);
-					
-					/* Upload the ortho matrix: */
-					double l=bboxEc.min[0];
-					double r=bboxEc.max[0];
-					double b=bboxEc.min[1];
-					double t=bboxEc.max[1];
-					double n=-bboxEc.max[2];
-					double f=-bboxEc.min[2];
-					shadowProjection.getMatrix()(0,0)=2.0/(r-l);
-					shadowProjection.getMatrix()(0,3)=-(r+l)/(r-l);
-					shadowProjection.getMatrix()(1,1)=2.0/(t-b);
-					shadowProjection.getMatrix()(1,3)=-(t+b)/(t-b);
-					shadowProjection.getMatrix()(2,2)=-2.0/(f-n);
-					shadowProjection.getMatrix()(2,3)=-(f+n)/(f-n);
-					shadowProjection.getMatrix()(3,3)=1.0;
-					}
-				
-				/* Multiply the shadow modelview matrix onto the shadow projection matrix: */
-				shadowProjection*=shadowModelview;
-				
-				/* Draw the surface into the shadow buffer: */
-				surfaceRenderer->glRenderDepthOnly(shadowProjection,contextData);
-				
-				/* Reset OpenGL state: */
-				glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
-				glViewport(currentViewport[0],currentViewport[1],currentViewport[2],currentViewport[3]);
-				glCullFace(GL_BACK);
-				glDepthMask(GL_FALSE);
-				
-				#if SAVEDEPTH
-				/* Save the depth image: */
-				{
-				glBindTexture(GL_TEXTURE_2D,dataItem->shadowDepthTextureObject);
-				GLfloat* depthTextureImage=new GLfloat[dataItem->shadowBufferSize[1]*dataItem->shadowBufferSize[0]];
-				glGetTexImage(GL_TEXTURE_2D,0,GL_DEPTH_COMPONENT,GL_FLOAT,depthTextureImage);
-				glBindTexture(GL_TEXTURE_2D,0);
-				Images::RGBImage dti(dataItem->shadowBufferSize[0],dataItem->shadowBufferSize[1]);
-				GLfloat* dtiPtr=depthTextureImage;
-				Images::RGBImage::Color* ciPtr=dti.modifyPixels();
-				for(int y=0;y<dataItem->shadowBufferSize[1];++y)
-					for(int x=0;x<dataItem->shadowBufferSize[0];++x,++dtiPtr,++ciPtr)
-						{
-						GLColor<GLfloat,3> tc(*dtiPtr,*dtiPtr,*dtiPtr);
-						*ciPtr=tc;
-						}
-				delete[] depthTextureImage;
-				Images::writeImageFile(dti,"DepthImage.png");
-				}
-				#endif
-				
-				/* Draw the surface using the shadow texture: */
-				rs.surfaceRenderer->glRenderShadowedIlluminatedHeightMap(dataItem->heightColorMapObject,dataItem->shadowDepthTextureObject,shadowProjection,contextData);
-				}
-		
-		/* Reset OpenGL state: */
-		glPopAttrib();
-		}
-	else
-	#endif
-		{
-		/* Render the surface in a single pass: */
-		rs.surfaceRenderer->renderSinglePass(ds.viewport,projection,ds.modelviewNavigational,contextData);
-		}
+	/* Render the surface in a single pass, including shadows if a hillshade map is attached: */
+	rs.surfaceRenderer->renderSinglePass(ds.viewport,projection,ds.modelviewNavigational,contextData);
 	
 	if(rs.waterRenderer!=0)
 		{
@@ -1759,38 +2659,25 @@ void Sandbox::initContext(GLContextData& contextData) const
 	DataItem* dataItem=new DataItem;
 	contextData.addDataItem(this,dataItem);
 	
-	{
-	/* Save the currently bound frame buffer: */
-	GLint currentFrameBuffer;
-	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
-	
-	/* Set the default shadow buffer size: */
-	dataItem->shadowBufferSize[0]=1024;
-	dataItem->shadowBufferSize[1]=1024;
-	
-	/* Generate the shadow rendering frame buffer: */
-	glGenFramebuffersEXT(1,&dataItem->shadowFramebufferObject);
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->shadowFramebufferObject);
-	
-	/* Generate a depth texture for shadow rendering: */
-	glGenTextures(1,&dataItem->shadowDepthTextureObject);
-	glBindTexture(GL_TEXTURE_2D,dataItem->shadowDepthTextureObject);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_COMPARE_MODE_ARB,GL_COMPARE_R_TO_TEXTURE);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_COMPARE_FUNC_ARB,GL_LEQUAL);
-	glTexParameteri(GL_TEXTURE_2D,GL_DEPTH_TEXTURE_MODE_ARB,GL_INTENSITY);
-	glTexImage2D(GL_TEXTURE_2D,0,GL_DEPTH_COMPONENT24_ARB,dataItem->shadowBufferSize[0],dataItem->shadowBufferSize[1],0,GL_DEPTH_COMPONENT,GL_UNSIGNED_BYTE,0);
-	glBindTexture(GL_TEXTURE_2D,0);
-	
-	/* Attach the depth texture to the frame buffer object: */
-	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_DEPTH_ATTACHMENT_EXT,GL_TEXTURE_2D,dataItem->shadowDepthTextureObject,0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
-	} 
+	if(simulationThread!=0&&!simulationThread->isRunning())
+		{
+		/* Start the water simulation thread with an OpenGL context sharing objects with the first render context: */
+		try
+			{
+			simulationThread->start();
+			}
+		catch(const std::runtime_error& err)
+			{
+			std::cerr<<"Running water simulation in the render contexts due to exception "<<err.what()<<std::endl;
+			delete simulationThread;
+			simulationThread=0;
+			}
+		}
+	else if(simulationThread!=0&&!simulationThread->sharesCurrentContext())
+		{
+		/* Reject render contexts that cannot bind the simulation thread's published state, which would otherwise have to run a second simulation: */
+		throw std::runtime_error("Sandbox: The background water simulation requires all windows to share one OpenGL context; disable it or open all windows on the same display");
+		}
 	}
 
 VRUI_APPLICATION_RUN(Sandbox)
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef SANDBOX_INCLUDED
 #define SANDBOX_INCLUDED
 
+#include <string>
 #include <Threads/Mutex.h>
 #include <Threads/TripleBuffer.h>
 #include <Geometry/Box.h>
@@ -44,6 +45,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Kinect/FrameSource.h>
 
 #include "Types.h"
+#include "FrameFilter.h"
 
 /* Forward declarations: */
 namespace Misc {
@@ -62,16 +64,24 @@ class Lightsource;
 namespace Kinect {
 class Camera;
 }
-class FrameFilter;
+class FramePipeline;
+class SimulationParameterStore;
+class DepthStreamRecorder;
 class DepthImageRenderer;
+class HillshadeMap;
 class ElevationColorMap;
 class DEM;
+class DEMCache;
 class SurfaceRenderer;
 class WaterTable2;
+class SimulationThread;
+class GridReadback;
+class QualityGovernor;
 class HandExtractor;
 typedef Misc::FunctionCall<GLContextData&> AddWaterFunction;
 class RemoteServer;
 class WaterRenderer;
+class StageTimers;
 
 class Sandbox:public Vrui::Application,public GLObject
 	{
@@ -86,80 +96,13 @@ class Sandbox:public Vrui::Application,public GLObject
 		/* Elements: */
 		public:
 		double waterTableTime; // Simulation time stamp of the water table in this OpenGL context
-		GLsizei shadowBufferSize[2]; // Size of the shadow rendering frame buffer
-		GLuint shadowFramebufferObject; // Frame buffer object to render shadow maps
-		GLuint shadowDepthTextureObject; // Depth texture for the shadow rendering frame buffer
+		unsigned int numQueuedWaterSteps; // Number of water simulation steps to queue in the next frame if water steps are queued asynchronously
 		
 		/* Constructors and destructors: */
 		DataItem(void);
 		virtual ~DataItem(void);
 		};
 	
-	struct GridRequest // Structure representing a request to read back bathymetry and/or water level grids from the GPU
-		{
-		/* Embedded classes: */
-		public:
-		typedef void (*CallbackFunction)(GLfloat*,GLfloat*,void*); // Type for callback functions
-		
-		struct Request // Structure holding a request's parameters
-			{
-			/* Elements: */
-			public:
-			GLfloat* bathymetryBuffer; // Pointer to a buffer to hold the requested bathymetry grid if requested
-			GLfloat* waterLevelBuffer; // Pointer to a buffer to hold the requested water level grid if requested
-			CallbackFunction callback; // Function to call when the grid(s) has/have been read back
-			void* callbackData; // Additional data element to pass to callback function
-			
-			/* Constructors and destructors: */
-			Request(void) // Creates an inactive request
-				:bathymetryBuffer(0),waterLevelBuffer(0),callback(0),callbackData(0)
-				{
-				}
-			
-			/* Methods: */
-			bool isActive(void) const // Returns true if there is a pending request
-				{
-				return callback!=0;
-				}
-			void complete(void) // Calls the read-back callback
-				{
-				(*callback)(bathymetryBuffer,waterLevelBuffer,callbackData);
-				}
-			};
-		
-		/* Elements: */
-		Threads::Mutex mutex; // Mutex serializing access to the request structure
-		Request currentRequest; // The currently pending grid request
-		
-		/* Constructors and destructors: */
-		GridRequest(void) // Creates an inactive grid request
-			{
-			}
-		
-		/* Methods: */
-		bool requestGrids(GLfloat* newBathymetryBuffer,GLfloat* newWaterLevelBuffer,CallbackFunction newCallback,void* newCallbackData) // Requests a grid read-back; returns true if request has been granted
-			{
-			Threads::Mutex::Lock lock(mutex);
-			if(currentRequest.callback==0)
-				{
-				currentRequest.bathymetryBuffer=newBathymetryBuffer;
-				currentRequest.waterLevelBuffer=newWaterLevelBuffer;
-				currentRequest.callback=newCallback;
-				currentRequest.callbackData=newCallbackData;
-				return true;
-				}
-			else
-				return false;
-			}
-		Request getRequest(void) // Returns the current grid request and deactivates it
-			{
-			Threads::Mutex::Lock lock(mutex);
-			Request result=currentRequest;
-			currentRequest.callback=0;
-			return result;
-			}
-		};
-	
 	struct RenderSettings // Structure to hold per-window rendering settings
 		{
 		/* Elements: */
@@ -201,38 +144,76 @@ class Sandbox:public Vrui::Application,public GLObject
 	unsigned int frameSize[2]; // Width and height of the camera's depth frames
 	PixelDepthCorrection* pixelDepthCorrection; // Buffer of per-pixel depth correction coefficients
 	Kinect::FrameSource::IntrinsicParameters cameraIps; // Intrinsic parameters of the Kinect camera
+	FramePipeline* framePipeline; // Pipeline sharing raw depth frames from the Kinect camera with the frame filter and hand extractor on a common pool of worker threads
+	DepthStreamRecorder* depthStreamRecorder; // Optional recorder saving raw depth frames from the Kinect camera to a depth stream file
+	unsigned int depthStreamRecorderStage; // Index of the depth stream recorder's stage in the frame pipeline
 	FrameFilter* frameFilter; // Processing object to filter raw depth frames from the Kinect camera
+	bool gpuTemporalFilter; // Flag whether raw depth frames are filtered by the depth image renderer on the GPU instead of by the frame filter
 	bool pauseUpdates; // Pauses updates of the topography
-	Threads::TripleBuffer<Kinect::FrameBuffer> filteredFrames; // Triple buffer for incoming filtered depth frames
+	Threads::TripleBuffer<FrameFilter::OutputFrame> filteredFrames; // Triple buffer for incoming filtered depth frames, or raw depth frames with a frame index of zero if gpuTemporalFilter is true
 	DepthImageRenderer* depthImageRenderer; // Object managing the current filtered depth image
+	HillshadeMap* hillshadeMap; // Cached sun visibility and ambient occlusion map for shadowed hill shading, or null if no window uses shadows
+	mutable Threads::Mutex depthImageMutex; // Mutex serializing depth image updates against bathymetry updates on the simulation thread
 	ONTransform boxTransform; // Transformation from camera space to baseplane space (x along long sandbox axis, z up)
 	Scalar boxSize; // Radius of sphere around sandbox area
 	Box bbox; // Bounding box around all potential surfaces
 	WaterTable2* waterTable; // Water flow simulation object
+	unsigned int waterTableSize[2]; // Full width and height of the water table in pixels
 	double waterSpeed; // Relative speed of water flow simulation
 	unsigned int waterMaxSteps; // Maximum number of water simulation steps per frame
+	SimulationParameterStore* parameterStore; // Store collecting run-time simulation parameter changes from the GUI, the control pipe, and the snow configuration file
+	bool queueWaterSteps; // Flag whether to queue all water simulation steps of a frame on the GPU without reading back each step size
+	mutable SimulationThread* simulationThread; // Background thread running the water flow simulation at a fixed rate in its own OpenGL context, or null if the simulation runs in the render contexts
+	unsigned int numQueuedTickSteps; // Number of water simulation steps to queue in the next tick of the simulation thread if water steps are queued asynchronously
+	unsigned int snowStepInterval; // Requested number of integration steps between snow updates
+	double snowUpdateInterval; // Requested wall-clock time between snow updates, or zero to follow the step interval
+	QualityGovernor* qualityGovernor; // Governor trading water simulation quality for speed to hold a target frame rate, or null if disabled
+	bool waterGridScaling; // Flag whether the quality governor may reduce the water grid resolution
+	mutable double waterSimulationTime; // Wall-clock time spent in the water simulation during the most recent frame in seconds; only measures submission if water steps are queued
+	mutable Threads::Mutex waterVolumesMutex; // Mutex protecting the most recently reduced water volumes, which are written by the simulation thread if it exists
+	mutable bool waterVolumesValid; // Flag whether the water volumes below have been read back at least once
+	mutable GLfloat waterVolumes[3]; // Most recently reduced total snowpack, melt water released by the last snow update, and free water volumes in cubic centimeters
 	GLfloat rainStrength; // Amount of water deposited by rain tools and objects on each water simulation step
 	HandExtractor* handExtractor; // Object to detect splayed hands above the sand surface to make rain
 	const AddWaterFunction* addWaterFunction; // Render function registered with the water table
 	bool addWaterFunctionRegistered; // Flag if the water adding function is currently registered with the water table
-	mutable GridRequest gridRequest; // Structure holding pending grid read-back requests
+	GridReadback* gridReadback; // Object reading back bathymetry and water level grids from the GPU for the remote server and tools
+	StageTimers* stageTimers; // Timer set measuring the water simulation, rendering, and input processing stages, or null if stage timing is disabled
 	std::vector<RenderSettings> renderSettings; // List of per-window rendering settings
 	Vrui::Lightsource* sun; // An external fixed light source
 	DEM* activeDem; // The currently active DEM
+	DEMCache* demCache; // Cache of preloaded DEMs to switch between through the control pipe
+	unsigned int demResolution; // Number of samples required along the longer side of the sandbox footprint for cached DEMs loaded from tiled DEM files
 	GLMotif::PopupMenu* mainMenu;
 	GLMotif::ToggleButton* pauseUpdatesToggle;
 	GLMotif::PopupWindow* waterControlDialog;
 	GLMotif::TextFieldSlider* waterSpeedSlider;
 	GLMotif::TextFieldSlider* waterMaxStepsSlider;
 	GLMotif::TextField* frameRateTextField;
+	GLMotif::TextField* qualityLevelTextField;
+	std::vector<GLMotif::TextField*> stageTimeTextFields; // Text fields showing the mean time of each measured pipeline stage, or empty if stage timing is disabled
 	GLMotif::TextFieldSlider* waterAttenuationSlider;
 	int controlPipeFd; // File descriptor of an optional named pipe to send control commands to a running AR Sandbox
+	std::string statusPipeName; // Name of an optional named pipe to which the AR Sandbox reports quality governor decisions and answers to control pipe queries
+	int statusPipeFd; // File descriptor of the status pipe, or -1 while no process is reading from it
 	
 	/* Private methods: */
-	void rawDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer); // Callback receiving raw depth frames from the Kinect camera; forwards them to the frame filter and rain maker objects
-	void receiveFilteredFrame(const Kinect::FrameBuffer& frameBuffer); // Callback receiving filtered depth frames from the filter object
+	void rawDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer); // Callback receiving raw depth frames from the Kinect camera; publishes them to the frame pipeline
+	void filterRawFrame(const Kinect::FrameBuffer& frameBuffer); // Frame pipeline stage passing raw depth frames to the frame filter unless updates are paused
+	void receiveFilteredFrame(const FrameFilter::OutputFrame& outputFrame); // Callback receiving filtered depth frames from the filter object
 	void toggleDEM(DEM* dem); // Sets or toggles the currently active DEM
+	void fitDem(DEM& dem,const OGTransform* demTransform,Scalar demVerticalShift,Scalar demVerticalScale,unsigned int demResolution) const; // Places the given loaded DEM into the sandbox using the given transformation, or by fitting it into the sandbox area if null, and selects its resolution
+	DEM* getCachedDem(const char* demFileName); // Returns the DEM loaded from the given file from the DEM cache, loading and fitting it on a cache miss
 	void addWater(GLContextData& contextData) const; // Function to render geometry that adds water to the water table
+	void applySimulationParameters(void); // Applies the most recent run-time changes to the simulation parameters
+	void runWaterSimulation(GLfloat totalTimeStep,unsigned int& numQueuedWaterSteps,GLContextData& contextData) const; // Updates the bathymetry, advances the water simulation by the given total time step, and reads back grids for subscribers in the given OpenGL context
+	void simulationTick(GLContextData& contextData); // Advances the water simulation by one tick of the simulation thread
+	void setTargetFrameRate(double newTargetFrameRate); // Enables the quality governor for the given target frame rate in Hz, or disables it and restores full quality if not positive
+	void applyQualityLevel(void); // Applies the quality governor's current maximum number of steps, snow cadence, and water grid size
+	std::string getQualityLevelDescription(void) const; // Returns a description of the quality governor's current level and the resulting simulation settings
+	void writeStatus(const std::string& status); // Writes a line of status to the status pipe if a process is reading from it
+	void updateQualityGovernor(void); // Feeds the most recent frame's timings to the quality governor and applies and reports its decisions
+	void printStageStatistics(void) const; // Prints the rolling statistics of all measured pipeline stages and the most recently reduced water volumes
 	void pauseUpdatesCallback(GLMotif::ToggleButton::ValueChangedCallbackData* cbData);
 	void showWaterControlDialogCallback(Misc::CallbackData* cbData);
 	void waterSpeedSliderCallback(GLMotif::TextFieldSlider::ValueChangedCallbackData* cbData);
@@ -0,0 +1,649 @@
+/***********************************************************************
+SandboxBench - Utility to measure the throughput of the depth frame
+filter and the water flow simulation, with and without the snow and
+freeze passes, on fragment or compute shaders, and with 32-bit or 16-bit
+floating-point grids. It renders into an offscreen GLX pbuffer, but
+still needs a connection to an X display.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+/***********************************************************************
+SandboxBench prints one comma-separated line per measurement to stdout,
+preceded by a header line naming the columns:
+benchmark,width,height,snow,backend,threads,iterations,seconds,
+perSecond,msPerIteration,gpuMemoryKB
+- benchmark is "filter" for the depth frame filter, "simulation" for
+  water flow simulation steps, "snowFreeze" for the difference between
+  simulation steps with and without the snow and freeze passes, or
+  "computeSpeedup" for the ratio of fragment shader to compute shader
+  time per simulation step, reported in the perSecond column.
+- benchmark is "pass:<pass name>" for the GPU time of one simulation
+  pass following a "simulation" line, measured with timer queries over
+  up to the last 64 executions of the pass in the timed steps; the
+  iterations column is the number of measured executions, and
+  msPerIteration is their mean time. Passes that did not run, or all
+  passes if the OpenGL driver does not support timer queries, are
+  omitted.
+- benchmark is "fp16Speedup" for the ratio of 32-bit to 16-bit grid
+  time per simulation step, "fp16MaxDepthError" for the largest
+  difference in water column height between 16-bit and 32-bit grids
+  after the same simulation steps, or "fp16VolumeError" for the
+  relative difference in total water volume, all reported in the
+  perSecond column.
+- width and height are the depth frame or water table size in pixels.
+- snow is 1 if the snow and freeze passes ran, 0 if not, or - if it does
+  not apply.
+- backend is "fragment" or "compute" for the shaders running the water
+  flow simulation, with a "-fp16" suffix if it used 16-bit grids, or -
+  if it does not apply.
+- gpuMemoryKB is the video memory taken by the water table, or -1 if the
+  OpenGL driver does not report available video memory.
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#include <Misc/FunctionCalls.h>
+#include <Misc/ThrowStdErr.h>
+#include <Threads/MutexCond.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+#include <Math/Math.h>
+#include <Geometry/Point.h>
+#include <Geometry/Vector.h>
+#include <GL/gl.h>
+#include <GL/GLExtensionManager.h>
+#include <GL/Extensions/GLARBTextureRectangle.h>
+#include <GL/GLContextData.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+
+#include "Types.h"
+#include "FrameFilter.h"
+#include "DepthStreamSource.h"
+#include "WaterTable2.h"
+#include "StageTimers.h"
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+class OffscreenContext // Class for an OpenGL context on the default X display rendering into a small pbuffer; all simulation passes render into frame buffer objects
+	{
+	/* Elements: */
+	private:
+	Display* display; // Connection to the X server
+	GLXPbuffer pbuffer; // Pbuffer to which the context is bound
+	GLXContext context; // The OpenGL context
+	GLExtensionManager* extensionManager; // Extension manager for the OpenGL context
+	GLContextData* contextData; // Context data for the OpenGL context
+	
+	/* Private methods: */
+	void release(void) // Releases all X and GLX resources
+		{
+		if(context!=0)
+			{
+			glXMakeContextCurrent(display,None,None,0);
+			glXDestroyContext(display,context);
+			}
+		if(pbuffer!=None)
+			glXDestroyPbuffer(display,pbuffer);
+		XCloseDisplay(display);
+		}
+	
+	/* Constructors and destructors: */
+	public:
+	OffscreenContext(void) // Creates an OpenGL context on the default X display and makes it current
+		:display(0),pbuffer(None),context(0),
+		 extensionManager(0),contextData(0)
+		{
+		/* Connect to the X server: */
+		display=XOpenDisplay(0);
+		if(display==0)
+			throw std::runtime_error("SandboxBench: Unable to open X display");
+		
+		/* Find a frame buffer configuration supporting pbuffers: */
+		int fbConfigAttribs[]={GLX_DRAWABLE_TYPE,GLX_PBUFFER_BIT,GLX_RENDER_TYPE,GLX_RGBA_BIT,GLX_RED_SIZE,8,GLX_GREEN_SIZE,8,GLX_BLUE_SIZE,8,None};
+		int numFbConfigs=0;
+		GLXFBConfig* fbConfigs=glXChooseFBConfig(display,DefaultScreen(display),fbConfigAttribs,&numFbConfigs);
+		if(fbConfigs==0||numFbConfigs==0)
+			{
+			release();
+			throw std::runtime_error("SandboxBench: No pbuffer-capable frame buffer configuration");
+			}
+		
+		/* Create the pbuffer and the OpenGL context: */
+		int pbufferAttribs[]={GLX_PBUFFER_WIDTH,16,GLX_PBUFFER_HEIGHT,16,None};
+		pbuffer=glXCreatePbuffer(display,fbConfigs[0],pbufferAttribs);
+		context=glXCreateNewContext(display,fbConfigs[0],GLX_RGBA_TYPE,0,True);
+		XFree(fbConfigs);
+		if(pbuffer==None||context==0||!glXMakeContextCurrent(display,pbuffer,pbuffer,context))
+			{
+			release();
+			throw std::runtime_error("SandboxBench: Unable to create offscreen OpenGL context");
+			}
+		
+		/* Initialize the OpenGL extension manager and context data: */
+		extensionManager=new GLExtensionManager;
+		GLExtensionManager::makeCurrent(extensionManager);
+		contextData=new GLContextData(101);
+		GLContextData::makeCurrent(contextData);
+		}
+	private:
+	OffscreenContext(const OffscreenContext& source); // Prohibit copy constructor
+	OffscreenContext& operator=(const OffscreenContext& source); // Prohibit assignment operator
+	public:
+	~OffscreenContext(void)
+		{
+		/* Release the context data and extension manager before the OpenGL context: */
+		GLContextData::makeCurrent(0);
+		delete contextData;
+		GLExtensionManager::makeCurrent(0);
+		delete extensionManager;
+		release();
+		}
+	
+	/* Methods: */
+	GLContextData& getContextData(void) // Returns the context data of the OpenGL context
+		{
+		return *contextData;
+		}
+	};
+
+struct Bathymetry // Structure for a regular elevation grid to resample into water tables of any size
+	{
+	/* Elements: */
+	public:
+	int size[2]; // Width and height of the elevation grid
+	double box[4]; // Positions of the lower-left and upper-right grid points as lower-left x, lower-left y, upper-right x, upper-right y
+	std::vector<float> elevations; // Grid of elevations
+	
+	/* Methods: */
+	float sample(double x,double y) const // Returns the bilinearly interpolated elevation at the given position, clamped to the grid
+		{
+		double gx=Math::clamp((x-box[0])*double(size[0]-1)/(box[2]-box[0]),0.0,double(size[0]-1));
+		double gy=Math::clamp((y-box[1])*double(size[1]-1)/(box[3]-box[1]),0.0,double(size[1]-1));
+		int ix=Math::min(int(gx),size[0]-2);
+		int iy=Math::min(int(gy),size[1]-2);
+		double dx=gx-double(ix);
+		double dy=gy-double(iy);
+		const float* ePtr=&elevations[iy*size[0]+ix];
+		double e0=double(ePtr[0])*(1.0-dx)+double(ePtr[1])*dx;
+		double e1=double(ePtr[size[0]])*(1.0-dx)+double(ePtr[size[0]+1])*dx;
+		return float(e0*(1.0-dy)+e1*dy);
+		}
+	void getElevationRange(float& min,float& max,float& mean) const // Returns the range and mean of all elevations
+		{
+		min=max=elevations[0];
+		double sum=0.0;
+		for(std::vector<float>::const_iterator eIt=elevations.begin();eIt!=elevations.end();++eIt)
+			{
+			min=Math::min(min,*eIt);
+			max=Math::max(max,*eIt);
+			sum+=double(*eIt);
+			}
+		mean=float(sum/double(elevations.size()));
+		}
+	};
+
+class FilterDriver // Class feeding replayed depth frames into a frame filter and counting them
+	{
+	/* Elements: */
+	private:
+	FrameFilter& frameFilter; // The benchmarked frame filter
+	Threads::MutexCond doneCond; // Condition variable to signal that another frame was filtered
+	size_t numFrames; // Number of frames filtered so far
+	
+	/* Constructors and destructors: */
+	public:
+	FilterDriver(FrameFilter& sFrameFilter) // Creates a driver for the given frame filter
+		:frameFilter(sFrameFilter),numFrames(0)
+		{
+		}
+	
+	/* Methods: */
+	void receiveRawFrame(const Kinect::FrameBuffer& frame) // Filters the given raw depth frame in the calling thread
+		{
+		frameFilter.receiveRawFrame(frame);
+		
+		Threads::MutexCond::Lock doneLock(doneCond);
+		++numFrames;
+		doneCond.signal();
+		}
+	void waitForFrames(size_t targetNumFrames) // Blocks until the given number of frames have been filtered
+		{
+		Threads::MutexCond::Lock doneLock(doneCond);
+		while(numFrames<targetNumFrames)
+			doneCond.wait(doneLock);
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+double getMonotonicTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)/1.0e9;
+	}
+
+GLint getAvailableVideoMemory(void)
+	{
+	/* Query the available video memory in KB if the driver reports it: */
+	GLint result=-1;
+	if(GLExtensionManager::isExtensionSupported("GL_NVX_gpu_memory_info"))
+		glGetIntegerv(0x9049,&result); // GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+	return result;
+	}
+
+void printResult(const char* benchmark,int width,int height,const char* snow,const char* backend,unsigned int numThreads,unsigned int numIterations,double seconds,GLint gpuMemoryKB)
+	{
+	std::cout<<benchmark<<','<<width<<','<<height<<','<<snow<<','<<backend<<','<<numThreads<<','<<numIterations<<','<<seconds<<',';
+	std::cout<<double(numIterations)/seconds<<','<<seconds*1000.0/double(numIterations)<<','<<gpuMemoryKB<<std::endl;
+	}
+
+void loadDem(const char* demFileName,Bathymetry& bathymetry)
+	{
+	/* Read the DEM file in the same format as DEM::load: */
+	IO::FilePtr demFile=IO::openFile(demFileName);
+	demFile->setEndianness(Misc::LittleEndian);
+	demFile->read<int>(bathymetry.size,2);
+	if(bathymetry.size[0]<2||bathymetry.size[1]<2)
+		Misc::throwStdErr("SandboxBench: DEM file %s is too small",demFileName);
+	for(int i=0;i<4;++i)
+		bathymetry.box[i]=double(demFile->read<float>());
+	bathymetry.elevations.resize(bathymetry.size[1]*bathymetry.size[0]);
+	demFile->read<float>(&bathymetry.elevations[0],bathymetry.size[1]*bathymetry.size[0]);
+	}
+
+void benchmarkFilter(const char* depthStreamFileName,unsigned int numFilterThreads,Bathymetry& bathymetry)
+	{
+	/* Open the depth stream and create a frame filter with the recorded metadata: */
+	DepthStreamSource source(depthStreamFileName);
+	if(source.getNumFrames()==0)
+		Misc::throwStdErr("SandboxBench: Depth stream file %s contains no frames",depthStreamFileName);
+	source.setMaxSpeed(true);
+	const unsigned int* frameSize=source.getActualFrameSize(Kinect::FrameSource::DEPTH);
+	Kinect::FrameSource::IntrinsicParameters ips=source.getIntrinsicParameters();
+	FrameFilter frameFilter(frameSize,30,false,source.getPixelDepthCorrection(),ips.depthProjection,source.getBasePlane());
+	frameFilter.setDepthPixelType(source.getDepthPixelType());
+	frameFilter.setNumFilterThreads(numFilterThreads);
+	
+	/* Filter all recorded frames as fast as possible: */
+	FilterDriver driver(frameFilter);
+	double startTime=getMonotonicTime();
+	source.startStreaming(0,Misc::createFunctionCall(&driver,&FilterDriver::receiveRawFrame));
+	driver.waitForFrames(source.getNumFrames());
+	double elapsed=getMonotonicTime()-startTime;
+	source.stopStreaming();
+	printResult("filter",frameSize[0],frameSize[1],"-","-",numFilterThreads,source.getNumFrames(),elapsed,-1);
+	
+	/* Set up a coordinate frame in the base plane: */
+	const Plane& basePlane=source.getBasePlane();
+	Vector normal=basePlane.getNormal();
+	normal.normalize();
+	Vector u=Geometry::normal(normal);
+	u.normalize();
+	Vector v=Geometry::cross(normal,u);
+	v.normalize();
+	
+	/* Project the last filtered frame's pixels into the base plane frame: */
+	frameFilter.lockNewFrame();
+	const float* dPtr=frameFilter.getLockedFrame().depthImage.getData<float>();
+	std::vector<Point> points;
+	points.reserve(frameSize[1]*frameSize[0]);
+	for(unsigned int y=0;y<frameSize[1];++y)
+		for(unsigned int x=0;x<frameSize[0];++x,++dPtr)
+			{
+			Point p=ips.depthProjection.transform(Point(Scalar(x)+Scalar(0.5),Scalar(y)+Scalar(0.5),Scalar(*dPtr)));
+			Vector d=p-Point::origin;
+			points.push_back(Point(d*u,d*v,basePlane.calcDistance(p)/basePlane.getNormal().mag()));
+			}
+	
+	/* Calculate the bounding box of all projected pixels: */
+	bathymetry.size[0]=frameSize[0];
+	bathymetry.size[1]=frameSize[1];
+	bathymetry.box[0]=bathymetry.box[2]=points[0][0];
+	bathymetry.box[1]=bathymetry.box[3]=points[0][1];
+	for(std::vector<Point>::iterator pIt=points.begin();pIt!=points.end();++pIt)
+		for(int i=0;i<2;++i)
+			{
+			bathymetry.box[i]=Math::min(bathymetry.box[i],double((*pIt)[i]));
+			bathymetry.box[2+i]=Math::max(bathymetry.box[2+i],double((*pIt)[i]));
+			}
+	
+	/* Average the projected pixels' elevations on a grid covering the bounding box: */
+	std::vector<double> sums(bathymetry.size[1]*bathymetry.size[0],0.0);
+	std::vector<unsigned int> counts(bathymetry.size[1]*bathymetry.size[0],0);
+	double elevationSum=0.0;
+	for(std::vector<Point>::iterator pIt=points.begin();pIt!=points.end();++pIt)
+		{
+		int index[2];
+		for(int i=0;i<2;++i)
+			index[i]=Math::clamp(int(Math::floor((double((*pIt)[i])-bathymetry.box[i])*double(bathymetry.size[i]-1)/(bathymetry.box[2+i]-bathymetry.box[i])+0.5)),0,bathymetry.size[i]-1);
+		sums[index[1]*bathymetry.size[0]+index[0]]+=double((*pIt)[2]);
+		++counts[index[1]*bathymetry.size[0]+index[0]];
+		elevationSum+=double((*pIt)[2]);
+		}
+	
+	/* Fill grid points that received no pixels with the mean elevation: */
+	double meanElevation=elevationSum/double(points.size());
+	bathymetry.elevations.resize(bathymetry.size[1]*bathymetry.size[0]);
+	for(size_t i=0;i<bathymetry.elevations.size();++i)
+		bathymetry.elevations[i]=float(counts[i]!=0?sums[i]/double(counts[i]):meanElevation);
+	}
+
+bool benchmarkSimulation(const Bathymetry& bathymetry,GLsizei width,GLsizei height,bool snow,bool compute,bool halfFloat,bool sparse,unsigned int numWarmupSteps,unsigned int numSteps,GLContextData& contextData,double& msPerStep,std::vector<GLfloat>* waterDepths)
+	{
+	/* Create a water table covering the bathymetry grid: */
+	float minElevation,maxElevation,meanElevation;
+	bathymetry.getElevationRange(minElevation,maxElevation,meanElevation);
+	GLfloat cellSize[2];
+	for(int i=0;i<2;++i)
+		cellSize[i]=GLfloat((bathymetry.box[2+i]-bathymetry.box[i])/double(i==0?width:height));
+	GLint availableBefore=getAvailableVideoMemory();
+	WaterTable2* waterTable=new WaterTable2(width,height,cellSize);
+	waterTable->setElevationRange(Scalar(minElevation),Scalar(maxElevation));
+	waterTable->setSnowEnabled(snow);
+	waterTable->setSnowParameters(meanElevation,0.001f);
+	waterTable->setUseComputeShaders(compute);
+	waterTable->setStorageFormat(halfFloat?WaterTable2::FLOAT16:WaterTable2::FLOAT32);
+	waterTable->setSparseSimulation(sparse);
+	contextData.updateThings();
+	
+	/* Skip the measurement if compute shaders were requested but are not supported: */
+	if(compute&&!waterTable->isUsingComputeShaders(contextData))
+		{
+		delete waterTable;
+		contextData.updateThings();
+		return false;
+		}
+	
+	/* Upload the resampled vertex-centered bathymetry grid: */
+	std::vector<GLfloat> grid((height-1)*(width-1));
+	std::vector<GLfloat>::iterator gIt=grid.begin();
+	for(GLsizei y=1;y<height;++y)
+		for(GLsizei x=1;x<width;++x,++gIt)
+			*gIt=bathymetry.sample(bathymetry.box[0]+double(x)*double(cellSize[0]),bathymetry.box[1]+double(y)*double(cellSize[1]));
+	waterTable->updateBathymetry(&grid[0],contextData);
+	
+	/* Flood the water table up to the mean elevation so that the simulation has work to do: */
+	std::vector<GLfloat> waterLevel(height*width,meanElevation);
+	waterTable->setWaterLevel(&waterLevel[0],contextData);
+	
+	/* Run the warm-up steps and measure the water table's video memory: */
+	for(unsigned int i=0;i<numWarmupSteps;++i)
+		waterTable->runSimulationStep(false,contextData);
+	glFinish();
+	GLint availableAfter=getAvailableVideoMemory();
+	GLint gpuMemoryKB=availableBefore>=0&&availableAfter>=0?availableBefore-availableAfter:-1;
+	
+	/* Measure the GPU time of the individual simulation passes during the timed steps: */
+	StageTimers* stageTimers=new StageTimers;
+	waterTable->setStageTimers(stageTimers);
+	
+	/* Run the timed steps, and wait for them to finish: */
+	double startTime=getMonotonicTime();
+	for(unsigned int i=0;i<numSteps;++i)
+		waterTable->runSimulationStep(false,contextData);
+	glFinish();
+	double elapsed=getMonotonicTime()-startTime;
+	std::string backend=compute?"compute":"fragment";
+	if(halfFloat)
+		backend.append("-fp16");
+	printResult("simulation",width,height,snow?"1":"0",backend.c_str(),1,numSteps,elapsed,gpuMemoryKB);
+	msPerStep=elapsed*1000.0/double(numSteps);
+	
+	/* Print the mean GPU time of each simulation pass that was measured: */
+	for(int stage=StageTimers::DERIVATIVE;stage<=StageTimers::WATERADD;++stage)
+		{
+		StageTimers::Statistics stats=stageTimers->getStatistics(StageTimers::Stage(stage));
+		if(stats.numSamples>0)
+			{
+			std::string benchmark="pass:";
+			benchmark.append(StageTimers::getStageName(StageTimers::Stage(stage)));
+			printResult(benchmark.c_str(),width,height,snow?"1":"0",backend.c_str(),1,stats.numSamples,stats.mean*double(stats.numSamples),-1);
+			}
+		}
+	waterTable->setStageTimers(0);
+	
+	if(waterDepths!=0)
+		{
+		/* Read back the final conserved quantities: */
+		std::vector<GLfloat> quantities(height*width*3);
+		waterTable->bindQuantityTexture(contextData);
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB,GL_FLOAT,&quantities[0]);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		
+		/* Convert the water surface elevations to water column heights above the cell-centered bathymetry, clamping to the grid like the simulation does: */
+		waterDepths->resize(height*width);
+		for(GLsizei y=0;y<height;++y)
+			for(GLsizei x=0;x<width;++x)
+				{
+				GLsizei x0=Math::clamp(x-1,0,width-2);
+				GLsizei x1=Math::clamp(x,0,width-2);
+				GLsizei y0=Math::clamp(y-1,0,height-2);
+				GLsizei y1=Math::clamp(y,0,height-2);
+				GLfloat b=(grid[y0*(width-1)+x0]+grid[y0*(width-1)+x1]+grid[y1*(width-1)+x0]+grid[y1*(width-1)+x1])*0.25f;
+				(*waterDepths)[y*width+x]=Math::max(quantities[(y*width+x)*3]-b,0.0f);
+				}
+		}
+	
+	/* Destroy the water table and the timer set, and release their OpenGL resources: */
+	delete waterTable;
+	delete stageTimers;
+	contextData.updateThings();
+	
+	return true;
+	}
+
+void printAccuracy(GLsizei width,GLsizei height,const char* backend,unsigned int numSteps,const std::vector<GLfloat>& referenceDepths,const std::vector<GLfloat>& depths)
+	{
+	/* Compare the water column heights and total water volumes: */
+	double maxError=0.0;
+	double referenceVolume=0.0;
+	double volume=0.0;
+	for(size_t i=0;i<depths.size();++i)
+		{
+		maxError=Math::max(maxError,Math::abs(double(depths[i])-double(referenceDepths[i])));
+		referenceVolume+=double(referenceDepths[i]);
+		volume+=double(depths[i]);
+		}
+	double volumeError=referenceVolume>0.0?Math::abs(volume-referenceVolume)/referenceVolume:0.0;
+	
+	std::cout<<"fp16MaxDepthError,"<<width<<','<<height<<",1,"<<backend<<",1,"<<numSteps<<",-,"<<maxError<<",-,-1"<<std::endl;
+	std::cout<<"fp16VolumeError,"<<width<<','<<height<<",1,"<<backend<<",1,"<<numSteps<<",-,"<<volumeError<<",-,-1"<<std::endl;
+	}
+
+void printUsage(void)
+	{
+	std::cout<<"Usage: SARndboxBench -dem <DEM file name> | -replay <depth stream file name> [option 1] ... [option n]"<<std::endl;
+	std::cout<<"  Options:"<<std::endl;
+	std::cout<<"  -h"<<std::endl;
+	std::cout<<"     Prints this help message"<<std::endl;
+	std::cout<<"  -dem <DEM file name>"<<std::endl;
+	std::cout<<"     Loads the bathymetry from the given digital elevation model file"<<std::endl;
+	std::cout<<"  -replay <depth stream file name>"<<std::endl;
+	std::cout<<"     Filters all frames of the given depth stream file as fast as"<<std::endl;
+	std::cout<<"     possible, and uses the last filtered frame as bathymetry"<<std::endl;
+	std::cout<<"  -nft <number of filter threads>"<<std::endl;
+	std::cout<<"     Number of threads sharing the work of filtering each depth frame"<<std::endl;
+	std::cout<<"     Default: 1"<<std::endl;
+	std::cout<<"  -wts <water grid width> <water grid height>"<<std::endl;
+	std::cout<<"     Adds a water table size to benchmark; can be given multiple times"<<std::endl;
+	std::cout<<"     Default: 160 120, 320 240, 640 480, 1280 960"<<std::endl;
+	std::cout<<"  -warmup <number of steps>"<<std::endl;
+	std::cout<<"     Number of untimed simulation steps before each measurement"<<std::endl;
+	std::cout<<"     Default: 50"<<std::endl;
+	std::cout<<"  -steps <number of steps>"<<std::endl;
+	std::cout<<"     Number of timed simulation steps in each measurement"<<std::endl;
+	std::cout<<"     Default: 500"<<std::endl;
+	std::cout<<"  -nsws"<<std::endl;
+	std::cout<<"     Simulates water flow on the entire water table instead of only on"<<std::endl;
+	std::cout<<"     tiles containing or adjacent to water or snow"<<std::endl;
+	}
+
+}
+
+/*************
+Main function:
+*************/
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* demFileName=0;
+	const char* depthStreamFileName=0;
+	unsigned int numFilterThreads=1;
+	std::vector<GLsizei> wtSizes;
+	unsigned int numWarmupSteps=50;
+	unsigned int numSteps=500;
+	bool sparse=true;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				printUsage();
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"dem")==0)
+				{
+				++i;
+				if(i<argc)
+					demFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"replay")==0)
+				{
+				++i;
+				if(i<argc)
+					depthStreamFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"nft")==0)
+				{
+				++i;
+				if(i<argc)
+					numFilterThreads=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"wts")==0)
+				{
+				if(i+2<argc)
+					{
+					for(int j=0;j<2;++j)
+						{
+						++i;
+						wtSizes.push_back(GLsizei(atoi(argv[i])));
+						}
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"warmup")==0)
+				{
+				++i;
+				if(i<argc)
+					numWarmupSteps=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"steps")==0)
+				{
+				++i;
+				if(i<argc)
+					numSteps=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"nsws")==0)
+				sparse=false;
+			else
+				std::cerr<<"Ignoring unrecognized command line switch "<<argv[i]<<std::endl;
+			}
+		}
+	if((demFileName==0)==(depthStreamFileName==0))
+		{
+		std::cerr<<"Exactly one of -dem or -replay must be given"<<std::endl;
+		printUsage();
+		return 1;
+		}
+	if(numSteps==0)
+		numSteps=1;
+	if(wtSizes.empty())
+		{
+		static const GLsizei defaultSizes[]={160,120,320,240,640,480,1280,960};
+		wtSizes.insert(wtSizes.end(),defaultSizes,defaultSizes+8);
+		}
+	
+	try
+		{
+		/* Print the column header: */
+		std::cout<<"benchmark,width,height,snow,backend,threads,iterations,seconds,perSecond,msPerIteration,gpuMemoryKB"<<std::endl;
+		
+		/* Load or create the bathymetry: */
+		Bathymetry bathymetry;
+		if(demFileName!=0)
+			loadDem(demFileName,bathymetry);
+		else
+			benchmarkFilter(depthStreamFileName,numFilterThreads,bathymetry);
+		
+		/* Benchmark the water flow simulation at all requested sizes, without and with the snow and freeze passes, on fragment and compute shaders: */
+		OffscreenContext context;
+		for(size_t i=0;i+1<wtSizes.size();i+=2)
+			{
+			double msPerStep[2][2];
+			std::vector<GLfloat> waterDepths[2];
+			bool haveCompute=true;
+			for(int compute=0;compute<2&&haveCompute;++compute)
+				for(int snow=0;snow<2&&haveCompute;++snow)
+					haveCompute=benchmarkSimulation(bathymetry,wtSizes[i],wtSizes[i+1],snow!=0,compute!=0,false,sparse,numWarmupSteps,numSteps,context.getContextData(),msPerStep[compute][snow],snow!=0?&waterDepths[compute]:0);
+			std::cout<<"snowFreeze,"<<wtSizes[i]<<','<<wtSizes[i+1]<<",-,fragment,1,"<<numSteps<<",-,-,"<<msPerStep[0][1]-msPerStep[0][0]<<",-1"<<std::endl;
+			if(haveCompute)
+				{
+				std::cout<<"snowFreeze,"<<wtSizes[i]<<','<<wtSizes[i+1]<<",-,compute,1,"<<numSteps<<",-,-,"<<msPerStep[1][1]-msPerStep[1][0]<<",-1"<<std::endl;
+				for(int snow=0;snow<2;++snow)
+					std::cout<<"computeSpeedup,"<<wtSizes[i]<<','<<wtSizes[i+1]<<','<<snow<<",-,1,"<<numSteps<<",-,"<<msPerStep[0][snow]/msPerStep[1][snow]<<",-,-1"<<std::endl;
+				}
+			else
+				std::cerr<<"Compute shaders are not supported; skipping compute shader measurements"<<std::endl;
+			
+			/* Check 16-bit grids against 32-bit grids with the snow and freeze passes on all supported backends: */
+			for(int compute=0;compute<(haveCompute?2:1);++compute)
+				{
+				double halfMsPerStep;
+				std::vector<GLfloat> halfWaterDepths;
+				benchmarkSimulation(bathymetry,wtSizes[i],wtSizes[i+1],true,compute!=0,true,sparse,numWarmupSteps,numSteps,context.getContextData(),halfMsPerStep,&halfWaterDepths);
+				const char* backend=compute!=0?"compute-fp16":"fragment-fp16";
+				std::cout<<"fp16Speedup,"<<wtSizes[i]<<','<<wtSizes[i+1]<<",1,"<<backend<<",1,"<<numSteps<<",-,"<<msPerStep[compute][1]/halfMsPerStep<<",-,-1"<<std::endl;
+				printAccuracy(wtSizes[i],wtSizes[i+1],backend,numSteps,waterDepths[compute],halfWaterDepths);
+				}
+			}
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"SandboxBench: Terminated due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
@@ -22,7 +22,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "SandboxClient.h"
 
+#include <string.h>
+#include <stdlib.h>
 #include <string>
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <Misc/SizedTypes.h>
@@ -30,6 +33,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Misc/FunctionCalls.h>
 #include <Comm/TCPPipe.h>
 #include <Math/Math.h>
+#include <Math/Constants.h>
 #include <Geometry/LinearUnit.h>
 #include <GL/gl.h>
 #include <GL/GLMaterialTemplates.h>
@@ -56,6 +60,120 @@ Static eleemnts of class SandboxClient::TeleportTool:
 
 SandboxClient::TeleportToolFactory* SandboxClient::TeleportTool::factory=0;
 
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+bool clipSegment(const Vrui::Point& gp0,const Vrui::Vector& gd,const Vrui::Scalar min[2],const Vrui::Scalar max[2],Vrui::Scalar& l0,Vrui::Scalar& l1)
+	{
+	/* Clip the line segment's parameter interval against the box's slabs in x and y: */
+	for(int i=0;i<2;++i)
+		{
+		if(gd[i]!=Vrui::Scalar(0))
+			{
+			Vrui::Scalar s0=(min[i]-gp0[i])/gd[i];
+			Vrui::Scalar s1=(max[i]-gp0[i])/gd[i];
+			if(s0>s1)
+				std::swap(s0,s1);
+			if(l0<s0)
+				l0=s0;
+			if(l1>s1)
+				l1=s1;
+			}
+		else if(gp0[i]<min[i]||gp0[i]>max[i])
+			return false;
+		}
+	
+	return l0<l1;
+	}
+
+void uploadChangedRows(GLsizei width,GLsizei height,const std::vector<unsigned int>& rowVersions,unsigned int textureVersion,const GLfloat* grid)
+	{
+	/* Upload each run of consecutive rows that changed after the texture was last updated: */
+	GLsizei y=0;
+	while(y<height)
+		{
+		/* Skip unchanged rows: */
+		for(;y<height&&rowVersions[y]<=textureVersion;++y)
+			;
+		
+		/* Find the end of the run of changed rows: */
+		GLsizei y0=y;
+		for(;y<height&&rowVersions[y]>textureVersion;++y)
+			;
+		if(y0<y)
+			glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,y0,width,y-y0,GL_RED,GL_FLOAT,grid+size_t(y0)*size_t(width));
+		}
+	}
+
+}
+
+/********************************************
+Methods of class SandboxClient::GridBuffers:
+********************************************/
+
+void SandboxClient::GridBuffers::updatePyramid(const GLsizei gridSize[2])
+	{
+	/* Create the pyramid's levels on first use, halving the number of blocks per level until a single block remains: */
+	if(pyramid.empty())
+		{
+		GLsizei size[2]={gridSize[0]-2,gridSize[1]-2};
+		while(true)
+			{
+			pyramid.push_back(PyramidLevel());
+			PyramidLevel& pl=pyramid.back();
+			for(int i=0;i<2;++i)
+				pl.size[i]=size[i];
+			pl.ranges.resize(size_t(size[0])*size_t(size[1])*2);
+			if(size[0]<=1&&size[1]<=1)
+				break;
+			for(int i=0;i<2;++i)
+				size[i]=(size[i]+1)/2;
+			}
+		}
+	
+	/* Calculate the elevation range of each bathymetry cell from its four corners: */
+	PyramidLevel& base=pyramid[0];
+	GLsizei bWidth=gridSize[0]-1;
+	GLfloat* rPtr=&base.ranges.front();
+	for(GLsizei y=0;y<base.size[1];++y)
+		{
+		const GLfloat* row=bathymetry+size_t(y)*size_t(bWidth);
+		for(GLsizei x=0;x<base.size[0];++x,rPtr+=2)
+			{
+			GLfloat c0=row[x];
+			GLfloat c1=row[x+1];
+			GLfloat c2=row[x+bWidth];
+			GLfloat c3=row[x+bWidth+1];
+			rPtr[0]=Math::min(Math::min(c0,c1),Math::min(c2,c3));
+			rPtr[1]=Math::max(Math::max(c0,c1),Math::max(c2,c3));
+			}
+		}
+	
+	/* Combine the elevation ranges of up to 2x2 blocks into each block of the next level: */
+	for(size_t level=1;level<pyramid.size();++level)
+		{
+		const PyramidLevel& child=pyramid[level-1];
+		PyramidLevel& pl=pyramid[level];
+		GLfloat* rPtr=&pl.ranges.front();
+		for(GLsizei y=0;y<pl.size[1];++y)
+			for(GLsizei x=0;x<pl.size[0];++x,rPtr+=2)
+				{
+				rPtr[0]=Math::Constants<GLfloat>::max;
+				rPtr[1]=-Math::Constants<GLfloat>::max;
+				for(GLsizei cy=y*2;cy<Math::min(y*2+2,child.size[1]);++cy)
+					for(GLsizei cx=x*2;cx<Math::min(x*2+2,child.size[0]);++cx)
+						{
+						const GLfloat* cr=&child.ranges[(size_t(cy)*size_t(child.size[0])+size_t(cx))*2];
+						rPtr[0]=Math::min(rPtr[0],cr[0]);
+						rPtr[1]=Math::max(rPtr[1],cr[1]);
+						}
+				}
+		}
+	}
+
 /********************************************
 Methods of class SandboxClient::TeleportTool:
 ********************************************/
@@ -336,6 +454,65 @@ Methods of class SandboxClient:
 
 void SandboxClient::readGrids(void)
 	{
+	/* Receive the frame header: */
+	Misc::UInt32 frameType=pipe->read<Misc::UInt32>();
+	if(frameType>GridLOD::LODDELTAFRAME)
+		throw std::runtime_error("SandboxClient: Invalid grid frame from remote AR Sandbox");
+	size_t frameSize=pipe->read<Misc::UInt32>();
+	
+	/* Receive the encoded grids in one read: */
+	encodedFrame.resize(frameSize);
+	if(frameSize>0)
+		pipe->read(&encodedFrame.front(),frameSize);
+	const Misc::UInt8* fPtr=frameSize>0?&encodedFrame.front():0;
+	const Misc::UInt8* fEnd=fPtr+frameSize;
+	
+	const GridCodec::Value* vPtr;
+	if(frameType==GridCodec::KEYFRAME||frameType==GridCodec::DELTAFRAME)
+		{
+		/* Decode the full-resolution grids against the previous grids: */
+		codec->decode(GridCodec::FrameType(frameType),fPtr,frameSize);
+		vPtr=codec->getValues();
+		}
+	else
+		{
+		/* Decode the coarse grids against the previous coarse grids and interpolate them to full resolution: */
+		size_t coarseFrameSize=GridLOD::readUInt32(fPtr,fEnd);
+		if(size_t(fEnd-fPtr)<coarseFrameSize)
+			throw std::runtime_error("SandboxClient: Truncated grid frame from remote AR Sandbox");
+		coarseCodec->decode(frameType==GridLOD::LODKEYFRAME?GridCodec::KEYFRAME:GridCodec::DELTAFRAME,fPtr,coarseFrameSize);
+		fPtr+=coarseFrameSize;
+		lod->upsample(coarseCodec->getValues(),&lodGrids.front());
+		
+		/* Merge the full-resolution tiles: */
+		unsigned int numTiles=GridLOD::readUInt32(fPtr,fEnd);
+		for(unsigned int i=0;i<numTiles;++i)
+			{
+			unsigned int tileIndex=GridLOD::readUInt32(fPtr,fEnd);
+			size_t tileFrameSize=GridLOD::readUInt32(fPtr,fEnd);
+			if(size_t(fEnd-fPtr)<tileFrameSize)
+				throw std::runtime_error("SandboxClient: Truncated grid frame from remote AR Sandbox");
+			lod->decodeTile(fPtr,tileFrameSize,tileIndex,&lodGrids.front());
+			fPtr+=tileFrameSize;
+			}
+		vPtr=&lodGrids.front();
+		}
+	
+	/* Find the rows of both grids that changed since the previous update: */
+	unsigned int version=nextVersion++;
+	const GridCodec::Value* rowPtr=vPtr;
+	GridCodec::Value* prevPtr=&previousGrids.front();
+	for(int g=0;g<2;++g)
+		{
+		size_t width=g==0?size_t(gridSize[0]-1):size_t(gridSize[0]);
+		for(size_t y=0;y<rowVersions[g].size();++y,rowPtr+=width,prevPtr+=width)
+			if(memcmp(rowPtr,prevPtr,width*sizeof(GridCodec::Value))!=0)
+				{
+				memcpy(prevPtr,rowPtr,width*sizeof(GridCodec::Value));
+				rowVersions[g][y]=version;
+				}
+		}
+	
 	/* Start a new set of grids: */
 	GridBuffers& gb=grids.startNewValue();
 	
@@ -343,163 +520,169 @@ void SandboxClient::readGrids(void)
 	GLfloat eScale=(elevationRange[1]-elevationRange[0])/65535.0f;
 	GLfloat eOffset=elevationRange[0];
 	
-	/* Receive the bathymetry grid: */
+	/* Dequantize the bathymetry grid: */
 	GLfloat* bPtr=gb.bathymetry;
-	for(GLsizei y=0;y<gridSize[1]-1;++y)
-		for(GLsizei x=0;x<gridSize[0]-1;++x,++bPtr)
-			*bPtr=GLfloat(pipe->read<Misc::UInt16>())*eScale+eOffset;
+	for(size_t count=size_t(gridSize[1]-1)*size_t(gridSize[0]-1);count>0;--count,++bPtr,++vPtr)
+		*bPtr=GLfloat(*vPtr)*eScale+eOffset;
 	
-	/* Receive the water level grid: */
+	/* Dequantize the water level grid: */
 	GLfloat* wlPtr=gb.waterLevel;
-	for(GLsizei y=0;y<gridSize[1];++y)
-		for(GLsizei x=0;x<gridSize[0];++x,++wlPtr)
-			*wlPtr=GLfloat(pipe->read<Misc::UInt16>())*eScale+eOffset;
+	for(size_t count=size_t(gridSize[1])*size_t(gridSize[0]);count>0;--count,++wlPtr,++vPtr)
+		*wlPtr=GLfloat(*vPtr)*eScale+eOffset;
+	
+	/* Update the grids' version numbers and the bathymetry's min/max pyramid: */
+	gb.version=version;
+	for(int g=0;g<2;++g)
+		gb.rowVersions[g]=rowVersions[g];
+	gb.updatePyramid(gridSize);
 	
 	/* Post the new set of grids: */
 	grids.postNewValue();
 	}
 
-SandboxClient::Scalar SandboxClient::intersectLine(const SandboxClient::Point& p0,const SandboxClient::Point& p1) const
+SandboxClient::Scalar SandboxClient::intersectCell(const SandboxClient::GridBuffers& gb,const SandboxClient::Point& gp0,const SandboxClient::Vector& gd,GLsizei cx,GLsizei cy,SandboxClient::Scalar cl0,SandboxClient::Scalar cl1) const
 	{
-	/* Convert the points to grid coordinates: */
-	Point gp0(p0[0]/Scalar(cellSize[0])-Scalar(0.5),p0[1]/Scalar(cellSize[1])-Scalar(0.5),p0[2]);
-	Point gp1(p1[0]/Scalar(cellSize[0])-Scalar(0.5),p1[1]/Scalar(cellSize[1])-Scalar(0.5),p1[2]);
-	Vector gd=gp1-gp0;
-	
-	/* Clip the line segment against the grid's boundaries: */
-	Scalar l0(0);
-	Scalar l1(1);
-	for(int i=0;i<2;++i)
+	/* Intersect the line segment with the bilinear surface inside the cell: */
+	const GLfloat* cell=gb.bathymetry+(cy*(gridSize[0]-1)+cx);
+	Scalar c0=cell[0];
+	Scalar c1=cell[1];
+	Scalar c2=cell[gridSize[0]-1];
+	Scalar c3=cell[gridSize[0]];
+	Scalar cx0=Scalar(cx);
+	Scalar cx1=Scalar(cx+1);
+	Scalar cy0=Scalar(cy);
+	Scalar cy1=Scalar(cy+1);
+	Scalar fxy=c0-c1+c3-c2;
+	Scalar fx=(c1-c0)*cy1-(c3-c2)*cy0;
+	Scalar fy=(c2-c0)*cx1-(c3-c1)*cx0;
+	Scalar f=(c0*cx1-c1*cx0)*cy1-(c2*cx1-c3*cx0)*cy0;
+	Scalar a=fxy*gd[0]*gd[1];
+	Scalar bc0=(fxy*gp0[1]+fx);
+	Scalar bc1=(fxy*gp0[0]+fy);
+	Scalar b=bc0*gd[0]+bc1*gd[1]-gd[2];
+	Scalar c=bc0*gp0[0]+bc1*gp0[1]-gp0[2]-fxy*gp0[0]*gp0[1]+f;
+	Scalar il=cl1;
+	if(a!=Scalar(0))
 		{
-		/* Clip against the lower boundary: */
-		Scalar b(0);
-		if(gp0[i]<b)
-			{
-			if(gp1[i]>b)
-				l0=Math::max(l0,(b-gp0[i])/gd[i]);
-			else
-				return Scalar(1);
-			}
-		else if(gp1[i]<b)
-			{
-			if(gp0[i]>b)
-				l1=Math::min(l1,(b-gp0[i])/gd[i]);
-			else
-				return Scalar(1);
-			}
-		
-		/* Clip against the upper boundary: */
-		b=Scalar(gridSize[i]-2);
-		if(gp0[i]>b)
+		/* Solve the quadratic equation and use the smaller valid solution: */
+		Scalar det=b*b-Scalar(4)*a*c;
+		if(det>=Scalar(0))
 			{
-			if(gp1[i]<b)
-				l0=Math::max(l0,(b-gp0[i])/gd[i]);
-			else
-				return Scalar(1);
-			}
-		else if(gp1[i]>b)
-			{
-			if(gp0[i]<b)
-				l1=Math::min(l1,(b-gp0[i])/gd[i]);
+			det=Math::sqrt(det);
+			if(a>Scalar(0))
+				{
+				/* Test the smaller intersection first: */
+				il=b>=Scalar(0)?(-b-det)/(Scalar(2)*a):(Scalar(2)*c)/(-b+det);
+				if(il<cl0)
+					il=b>=Scalar(0)?(Scalar(2)*c)/(-b-det):(-b+det)/(Scalar(2)*a);
+				}
 			else
-				return Scalar(1);
+				{
+				/* Test the smaller intersection first: */
+				il=b>=Scalar(0)?(Scalar(2)*c)/(-b-det):(-b+det)/(Scalar(2)*a);
+				if(il<cl0)
+					il=b>=Scalar(0)?(-b-det)/(Scalar(2)*a):(Scalar(2)*c)/(-b+det);
+				}
 			}
 		}
-	if(l0>=l1)
-		return Scalar(1);
+	else
+		{
+		/* Solve the linear equation: */
+		il=-c/b;
+		}
+	
+/* Check if the intersection is valid: */
+	if(il>=cl0&&il<cl1)
+		return il;
 	
-	/* Find the grid cell containing the first point: */
-	Point gp=Geometry::affineCombination(gp0,gp1,l0);
-	GLsizei cp[2];
+	return Scalar(1);
+	}
+
+SandboxClient::Scalar SandboxClient::intersectBlock(const SandboxClient::GridBuffers& gb,const SandboxClient::Point& gp0,const SandboxClient::Vector& gd,unsigned int level,GLsizei bx,GLsizei by,SandboxClient::Scalar l0,SandboxClient::Scalar l1) const
+	{
+	/* Clip the line segment against the block's extent in grid coordinates: */
+	const PyramidLevel& pl=gb.pyramid[level];
+	GLsizei blockSize=GLsizei(1)<<level;
+	GLsizei block[2]={bx,by};
+	Scalar min[2],max[2];
 	for(int i=0;i<2;++i)
-		cp[i]=Math::clamp(GLsizei(Math::floor(gp[i])),GLsizei(0),gridSize[i]-3);
-	Scalar cl0=l0;
-	while(cl0<l1)
 		{
-		/* Calculate the line parameter where the line segment leaves the current cell: */
-		Scalar cl1=l1;
-		int exit=-1;
-		for(int i=0;i<2;++i)
+		min[i]=Scalar(block[i]*blockSize);
+		max[i]=Scalar(Math::min((block[i]+1)*blockSize,gb.pyramid[0].size[i]));
+		}
+	if(!clipSegment(gp0,gd,min,max,l0,l1))
+		return Scalar(1);
+	
+	/* Skip the block if the line segment's elevation range inside the block does not overlap the block's elevation range: */
+	const GLfloat* range=&pl.ranges[(size_t(by)*size_t(pl.size[0])+size_t(bx))*2];
+	Scalar z0=gp0[2]+gd[2]*l0;
+	Scalar z1=gp0[2]+gd[2]*l1;
+	if(Math::max(z0,z1)<Scalar(range[0])||Math::min(z0,z1)>Scalar(range[1]))
+		return Scalar(1);
+	
+	/* Intersect the line segment with the surface if the block is a single cell: */
+	if(level==0)
+		return intersectCell(gb,gp0,gd,bx,by,l0,l1);
+	
+	/* Sort the block's children by the line parameter at which the line segment enters them: */
+	const PyramidLevel& cpl=gb.pyramid[level-1];
+	GLsizei childSize=blockSize>>1;
+	GLsizei children[4][2];
+	Scalar childL0s[4];
+	int numChildren=0;
+	for(GLsizei cy=by*2;cy<Math::min(by*2+2,cpl.size[1]);++cy)
+		for(GLsizei cx=bx*2;cx<Math::min(bx*2+2,cpl.size[0]);++cx)
 			{
-			Scalar el=cl1;
-			if(gp0[i]<gp1[i])
-				el=(Scalar(cp[i]+1)-gp0[i])/gd[i];
-			else if(gp0[i]>gp1[i])
-				el=(Scalar(cp[i])-gp0[i])/gd[i];
-			if(cl1>el)
+			GLsizei child[2]={cx,cy};
+			Scalar cmin[2],cmax[2];
+			for(int i=0;i<2;++i)
 				{
-				cl1=el;
-				exit=i;
+				cmin[i]=Scalar(child[i]*childSize);
+				cmax[i]=Scalar(Math::min((child[i]+1)*childSize,gb.pyramid[0].size[i]));
 				}
-			}
-		
-		/* Intersect the line segment with the surface inside the current cell: */
-		const GLfloat* cell=grids.getLockedValue().bathymetry+(cp[1]*(gridSize[0]-1)+cp[0]);
-		Scalar c0=cell[0];
-		Scalar c1=cell[1];
-		Scalar c2=cell[gridSize[0]-1];
-		Scalar c3=cell[gridSize[0]];
-		Scalar cx0=Scalar(cp[0]);
-		Scalar cx1=Scalar(cp[0]+1);
-		Scalar cy0=Scalar(cp[1]);
-		Scalar cy1=Scalar(cp[1]+1);
-		Scalar fxy=c0-c1+c3-c2;
-		Scalar fx=(c1-c0)*cy1-(c3-c2)*cy0;
-		Scalar fy=(c2-c0)*cx1-(c3-c1)*cx0;
-		Scalar f=(c0*cx1-c1*cx0)*cy1-(c2*cx1-c3*cx0)*cy0;
-		Scalar a=fxy*gd[0]*gd[1];
-		Scalar bc0=(fxy*gp0[1]+fx);
-		Scalar bc1=(fxy*gp0[0]+fy);
-		Scalar b=bc0*gd[0]+bc1*gd[1]-gd[2];
-		Scalar c=bc0*gp0[0]+bc1*gp0[1]-gp0[2]-fxy*gp0[0]*gp0[1]+f;
-		Scalar il=cl1;
-		if(a!=Scalar(0))
-			{
-			/* Solve the quadratic equation and use the smaller valid solution: */
-			Scalar det=b*b-Scalar(4)*a*c;
-			if(det>=Scalar(0))
+			Scalar cl0=l0;
+			Scalar cl1=l1;
+			if(clipSegment(gp0,gd,cmin,cmax,cl0,cl1))
 				{
-				det=Math::sqrt(det);
-				if(a>Scalar(0))
-					{
-					/* Test the smaller intersection first: */
-					il=b>=Scalar(0)?(-b-det)/(Scalar(2)*a):(Scalar(2)*c)/(-b+det);
-					if(il<cl0)
-						il=b>=Scalar(0)?(Scalar(2)*c)/(-b-det):(-b+det)/(Scalar(2)*a);
-					}
-				else
+				int insert=numChildren;
+				for(;insert>0&&childL0s[insert-1]>cl0;--insert)
 					{
-					/* Test the smaller intersection first: */
-					il=b>=Scalar(0)?(Scalar(2)*c)/(-b-det):(-b+det)/(Scalar(2)*a);
-					if(il<cl0)
-						il=b>=Scalar(0)?(-b-det)/(Scalar(2)*a):(Scalar(2)*c)/(-b+det);
+					children[insert][0]=children[insert-1][0];
+					children[insert][1]=children[insert-1][1];
+					childL0s[insert]=childL0s[insert-1];
 					}
+				children[insert][0]=cx;
+				children[insert][1]=cy;
+				childL0s[insert]=cl0;
+				++numChildren;
 				}
 			}
-		else
-			{
-			/* Solve the linear equation: */
-			il=-c/b;
-			}
-		
-		/* Check if the intersection is valid: */
-		if(il>=cl0&&il<cl1)
+	
+	/* Return the first intersection in the first child that has one: */
+	for(int i=0;i<numChildren;++i)
+		{
+		Scalar il=intersectBlock(gb,gp0,gd,level-1,children[i][0],children[i][1],l0,l1);
+		if(il<Scalar(1))
 			return il;
-		
-		/* Go to the next cell: */
-		if(exit>=0)
-			{
-			if(gd[exit]<Scalar(0))
-				--cp[exit];
-			else
-				++cp[exit];
-			}
-		cl0=cl1;
 		}
 	
 	return Scalar(1);
 	}
 
+SandboxClient::Scalar SandboxClient::intersectLine(const SandboxClient::Point& p0,const SandboxClient::Point& p1) const
+	{
+	/* Convert the points to grid coordinates: */
+	Point gp0(p0[0]/Scalar(cellSize[0])-Scalar(0.5),p0[1]/Scalar(cellSize[1])-Scalar(0.5),p0[2]);
+	Point gp1(p1[0]/Scalar(cellSize[0])-Scalar(0.5),p1[1]/Scalar(cellSize[1])-Scalar(0.5),p1[2]);
+	Vector gd=gp1-gp0;
+	
+	/* Descend the bathymetry's min/max pyramid from its single top-level block: */
+	const GridBuffers& gb=grids.getLockedValue();
+	if(gb.pyramid.empty())
+		return Scalar(1);
+	return intersectBlock(gb,gp0,gd,gb.pyramid.size()-1,0,0,Scalar(0),Scalar(1));
+	}
+
 bool SandboxClient::serverMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData)
 	{
 	SandboxClient* thisPtr=static_cast<SandboxClient*>(userData);
@@ -728,17 +911,30 @@ void SandboxClient::compileShaders(SandboxClient::DataItem* dataItem,const GLLig
 SandboxClient::SandboxClient(int& argc,char**& argv)
 	:Vrui::Application(argc,argv),
 	 pipe(0),
+	 codec(0),
+	 lod(0),coarseCodec(0),
+	 nextVersion(1),
 	 gridVersion(0),
 	 sun(0),underwater(false)
 	{
 	/* Parse the command line: */
 	const char* serverName=0;
 	int serverPortId=26000;
+	for(int i=0;i<2;++i)
+		lodRadii[i]=0.0f;
 	for(int argi=1;argi<argc;++argi)
 		{
 		if(argv[argi][0]=='-')
 			{
-			std::cerr<<"SandboxClient: Ignoring command line option "<<argv[argi]<<std::endl;
+			if(strcasecmp(argv[argi]+1,"lod")==0&&argi+2<argc)
+				{
+				/* Request full-resolution grids only around the viewer and inside the viewer's view cone: */
+				for(int i=0;i<2;++i)
+					lodRadii[i]=GLfloat(atof(argv[argi+1+i]));
+				argi+=2;
+				}
+			else
+				std::cerr<<"SandboxClient: Ignoring command line option "<<argv[argi]<<std::endl;
 			}
 		else if(serverName==0)
 			serverName=argv[argi];
@@ -753,6 +949,16 @@ SandboxClient::SandboxClient(int& argc,char**& argv)
 	
 	/* Send an endianness token to the server: */
 	pipe->write<Misc::UInt32>(0x12345678U);
+	if(lodRadii[1]>0.0f)
+		{
+		/* Request level-of-detail grids with a 60 degree half opening angle of the view cone: */
+		pipe->write<Misc::UInt16>(1);
+		Misc::Float32 lodParams[3];
+		for(int i=0;i<2;++i)
+			lodParams[i]=lodRadii[i];
+		lodParams[2]=Misc::Float32(Math::rad(60.0));
+		pipe->write(lodParams,3);
+		}
 	pipe->flush();
 	
 	/* Receive an endianness token from the server: */
@@ -776,9 +982,20 @@ SandboxClient::SandboxClient(int& argc,char**& argv)
 		for(int i=0;i<2;++i)
 			elevationRange[i]=pipe->read<Misc::Float32>();
 		
-		/* Initialize the grid buffers: */
+		/* Initialize the grid buffers and the codec for the quantized grids, which are sent back-to-back: */
 		for(int i=0;i<3;++i)
 			grids.getBuffer(i).init(gridSize);
+		codec=new GridCodec(size_t(gridSize[1]-1)*size_t(gridSize[0]-1)+size_t(gridSize[1])*size_t(gridSize[0]));
+		
+		/* Initialize the level-of-detail scheme and the codec for the coarse grids: */
+		lod=new GridLOD(gridSize);
+		coarseCodec=new GridCodec(lod->getNumCoarseValues());
+		lodGrids.resize(lod->getNumValues());
+		
+		/* Initialize change detection; the first set of grids marks all rows as changed: */
+		previousGrids.resize(codec->getNumValues());
+		rowVersions[0].resize(gridSize[1]-1,1U);
+		rowVersions[1].resize(gridSize[1],1U);
 		
 		/* Read the initial set of grids: */
 		readGrids();
@@ -787,6 +1004,9 @@ SandboxClient::SandboxClient(int& argc,char**& argv)
 		{
 		/* Disconnect from the remote AR Sandbox: */
 		delete pipe;
+		delete codec;
+		delete lod;
+		delete coarseCodec;
 		
 		/* Re-throw the exception: */
 		throw;
@@ -816,6 +1036,9 @@ SandboxClient::~SandboxClient(void)
 	dispatcher.stop();
 	communicationThread.join();
 	delete pipe;
+	delete codec;
+	delete lod;
+	delete coarseCodec;
 	}
 
 void SandboxClient::toolCreationCallback(Vrui::ToolManager::ToolCreationCallbackData* cbData)
@@ -836,7 +1059,7 @@ void SandboxClient::frame(void)
 	{
 	/* Lock the most recent grid buffers: */
 	if(grids.lockNewValue())
-		++gridVersion;
+		gridVersion=grids.getLockedValue().version;
 	
 	/* Calculate the position of the main viewer's head in grid space: */
 	Point head=Vrui::getHeadPosition();
@@ -892,8 +1115,8 @@ void SandboxClient::display(GLContextData& contextData) const
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTexture);
 	if(dataItem->textureVersion!=gridVersion)
 		{
-		/* Upload the new bathymetry grid: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,gridSize[0]-1,gridSize[1]-1,GL_RED,GL_FLOAT,grids.getLockedValue().bathymetry);
+		/* Upload the bathymetry grid's rows that changed since the last upload: */
+		uploadChangedRows(gridSize[0]-1,gridSize[1]-1,grids.getLockedValue().rowVersions[0],dataItem->textureVersion,grids.getLockedValue().bathymetry);
 		}
 	glUniform1iARB(dataItem->bathymetryShaderUniforms[0],0);
 	
@@ -926,8 +1149,8 @@ void SandboxClient::display(GLContextData& contextData) const
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTexture);
 	if(dataItem->textureVersion!=gridVersion)
 		{
-		/* Upload the new water surface grid: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,gridSize[0],gridSize[1],GL_RED,GL_FLOAT,grids.getLockedValue().waterLevel);
+		/* Upload the water surface grid's rows that changed since the last upload: */
+		uploadChangedRows(gridSize[0],gridSize[1],grids.getLockedValue().rowVersions[1],dataItem->textureVersion,grids.getLockedValue().waterLevel);
 		}
 	glUniform1iARB(dataItem->waterShaderUniforms[1],1);
 	
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef SANDBOXCLIENT_INCLUDED
 #define SANDBOXCLIENT_INCLUDED
 
+#include <vector>
 #include <Threads/Thread.h>
 #include <Threads/TripleBuffer.h>
 #include <Threads/EventDispatcher.h>
@@ -39,6 +40,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Vrui/GenericToolFactory.h>
 #include <Vrui/SurfaceNavigationTool.h>
 
+#include "GridCodec.h"
+#include "GridLOD.h"
+
 /* Forward declarations: */
 namespace Comm {
 class TCPPipe;
@@ -56,16 +60,27 @@ class SandboxClient:public Vrui::Application,public GLObject
 	typedef Vrui::Point Point;
 	typedef Vrui::Vector Vector;
 	
+	struct PyramidLevel // Structure representing a level of a min/max pyramid over the bathymetry grid's cells
+		{
+		/* Elements: */
+		public:
+		GLsizei size[2]; // Number of blocks in this level
+		std::vector<GLfloat> ranges; // Minimum and maximum elevation of each block
+		};
+	
 	struct GridBuffers // Structure representing a pair of grids
 		{
 		/* Elements: */
 		public:
 		GLfloat* bathymetry;
 		GLfloat* waterLevel;
+		unsigned int version; // Version number of the grids
+		std::vector<unsigned int> rowVersions[2]; // Version numbers at which each row of the bathymetry and water level grids last changed
+		std::vector<PyramidLevel> pyramid; // Min/max pyramid over the bathymetry grid's cells, from individual cells to a single block
 		
 		/* Constructors and destructors: */
 		GridBuffers(void)
-			:bathymetry(0),waterLevel(0)
+			:bathymetry(0),waterLevel(0),version(0)
 			{
 			}
 		~GridBuffers(void)
@@ -80,6 +95,7 @@ class SandboxClient:public Vrui::Application,public GLObject
 			bathymetry=new GLfloat[(gridSize[1]-1)*(gridSize[0]-1)];
 			waterLevel=new GLfloat[gridSize[1]*gridSize[0]];
 			}
+		void updatePyramid(const GLsizei gridSize[2]); // Recalculates the min/max pyramid from the current bathymetry grid
 		};
 	
 	class TeleportTool;
@@ -156,6 +172,15 @@ class SandboxClient:public Vrui::Application,public GLObject
 	GLfloat elevationRange[2]; // Minimum and maximum valid elevations
 	Threads::EventDispatcher dispatcher; // Dispatcher for events on the TCP pipe
 	Threads::Thread communicationThread; // Thread to handle communication with the remote AR Sandbox in the background
+	GridCodec* codec; // Codec decoding the stream of bathymetry and water level grids
+	GridCodec::Buffer encodedFrame; // Buffer receiving encoded grids from the remote AR Sandbox
+	GLfloat lodRadii[2]; // Radius around the viewer, and radius inside the viewer's view cone, within which to request full-resolution grids; non-positive to request full-resolution grids everywhere
+	GridLOD* lod; // Level-of-detail scheme splitting the grids into coarse grids and full-resolution tiles
+	GridCodec* coarseCodec; // Codec decoding the stream of coarse bathymetry and water level grids
+	std::vector<GridCodec::Value> lodGrids; // Quantized grids merged from coarse grids and full-resolution tiles
+	std::vector<GridCodec::Value> previousGrids; // Quantized grids of the previous update, to detect changed rows
+	unsigned int nextVersion; // Version number for the next set of grids
+	std::vector<unsigned int> rowVersions[2]; // Version numbers at which each row of the bathymetry and water level grids last changed
 	Threads::TripleBuffer<GridBuffers> grids; // Triple buffer of bathymetry and water level grids
 	unsigned int gridVersion; // Version number of currently locked grids
 	Vrui::Lightsource* sun; // Light source representing the sun
@@ -163,6 +188,8 @@ class SandboxClient:public Vrui::Application,public GLObject
 	
 	/* Private methods: */
 	void readGrids(void); // Reads a new set of bathymetry and water level grids from the remote AR Sandbox
+	Scalar intersectCell(const GridBuffers& gb,const Point& gp0,const Vector& gd,GLsizei cx,GLsizei cy,Scalar cl0,Scalar cl1) const; // Returns the intersection parameter of a line segment in grid coordinates with the bathymetry inside the given cell and parameter interval; returns 1.0 if there is no intersection
+	Scalar intersectBlock(const GridBuffers& gb,const Point& gp0,const Vector& gd,unsigned int level,GLsizei bx,GLsizei by,Scalar l0,Scalar l1) const; // Ditto, inside the given block of the given min/max pyramid level
 	Scalar intersectLine(const Point& p0,const Point& p1) const; // Returns the intersection parameter of a line segment with the bathymetry; returns 1.0 if there is no intersection
 	static bool serverMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a message arrives from the remote AR Sandbox
 	void* communicationThreadMethod(void); // Method handling communication with the remote AR Sandbox in the background
@@ -21,14 +21,176 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "ShaderHelper.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <string>
+#include <vector>
+#include <stdexcept>
+#include <Misc/ThrowStdErr.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
 #include <GL/gl.h>
+#include <GL/GLExtensionManager.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <GL/Extensions/GLARBVertexShader.h>
 
 #include "Config.h"
 
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_ARB_get_program_binary
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_COMPLETION_STATUS_ARB
+#define GL_COMPLETION_STATUS_ARB 0x91B1
+#endif
+
+namespace {
+
+/****************************
+Compute shader entry points:
+****************************/
+
+typedef void (APIENTRY * DispatchComputeProc)(GLuint numGroupsX,GLuint numGroupsY,GLuint numGroupsZ);
+typedef void (APIENTRY * BindImageTextureProc)(GLuint unit,GLuint texture,GLint level,GLboolean layered,GLint layer,GLenum access,GLenum format);
+typedef void (APIENTRY * MemoryBarrierProc)(GLbitfield barriers);
+
+DispatchComputeProc dispatchComputeProc=0;
+BindImageTextureProc bindImageTextureProc=0;
+MemoryBarrierProc memoryBarrierProc=0;
+
+/***********************
+Fence sync entry points:
+***********************/
+
+typedef GLsync (APIENTRY * FenceSyncProc)(GLenum condition,GLbitfield flags);
+typedef GLenum (APIENTRY * ClientWaitSyncProc)(GLsync sync,GLbitfield flags,Misc::UInt64 timeout);
+typedef void (APIENTRY * WaitSyncProc)(GLsync sync,GLbitfield flags,Misc::UInt64 timeout);
+typedef void (APIENTRY * DeleteSyncProc)(GLsync sync);
+
+FenceSyncProc fenceSyncProc=0;
+ClientWaitSyncProc clientWaitSyncProc=0;
+WaitSyncProc waitSyncProc=0;
+DeleteSyncProc deleteSyncProc=0;
+
+/**************************************
+Program binary entry points and state:
+**************************************/
+
+typedef void (APIENTRY * GetProgramBinaryProc)(GLuint program,GLsizei bufSize,GLsizei* length,GLenum* binaryFormat,void* binary);
+typedef void (APIENTRY * ProgramBinaryProc)(GLuint program,GLenum binaryFormat,const void* binary,GLsizei length);
+typedef void (APIENTRY * ProgramParameteriProc)(GLuint program,GLenum pname,GLint value);
+typedef void (APIENTRY * GetProgramivProc)(GLuint program,GLenum pname,GLint* params);
+
+std::string programBinaryDirectory; // Directory holding program binaries; empty if program binaries are disabled
+GetProgramBinaryProc getProgramBinaryProc=0;
+ProgramBinaryProc programBinaryProc=0;
+ProgramParameteriProc programParameteriProc=0;
+GetProgramivProc getProgramivProc=0;
+
+/****************
+Helper functions:
+****************/
+
+bool initProgramBinaries(void)
+	{
+	/* Check if program binaries are enabled and supported by the current OpenGL context: */
+	if(programBinaryDirectory.empty()||!GLExtensionManager::isExtensionSupported("GL_ARB_get_program_binary"))
+		return false;
+	
+	/* Retrieve the entry points: */
+	if(getProgramBinaryProc==0)
+		{
+		getProgramBinaryProc=GLExtensionManager::getFunction<GetProgramBinaryProc>("glGetProgramBinary");
+		programBinaryProc=GLExtensionManager::getFunction<ProgramBinaryProc>("glProgramBinary");
+		programParameteriProc=GLExtensionManager::getFunction<ProgramParameteriProc>("glProgramParameteri");
+		getProgramivProc=GLExtensionManager::getFunction<GetProgramivProc>("glGetProgramiv");
+		}
+	return getProgramBinaryProc!=0&&programBinaryProc!=0&&programParameteriProc!=0&&getProgramivProc!=0;
+	}
+
+bool initParallelShaderCompile(void)
+	{
+	/* Check if the current OpenGL context compiles and links shaders in the background: */
+	if(!GLExtensionManager::isExtensionSupported("GL_ARB_parallel_shader_compile")&&!GLExtensionManager::isExtensionSupported("GL_KHR_parallel_shader_compile"))
+		return false;
+	
+	/* Retrieve the entry point to query completion status: */
+	if(getProgramivProc==0)
+		getProgramivProc=GLExtensionManager::getFunction<GetProgramivProc>("glGetProgramiv");
+	return getProgramivProc!=0;
+	}
+
+Misc::UInt64 hashBytes(Misc::UInt64 hash,const void* bytes,size_t numBytes)
+	{
+	/* Update the 64-bit FNV-1a hash: */
+	const unsigned char* bPtr=static_cast<const unsigned char*>(bytes);
+	for(size_t i=0;i<numBytes;++i,++bPtr)
+		{
+		hash^=Misc::UInt64(*bPtr);
+		hash*=0x100000001b3ULL;
+		}
+	return hash;
+	}
+
+std::string getProgramBinaryFileName(Misc::UInt64 sourcesHash)
+	{
+	/* Name the program binary file after the sources hash: */
+	char hashBuffer[17];
+	snprintf(hashBuffer,sizeof(hashBuffer),"%016llx",(unsigned long long)sourcesHash);
+	std::string result=programBinaryDirectory;
+	result.push_back('/');
+	result.append(hashBuffer);
+	result.append(".bin");
+	return result;
+	}
+
+void saveProgramBinary(GLhandleARB shaderProgram,Misc::UInt64 sourcesHash)
+	{
+	/* Retrieve the linked program's binary: */
+	GLint binaryLength=0;
+	getProgramivProc(GLuint(shaderProgram),GL_PROGRAM_BINARY_LENGTH,&binaryLength);
+	if(binaryLength<=0)
+		return;
+	std::vector<char> binary(binaryLength);
+	GLsizei length=0;
+	GLenum binaryFormat=0;
+	getProgramBinaryProc(GLuint(shaderProgram),binaryLength,&length,&binaryFormat,&binary.front());
+	if(length<=0)
+		return;
+	
+	/* Write the binary to a temporary file and move it into place, so that concurrent readers never see a partial binary: */
+	std::string binaryFileName=getProgramBinaryFileName(sourcesHash);
+	char suffixBuffer[32];
+	snprintf(suffixBuffer,sizeof(suffixBuffer),".%d.%u.tmp",int(getpid()),(unsigned int)(shaderProgram));
+	std::string tempFileName=binaryFileName+suffixBuffer;
+	try
+		{
+		{
+		IO::FilePtr binaryFile=IO::openFile(tempFileName.c_str(),IO::File::WriteOnly);
+		binaryFile->write<Misc::UInt32>(binaryFormat);
+		binaryFile->write<Misc::UInt32>(length);
+		binaryFile->write(&binary.front(),length);
+		}
+		if(rename(tempFileName.c_str(),binaryFileName.c_str())!=0)
+			unlink(tempFileName.c_str());
+		}
+	catch(const std::runtime_error& err)
+		{
+		/* Ignore the error; the program will be compiled again on the next run: */
+		unlink(tempFileName.c_str());
+		}
+	}
+
+}
+
 GLhandleARB compileVertexShader(const char* vertexShaderFileName)
 	{
 	/* Construct the full shader source file name: */
@@ -53,18 +215,290 @@ GLhandleARB compileFragmentShader(const char* fragmentShaderFileName)
 	return glCompileFragmentShaderFromFile(fullShaderFileName.c_str());
 	}
 
+std::string readShaderSourceFile(const char* shaderFileName)
+	{
+	/* Construct the full shader source file name: */
+	std::string fullShaderFileName=CONFIG_SHADERDIR;
+	fullShaderFileName.push_back('/');
+	fullShaderFileName.append(shaderFileName);
+	
+	/* Read the entire shader source file: */
+	IO::FilePtr shaderFile=IO::openFile(fullShaderFileName.c_str());
+	std::string result;
+	char buffer[4096];
+	size_t readSize;
+	while((readSize=shaderFile->readUpTo(buffer,sizeof(buffer)))>0)
+		result.append(buffer,readSize);
+	
+	return result;
+	}
+
+bool setProgramBinaryDirectory(const char* newProgramBinaryDirectory)
+	{
+	programBinaryDirectory.clear();
+	if(newProgramBinaryDirectory==0||newProgramBinaryDirectory[0]=='\0')
+		return true;
+	
+	/* Create the directory and all its parents that do not exist yet: */
+	std::string directory=newProgramBinaryDirectory;
+	std::string::size_type slash=0;
+	do
+		{
+		slash=directory.find('/',slash+1);
+		std::string prefix=directory.substr(0,slash);
+		if(mkdir(prefix.c_str(),0755)!=0&&errno!=EEXIST)
+			return false;
+		}
+	while(slash!=std::string::npos);
+	
+	programBinaryDirectory=directory;
+	return true;
+	}
+
+Misc::UInt64 hashShaderSources(const ShaderSourceList& sources)
+	{
+	Misc::UInt64 hash=0xcbf29ce484222325ULL;
+	
+	/* Hash the OpenGL context's vendor, renderer, and version, as program binaries are only valid for the driver that created them: */
+	static const GLenum contextStrings[3]={GL_VENDOR,GL_RENDERER,GL_VERSION};
+	for(int i=0;i<3;++i)
+		{
+		const char* string=reinterpret_cast<const char*>(glGetString(contextStrings[i]));
+		if(string!=0)
+			hash=hashBytes(hash,string,strlen(string)+1);
+		}
+	
+	/* Hash the type and source code of each shader: */
+	for(ShaderSourceList::const_iterator sIt=sources.begin();sIt!=sources.end();++sIt)
+		{
+		Misc::UInt32 typeAndSize[2]={Misc::UInt32(sIt->shaderType),Misc::UInt32(sIt->source.size())};
+		hash=hashBytes(hash,typeAndSize,sizeof(typeAndSize));
+		hash=hashBytes(hash,sIt->source.data(),sIt->source.size());
+		}
+	
+	return hash;
+	}
+
+GLhandleARB loadProgramBinary(Misc::UInt64 sourcesHash)
+	{
+	if(!initProgramBinaries())
+		return 0;
+	
+	/* Read the program binary file: */
+	GLenum binaryFormat;
+	std::vector<char> binary;
+	try
+		{
+		IO::FilePtr binaryFile=IO::openFile(getProgramBinaryFileName(sourcesHash).c_str());
+		binaryFormat=binaryFile->read<Misc::UInt32>();
+		binary.resize(binaryFile->read<Misc::UInt32>());
+		if(binary.empty())
+			return 0;
+		binaryFile->read(&binary.front(),binary.size());
+		}
+	catch(const std::runtime_error& err)
+		{
+		/* There is no readable program binary: */
+		return 0;
+		}
+	
+	/* Load the program binary into a new shader program: */
+	GLhandleARB shaderProgram=glCreateProgramObjectARB();
+	programBinaryProc(GLuint(shaderProgram),binaryFormat,&binary.front(),GLsizei(binary.size()));
+	
+	/* Check if the driver accepted the program binary, which it may reject after a driver update: */
+	GLint linkStatus;
+	glGetObjectParameterivARB(shaderProgram,GL_OBJECT_LINK_STATUS_ARB,&linkStatus);
+	if(!linkStatus)
+		{
+		glDeleteObjectARB(shaderProgram);
+		return 0;
+		}
+	
+	return shaderProgram;
+	}
+
+bool hasParallelShaderCompile(void)
+	{
+	return initParallelShaderCompile();
+	}
+
+GLhandleARB startLinkShaderSources(const ShaderSourceList& sources)
+	{
+	/* Compile all shaders and attach them to a new shader program: */
+	GLhandleARB shaderProgram=glCreateProgramObjectARB();
+	for(ShaderSourceList::const_iterator sIt=sources.begin();sIt!=sources.end();++sIt)
+		{
+		GLhandleARB shader=glCreateShaderObjectARB(sIt->shaderType);
+		const GLcharARB* sourceString=sIt->source.c_str();
+		glShaderSourceARB(shader,1,&sourceString,0);
+		glCompileShaderARB(shader);
+		glAttachObjectARB(shaderProgram,shader);
+		
+		/* Release the shader (won't get deleted until shader program is released): */
+		glDeleteObjectARB(shader);
+		}
+	
+	/* Ask the driver to keep the program binary retrievable, and link the shader program: */
+	if(initProgramBinaries())
+		programParameteriProc(GLuint(shaderProgram),GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+	glLinkProgramARB(shaderProgram);
+	
+	return shaderProgram;
+	}
+
+bool isShaderProgramLinked(GLhandleARB shaderProgram)
+	{
+	/* Without parallel shader compilation, linking already finished or will finish on first use: */
+	if(!initParallelShaderCompile())
+		return true;
+	
+	GLint completionStatus;
+	getProgramivProc(GLuint(shaderProgram),GL_COMPLETION_STATUS_ARB,&completionStatus);
+	return completionStatus!=0;
+	}
+
+void finishLinkShaderSources(GLhandleARB shaderProgram,Misc::UInt64 sourcesHash)
+	{
+	/* Check if the shader program linked properly: */
+	GLint linkStatus;
+	glGetObjectParameterivARB(shaderProgram,GL_OBJECT_LINK_STATUS_ARB,&linkStatus);
+	if(!linkStatus)
+		{
+		/* Report the log of the first shader that failed to compile, or the program's link log: */
+		GLcharARB logBuffer[2048];
+		GLsizei logSize=0;
+		logBuffer[0]='\0';
+		GLhandleARB shaders[16];
+		GLsizei numShaders=0;
+		glGetAttachedObjectsARB(shaderProgram,16,&numShaders,shaders);
+		bool compileError=false;
+		for(GLsizei i=0;i<numShaders&&!compileError;++i)
+			{
+			GLint compileStatus;
+			glGetObjectParameterivARB(shaders[i],GL_OBJECT_COMPILE_STATUS_ARB,&compileStatus);
+			if(!compileStatus)
+				{
+				glGetInfoLogARB(shaders[i],sizeof(logBuffer),&logSize,logBuffer);
+				compileError=true;
+				}
+			}
+		if(!compileError)
+			glGetInfoLogARB(shaderProgram,sizeof(logBuffer),&logSize,logBuffer);
+		glDeleteObjectARB(shaderProgram);
+		Misc::throwStdErr("finishLinkShaderSources: Error \"%s\" while %s shader program",logBuffer,compileError?"compiling":"linking");
+		}
+	
+	/* Store the program binary for the next run: */
+	if(initProgramBinaries())
+		saveProgramBinary(shaderProgram,sourcesHash);
+	}
+
+GLhandleARB linkShaderSources(const ShaderSourceList& sources)
+	{
+	/* Load the shader program from its stored program binary if possible: */
+	Misc::UInt64 sourcesHash=hashShaderSources(sources);
+	GLhandleARB shaderProgram=loadProgramBinary(sourcesHash);
+	if(shaderProgram==0)
+		{
+		/* Compile and link the shader program: */
+		shaderProgram=startLinkShaderSources(sources);
+		finishLinkShaderSources(shaderProgram,sourcesHash);
+		}
+	
+	return shaderProgram;
+	}
+
 GLhandleARB linkVertexAndFragmentShader(const char* shaderFileName)
 	{
-	/* Compile the vertex and fragment shaders: */
-	GLhandleARB vertexShader=compileVertexShader(shaderFileName);
-	GLhandleARB fragmentShader=compileFragmentShader(shaderFileName);
+	/* Read the vertex and fragment shader sources: */
+	ShaderSourceList sources;
+	sources.push_back(ShaderSource(GL_VERTEX_SHADER_ARB,readShaderSourceFile((std::string(shaderFileName)+".vs").c_str())));
+	sources.push_back(ShaderSource(GL_FRAGMENT_SHADER_ARB,readShaderSourceFile((std::string(shaderFileName)+".fs").c_str())));
 	
 	/* Link the shader program: */
-	GLhandleARB shaderProgram=glLinkShader(vertexShader,fragmentShader);
+	return linkShaderSources(sources);
+	}
 	
-	/* Release the compiled shaders (won't get deleted until shader program is released): */
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+GLhandleARB linkVertexStringAndFragmentShader(const char* vertexShaderSource,const char* fragmentShaderFileName)
+	{
+	/* Collect the vertex and fragment shader sources: */
+	ShaderSourceList sources;
+	sources.push_back(ShaderSource(GL_VERTEX_SHADER_ARB,vertexShaderSource));
+	sources.push_back(ShaderSource(GL_FRAGMENT_SHADER_ARB,readShaderSourceFile((std::string(fragmentShaderFileName)+".fs").c_str())));
 	
-	return shaderProgram;
+	/* Link the shader program: */
+	return linkShaderSources(sources);
+	}
+
+bool initComputeShaders(void)
+	{
+	/* Check for the required extensions: */
+	if(!GLExtensionManager::isExtensionSupported("GL_ARB_compute_shader")||!GLExtensionManager::isExtensionSupported("GL_ARB_shader_image_load_store"))
+		return false;
+	
+	/* Retrieve the entry points: */
+	dispatchComputeProc=GLExtensionManager::getFunction<DispatchComputeProc>("glDispatchCompute");
+	bindImageTextureProc=GLExtensionManager::getFunction<BindImageTextureProc>("glBindImageTexture");
+	memoryBarrierProc=GLExtensionManager::getFunction<MemoryBarrierProc>("glMemoryBarrier");
+	return dispatchComputeProc!=0&&bindImageTextureProc!=0&&memoryBarrierProc!=0;
+	}
+
+GLhandleARB linkComputeShader(const char* computeShaderFileName)
+	{
+	/* Read the compute shader source: */
+	ShaderSourceList sources;
+	sources.push_back(ShaderSource(GL_COMPUTE_SHADER,readShaderSourceFile((std::string(computeShaderFileName)+".cs").c_str())));
+	
+	/* Link the shader program: */
+	return linkShaderSources(sources);
+	}
+
+void dispatchCompute(GLuint numGroupsX,GLuint numGroupsY)
+	{
+	dispatchComputeProc(numGroupsX,numGroupsY,1);
+	}
+
+void bindImageTexture(GLuint unit,GLuint textureObject,GLenum access,GLenum format)
+	{
+	bindImageTextureProc(unit,textureObject,0,GL_FALSE,0,access,format);
+	}
+
+void memoryBarrier(GLbitfield barriers)
+	{
+	memoryBarrierProc(barriers);
+	}
+
+bool initFenceSync(void)
+	{
+	/* Check for the required extension: */
+	if(!GLExtensionManager::isExtensionSupported("GL_ARB_sync"))
+		return false;
+	
+	/* Retrieve the entry points: */
+	fenceSyncProc=GLExtensionManager::getFunction<FenceSyncProc>("glFenceSync");
+	clientWaitSyncProc=GLExtensionManager::getFunction<ClientWaitSyncProc>("glClientWaitSync");
+	waitSyncProc=GLExtensionManager::getFunction<WaitSyncProc>("glWaitSync");
+	deleteSyncProc=GLExtensionManager::getFunction<DeleteSyncProc>("glDeleteSync");
+	return fenceSyncProc!=0&&clientWaitSyncProc!=0&&waitSyncProc!=0&&deleteSyncProc!=0;
+	}
+
+GLsync fenceSync(void)
+	{
+	return fenceSyncProc(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	}
+
+GLenum clientWaitSync(GLsync fence,Misc::UInt64 timeout)
+	{
+	return clientWaitSyncProc(fence,GL_SYNC_FLUSH_COMMANDS_BIT,timeout);
+	}
+
+void waitSync(GLsync fence)
+	{
+	waitSyncProc(fence,0,GL_TIMEOUT_IGNORED);
+	}
+
+void deleteSync(GLsync fence)
+	{
+	deleteSyncProc(fence);
 	}
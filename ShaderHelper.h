@@ -22,11 +22,71 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef SHADERHELPER_INCLUDED
 #define SHADERHELPER_INCLUDED
 
+#include <string>
+#include <vector>
+#include <Misc/SizedTypes.h>
 #include <GL/gl.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 
+/* Memory barrier bits of OpenGL 4.2 image load/store, in case the system's OpenGL headers predate them: */
+#ifndef GL_ARB_shader_image_load_store
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#define GL_PIXEL_BUFFER_BARRIER_BIT 0x00000080
+#define GL_TEXTURE_UPDATE_BARRIER_BIT 0x00000100
+#define GL_FRAMEBUFFER_BARRIER_BIT 0x00000400
+#endif
+
+/* Fence sync object type and constants of OpenGL 3.2, in case the system's OpenGL headers predate them: */
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+typedef struct __GLsync* GLsync;
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_WAIT_FAILED 0x911D
+#define GL_TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFull
+#endif
+
+struct ShaderSource // Structure holding the complete source code of one shader of a shader program
+	{
+	/* Elements: */
+	public:
+	GLenum shaderType; // Type of the shader, GL_VERTEX_SHADER_ARB, GL_FRAGMENT_SHADER_ARB, or GL_COMPUTE_SHADER
+	std::string source; // The shader's source code
+	
+	/* Constructors and destructors: */
+	ShaderSource(GLenum sShaderType,const std::string& sSource)
+		:shaderType(sShaderType),source(sSource)
+		{
+		}
+	};
+
+typedef std::vector<ShaderSource> ShaderSourceList; // Type for lists of shader sources making up a shader program
+
 GLhandleARB compileVertexShader(const char* vertexShaderFileName); // Returns a handle to a vertex shader compiled from the given source file in the SARndbox's shader directory
 GLhandleARB compileFragmentShader(const char* fragmentShaderFileName); // Returns a handle to a fragment shader compiled from the given source file in the SARndbox's shader directory
+std::string readShaderSourceFile(const char* shaderFileName); // Returns the contents of the given shader source file, including its extension, in the SARndbox's shader directory
+bool setProgramBinaryDirectory(const char* newProgramBinaryDirectory); // Sets the directory in which linked shader programs are stored as program binaries to be reused across runs, creating it if necessary; NULL or an empty name disables program binaries; returns false and disables program binaries if the directory cannot be created
+Misc::UInt64 hashShaderSources(const ShaderSourceList& sources); // Returns a hash of the given shader sources and the current OpenGL context's renderer and version
+GLhandleARB loadProgramBinary(Misc::UInt64 sourcesHash); // Returns a handle to a shader program loaded from the stored program binary for the given shader sources hash, or 0 if there is no valid binary
+bool hasParallelShaderCompile(void); // Returns true if the current OpenGL context compiles and links shader programs in the background
+GLhandleARB startLinkShaderSources(const ShaderSourceList& sources); // Returns a handle to a shader program that is being compiled and linked from the given shader sources, in the background if the OpenGL context supports parallel shader compilation
+bool isShaderProgramLinked(GLhandleARB shaderProgram); // Returns true if a shader program started by startLinkShaderSources has been compiled and linked
+void finishLinkShaderSources(GLhandleARB shaderProgram,Misc::UInt64 sourcesHash); // Waits for a shader program started by startLinkShaderSources to be linked, stores its program binary, and throws an exception and deletes the program if compiling or linking failed
+GLhandleARB linkShaderSources(const ShaderSourceList& sources); // Returns a handle to a shader program loaded from the stored program binary of the given shader sources, or compiled and linked from them
 GLhandleARB linkVertexAndFragmentShader(const char* shaderFileName); // Returns a handle to a shader program linked from a vertex shader and a fragment shader compiled from the given source files in the SARndbox's shader directory
+GLhandleARB linkVertexStringAndFragmentShader(const char* vertexShaderSource,const char* fragmentShaderFileName); // Returns a handle to a shader program linked from a vertex shader compiled from the given source code and a fragment shader compiled from the given source file in the SARndbox's shader directory
+bool initComputeShaders(void); // Returns true and retrieves the entry points used by the functions below if the current OpenGL context supports compute shaders and image load/store
+GLhandleARB linkComputeShader(const char* computeShaderFileName); // Returns a handle to a shader program linked from a compute shader compiled from the given source file in the SARndbox's shader directory
+void dispatchCompute(GLuint numGroupsX,GLuint numGroupsY); // Runs the current compute shader program on the given two-dimensional grid of work groups
+void bindImageTexture(GLuint unit,GLuint textureObject,GLenum access,GLenum format); // Binds level 0 of the given texture object to the given image unit
+void memoryBarrier(GLbitfield barriers); // Orders shader image writes before subsequent accesses of the given types
+bool initFenceSync(void); // Returns true and retrieves the entry points used by the functions below if the current OpenGL context supports fence sync objects
+GLsync fenceSync(void); // Returns a new fence that is signalled when all commands issued so far in the current OpenGL context have completed
+GLenum clientWaitSync(GLsync fence,Misc::UInt64 timeout); // Flushes the current OpenGL context and waits up to the given number of nanoseconds for the given fence; returns GL_ALREADY_SIGNALED, GL_CONDITION_SATISFIED, GL_TIMEOUT_EXPIRED, or GL_WAIT_FAILED
+void waitSync(GLsync fence); // Makes the GPU wait for the given fence before executing subsequent commands of the current OpenGL context, without blocking the CPU
+void deleteSync(GLsync fence); // Deletes the given fence
 
 #endif
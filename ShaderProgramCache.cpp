@@ -0,0 +1,116 @@
+/***********************************************************************
+ShaderProgramCache - Class to cache the shader programs built from
+generated shader sources in one OpenGL context, and to link anticipated
+shader programs in the background.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "ShaderProgramCache.h"
+
+#include <stdexcept>
+
+/***********************************
+Methods of class ShaderProgramCache:
+***********************************/
+
+ShaderProgramCache::ShaderProgramCache(void)
+	{
+	}
+
+ShaderProgramCache::~ShaderProgramCache(void)
+	{
+	/* Delete all cached shader programs: */
+	for(ProgramMap::iterator pIt=programs.begin();pIt!=programs.end();++pIt)
+		glDeleteObjectARB(pIt->second.program);
+	}
+
+GLhandleARB ShaderProgramCache::getProgram(const ShaderSourceList& sources)
+	{
+	/* Check if the shader program is already cached: */
+	Misc::UInt64 sourcesHash=hashShaderSources(sources);
+	ProgramMap::iterator pIt=programs.find(sourcesHash);
+	if(pIt!=programs.end())
+		{
+		if(pIt->second.pending)
+			{
+			/* Wait for the shader program to finish linking: */
+			GLhandleARB program=pIt->second.program;
+			programs.erase(pIt);
+			finishLinkShaderSources(program,sourcesHash);
+			programs.insert(ProgramMap::value_type(sourcesHash,Program(program,false)));
+			return program;
+			}
+		
+		return pIt->second.program;
+		}
+	
+	/* Load the shader program from its stored program binary, or compile and link it: */
+	GLhandleARB program=loadProgramBinary(sourcesHash);
+	if(program==0)
+		{
+		program=startLinkShaderSources(sources);
+		finishLinkShaderSources(program,sourcesHash);
+		}
+	programs.insert(ProgramMap::value_type(sourcesHash,Program(program,false)));
+	
+	return program;
+	}
+
+void ShaderProgramCache::precompile(const ShaderSourceList& sources)
+	{
+	/* Bail out if the shader program is already cached: */
+	Misc::UInt64 sourcesHash=hashShaderSources(sources);
+	if(programs.find(sourcesHash)!=programs.end())
+		return;
+	
+	/* Load the shader program from its stored program binary, which is fast: */
+	GLhandleARB program=loadProgramBinary(sourcesHash);
+	if(program!=0)
+		programs.insert(ProgramMap::value_type(sourcesHash,Program(program,false)));
+	else if(hasParallelShaderCompile())
+		{
+		/* Start linking the shader program in the background: */
+		programs.insert(ProgramMap::value_type(sourcesHash,Program(startLinkShaderSources(sources),true)));
+		}
+	}
+
+void ShaderProgramCache::update(void)
+	{
+	/* Finish all pending shader programs that have been linked: */
+	ProgramMap::iterator pIt=programs.begin();
+	while(pIt!=programs.end())
+		{
+		ProgramMap::iterator next=pIt;
+		++next;
+		if(pIt->second.pending&&isShaderProgramLinked(pIt->second.program))
+			{
+			try
+				{
+				finishLinkShaderSources(pIt->second.program,pIt->first);
+				pIt->second.pending=false;
+				}
+			catch(const std::runtime_error& err)
+				{
+				/* Drop the failed shader program, which has already been deleted; getProgram will report the error if the program is ever requested: */
+				programs.erase(pIt);
+				}
+			}
+		pIt=next;
+		}
+	}
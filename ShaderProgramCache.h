@@ -0,0 +1,72 @@
+/***********************************************************************
+ShaderProgramCache - Class to cache the shader programs built from
+generated shader sources in one OpenGL context, and to link anticipated
+shader programs in the background.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef SHADERPROGRAMCACHE_INCLUDED
+#define SHADERPROGRAMCACHE_INCLUDED
+
+#include <map>
+#include <Misc/SizedTypes.h>
+#include <GL/gl.h>
+#include <GL/Extensions/GLARBShaderObjects.h>
+
+#include "ShaderHelper.h"
+
+class ShaderProgramCache
+	{
+	/* Embedded classes: */
+	private:
+	struct Program // Structure for cached shader programs
+		{
+		/* Elements: */
+		public:
+		GLhandleARB program; // Handle of the shader program
+		bool pending; // Flag if the shader program is still being linked in the background
+		
+		/* Constructors and destructors: */
+		Program(GLhandleARB sProgram,bool sPending)
+			:program(sProgram),pending(sPending)
+			{
+			}
+		};
+	
+	typedef std::map<Misc::UInt64,Program> ProgramMap; // Type for maps from shader sources hashes to cached shader programs
+	
+	/* Elements: */
+	ProgramMap programs; // Map of cached shader programs
+	
+	/* Constructors and destructors: */
+	public:
+	ShaderProgramCache(void); // Creates an empty cache for the current OpenGL context
+	private:
+	ShaderProgramCache(const ShaderProgramCache& source); // Prohibit copy constructor
+	ShaderProgramCache& operator=(const ShaderProgramCache& source); // Prohibit assignment operator
+	public:
+	~ShaderProgramCache(void); // Deletes all cached shader programs
+	
+	/* Methods: */
+	GLhandleARB getProgram(const ShaderSourceList& sources); // Returns the cached shader program for the given sources, waiting for it if it is still being linked, or creates it; cache retains ownership; throws an exception if compiling or linking fails
+	void precompile(const ShaderSourceList& sources); // Starts linking the shader program for the given sources in the background if it is not cached yet and the OpenGL context supports parallel shader compilation
+	void update(void); // Finishes shader programs whose background linking has completed; drops shader programs that failed to link
+	};
+
+#endif
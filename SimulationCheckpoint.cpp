@@ -0,0 +1,109 @@
+/***********************************************************************
+SimulationCheckpoint - Class holding a complete copy of the water flow
+simulation's state, to save it to and restore it from compact binary
+checkpoint files.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "SimulationCheckpoint.h"
+
+#include <string.h>
+#include <Misc/SizedTypes.h>
+#include <Misc/ThrowStdErr.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+
+/*********************************************
+Static elements of class SimulationCheckpoint:
+*********************************************/
+
+const char SimulationCheckpoint::fileSignature[8]={'S','B','X','S','T','A','T','E'};
+
+/*************************************
+Methods of class SimulationCheckpoint:
+*************************************/
+
+SimulationCheckpoint::SimulationCheckpoint(void)
+	{
+	for(int i=0;i<2;++i)
+		size[i]=0;
+	}
+
+SimulationCheckpoint::SimulationCheckpoint(const int sSize[2],const float* sBathymetry,const float* sQuantity,const float* sSnow)
+	{
+	for(int i=0;i<2;++i)
+		size[i]=sSize[i];
+	
+	/* Copy the grids: */
+	size_t numVertices=size_t(size[1]-1)*size_t(size[0]-1);
+	size_t numCells=size_t(size[1])*size_t(size[0]);
+	bathymetry.assign(sBathymetry,sBathymetry+numVertices);
+	quantity.assign(sQuantity,sQuantity+numCells*3);
+	snow.assign(sSnow,sSnow+numCells*3);
+	}
+
+void SimulationCheckpoint::load(const char* checkpointFileName)
+	{
+	/* Open the checkpoint file and check its signature and version: */
+	IO::FilePtr file=IO::openFile(checkpointFileName);
+	file->setEndianness(Misc::LittleEndian);
+	char signature[8];
+	file->read<char>(signature,8);
+	if(memcmp(signature,fileSignature,8)!=0)
+		Misc::throwStdErr("SimulationCheckpoint::load: %s is not a checkpoint file",checkpointFileName);
+	Misc::UInt32 version=file->read<Misc::UInt32>();
+	if(version!=Misc::UInt32(fileVersion))
+		Misc::throwStdErr("SimulationCheckpoint::load: Checkpoint file %s has unsupported version %u",checkpointFileName,(unsigned int)version);
+	
+	/* Read the water table size: */
+	int newSize[2];
+	for(int i=0;i<2;++i)
+		newSize[i]=int(file->read<Misc::UInt32>());
+	if(newSize[0]<2||newSize[1]<2)
+		Misc::throwStdErr("SimulationCheckpoint::load: Checkpoint file %s has invalid size %d x %d",checkpointFileName,newSize[0],newSize[1]);
+	
+	/* Read the grids: */
+	size_t numVertices=size_t(newSize[1]-1)*size_t(newSize[0]-1);
+	size_t numCells=size_t(newSize[1])*size_t(newSize[0]);
+	bathymetry.resize(numVertices);
+	file->read<Misc::Float32>(&bathymetry[0],bathymetry.size());
+	quantity.resize(numCells*3);
+	file->read<Misc::Float32>(&quantity[0],quantity.size());
+	snow.resize(numCells*3);
+	file->read<Misc::Float32>(&snow[0],snow.size());
+	
+	for(int i=0;i<2;++i)
+		size[i]=newSize[i];
+	}
+
+void SimulationCheckpoint::save(const char* checkpointFileName) const
+	{
+	/* Write the header: */
+	IO::FilePtr file=IO::openFile(checkpointFileName,IO::File::WriteOnly);
+	file->setEndianness(Misc::LittleEndian);
+	file->write<char>(fileSignature,8);
+	file->write<Misc::UInt32>(Misc::UInt32(fileVersion));
+	for(int i=0;i<2;++i)
+		file->write<Misc::UInt32>(Misc::UInt32(size[i]));
+	
+	/* Write the grids: */
+	file->write<Misc::Float32>(&bathymetry[0],bathymetry.size());
+	file->write<Misc::Float32>(&quantity[0],quantity.size());
+	file->write<Misc::Float32>(&snow[0],snow.size());
+	}
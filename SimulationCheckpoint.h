@@ -0,0 +1,82 @@
+/***********************************************************************
+SimulationCheckpoint - Class holding a complete copy of the water flow
+simulation's state, to save it to and restore it from compact binary
+checkpoint files.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef SIMULATIONCHECKPOINT_INCLUDED
+#define SIMULATIONCHECKPOINT_INCLUDED
+
+#include <vector>
+
+/***********************************************************************
+Checkpoint files are little-endian and contain a header followed by the
+grids in row-major order, bottom row first:
+- char signature[8]: "SBXSTATE"
+- UInt32 version: file format version, currently 1
+- UInt32 size[2]: width and height of the water table in cells
+- Float32 bathymetry[(size[1]-1)*(size[0]-1)]: vertex-centered
+  bathymetry grid
+- Float32 quantity[size[1]*size[0]*3]: cell-centered conserved quantity
+  grid (w, hu, hv)
+- Float32 snow[size[1]*size[0]*3]: cell-centered snow grid
+***********************************************************************/
+
+class SimulationCheckpoint
+	{
+	/* Embedded classes: */
+	public:
+	static const char fileSignature[8]; // Signature identifying checkpoint files
+	static const unsigned int fileVersion=1U; // Current checkpoint file format version
+	
+	/* Elements: */
+	private:
+	int size[2]; // Width and height of the water table in cells
+	std::vector<float> bathymetry; // Vertex-centered bathymetry grid
+	std::vector<float> quantity; // Cell-centered conserved quantity grid
+	std::vector<float> snow; // Cell-centered snow grid
+	
+	/* Constructors and destructors: */
+	public:
+	SimulationCheckpoint(void); // Creates an empty checkpoint
+	SimulationCheckpoint(const int sSize[2],const float* sBathymetry,const float* sQuantity,const float* sSnow); // Creates a checkpoint by copying the given grids of a water table of the given size
+	
+	/* Methods: */
+	const int* getSize(void) const // Returns the water table size
+		{
+		return size;
+		}
+	const float* getBathymetry(void) const // Returns the bathymetry grid
+		{
+		return &bathymetry[0];
+		}
+	const float* getQuantity(void) const // Returns the conserved quantity grid
+		{
+		return &quantity[0];
+		}
+	const float* getSnow(void) const // Returns the snow grid
+		{
+		return &snow[0];
+		}
+	void load(const char* checkpointFileName); // Replaces the checkpoint with the contents of the given checkpoint file
+	void save(const char* checkpointFileName) const; // Writes the checkpoint to the given checkpoint file
+	};
+
+#endif
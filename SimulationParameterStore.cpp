@@ -0,0 +1,156 @@
+/***********************************************************************
+SimulationParameterStore - Class to collect run-time changes to water
+and snow simulation parameters from several threads, and to publish
+consistent snapshots of them to the simulation.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "SimulationParameterStore.h"
+
+#include <stdlib.h>
+#include <stdexcept>
+#include <iostream>
+#include <Misc/FunctionCalls.h>
+#include <IO/ValueSource.h>
+#include <IO/OpenFile.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void readSnowConfigFile(const char* fileName,GLfloat& criticalHeight,GLfloat& meltRate)
+	{
+	/* Read the critical height and the melt rate, each preceded by a comment line: */
+	IO::ValueSource snowConfigSource(IO::openFile(fileName));
+	snowConfigSource.skipWs();
+	snowConfigSource.readLine();
+	std::string line=snowConfigSource.readLine();
+	criticalHeight=GLfloat(atof(line.c_str()));
+	snowConfigSource.readLine();
+	line=snowConfigSource.readLine();
+	meltRate=GLfloat(atof(line.c_str()));
+	}
+
+}
+
+/*****************************************
+Methods of class SimulationParameterStore:
+*****************************************/
+
+void SimulationParameterStore::publishParameters(void)
+	{
+	snapshots.startNewValue()=parameters;
+	snapshots.postNewValue();
+	}
+
+void SimulationParameterStore::snowConfigFileChanged(const IO::FileMonitor::Event& event)
+	{
+	/* Parse the changed file outside the lock; keep the previous values if it cannot be read: */
+	GLfloat newCriticalHeight,newMeltRate;
+	try
+		{
+		readSnowConfigFile(snowConfigFileName.c_str(),newCriticalHeight,newMeltRate);
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"SimulationParameterStore: Cannot re-read snow configuration file "<<snowConfigFileName<<" due to exception "<<err.what()<<std::endl;
+		return;
+		}
+	
+	setSnowParameters(newCriticalHeight,newMeltRate);
+	}
+
+SimulationParameterStore::SimulationParameterStore(const SimulationParameters& sParameters)
+	:parameters(sParameters)
+	{
+	/* Publish the initial parameters: */
+	Threads::Mutex::Lock parametersLock(parametersMutex);
+	publishParameters();
+	}
+
+SimulationParameterStore::~SimulationParameterStore(void)
+	{
+	/* Stop watching the snow configuration file before the store goes away: */
+	fileMonitor.stopPolling();
+	}
+
+void SimulationParameterStore::watchSnowConfigFile(const char* newSnowConfigFileName)
+	{
+	/* Read the initial snow parameters; throws an exception if the file cannot be read: */
+	snowConfigFileName=newSnowConfigFileName;
+	GLfloat newCriticalHeight,newMeltRate;
+	readSnowConfigFile(snowConfigFileName.c_str(),newCriticalHeight,newMeltRate);
+	setSnowParameters(newCriticalHeight,newMeltRate);
+	
+	/* Re-read the file on the file monitor's background thread whenever it changes: */
+	fileMonitor.addPath(snowConfigFileName.c_str(),IO::FileMonitor::Modified,Misc::createFunctionCall(this,&SimulationParameterStore::snowConfigFileChanged));
+	fileMonitor.startPolling();
+	}
+
+void SimulationParameterStore::setWaterSpeed(double newWaterSpeed)
+	{
+	Threads::Mutex::Lock parametersLock(parametersMutex);
+	parameters.waterSpeed=newWaterSpeed;
+	publishParameters();
+	}
+
+void SimulationParameterStore::setWaterMaxSteps(unsigned int newWaterMaxSteps)
+	{
+	Threads::Mutex::Lock parametersLock(parametersMutex);
+	parameters.waterMaxSteps=newWaterMaxSteps;
+	publishParameters();
+	}
+
+void SimulationParameterStore::setAttenuation(GLfloat newAttenuation)
+	{
+	Threads::Mutex::Lock parametersLock(parametersMutex);
+	parameters.attenuation=newAttenuation;
+	publishParameters();
+	}
+
+void SimulationParameterStore::setWaterDeposit(GLfloat newWaterDeposit)
+	{
+	Threads::Mutex::Lock parametersLock(parametersMutex);
+	parameters.waterDeposit=newWaterDeposit;
+	publishParameters();
+	}
+
+void SimulationParameterStore::addWaterDeposit(GLfloat waterDepositDelta)
+	{
+	Threads::Mutex::Lock parametersLock(parametersMutex);
+	parameters.waterDeposit+=waterDepositDelta;
+	publishParameters();
+	}
+
+void SimulationParameterStore::setSnowParameters(GLfloat newCriticalHeight,GLfloat newMeltRate)
+	{
+	Threads::Mutex::Lock parametersLock(parametersMutex);
+	parameters.criticalHeight=newCriticalHeight;
+	parameters.meltRate=newMeltRate;
+	publishParameters();
+	}
+
+void SimulationParameterStore::setRainDisks(const std::vector<SimulationParameters::RainDisk>& newRainDisks)
+	{
+	Threads::Mutex::Lock parametersLock(parametersMutex);
+	parameters.rainDisks=newRainDisks;
+	publishParameters();
+	}
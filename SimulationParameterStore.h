@@ -0,0 +1,100 @@
+/***********************************************************************
+SimulationParameterStore - Class to collect run-time changes to water
+and snow simulation parameters from several threads, and to publish
+consistent snapshots of them to the simulation.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef SIMULATIONPARAMETERSTORE_INCLUDED
+#define SIMULATIONPARAMETERSTORE_INCLUDED
+
+#include <string>
+#include <vector>
+#include <Threads/Mutex.h>
+#include <Threads/TripleBuffer.h>
+#include <IO/FileMonitor.h>
+#include <GL/gl.h>
+
+#include "Types.h"
+
+struct SimulationParameters // Structure holding the water and snow simulation parameters that can change at run-time
+	{
+	/* Embedded classes: */
+	public:
+	struct RainDisk // Structure for a disk raining water onto the simulation, approximating a detected hand
+		{
+		/* Elements: */
+		public:
+		Point center; // Disk center
+		Scalar radius; // Disk radius
+		};
+	
+	/* Elements: */
+	double waterSpeed; // Relative speed of water flow simulation
+	unsigned int waterMaxSteps; // Maximum number of water simulation steps per frame
+	GLfloat attenuation; // Attenuation factor for partial discharges
+	GLfloat waterDeposit; // Amount of water deposited on every simulation step
+	GLfloat criticalHeight; // Elevation above which water freezes into snow
+	GLfloat meltRate; // Rate at which snow below the critical height melts
+	std::vector<RainDisk> rainDisks; // Disks raining water onto the simulation, copied from the most recent extracted hand list
+	};
+
+class SimulationParameterStore
+	{
+	/* Elements: */
+	private:
+	Threads::Mutex parametersMutex; // Mutex serializing parameter updates from the GUI, the control pipe, and the file monitor's background thread
+	SimulationParameters parameters; // Most recent parameters; protected by parametersMutex
+	Threads::TripleBuffer<SimulationParameters> snapshots; // Triple buffer publishing parameter snapshots to the simulation without blocking it
+	std::string snowConfigFileName; // Name of the watched snow configuration file, or empty
+	IO::FileMonitor fileMonitor; // Monitor to watch the snow configuration file in a background thread
+	
+	/* Private methods: */
+	void publishParameters(void); // Publishes a snapshot of the current parameters; must be called with parametersMutex locked
+	void snowConfigFileChanged(const IO::FileMonitor::Event& event); // Callback when the snow configuration file changed
+	
+	/* Constructors and destructors: */
+	public:
+	SimulationParameterStore(const SimulationParameters& sParameters); // Creates a store holding the given initial parameters
+	private:
+	SimulationParameterStore(const SimulationParameterStore& source); // Prohibit copy constructor
+	SimulationParameterStore& operator=(const SimulationParameterStore& source); // Prohibit assignment operator
+	public:
+	~SimulationParameterStore(void);
+	
+	/* Methods: */
+	void watchSnowConfigFile(const char* newSnowConfigFileName); // Reads the critical height and melt rate from the given snow configuration file, and re-reads them in a background thread whenever the file changes
+	void setWaterSpeed(double newWaterSpeed); // Sets the relative speed of water flow simulation
+	void setWaterMaxSteps(unsigned int newWaterMaxSteps); // Sets the maximum number of water simulation steps per frame
+	void setAttenuation(GLfloat newAttenuation); // Sets the attenuation factor for partial discharges
+	void setWaterDeposit(GLfloat newWaterDeposit); // Sets the amount of water deposited on every simulation step
+	void addWaterDeposit(GLfloat waterDepositDelta); // Adds the given amount to the amount of water deposited on every simulation step
+	void setSnowParameters(GLfloat newCriticalHeight,GLfloat newMeltRate); // Sets the critical height and the snow melt rate
+	void setRainDisks(const std::vector<SimulationParameters::RainDisk>& newRainDisks); // Sets the disks raining water onto the simulation
+	bool lockNewSnapshot(void) // Locks the most recently published parameter snapshot without blocking; returns true if it changed since the last call; must only be called from a single thread
+		{
+		return snapshots.lockNewValue();
+		}
+	const SimulationParameters& getSnapshot(void) const // Returns the locked parameter snapshot
+		{
+		return snapshots.getLockedValue();
+		}
+	};
+
+#endif
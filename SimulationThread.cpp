@@ -0,0 +1,242 @@
+/***********************************************************************
+SimulationThread - Class to run the water flow simulation at a fixed
+rate on a background thread with its own OpenGL context, which shares
+objects with a render context and publishes each new simulation state
+to it.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "SimulationThread.h"
+
+#include <time.h>
+#include <stdexcept>
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#include <GL/gl.h>
+#include <GL/GLExtensionManager.h>
+#include <GL/GLContextData.h>
+
+#include "DepthImageRenderer.h"
+#include "WaterTable2.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void advanceTime(struct timespec& time,double interval)
+	{
+	long nsec=time.tv_nsec+long(interval*1.0e9);
+	time.tv_sec+=nsec/1000000000L;
+	time.tv_nsec=nsec%1000000000L;
+	}
+
+bool isEarlier(const struct timespec& time0,const struct timespec& time1)
+	{
+	return time0.tv_sec<time1.tv_sec||(time0.tv_sec==time1.tv_sec&&time0.tv_nsec<time1.tv_nsec);
+	}
+
+}
+
+/*********************************
+Methods of class SimulationThread:
+*********************************/
+
+void SimulationThread::release(void)
+	{
+	if(display!=0)
+		{
+		/* Destroy the context and pbuffer; the X connection belongs to the render context: */
+		XLockDisplay(display);
+		if(context!=0)
+			glXDestroyContext(display,context);
+		if(pbuffer!=None)
+			glXDestroyPbuffer(display,pbuffer);
+		XUnlockDisplay(display);
+		}
+	display=0;
+	pbuffer=None;
+	context=0;
+	}
+
+void* SimulationThread::simulationThreadMethod(void)
+	{
+	/* Make the simulation context current on this thread: */
+	XLockDisplay(display);
+	bool current=glXMakeContextCurrent(display,pbuffer,pbuffer,context);
+	XUnlockDisplay(display);
+	
+	/* Check whether the simulation context sees objects created in the render context, and report the result: */
+	bool shared=current&&glIsTexture(shareTestTextureObject);
+	{
+	Threads::MutexCond::Lock startLock(startCond);
+	startResult=shared?1:-1;
+	startCond.signal();
+	}
+	if(!shared)
+		{
+		if(current)
+			{
+			XLockDisplay(display);
+			glXMakeContextCurrent(display,None,None,0);
+			XUnlockDisplay(display);
+			}
+		return 0;
+		}
+	
+	/* Initialize the OpenGL extension manager and context data: */
+	GLExtensionManager* extensionManager=new GLExtensionManager;
+	GLExtensionManager::makeCurrent(extensionManager);
+	GLContextData* contextData=new GLContextData(17);
+	GLContextData::makeCurrent(contextData);
+	
+	/* Initialize the depth image renderer and the water table in the simulation context: */
+	depthImageRenderer->initContext(*contextData);
+	waterTable->initContext(*contextData);
+	
+	/* Run simulation ticks at the fixed rate: */
+	struct timespec nextTick;
+	clock_gettime(CLOCK_MONOTONIC,&nextTick);
+	while(runSimulationThread)
+		{
+		/* Advance the simulation and publish its new state to the render context: */
+		(*tickFunction)(*contextData);
+		waterTable->publishState(*contextData);
+		
+		/* Wait for the next tick, or start it immediately and drop the missed ticks if the simulation fell behind: */
+		advanceTime(nextTick,tickInterval);
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		if(isEarlier(nextTick,now))
+			nextTick=now;
+		else
+			clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&nextTick,0);
+		}
+	
+	/* Release the context data and extension manager before the OpenGL context: */
+	GLContextData::makeCurrent(0);
+	delete contextData;
+	GLExtensionManager::makeCurrent(0);
+	delete extensionManager;
+	XLockDisplay(display);
+	glXMakeContextCurrent(display,None,None,0);
+	XUnlockDisplay(display);
+	
+	return 0;
+	}
+
+SimulationThread::SimulationThread(const DepthImageRenderer* sDepthImageRenderer,const WaterTable2* sWaterTable,double rate,SimulationThread::TickFunction* sTickFunction)
+	:depthImageRenderer(sDepthImageRenderer),waterTable(sWaterTable),
+	 tickInterval(1.0/rate),tickFunction(sTickFunction),
+	 display(0),pbuffer(None),renderContext(0),context(0),
+	 shareTestTextureObject(0),startResult(0),
+	 runSimulationThread(false)
+	{
+	/* Make Xlib thread-safe before Vrui opens its windows, so that the simulation thread can share the render context's X connection: */
+	XInitThreads();
+	}
+
+SimulationThread::~SimulationThread(void)
+	{
+	/* Shut down the simulation thread: */
+	if(runSimulationThread)
+		{
+		runSimulationThread=false;
+		simulationThread.join();
+		}
+	release();
+	delete tickFunction;
+	}
+
+void SimulationThread::start(void)
+	{
+	/* Remember the current render context: */
+	display=glXGetCurrentDisplay();
+	renderContext=glXGetCurrentContext();
+	if(display==0||renderContext==0)
+		{
+		display=0;
+		throw std::runtime_error("SimulationThread: No current render context");
+		}
+	
+	/* Create the simulation context on the render context's own X connection, as direct rendering contexts can only share objects within one connection: */
+	XLockDisplay(display);
+	
+	/* Find a frame buffer configuration supporting pbuffers on the render context's screen: */
+	int screen=DefaultScreen(display);
+	glXQueryContext(display,renderContext,GLX_SCREEN,&screen);
+	int fbConfigAttribs[]={GLX_DRAWABLE_TYPE,GLX_PBUFFER_BIT,GLX_RENDER_TYPE,GLX_RGBA_BIT,GLX_RED_SIZE,8,GLX_GREEN_SIZE,8,GLX_BLUE_SIZE,8,None};
+	int numFbConfigs=0;
+	GLXFBConfig* fbConfigs=glXChooseFBConfig(display,screen,fbConfigAttribs,&numFbConfigs);
+	if(fbConfigs==0||numFbConfigs==0)
+		{
+		XUnlockDisplay(display);
+		release();
+		throw std::runtime_error("SimulationThread: No pbuffer-capable frame buffer configuration");
+		}
+	
+	/* Create a small pbuffer and an OpenGL context sharing objects with the render context; all simulation passes render into frame buffer objects: */
+	int pbufferAttribs[]={GLX_PBUFFER_WIDTH,16,GLX_PBUFFER_HEIGHT,16,None};
+	pbuffer=glXCreatePbuffer(display,fbConfigs[0],pbufferAttribs);
+	context=glXCreateNewContext(display,fbConfigs[0],GLX_RGBA_TYPE,renderContext,True);
+	XFree(fbConfigs);
+	XUnlockDisplay(display);
+	if(pbuffer==None||context==0)
+		{
+		release();
+		throw std::runtime_error("SimulationThread: Unable to create shared OpenGL context");
+		}
+	
+	/* Create a texture object in the render context for the simulation thread to look for: */
+	GLint currentTexture;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D,&currentTexture);
+	glGenTextures(1,&shareTestTextureObject);
+	glBindTexture(GL_TEXTURE_2D,shareTestTextureObject);
+	glBindTexture(GL_TEXTURE_2D,currentTexture);
+	glFlush();
+	
+	/* Start the simulation thread and wait until it has checked that its context shares objects with the render context: */
+	startResult=0;
+	runSimulationThread=true;
+	simulationThread.start(this,&SimulationThread::simulationThreadMethod);
+	int result;
+	{
+	Threads::MutexCond::Lock startLock(startCond);
+	while(startResult==0)
+		startCond.wait(startLock);
+	result=startResult;
+	}
+	glDeleteTextures(1,&shareTestTextureObject);
+	shareTestTextureObject=0;
+	
+	if(result<0)
+		{
+		/* Shut down the simulation thread, which already bailed out, and let the caller run the simulation in the render contexts: */
+		runSimulationThread=false;
+		simulationThread.join();
+		release();
+		throw std::runtime_error("SimulationThread: OpenGL context does not share objects with the render context");
+		}
+	}
+
+bool SimulationThread::sharesCurrentContext(void) const
+	{
+	return context!=0&&glXGetCurrentContext()==renderContext;
+	}
@@ -0,0 +1,88 @@
+/***********************************************************************
+SimulationThread - Class to run the water flow simulation at a fixed
+rate on a background thread with its own OpenGL context, which shares
+objects with a render context and publishes each new simulation state
+to it.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef SIMULATIONTHREAD_INCLUDED
+#define SIMULATIONTHREAD_INCLUDED
+
+#include <Misc/FunctionCalls.h>
+#include <Threads/MutexCond.h>
+#include <Threads/Thread.h>
+#include <GL/gl.h>
+
+/* Forward declarations: */
+struct _XDisplay;
+struct __GLXcontextRec;
+class GLContextData;
+class DepthImageRenderer;
+class WaterTable2;
+
+class SimulationThread
+	{
+	/* Embedded classes: */
+	public:
+	typedef Misc::FunctionCall<GLContextData&> TickFunction; // Type for functions advancing the simulation by one tick in the simulation thread's OpenGL context
+	
+	/* Elements: */
+	private:
+	const DepthImageRenderer* depthImageRenderer; // Renderer object used to update the water table's bathymetry grid
+	const WaterTable2* waterTable; // The simulated water table
+	double tickInterval; // Wall-clock time between simulation ticks in seconds
+	TickFunction* tickFunction; // Function advancing the simulation by one tick
+	_XDisplay* display; // The render context's connection to the X server, which the simulation thread uses under Xlib's display lock
+	unsigned long pbuffer; // Pbuffer to which the simulation thread's OpenGL context is bound
+	__GLXcontextRec* renderContext; // The render context sharing objects with the simulation thread's OpenGL context
+	__GLXcontextRec* context; // The simulation thread's OpenGL context
+	GLuint shareTestTextureObject; // Texture object created in the render context that the simulation thread's context must see if sharing works
+	Threads::MutexCond startCond; // Condition variable to signal the result of the share test to the thread starting the simulation thread
+	int startResult; // Result of the share test: 0 while pending, 1 if objects are shared, -1 otherwise
+	volatile bool runSimulationThread; // Flag to keep the simulation thread running
+	Threads::Thread simulationThread; // The background simulation thread
+	
+	/* Private methods: */
+	void release(void); // Releases all X and GLX resources
+	void* simulationThreadMethod(void); // Method running the simulation ticks
+	
+	/* Constructors and destructors: */
+	public:
+	SimulationThread(const DepthImageRenderer* sDepthImageRenderer,const WaterTable2* sWaterTable,double rate,TickFunction* sTickFunction); // Creates a simulation thread running the given tick function at the given rate in Hz; adopts the tick function object; must be created before the first X connection is opened
+	private:
+	SimulationThread(const SimulationThread& source); // Prohibit copy constructor
+	SimulationThread& operator=(const SimulationThread& source); // Prohibit assignment operator
+	public:
+	~SimulationThread(void); // Stops the simulation thread if it is running
+	
+	/* Methods: */
+	double getTickInterval(void) const // Returns the wall-clock time between simulation ticks in seconds
+		{
+		return tickInterval;
+		}
+	bool isRunning(void) const // Returns true if the simulation thread has been started
+		{
+		return context!=0;
+		}
+	void start(void); // Starts the simulation thread with an OpenGL context sharing objects with the current render context; throws an exception if the context cannot be created or does not share objects
+	bool sharesCurrentContext(void) const; // Returns true if the current OpenGL context is the render context sharing objects with the simulation thread
+	};
+
+#endif
@@ -0,0 +1,381 @@
+/***********************************************************************
+StageTimers - Class to measure the time spent in the stages of the
+water simulation, rendering, and input processing pipelines, using
+non-stalling GPU timer queries and CPU scoped timers, and to keep
+rolling statistics of the measured times.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "StageTimers.h"
+
+#include <time.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+#include <IO/OStream.h>
+#include <GL/GLContextData.h>
+#include <GL/GLExtensionManager.h>
+
+/* Timer query constants of OpenGL 3.3, in case the system's OpenGL headers predate them: */
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+namespace {
+
+/************************
+Timer query entry points:
+************************/
+
+typedef void (APIENTRY * GenQueriesProc)(GLsizei n,GLuint* ids);
+typedef void (APIENTRY * DeleteQueriesProc)(GLsizei n,const GLuint* ids);
+typedef void (APIENTRY * BeginQueryProc)(GLenum target,GLuint id);
+typedef void (APIENTRY * EndQueryProc)(GLenum target);
+typedef void (APIENTRY * QueryCounterProc)(GLuint id,GLenum target);
+typedef void (APIENTRY * GetQueryObjectivProc)(GLuint id,GLenum pname,GLint* params);
+typedef void (APIENTRY * GetQueryObjectui64vProc)(GLuint id,GLenum pname,unsigned long long* params);
+
+GenQueriesProc genQueriesProc=0;
+DeleteQueriesProc deleteQueriesProc=0;
+BeginQueryProc beginQueryProc=0;
+EndQueryProc endQueryProc=0;
+QueryCounterProc queryCounterProc=0;
+GetQueryObjectivProc getQueryObjectivProc=0;
+GetQueryObjectui64vProc getQueryObjectui64vProc=0;
+
+/****************
+Helper functions:
+****************/
+
+bool initTimerQuery(void)
+	{
+	/* Check for the required extension: */
+	if(!GLExtensionManager::isExtensionSupported("GL_ARB_timer_query"))
+		return false;
+	
+	/* Retrieve the entry points: */
+	genQueriesProc=GLExtensionManager::getFunction<GenQueriesProc>("glGenQueries");
+	deleteQueriesProc=GLExtensionManager::getFunction<DeleteQueriesProc>("glDeleteQueries");
+	beginQueryProc=GLExtensionManager::getFunction<BeginQueryProc>("glBeginQuery");
+	endQueryProc=GLExtensionManager::getFunction<EndQueryProc>("glEndQuery");
+	queryCounterProc=GLExtensionManager::getFunction<QueryCounterProc>("glQueryCounter");
+	getQueryObjectivProc=GLExtensionManager::getFunction<GetQueryObjectivProc>("glGetQueryObjectiv");
+	getQueryObjectui64vProc=GLExtensionManager::getFunction<GetQueryObjectui64vProc>("glGetQueryObjectui64v");
+	return genQueriesProc!=0&&deleteQueriesProc!=0&&beginQueryProc!=0&&endQueryProc!=0&&queryCounterProc!=0&&getQueryObjectivProc!=0&&getQueryObjectui64vProc!=0;
+	}
+
+double getMonotonicTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)/1.0e9;
+	}
+
+}
+
+/**************************************
+Methods of class StageTimers::CPUTimer:
+**************************************/
+
+StageTimers::CPUTimer::CPUTimer(const StageTimers* sTimers,StageTimers::Stage sStage)
+	:timers(sTimers),stage(sStage),
+	 start(timers!=0?getMonotonicTime():0.0)
+	{
+	}
+
+StageTimers::CPUTimer::~CPUTimer(void)
+	{
+	if(timers!=0)
+		timers->addSample(stage,getMonotonicTime()-start);
+	}
+
+/**************************************
+Methods of class StageTimers::GPUTimer:
+**************************************/
+
+StageTimers::GPUTimer::GPUTimer(const StageTimers* timers,StageTimers::Stage stage,GLContextData& contextData)
+	:dataItem(0)
+	{
+	if(timers==0)
+		return;
+	
+	/* Get the data item and bail out if timer queries are unavailable or already active: */
+	DataItem* di=timers->getDataItem(contextData);
+	if(!di->haveTimerQuery||di->queryActive)
+		return;
+	
+	/* Collect the stage's finished queries, and start a query in a free slot: */
+	timers->collectQueries(di,stage);
+	for(int i=0;i<2;++i)
+		if(!di->queryPending[stage][i])
+			{
+			(*beginQueryProc)(GL_TIME_ELAPSED,di->queryObjects[stage][i]);
+			di->queryPending[stage][i]=true;
+			di->queryActive=true;
+			dataItem=di;
+			break;
+			}
+	}
+
+StageTimers::GPUTimer::~GPUTimer(void)
+	{
+	if(dataItem!=0)
+		{
+		(*endQueryProc)(GL_TIME_ELAPSED);
+		dataItem->queryActive=false;
+		}
+	}
+
+/******************************************
+Methods of class StageTimers::GPUSpanTimer:
+******************************************/
+
+StageTimers::GPUSpanTimer::GPUSpanTimer(const StageTimers* timers,StageTimers::Stage sStage,GLContextData& contextData)
+	:dataItem(0),stage(sStage),slot(0)
+	{
+	if(timers==0)
+		return;
+	
+	/* Get the data item and bail out if timer queries are unavailable: */
+	DataItem* di=timers->getDataItem(contextData);
+	if(!di->haveTimerQuery)
+		return;
+	
+	/* Collect the stage's finished queries, and query the start timestamp in a free slot: */
+	timers->collectQueries(di,stage);
+	for(int i=0;i<2;++i)
+		if(!di->timestampQueryPending[stage][i])
+			{
+			(*queryCounterProc)(di->timestampQueryObjects[stage][i][0],GL_TIMESTAMP);
+			dataItem=di;
+			slot=i;
+			break;
+			}
+	}
+
+StageTimers::GPUSpanTimer::~GPUSpanTimer(void)
+	{
+	if(dataItem!=0)
+		{
+		(*queryCounterProc)(dataItem->timestampQueryObjects[stage][slot][1],GL_TIMESTAMP);
+		dataItem->timestampQueryPending[stage][slot]=true;
+		}
+	}
+
+/**************************************
+Methods of class StageTimers::DataItem:
+**************************************/
+
+StageTimers::DataItem::DataItem(void)
+	:haveTimerQuery(initTimerQuery()),
+	 queryActive(false)
+	{
+	for(int stage=0;stage<NUM_STAGES;++stage)
+		for(int i=0;i<2;++i)
+			{
+			queryObjects[stage][i]=0;
+			queryPending[stage][i]=false;
+			for(int j=0;j<2;++j)
+				timestampQueryObjects[stage][i][j]=0;
+			timestampQueryPending[stage][i]=false;
+			}
+	
+	/* Create all timer and timestamp query objects: */
+	if(haveTimerQuery)
+		{
+		(*genQueriesProc)(NUM_STAGES*2,queryObjects[0]);
+		(*genQueriesProc)(NUM_STAGES*2*2,timestampQueryObjects[0][0]);
+		}
+	}
+
+StageTimers::DataItem::~DataItem(void)
+	{
+	/* Delete all timer and timestamp query objects: */
+	if(haveTimerQuery)
+		{
+		(*deleteQueriesProc)(NUM_STAGES*2,queryObjects[0]);
+		(*deleteQueriesProc)(NUM_STAGES*2*2,timestampQueryObjects[0][0]);
+		}
+	}
+
+/****************************
+Methods of class StageTimers:
+****************************/
+
+StageTimers::DataItem* StageTimers::getDataItem(GLContextData& contextData) const
+	{
+	/* Get the data item, and create it if this object was not initialized in the context, as in the water simulation thread's context: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	if(dataItem==0)
+		{
+		dataItem=new DataItem;
+		contextData.addDataItem(this,dataItem);
+		}
+	
+	return dataItem;
+	}
+
+void StageTimers::collectQueries(StageTimers::DataItem* dataItem,StageTimers::Stage stage) const
+	{
+	for(int i=0;i<2;++i)
+		if(dataItem->queryPending[stage][i])
+			{
+			/* Check if the query's result is available without waiting for it: */
+			GLint available=0;
+			(*getQueryObjectivProc)(dataItem->queryObjects[stage][i],GL_QUERY_RESULT_AVAILABLE,&available);
+			if(available)
+				{
+				/* Add the measured time to the stage: */
+				unsigned long long elapsed=0;
+				(*getQueryObjectui64vProc)(dataItem->queryObjects[stage][i],GL_QUERY_RESULT,&elapsed);
+				addSample(stage,double(elapsed)*1.0e-9);
+				dataItem->queryPending[stage][i]=false;
+				}
+			}
+	
+	for(int i=0;i<2;++i)
+		if(dataItem->timestampQueryPending[stage][i])
+			{
+			/* Check if the end timestamp is available without waiting for it, which implies that the start timestamp is available as well: */
+			GLint available=0;
+			(*getQueryObjectivProc)(dataItem->timestampQueryObjects[stage][i][1],GL_QUERY_RESULT_AVAILABLE,&available);
+			if(available)
+				{
+				/* Add the time between the two timestamps to the stage: */
+				unsigned long long timestamps[2]={0,0};
+				for(int j=0;j<2;++j)
+					(*getQueryObjectui64vProc)(dataItem->timestampQueryObjects[stage][i][j],GL_QUERY_RESULT,&timestamps[j]);
+				addSample(stage,double(timestamps[1]-timestamps[0])*1.0e-9);
+				dataItem->timestampQueryPending[stage][i]=false;
+				}
+			}
+	}
+
+StageTimers::StageTimers(void)
+	:traceFile(0)
+	{
+	for(int stage=0;stage<NUM_STAGES;++stage)
+		{
+		StageSamples& ss=stageSamples[stage];
+		ss.numSamples=0;
+		ss.nextSample=0;
+		ss.traceTime=0.0;
+		}
+	}
+
+StageTimers::~StageTimers(void)
+	{
+	delete traceFile;
+	}
+
+void StageTimers::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	}
+
+const char* StageTimers::getStageName(StageTimers::Stage stage)
+	{
+	static const char* stageNames[NUM_STAGES]=
+		{
+		"Derivative","Max Step Size","Euler Step","Runge-Kutta Step","Boundary","Snow Step","Water Add","Water Simulation",
+		"Bathymetry","Surface","Water Surface","Frame Filter","Hand Extractor","Remote Server"
+		};
+	
+	return stageNames[stage];
+	}
+
+void StageTimers::openTraceFile(const char* traceFileName)
+	{
+	/* Open the trace file and write the CSV header: */
+	IO::OStream* newTraceFile=new IO::OStream(IO::openFile(traceFileName,IO::File::WriteOnly));
+	*newTraceFile<<"\"Time\",\"Frame Time\"";
+	for(int stage=0;stage<NUM_STAGES;++stage)
+		*newTraceFile<<",\""<<getStageName(Stage(stage))<<'"';
+	*newTraceFile<<std::endl;
+	
+	/* Replace the current trace file: */
+	delete traceFile;
+	traceFile=newTraceFile;
+	}
+
+void StageTimers::addSample(StageTimers::Stage stage,double time) const
+	{
+	Threads::Mutex::Lock samplesLock(samplesMutex);
+	
+	/* Store the measurement in the stage's rolling window and add it to the per-frame total: */
+	StageSamples& ss=stageSamples[stage];
+	ss.samples[ss.nextSample]=time;
+	if(++ss.nextSample==windowSize)
+		ss.nextSample=0;
+	if(ss.numSamples<windowSize)
+		++ss.numSamples;
+	ss.traceTime+=time;
+	}
+
+StageTimers::Statistics StageTimers::getStatistics(StageTimers::Stage stage) const
+	{
+	Threads::Mutex::Lock samplesLock(samplesMutex);
+	
+	/* Calculate the statistics over the stage's rolling window: */
+	const StageSamples& ss=stageSamples[stage];
+	Statistics result;
+	result.numSamples=ss.numSamples;
+	result.last=0.0;
+	result.mean=0.0;
+	result.max=0.0;
+	if(ss.numSamples>0)
+		{
+		result.last=ss.samples[(ss.nextSample+windowSize-1)%windowSize];
+		for(unsigned int i=0;i<ss.numSamples;++i)
+			{
+			result.mean+=ss.samples[i];
+			if(result.max<ss.samples[i])
+				result.max=ss.samples[i];
+			}
+		result.mean/=double(ss.numSamples);
+		}
+	
+	return result;
+	}
+
+void StageTimers::frame(double applicationTime,double frameTime)
+	{
+	Threads::Mutex::Lock samplesLock(samplesMutex);
+	
+	/* Write a record of the time measured for each stage since the last frame in milliseconds; GPU measurements arrive one or two frames late: */
+	if(traceFile!=0)
+		{
+		*traceFile<<applicationTime<<','<<frameTime*1000.0;
+		for(int stage=0;stage<NUM_STAGES;++stage)
+			*traceFile<<','<<stageSamples[stage].traceTime*1000.0;
+		*traceFile<<'\n';
+		}
+	
+	/* Start the next frame: */
+	for(int stage=0;stage<NUM_STAGES;++stage)
+		stageSamples[stage].traceTime=0.0;
+	}
@@ -0,0 +1,172 @@
+/***********************************************************************
+StageTimers - Class to measure the time spent in the stages of the
+water simulation, rendering, and input processing pipelines, using
+non-stalling GPU timer queries and CPU scoped timers, and to keep
+rolling statistics of the measured times.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef STAGETIMERS_INCLUDED
+#define STAGETIMERS_INCLUDED
+
+#include <Threads/Mutex.h>
+#include <GL/gl.h>
+#include <GL/GLObject.h>
+
+/* Forward declarations: */
+namespace IO {
+class OStream;
+}
+class GLContextData;
+
+class StageTimers:public GLObject
+	{
+	/* Embedded classes: */
+	private:
+	struct DataItem;
+	
+	public:
+	enum Stage // Enumerated type for measured stages
+		{
+		DERIVATIVE, // Temporal derivative calculation of the water simulation
+		MAXSTEPSIZE, // Maximum step size reduction and step size selection of the water simulation
+		EULERSTEP, // Tentative Euler integration step of the water simulation
+		RUNGEKUTTASTEP, // Final Runge-Kutta integration step of the water simulation
+		BOUNDARY, // Dry boundary condition pass of the water simulation
+		SNOWSTEP, // Runge-Kutta integration step fused with the snow accumulation, snow melt, and freeze updates
+		WATERADD, // Water sources and sinks pass of the water simulation
+		SIMULATION, // Entire water simulation of a frame, including all passes measured by the stages above
+		BATHYMETRY, // Bathymetry grid update of the water simulation
+		SURFACE, // Single-pass surface rendering
+		WATERSURFACE, // Geometric water surface rendering
+		FRAMEFILTER, // Depth frame filtering on the CPU
+		HANDEXTRACTOR, // Hand extraction on the CPU
+		REMOTESERVER, // Grid quantization and encoding for remote clients on the CPU
+		NUM_STAGES
+		};
+	
+	struct Statistics // Structure holding rolling statistics of a stage's measured times
+		{
+		/* Elements: */
+		public:
+		unsigned int numSamples; // Number of measurements in the rolling window
+		double last; // Most recent measured time in seconds
+		double mean; // Mean measured time over the rolling window in seconds
+		double max; // Maximum measured time over the rolling window in seconds
+		};
+	
+	class CPUTimer // Class to measure the CPU time of a stage during the lifetime of an object
+		{
+		/* Elements: */
+		private:
+		const StageTimers* timers; // Timer set receiving the measurement, or null
+		Stage stage; // The measured stage
+		double start; // Monotonic time at which the measurement started
+		
+		/* Constructors and destructors: */
+		public:
+		CPUTimer(const StageTimers* sTimers,Stage sStage); // Starts measuring the given stage; does nothing if the timer set is null
+		~CPUTimer(void); // Stops the measurement and adds it to the timer set
+		};
+	
+	class GPUTimer // Class to measure the GPU time of the OpenGL commands of a stage issued during the lifetime of an object
+		{
+		/* Elements: */
+		private:
+		DataItem* dataItem; // Data item of the OpenGL context in which a timer query was started, or null
+		
+		/* Constructors and destructors: */
+		public:
+		GPUTimer(const StageTimers* timers,Stage stage,GLContextData& contextData); // Starts a timer query for the given stage in the given OpenGL context; does nothing if the timer set is null, another query is active, or both of the stage's queries are still in flight
+		~GPUTimer(void); // Ends the timer query
+		};
+	
+	class GPUSpanTimer // Class to measure the GPU time of the OpenGL commands of a stage issued during the lifetime of an object with a pair of timestamp queries, which can enclose GPU timers of other stages
+		{
+		/* Elements: */
+		private:
+		DataItem* dataItem; // Data item of the OpenGL context in which the start timestamp was queried, or null
+		Stage stage; // The measured stage
+		int slot; // Index of the stage's timestamp query pair in use
+		
+		/* Constructors and destructors: */
+		public:
+		GPUSpanTimer(const StageTimers* timers,Stage sStage,GLContextData& contextData); // Queries the start timestamp of the given stage in the given OpenGL context; does nothing if the timer set is null or both of the stage's timestamp query pairs are still in flight
+		~GPUSpanTimer(void); // Queries the end timestamp
+		};
+	
+	private:
+	struct DataItem:public GLObject::DataItem // Structure holding per-context state
+		{
+		/* Elements: */
+		public:
+		bool haveTimerQuery; // Flag whether this OpenGL context supports timer queries
+		GLuint queryObjects[NUM_STAGES][2]; // Double-buffered timer query objects for each stage
+		bool queryPending[NUM_STAGES][2]; // Flags whether each timer query's result has not been collected yet
+		bool queryActive; // Flag whether a timer query is currently active; timer queries cannot be nested
+		GLuint timestampQueryObjects[NUM_STAGES][2][2]; // Double-buffered pairs of start and end timestamp query objects for each stage
+		bool timestampQueryPending[NUM_STAGES][2]; // Flags whether each timestamp query pair's result has not been collected yet
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
+	static const unsigned int windowSize=64; // Number of measurements in the rolling window of each stage
+	
+	struct StageSamples // Structure holding the recent measurements of a stage
+		{
+		/* Elements: */
+		public:
+		double samples[windowSize]; // Ring buffer of measured times in seconds
+		unsigned int numSamples; // Number of valid measurements in the ring buffer
+		unsigned int nextSample; // Index at which the next measurement is stored
+		double traceTime; // Total time measured since the last trace file record in seconds
+		};
+	
+	/* Elements: */
+	mutable Threads::Mutex samplesMutex; // Mutex serializing access to the measurements, which are added from several threads
+	mutable StageSamples stageSamples[NUM_STAGES]; // Recent measurements of all stages
+	IO::OStream* traceFile; // CSV file receiving one record of per-frame stage times per frame, or null
+	
+	/* Private methods: */
+	DataItem* getDataItem(GLContextData& contextData) const; // Returns the data item of the given OpenGL context, creating it in contexts that did not initialize this object
+	void collectQueries(DataItem* dataItem,Stage stage) const; // Adds the results of the given stage's finished timer and timestamp queries to its measurements without waiting
+	
+	/* Constructors and destructors: */
+	public:
+	StageTimers(void); // Creates a timer set without measurements
+	private:
+	StageTimers(const StageTimers& source); // Prohibit copy constructor
+	StageTimers& operator=(const StageTimers& source); // Prohibit assignment operator
+	public:
+	virtual ~StageTimers(void);
+	
+	/* Methods from GLObject: */
+	virtual void initContext(GLContextData& contextData) const;
+	
+	/* New methods: */
+	static const char* getStageName(Stage stage); // Returns a short name for the given stage
+	void openTraceFile(const char* traceFileName); // Writes per-frame stage times to a new CSV file of the given name; throws an exception if the file cannot be created
+	void addSample(Stage stage,double time) const; // Adds a measured time in seconds to the given stage
+	Statistics getStatistics(Stage stage) const; // Returns the rolling statistics of the given stage
+	void frame(double applicationTime,double frameTime); // Writes a trace file record of the times measured since the last frame; called once per frame from the main thread
+	};
+
+#endif
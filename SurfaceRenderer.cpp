@@ -37,6 +37,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/Extensions/GLARBTextureRg.h>
 #include <GL/Extensions/GLARBVertexShader.h>
 #include <GL/Extensions/GLEXTFramebufferObject.h>
+#include <GL/Extensions/GLEXTTextureArray.h>
 #include <GL/GLLightTracker.h>
 #include <GL/GLContextData.h>
 #include <GL/GLTransformationWrappers.h>
@@ -46,6 +47,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "ElevationColorMap.h"
 #include "DEM.h"
 #include "WaterTable2.h"
+#include "HillshadeMap.h"
+#include "StageTimers.h"
 #include "ShaderHelper.h"
 #include "Config.h"
 
@@ -75,7 +78,6 @@ SurfaceRenderer::DataItem::~DataItem(void)
 	glDeleteFramebuffersEXT(1,&contourLineFramebufferObject);
 	glDeleteRenderbuffersEXT(1,&contourLineDepthBufferObject);
 	glDeleteTextures(1,&contourLineColorTextureObject);
-	glDeleteObjectARB(heightMapShader);
 	glDeleteObjectARB(globalAmbientHeightMapShader);
 	glDeleteObjectARB(shadowedIlluminatedHeightMapShader);
 	}
@@ -90,411 +92,466 @@ void SurfaceRenderer::shaderSourceFileChanged(const IO::FileMonitor::Event& even
 	++surfaceSettingsVersion;
 	}
 
-GLhandleARB SurfaceRenderer::createSinglePassSurfaceShader(const GLLightTracker& lt,GLint* uniformLocations) const
+unsigned int SurfaceRenderer::getShaderFeatures(void) const
 	{
-	GLhandleARB result=0;
+	unsigned int result=0x0U;
+	if(dem!=0)
+		result|=DEMMATCHING;
+	if(elevationColorMap!=0)
+		result|=HEIGHTCOLORMAP;
+	if(drawDippingBed)
+		result|=DIPPINGBED;
+	if(dippingBedFolded)
+		result|=FOLDEDDIPPINGBED;
+	if(drawContourLines)
+		result|=CONTOURLINES;
+	if(illuminate)
+		result|=ILLUMINATION;
+	if(waterTable!=0)
+		result|=WATER;
+	if(advectWaterTexture)
+		result|=ADVECTEDWATER;
+	if(illuminate&&hillshadeMap!=0)
+		result|=SHADOWS;
 	
-	std::vector<GLhandleARB> shaders;
-	try
+	return result;
+	}
+
+ShaderSourceList SurfaceRenderer::createSinglePassSurfaceShaderSources(unsigned int shaderFeatures,const GLLightTracker& lt) const
+	{
+	ShaderSourceList result;
+	
+	/*********************************************************************
+	Assemble the surface rendering vertex shader:
+	*********************************************************************/
+	
+	/* Assemble the function and declaration strings: */
+	std::string vertexFunctions="\
+		#extension GL_ARB_texture_rectangle : enable\n";
+	
+	std::string vertexUniforms="\
+		uniform sampler2DRect depthSampler; // Sampler for the depth image-space elevation texture\n\
+		uniform mat4 depthProjection; // Transformation from depth image space to camera space\n\
+		uniform mat4 projectionModelviewDepthProjection; // Transformation from depth image space to clip space\n";
+	
+	std::string vertexVaryings;
+	
+	/* Assemble the vertex shader's main function: */
+	std::string vertexMain="\
+		void main()\n\
+			{\n\
+			/* Get the vertex' depth image-space z coordinate from the texture: */\n\
+			vec4 vertexDic=gl_Vertex;\n\
+			vertexDic.z=texture2DRect(depthSampler,gl_Vertex.xy).r;\n\
+			\n\
+			/* Transform the vertex from depth image space to camera space and normalize it: */\n\
+			vec4 vertexCc=depthProjection*vertexDic;\n\
+			vertexCc/=vertexCc.w;\n\
+			\n";
+	
+	if(shaderFeatures&DEMMATCHING)
 		{
-		/*********************************************************************
-		Assemble and compile the surface rendering vertex shader:
-		*********************************************************************/
-		
-		/* Assemble the function and declaration strings: */
-		std::string vertexFunctions="\
-			#extension GL_ARB_texture_rectangle : enable\n";
-		
-		std::string vertexUniforms="\
-			uniform sampler2DRect depthSampler; // Sampler for the depth image-space elevation texture\n\
-			uniform mat4 depthProjection; // Transformation from depth image space to camera space\n\
-			uniform mat4 projectionModelviewDepthProjection; // Transformation from depth image space to clip space\n";
-		
-		std::string vertexVaryings;
+		/* Add declarations for DEM matching: */
+		vertexUniforms+="\
+			uniform mat4 demTransform; // Transformation from camera space to DEM space\n\
+			uniform sampler2DRect demSampler; // Sampler for the DEM texture\n\
+			uniform float demDistScale; // Distance from surface to DEM at which the color map saturates\n";
 		
-		/* Assemble the vertex shader's main function: */
-		std::string vertexMain="\
-			void main()\n\
-				{\n\
-				/* Get the vertex' depth image-space z coordinate from the texture: */\n\
-				vec4 vertexDic=gl_Vertex;\n\
-				vertexDic.z=texture2DRect(depthSampler,gl_Vertex.xy).r;\n\
-				\n\
-				/* Transform the vertex from depth image space to camera space and normalize it: */\n\
-				vec4 vertexCc=depthProjection*vertexDic;\n\
-				vertexCc/=vertexCc.w;\n\
-				\n";
+		vertexVaryings+="\
+			varying float demDist; // Scaled signed distance from surface to DEM\n";
 		
-		if(dem!=0)
+		/* Add DEM matching code to vertex shader's main function: */
+		vertexMain+="\
+			/* Transform the camera-space vertex to scaled DEM space: */\n\
+			vec4 vertexDem=demTransform*vertexCc;\n\
+			\n\
+			/* Calculate scaled DEM-surface distance: */\n\
+			demDist=(vertexDem.z-texture2DRect(demSampler,vertexDem.xy).r)*demDistScale;\n\
+			\n";
+		}
+	else
+		{
+		if(shaderFeatures&HEIGHTCOLORMAP)
 			{
-			/* Add declarations for DEM matching: */
+			/* Add declarations for height mapping: */
 			vertexUniforms+="\
-				uniform mat4 demTransform; // Transformation from camera space to DEM space\n\
-				uniform sampler2DRect demSampler; // Sampler for the DEM texture\n\
-				uniform float demDistScale; // Distance from surface to DEM at which the color map saturates\n";
+				uniform vec4 heightColorMapPlaneEq; // Plane equation of the base plane in camera space, scaled for height map textures\n";
 			
 			vertexVaryings+="\
-				varying float demDist; // Scaled signed distance from surface to DEM\n";
+				varying float heightColorMapTexCoord; // Texture coordinate for the height color map\n";
 			
-			/* Add DEM matching code to vertex shader's main function: */
+			/* Add height mapping code to vertex shader's main function: */
 			vertexMain+="\
-				/* Transform the camera-space vertex to scaled DEM space: */\n\
-				vec4 vertexDem=demTransform*vertexCc;\n\
-				\n\
-				/* Calculate scaled DEM-surface distance: */\n\
-				demDist=(vertexDem.z-texture2DRect(demSampler,vertexDem.xy).r)*demDistScale;\n\
+				/* Plug camera-space vertex into the scaled and offset base plane equation: */\n\
+				heightColorMapTexCoord=dot(heightColorMapPlaneEq,vertexCc);\n\
 				\n";
 			}
-		else
+		
+		if(shaderFeatures&DIPPINGBED)
 			{
-			if(elevationColorMap!=0)
+			/* Add declarations for dipping bed rendering: */
+			if(shaderFeatures&FOLDEDDIPPINGBED)
 				{
-				/* Add declarations for height mapping: */
 				vertexUniforms+="\
-					uniform vec4 heightColorMapPlaneEq; // Plane equation of the base plane in camera space, scaled for height map textures\n";
-				
-				vertexVaryings+="\
-					varying float heightColorMapTexCoord; // Texture coordinate for the height color map\n";
-				
-				/* Add height mapping code to vertex shader's main function: */
+					uniform float dbc[5]; // Dipping bed coefficients\n";
+				}
+			else
+				{
+				vertexUniforms+="\
+					uniform vec4 dippingBedPlaneEq; // Plane equation of the dipping bed\n";
+				}
+			
+			vertexVaryings+="\
+				varying float dippingBedDistance; // Vertex distance to dipping bed\n";
+			
+			/* Add dipping bed code to vertex shader's main function: */
+			if(shaderFeatures&FOLDEDDIPPINGBED)
+				{
 				vertexMain+="\
-					/* Plug camera-space vertex into the scaled and offset base plane equation: */\n\
-					heightColorMapTexCoord=dot(heightColorMapPlaneEq,vertexCc);\n\
+					/* Calculate distance from camera-space vertex to dipping bed equation: */\n\
+					dippingBedDistance=vertexCc.z-(((1.0-dbc[3])+cos(dbc[0]*vertexCc.x)*dbc[3])*sin(dbc[1]*vertexCc.y)*dbc[2]+dbc[4]);\n\
 					\n";
 				}
-			
-			if(drawDippingBed)
+			else
 				{
-				/* Add declarations for dipping bed rendering: */
-				if(dippingBedFolded)
-					{
-					vertexUniforms+="\
-						uniform float dbc[5]; // Dipping bed coefficients\n";
-					}
-				else
-					{
-					vertexUniforms+="\
-						uniform vec4 dippingBedPlaneEq; // Plane equation of the dipping bed\n";
-					}
-				
-				vertexVaryings+="\
-					varying float dippingBedDistance; // Vertex distance to dipping bed\n";
-				
-				/* Add dipping bed code to vertex shader's main function: */
-				if(dippingBedFolded)
-					{
-					vertexMain+="\
-						/* Calculate distance from camera-space vertex to dipping bed equation: */\n\
-						dippingBedDistance=vertexCc.z-(((1.0-dbc[3])+cos(dbc[0]*vertexCc.x)*dbc[3])*sin(dbc[1]*vertexCc.y)*dbc[2]+dbc[4]);\n\
-						\n";
-					}
-				else
-					{
-					vertexMain+="\
-						/* Plug camera-space vertex into the dipping bed equation: */\n\
-						dippingBedDistance=dot(dippingBedPlaneEq,vertexCc);\n\
-						\n";
-					}
+				vertexMain+="\
+					/* Plug camera-space vertex into the dipping bed equation: */\n\
+					dippingBedDistance=dot(dippingBedPlaneEq,vertexCc);\n\
+					\n";
 				}
 			}
+		}
+	
+	if(shaderFeatures&ILLUMINATION)
+		{
+		/* Add declarations for illumination: */
+		vertexUniforms+="\
+			uniform mat4 modelview; // Transformation from camera space to eye space\n\
+			uniform mat4 tangentModelviewDepthProjection; // Transformation from depth image space to eye space for tangent planes\n";
+		
+		vertexVaryings+="\
+			varying vec4 diffColor,specColor; // Diffuse and specular colors, interpolated separately for correct highlights\n";
 		
-		if(illuminate)
+		/* Add illumination code to vertex shader's main function: */
+		vertexMain+="\
+			/* Calculate the vertex' tangent plane equation in depth image space: */\n\
+			vec4 tangentDic;\n\
+			tangentDic.x=texture2DRect(depthSampler,vec2(vertexDic.x-1.0,vertexDic.y)).r-texture2DRect(depthSampler,vec2(vertexDic.x+1.0,vertexDic.y)).r;\n\
+			tangentDic.y=texture2DRect(depthSampler,vec2(vertexDic.x,vertexDic.y-1.0)).r-texture2DRect(depthSampler,vec2(vertexDic.x,vertexDic.y+1.0)).r;\n\
+			tangentDic.z=2.0;\n\
+			tangentDic.w=-dot(vertexDic.xyz,tangentDic.xyz)/vertexDic.w;\n\
+			\n\
+			/* Transform the vertex and its tangent plane from depth image space to eye space: */\n\
+			vec4 vertexEc=modelview*vertexCc;\n\
+			vec3 normalEc=normalize((tangentModelviewDepthProjection*tangentDic).xyz);\n\
+			\n";
+		
+		if(shaderFeatures&SHADOWS)
 			{
-			/* Add declarations for illumination: */
+			/* Add declarations for cached shadows and ambient occlusion: */
 			vertexUniforms+="\
-				uniform mat4 modelview; // Transformation from camera space to eye space\n\
-				uniform mat4 tangentModelviewDepthProjection; // Transformation from depth image space to eye space for tangent planes\n";
-			
-			vertexVaryings+="\
-				varying vec4 diffColor,specColor; // Diffuse and specular colors, interpolated separately for correct highlights\n";
+				uniform sampler2DRect hillshadeSampler; // Sampler for the hillshade map holding sun visibility and ambient occlusion\n";
 			
-			/* Add illumination code to vertex shader's main function: */
+			/* Accumulate light sources separately from global ambient light to attenuate them by the vertex' sun visibility: */
 			vertexMain+="\
-				/* Calculate the vertex' tangent plane equation in depth image space: */\n\
-				vec4 tangentDic;\n\
-				tangentDic.x=texture2DRect(depthSampler,vec2(vertexDic.x-1.0,vertexDic.y)).r-texture2DRect(depthSampler,vec2(vertexDic.x+1.0,vertexDic.y)).r;\n\
-				tangentDic.y=texture2DRect(depthSampler,vec2(vertexDic.x,vertexDic.y-1.0)).r-texture2DRect(depthSampler,vec2(vertexDic.x,vertexDic.y+1.0)).r;\n\
-				tangentDic.z=2.0;\n\
-				tangentDic.w=-dot(vertexDic.xyz,tangentDic.xyz)/vertexDic.w;\n\
-				\n\
-				/* Transform the vertex and its tangent plane from depth image space to eye space: */\n\
-				vec4 vertexEc=modelview*vertexCc;\n\
-				vec3 normalEc=normalize((tangentModelviewDepthProjection*tangentDic).xyz);\n\
+				/* Look up the vertex' sun visibility and ambient occlusion: */\n\
+				vec2 hillshade=texture2DRect(hillshadeSampler,vertexDic.xy).rg;\n\
 				\n\
+				/* Initialize the color accumulators: */\n\
+				diffColor=vec4(0.0,0.0,0.0,0.0);\n\
+				specColor=vec4(0.0,0.0,0.0,0.0);\n\
+				\n";
+			}
+		else
+			{
+			vertexMain+="\
 				/* Initialize the color accumulators: */\n\
 				diffColor=gl_LightModel.ambient*gl_FrontMaterial.ambient;\n\
 				specColor=vec4(0.0,0.0,0.0,0.0);\n\
 				\n";
-			
-			/* Call the appropriate light accumulation function for every enabled light source: */
-			bool firstLight=true;
-			for(int lightIndex=0;lightIndex<lt.getMaxNumLights();++lightIndex)
-				if(lt.getLightState(lightIndex).isEnabled())
+			}
+		
+		/* Call the appropriate light accumulation function for every enabled light source: */
+		bool firstLight=true;
+		for(int lightIndex=0;lightIndex<lt.getMaxNumLights();++lightIndex)
+			if(lt.getLightState(lightIndex).isEnabled())
+				{
+				/* Create the light accumulation function: */
+				vertexFunctions.push_back('\n');
+				vertexFunctions+=lt.createAccumulateLightFunction(lightIndex);
+				
+				if(firstLight)
 					{
-					/* Create the light accumulation function: */
-					vertexFunctions.push_back('\n');
-					vertexFunctions+=lt.createAccumulateLightFunction(lightIndex);
-					
-					if(firstLight)
-						{
-						vertexMain+="\
-							/* Call the light accumulation functions for all enabled light sources: */\n";
-						firstLight=false;
-						}
-					
-					/* Call the light accumulation function from vertex shader's main function: */
 					vertexMain+="\
-						accumulateLight";
-					char liBuffer[12];
-					vertexMain.append(Misc::print(lightIndex,liBuffer+11));
-					vertexMain+="(vertexEc,normalEc,gl_FrontMaterial.ambient,gl_FrontMaterial.diffuse,gl_FrontMaterial.specular,gl_FrontMaterial.shininess,diffColor,specColor);\n";
+						/* Call the light accumulation functions for all enabled light sources: */\n";
+					firstLight=false;
 					}
-			if(!firstLight)
+				
+				/* Call the light accumulation function from vertex shader's main function: */
 				vertexMain+="\
-					\n";
-			}
+					accumulateLight";
+				char liBuffer[12];
+				vertexMain.append(Misc::print(lightIndex,liBuffer+11));
+				vertexMain+="(vertexEc,normalEc,gl_FrontMaterial.ambient,gl_FrontMaterial.diffuse,gl_FrontMaterial.specular,gl_FrontMaterial.shininess,diffColor,specColor);\n";
+				}
+		if(!firstLight)
+			vertexMain+="\
+				\n";
 		
-		if(waterTable!=0&&dem==0)
+		if(shaderFeatures&SHADOWS)
 			{
-			/* Add declarations for water handling: */
-			vertexUniforms+="\
-				uniform mat4 waterTransform; // Transformation from camera space to water level texture coordinate space\n";
-			vertexVaryings+="\
-				varying vec2 waterTexCoord; // Texture coordinate for water level texture\n";
-			
-			/* Add water handling code to vertex shader's main function: */
 			vertexMain+="\
-				/* Transform the vertex from camera space to water level texture coordinate space: */\n\
-				waterTexCoord=(waterTransform*vertexCc).xy;\n\
+				/* Attenuate light sources by sun visibility and global ambient light by ambient occlusion: */\n\
+				diffColor=gl_LightModel.ambient*gl_FrontMaterial.ambient*hillshade.g+diffColor*hillshade.r;\n\
+				specColor*=hillshade.r;\n\
 				\n";
 			}
+		}
+	
+	if((shaderFeatures&(WATER|DEMMATCHING))==WATER)
+		{
+		/* Add declarations for water handling: */
+		vertexUniforms+="\
+			uniform mat4 waterTransform; // Transformation from camera space to water level texture coordinate space\n";
+		vertexVaryings+="\
+			varying vec2 waterTexCoord; // Texture coordinate for water level texture\n";
 		
-		/* Finish the vertex shader's main function: */
+		/* Add water handling code to vertex shader's main function: */
 		vertexMain+="\
-				/* Transform vertex from depth image space to clip space: */\n\
-				gl_Position=projectionModelviewDepthProjection*vertexDic;\n\
-				}\n";
-		
-		/* Compile the vertex shader: */
-		shaders.push_back(glCompileVertexShaderFromStrings(7,vertexFunctions.c_str(),"\t\t\n",vertexUniforms.c_str(),"\t\t\n",vertexVaryings.c_str(),"\t\t\n",vertexMain.c_str()));
-		
-		/*********************************************************************
-		Assemble and compile the surface rendering fragment shaders:
-		*********************************************************************/
-		
-		/* Assemble the fragment shader's function declarations: */
-		std::string fragmentDeclarations;
-		
-		/* Assemble the fragment shader's uniform and varying variables: */
-		std::string fragmentUniforms;
-		std::string fragmentVaryings;
-		
-		/* Assemble the fragment shader's main function: */
-		std::string fragmentMain="\
-			void main()\n\
-				{\n";
+			/* Transform the vertex from camera space to water level texture coordinate space: */\n\
+			waterTexCoord=(waterTransform*vertexCc).xy;\n\
+			\n";
+		}
+	
+	/* Finish the vertex shader's main function: */
+	vertexMain+="\
+			/* Transform vertex from depth image space to clip space: */\n\
+			gl_Position=projectionModelviewDepthProjection*vertexDic;\n\
+			}\n";
+	
+	/* Assemble the vertex shader: */
+	result.push_back(ShaderSource(GL_VERTEX_SHADER_ARB,vertexFunctions+"\t\t\n"+vertexUniforms+"\t\t\n"+vertexVaryings+"\t\t\n"+vertexMain));
+	
+	/*********************************************************************
+	Assemble the surface rendering fragment shaders:
+	*********************************************************************/
+	
+	/* Assemble the fragment shader's function declarations: */
+	std::string fragmentDeclarations;
+	
+	/* Assemble the fragment shader's uniform and varying variables: */
+	std::string fragmentUniforms;
+	std::string fragmentVaryings;
+	
+	/* Assemble the fragment shader's main function: */
+	std::string fragmentMain="\
+		void main()\n\
+			{\n";
+	
+	if(shaderFeatures&DEMMATCHING)
+		{
+		/* Add declarations for DEM matching: */
+		fragmentVaryings+="\
+			varying float demDist; // Scaled signed distance from surface to DEM\n";
 		
-		if(dem!=0)
+		/* Add DEM matching code to the fragment shader's main function: */
+		fragmentMain+="\
+			/* Calculate the fragment's color from a double-ramp function: */\n\
+			vec4 baseColor;\n\
+			if(demDist<0.0)\n\
+				baseColor=mix(vec4(1.0,1.0,1.0,1.0),vec4(1.0,0.0,0.0,1.0),min(-demDist,1.0));\n\
+			else\n\
+				baseColor=mix(vec4(1.0,1.0,1.0,1.0),vec4(0.0,0.0,1.0,1.0),min(demDist,1.0));\n\
+			\n";
+		}
+	else
+		{
+		if(shaderFeatures&HEIGHTCOLORMAP)
 			{
-			/* Add declarations for DEM matching: */
+			/* Add declarations for height mapping: */
+			fragmentDeclarations+="\
+				#extension GL_EXT_texture_array : enable\n";
+			fragmentUniforms+="\
+				uniform sampler1DArray heightColorMapSampler; // Sampler for the array of preloaded height color maps\n\
+				uniform float heightColorMapLayer; // Array layer of the selected height color map\n";
 			fragmentVaryings+="\
-				varying float demDist; // Scaled signed distance from surface to DEM\n";
+				varying float heightColorMapTexCoord; // Texture coordinate for the height color map\n";
 			
-			/* Add DEM matching code to the fragment shader's main function: */
+			/* Add height mapping code to the fragment shader's main function: */
 			fragmentMain+="\
-				/* Calculate the fragment's color from a double-ramp function: */\n\
-				vec4 baseColor;\n\
-				if(demDist<0.0)\n\
-					baseColor=mix(vec4(1.0,1.0,1.0,1.0),vec4(1.0,0.0,0.0,1.0),min(-demDist,1.0));\n\
-				else\n\
-					baseColor=mix(vec4(1.0,1.0,1.0,1.0),vec4(0.0,0.0,1.0,1.0),min(demDist,1.0));\n\
+				/* Get the fragment's color from the selected height color map: */\n\
+				vec4 baseColor=texture1DArray(heightColorMapSampler,vec2(heightColorMapTexCoord,heightColorMapLayer));\n\
 				\n";
 			}
 		else
 			{
-			if(elevationColorMap!=0)
-				{
-				/* Add declarations for height mapping: */
-				fragmentUniforms+="\
-					uniform sampler1D heightColorMapSampler;\n";
-				fragmentVaryings+="\
-					varying float heightColorMapTexCoord; // Texture coordinate for the height color map\n";
-				
-				/* Add height mapping code to the fragment shader's main function: */
-				fragmentMain+="\
-					/* Get the fragment's color from the height color map: */\n\
-					vec4 baseColor=texture1D(heightColorMapSampler,heightColorMapTexCoord);\n\
-					\n";
-				}
-			else
-				{
-				fragmentMain+="\
-					/* Set the surface's base color to white: */\n\
-					vec4 baseColor=vec4(1.0,1.0,1.0,1.0);\n\
-					\n";
-				}
-			
-			if(drawDippingBed)
-				{
-				/* Add declarations for dipping bed rendering: */
-				fragmentUniforms+="\
-					uniform float dippingBedThickness; // Thickness of dipping bed in camera-space units\n";
-				
-				fragmentVaryings+="\
-					varying float dippingBedDistance; // Vertex distance to dipping bed plane\n";
-				
-				/* Add dipping bed code to fragment shader's main function: */
-				fragmentMain+="\
-					/* Check fragment's dipping plane distance against dipping bed thickness: */\n\
-					float w=fwidth(dippingBedDistance)*1.0;\n\
-					if(dippingBedDistance<0.0)\n\
-						baseColor=mix(baseColor,vec4(1.0,0.0,0.0,1.0),smoothstep(-dippingBedThickness*0.5-w,-dippingBedThickness*0.5+w,dippingBedDistance));\n\
-					else\n\
-						baseColor=mix(vec4(1.0,0.0,0.0,1.0),baseColor,smoothstep(dippingBedThickness*0.5-w,dippingBedThickness*0.5+w,dippingBedDistance));\n\
-					\n";
-				}
-			}
-		
-		if(drawContourLines)
-			{
-			/* Declare the contour line function: */
-			fragmentDeclarations+="\
-				void addContourLines(in vec2,inout vec4);\n";
-			
-			/* Compile the contour line shader: */
-			shaders.push_back(compileFragmentShader("SurfaceAddContourLines"));
-			
-			/* Call contour line function from fragment shader's main function: */
 			fragmentMain+="\
-				/* Modulate the base color by contour line color: */\n\
-				addContourLines(gl_FragCoord.xy,baseColor);\n\
+				/* Set the surface's base color to white: */\n\
+				vec4 baseColor=vec4(1.0,1.0,1.0,1.0);\n\
 				\n";
 			}
 		
-		if(illuminate)
+		if(shaderFeatures&DIPPINGBED)
 			{
-			/* Declare the illumination function: */
-			fragmentDeclarations+="\
-				void illuminate(inout vec4);\n";
-			
-			/* Compile the illumination shader: */
-			shaders.push_back(compileFragmentShader("SurfaceIlluminate"));
-			
-			/* Call illumination function from fragment shader's main function: */
+			/* Add declarations for dipping bed rendering: */
+			fragmentUniforms+="\
+				uniform float dippingBedThickness; // Thickness of dipping bed in camera-space units\n";
+		
+			fragmentVaryings+="\
+				varying float dippingBedDistance; // Vertex distance to dipping bed plane\n";
+		
+			/* Add dipping bed code to fragment shader's main function: */
 			fragmentMain+="\
-				/* Apply illumination to the base color: */\n\
-				illuminate(baseColor);\n\
+				/* Check fragment's dipping plane distance against dipping bed thickness: */\n\
+				float w=fwidth(dippingBedDistance)*1.0;\n\
+				if(dippingBedDistance<0.0)\n\
+					baseColor=mix(baseColor,vec4(1.0,0.0,0.0,1.0),smoothstep(-dippingBedThickness*0.5-w,-dippingBedThickness*0.5+w,dippingBedDistance));\n\
+				else\n\
+					baseColor=mix(vec4(1.0,0.0,0.0,1.0),baseColor,smoothstep(dippingBedThickness*0.5-w,dippingBedThickness*0.5+w,dippingBedDistance));\n\
 				\n";
 			}
+		}
 		
-		if(waterTable!=0&&dem==0)
-			{
-			/* Declare the water handling functions: */
-			fragmentDeclarations+="\
-				void addWaterColor(in vec2,inout vec4);\n\
-				void addWaterColorAdvected(inout vec4);\n";
-			
-			/* Compile the water handling shader: */
-			shaders.push_back(compileFragmentShader("SurfaceAddWaterColor"));
-			
-			/* Call water coloring function from fragment shader's main function: */
-			if(advectWaterTexture)
-				{
-				fragmentMain+="\
-					/* Modulate the base color with water color: */\n\
-					addWaterColorAdvected(baseColor);\n\
-					\n";
-				}
-			else
-				{
-				fragmentMain+="\
-					/* Modulate the base color with water color: */\n\
-					addWaterColor(gl_FragCoord.xy,baseColor);\n\
-					\n";
-				}
-			}
+	if(shaderFeatures&CONTOURLINES)
+		{
+		/* Declare the contour line function: */
+		fragmentDeclarations+="\
+			void addContourLines(in vec2,inout vec4);\n";
 		
-		/* Finish the fragment shader's main function: */
-		fragmentMain+="\
-			/* Assign the final color to the fragment: */\n\
-			gl_FragColor=baseColor;\n\
-			}\n";
+		/* Add the contour line shader: */
+		result.push_back(ShaderSource(GL_FRAGMENT_SHADER_ARB,readShaderSourceFile("SurfaceAddContourLines.fs")));
 		
-		/* Compile the fragment shader: */
-		shaders.push_back(glCompileFragmentShaderFromStrings(7,fragmentDeclarations.c_str(),"\t\t\n",fragmentUniforms.c_str(),"\t\t\n",fragmentVaryings.c_str(),"\t\t\n",fragmentMain.c_str()));
+		/* Call contour line function from fragment shader's main function: */
+		fragmentMain+="\
+			/* Modulate the base color by contour line color: */\n\
+			addContourLines(gl_FragCoord.xy,baseColor);\n\
+			\n";
+		}
 		
-		/* Link the shader program: */
-		result=glLinkShader(shaders);
+	if(shaderFeatures&ILLUMINATION)
+		{
+		/* Declare the illumination function: */
+		fragmentDeclarations+="\
+			void illuminate(inout vec4);\n";
 		
-		/* Release all compiled shaders: */
-		for(std::vector<GLhandleARB>::iterator shIt=shaders.begin();shIt!=shaders.end();++shIt)
-			glDeleteObjectARB(*shIt);
+		/* Add the illumination shader: */
+		result.push_back(ShaderSource(GL_FRAGMENT_SHADER_ARB,readShaderSourceFile("SurfaceIlluminate.fs")));
 		
-		/*******************************************************************
-		Query the shader program's uniform locations:
-		*******************************************************************/
+		/* Call illumination function from fragment shader's main function: */
+		fragmentMain+="\
+			/* Apply illumination to the base color: */\n\
+			illuminate(baseColor);\n\
+			\n";
+		}
+	
+	if((shaderFeatures&(WATER|DEMMATCHING))==WATER)
+		{
+		/* Declare the water handling functions: */
+		fragmentDeclarations+="\
+			void addWaterColor(in vec2,inout vec4);\n\
+			void addWaterColorAdvected(inout vec4);\n";
 		
-		GLint* ulPtr=uniformLocations;
+		/* Add the water handling shader: */
+		result.push_back(ShaderSource(GL_FRAGMENT_SHADER_ARB,readShaderSourceFile("SurfaceAddWaterColor.fs")));
 		
-		/* Query common uniform variables: */
-		*(ulPtr++)=glGetUniformLocationARB(result,"depthSampler");
-		*(ulPtr++)=glGetUniformLocationARB(result,"depthProjection");
-		if(dem!=0)
-			{
-			/* Query DEM matching uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"demTransform");
-			*(ulPtr++)=glGetUniformLocationARB(result,"demSampler");
-			*(ulPtr++)=glGetUniformLocationARB(result,"demDistScale");
-			}
-		else if(elevationColorMap!=0)
-			{
-			/* Query height color mapping uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"heightColorMapPlaneEq");
-			*(ulPtr++)=glGetUniformLocationARB(result,"heightColorMapSampler");
-			}
-		if(drawContourLines)
-			{
-			*(ulPtr++)=glGetUniformLocationARB(result,"pixelCornerElevationSampler");
-			*(ulPtr++)=glGetUniformLocationARB(result,"contourLineFactor");
-			}
-		if(drawDippingBed)
+		/* Call water coloring function from fragment shader's main function: */
+		if(shaderFeatures&ADVECTEDWATER)
 			{
-			if(dippingBedFolded)
-				*(ulPtr++)=glGetUniformLocationARB(result,"dbc");
-			else
-				*(ulPtr++)=glGetUniformLocationARB(result,"dippingBedPlaneEq");
-			*(ulPtr++)=glGetUniformLocationARB(result,"dippingBedThickness");
-			}
-		if(illuminate)
-			{
-			/* Query illumination uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"modelview");
-			*(ulPtr++)=glGetUniformLocationARB(result,"tangentModelviewDepthProjection");
+			fragmentMain+="\
+				/* Modulate the base color with water color: */\n\
+				addWaterColorAdvected(baseColor);\n\
+				\n";
 			}
-		if(waterTable!=0&&dem==0)
+		else
 			{
-			/* Query water handling uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"waterTransform");
-			*(ulPtr++)=glGetUniformLocationARB(result,"bathymetrySampler");
-			*(ulPtr++)=glGetUniformLocationARB(result,"quantitySampler");
-			*(ulPtr++)=glGetUniformLocationARB(result,"snowSampler"); //Snow Support
-			*(ulPtr++)=glGetUniformLocationARB(result,"waterCellSize");
-			*(ulPtr++)=glGetUniformLocationARB(result,"waterOpacity");
-			*(ulPtr++)=glGetUniformLocationARB(result,"waterAnimationTime");
+			fragmentMain+="\
+				/* Modulate the base color with water color: */\n\
+				addWaterColor(gl_FragCoord.xy,baseColor);\n\
+				\n";
 			}
-		*(ulPtr++)=glGetUniformLocationARB(result,"projectionModelviewDepthProjection");
-		}
-	catch(...)
-		{
-		/* Clean up and re-throw the exception: */
-		for(std::vector<GLhandleARB>::iterator shIt=shaders.begin();shIt!=shaders.end();++shIt)
-			glDeleteObjectARB(*shIt);
-		throw;
 		}
 	
+	/* Finish the fragment shader's main function: */
+	fragmentMain+="\
+		/* Assign the final color to the fragment: */\n\
+		gl_FragColor=baseColor;\n\
+		}\n";
+	
+	/* Assemble the fragment shader: */
+	result.push_back(ShaderSource(GL_FRAGMENT_SHADER_ARB,fragmentDeclarations+"\t\t\n"+fragmentUniforms+"\t\t\n"+fragmentVaryings+"\t\t\n"+fragmentMain));
+	
 	return result;
 	}
 
+void SurfaceRenderer::querySinglePassSurfaceShaderUniforms(unsigned int shaderFeatures,GLhandleARB shader,GLint* uniformLocations) const
+	{
+	GLint* ulPtr=uniformLocations;
+	
+	/* Query common uniform variables: */
+	*(ulPtr++)=glGetUniformLocationARB(shader,"depthSampler");
+	*(ulPtr++)=glGetUniformLocationARB(shader,"depthProjection");
+	if(shaderFeatures&DEMMATCHING)
+		{
+		/* Query DEM matching uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(shader,"demTransform");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"demSampler");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"demDistScale");
+		}
+	else if(shaderFeatures&HEIGHTCOLORMAP)
+		{
+		/* Query height color mapping uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(shader,"heightColorMapPlaneEq");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"heightColorMapSampler");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"heightColorMapLayer");
+		}
+	if(shaderFeatures&CONTOURLINES)
+		{
+		*(ulPtr++)=glGetUniformLocationARB(shader,"pixelCornerElevationSampler");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"contourLineFactor");
+		}
+	if(shaderFeatures&DIPPINGBED)
+		{
+		if(shaderFeatures&FOLDEDDIPPINGBED)
+			*(ulPtr++)=glGetUniformLocationARB(shader,"dbc");
+		else
+			*(ulPtr++)=glGetUniformLocationARB(shader,"dippingBedPlaneEq");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"dippingBedThickness");
+		}
+	if(shaderFeatures&ILLUMINATION)
+		{
+		/* Query illumination uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(shader,"modelview");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"tangentModelviewDepthProjection");
+		if(shaderFeatures&SHADOWS)
+			*(ulPtr++)=glGetUniformLocationARB(shader,"hillshadeSampler");
+		}
+	if((shaderFeatures&(WATER|DEMMATCHING))==WATER)
+		{
+		/* Query water handling uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(shader,"waterTransform");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"bathymetrySampler");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"quantitySampler");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"snowSampler"); //Snow Support
+		*(ulPtr++)=glGetUniformLocationARB(shader,"waterCellSize");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"waterOpacity");
+		*(ulPtr++)=glGetUniformLocationARB(shader,"waterAnimationTime");
+		}
+	*(ulPtr++)=glGetUniformLocationARB(shader,"projectionModelviewDepthProjection");
+	}
+
+void SurfaceRenderer::updateSinglePassSurfaceShader(const GLLightTracker& lt,SurfaceRenderer::DataItem* dataItem) const
+	{
+	/* Retrieve the shader for the current renderer settings from the cache, or create it: */
+	unsigned int shaderFeatures=getShaderFeatures();
+	dataItem->heightMapShader=dataItem->shaderCache.getProgram(createSinglePassSurfaceShaderSources(shaderFeatures,lt));
+	querySinglePassSurfaceShaderUniforms(shaderFeatures,dataItem->heightMapShader,dataItem->heightMapShaderUniforms);
+	
+	/* Link the shaders for the settings most likely toggled next in the background: */
+	static const unsigned int toggledFeatures[3]={DEMMATCHING,CONTOURLINES,DIPPINGBED};
+	for(int i=0;i<3;++i)
+		dataItem->shaderCache.precompile(createSinglePassSurfaceShaderSources(shaderFeatures^toggledFeatures[i],lt));
+	}
+
 void SurfaceRenderer::renderPixelCornerElevations(const int viewport[4],const PTransform& projectionModelview,GLContextData& contextData,SurfaceRenderer::DataItem* dataItem) const
 	{
 	/* Save the currently-bound frame buffer and clear color: */
@@ -586,6 +643,8 @@ SurfaceRenderer::SurfaceRenderer(const DepthImageRenderer* sDepthImageRenderer)
 	 dem(0),demDistScale(1.0f),
 	 illuminate(false),
 	 waterTable(0),advectWaterTexture(false),waterOpacity(2.0f),
+	 hillshadeMap(0),
+	 stageTimers(0),
 	 surfaceSettingsVersion(1),
 	 animationTime(0.0)
 	{
@@ -620,7 +679,7 @@ void SurfaceRenderer::initContext(GLContextData& contextData) const
 	contextData.addDataItem(this,dataItem);
 	
 	/* Create the height map render shader: */
-	dataItem->heightMapShader=createSinglePassSurfaceShader(*contextData.getLightTracker(),dataItem->heightMapShaderUniforms);
+	updateSinglePassSurfaceShader(*contextData.getLightTracker(),dataItem);
 	dataItem->surfaceSettingsVersion=surfaceSettingsVersion;
 	dataItem->lightTrackerVersion=contextData.getLightTracker()->getVersion();
 	
@@ -754,6 +813,17 @@ void SurfaceRenderer::setWaterOpacity(GLfloat newWaterOpacity)
 	waterOpacity=newWaterOpacity;
 	}
 
+void SurfaceRenderer::setHillshadeMap(const HillshadeMap* newHillshadeMap)
+	{
+	hillshadeMap=newHillshadeMap;
+	++surfaceSettingsVersion;
+	}
+
+void SurfaceRenderer::setStageTimers(const StageTimers* newStageTimers)
+	{
+	stageTimers=newStageTimers;
+	}
+
 void SurfaceRenderer::setAnimationTime(double newAnimationTime)
 	{
 	/* Set the new animation time: */
@@ -768,6 +838,9 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
+	/* Measure all surface rendering passes: */
+	StageTimers::GPUTimer surfaceTimer(stageTimers,StageTimers::SURFACE,contextData);
+	
 	/* Calculate the required matrices: */
 	PTransform projectionModelview=projection;
 	projectionModelview*=modelview;
@@ -789,15 +862,17 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 		dataItem->contourLineColorTextureObject=0;
 		}
 	
+	/* Recalculate the parts of the hillshade map invalidated by bathymetry changes or sun motion: */
+	if(illuminate&&hillshadeMap!=0)
+		hillshadeMap->update(contextData);
+	
 	/* Check if the single-pass surface shader is outdated: */
 	if(dataItem->surfaceSettingsVersion!=surfaceSettingsVersion||(illuminate&&dataItem->lightTrackerVersion!=contextData.getLightTracker()->getVersion()))
 		{
-		/* Rebuild the shader: */
+		/* Switch to the shader for the new settings: */
 		try
 			{
-			GLhandleARB newShader=createSinglePassSurfaceShader(*contextData.getLightTracker(),dataItem->heightMapShaderUniforms);
-			glDeleteObjectARB(dataItem->heightMapShader);
-			dataItem->heightMapShader=newShader;
+			updateSinglePassSurfaceShader(*contextData.getLightTracker(),dataItem);
 			}
 		catch(const std::runtime_error& err)
 			{
@@ -809,6 +884,9 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 		dataItem->lightTrackerVersion=contextData.getLightTracker()->getVersion();
 		}
 	
+	/* Finish shaders that were linked in the background: */
+	dataItem->shaderCache.update();
+	
 	/* Bind the single-pass surface shader: */
 	glUseProgramObjectARB(dataItem->heightMapShader);
 	const GLint* ulPtr=dataItem->heightMapShaderUniforms;
@@ -839,10 +917,11 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 		/* Upload the texture mapping plane equation: */
 		elevationColorMap->uploadTexturePlane(*(ulPtr++));
 		
-		/* Bind the height color map texture: */
+		/* Bind the height color map texture array and select the current height color map: */
 		glActiveTextureARB(GL_TEXTURE1_ARB);
 		elevationColorMap->bindTexture(contextData);
 		glUniform1iARB(*(ulPtr++),1);
+		elevationColorMap->uploadTextureLayer(*(ulPtr++));
 		}
 	
 	if(drawContourLines)
@@ -891,6 +970,14 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 		for(int i=0;i<16;++i,++tmdpPtr,++mPtr)
 				*mPtr=GLfloat(*tmdpPtr);
 		glUniformMatrix4fvARB(*(ulPtr++),1,GL_FALSE,matrix);
+		
+		if(hillshadeMap!=0)
+			{
+			/* Bind the hillshade map texture: */
+			glActiveTextureARB(GL_TEXTURE6_ARB);
+			hillshadeMap->bindTexture(contextData);
+			glUniform1iARB(*(ulPtr++),6);
+			}
 		}
 	
 	if(waterTable!=0&&dem==0)
@@ -942,9 +1029,14 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 	glUniformARB(*(ulPtr++),projectionModelviewDepthProjection);
 	
 	/* Draw the surface: */
-	depthImageRenderer->renderSurfaceTemplate(contextData);
+	depthImageRenderer->renderSurfaceTemplate(projectionModelviewDepthProjection,contextData);
 	
 	/* Unbind all textures and buffers: */
+	if(illuminate&&hillshadeMap!=0)
+		{
+		glActiveTextureARB(GL_TEXTURE6_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		}
 	if(waterTable!=0&&dem==0)
 		{
 		glActiveTextureARB(GL_TEXTURE4_ARB);
@@ -973,7 +1065,7 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 	else if(elevationColorMap!=0)
 		{
 		glActiveTextureARB(GL_TEXTURE1_ARB);
-		glBindTexture(GL_TEXTURE_1D,0);
+		glBindTexture(GL_TEXTURE_1D_ARRAY_EXT,0);
 		}
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
@@ -32,6 +32,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Kinect/FrameBuffer.h>
 
 #include "Types.h"
+#include "ShaderHelper.h"
+#include "ShaderProgramCache.h"
 
 /* Forward declarations: */
 class DepthImageRenderer;
@@ -39,6 +41,8 @@ class ElevationColorMap;
 class GLLightTracker;
 class DEM;
 class WaterTable2;
+class HillshadeMap;
+class StageTimers;
 
 class SurfaceRenderer:public GLObject
 	{
@@ -47,6 +51,13 @@ class SurfaceRenderer:public GLObject
 	typedef Geometry::Plane<GLfloat,3> Plane; // Type for plane equations
 	
 	private:
+	enum ShaderFeatures // Enumerated type for features of the single-pass surface shader
+		{
+		DEMMATCHING=0x1,HEIGHTCOLORMAP=0x2,DIPPINGBED=0x4,FOLDEDDIPPINGBED=0x8,
+		CONTOURLINES=0x10,ILLUMINATION=0x20,WATER=0x40,ADVECTEDWATER=0x80,
+		SHADOWS=0x100
+		};
+	
 	struct DataItem:public GLObject::DataItem
 		{
 		/* Elements: */
@@ -56,8 +67,9 @@ class SurfaceRenderer:public GLObject
 		GLuint contourLineDepthBufferObject; // Depth render buffer for topographic contour line frame buffer
 		GLuint contourLineColorTextureObject; // Color texture object for topographic contour line frame buffer
 		unsigned int contourLineVersion; // Version number of depth image used for contour line generation
-		GLhandleARB heightMapShader; // Shader program to render the surface using a height color map
-		GLint heightMapShaderUniforms[17];//[16]; // Locations of the height map shader's uniform variables
+		ShaderProgramCache shaderCache; // Cache of single-pass surface shader programs for all surface settings used so far
+		GLhandleARB heightMapShader; // Shader program to render the surface using a height color map; owned by the shader cache
+		GLint heightMapShaderUniforms[20]; // Locations of the height map shader's uniform variables
 		unsigned int surfaceSettingsVersion; // Version number of surface settings for which the height map shader was built
 		unsigned int lightTrackerVersion; // Version number of light tracker state for which the height map shader was built
 		GLhandleARB globalAmbientHeightMapShader; // Shader program to render the global ambient component of the surface using a height color map
@@ -96,12 +108,19 @@ class SurfaceRenderer:public GLObject
 	bool advectWaterTexture; // Flag whether water texture coordinates are advected to visualize water flow
 	GLfloat waterOpacity; // Scaling factor for water opacity
 	
+	const HillshadeMap* hillshadeMap; // Pointer to a cached map of sun visibility and ambient occlusion to shadow the illuminated surface; if NULL, shadows are disabled
+	
+	const StageTimers* stageTimers; // Timer set measuring surface rendering; if NULL, rendering is not measured
+	
 	unsigned int surfaceSettingsVersion; // Version number of surface settings to invalidate surface rendering shader on changes
 	double animationTime; // Time value for water animation
 	
 	/* Private methods: */
 	void shaderSourceFileChanged(const IO::FileMonitor::Event& event); // Callback called when one of the external shader source files is changed
-	GLhandleARB createSinglePassSurfaceShader(const GLLightTracker& lt,GLint* uniformLocations) const; // Creates a single-pass surface rendering shader based on current renderer settings
+	unsigned int getShaderFeatures(void) const; // Returns the bit mask of single-pass surface shader features for the current renderer settings
+	ShaderSourceList createSinglePassSurfaceShaderSources(unsigned int shaderFeatures,const GLLightTracker& lt) const; // Creates the sources of a single-pass surface rendering shader with the given features
+	void querySinglePassSurfaceShaderUniforms(unsigned int shaderFeatures,GLhandleARB shader,GLint* uniformLocations) const; // Queries the uniform locations of a single-pass surface rendering shader with the given features
+	void updateSinglePassSurfaceShader(const GLLightTracker& lt,DataItem* dataItem) const; // Retrieves the single-pass surface rendering shader for the current renderer settings from the data item's cache, and links likely next shaders in the background
 	void renderPixelCornerElevations(const int viewport[4],const PTransform& projectionModelview,GLContextData& contextData,DataItem* dataItem) const; // Creates texture containing pixel-corner elevations based on the current depth image
 	
 	/* Constructors and destructors: */
@@ -125,6 +144,8 @@ class SurfaceRenderer:public GLObject
 	void setWaterTable(WaterTable2* newWaterTable); // Sets the pointer to the water table; NULL disables water handling
 	void setAdvectWaterTexture(bool newAdvectWaterTexture); // Sets the water texture coordinate advection flag
 	void setWaterOpacity(GLfloat newWaterOpacity); // Sets the water opacity factor
+	void setHillshadeMap(const HillshadeMap* newHillshadeMap); // Sets the hillshade map used to shadow the illuminated surface; NULL disables shadows
+	void setStageTimers(const StageTimers* newStageTimers); // Measures the GPU time of surface rendering with the given timer set; NULL stops measuring
 	void setAnimationTime(double newAnimationTime); // Sets the time for water animation in seconds
 	void renderSinglePass(const int viewport[4],const PTransform& projection,const OGTransform& modelview,GLContextData& contextData) const; // Renders the surface in a single pass using the current surface settings
 	#if 0
@@ -25,11 +25,18 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 // DEBUGGING
 #include <iostream>
 
+#include <stdio.h>
+#include <string>
+#include <algorithm>
+#include <Math/Math.h>
+#include <Math/Constants.h>
 #include <GL/gl.h>
 #include <GL/GLVertexArrayParts.h>
 #include <GL/GLContextData.h>
+#include <GL/GLExtensionManager.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
 #include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
 #include <GL/Extensions/GLARBTextureRectangle.h>
@@ -40,6 +47,34 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "WaterTable2.h"
 #include "ShaderHelper.h"
+#include "StageTimers.h"
+
+namespace {
+
+/*****************************
+Instanced drawing entry point:
+*****************************/
+
+typedef void (APIENTRY * DrawElementsInstancedProc)(GLenum mode,GLsizei count,GLenum type,const GLvoid* indices,GLsizei primcount);
+
+DrawElementsInstancedProc drawElementsInstancedProc=0;
+
+/****************
+Helper functions:
+****************/
+
+bool initDrawInstanced(void)
+	{
+	/* Check for the required extension: */
+	if(!GLExtensionManager::isExtensionSupported("GL_ARB_draw_instanced"))
+		return false;
+	
+	/* Retrieve the entry point: */
+	drawElementsInstancedProc=GLExtensionManager::getFunction<DrawElementsInstancedProc>("glDrawElementsInstancedARB");
+	return drawElementsInstancedProc!=0;
+	}
+
+}
 
 /****************************************
 Methods of class WaterRenderer::DataItem:
@@ -47,11 +82,14 @@ Methods of class WaterRenderer::DataItem:
 
 WaterRenderer::DataItem::DataItem(void)
 	:vertexBuffer(0),indexBuffer(0),
+	 haveDrawInstanced(false),
+	 wetTileBuffer(0),wetTileReadPending(false),wetTileFrameIndex(0),
 	 waterShader(0)
 	{
 	/* Initialize all required extensions: */
 	GLARBFragmentShader::initExtension();
 	GLARBMultitexture::initExtension();
+	GLARBPixelBufferObject::initExtension();
 	GLARBShaderObjects::initExtension();
 	GLARBTextureFloat::initExtension();
 	GLARBTextureRectangle::initExtension();
@@ -59,9 +97,13 @@ WaterRenderer::DataItem::DataItem(void)
 	GLARBVertexBufferObject::initExtension();
 	GLARBVertexShader::initExtension();
 	
+	/* Check whether tiles can be drawn with instanced draw calls: */
+	haveDrawInstanced=initDrawInstanced();
+	
 	/* Allocate the buffers: */
 	glGenBuffersARB(1,&vertexBuffer);
 	glGenBuffersARB(1,&indexBuffer);
+	glGenBuffersARB(1,&wetTileBuffer);
 	}
 
 WaterRenderer::DataItem::~DataItem(void)
@@ -69,6 +111,7 @@ WaterRenderer::DataItem::~DataItem(void)
 	/* Release all allocated buffers and shaders: */
 	glDeleteBuffersARB(1,&vertexBuffer);
 	glDeleteBuffersARB(1,&indexBuffer);
+	glDeleteBuffersARB(1,&wetTileBuffer);
 	glDeleteObjectARB(waterShader);
 	}
 
@@ -76,8 +119,111 @@ WaterRenderer::DataItem::~DataItem(void)
 Methods of class WaterRenderer:
 ******************************/
 
+void WaterRenderer::updateWetTiles(WaterRenderer::DataItem* dataItem,GLContextData& contextData) const
+	{
+	/* Read the active tiles only once per frame, so that the previous read has completed when it is retrieved: */
+	if(dataItem->wetTileFrameIndex==frameIndex)
+		return;
+	dataItem->wetTileFrameIndex=frameIndex;
+	
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->wetTileBuffer);
+	if(dataItem->wetTileReadPending)
+		{
+		/* Retrieve the active tiles read during the previous frame; they lag by one frame, which the active tiles' dilation covers: */
+		const GLfloat* atPtr=static_cast<const GLfloat*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+		if(atPtr!=0)
+			{
+			for(std::vector<bool>::iterator wtIt=dataItem->wetTiles.begin();wtIt!=dataItem->wetTiles.end();++wtIt,++atPtr)
+				*wtIt=*atPtr>0.0f;
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+			}
+		dataItem->wetTileReadPending=false;
+		}
+	
+	/* Issue an asynchronous read of the current active tiles if the water table simulates sparsely in this context: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	if(waterTable->bindActiveTileTexture(contextData))
+		{
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,0);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		dataItem->wetTileReadPending=true;
+		}
+	else
+		{
+		/* Treat all tiles as wet: */
+		std::fill(dataItem->wetTiles.begin(),dataItem->wetTiles.end(),true);
+		}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	}
+
+bool WaterRenderer::isTileVisible(const PTransform::Matrix& pmvg,unsigned int tx,unsigned int ty) const
+	{
+	/* Get the tile's grid-space bounding box: */
+	Scalar box[2][3];
+	box[0][0]=Scalar(tx*tileSize);
+	box[0][1]=Scalar(ty*tileSize);
+	box[0][2]=elevationRange[0];
+	box[1][0]=Scalar(Math::min((tx+1)*tileSize,waterGridSize[0]-1))+Scalar(1);
+	box[1][1]=Scalar(Math::min((ty+1)*tileSize,waterGridSize[1]-1))+Scalar(1);
+	box[1][2]=elevationRange[1];
+	
+	/* Find the clip planes that each corner of the bounding box is outside of: */
+	unsigned int commonOutside=0x3fU;
+	for(int corner=0;corner<8;++corner)
+		{
+		Scalar c[4];
+		for(int i=0;i<4;++i)
+			c[i]=pmvg(i,0)*box[corner&0x1][0]+pmvg(i,1)*box[(corner>>1)&0x1][1]+pmvg(i,2)*box[(corner>>2)&0x1][2]+pmvg(i,3);
+		unsigned int outside=0x0U;
+		for(int i=0;i<3;++i)
+			{
+			if(c[i]<-c[3])
+				outside|=0x1U<<(i*2);
+			if(c[i]>c[3])
+				outside|=0x2U<<(i*2);
+			}
+		commonOutside&=outside;
+		}
+	
+	/* The tile is visible unless all its corners are outside the same clip plane: */
+	return commonOutside==0x0U;
+	}
+
+Scalar WaterRenderer::calcTileDensity(const PTransform::Matrix& pmvg,const GLint viewport[4],unsigned int tx,unsigned int ty) const
+	{
+	/* Get the tile's center at the middle of the elevation range: */
+	Scalar px=(Scalar(tx)+Scalar(0.5))*Scalar(tileSize);
+	Scalar py=(Scalar(ty)+Scalar(0.5))*Scalar(tileSize);
+	Scalar pz=Math::mid(elevationRange[0],elevationRange[1]);
+	
+	/* Project the center and its horizontal and vertical neighbors into window space: */
+	Scalar win[3][2];
+	for(int n=0;n<3;++n)
+		{
+		Scalar x=n==1?px+Scalar(1):px;
+		Scalar y=n==2?py+Scalar(1):py;
+		Scalar c[4];
+		for(int i=0;i<4;++i)
+			c[i]=pmvg(i,0)*x+pmvg(i,1)*y+pmvg(i,2)*pz+pmvg(i,3);
+		
+		/* Request full detail for tiles reaching behind the viewer: */
+		if(c[3]<=Scalar(0))
+			return Math::Constants<Scalar>::max;
+		for(int i=0;i<2;++i)
+			win[n][i]=c[i]/c[3]*Scalar(0.5)*Scalar(viewport[2+i]);
+		}
+	
+	/* Return the larger of the projected cell sizes: */
+	Scalar dx2=Math::sqr(win[1][0]-win[0][0])+Math::sqr(win[1][1]-win[0][1]);
+	Scalar dy2=Math::sqr(win[2][0]-win[0][0])+Math::sqr(win[2][1]-win[0][1]);
+	return Math::sqrt(Math::max(dx2,dy2));
+	}
+
 WaterRenderer::WaterRenderer(const WaterTable2* sWaterTable)
-	:waterTable(sWaterTable)
+	:waterTable(sWaterTable),
+	 lodCellSize(0.0f),
+	 stageTimers(0),
+	 frameIndex(1)
 	{
 	/* Copy the water table's grid sizes and grid cell size: */
 	for(int i=0;i<2;++i)
@@ -89,6 +235,8 @@ WaterRenderer::WaterRenderer(const WaterTable2* sWaterTable)
 	
 	/* Get the water table's domain: */
 	const WaterTable2::Box& wd=waterTable->getDomain();
+	elevationRange[0]=wd.min[2];
+	elevationRange[1]=wd.max[2];
 	
 	/* Calculate the transformation from grid space to world space: */
 	gridTransform=PTransform::identity;
@@ -107,6 +255,21 @@ WaterRenderer::WaterRenderer(const WaterTable2* sWaterTable)
 	tgtm(1,1)=Scalar(waterGridSize[1])/(wd.max[1]-wd.min[1]);
 	tgtm(1,3)=-wd.min[1]*tgtm(1,1);
 	tangentGridTransform*=waterTable->getBaseTransform();
+	
+	/* Calculate the number of tiles covering the water surface's vertices, and the number of the water table's active tiles covering its cells: */
+	for(int i=0;i<2;++i)
+		{
+		numTiles[i]=(waterGridSize[i]-1+tileSize-1)/tileSize;
+		numActiveTiles[i]=(waterGridSize[i]+tileSize-1)/tileSize;
+		}
+	
+	/* Calculate the index ranges of the tile template's triangle strips in all levels of detail: */
+	levelIndices[0]=0;
+	for(unsigned int level=0;level<numTileLevels;++level)
+		{
+		unsigned int n=(tileSize>>level)+1;
+		levelIndices[level+1]=levelIndices[level]+(n-1)*n*2+(n-2)*2;
+		}
 	}
 
 void WaterRenderer::initContext(GLContextData& contextData) const
@@ -115,41 +278,100 @@ void WaterRenderer::initContext(GLContextData& contextData) const
 	DataItem* dataItem=new DataItem;
 	contextData.addDataItem(this,dataItem);
 	
-	/* Upload the grid of template vertices into the vertex buffer: */
+	/* Start with all of the water table's active tiles wet: */
+	dataItem->wetTiles.resize(numActiveTiles[1]*numActiveTiles[0],true);
+	dataItem->tileLevels.resize(numTiles[1]*numTiles[0]);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->wetTileBuffer);
+	glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,numActiveTiles[1]*numActiveTiles[0]*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	
+	/* Upload the tile template vertices of all levels of detail into the vertex buffer, in tile-local grid coordinates: */
+	unsigned int numVertices=0;
+	unsigned int levelVertices[numTileLevels];
+	for(unsigned int level=0;level<numTileLevels;++level)
+		{
+		levelVertices[level]=numVertices;
+		numVertices+=Math::sqr((tileSize>>level)+1);
+		}
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB,dataItem->vertexBuffer);
-	glBufferDataARB(GL_ARRAY_BUFFER_ARB,waterGridSize[1]*waterGridSize[0]*sizeof(Vertex),0,GL_STATIC_DRAW_ARB);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB,numVertices*sizeof(Vertex),0,GL_STATIC_DRAW_ARB);
 	Vertex* vPtr=static_cast<Vertex*>(glMapBufferARB(GL_ARRAY_BUFFER_ARB,GL_WRITE_ONLY_ARB));
-	for(unsigned int y=0;y<waterGridSize[1];++y)
-		for(unsigned int x=0;x<waterGridSize[0];++x,++vPtr)
-			{
-			/* Set the template vertex' position to the pixel center's position: */
-			vPtr->position[0]=GLfloat(x)+0.5f;
-			vPtr->position[1]=GLfloat(y)+0.5f;
-			}
+	for(unsigned int level=0;level<numTileLevels;++level)
+		{
+		unsigned int n=(tileSize>>level)+1;
+		for(unsigned int y=0;y<n;++y)
+			for(unsigned int x=0;x<n;++x,++vPtr)
+				{
+				vPtr->position[0]=GLfloat(x<<level);
+				vPtr->position[1]=GLfloat(y<<level);
+				}
+		}
 	glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
 	
-	/* Upload the surface's triangle indices into the index buffer: */
+	/* Upload each level's tile template as one triangle strip whose rows are joined by degenerate triangles: */
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
-	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,(waterGridSize[1]-1)*waterGridSize[0]*2*sizeof(GLuint),0,GL_STATIC_DRAW_ARB);
+	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,levelIndices[numTileLevels]*sizeof(GLuint),0,GL_STATIC_DRAW_ARB);
 	GLuint* iPtr=static_cast<GLuint*>(glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,GL_WRITE_ONLY_ARB));
-	for(unsigned int y=1;y<waterGridSize[1];++y)
-		for(unsigned int x=0;x<waterGridSize[0];++x,iPtr+=2)
+	for(unsigned int level=0;level<numTileLevels;++level)
+		{
+		unsigned int n=(tileSize>>level)+1;
+		GLuint base=GLuint(levelVertices[level]);
+		for(unsigned int y=1;y<n;++y)
 			{
-			iPtr[0]=GLuint(y*waterGridSize[0]+x);
-			iPtr[1]=GLuint((y-1)*waterGridSize[0]+x);
+			if(y>1)
+				{
+				/* Join the row of quads to the previous one by repeating the previous row's last index and this row's first index: */
+				iPtr[0]=base+GLuint((y-2)*n+n-1);
+				iPtr[1]=base+GLuint(y*n);
+				iPtr+=2;
+				}
+			
+			/* Store the row of quads as pairs of upper and lower vertices: */
+			for(unsigned int x=0;x<n;++x,iPtr+=2)
+				{
+				iPtr[0]=base+GLuint(y*n+x);
+				iPtr[1]=base+GLuint((y-1)*n+x);
+				}
 			}
+		}
 	glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,0);
 	
-	/* Create the water rendering shader: */
-	dataItem->waterShader=linkVertexAndFragmentShader("WaterRenderingShader");
+	/* Create the water rendering shader, reading the tile index from the instance ID if tiles are drawn with instanced draw calls: */
+	char tileDefines[256];
+	if(dataItem->haveDrawInstanced)
+		snprintf(tileDefines,sizeof(tileDefines),"#extension GL_ARB_draw_instanced : enable\n#define TILE_SIZE %u.0\n#define MAX_TILES %u\n#define TILE_INDEX gl_InstanceIDARB\n",tileSize,maxTileBatchSize);
+	else
+		snprintf(tileDefines,sizeof(tileDefines),"#define TILE_SIZE %u.0\n#define MAX_TILES 1\n#define TILE_INDEX 0\n",tileSize);
+	ShaderSourceList sources;
+	sources.push_back(ShaderSource(GL_VERTEX_SHADER_ARB,std::string(tileDefines)+readShaderSourceFile("WaterRenderingShader.vs")));
+	sources.push_back(ShaderSource(GL_FRAGMENT_SHADER_ARB,readShaderSourceFile("WaterRenderingShader.fs")));
+	dataItem->waterShader=linkShaderSources(sources);
 	GLint* ulPtr=dataItem->waterShaderUniforms;
 	*(ulPtr++)=glGetUniformLocationARB(dataItem->waterShader,"quantitySampler");
 	*(ulPtr++)=glGetUniformLocationARB(dataItem->waterShader,"bathymetrySampler");
 	*(ulPtr++)=glGetUniformLocationARB(dataItem->waterShader,"modelviewGridMatrix");
 	*(ulPtr++)=glGetUniformLocationARB(dataItem->waterShader,"tangentModelviewGridMatrix");
 	*(ulPtr++)=glGetUniformLocationARB(dataItem->waterShader,"projectionModelviewGridMatrix");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->waterShader,"gridMax");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->waterShader,"tileOrigins");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->waterShader,"tileEdgeStrides");
+	}
+
+void WaterRenderer::setLod(float newLodCellSize)
+	{
+	lodCellSize=newLodCellSize;
+	}
+
+void WaterRenderer::setStageTimers(const StageTimers* newStageTimers)
+	{
+	stageTimers=newStageTimers;
+	}
+
+void WaterRenderer::frame(void)
+	{
+	++frameIndex;
 	}
 
 void WaterRenderer::render(const PTransform& projection,const OGTransform& modelview,GLContextData& contextData) const
@@ -157,10 +379,55 @@ void WaterRenderer::render(const PTransform& projection,const OGTransform& model
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
+	/* Measure water surface rendering: */
+	StageTimers::GPUTimer waterSurfaceTimer(stageTimers,StageTimers::WATERSURFACE,contextData);
+	
+	/* Pick up the water table's newest active tiles: */
+	updateWetTiles(dataItem,contextData);
+	
 	/* Calculate the required matrices: */
 	PTransform projectionModelview=projection;
 	projectionModelview*=modelview;
 	
+	/* Calculate the vertex transformation from grid space to clip space: */
+	PTransform projectionModelviewGridTransform=gridTransform;
+	projectionModelviewGridTransform.leftMultiply(modelview);
+	projectionModelviewGridTransform.leftMultiply(projection);
+	const PTransform::Matrix& pmvg=projectionModelviewGridTransform.getMatrix();
+	
+	/* Find the wet tiles that might be visible and their levels of detail: */
+	GLint viewport[4];
+	if(lodCellSize>0.0f)
+		glGetIntegerv(GL_VIEWPORT,viewport);
+	unsigned int numDrawnTiles=0;
+	std::vector<unsigned int>::iterator tlIt=dataItem->tileLevels.begin();
+	for(unsigned int ty=0;ty<numTiles[1];++ty)
+		for(unsigned int tx=0;tx<numTiles[0];++tx,++tlIt)
+			{
+			/* Check the active tiles covering the tile's cells, including the cells shared with the next tiles: */
+			unsigned int atx1=Math::min(tx+1,numActiveTiles[0]-1);
+			unsigned int aty1=Math::min(ty+1,numActiveTiles[1]-1);
+			const std::vector<bool>& wt=dataItem->wetTiles;
+			bool wet=wt[ty*numActiveTiles[0]+tx]||wt[ty*numActiveTiles[0]+atx1]||wt[aty1*numActiveTiles[0]+tx]||wt[aty1*numActiveTiles[0]+atx1];
+			
+			*tlIt=numTileLevels;
+			if(wet&&isTileVisible(pmvg,tx,ty))
+				{
+				/* Use the coarsest level whose cells do not exceed the target projected size: */
+				unsigned int level=0;
+				if(lodCellSize>0.0f)
+					{
+					Scalar density=calcTileDensity(pmvg,viewport,tx,ty);
+					while(level+1<numTileLevels&&Scalar(1U<<(level+1))*density<=Scalar(lodCellSize))
+						++level;
+					}
+				*tlIt=level;
+				++numDrawnTiles;
+				}
+			}
+	if(numDrawnTiles==0)
+		return;
+	
 	/* Bind the water rendering shader: */
 	glUseProgramObjectARB(dataItem->waterShader);
 	const GLint* ulPtr=dataItem->waterShaderUniforms;
@@ -192,22 +459,73 @@ void WaterRenderer::render(const PTransform& projection,const OGTransform& model
 		*tmvgtmPtr=GLfloat(*tmvgtPtr);
 	glUniformMatrix4fvARB(*(ulPtr++),1,GL_FALSE,tangentModelviewGridTransformMatrix);
 	
-	/* Calculate and upload the vertex transformation from grid space to clip space: */
-	PTransform projectionModelviewGridTransform=gridTransform;
-	projectionModelviewGridTransform.leftMultiply(modelview);
-	projectionModelviewGridTransform.leftMultiply(projection);
+	/* Upload the vertex transformation from grid space to clip space: */
 	glUniformARB(*(ulPtr++),projectionModelviewGridTransform);
 	
+	/* Upload the position of the last water grid cell center, to which vertices of tiles overlapping the grid's edges are clamped: */
+	glUniform2fARB(*(ulPtr++),GLfloat(waterGridSize[0])-0.5f,GLfloat(waterGridSize[1])-0.5f);
+	GLint tileOriginsLocation=*(ulPtr++);
+	GLint tileEdgeStridesLocation=*(ulPtr++);
+	
 	/* Bind the vertex and index buffers: */
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB,dataItem->vertexBuffer);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
 	
-	/* Draw the surface: */
+	/* Draw the tiles of each level of detail in batches: */
 	GLVertexArrayParts::enable(Vertex::getPartsMask());
 	glVertexPointer(static_cast<const Vertex*>(0));
-	GLuint* indexPtr=0;
-	for(unsigned int y=1;y<waterGridSize[1];++y,indexPtr+=waterGridSize[0]*2)
-		glDrawElements(GL_QUAD_STRIP,waterGridSize[0]*2,GL_UNSIGNED_INT,indexPtr);
+	unsigned int batchSize=dataItem->haveDrawInstanced?maxTileBatchSize:1;
+	GLfloat tileOrigins[maxTileBatchSize*2];
+	GLfloat tileEdgeStrides[maxTileBatchSize*4];
+	for(unsigned int level=0;level<numTileLevels;++level)
+		{
+		GLsizei numIndices=GLsizei(levelIndices[level+1]-levelIndices[level]);
+		const GLuint* levelIndexPtr=static_cast<const GLuint*>(0)+levelIndices[level];
+		unsigned int numBatchTiles=0;
+		tlIt=dataItem->tileLevels.begin();
+		for(unsigned int ty=0;ty<numTiles[1];++ty)
+			for(unsigned int tx=0;tx<numTiles[0];++tx,++tlIt)
+				{
+				if(*tlIt!=level)
+					continue;
+				
+				/* Add the tile to the current batch: */
+				tileOrigins[numBatchTiles*2+0]=GLfloat(tx*tileSize);
+				tileOrigins[numBatchTiles*2+1]=GLfloat(ty*tileSize);
+				
+				/* Snap the vertices on edges shared with coarser drawn tiles to the coarser tiles' edges to avoid cracks: */
+				unsigned int neighborLevels[4];
+				neighborLevels[0]=tx>0?tlIt[-1]:numTileLevels;
+				neighborLevels[1]=tx+1<numTiles[0]?tlIt[1]:numTileLevels;
+				neighborLevels[2]=ty>0?tlIt[-int(numTiles[0])]:numTileLevels;
+				neighborLevels[3]=ty+1<numTiles[1]?tlIt[numTiles[0]]:numTileLevels;
+				for(int i=0;i<4;++i)
+					{
+					unsigned int edgeLevel=neighborLevels[i]<numTileLevels?Math::max(level,neighborLevels[i]):level;
+					tileEdgeStrides[numBatchTiles*4+i]=GLfloat(1U<<edgeLevel);
+					}
+				
+				if(++numBatchTiles==batchSize)
+					{
+					/* Draw the full batch: */
+					glUniform2fvARB(tileOriginsLocation,numBatchTiles,tileOrigins);
+					glUniform4fvARB(tileEdgeStridesLocation,numBatchTiles,tileEdgeStrides);
+					if(dataItem->haveDrawInstanced)
+						(*drawElementsInstancedProc)(GL_TRIANGLE_STRIP,numIndices,GL_UNSIGNED_INT,levelIndexPtr,numBatchTiles);
+					else
+						glDrawElements(GL_TRIANGLE_STRIP,numIndices,GL_UNSIGNED_INT,levelIndexPtr);
+					numBatchTiles=0;
+					}
+				}
+		
+		if(numBatchTiles>0)
+			{
+			/* Draw the last partial batch, which only remains with instanced draw calls: */
+			glUniform2fvARB(tileOriginsLocation,numBatchTiles,tileOrigins);
+			glUniform4fvARB(tileEdgeStridesLocation,numBatchTiles,tileEdgeStrides);
+			(*drawElementsInstancedProc)(GL_TRIANGLE_STRIP,numIndices,GL_UNSIGNED_INT,levelIndexPtr,numBatchTiles);
+			}
+		}
 	GLVertexArrayParts::disable(Vertex::getPartsMask());
 	
 	/* Unbind all textures and buffers: */
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef WATERRENDERER_INCLUDED
 #define WATERRENDERER_INCLUDED
 
+#include <vector>
 #include <GL/gl.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <GL/GLObject.h>
@@ -32,12 +33,16 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 /* Forward declarations: */
 class WaterTable2;
+class StageTimers;
 
 class WaterRenderer:public GLObject
 	{
 	/* Embedded classes: */
 	private:
 	typedef GLGeometry::Vertex<void,0,void,0,void,GLfloat,2> Vertex; // Type for template vertices
+	static const unsigned int tileSize=16; // Width and height of the square tiles of water grid cells that are culled and drawn together; matches the water table's active tiles
+	static const unsigned int numTileLevels=4; // Number of levels of detail of the tile template mesh, with vertex strides of 1, 2, 4, and 8 cells
+	static const unsigned int maxTileBatchSize=64; // Maximum number of tiles drawn by one instanced draw call
 	
 	struct DataItem:public GLObject::DataItem // Structure storing per-context OpenGL state
 		{
@@ -45,12 +50,18 @@ class WaterRenderer:public GLObject
 		public:
 		
 		/* OpenGL state management: */
-		GLuint vertexBuffer; // ID of vertex buffer object holding water surface's template vertices
-		GLuint indexBuffer; // ID of index buffer object holding water surface's triangles
+		GLuint vertexBuffer; // ID of vertex buffer object holding the tile template vertices of all levels of detail
+		GLuint indexBuffer; // ID of index buffer object holding the tile template triangle strips of all levels of detail
+		bool haveDrawInstanced; // Flag whether the context supports instanced draw calls via GL_ARB_draw_instanced
+		GLuint wetTileBuffer; // ID of pixel buffer object receiving asynchronous reads of the water table's active tile texture
+		bool wetTileReadPending; // Flag whether a read of the active tile texture into the pixel buffer has been issued but not retrieved
+		unsigned int wetTileFrameIndex; // Index of the frame during which the active tile texture was last read
+		std::vector<bool> wetTiles; // Most recently retrieved flags for the water table's active tiles; all tiles are wet if the water table does not simulate sparsely in this context
+		std::vector<unsigned int> tileLevels; // Level of detail of each tile in the current rendering pass, or numTileLevels if the tile is not drawn
 		
 		/* GLSL shader management: */
 		GLhandleARB waterShader; // Shader program to render the water surface
-		GLint waterShaderUniforms[5]; // Locations of the water shader's uniform variables
+		GLint waterShaderUniforms[8]; // Locations of the water shader's uniform variables
 		
 		/* Constructors and destructors: */
 		DataItem(void);
@@ -62,8 +73,20 @@ class WaterRenderer:public GLObject
 	unsigned int bathymetryGridSize[2]; // Size of vertex-centered bathymetry grid
 	unsigned int waterGridSize[2]; // Size of cell-centered water level grid; one cell larger than bathymetry grid
 	GLfloat cellSize[2]; // Cell size of the bathymetry and water level grids in world coordinate units
+	Scalar elevationRange[2]; // Range of water surface elevations in grid space, used to cull tiles
 	PTransform gridTransform; // Vertex transformation from grid space to world space
 	PTransform tangentGridTransform; // Transposed tangent plane transformation from grid space to world space
+	unsigned int numTiles[2]; // Number of tiles covering the water surface horizontally and vertically
+	unsigned int numActiveTiles[2]; // Number of the water table's active tiles horizontally and vertically
+	unsigned int levelIndices[numTileLevels+1]; // Index of the first index of each level's tile template triangle strip, and the total number of indices
+	GLfloat lodCellSize; // Projected size of water grid cells in window pixels up to which a tile's level of detail is reduced; 0 always draws tiles at full detail
+	const StageTimers* stageTimers; // Timer set measuring water surface rendering, or null
+	unsigned int frameIndex; // Index of the current frame, to read the active tile texture once per frame
+	
+	/* Private methods: */
+	void updateWetTiles(DataItem* dataItem,GLContextData& contextData) const; // Retrieves the active tile flags read during the previous frame and issues an asynchronous read for the current frame
+	bool isTileVisible(const PTransform::Matrix& pmvg,unsigned int tx,unsigned int ty) const; // Returns true if the given tile might be visible under the given combined projection, modelview, and grid matrix
+	Scalar calcTileDensity(const PTransform::Matrix& pmvg,const GLint viewport[4],unsigned int tx,unsigned int ty) const; // Returns the projected size of one water grid cell at the center of the given tile in window pixels
 	
 	/* Constructors and destructors: */
 	public:
@@ -73,7 +96,10 @@ class WaterRenderer:public GLObject
 	virtual void initContext(GLContextData& contextData) const;
 	
 	/* New methods: */
-	void render(const PTransform& projection,const OGTransform& modelview,GLContextData& contextData) const; // Renders the water surface
+	void setLod(float newLodCellSize); // Reduces each tile's level of detail up to the given projected cell size in window pixels; 0 always draws tiles at full detail
+	void setStageTimers(const StageTimers* newStageTimers); // Measures the GPU time of water surface rendering with the given timer set, or stops measuring if null
+	void frame(void); // Starts a new frame; lets the next rendering pass in each context pick up the water table's newest active tiles
+	void render(const PTransform& projection,const OGTransform& modelview,GLContextData& contextData) const; // Renders the visible parts of the water surface that are inside the water table's active tiles
 	};
 
 #endif
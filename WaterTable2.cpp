@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <time.h>
 #include <string>
 #include <Math/Math.h>
 #include <Geometry/AffineCombiner.h>
@@ -33,27 +34,32 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/Extensions/GLARBDrawBuffers.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
 #include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
 #include <GL/Extensions/GLARBTextureRectangle.h>
 #include <GL/Extensions/GLARBTextureRg.h>
+#include <GL/Extensions/GLARBVertexBufferObject.h>
 #include <GL/Extensions/GLARBVertexShader.h>
 #include <GL/Extensions/GLEXTFramebufferObject.h>
 #include <GL/GLContextData.h>
 #include <GL/GLTransformationWrappers.h>
 
 #include "DepthImageRenderer.h"
+#include "StageTimers.h"
 #include "ShaderHelper.h"
 
 // DEBUGGING
 #include <iostream>
 
-//Snow Support
-#include <IO/ValueSource.h>
-#include <IO/OpenFile.h>
-
 namespace {
 
+/*********
+Constants:
+*********/
+
+const unsigned int activeTileUpdateInterval=16; // Number of integration steps between active tile updates; water moves at most half a cell per step, so it cannot leave the dilated active tiles in between
+
 /****************
 Helper functions:
 ****************/
@@ -77,6 +83,58 @@ GLfloat* makeBuffer(int width,int height,int numComponents,...)
 	return buffer;
 	}
 
+double getMonotonicTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)/1.0e9;
+	}
+
+void replaceFence(GLsync& fence)
+	{
+	/* Replace the given fence with a fence after all commands issued so far in the current context: */
+	if(fence!=0)
+		deleteSync(fence);
+	fence=fenceSync();
+	}
+
+void waitForFence(GLsync& fence)
+	{
+	/* Make the current context wait for the given fence on the GPU, and delete the fence: */
+	if(fence!=0)
+		{
+		waitSync(fence);
+		deleteSync(fence);
+		fence=0;
+		}
+	}
+
+void resampleGrid(const GLfloat* source,const GLsizei sourceSize[2],GLfloat* dest,const GLsizei destSize[2],int numComponents)
+	{
+	/* Bilinearly interpolate the source grid at the centers of the destination cells, clamping at the source grid's boundaries: */
+	GLfloat* dPtr=dest;
+	for(GLsizei y=0;y<destSize[1];++y)
+		{
+		GLfloat sy=Math::max((GLfloat(y)+0.5f)*GLfloat(sourceSize[1])/GLfloat(destSize[1])-0.5f,0.0f);
+		GLsizei y0=Math::min(GLsizei(sy),sourceSize[1]-1);
+		GLsizei y1=Math::min(y0+1,sourceSize[1]-1);
+		GLfloat wy=Math::min(sy-GLfloat(y0),1.0f);
+		for(GLsizei x=0;x<destSize[0];++x,dPtr+=numComponents)
+			{
+			GLfloat sx=Math::max((GLfloat(x)+0.5f)*GLfloat(sourceSize[0])/GLfloat(destSize[0])-0.5f,0.0f);
+			GLsizei x0=Math::min(GLsizei(sx),sourceSize[0]-1);
+			GLsizei x1=Math::min(x0+1,sourceSize[0]-1);
+			GLfloat wx=Math::min(sx-GLfloat(x0),1.0f);
+			const GLfloat* s00=source+(y0*sourceSize[0]+x0)*numComponents;
+			const GLfloat* s10=source+(y0*sourceSize[0]+x1)*numComponents;
+			const GLfloat* s01=source+(y1*sourceSize[0]+x0)*numComponents;
+			const GLfloat* s11=source+(y1*sourceSize[0]+x1)*numComponents;
+			for(int i=0;i<numComponents;++i)
+				dPtr[i]=(s00[i]*(1.0f-wx)+s10[i]*wx)*(1.0f-wy)+(s01[i]*(1.0f-wx)+s11[i]*wx)*wy;
+			}
+		}
+	}
+
 }
 
 /**************************************
@@ -85,61 +143,141 @@ Methods of class WaterTable2::DataItem:
 
 WaterTable2::DataItem::DataItem(void)
 	:currentBathymetry(0),bathymetryVersion(0),currentQuantity(0),
-	 derivativeTextureObject(0),waterTextureObject(0),
-	 bathymetryFramebufferObject(0),derivativeFramebufferObject(0),maxStepSizeFramebufferObject(0),integrationFramebufferObject(0),waterFramebufferObject(0),
-	 bathymetryShader(0),waterAdaptShader(0),derivativeShader(0),maxStepSizeShader(0),boundaryShader(0),eulerStepShader(0),rungeKuttaStepShader(0),waterAddShader(0),waterShader(0),
-	//Snow Support
-	 snowShader(0),freezeShader(0),snowTextureObject(0),snowFramebufferObject(0),freezeFramebufferObject(0)
+	 derivativeTextureObject(0),currentMaxStepSize(0),currentStepState(0),resetSnowClock(false),numStepsSinceSnowUpdate(0),lastSnowUpdateTime(0.0),stepStateBufferObject(0),stepStateReadPending(false),waterTextureObject(0),waterSourceVersion(0),
+	 bathymetryFramebufferObject(0),derivativeFramebufferObject(0),maxStepSizeFramebufferObject(0),integrationFramebufferObject(0),waterFramebufferObject(0),stepStateFramebufferObject(0),
+	 bathymetryShader(0),waterAdaptShader(0),derivativeShader(0),maxStepSizeShader(0),stepSizeShader(0),boundaryShader(0),eulerStepShader(0),rungeKuttaStepShader(0),waterAddShader(0),waterShader(0),
+	 rungeKuttaSnowStepShader(0),fusedSnowStep(false),snowFramebufferObject(0),snowShader(0),freezeShader(0),currentSnow(0),
+	 volumeFramebufferObject(0),volumeBufferObject(0),volumeReadPending(false),volumeShader(0),volumeReductionShader(0),
+	 computeShaders(false),vectorFormat(GL_RGB32F),workGroupStepSizeTextureObject(0),derivativeComputeShader(0),stepSizeComputeShader(0),rungeKuttaComputeShader(0),
+	 activityTextureObject(0),activeTileTextureObject(0),numStepsSinceActiveTileUpdate(0),activeTileDepthBufferObject(0),activityFramebufferObject(0),activeTileFramebufferObject(0),
+	 activityShader(0),activeTileShader(0),activeTileDepthShader(0),
+	 haveFenceSync(false),publishFramebufferObject(0),usePublishedState(false),gridVersion(0),restoreVersion(0)
 	{
 	for(int i=0;i<2;++i)
 		{
 		bathymetryTextureObjects[i]=0;
 		maxStepSizeTextureObjects[i]=0;
+		stepStateTextureObjects[i]=0;
+		snowClockTextureObjects[i]=0;
+		snowTextureObjects[i]=0;
+		volumeTextureObjects[i]=0;
 		}
+	for(int i=0;i<4;++i)
+		bathymetryChangedRect[i]=0;
+	for(int i=0;i<2;++i)
+		gridSize[i]=0;
 	for(int i=0;i<3;++i)
+		{
 		quantityTextureObjects[i]=0;
+		for(int j=0;j<3;++j)
+			publishedTextureObjects[i][j]=0;
+		}
 	
 	/* Initialize all required OpenGL extensions: */
 	GLARBDrawBuffers::initExtension();
 	GLARBFragmentShader::initExtension();
 	GLARBMultitexture::initExtension();
+	GLARBPixelBufferObject::initExtension();
 	GLARBShaderObjects::initExtension();
 	GLARBTextureFloat::initExtension();
 	GLARBTextureRectangle::initExtension();
 	GLARBTextureRg::initExtension();
+	GLARBVertexBufferObject::initExtension();
 	GLARBVertexShader::initExtension();
 	GLEXTFramebufferObject::initExtension();
 	}
 
 WaterTable2::DataItem::~DataItem(void)
 	{
-	/* Delete all allocated shaders, textures, and buffers: */
+	/* Delete all grids and their frame buffers: */
+	deleteGrids();
+	
+	/* Delete all other allocated shaders, textures, and buffers: */
+	glDeleteTextures(2,stepStateTextureObjects);
+	glDeleteTextures(2,snowClockTextureObjects);
+	glDeleteBuffersARB(1,&stepStateBufferObject);
+	glDeleteBuffersARB(1,&volumeBufferObject);
+	glDeleteFramebuffersEXT(1,&stepStateFramebufferObject);
+	glDeleteObjectARB(bathymetryShader);
+	glDeleteObjectARB(waterAdaptShader);
+	glDeleteObjectARB(derivativeShader);
+	glDeleteObjectARB(maxStepSizeShader);
+	glDeleteObjectARB(stepSizeShader);
+	glDeleteObjectARB(boundaryShader);
+	glDeleteObjectARB(eulerStepShader);
+	glDeleteObjectARB(rungeKuttaStepShader);
+	glDeleteObjectARB(rungeKuttaSnowStepShader);
+	glDeleteObjectARB(snowShader);
+	glDeleteObjectARB(freezeShader);
+	glDeleteObjectARB(volumeShader);
+	glDeleteObjectARB(volumeReductionShader);
+	glDeleteObjectARB(waterAddShader);
+	glDeleteObjectARB(waterShader);
+	glDeleteObjectARB(derivativeComputeShader);
+	glDeleteObjectARB(stepSizeComputeShader);
+	glDeleteObjectARB(rungeKuttaComputeShader);
+	glDeleteObjectARB(activityShader);
+	glDeleteObjectARB(activeTileShader);
+	glDeleteObjectARB(activeTileDepthShader);
+	}
+
+void WaterTable2::DataItem::deleteGrids(void)
+	{
+	/* Delete all textures, render buffers, and frame buffers whose size depends on the water table size: */
 	glDeleteTextures(2,bathymetryTextureObjects);
 	glDeleteTextures(3,quantityTextureObjects);
 	glDeleteTextures(1,&derivativeTextureObject);
 	glDeleteTextures(2,maxStepSizeTextureObjects);
+	glDeleteTextures(2,snowTextureObjects);
+	glDeleteTextures(2,volumeTextureObjects);
+	glDeleteTextures(1,&workGroupStepSizeTextureObject);
+	glDeleteTextures(1,&activityTextureObject);
+	glDeleteTextures(1,&activeTileTextureObject);
+	for(int i=0;i<3;++i)
+		glDeleteTextures(3,publishedTextureObjects[i]);
+	glDeleteRenderbuffersEXT(1,&activeTileDepthBufferObject);
 	glDeleteTextures(1,&waterTextureObject);
 	glDeleteFramebuffersEXT(1,&bathymetryFramebufferObject);
 	glDeleteFramebuffersEXT(1,&derivativeFramebufferObject);
 	glDeleteFramebuffersEXT(1,&maxStepSizeFramebufferObject);
 	glDeleteFramebuffersEXT(1,&integrationFramebufferObject);
+	glDeleteFramebuffersEXT(1,&snowFramebufferObject);
 	glDeleteFramebuffersEXT(1,&waterFramebufferObject);
-	glDeleteObjectARB(bathymetryShader);
-	glDeleteObjectARB(waterAdaptShader);
-	glDeleteObjectARB(derivativeShader);
-	glDeleteObjectARB(maxStepSizeShader);
-	glDeleteObjectARB(boundaryShader);
-	glDeleteObjectARB(eulerStepShader);
-	glDeleteObjectARB(rungeKuttaStepShader);
-	glDeleteObjectARB(waterAddShader);
-	glDeleteObjectARB(waterShader);
+	glDeleteFramebuffersEXT(1,&volumeFramebufferObject);
+	glDeleteFramebuffersEXT(1,&activityFramebufferObject);
+	glDeleteFramebuffersEXT(1,&activeTileFramebufferObject);
+	glDeleteFramebuffersEXT(1,&publishFramebufferObject);
 	
-	/*Snow Support*/
-	glDeleteTextures(1,&snowTextureObject);
-	glDeleteFramebuffersEXT(1,&snowFramebufferObject);
-	glDeleteFramebuffersEXT(1,&freezeFramebufferObject);
-	glDeleteObjectARB(snowShader);
-	glDeleteObjectARB(freezeShader);
+	/* Reset the deleted objects, so that optional ones are not attached or used again: */
+	for(int i=0;i<2;++i)
+		{
+		bathymetryTextureObjects[i]=0;
+		maxStepSizeTextureObjects[i]=0;
+		snowTextureObjects[i]=0;
+		volumeTextureObjects[i]=0;
+		}
+	for(int i=0;i<3;++i)
+		{
+		quantityTextureObjects[i]=0;
+		for(int j=0;j<3;++j)
+			publishedTextureObjects[i][j]=0;
+		}
+	derivativeTextureObject=0;
+	workGroupStepSizeTextureObject=0;
+	activityTextureObject=0;
+	activeTileTextureObject=0;
+	activeTileDepthBufferObject=0;
+	waterTextureObject=0;
+	bathymetryFramebufferObject=0;
+	derivativeFramebufferObject=0;
+	maxStepSizeFramebufferObject=0;
+	integrationFramebufferObject=0;
+	snowFramebufferObject=0;
+	waterFramebufferObject=0;
+	volumeFramebufferObject=0;
+	activityFramebufferObject=0;
+	activeTileFramebufferObject=0;
+	publishFramebufferObject=0;
 	}
 
 /****************************
@@ -210,17 +348,131 @@ void WaterTable2::calcTransformations(void)
 			*wttmPtr=GLfloat(wttm(i,j));
 	}
 
-GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quantityTextureObject,bool calcMaxStepSize) const
+void WaterTable2::updateActiveTiles(WaterTable2::DataItem* dataItem) const
+	{
+	GLsizei blockSize[2],tileSize[2];
+	for(int i=0;i<2;++i)
+		{
+		blockSize[i]=(size[i]+3)/4;
+		tileSize[i]=(size[i]+15)/16;
+		}
+	
+	/* Set up the active tile frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->activeTileFramebufferObject);
+	glViewport(0,0,tileSize[0],tileSize[1]);
+	
+	if(sparseSimulation)
+		{
+		/* Flag 4x4 blocks of cells containing water, snow, or water added by the most recent step: */
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->activityFramebufferObject);
+		glViewport(0,0,blockSize[0],blockSize[1]);
+		glUseProgramObjectARB(dataItem->activityShader);
+		glUniformARB(dataItem->activityShaderUniformLocations[0],GLfloat(size[0]),GLfloat(size[1]));
+		glUniformARB(dataItem->activityShaderUniformLocations[1],wetThreshold);
+		glUniform1iARB(dataItem->activityShaderUniformLocations[2],waterDeposit>0.0f||!renderFunctions.empty()?1:0);
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+		glUniform1iARB(dataItem->activityShaderUniformLocations[3],0);
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+		glUniform1iARB(dataItem->activityShaderUniformLocations[4],1);
+		glActiveTextureARB(GL_TEXTURE2_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[dataItem->currentSnow]);
+		glUniform1iARB(dataItem->activityShaderUniformLocations[5],2);
+		glActiveTextureARB(GL_TEXTURE3_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
+		glUniform1iARB(dataItem->activityShaderUniformLocations[6],3);
+		glBegin(GL_QUADS);
+		glVertex2i(0,0);
+		glVertex2i(size[0],0);
+		glVertex2i(size[0],size[1]);
+		glVertex2i(0,size[1]);
+		glEnd();
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		glActiveTextureARB(GL_TEXTURE2_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		
+		/* Flag the tiles containing or adjacent to active blocks: */
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->activeTileFramebufferObject);
+		glViewport(0,0,tileSize[0],tileSize[1]);
+		glUseProgramObjectARB(dataItem->activeTileShader);
+		glUniformARB(dataItem->activeTileShaderUniformLocations[0],GLfloat(blockSize[0]),GLfloat(blockSize[1]));
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->activityTextureObject);
+		glUniform1iARB(dataItem->activeTileShaderUniformLocations[1],0);
+		glBegin(GL_QUADS);
+		glVertex2i(0,0);
+		glVertex2i(size[0],0);
+		glVertex2i(size[0],size[1]);
+		glVertex2i(0,size[1]);
+		glEnd();
+		}
+	else
+		{
+		/* Flag all tiles as active: */
+		glClearColor(1.0f,0.0f,0.0f,0.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		}
+	
+	if(!dataItem->computeShaders)
+		{
+		/* Write the active tiles into the derivative frame buffer's depth buffer: */
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->derivativeFramebufferObject);
+		glDrawBuffer(GL_NONE);
+		glViewport(0,0,size[0],size[1]);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_ALWAYS);
+		glDepthMask(GL_TRUE);
+		glUseProgramObjectARB(dataItem->activeTileDepthShader);
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->activeTileTextureObject);
+		glUniform1iARB(dataItem->activeTileDepthShaderUniformLocations[0],0);
+		glBegin(GL_QUADS);
+		glVertex2i(0,0);
+		glVertex2i(size[0],0);
+		glVertex2i(size[0],size[1]);
+		glVertex2i(0,size[1]);
+		glEnd();
+		glDisable(GL_DEPTH_TEST);
+		}
+	
+	/* Unbind unneeded textures: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	}
+
+void WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quantityTextureObject,bool calcMaxStepSize,GLContextData& contextData) const
 	{
 	/*********************************************************************
 	Step 1: Calculate partial spatial derivatives, partial fluxes across
 	cell boundaries, and the temporal derivative.
 	*********************************************************************/
 	
+	{
+	/* Measure the temporal derivative computation: */
+	StageTimers::GPUTimer derivativeTimer(stageTimers,StageTimers::DERIVATIVE,contextData);
+	
 	/* Set up the derivative computation frame buffer: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->derivativeFramebufferObject);
 	glViewport(0,0,size[0],size[1]);
 	
+	/* Clear the derivative and maximum step size textures, so that cells outside active tiles neither move nor limit the step size: */
+	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	glClearColor(0.0f,0.0f,0.0f,0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDrawBuffer(GL_COLOR_ATTACHMENT1_EXT);
+	glClearColor(10000.0f,0.0f,0.0f,0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	GLenum drawBuffers[2]={GL_COLOR_ATTACHMENT0_EXT,GL_COLOR_ATTACHMENT1_EXT};
+	glDrawBuffersARB(2,drawBuffers);
+	
+	/* Reject cells outside active tiles with early depth tests against the active tile depth buffer: */
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_FALSE);
+	
 	/* Set up the temporal derivative computation shader: */
 	glUseProgramObjectARB(dataItem->derivativeShader);
 	glUniformARB<2>(dataItem->derivativeShaderUniformLocations[0],1,cellSize);
@@ -233,6 +485,9 @@ GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quant
 	glActiveTextureARB(GL_TEXTURE1_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,quantityTextureObject);
 	glUniform1iARB(dataItem->derivativeShaderUniformLocations[5],1);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->derivativeShaderUniformLocations[6],2);
 	
 	/* Run the temporal derivative computation: */
 	glBegin(GL_QUADS);
@@ -241,20 +496,24 @@ GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quant
 	glVertex2i(size[0],size[1]);
 	glVertex2i(0,size[1]);
 	glEnd();
+	glDisable(GL_DEPTH_TEST);
 	
 	/* Unbind unneeded textures: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	glActiveTextureARB(GL_TEXTURE1_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	}
 	
 	/*********************************************************************
 	Step 2: Gather the maximum step size by reducing the maximum step size
 	texture.
 	*********************************************************************/
 	
-	GLfloat stepSize=maxStepSize;
-	
 	if(calcMaxStepSize)
 		{
+		/* Measure the maximum step size reduction: */
+		StageTimers::GPUTimer maxStepSizeTimer(stageTimers,StageTimers::MAXSTEPSIZE,contextData);
+		
 		/* Set up the maximum step size reduction shader: */
 		glUseProgramObjectARB(dataItem->maxStepSizeShader);
 		
@@ -293,21 +552,160 @@ GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quant
 			currentMaxStepSizeTexture=1-currentMaxStepSizeTexture;
 			}
 		
-		/* Read the final value written into the last reduced 1x1 frame buffer: */
-		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+currentMaxStepSizeTexture);
-		glReadPixels(0,0,1,1,GL_LUMINANCE,GL_FLOAT,&stepSize);
+		/* Remember which texture holds the final reduced 1x1 value: */
+		dataItem->currentMaxStepSize=currentMaxStepSizeTexture;
+		}
+	}
 		
-		/* Limit the step size to the client-specified range: */
-		stepSize=Math::min(stepSize,maxStepSize);
+void WaterTable2::resetStepState(WaterTable2::DataItem* dataItem,GLfloat timeBudget) const
+	{
+	/* Upload a step state with the given remaining time and no advanced time: */
+	GLfloat state[4]={0.0f,timeBudget,0.0f,0.0f};
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+	glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,1,1,GL_RGBA,GL_FLOAT,state);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	}
+	
+void WaterTable2::calcStepSize(WaterTable2::DataItem* dataItem,bool useReducedStepSize) const
+	{
+	/* Set up the step state frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->stepStateFramebufferObject);
+	GLenum drawBuffers[2]={GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentStepState),GL_COLOR_ATTACHMENT2_EXT+(1-dataItem->currentStepState)};
+	glDrawBuffersARB(2,drawBuffers);
+	glViewport(0,0,1,1);
+	
+	/* Set up the step size selection shader: */
+	glUseProgramObjectARB(dataItem->stepSizeShader);
+	glUniformARB(dataItem->stepSizeShaderUniformLocations[0],maxStepSize);
+	glUniform1iARB(dataItem->stepSizeShaderUniformLocations[1],useReducedStepSize?1:0);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->maxStepSizeTextureObjects[dataItem->currentMaxStepSize]);
+	glUniform1iARB(dataItem->stepSizeShaderUniformLocations[2],0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->stepSizeShaderUniformLocations[3],1);
+	glUniform1iARB(dataItem->stepSizeShaderUniformLocations[4],dataItem->resetSnowClock?1:0);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowClockTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->stepSizeShaderUniformLocations[5],2);
+	dataItem->resetSnowClock=false;
+	
+	/* Run the step size selection on the single step state pixel: */
+	glBegin(GL_QUADS);
+	glVertex2i(0,0);
+	glVertex2i(size[0],0);
+	glVertex2i(size[0],size[1]);
+	glVertex2i(0,size[1]);
+	glEnd();
+	
+	/* Unbind unneeded textures: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	
+	/* Update the current step state: */
+	dataItem->currentStepState=1-dataItem->currentStepState;
+	}
+
+WaterTable2::DataItem* WaterTable2::getDataItem(GLContextData& contextData) const
+	{
+	/* Get the data item and check if its grids match the current water table size: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	if(dataItem->gridVersion==gridVersion)
+		return dataItem;
+	
+	/* Save relevant OpenGL state: */
+	GLint currentTextureUnit;
+	glGetIntegerv(GL_ACTIVE_TEXTURE_ARB,&currentTextureUnit);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	
+	/* Read back the current bathymetry, conserved quantity, and snow grids at the old size: */
+	GLsizei oldSize[2]={dataItem->gridSize[0],dataItem->gridSize[1]};
+	GLsizei oldBathymetrySize[2]={oldSize[0]-1,oldSize[1]-1};
+	GLfloat* oldB=new GLfloat[oldBathymetrySize[1]*oldBathymetrySize[0]];
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+	glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,oldB);
+	GLfloat* oldQ=new GLfloat[oldSize[1]*oldSize[0]*3];
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB,GL_FLOAT,oldQ);
+	GLfloat* oldS=new GLfloat[oldSize[1]*oldSize[0]*3];
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[dataItem->currentSnow]);
+	glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB,GL_FLOAT,oldS);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	
+	/* Convert water surface elevations into water column heights, which can be resampled without the old bathymetry: */
+	GLfloat* qPtr=oldQ;
+	for(GLsizei y=0;y<oldSize[1];++y)
+		{
+		GLsizei y0=Math::max(y-1,0);
+		GLsizei y1=Math::min(y,oldBathymetrySize[1]-1);
+		for(GLsizei x=0;x<oldSize[0];++x,qPtr+=3)
+			{
+			GLsizei x0=Math::max(x-1,0);
+			GLsizei x1=Math::min(x,oldBathymetrySize[0]-1);
+			GLfloat b=(oldB[y0*oldBathymetrySize[0]+x0]+oldB[y0*oldBathymetrySize[0]+x1]+oldB[y1*oldBathymetrySize[0]+x0]+oldB[y1*oldBathymetrySize[0]+x1])*0.25f;
+			qPtr[0]=Math::max(qPtr[0]-b,0.0f);
+			}
 		}
+	delete[] oldB;
+	
+	/* Re-create only the grids at the new size; the shaders and the step state are independent of the grid size: */
+	dataItem->deleteGrids();
+	for(int i=0;i<2;++i)
+		dataItem->gridSize[i]=size[i];
+	dataItem->gridVersion=gridVersion;
+	createGrids(dataItem);
+	setPixelScale(dataItem);
+	
+	/* Start the new grids like freshly created per-context state, keeping a restored state that is still pending: */
+	dataItem->currentBathymetry=0;
+	dataItem->bathymetryVersion=0;
+	for(int i=0;i<4;++i)
+		dataItem->bathymetryChangedRect[i]=0;
+	dataItem->currentQuantity=0;
+	dataItem->currentMaxStepSize=0;
+	dataItem->currentSnow=0;
+	dataItem->waterSourceVersion=0;
+	dataItem->numStepsSinceActiveTileUpdate=0;
+	
+	/* Resample the water column heights, discharges, and snow to the new size: */
+	GLfloat* q=new GLfloat[size[1]*size[0]*3];
+	resampleGrid(oldQ,oldSize,q,size,3);
+	delete[] oldQ;
+	GLfloat* st=new GLfloat[size[1]*size[0]*3];
+	resampleGrid(oldS,oldSize,st,size,3);
+	delete[] oldS;
+	
+	/* Place the water columns on the new bathymetry grid's initial flat elevation; the next bathymetry update lifts them onto the actual surface: */
+	qPtr=q;
+	for(GLsizei count=size[1]*size[0];count>0;--count,qPtr+=3)
+		qPtr[0]+=GLfloat(domain.min[2]);
+	
+	/* Upload the resampled grids: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0],size[1],GL_RGB,GL_FLOAT,q);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[dataItem->currentSnow]);
+	glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0],size[1],GL_RGB,GL_FLOAT,st);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	delete[] q;
+	delete[] st;
+	
+	/* Restore OpenGL state: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	glActiveTextureARB(currentTextureUnit);
 	
-	return stepSize;
+	return dataItem;
 	}
 
 WaterTable2::WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2])
-	:depthImageRenderer(0),
+	:gridVersion(0),depthImageRenderer(0),
 	 baseTransform(ONTransform::identity),
-	 dryBoundary(true)
+	 dryBoundary(true),snowEnabled(true),criticalHeight(0.0f),meltRate(0.0f),snowStepInterval(1),snowUpdateInterval(0.0),fuseSnowStep(true),useComputeShaders(false),
+	 storageFormat(FLOAT32),sparseSimulation(true),wetThreshold(1.0e-3f),
+	 stageTimers(0),waterSourceVersion(1),restoreVersion(0)
 	{
 	/* Initialize the water table size and cell size: */
 	size[0]=width;
@@ -337,8 +735,10 @@ WaterTable2::WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2]
 	}
 
 WaterTable2::WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer* sDepthImageRenderer,const Point basePlaneCorners[4])
-	:depthImageRenderer(sDepthImageRenderer),
-	 dryBoundary(true)
+	:gridVersion(0),depthImageRenderer(sDepthImageRenderer),
+	 dryBoundary(true),snowEnabled(true),criticalHeight(0.0f),meltRate(0.0f),snowStepInterval(1),snowUpdateInterval(0.0),fuseSnowStep(true),useComputeShaders(false),
+	 storageFormat(FLOAT32),sparseSimulation(true),wetThreshold(1.0e-3f),
+	 stageTimers(0),waterSourceVersion(1),restoreVersion(0)
 	{
 	/* Initialize the water table size: */
 	size[0]=width;
@@ -378,23 +778,6 @@ WaterTable2::WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer*
 	// DEBUGGING
 	// std::cout<<cellSize[0]<<" x "<<cellSize[1]<<std::endl;
 	
-
-	/*Snow Support: Snow Configuration File*/
-	std::string criticalHeightFileName=CONFIG_CONFIGDIR;
-	criticalHeightFileName.append(std::string("/snowConfig.cfg").c_str());
-	fileMonitor.addPath(criticalHeightFileName.c_str(),IO::FileMonitor::Modified,Misc::createFunctionCall(this,&WaterTable2::snowConfigurationCallback));
-	fileMonitor.startPolling();
-	IO::ValueSource criticalHeightSource(IO::openFile(criticalHeightFileName.c_str()));
-	criticalHeightSource.skipWs();
-	std::string s=criticalHeightSource.readLine(); //first line is comment
-	s=criticalHeightSource.readLine();
-	criticalHeight=std::stof(s);
-	s=criticalHeightSource.readLine(); //third line is comment
-	s=criticalHeightSource.readLine();
-	meltRate=std::stof(s);
-	//std::cout<< "Initial critical height: " << criticalHeight << std::endl;
-	//std::cout<< "Initial melt rate: " << meltRate << std::endl;
-	
 	/* Calculate the water table transformations: */
 	calcTransformations();
 	
@@ -413,12 +796,8 @@ WaterTable2::~WaterTable2(void)
 	{
 	}
 
-void WaterTable2::initContext(GLContextData& contextData) const
+void WaterTable2::createGrids(WaterTable2::DataItem* dataItem) const
 	{
-	/* Create a data item and add it to the context: */
-	DataItem* dataItem=new DataItem;
-	contextData.addDataItem(this,dataItem);
-	
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	
 	{
@@ -448,7 +827,7 @@ void WaterTable2::initContext(GLContextData& contextData) const
 		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB32F,size[0],size[1],0,GL_RGB,GL_FLOAT,q);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,dataItem->vectorFormat,size[0],size[1],0,GL_RGB,GL_FLOAT,q);
 		}
 	delete[] q;
 	}
@@ -462,7 +841,7 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
 	GLfloat* qt=makeBuffer(size[0],size[1],3,0.0,0.0,0.0);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB32F,size[0],size[1],0,GL_RGB,GL_FLOAT,qt);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,dataItem->vectorFormat,size[0],size[1],0,GL_RGB,GL_FLOAT,qt);
 	delete[] qt;
 	}
 	
@@ -480,6 +859,18 @@ void WaterTable2::initContext(GLContextData& contextData) const
 		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,size[0],size[1],0,GL_LUMINANCE,GL_FLOAT,mss);
 		}
 	delete[] mss;
+	
+	if(dataItem->computeShaders)
+		{
+		/* Create the texture receiving the maximum step size of each compute shader work group of 16x16 cells: */
+		glGenTextures(1,&dataItem->workGroupStepSizeTextureObject);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->workGroupStepSizeTextureObject);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,(size[0]+15)/16,(size[1]+15)/16,0,GL_LUMINANCE,GL_FLOAT,0);
+		}
 	}
 	
 	{
@@ -496,17 +887,66 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	}
 	
 	{
-	/*Snow Support*/
-	//Create the cell-centered snow texture
-	glGenTextures(1,&dataItem->snowTextureObject);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObject);
+	/* Create the cell-centered snow textures; they share the quantity textures' format so they can be rendered together: */
+	glGenTextures(2,dataItem->snowTextureObjects);
+	GLfloat* st=makeBuffer(size[0],size[1],3,0.0,0.0,0.0);
+	for(int i=0;i<2;++i)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[i]);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,dataItem->vectorFormat,size[0],size[1],0,GL_RGB,GL_FLOAT,st);
+		}
+	delete[] st;
+	}
+
+	{
+	/* Create the volume reduction textures, which start at half the grid size: */
+	glGenTextures(2,dataItem->volumeTextureObjects);
+	GLfloat* vt=makeBuffer((size[0]+1)/2,(size[1]+1)/2,3,0.0,0.0,0.0);
+	for(int i=0;i<2;++i)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->volumeTextureObjects[i]);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB32F,(size[0]+1)/2,(size[1]+1)/2,0,GL_RGB,GL_FLOAT,vt);
+		}
+	delete[] vt;
+	}
+
+	{
+	/* Create the active block texture, with one pixel per 4x4 block of cells: */
+	glGenTextures(1,&dataItem->activityTextureObject);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->activityTextureObject);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	GLfloat* st=makeBuffer(size[0],size[1],1,0.0);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,size[0],size[1],0,GL_LUMINANCE,GL_FLOAT,st);
-	delete[] st;
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,(size[0]+3)/4,(size[1]+3)/4,0,GL_LUMINANCE,GL_FLOAT,0);
+	
+	/* Create the active tile texture, with one pixel per 16x16 tile of cells, and start with all tiles active: */
+	glGenTextures(1,&dataItem->activeTileTextureObject);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->activeTileTextureObject);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+	GLfloat* at=makeBuffer((size[0]+15)/16,(size[1]+15)/16,1,1.0);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,(size[0]+15)/16,(size[1]+15)/16,0,GL_LUMINANCE,GL_FLOAT,at);
+	delete[] at;
+	
+	if(!dataItem->computeShaders)
+		{
+		/* Create the depth buffer restricting the fragment shader derivative passes to active tiles: */
+		glGenRenderbuffersEXT(1,&dataItem->activeTileDepthBufferObject);
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT,dataItem->activeTileDepthBufferObject);
+		glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT,GL_DEPTH_COMPONENT,size[0],size[1]);
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT,0);
+		}
 	}
 
 	/* Protect the newly-created textures: */
@@ -536,6 +976,10 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	/* Attach the derivative and maximum step size textures to the temporal derivative computation frame buffer: */
 	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject,0);
 	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT1_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->maxStepSizeTextureObjects[0],0);
+	
+	/* Attach the active tile depth buffer to the temporal derivative computation frame buffer: */
+	if(dataItem->activeTileDepthBufferObject!=0)
+		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT,GL_DEPTH_ATTACHMENT_EXT,GL_RENDERBUFFER_EXT,dataItem->activeTileDepthBufferObject);
 	GLenum drawBuffers[2]={GL_COLOR_ATTACHMENT0_EXT,GL_COLOR_ATTACHMENT1_EXT};
 	glDrawBuffersARB(2,drawBuffers);
 	glReadBuffer(GL_NONE);
@@ -561,6 +1005,39 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	/* Attach the quantity textures to the integration step frame buffer: */
 	for(int i=0;i<3;++i)
 		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[i],0);
+	
+	/* Attach the snow textures as well if the frame buffer has enough color attachments and draw buffers to write quantities and snow in the same pass: */
+	GLint maxColorAttachments=0,maxDrawBuffers=0;
+	glGetIntegerv(GL_MAX_COLOR_ATTACHMENTS_EXT,&maxColorAttachments);
+	glGetIntegerv(GL_MAX_DRAW_BUFFERS_ARB,&maxDrawBuffers);
+	dataItem->fusedSnowStep=maxColorAttachments>=5&&maxDrawBuffers>=2;
+	if(dataItem->fusedSnowStep)
+		{
+		for(int i=0;i<2;++i)
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT3_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[i],0);
+		
+		/* Fall back to separate snow passes if the implementation does not accept the combination of render targets: */
+		GLenum drawBuffers[2]={GL_COLOR_ATTACHMENT0_EXT,GL_COLOR_ATTACHMENT3_EXT};
+		glDrawBuffersARB(2,drawBuffers);
+		if(glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT)!=GL_FRAMEBUFFER_COMPLETE_EXT)
+			{
+			for(int i=0;i<2;++i)
+				glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT3_EXT+i,GL_TEXTURE_RECTANGLE_ARB,0,0);
+			dataItem->fusedSnowStep=false;
+			}
+		}
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	}
+	
+	{
+	/* Create the snow frame buffer for snow updates that are not fused with the Runge-Kutta integration step: */
+	glGenFramebuffersEXT(1,&dataItem->snowFramebufferObject);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->snowFramebufferObject);
+	
+	/* Attach the snow textures to the snow frame buffer: */
+	for(int i=0;i<2;++i)
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[i],0);
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
 	}
@@ -576,45 +1053,171 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	glReadBuffer(GL_NONE);
 	}
 	
-	/*Snow Support*/
 	{
-	/*Create the snow frame buffer: */
-	glGenFramebuffersEXT(1,&dataItem->snowFramebufferObject);
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->snowFramebufferObject);
-
-	/*Attach the snow texture to the snow frame buffer: */
-	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObject,0);
+	/* Create the volume reduction frame buffer: */
+	glGenFramebuffersEXT(1,&dataItem->volumeFramebufferObject);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->volumeFramebufferObject);
+	
+	/* Attach the volume reduction textures to the volume reduction frame buffer: */
+	for(int i=0;i<2;++i)
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->volumeTextureObjects[i],0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	}
+	
+	{
+	/* Create the active block frame buffer: */
+	glGenFramebuffersEXT(1,&dataItem->activityFramebufferObject);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->activityFramebufferObject);
+	
+	/* Attach the active block texture to the active block frame buffer: */
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->activityTextureObject,0);
 	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
-	glReadBuffer(GL_NONE);	
+	glReadBuffer(GL_NONE);
 	}
-
+	
 	{
-	/*Create the freeze frame buffer: */
-	glGenFramebuffersEXT(1,&dataItem->freezeFramebufferObject);
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->freezeFramebufferObject);
-
-	/*Attach the quantity texture to freeze frame buffer*/
-	for(int i=0;i<3;++i)
-		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[i],0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);	
+	/* Create the active tile frame buffer: */
+	glGenFramebuffersEXT(1,&dataItem->activeTileFramebufferObject);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->activeTileFramebufferObject);
+	
+	/* Attach the active tile texture to the active tile frame buffer: */
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->activeTileTextureObject,0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	glReadBuffer(GL_NONE);
+	}
+
+	/* Restore the previously bound frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	}
+
+void WaterTable2::setPixelScale(WaterTable2::DataItem* dataItem) const
+	{
+	/* Upload the scale from pixel space to clip space into all shaders using the pixel space vertex shader: */
+	GLhandleARB shaders[]=
+		{
+		dataItem->bathymetryShader,dataItem->waterAdaptShader,dataItem->derivativeShader,dataItem->maxStepSizeShader,
+		dataItem->stepSizeShader,dataItem->boundaryShader,dataItem->eulerStepShader,dataItem->rungeKuttaStepShader,
+		dataItem->waterShader,dataItem->rungeKuttaSnowStepShader,dataItem->snowShader,dataItem->freezeShader,dataItem->volumeShader,dataItem->volumeReductionShader,
+		dataItem->activityShader,dataItem->activeTileShader,dataItem->activeTileDepthShader
+		};
+	for(size_t i=0;i<sizeof(shaders)/sizeof(GLhandleARB);++i)
+		if(shaders[i]!=0)
+			{
+			glUseProgramObjectARB(shaders[i]);
+			glUniform2fARB(glGetUniformLocationARB(shaders[i],"pixelScale"),2.0f/GLfloat(size[0]),2.0f/GLfloat(size[1]));
+			}
+	glUseProgramObjectARB(0);
 	}
 
+void WaterTable2::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	
+	/* Remember the water table size for which the grids are created: */
+	for(int i=0;i<2;++i)
+		dataItem->gridSize[i]=size[i];
+	dataItem->gridVersion=gridVersion;
+	
+	{
+	/* Start from the initial state instead of a previously restored one: */
+	Threads::Mutex::Lock restoreLock(restoreMutex);
+	dataItem->restoreVersion=restoreVersion;
+	}
+	
+	/* Run the solver on compute shaders if requested and supported: */
+	if(useComputeShaders)
+		{
+		dataItem->computeShaders=initComputeShaders();
+		if(!dataItem->computeShaders)
+			std::cerr<<"WaterTable2: OpenGL context does not support compute shaders; falling back to fragment shaders"<<std::endl;
+		}
+	
+	/* Retrieve the fence sync entry points used to hand off published simulation states between contexts: */
+	dataItem->haveFenceSync=initFenceSync();
+	
+	/* Select the storage format of the vector-valued grids; compute shaders can only write four-component images, and half-float render targets are only portable with four components: */
+	if(storageFormat==FLOAT16)
+		dataItem->vectorFormat=GL_RGBA16F;
+	else
+		dataItem->vectorFormat=dataItem->computeShaders?GL_RGBA32F:GL_RGB32F;
+	
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	
+	{
+	/* Create the single-pixel step state textures: */
+	glGenTextures(2,dataItem->stepStateTextureObjects);
+	GLfloat ss[4]={0.0f,0.0f,0.0f,0.0f};
+	for(int i=0;i<2;++i)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[i]);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGBA32F,1,1,0,GL_RGBA,GL_FLOAT,ss);
+		}
+	
+	/* Create the single-pixel snow clock textures; they share the step state textures' format so they can be rendered together: */
+	glGenTextures(2,dataItem->snowClockTextureObjects);
+	for(int i=0;i<2;++i)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowClockTextureObjects[i]);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGBA32F,1,1,0,GL_RGBA,GL_FLOAT,ss);
+		}
+	
+	/* Create the pixel buffer object receiving asynchronous step state read-backs: */
+	glGenBuffersARB(1,&dataItem->stepStateBufferObject);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->stepStateBufferObject);
+	glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,4*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	}
+	
+	{
+	/* Create the pixel buffer object receiving asynchronous read-backs of reduced volumes: */
+	glGenBuffersARB(1,&dataItem->volumeBufferObject);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->volumeBufferObject);
+	glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,3*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	}
+	
+	/* Create the grids and their frame buffers at the current water table size: */
+	createGrids(dataItem);
+	
+	/* Save the currently bound frame buffer: */
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	{
+	/* Create the step state frame buffer: */
+	glGenFramebuffersEXT(1,&dataItem->stepStateFramebufferObject);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->stepStateFramebufferObject);
+	
+	/* Attach the step state and snow clock textures to the step state frame buffer: */
+	for(int i=0;i<2;++i)
+		{
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[i],0);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT2_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->snowClockTextureObjects[i],0);
+		}
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	}
+	
 	/* Restore the previously bound frame buffer: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	
-	/* Create a simple vertex shader to render quads in pixel space: */
-	static const char* vertexShaderSourceTemplate="void main(){gl_Position=vec4(gl_Vertex.x*%f-1.0,gl_Vertex.y*%f-1.0,0.0,1.0);}";
-	char vertexShaderSource[256];
-	snprintf(vertexShaderSource,sizeof(vertexShaderSource),vertexShaderSourceTemplate,2.0/double(size[0]),2.0/double(size[1]));
+	/* Create a simple vertex shader to render quads in pixel space; the pixel scale is a uniform so that the grids can be resized without recompiling the shaders: */
+	static const char* vertexShaderSource="uniform vec2 pixelScale;void main(){gl_Position=vec4(gl_Vertex.x*pixelScale.x-1.0,gl_Vertex.y*pixelScale.y-1.0,0.0,1.0);}";
 	
 	/* Create the bathymetry update shader: */
 	{
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2BathymetryUpdateShader");
-	dataItem->bathymetryShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+	dataItem->bathymetryShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2BathymetryUpdateShader");
 	dataItem->bathymetryShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->bathymetryShader,"oldBathymetrySampler");
 	dataItem->bathymetryShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->bathymetryShader,"newBathymetrySampler");
 	dataItem->bathymetryShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->bathymetryShader,"quantitySampler");
@@ -622,59 +1225,51 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	
 	/* Create the water adaptation shader: */
 	{
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2WaterAdaptShader");
-	dataItem->waterAdaptShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+	dataItem->waterAdaptShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2WaterAdaptShader");
 	dataItem->waterAdaptShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->waterAdaptShader,"bathymetrySampler");
 	dataItem->waterAdaptShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->waterAdaptShader,"newQuantitySampler");
 	}
 	
 	/* Create the temporal derivative computation shader: */
 	{
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2SlopeAndFluxAndDerivativeShader");
-	dataItem->derivativeShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+	dataItem->derivativeShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2SlopeAndFluxAndDerivativeShader");
 	dataItem->derivativeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->derivativeShader,"cellSize");
 	dataItem->derivativeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->derivativeShader,"theta");
 	dataItem->derivativeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->derivativeShader,"g");
 	dataItem->derivativeShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->derivativeShader,"epsilon");
 	dataItem->derivativeShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->derivativeShader,"bathymetrySampler");
 	dataItem->derivativeShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->derivativeShader,"quantitySampler");
+	dataItem->derivativeShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->derivativeShader,"stepStateSampler");
 	}
 	
 	/* Create the maximum step size gathering shader: */
 	{
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2MaxStepSizeShader");
-	dataItem->maxStepSizeShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+	dataItem->maxStepSizeShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2MaxStepSizeShader");
 	dataItem->maxStepSizeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->maxStepSizeShader,"fullTextureSize");
 	dataItem->maxStepSizeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->maxStepSizeShader,"maxStepSizeSampler");
 	}
 	
+	/* Create the step size selection shader: */
+	{
+	dataItem->stepSizeShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2StepSizeShader");
+	dataItem->stepSizeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->stepSizeShader,"maxStepSize");
+	dataItem->stepSizeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->stepSizeShader,"useReducedStepSize");
+	dataItem->stepSizeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->stepSizeShader,"reducedStepSizeSampler");
+	dataItem->stepSizeShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->stepSizeShader,"stepStateSampler");
+	dataItem->stepSizeShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->stepSizeShader,"resetSnowClock");
+	dataItem->stepSizeShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->stepSizeShader,"snowClockSampler");
+	}
+	
 	/* Create the boundary condition shader: */
 	{
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2BoundaryShader");
-	dataItem->boundaryShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+	dataItem->boundaryShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2BoundaryShader");
 	dataItem->boundaryShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->boundaryShader,"bathymetrySampler");
 	}
 	
 	/* Create the Euler integration step shader: */
 	{
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2EulerStepShader");
-	dataItem->eulerStepShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
-	dataItem->eulerStepShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->eulerStepShader,"stepSize");
+	dataItem->eulerStepShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2EulerStepShader");
+	dataItem->eulerStepShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->eulerStepShader,"stepStateSampler");
 	dataItem->eulerStepShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->eulerStepShader,"attenuation");
 	dataItem->eulerStepShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->eulerStepShader,"quantitySampler");
 	dataItem->eulerStepShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->eulerStepShader,"derivativeSampler");
@@ -683,31 +1278,19 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	/* Create the Runge-Kutta integration step shader: */
 	{
 	/*
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2RungeKuttaStepShader");
-	dataItem->rungeKuttaStepShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+	dataItem->rungeKuttaStepShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2RungeKuttaStepShader");
 	dataItem->rungeKuttaStepShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"stepSize");
 	dataItem->rungeKuttaStepShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"attenuation");
 	dataItem->rungeKuttaStepShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"quantitySampler");
 	dataItem->rungeKuttaStepShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"quantityStarSampler");
 	dataItem->rungeKuttaStepShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"derivativeSampler");
 	*/
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2RungeKuttaStepShader");
-	dataItem->rungeKuttaStepShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
-	dataItem->rungeKuttaStepShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"stepSize");
+	dataItem->rungeKuttaStepShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2RungeKuttaStepShader");
+	dataItem->rungeKuttaStepShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"stepStateSampler");
 	dataItem->rungeKuttaStepShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"attenuation");
-	dataItem->rungeKuttaStepShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"criticalHeight");
-	dataItem->rungeKuttaStepShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"meltRate");
-	dataItem->rungeKuttaStepShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"quantitySampler");
-	dataItem->rungeKuttaStepShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"quantityStarSampler");
-	dataItem->rungeKuttaStepShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"derivativeSampler");
-	dataItem->rungeKuttaStepShaderUniformLocations[7]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"snowSampler");
-	dataItem->rungeKuttaStepShaderUniformLocations[8]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"bathymetrySampler");
+	dataItem->rungeKuttaStepShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"quantitySampler");
+	dataItem->rungeKuttaStepShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"quantityStarSampler");
+	dataItem->rungeKuttaStepShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->rungeKuttaStepShader,"derivativeSampler");
 	
 
 
@@ -715,11 +1298,7 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	
 	/* Create the water adder rendering shader: */
 	{
-	GLhandleARB vertexShader=compileVertexShader("Water2WaterAddShader");
-	GLhandleARB fragmentShader=compileFragmentShader("Water2WaterAddShader");
-	dataItem->waterAddShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+	dataItem->waterAddShader=linkVertexAndFragmentShader("Water2WaterAddShader");
 	dataItem->waterAddShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->waterAddShader,"pmv");
 	dataItem->waterAddShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->waterAddShader,"stepSize");
 	dataItem->waterAddShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->waterAddShader,"waterSampler");
@@ -727,40 +1306,175 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	
 	/* Create the water shader: */
 	{
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("Water2WaterUpdateShader");
-	dataItem->waterShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
+	dataItem->waterShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2WaterUpdateShader");
 	dataItem->waterShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->waterShader,"bathymetrySampler");
 	dataItem->waterShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->waterShader,"quantitySampler");
 	dataItem->waterShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->waterShader,"waterSampler");
+	dataItem->waterShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->waterShader,"stepStateSampler");
 	}
 
-	/*Snow Support*/
-	{//Create the snow shader:
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("SnowShader");
-	dataItem->snowShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
-	dataItem->snowShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->snowShader,"criticalHeight");	
-	dataItem->snowShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->snowShader,"meltRate");
-	dataItem->snowShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->snowShader,"snowSampler");
-	dataItem->snowShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->snowShader,"quantitySampler");
-	dataItem->snowShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->snowShader,"bathymetrySampler");
+	/* Create the fused Runge-Kutta integration and snow step shader: */
+	{
+	dataItem->rungeKuttaSnowStepShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2RungeKuttaSnowStepShader");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"stepStateSampler");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"attenuation");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"criticalHeight");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"meltRate");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"dryBoundary");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"gridSize");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"quantitySampler");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[7]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"quantityStarSampler");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[8]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"derivativeSampler");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[9]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"snowSampler");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[10]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"bathymetrySampler");
+	dataItem->rungeKuttaSnowStepShaderUniformLocations[11]=glGetUniformLocationARB(dataItem->rungeKuttaSnowStepShader,"snowClockSampler");
 	}
-
-	{//Create the freeze shader:
-	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
-	GLhandleARB fragmentShader=compileFragmentShader("FreezeShader");
-	dataItem->freezeShader=glLinkShader(vertexShader,fragmentShader);
-	glDeleteObjectARB(vertexShader);
-	glDeleteObjectARB(fragmentShader);
-	dataItem->freezeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->freezeShader,"criticalHeight");	
-	dataItem->freezeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->freezeShader,"quantitySampler");
-	dataItem->freezeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->freezeShader,"bathymetrySampler");	
+	
+	/* Create the separate snow and freeze shaders for snow updates that are not fused with the Runge-Kutta integration step: */
+	{
+	dataItem->snowShader=linkVertexStringAndFragmentShader(vertexShaderSource,"SnowShader");
+	dataItem->snowShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->snowShader,"stepStateSampler");
+	dataItem->snowShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->snowShader,"attenuation");
+	dataItem->snowShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->snowShader,"criticalHeight");
+	dataItem->snowShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->snowShader,"meltRate");
+	dataItem->snowShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->snowShader,"dryBoundary");
+	dataItem->snowShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->snowShader,"gridSize");
+	dataItem->snowShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->snowShader,"quantitySampler");
+	dataItem->snowShaderUniformLocations[7]=glGetUniformLocationARB(dataItem->snowShader,"quantityStarSampler");
+	dataItem->snowShaderUniformLocations[8]=glGetUniformLocationARB(dataItem->snowShader,"derivativeSampler");
+	dataItem->snowShaderUniformLocations[9]=glGetUniformLocationARB(dataItem->snowShader,"snowSampler");
+	dataItem->snowShaderUniformLocations[10]=glGetUniformLocationARB(dataItem->snowShader,"bathymetrySampler");
+	dataItem->snowShaderUniformLocations[11]=glGetUniformLocationARB(dataItem->snowShader,"snowClockSampler");
+	}
+	{
+	dataItem->freezeShader=linkVertexStringAndFragmentShader(vertexShaderSource,"FreezeShader");
+	dataItem->freezeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->freezeShader,"stepStateSampler");
+	dataItem->freezeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->freezeShader,"attenuation");
+	dataItem->freezeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->freezeShader,"criticalHeight");
+	dataItem->freezeShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->freezeShader,"meltRate");
+	dataItem->freezeShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->freezeShader,"dryBoundary");
+	dataItem->freezeShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->freezeShader,"gridSize");
+	dataItem->freezeShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->freezeShader,"quantitySampler");
+	dataItem->freezeShaderUniformLocations[7]=glGetUniformLocationARB(dataItem->freezeShader,"quantityStarSampler");
+	dataItem->freezeShaderUniformLocations[8]=glGetUniformLocationARB(dataItem->freezeShader,"derivativeSampler");
+	dataItem->freezeShaderUniformLocations[9]=glGetUniformLocationARB(dataItem->freezeShader,"snowSampler");
+	dataItem->freezeShaderUniformLocations[10]=glGetUniformLocationARB(dataItem->freezeShader,"bathymetrySampler");
+	dataItem->freezeShaderUniformLocations[11]=glGetUniformLocationARB(dataItem->freezeShader,"snowClockSampler");
+	}
+	
+	/* Create the volume gathering shader: */
+	{
+	dataItem->volumeShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2VolumeShader");
+	dataItem->volumeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->volumeShader,"fullTextureSize");
+	dataItem->volumeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->volumeShader,"snowSampler");
+	dataItem->volumeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->volumeShader,"quantitySampler");
+	dataItem->volumeShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->volumeShader,"bathymetrySampler");
+	}
+	
+	/* Create the volume reduction shader: */
+	{
+	dataItem->volumeReductionShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2VolumeReductionShader");
+	dataItem->volumeReductionShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->volumeReductionShader,"fullTextureSize");
+	dataItem->volumeReductionShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->volumeReductionShader,"volumeSampler");
+	}
+	
+	/* Create the active block flagging shader: */
+	{
+	dataItem->activityShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2ActivityShader");
+	dataItem->activityShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->activityShader,"gridSize");
+	dataItem->activityShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->activityShader,"wetThreshold");
+	dataItem->activityShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->activityShader,"useWaterSampler");
+	dataItem->activityShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->activityShader,"bathymetrySampler");
+	dataItem->activityShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->activityShader,"quantitySampler");
+	dataItem->activityShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->activityShader,"snowSampler");
+	dataItem->activityShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->activityShader,"waterSampler");
+	}
+	
+	/* Create the active tile flagging shader: */
+	{
+	dataItem->activeTileShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2ActiveTileShader");
+	dataItem->activeTileShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->activeTileShader,"blockSize");
+	dataItem->activeTileShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->activeTileShader,"activitySampler");
 	}
+	
+	if(!dataItem->computeShaders)
+		{
+		/* Create the active tile depth shader: */
+		dataItem->activeTileDepthShader=linkVertexStringAndFragmentShader(vertexShaderSource,"Water2ActiveTileDepthShader");
+		dataItem->activeTileDepthShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->activeTileDepthShader,"activeTileSampler");
+		}
+	
+	if(dataItem->computeShaders)
+		{
+		/* Create the fused slope, flux, and temporal derivative compute shader: */
+		dataItem->derivativeComputeShader=linkComputeShader("Water2SlopeAndFluxAndDerivativeShader");
+		dataItem->derivativeComputeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"cellSize");
+		dataItem->derivativeComputeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"theta");
+		dataItem->derivativeComputeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"g");
+		dataItem->derivativeComputeShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"epsilon");
+		dataItem->derivativeComputeShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"gridSize");
+		dataItem->derivativeComputeShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"bathymetrySampler");
+		dataItem->derivativeComputeShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"quantitySampler");
+		dataItem->derivativeComputeShaderUniformLocations[7]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"derivativeImage");
+		dataItem->derivativeComputeShaderUniformLocations[8]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"maxStepSizeImage");
+		dataItem->derivativeComputeShaderUniformLocations[9]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"activeTileSampler");
+		dataItem->derivativeComputeShaderUniformLocations[10]=glGetUniformLocationARB(dataItem->derivativeComputeShader,"stepStateSampler");
+		
+		/* Create the step size reduction and selection compute shader: */
+		dataItem->stepSizeComputeShader=linkComputeShader("Water2StepSizeShader");
+		dataItem->stepSizeComputeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"maxStepSize");
+		dataItem->stepSizeComputeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"useReducedStepSize");
+		dataItem->stepSizeComputeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"reducedSize");
+		dataItem->stepSizeComputeShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"reducedStepSizeSampler");
+		dataItem->stepSizeComputeShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"stepStateSampler");
+		dataItem->stepSizeComputeShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"resetSnowClock");
+		dataItem->stepSizeComputeShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"snowClockSampler");
+		dataItem->stepSizeComputeShaderUniformLocations[7]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"stepStateImage");
+		dataItem->stepSizeComputeShaderUniformLocations[8]=glGetUniformLocationARB(dataItem->stepSizeComputeShader,"snowClockImage");
+		
+		/* Create the fused Euler and Runge-Kutta integration step compute shader: */
+		dataItem->rungeKuttaComputeShader=linkComputeShader("Water2EulerAndRungeKuttaStepShader");
+		dataItem->rungeKuttaComputeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"cellSize");
+		dataItem->rungeKuttaComputeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"theta");
+		dataItem->rungeKuttaComputeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"g");
+		dataItem->rungeKuttaComputeShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"epsilon");
+		dataItem->rungeKuttaComputeShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"gridSize");
+		dataItem->rungeKuttaComputeShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"attenuation");
+		dataItem->rungeKuttaComputeShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"dryBoundary");
+		dataItem->rungeKuttaComputeShaderUniformLocations[7]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"updateSnow");
+		dataItem->rungeKuttaComputeShaderUniformLocations[8]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"criticalHeight");
+		dataItem->rungeKuttaComputeShaderUniformLocations[9]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"meltRate");
+		dataItem->rungeKuttaComputeShaderUniformLocations[10]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"bathymetrySampler");
+		dataItem->rungeKuttaComputeShaderUniformLocations[11]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"quantitySampler");
+		dataItem->rungeKuttaComputeShaderUniformLocations[12]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"derivativeSampler");
+		dataItem->rungeKuttaComputeShaderUniformLocations[13]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"stepStateSampler");
+		dataItem->rungeKuttaComputeShaderUniformLocations[14]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"snowSampler");
+		dataItem->rungeKuttaComputeShaderUniformLocations[15]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"snowClockSampler");
+		dataItem->rungeKuttaComputeShaderUniformLocations[16]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"quantityImage");
+		dataItem->rungeKuttaComputeShaderUniformLocations[17]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"snowImage");
+		dataItem->rungeKuttaComputeShaderUniformLocations[18]=glGetUniformLocationARB(dataItem->rungeKuttaComputeShader,"activeTileSampler");
+		}
+	
+	/* Map the current grid size to the shaders' pixel space: */
+	setPixelScale(dataItem);
+	}
+
+void WaterTable2::setGridSize(GLsizei newWidth,GLsizei newHeight)
+	{
+	/* Set the new water table size: */
+	size[0]=newWidth;
+	size[1]=newHeight;
+	
+	/* Recalculate the grid's cell size for the unchanged domain: */
+	for(int i=0;i<2;++i)
+		cellSize[i]=GLfloat((domain.max[i]-domain.min[i])/Scalar(size[i]));
+	epsilon=0.01f*Math::max(Math::max(cellSize[0],cellSize[1]),1.0f);
+	
+	/* Recalculate the water table transformations: */
+	calcTransformations();
+	
+	/* Invalidate the grids in all OpenGL contexts: */
+	++gridVersion;
 	}
 
 void WaterTable2::setElevationRange(Scalar newMin,Scalar newMax)
@@ -781,36 +1495,20 @@ void WaterTable2::setAttenuation(GLfloat newAttenuation)
 void WaterTable2::setMaxStepSize(GLfloat newMaxStepSize)
 	{
 	maxStepSize=newMaxStepSize;
-	fileMonitor.processEvents(); //Snow Support
-	}
-
-/*Snow Support*/
-void WaterTable2::snowConfigurationCallback(const IO::FileMonitor::Event& event)
-	{
-		//std::cout << " in snowConfigurationCallback"<< std::endl;
-	std::string criticalHeightFileName=CONFIG_CONFIGDIR;
-	criticalHeightFileName.append(std::string("/snowConfig.cfg").c_str());
-	IO::ValueSource criticalHeightSource(IO::openFile(criticalHeightFileName.c_str()));
-	criticalHeightSource.skipWs();
-	std::string s=criticalHeightSource.readLine(); //first line is comment
-	s=criticalHeightSource.readLine();
-	criticalHeight=std::stof(s);
-	s=criticalHeightSource.readLine(); //third line is comment
-	s=criticalHeightSource.readLine();
-	meltRate=std::stof(s);
-	//std::cout<< "Updated critical height: " << criticalHeight << std::endl;
-	//std::cout<< "Updated the snow melt rate: " << meltRate << std::endl;
 	}
 
 void WaterTable2::addRenderFunction(const AddWaterFunction* newRenderFunction)
 	{
 	/* Store the new render function: */
+	Threads::Mutex::Lock renderFunctionsLock(renderFunctionsMutex);
 	renderFunctions.push_back(newRenderFunction);
+	++waterSourceVersion;
 	}
 
 void WaterTable2::removeRenderFunction(const AddWaterFunction* removeRenderFunction)
 	{
 	/* Find the given render function in the list and remove it: */
+	Threads::Mutex::Lock renderFunctionsLock(renderFunctionsMutex);
 	for(std::vector<const AddWaterFunction*>::iterator rfIt=renderFunctions.begin();rfIt!=renderFunctions.end();++rfIt)
 		if(*rfIt==removeRenderFunction)
 			{
@@ -818,11 +1516,24 @@ void WaterTable2::removeRenderFunction(const AddWaterFunction* removeRenderFunct
 			renderFunctions.erase(rfIt);
 			break;
 			}
+	++waterSourceVersion;
+	}
+
+void WaterTable2::updateWaterSources(void)
+	{
+	/* Invalidate the water textures in all OpenGL contexts: */
+	Threads::Mutex::Lock renderFunctionsLock(renderFunctionsMutex);
+	++waterSourceVersion;
 	}
 
 void WaterTable2::setWaterDeposit(GLfloat newWaterDeposit)
 	{
-	waterDeposit=newWaterDeposit;
+	Threads::Mutex::Lock renderFunctionsLock(renderFunctionsMutex);
+	if(waterDeposit!=newWaterDeposit)
+		{
+		waterDeposit=newWaterDeposit;
+		++waterSourceVersion;
+		}
 	}
 
 void WaterTable2::setDryBoundary(bool newDryBoundary)
@@ -830,35 +1541,134 @@ void WaterTable2::setDryBoundary(bool newDryBoundary)
 	dryBoundary=newDryBoundary;
 	}
 
+void WaterTable2::setSnowEnabled(bool newSnowEnabled)
+	{
+	snowEnabled=newSnowEnabled;
+	}
+
+void WaterTable2::setSnowParameters(GLfloat newCriticalHeight,GLfloat newMeltRate)
+	{
+	criticalHeight=newCriticalHeight;
+	meltRate=newMeltRate;
+	}
+
+void WaterTable2::setSnowStepInterval(unsigned int newSnowStepInterval)
+	{
+	snowStepInterval=newSnowStepInterval>0?newSnowStepInterval:1;
+	}
+
+void WaterTable2::setSnowUpdateInterval(double newSnowUpdateInterval)
+	{
+	snowUpdateInterval=newSnowUpdateInterval;
+	}
+
+void WaterTable2::setFuseSnowStep(bool newFuseSnowStep)
+	{
+	fuseSnowStep=newFuseSnowStep;
+	}
+
+void WaterTable2::setUseComputeShaders(bool newUseComputeShaders)
+	{
+	useComputeShaders=newUseComputeShaders;
+	}
+
+void WaterTable2::setStorageFormat(WaterTable2::StorageFormat newStorageFormat)
+	{
+	storageFormat=newStorageFormat;
+	}
+
+void WaterTable2::setSparseSimulation(bool newSparseSimulation)
+	{
+	sparseSimulation=newSparseSimulation;
+	}
+
+void WaterTable2::setStageTimers(const StageTimers* newStageTimers)
+	{
+	stageTimers=newStageTimers;
+	}
+
+bool WaterTable2::isUsingComputeShaders(GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=getDataItem(contextData);
+	
+	return dataItem->computeShaders;
+	}
+
 void WaterTable2::updateBathymetry(GLContextData& contextData) const
 	{
 	/* Get the data item: */
-	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	DataItem* dataItem=getDataItem(contextData);
+	
+	{
+	/* Upload a newly restored simulation state before the bathymetry update adapts it to the current surface: */
+	Threads::Mutex::Lock restoreLock(restoreMutex);
+	if(dataItem->restoreVersion!=restoreVersion)
+		uploadRestoredState(dataItem);
+	}
 	
 	/* Check if the current bathymetry texture is outdated: */
 	if(dataItem->bathymetryVersion!=depthImageRenderer->getDepthImageVersion())
 		{
+		/* Find the rectangle of the bathymetry grid covered by the parts of the surface that changed since the last update: */
+		unsigned int bathymetrySize[2]={size[0]-1,size[1]-1};
+		int changedRect[4]={0,0,int(bathymetrySize[0]),int(bathymetrySize[1])};
+		if(dataItem->bathymetryVersion!=0&&!depthImageRenderer->calcChangedRect(dataItem->bathymetryVersion,bathymetryPmv,bathymetrySize,changedRect))
+			{
+			/* Nothing visible changed; mark the bathymetry as current: */
+			dataItem->bathymetryVersion=depthImageRenderer->getDepthImageVersion();
+			return;
+			}
+		
+		/* Re-render the changed rectangle and the rectangle in which the two bathymetry textures still differ from the previous update: */
+		int renderRect[4];
+		for(int i=0;i<2;++i)
+			{
+			renderRect[i]=changedRect[i];
+			renderRect[2+i]=changedRect[2+i];
+			if(dataItem->bathymetryChangedRect[i]<dataItem->bathymetryChangedRect[2+i])
+				{
+				renderRect[i]=Math::min(renderRect[i],dataItem->bathymetryChangedRect[i]);
+				renderRect[2+i]=Math::max(renderRect[2+i],dataItem->bathymetryChangedRect[2+i]);
+				}
+			}
+		
+		/* Cells read the four bathymetry vertices around them, so the affected cell rectangle extends one cell further: */
+		int cellRect[4];
+		for(int i=0;i<2;++i)
+			{
+			cellRect[i]=changedRect[i];
+			cellRect[2+i]=changedRect[2+i]+1;
+			}
+		bool fullUpdate=cellRect[0]==0&&cellRect[1]==0&&cellRect[2]==int(size[0])&&cellRect[3]==int(size[1]);
+		
+		/* Measure the bathymetry update: */
+		StageTimers::GPUTimer bathymetryTimer(stageTimers,StageTimers::BATHYMETRY,contextData);
+		
 		/* Save relevant OpenGL state: */
-		glPushAttrib(GL_VIEWPORT_BIT);
+		glPushAttrib(GL_VIEWPORT_BIT|GL_SCISSOR_BIT);
 		GLint currentFrameBuffer;
 		glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
 		GLfloat currentClearColor[4];
 		glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
 		
-		/* Bind the bathymetry rendering frame buffer and clear it: */
+		/* Bind the bathymetry rendering frame buffer and clear the rectangle to be re-rendered: */
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->bathymetryFramebufferObject);
 		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentBathymetry));
 		glViewport(0,0,size[0]-1,size[1]-1);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(renderRect[0],renderRect[1],renderRect[2]-renderRect[0],renderRect[3]-renderRect[1]);
 		glClearColor(GLfloat(domain.min[2]),0.0f,0.0f,1.0f);
 		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 		
 		/* Render the surface into the bathymetry grid: */
 		depthImageRenderer->renderElevation(bathymetryPmv,contextData);
 		
-		/* Set up the integration frame buffer to update the conserved quantities based on bathymetry changes: */
+		/* Set up the integration frame buffer to update the conserved quantities in the affected cells based on bathymetry changes: */
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
 		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
 		glViewport(0,0,size[0],size[1]);
+		glScissor(cellRect[0],cellRect[1],cellRect[2]-cellRect[0],cellRect[3]-cellRect[1]);
 		
 		/* Set up the bathymetry update shader: */
 		glUseProgramObjectARB(dataItem->bathymetryShader);
@@ -890,6 +1700,16 @@ void WaterTable2::updateBathymetry(GLContextData& contextData) const
 		glActiveTextureARB(GL_TEXTURE0_ARB);
 		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 		
+		if(!fullUpdate)
+			{
+			/* Copy the updated cells back into the current quantity grid, whose other cells are still valid: */
+			glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+			glCopyTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,cellRect[0],cellRect[1],cellRect[0],cellRect[1],cellRect[2]-cellRect[0],cellRect[3]-cellRect[1]);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			glReadBuffer(GL_NONE);
+			}
+		
 		/* Restore OpenGL state: */
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 		glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
@@ -897,15 +1717,18 @@ void WaterTable2::updateBathymetry(GLContextData& contextData) const
 		
 		/* Update the bathymetry and quantity grids: */
 		dataItem->currentBathymetry=1-dataItem->currentBathymetry;
+		for(int i=0;i<4;++i)
+			dataItem->bathymetryChangedRect[i]=changedRect[i];
 		dataItem->bathymetryVersion=depthImageRenderer->getDepthImageVersion();
-		dataItem->currentQuantity=1-dataItem->currentQuantity;
+		if(fullUpdate)
+			dataItem->currentQuantity=1-dataItem->currentQuantity;
 		}
 	}
 
 void WaterTable2::updateBathymetry(const GLfloat* bathymetryGrid,GLContextData& contextData) const
 	{
 	/* Get the data item: */
-	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	DataItem* dataItem=getDataItem(contextData);
 	
 	/* Set up the integration frame buffer to update the conserved quantities based on bathymetry changes: */
 	glPushAttrib(GL_VIEWPORT_BIT);
@@ -952,15 +1775,19 @@ void WaterTable2::updateBathymetry(const GLfloat* bathymetryGrid,GLContextData&
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	glPopAttrib();
 
-	/* Update the bathymetry and quantity grids: */
+	/* Update the bathymetry and quantity grids; the two bathymetry textures may now differ everywhere: */
 	dataItem->currentBathymetry=1-dataItem->currentBathymetry;
+	dataItem->bathymetryChangedRect[0]=0;
+	dataItem->bathymetryChangedRect[1]=0;
+	dataItem->bathymetryChangedRect[2]=size[0]-1;
+	dataItem->bathymetryChangedRect[3]=size[1]-1;
 	dataItem->currentQuantity=1-dataItem->currentQuantity;
 	}
 
 void WaterTable2::setWaterLevel(const GLfloat* waterGrid,GLContextData& contextData) const
 	{
 	/* Get the data item: */
-	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	DataItem* dataItem=getDataItem(contextData);
 	
 	/* Set up the integration frame buffer to adapt the new water level to the current bathymetry: */
 	glPushAttrib(GL_VIEWPORT_BIT);
@@ -1005,30 +1832,129 @@ void WaterTable2::setWaterLevel(const GLfloat* waterGrid,GLContextData& contextD
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	glPopAttrib();
 
-	/* Update the quantity grid: */
+	/* Update the quantity grid, and the active tiles with the next step: */
 	dataItem->currentQuantity=1-dataItem->currentQuantity;
+	dataItem->numStepsSinceActiveTileUpdate=0;
 	}
 
-GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& contextData) const
+void WaterTable2::restoreState(const GLsizei stateSize[2],const GLfloat* bathymetryGrid,const GLfloat* quantityGrid,const GLfloat* snowGrid)
 	{
-	/* Get the data item: */
-	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
-	//std::cout<<"Testing000"<<std::endl;
-	/* Save relevant OpenGL state: */
-	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
-	GLint currentFrameBuffer;
-	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	Threads::Mutex::Lock restoreLock(restoreMutex);
+	
+	/* Copy the grids: */
+	for(int i=0;i<2;++i)
+		restoreSize[i]=stateSize[i];
+	size_t numCells=size_t(stateSize[1])*size_t(stateSize[0]);
+	restoreGrids[0].assign(bathymetryGrid,bathymetryGrid+size_t(stateSize[1]-1)*size_t(stateSize[0]-1));
+	restoreGrids[1].assign(quantityGrid,quantityGrid+numCells*3);
+	restoreGrids[2].assign(snowGrid,snowGrid+numCells*3);
+	
+	/* Invalidate the simulation states in all OpenGL contexts: */
+	++restoreVersion;
+	}
+
+void WaterTable2::uploadRestoredState(WaterTable2::DataItem* dataItem) const
+	{
+	/* Keep the restored state pending while the grids run at a different size: */
+	if(restoreSize[0]!=size[0]||restoreSize[1]!=size[1])
+		return;
+	dataItem->restoreVersion=restoreVersion;
+	
+	/* Upload the bathymetry into both bathymetry textures, so that they are identical everywhere: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	for(int i=0;i<2;++i)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[i]);
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0]-1,size[1]-1,GL_LUMINANCE,GL_FLOAT,&restoreGrids[0][0]);
+		}
+	for(int i=0;i<4;++i)
+		dataItem->bathymetryChangedRect[i]=0;
+	
+	/* Upload the conserved quantities and snow directly, keeping the restored discharges: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0],size[1],GL_RGB,GL_FLOAT,&restoreGrids[1][0]);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[dataItem->currentSnow]);
+	glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0],size[1],GL_RGB,GL_FLOAT,&restoreGrids[2][0]);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
+	/* Re-render the entire current surface on the next bathymetry update, which moves the restored water onto it, and update the active tiles with the next step: */
+	dataItem->bathymetryVersion=0;
+	dataItem->numStepsSinceActiveTileUpdate=0;
+	}
+
+bool WaterTable2::isSnowUpdateDue(WaterTable2::DataItem* dataItem) const
+	{
+	if(snowUpdateInterval>0.0)
+		{
+		/* Update snow with the first step after the wall-clock interval has passed: */
+		double now=getMonotonicTime();
+		if(now-dataItem->lastSnowUpdateTime<snowUpdateInterval)
+			return false;
+		dataItem->lastSnowUpdateTime=now;
+		}
+	else
+		{
+		/* Update snow every snow step interval steps: */
+		if(++dataItem->numStepsSinceSnowUpdate<snowStepInterval)
+			return false;
+		}
+	dataItem->numStepsSinceSnowUpdate=0;
+	return true;
+	}
+
+void WaterTable2::bindSnowStepShader(WaterTable2::DataItem* dataItem,GLhandleARB shader,const GLint uniformLocations[12]) const
+	{
+	/* Install the shader and upload the snow and boundary parameters: */
+	glUseProgramObjectARB(shader);
+	glUniformARB(uniformLocations[1],attenuation);
+	glUniformARB(uniformLocations[2],criticalHeight);
+	glUniformARB(uniformLocations[3],meltRate);
+	glUniform1iARB(uniformLocations[4],dryBoundary?1:0);
+	glUniform2fARB(uniformLocations[5],GLfloat(size[0]),GLfloat(size[1]));
+	
+	/* Bind the current grids and the step state: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	glUniform1iARB(uniformLocations[6],0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[2]);
+	glUniform1iARB(uniformLocations[7],1);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
+	glUniform1iARB(uniformLocations[8],2);
+	glActiveTextureARB(GL_TEXTURE3_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[dataItem->currentSnow]);
+	glUniform1iARB(uniformLocations[9],3);
+	glActiveTextureARB(GL_TEXTURE4_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+	glUniform1iARB(uniformLocations[10],4);
+	glActiveTextureARB(GL_TEXTURE5_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(uniformLocations[0],5);
+	glActiveTextureARB(GL_TEXTURE6_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowClockTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(uniformLocations[11],6);
+	}
+
+void WaterTable2::runFragmentStages(WaterTable2::DataItem* dataItem,bool forceStepSize,GLContextData& contextData) const
+	{
 	/*********************************************************************
 	Step 1: Calculate temporal derivative of most recent quantities.
 	*********************************************************************/
 	
-	GLfloat stepSize=calcDerivative(dataItem,dataItem->quantityTextureObjects[dataItem->currentQuantity],!forceStepSize);
+	calcDerivative(dataItem,dataItem->quantityTextureObjects[dataItem->currentQuantity],!forceStepSize,contextData);
+	
+	/* Select the step size on the GPU; the integration shaders read it from the step state: */
+	calcStepSize(dataItem,!forceStepSize);
 	
 	/*********************************************************************
 	Step 2: Perform the tentative Euler integration step.
 	*********************************************************************/
 	
+	{
+	/* Measure the Euler integration step: */
+	StageTimers::GPUTimer eulerStepTimer(stageTimers,StageTimers::EULERSTEP,contextData);
+	
 	/* Set up the Euler step integration frame buffer: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
 	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+2);
@@ -1036,14 +1962,16 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 	
 	/* Set up the Euler integration step shader: */
 	glUseProgramObjectARB(dataItem->eulerStepShader);
-	glUniformARB(dataItem->eulerStepShaderUniformLocations[0],stepSize);
-	glUniformARB(dataItem->eulerStepShaderUniformLocations[1],Math::pow(attenuation,stepSize));
+	glUniformARB(dataItem->eulerStepShaderUniformLocations[1],attenuation);
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
 	glUniform1iARB(dataItem->eulerStepShaderUniformLocations[2],0);
 	glActiveTextureARB(GL_TEXTURE1_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
 	glUniform1iARB(dataItem->eulerStepShaderUniformLocations[3],1);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->eulerStepShaderUniformLocations[0],2);
 	
 	/* Run the Euler integration step: */
 	glBegin(GL_QUADS);
@@ -1052,165 +1980,356 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 	glVertex2i(size[0],size[1]);
 	glVertex2i(0,size[1]);
 	glEnd();
+	}
 	
 	/*********************************************************************
 	Step 3: Calculate temporal derivative of intermediate quantities.
 	*********************************************************************/
 	
-	calcDerivative(dataItem,dataItem->quantityTextureObjects[2],false);
+	calcDerivative(dataItem,dataItem->quantityTextureObjects[2],false,contextData);
 	
 	/*********************************************************************
 	Step 4: Perform the final Runge-Kutta integration step.
 	*********************************************************************/
-	//std::cout<<"Testing00"<<std::endl;
-	/* Set up the Runge-Kutta step integration frame buffer: */
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
-	glViewport(0,0,size[0],size[1]);
-	
-	/* Set up the Runge-Kutta integration step shader: */
-	glUseProgramObjectARB(dataItem->rungeKuttaStepShader);
-	glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[0],stepSize);
-	glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[1],Math::pow(attenuation,stepSize));
-	glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[2],criticalHeight);
-	glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[3],meltRate);
-	glActiveTextureARB(GL_TEXTURE0_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
-	glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[4],0);
-	glActiveTextureARB(GL_TEXTURE1_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[2]);
-	glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[5],1);
-	glActiveTextureARB(GL_TEXTURE2_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
-	glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[6],2);
-	glActiveTextureARB(GL_TEXTURE3_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObject);
-	glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[7],3);
-	glActiveTextureARB(GL_TEXTURE4_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
-	glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[8],4);
 	
-	/* Run the Runge-Kutta integration step: */
-	glBegin(GL_QUADS);
-	glVertex2i(0,0);
-	glVertex2i(size[0],0);
-	glVertex2i(size[0],size[1]);
-	glVertex2i(0,size[1]);
-	glEnd();
-	//std::cout<<"Count"<<std::endl;
-	if(dryBoundary)
+	/* Select the Runge-Kutta shader that also updates snow if a snow update is due: */
+	bool snowStep=snowEnabled&&isSnowUpdateDue(dataItem);
+	if(snowStep)
 		{
-		/* Set up the boundary condition shader to enforce dry boundaries: */
-		glUseProgramObjectARB(dataItem->boundaryShader);
-		glActiveTextureARB(GL_TEXTURE0_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
-		glUniform1iARB(dataItem->boundaryShaderUniformLocations[0],0);
+		/* Measure the Runge-Kutta integration and snow step: */
+		StageTimers::GPUTimer snowStepTimer(stageTimers,StageTimers::SNOWSTEP,contextData);
+		glViewport(0,0,size[0],size[1]);
 		
-		/* Run the boundary condition shader on the outermost layer of pixels: */
-		//glColorMask(GL_TRUE,GL_FALSE,GL_FALSE,GL_FALSE);
-		glBegin(GL_LINE_LOOP);
-		glVertex2f(0.5f,0.5f);
-		glVertex2f(GLfloat(size[0])-0.5f,0.5f);
-		glVertex2f(GLfloat(size[0])-0.5f,GLfloat(size[1])-0.5f);
+		if(fuseSnowStep&&dataItem->fusedSnowStep)
+			{
+			/* Set up the Runge-Kutta step integration frame buffer to write the new quantities and the new snow grid at once: */
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
+			GLenum drawBuffers[2]={GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity),GL_COLOR_ATTACHMENT3_EXT+(1-dataItem->currentSnow)};
+			glDrawBuffersARB(2,drawBuffers);
+			
+			/* Run the fused Runge-Kutta integration and snow step shader, which also enforces dry boundaries: */
+			bindSnowStepShader(dataItem,dataItem->rungeKuttaSnowStepShader,dataItem->rungeKuttaSnowStepShaderUniformLocations);
+			glBegin(GL_QUADS);
+			glVertex2i(0,0);
+			glVertex2i(size[0],0);
+			glVertex2i(size[0],size[1]);
+			glVertex2i(0,size[1]);
+			glEnd();
+			}
+		else
+			{
+			/* Update the snow grid from the new water surface of the Runge-Kutta integration step: */
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->snowFramebufferObject);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentSnow));
+			bindSnowStepShader(dataItem,dataItem->snowShader,dataItem->snowShaderUniformLocations);
+			glBegin(GL_QUADS);
+			glVertex2i(0,0);
+			glVertex2i(size[0],0);
+			glVertex2i(size[0],size[1]);
+			glVertex2i(0,size[1]);
+			glEnd();
+			
+			/* Run the Runge-Kutta integration step with the freeze update, which reads the same unchanged grids as the snow update: */
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
+			bindSnowStepShader(dataItem,dataItem->freezeShader,dataItem->freezeShaderUniformLocations);
+			glBegin(GL_QUADS);
+			glVertex2i(0,0);
+			glVertex2i(size[0],0);
+			glVertex2i(size[0],size[1]);
+			glVertex2i(0,size[1]);
+			glEnd();
+			}
+		
+		/* Update the current snow grid, and restart counting advancing steps with the next step: */
+		dataItem->currentSnow=1-dataItem->currentSnow;
+		dataItem->resetSnowClock=true;
+		}
+	else
+		{
+		/* Measure the Runge-Kutta integration step: */
+		StageTimers::GPUTimer rungeKuttaStepTimer(stageTimers,StageTimers::RUNGEKUTTASTEP,contextData);
+		
+		/* Set up the Runge-Kutta step integration frame buffer: */
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
+		glViewport(0,0,size[0],size[1]);
+		
+		/* Set up the Runge-Kutta integration step shader: */
+		glUseProgramObjectARB(dataItem->rungeKuttaStepShader);
+		glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[1],attenuation);
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+		glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[2],0);
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[2]);
+		glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[3],1);
+		glActiveTextureARB(GL_TEXTURE2_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
+		glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[4],2);
+		glActiveTextureARB(GL_TEXTURE3_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+		glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[0],3);
+		
+		/* Run the Runge-Kutta integration step: */
+		glBegin(GL_QUADS);
+		glVertex2i(0,0);
+		glVertex2i(size[0],0);
+		glVertex2i(size[0],size[1]);
+		glVertex2i(0,size[1]);
+		glEnd();
+		}
+	
+	/*********************************************************************
+	Step 5: Enforce dry boundaries after a plain Runge-Kutta step, once
+	the Runge-Kutta step's timer query ended; timer queries cannot nest.
+	*********************************************************************/
+	
+	if(!snowStep&&dryBoundary)
+		{
+		/* Measure the boundary condition pass: */
+		StageTimers::GPUTimer boundaryTimer(stageTimers,StageTimers::BOUNDARY,contextData);
+		
+		/* Set up the boundary condition shader to enforce dry boundaries: */
+		glUseProgramObjectARB(dataItem->boundaryShader);
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+		glUniform1iARB(dataItem->boundaryShaderUniformLocations[0],0);
+		
+		/* Run the boundary condition shader on the outermost layer of pixels: */
+		//glColorMask(GL_TRUE,GL_FALSE,GL_FALSE,GL_FALSE);
+		glBegin(GL_LINE_LOOP);
+		glVertex2f(0.5f,0.5f);
+		glVertex2f(GLfloat(size[0])-0.5f,0.5f);
+		glVertex2f(GLfloat(size[0])-0.5f,GLfloat(size[1])-0.5f);
 		glVertex2f(0.5f,GLfloat(size[1])-0.5f);
 		glEnd();
 		//glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
 		}
 	
-	/* Update the current quantities: */
-	dataItem->currentQuantity=1-dataItem->currentQuantity;
-	//std::cout<<"Testing"<<std::endl;
-	/*Set up the Snow Frame buffer*/
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->snowFramebufferObject);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
-	glViewport(0,0,size[0],size[1]);
+	/* Keep the snow clock from running while snow is disabled: */
+	if(!snowEnabled)
+		dataItem->resetSnowClock=true;
+	}
 
-	/*Set up the snow shader*/
-	glUseProgramObjectARB(dataItem->snowShader);
-	glUniformARB(dataItem->snowShaderUniformLocations[0],criticalHeight);
-	glUniformARB(dataItem->snowShaderUniformLocations[1],meltRate);
+void WaterTable2::runComputeStages(WaterTable2::DataItem* dataItem,bool forceStepSize,GLContextData& contextData) const
+	{
+	/* Cover the grid with work groups of 16x16 cells: */
+	GLuint numGroups[2];
+	for(int i=0;i<2;++i)
+		numGroups[i]=GLuint((size[i]+15)/16);
+	
+	/*********************************************************************
+	Step 1: Calculate the temporal derivative of the most recent
+	quantities and the maximum step size of each work group.
+	*********************************************************************/
+	
+	{
+	/* Measure the temporal derivative computation: */
+	StageTimers::GPUTimer derivativeTimer(stageTimers,StageTimers::DERIVATIVE,contextData);
+	
+	/* Set up the fused slope, flux, and temporal derivative compute shader: */
+	glUseProgramObjectARB(dataItem->derivativeComputeShader);
+	glUniformARB<2>(dataItem->derivativeComputeShaderUniformLocations[0],1,cellSize);
+	glUniformARB(dataItem->derivativeComputeShaderUniformLocations[1],theta);
+	glUniformARB(dataItem->derivativeComputeShaderUniformLocations[2],g);
+	glUniformARB(dataItem->derivativeComputeShaderUniformLocations[3],epsilon);
+	glUniform2iARB(dataItem->derivativeComputeShaderUniformLocations[4],size[0],size[1]);
 	glActiveTextureARB(GL_TEXTURE0_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObject);
-	glUniform1iARB(dataItem->snowShaderUniformLocations[2],0);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+	glUniform1iARB(dataItem->derivativeComputeShaderUniformLocations[5],0);
 	glActiveTextureARB(GL_TEXTURE1_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
-	glUniform1iARB(dataItem->snowShaderUniformLocations[3],1);
+	glUniform1iARB(dataItem->derivativeComputeShaderUniformLocations[6],1);
 	glActiveTextureARB(GL_TEXTURE2_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
-	glUniform1iARB(dataItem->snowShaderUniformLocations[4],2);
-
-	/*Run the Snow Step*/
-	//std::cout<<"Testing2"<<std::endl;
-	glBegin(GL_QUADS);
-	glVertex2i(0,0);
-	glVertex2i(size[0],0);
-	glVertex2i(size[0],size[1]);
-	glVertex2i(0,size[1]);
-	glEnd();
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->activeTileTextureObject);
+	glUniform1iARB(dataItem->derivativeComputeShaderUniformLocations[9],2);
+	glActiveTextureARB(GL_TEXTURE3_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->derivativeComputeShaderUniformLocations[10],3);
+	bindImageTexture(0,dataItem->derivativeTextureObject,GL_WRITE_ONLY_ARB,dataItem->vectorFormat);
+	glUniform1iARB(dataItem->derivativeComputeShaderUniformLocations[7],0);
+	bindImageTexture(1,dataItem->workGroupStepSizeTextureObject,GL_WRITE_ONLY_ARB,GL_R32F);
+	glUniform1iARB(dataItem->derivativeComputeShaderUniformLocations[8],1);
 	
-	/*Set up the freeze frame buffer*/
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->freezeFramebufferObject);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(dataItem->currentQuantity));
-	glViewport(0,0,size[0],size[1]);
-
-	/*Set up the freeze shader*/
-	glUseProgramObjectARB(dataItem->freezeShader);
-	glUniformARB(dataItem->freezeShaderUniformLocations[0],criticalHeight);
+	/* Run the temporal derivative computation: */
+	dispatchCompute(numGroups[0],numGroups[1]);
+	memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	
+	/*********************************************************************
+	Step 2: Reduce the work groups' maximum step sizes and select the step
+	size in a single work group.
+	*********************************************************************/
+	
+	{
+	/* Measure the step size reduction and selection: */
+	StageTimers::GPUTimer maxStepSizeTimer(stageTimers,StageTimers::MAXSTEPSIZE,contextData);
+	
+	/* Set up the step size compute shader: */
+	glUseProgramObjectARB(dataItem->stepSizeComputeShader);
+	glUniformARB(dataItem->stepSizeComputeShaderUniformLocations[0],maxStepSize);
+	glUniform1iARB(dataItem->stepSizeComputeShaderUniformLocations[1],forceStepSize?0:1);
+	glUniform2iARB(dataItem->stepSizeComputeShaderUniformLocations[2],GLint(numGroups[0]),GLint(numGroups[1]));
 	glActiveTextureARB(GL_TEXTURE0_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
-	glUniform1iARB(dataItem->freezeShaderUniformLocations[1],0);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->workGroupStepSizeTextureObject);
+	glUniform1iARB(dataItem->stepSizeComputeShaderUniformLocations[3],0);
 	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->stepSizeComputeShaderUniformLocations[4],1);
+	glUniform1iARB(dataItem->stepSizeComputeShaderUniformLocations[5],dataItem->resetSnowClock?1:0);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowClockTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->stepSizeComputeShaderUniformLocations[6],2);
+	bindImageTexture(0,dataItem->stepStateTextureObjects[1-dataItem->currentStepState],GL_WRITE_ONLY_ARB,GL_RGBA32F);
+	glUniform1iARB(dataItem->stepSizeComputeShaderUniformLocations[7],0);
+	bindImageTexture(1,dataItem->snowClockTextureObjects[1-dataItem->currentStepState],GL_WRITE_ONLY_ARB,GL_RGBA32F);
+	glUniform1iARB(dataItem->stepSizeComputeShaderUniformLocations[8],1);
+	dataItem->resetSnowClock=false;
+	
+	/* Run the step size selection and update the current step state: */
+	dispatchCompute(1,1);
+	memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	dataItem->currentStepState=1-dataItem->currentStepState;
+	}
+	
+	/*********************************************************************
+	Step 3: Perform the tentative Euler step, the final Runge-Kutta step,
+	the boundary conditions, and the snow updates in a single pass.
+	*********************************************************************/
+	
+	bool updateSnow=snowEnabled&&isSnowUpdateDue(dataItem);
+	
+	{
+	/* Measure the fused integration step as a snow step if it updates snow: */
+	StageTimers::GPUTimer rungeKuttaStepTimer(stageTimers,updateSnow?StageTimers::SNOWSTEP:StageTimers::RUNGEKUTTASTEP,contextData);
+	
+	/* Set up the fused Euler and Runge-Kutta integration step compute shader: */
+	glUseProgramObjectARB(dataItem->rungeKuttaComputeShader);
+	glUniformARB<2>(dataItem->rungeKuttaComputeShaderUniformLocations[0],1,cellSize);
+	glUniformARB(dataItem->rungeKuttaComputeShaderUniformLocations[1],theta);
+	glUniformARB(dataItem->rungeKuttaComputeShaderUniformLocations[2],g);
+	glUniformARB(dataItem->rungeKuttaComputeShaderUniformLocations[3],epsilon);
+	glUniform2iARB(dataItem->rungeKuttaComputeShaderUniformLocations[4],size[0],size[1]);
+	glUniformARB(dataItem->rungeKuttaComputeShaderUniformLocations[5],attenuation);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[6],dryBoundary?1:0);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[7],updateSnow?1:0);
+	glUniformARB(dataItem->rungeKuttaComputeShaderUniformLocations[8],criticalHeight);
+	glUniformARB(dataItem->rungeKuttaComputeShaderUniformLocations[9],meltRate);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
-	glUniform1iARB(dataItem->freezeShaderUniformLocations[2],1);
-
-	/*Run the Freeze Step*/
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[10],0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[11],1);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[12],2);
+	glActiveTextureARB(GL_TEXTURE3_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[13],3);
+	glActiveTextureARB(GL_TEXTURE4_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[dataItem->currentSnow]);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[14],4);
+	glActiveTextureARB(GL_TEXTURE5_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowClockTextureObjects[dataItem->currentStepState]);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[15],5);
+	glActiveTextureARB(GL_TEXTURE6_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->activeTileTextureObject);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[18],6);
+	bindImageTexture(0,dataItem->quantityTextureObjects[1-dataItem->currentQuantity],GL_WRITE_ONLY_ARB,dataItem->vectorFormat);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[16],0);
+	bindImageTexture(1,dataItem->snowTextureObjects[1-dataItem->currentSnow],GL_WRITE_ONLY_ARB,dataItem->vectorFormat);
+	glUniform1iARB(dataItem->rungeKuttaComputeShaderUniformLocations[17],1);
+	
+	/* Run the fused integration step, and make its results visible to all following passes and read-backs: */
+	dispatchCompute(numGroups[0],numGroups[1]);
+	memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT|GL_TEXTURE_UPDATE_BARRIER_BIT|GL_PIXEL_BUFFER_BARRIER_BIT|GL_FRAMEBUFFER_BARRIER_BIT);
+	
+	/* Unbind the images: */
+	for(GLuint i=0;i<2;++i)
+		bindImageTexture(i,0,GL_WRITE_ONLY_ARB,GL_RGBA32F);
+	}
 	
-	glBegin(GL_QUADS);
-	glVertex2i(0,0);
-	glVertex2i(size[0],0);
-	glVertex2i(size[0],size[1]);
-	glVertex2i(0,size[1]);
-	glEnd();
-	//std::cout<<"Count"<<std::endl;
+	if(updateSnow)
+		{
+		/* Update the current snow grid, and restart counting advancing steps with the next step: */
+		dataItem->currentSnow=1-dataItem->currentSnow;
+		dataItem->resetSnowClock=true;
+		}
+	else if(!snowEnabled)
+		dataItem->resetSnowClock=true; // Keep the snow clock from running while snow is disabled
+	}
 
+void WaterTable2::runStep(WaterTable2::DataItem* dataItem,bool forceStepSize,GLContextData& contextData) const
+	{
+	/* Keep the list of render functions from changing during the step: */
+	Threads::Mutex::Lock renderFunctionsLock(renderFunctionsMutex);
+	
+	/* Update the active tiles every few steps: */
+	if(dataItem->numStepsSinceActiveTileUpdate==0)
+		updateActiveTiles(dataItem);
+	if(++dataItem->numStepsSinceActiveTileUpdate>=activeTileUpdateInterval)
+		dataItem->numStepsSinceActiveTileUpdate=0;
+	
+	/* Calculate the new quantities into the other quantity texture: */
+	if(dataItem->computeShaders)
+		runComputeStages(dataItem,forceStepSize,contextData);
+	else
+		runFragmentStages(dataItem,forceStepSize,contextData);
+	
+	/* Update the current quantities: */
+	dataItem->currentQuantity=1-dataItem->currentQuantity;
+	
 	if(waterDeposit!=0.0f||!renderFunctions.empty())
 		{
-		/* Save OpenGL state: */
-		GLfloat currentClearColor[4];
-		glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
+		/* Measure the water sources and sinks pass: */
+		StageTimers::GPUTimer waterAddTimer(stageTimers,StageTimers::WATERADD,contextData);
 		
-		/*******************************************************************
-		Step 5: Render all water sources and sinks additively into the water
-		texture.
-		*******************************************************************/
-		
-		/* Set up and clear the water frame buffer: */
-		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->waterFramebufferObject);
-		glViewport(0,0,size[0],size[1]);
-		glClearColor(waterDeposit*stepSize,0.0f,0.0f,0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		
-		/* Enable additive rendering: */
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_ONE,GL_ONE);
-		
-		/* Set up the water adding shader: */
-		glUseProgramObjectARB(dataItem->waterAddShader);
-		glUniformMatrix4fvARB(dataItem->waterAddShaderUniformLocations[0],1,GL_FALSE,waterAddPmvMatrix);
-		glUniform1fARB(dataItem->waterAddShaderUniformLocations[1],stepSize);
-		
-		/* Bind the water texture: */
-		glActiveTextureARB(GL_TEXTURE0_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
-		glUniform1iARB(dataItem->waterAddShaderUniformLocations[2],0);
-		
-		/* Call all render functions: */
-		for(std::vector<const AddWaterFunction*>::const_iterator rfIt=renderFunctions.begin();rfIt!=renderFunctions.end();++rfIt)
-			(**rfIt)(contextData);
-		
-		/* Restore OpenGL state: */
-		glDisable(GL_BLEND);
-		glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
+		if(dataItem->waterSourceVersion!=waterSourceVersion)
+			{
+			/* Save OpenGL state: */
+			GLfloat currentClearColor[4];
+			glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
+			
+			/*****************************************************************
+			Step 5: Render all water sources and sinks additively into the
+			water texture. The texture holds source rates that are scaled by
+			each step's size when they are applied, so it is only re-rendered
+			when the sources change, and not on every step.
+			*****************************************************************/
+			
+			/* Set up and clear the water frame buffer: */
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->waterFramebufferObject);
+			glViewport(0,0,size[0],size[1]);
+			glClearColor(waterDeposit,0.0f,0.0f,0.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			
+			/* Enable additive rendering: */
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_ONE,GL_ONE);
+			
+			/* Set up the water adding shader: */
+			glUseProgramObjectARB(dataItem->waterAddShader);
+			glUniformMatrix4fvARB(dataItem->waterAddShaderUniformLocations[0],1,GL_FALSE,waterAddPmvMatrix);
+			glUniform1fARB(dataItem->waterAddShaderUniformLocations[1],1.0f);
+			
+			/* Bind the water texture: */
+			glActiveTextureARB(GL_TEXTURE0_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
+			glUniform1iARB(dataItem->waterAddShaderUniformLocations[2],0);
+			
+			/* Call all render functions: */
+			for(std::vector<const AddWaterFunction*>::const_iterator rfIt=renderFunctions.begin();rfIt!=renderFunctions.end();++rfIt)
+				(**rfIt)(contextData);
+			
+			/* Restore OpenGL state: */
+			glDisable(GL_BLEND);
+			glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
+			
+			/* Mark the water texture as current: */
+			dataItem->waterSourceVersion=waterSourceVersion;
+			}
 		
 		/*******************************************************************
 		Step 6: Update the conserved quantities based on the water texture.
@@ -1232,6 +2351,9 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 		glActiveTextureARB(GL_TEXTURE2_ARB);
 		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
 		glUniform1iARB(dataItem->waterShaderUniformLocations[2],2);
+		glActiveTextureARB(GL_TEXTURE3_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepStateTextureObjects[dataItem->currentStepState]);
+		glUniform1iARB(dataItem->waterShaderUniformLocations[3],3);
 		
 		/* Run the water update: */
 		glBegin(GL_QUADS);
@@ -1247,47 +2369,346 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 	
 	/* Unbind all shaders and textures: */
 	glUseProgramObjectARB(0);
+	for(int i=6;i>=3;--i)
+		{
+		glActiveTextureARB(GL_TEXTURE0_ARB+i);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		}
 	glActiveTextureARB(GL_TEXTURE2_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	glActiveTextureARB(GL_TEXTURE1_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	}
+
+GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=getDataItem(contextData);
+	
+	/* Save relevant OpenGL state: */
+	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_VIEWPORT_BIT);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	/* Run a single step limited only by the maximum step size: */
+	resetStepState(dataItem,maxStepSize);
+	runStep(dataItem,forceStepSize,contextData);
+	
+	/* Read back the step state, which waits for the GPU to finish the step: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->stepStateFramebufferObject);
+	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+dataItem->currentStepState);
+	GLfloat state[4];
+	glReadPixels(0,0,1,1,GL_RGBA,GL_FLOAT,state);
+	glReadBuffer(GL_NONE);
 	
 	/* Restore OpenGL state: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	glPopAttrib();
 	
 	/* Return the Runge-Kutta step's step size: */
-	return stepSize;
-	//std::cout<<"Count"<<std::endl;
+	return state[0];
+	}
+
+bool WaterTable2::queueSimulationSteps(GLfloat totalTimeStep,unsigned int numSteps,GLContextData& contextData,GLfloat& lastRemainingTime,unsigned int& lastNumSteps) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=getDataItem(contextData);
+	
+	/* Retrieve the previous call's final step state; it was read back a frame ago, so mapping the buffer does not stall in practice: */
+	bool haveLastState=false;
+	if(dataItem->stepStateReadPending)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->stepStateBufferObject);
+		const GLfloat* state=static_cast<const GLfloat*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+		if(state!=0)
+			{
+			lastRemainingTime=state[1];
+			lastNumSteps=(unsigned int)(state[3]+0.5f);
+			haveLastState=true;
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+			}
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+		dataItem->stepStateReadPending=false;
+		}
+	
+	/* Save relevant OpenGL state: */
+	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_VIEWPORT_BIT);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	/* Queue all steps against a shared time budget; steps after the budget is used up do not advance the simulation: */
+	resetStepState(dataItem,totalTimeStep);
+	for(unsigned int i=0;i<numSteps;++i)
+		runStep(dataItem,false,contextData);
+	
+	/* Read the final step state into the pixel buffer object without waiting for the GPU: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->stepStateFramebufferObject);
+	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+dataItem->currentStepState);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->stepStateBufferObject);
+	glReadPixels(0,0,1,1,GL_RGBA,GL_FLOAT,0);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	glReadBuffer(GL_NONE);
+	dataItem->stepStateReadPending=true;
+	
+	/* Restore OpenGL state: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	glPopAttrib();
+	
+	return haveLastState;
+	}
+
+bool WaterTable2::queueVolumeReduction(GLContextData& contextData,GLfloat lastVolumes[3]) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=getDataItem(contextData);
+	
+	/* Retrieve the previous call's totals and convert them from cell heights to volumes: */
+	bool haveLastVolumes=false;
+	if(dataItem->volumeReadPending)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->volumeBufferObject);
+		const GLfloat* totals=static_cast<const GLfloat*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+		if(totals!=0)
+			{
+			for(int i=0;i<3;++i)
+				lastVolumes[i]=totals[i]*cellSize[0]*cellSize[1];
+			haveLastVolumes=true;
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+			}
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+		dataItem->volumeReadPending=false;
+		}
+	
+	/* Save relevant OpenGL state: */
+	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	/* Gather the amounts of 2x2 tiles of cells into the first volume reduction texture: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->volumeFramebufferObject);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	int reducedWidth=(size[0]+1)/2;
+	int reducedHeight=(size[1]+1)/2;
+	glViewport(0,0,reducedWidth,reducedHeight);
+	glUseProgramObjectARB(dataItem->volumeShader);
+	glUniformARB(dataItem->volumeShaderUniformLocations[0],GLfloat(size[0]-1),GLfloat(size[1]-1));
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[dataItem->currentSnow]);
+	glUniform1iARB(dataItem->volumeShaderUniformLocations[1],0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	glUniform1iARB(dataItem->volumeShaderUniformLocations[2],1);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+	glUniform1iARB(dataItem->volumeShaderUniformLocations[3],2);
+	glBegin(GL_QUADS);
+	glVertex2i(0,0);
+	glVertex2i(size[0],0);
+	glVertex2i(size[0],size[1]);
+	glVertex2i(0,size[1]);
+	glEnd();
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	
+	/* Sum the gathered amounts in a sequence of half-reduction steps: */
+	glUseProgramObjectARB(dataItem->volumeReductionShader);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	int currentVolumeTexture=0;
+	while(reducedWidth>1||reducedHeight>1)
+		{
+		/* Set up the volume reduction frame buffer for the next step: */
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-currentVolumeTexture));
+		
+		/* Reduce the viewport by a factor of two: */
+		glViewport(0,0,(reducedWidth+1)/2,(reducedHeight+1)/2);
+		glUniformARB(dataItem->volumeReductionShaderUniformLocations[0],GLfloat(reducedWidth-1),GLfloat(reducedHeight-1));
+		
+		/* Bind the current volume reduction texture: */
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->volumeTextureObjects[currentVolumeTexture]);
+		glUniform1iARB(dataItem->volumeReductionShaderUniformLocations[1],0);
+		
+		/* Run the reduction step: */
+		glBegin(GL_QUADS);
+		glVertex2i(0,0);
+		glVertex2i(size[0],0);
+		glVertex2i(size[0],size[1]);
+		glVertex2i(0,size[1]);
+		glEnd();
+		
+		/* Go to the next step: */
+		reducedWidth=(reducedWidth+1)/2;
+		reducedHeight=(reducedHeight+1)/2;
+		currentVolumeTexture=1-currentVolumeTexture;
+		}
+	
+	/* Unbind all shaders and textures: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glUseProgramObjectARB(0);
+	
+	/* Read the totals into the pixel buffer object without waiting for the GPU: */
+	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+currentVolumeTexture);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->volumeBufferObject);
+	glReadPixels(0,0,1,1,GL_RGB,GL_FLOAT,0);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	glReadBuffer(GL_NONE);
+	dataItem->volumeReadPending=true;
+	
+	/* Restore OpenGL state: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	glPopAttrib();
+	
+	return haveLastVolumes;
+	}
+
+void WaterTable2::publishState(GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=getDataItem(contextData);
+	
+	/* Save the currently bound frame buffer: */
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	if(dataItem->publishFramebufferObject==0)
+		{
+		/* Create the textures of all published state slots; no state has been posted yet, so no render context can be using a slot: */
+		for(int i=0;i<3;++i)
+			{
+			glGenTextures(3,dataItem->publishedTextureObjects[i]);
+			for(int j=0;j<3;++j)
+				{
+				glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->publishedTextureObjects[i][j]);
+				glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+				glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+				if(j==0)
+					glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,size[0]-1,size[1]-1,0,GL_LUMINANCE,GL_FLOAT,0);
+				else
+					glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,dataItem->vectorFormat,size[0],size[1],0,GL_RGB,GL_FLOAT,0);
+				}
+			PublishedState& ps=publishedStates.getBuffer(i);
+			ps.bathymetryTextureObject=dataItem->publishedTextureObjects[i][0];
+			ps.quantityTextureObject=dataItem->publishedTextureObjects[i][1];
+			ps.snowTextureObject=dataItem->publishedTextureObjects[i][2];
+			}
+		
+		/* Create the frame buffer to read from the simulation state's textures: */
+		glGenFramebuffersEXT(1,&dataItem->publishFramebufferObject);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->publishFramebufferObject);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+		}
+	else
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->publishFramebufferObject);
+	
+	/* Start a new published state, and wait until the render context has finished its last use of it: */
+	PublishedState& ps=publishedStates.startNewValue();
+	if(dataItem->haveFenceSync)
+		waitForFence(ps.releaseFence);
+	
+	/* Copy the current grids into the published state's textures: */
+	GLuint sourceTextureObjects[3]={dataItem->bathymetryTextureObjects[dataItem->currentBathymetry],dataItem->quantityTextureObjects[dataItem->currentQuantity],dataItem->snowTextureObjects[dataItem->currentSnow]};
+	GLuint publishedTextureObjects[3]={ps.bathymetryTextureObject,ps.quantityTextureObject,ps.snowTextureObject};
+	for(int i=0;i<3;++i)
+		{
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,sourceTextureObjects[i],0);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,publishedTextureObjects[i]);
+		if(i==0)
+			glCopyTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,0,0,size[0]-1,size[1]-1);
+		else
+			glCopyTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,0,0,size[0],size[1]);
+		}
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,0,0);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	
+	/* Restore OpenGL state: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	
+	/* Fence the copies, or wait for them if fences are not supported, before handing off the new state: */
+	if(dataItem->haveFenceSync)
+		{
+		replaceFence(ps.publishFence);
+		glFlush();
+		}
+	else
+		glFinish();
+	publishedStates.postNewValue();
+	}
+
+void WaterTable2::lockNewPublishedState(GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=getDataItem(contextData);
+	
+	if(dataItem->usePublishedState&&dataItem->haveFenceSync)
+		{
+		/* Fence all uses of the currently locked state so far, so that the publishing context does not overwrite it too early: */
+		replaceFence(publishedStates.getLockedValue().releaseFence);
+		glFlush();
+		}
+	
+	/* Lock the most recently published state, and make this context wait until its copies are complete: */
+	if(publishedStates.lockNewValue())
+		{
+		if(dataItem->haveFenceSync)
+			waitForFence(publishedStates.getLockedValue().publishFence);
+		dataItem->usePublishedState=true;
+		}
 	}
 
 void WaterTable2::bindBathymetryTexture(GLContextData& contextData) const
 	{
 	/* Get the data item: */
-	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	DataItem* dataItem=getDataItem(contextData);
 	
 	/* Bind the bathymetry texture: */
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+	if(dataItem->usePublishedState)
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,publishedStates.getLockedValue().bathymetryTextureObject);
+	else
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
 	}
 
 void WaterTable2::bindQuantityTexture(GLContextData& contextData) const
 	{
 	/* Get the data item: */
-	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	DataItem* dataItem=getDataItem(contextData);
 	
 	/* Bind the conserved quantities texture: */
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	if(dataItem->usePublishedState)
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,publishedStates.getLockedValue().quantityTextureObject);
+	else
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
 	}
 
 void WaterTable2::bindSnowTexture(GLContextData& contextData) const
 	{
 	//Get the data item
-	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	DataItem* dataItem=getDataItem(contextData);
 
 	//Bind thhe snow texture
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObject);
+	if(dataItem->usePublishedState)
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,publishedStates.getLockedValue().snowTextureObject);
+	else
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->snowTextureObjects[dataItem->currentSnow]);
+	}
+
+bool WaterTable2::bindActiveTileTexture(GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=getDataItem(contextData);
+	
+	/* Only contexts running a sparse simulation keep their active tiles up to date: */
+	if(!sparseSimulation||dataItem->usePublishedState)
+		return false;
+	
+	/* Bind the active tile texture: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->activeTileTextureObject);
+	return true;
 	}
 
 void WaterTable2::uploadWaterTextureTransform(GLint location) const
@@ -26,6 +26,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <vector>
 #include <Misc/FunctionCalls.h>
+#include <Threads/Mutex.h>
+#include <Threads/TripleBuffer.h>
 #include <Geometry/Point.h>
 #include <Geometry/Box.h>
 #include <Geometry/OrthonormalTransformation.h>
@@ -34,14 +36,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/GLObject.h>
 #include <GL/GLContextData.h>
 
-// Snow Support
-#include <IO/FileMonitor.h>
-#include "Config.h"
-
 #include "Types.h"
+#include "ShaderHelper.h"
 
 /* Forward declarations: */
 class DepthImageRenderer;
+class StageTimers;
 
 typedef Misc::FunctionCall<GLContextData&> AddWaterFunction; // Type for render functions called to locally add water to the water table
 
@@ -52,6 +52,12 @@ class WaterTable2:public GLObject
 	typedef Geometry::Box<Scalar,3> Box;
 	typedef Geometry::OrthonormalTransformation<Scalar,3> ONTransform;
 	
+	enum StorageFormat // Enumerated type for the storage formats of the conserved quantity, temporal derivative, and snow grids
+		{
+		FLOAT32, // 32-bit floating-point components
+		FLOAT16 // 16-bit floating-point components, halving the memory bandwidth of the solver; all shader math remains 32-bit
+		};
+	
 	private:
 	struct DataItem:public GLObject::DataItem // Structure holding per-context state
 		{
@@ -60,52 +66,120 @@ class WaterTable2:public GLObject
 		GLuint bathymetryTextureObjects[2]; // Double-buffered one-component float color texture object holding the vertex-centered bathymetry grid
 		int currentBathymetry; // Index of bathymetry texture containing the most recent bathymetry grid
 		unsigned int bathymetryVersion; // Version number of the most recent bathymetry grid
+		int bathymetryChangedRect[4]; // Rectangle of the bathymetry grid outside of which both bathymetry textures are identical, as min x, min y, max x, max y (exclusive)
 		GLuint quantityTextureObjects[3]; // Double-buffered three-component color texture object holding the cell-centered conserved quantity grid (w, hu, hv)
 		int currentQuantity; // Index of quantity texture containing the most recent conserved quantity grid
 		GLuint derivativeTextureObject; // Three-component color texture object holding the cell-centered temporal derivative grid
 		GLuint maxStepSizeTextureObjects[2]; // Double-buffered one-component color texture objects to gather the maximum step size for Runge-Kutta integration steps
+		int currentMaxStepSize; // Index of maximum step size texture containing the most recently reduced maximum step size
+		GLuint stepStateTextureObjects[2]; // Double-buffered 1x1 four-component color texture objects holding the step state (step size, remaining time, advanced time, number of advancing steps)
+		int currentStepState; // Index of step state texture containing the most recent step state
+		GLuint snowClockTextureObjects[2]; // Double-buffered 1x1 color texture objects counting the advancing steps and the simulation time advanced since the last snow update; current one shares the step state's index
+		bool resetSnowClock; // Flag whether the next step size selection restarts the snow clock
+		unsigned int numStepsSinceSnowUpdate; // Number of integration steps queued since the last snow update
+		double lastSnowUpdateTime; // Wall-clock time of the last snow update in seconds
+		GLuint stepStateBufferObject; // Pixel buffer object receiving asynchronous read-backs of the step state
+		bool stepStateReadPending; // Flag whether a step state read-back into the pixel buffer object has been queued
 		GLuint waterTextureObject; // One-component color texture object to add or remove water to/from the conserved quantity grid
+		unsigned int waterSourceVersion; // Version number of the water sources and sinks rendered into the water texture
 		GLuint bathymetryFramebufferObject; // Frame buffer used to render the bathymetry surface into the bathymetry grid
 		GLuint derivativeFramebufferObject; // Frame buffer used for temporal derivative computation
 		GLuint maxStepSizeFramebufferObject; // Frame buffer used to calculate the maximum integration step size
 		GLuint integrationFramebufferObject; // Frame buffer used for the Euler and Runge-Kutta integration steps
 		GLuint waterFramebufferObject; // Frame buffer used for the water rendering step
+		GLuint stepStateFramebufferObject; // Frame buffer used to update the step state
 		GLhandleARB bathymetryShader; // Shader to update cell-centered conserved quantities after a change to the bathymetry grid
 		GLint bathymetryShaderUniformLocations[3];
 		GLhandleARB waterAdaptShader; // Shader to adapt a new conserved quantity grid to the current bathymetry grid
 		GLint waterAdaptShaderUniformLocations[2]; //3];
 		GLhandleARB derivativeShader; // Shader to compute face-centered partial fluxes and cell-centered temporal derivatives
-		GLint derivativeShaderUniformLocations[6];
+		GLint derivativeShaderUniformLocations[7];
 		GLhandleARB maxStepSizeShader; // Shader to compute a maximum step size for a subsequent Runge-Kutta integration step
 		GLint maxStepSizeShaderUniformLocations[2];
+		GLhandleARB stepSizeShader; // Shader to select the step size of the next integration step and advance the step state
+		GLint stepSizeShaderUniformLocations[6];
 		GLhandleARB boundaryShader; // Shader to enforce boundary conditions on the quantities grid
 		GLint boundaryShaderUniformLocations[1];
 		GLhandleARB eulerStepShader; // Shader to compute an Euler integration step
 		GLint eulerStepShaderUniformLocations[4];
 		GLhandleARB rungeKuttaStepShader; // Shader to compute a Runge-Kutta integration step
-		GLint rungeKuttaStepShaderUniformLocations[9]; //was 5
+		GLint rungeKuttaStepShaderUniformLocations[5];
 		GLhandleARB waterAddShader; // Shader to render water adder objects
 		GLint waterAddShaderUniformLocations[3];
 		GLhandleARB waterShader; // Shader to add or remove water from the conserved quantities grid
-		GLint waterShaderUniformLocations[3];
-
-		/*Snow Support*/
-		//Snow step
-		GLuint snowFramebufferObject;
-		GLhandleARB snowShader;
-		GLint snowShaderUniformLocations[5];
-		//GLuint snowTextureObjects[2];
-		GLuint snowTextureObject;
-		//int currentSnow;
-		//Freeze step
-		GLuint freezeFramebufferObject;
-		GLhandleARB freezeShader;
-		GLint freezeShaderUniformLocations[3];
-		
+		GLint waterShaderUniformLocations[4];
+
+		GLhandleARB rungeKuttaSnowStepShader; // Shader to compute a Runge-Kutta integration step fused with the snow accumulation, snow melt, and freeze updates
+		GLint rungeKuttaSnowStepShaderUniformLocations[12];
+		bool fusedSnowStep; // Flag whether the integration frame buffer can write the conserved quantity and snow grids in the same pass in this OpenGL context
+		GLuint snowFramebufferObject; // Frame buffer used to update the snow grid in a separate pass if the snow step is not fused
+		GLhandleARB snowShader; // Shader to compute the snow accumulation and snow melt updates of a Runge-Kutta integration step in a separate pass
+		GLint snowShaderUniformLocations[12];
+		GLhandleARB freezeShader; // Shader to compute a Runge-Kutta integration step with the freeze update in a separate pass
+		GLint freezeShaderUniformLocations[12];
+		GLuint snowTextureObjects[2]; // Double-buffered three-component color texture objects holding the cell-centered snow grid (snow amount, melt water released by the last snow update)
+		int currentSnow; // Index of snow texture containing the most recent snow grid
+		GLuint volumeTextureObjects[2]; // Double-buffered three-component color texture objects to reduce the snow, melt water, and free water amounts of the grid
+		GLuint volumeFramebufferObject; // Frame buffer used to reduce the snow, melt water, and free water amounts
+		GLuint volumeBufferObject; // Pixel buffer object receiving asynchronous read-backs of the reduced amounts
+		bool volumeReadPending; // Flag whether a read-back of reduced amounts into the pixel buffer object has been queued
+		GLhandleARB volumeShader; // Shader to gather the snow, melt water, and free water amounts of 2x2 tiles of cells
+		GLint volumeShaderUniformLocations[4];
+		GLhandleARB volumeReductionShader; // Shader to sum gathered amounts over 2x2 tiles of pixels
+		GLint volumeReductionShaderUniformLocations[2];
+		bool computeShaders; // Flag whether the solver runs on compute shaders in this OpenGL context
+		GLenum vectorFormat; // Internal format of the conserved quantity, temporal derivative, and snow textures in this OpenGL context
+		GLuint workGroupStepSizeTextureObject; // One-component color texture object receiving the maximum step size of each compute shader work group
+		GLhandleARB derivativeComputeShader; // Compute shader to calculate temporal derivatives and the maximum step size of each work group
+		GLint derivativeComputeShaderUniformLocations[11];
+		GLhandleARB stepSizeComputeShader; // Compute shader to reduce the work groups' maximum step sizes and advance the step state
+		GLint stepSizeComputeShaderUniformLocations[9];
+		GLhandleARB rungeKuttaComputeShader; // Compute shader to perform the Euler and Runge-Kutta integration steps, the boundary conditions, and the snow updates
+		GLint rungeKuttaComputeShaderUniformLocations[19];
+		GLuint activityTextureObject; // One-component color texture object flagging 4x4 blocks of cells containing water, snow, or added water
+		GLuint activeTileTextureObject; // One-component color texture object flagging active 16x16 tiles of cells, whose temporal derivatives are calculated
+		unsigned int numStepsSinceActiveTileUpdate; // Number of integration steps since the active tiles were last updated
+		GLuint activeTileDepthBufferObject; // Render buffer holding the active tiles as depths to restrict the fragment shader derivative passes to active tiles
+		GLuint activityFramebufferObject; // Frame buffer used to flag active blocks of cells
+		GLuint activeTileFramebufferObject; // Frame buffer used to flag active tiles
+		GLhandleARB activityShader; // Shader to flag 4x4 blocks of cells containing water, snow, or added water
+		GLint activityShaderUniformLocations[7];
+		GLhandleARB activeTileShader; // Shader to flag tiles containing or adjacent to active blocks of cells
+		GLint activeTileShaderUniformLocations[2];
+		GLhandleARB activeTileDepthShader; // Shader to write the active tiles into the active tile depth buffer
+		GLint activeTileDepthShaderUniformLocations[1];
+		bool haveFenceSync; // Flag whether this OpenGL context supports fence sync objects
+		GLuint publishedTextureObjects[3][3]; // Bathymetry, conserved quantity, and snow texture objects of the three published state slots if this context publishes simulation states
+		GLuint publishFramebufferObject; // Frame buffer used to copy the simulation state into a published state slot
+		bool usePublishedState; // Flag whether this context binds the most recently published simulation state instead of its own simulation state
+		GLsizei gridSize[2]; // Width and height of the grids in this OpenGL context
+		unsigned int gridVersion; // Version number of the water table size for which the grids in this OpenGL context were created
+		unsigned int restoreVersion; // Version number of the most recent simulation state restored into this OpenGL context
 
 		/* Constructors and destructors: */
 		DataItem(void);
 		virtual ~DataItem(void);
+		
+		/* Methods: */
+		void deleteGrids(void); // Deletes all textures, render buffers, and frame buffers whose size depends on the water table size
+		};
+	
+	struct PublishedState // Structure holding a copy of the simulation state handed off from a simulation context to a render context sharing its objects
+		{
+		/* Elements: */
+		public:
+		GLuint bathymetryTextureObject; // Copy of the bathymetry grid
+		GLuint quantityTextureObject; // Copy of the conserved quantity grid
+		GLuint snowTextureObject; // Copy of the snow grid
+		GLsync publishFence; // Fence signalled when the simulation context has finished copying the state
+		GLsync releaseFence; // Fence signalled when the render context has finished its last use of the state
+		
+		/* Constructors and destructors: */
+		PublishedState(void)
+			:bathymetryTextureObject(0),quantityTextureObject(0),snowTextureObject(0),
+			 publishFence(0),releaseFence(0)
+			{
+			}
 		};
 	
    
@@ -114,6 +188,7 @@ class WaterTable2:public GLObject
 	/* Elements: */
 
 	GLsizei size[2]; // Width and height of water table in pixels
+	unsigned int gridVersion; // Version number of the water table size, incremented whenever the size changes
 	const DepthImageRenderer* depthImageRenderer; // Renderer object used to update the water table's bathymetry grid
 	ONTransform baseTransform; // Transformation from camera space to upright elevation map space
 	//Box domain; // Domain of elevation map space in rotated camera space
@@ -128,13 +203,43 @@ class WaterTable2:public GLObject
 	GLfloat maxStepSize; // Maximum step size for each Runge-Kutta integration step
 	PTransform waterTextureTransform; // Projective transformation from camera space to water level texture space
 	GLfloat waterTextureTransformMatrix[16]; // Same in GLSL-compatible format
-	std::vector<const AddWaterFunction*> renderFunctions; // A list of functions that are called after each water flow simulation step to locally add or remove water from the water table
+	mutable Threads::Mutex renderFunctionsMutex; // Mutex serializing changes to the list of render functions against simulation steps running on a simulation thread
+	std::vector<const AddWaterFunction*> renderFunctions; // A list of functions that are called to render the rates at which water is locally added to or removed from the water table
 	GLfloat waterDeposit; // A fixed amount of water added at every iteration of the flow simulation, for evaporation etc.
+	unsigned int waterSourceVersion; // Version number of the water sources and sinks, incremented whenever the render functions, their geometry, or the water deposit change
 	bool dryBoundary; // Flag whether to enforce dry boundary conditions at the end of each simulation step
+	bool snowEnabled; // Flag whether to update snow and freeze water together with Runge-Kutta integration steps
+	GLfloat criticalHeight; // Elevation above which water freezes into snow
+	GLfloat meltRate; // Rate at which snow below the critical height melts, as the fraction melting per unit of simulation time in units of 1/100000
+	unsigned int snowStepInterval; // Number of integration steps between snow updates
+	double snowUpdateInterval; // Wall-clock time in seconds between snow updates; overrides the step interval if positive
+	bool fuseSnowStep; // Flag whether to update snow in the same fragment shader pass as the Runge-Kutta integration step in OpenGL contexts that support it
+	bool useComputeShaders; // Flag whether to run the solver on OpenGL 4.3 compute shaders in OpenGL contexts that support them
+	StorageFormat storageFormat; // Storage format of the conserved quantity, temporal derivative, and snow grids
+	bool sparseSimulation; // Flag whether to skip temporal derivatives on tiles of cells that are dry and not adjacent to water, snow, or added water
+	GLfloat wetThreshold; // Water column height above which a cell counts as wet for sparse simulation
+	mutable Threads::TripleBuffer<PublishedState> publishedStates; // Triple buffer handing off copies of the simulation state from a simulation context to a render context
+	const StageTimers* stageTimers; // Timer set measuring the simulation passes, or null
+	mutable Threads::Mutex restoreMutex; // Mutex protecting the simulation state to be restored against simulation steps running on a simulation thread
+	GLsizei restoreSize[2]; // Width and height of the grids of the simulation state to be restored
+	std::vector<GLfloat> restoreGrids[3]; // Bathymetry, conserved quantity, and snow grids of the simulation state to be restored into each OpenGL context
+	unsigned int restoreVersion; // Version number of the most recently requested simulation state restore
 	
 	/* Private methods: */
 	void calcTransformations(void); // Calculates derived transformations
-	GLfloat calcDerivative(DataItem* dataItem,GLuint quantityTextureObject,bool calcMaxStepSize) const; // Calculates the temporal derivative of the conserved quantities in the given texture object and returns maximum step size if flag is true
+	DataItem* getDataItem(GLContextData& contextData) const; // Returns the data item of the given OpenGL context, after resampling its grids to the current water table size if the size changed
+	void createGrids(DataItem* dataItem) const; // Creates the grids and their frame buffers in the given OpenGL context at the current water table size
+	void setPixelScale(DataItem* dataItem) const; // Maps the current water table size to pixel space in all shaders of the given OpenGL context
+	void updateActiveTiles(DataItem* dataItem) const; // Flags the tiles on which subsequent integration steps calculate temporal derivatives
+	void calcDerivative(DataItem* dataItem,GLuint quantityTextureObject,bool calcMaxStepSize,GLContextData& contextData) const; // Calculates the temporal derivative of the conserved quantities in the given texture object on active tiles and reduces the maximum step size into a single pixel if flag is true
+	void resetStepState(DataItem* dataItem,GLfloat timeBudget) const; // Starts a new step state with the given remaining time
+	void calcStepSize(DataItem* dataItem,bool useReducedStepSize) const; // Selects the next step size on the GPU from the maximum step size, the reduced maximum step size if flag is true, and the remaining time
+	bool isSnowUpdateDue(DataItem* dataItem) const; // Returns true if the next integration step updates snow according to the snow schedule
+	void bindSnowStepShader(DataItem* dataItem,GLhandleARB shader,const GLint uniformLocations[12]) const; // Installs the given Runge-Kutta snow step shader and binds its uniform variables and textures
+	void runFragmentStages(DataItem* dataItem,bool forceStepSize,GLContextData& contextData) const; // Runs the derivative, step size selection, and integration stages of a water flow simulation step as fragment shader passes
+	void runComputeStages(DataItem* dataItem,bool forceStepSize,GLContextData& contextData) const; // Runs the derivative, step size selection, and integration stages of a water flow simulation step as three tiled compute shader passes
+	void runStep(DataItem* dataItem,bool forceStepSize,GLContextData& contextData) const; // Runs a water flow simulation step whose step size stays on the GPU
+	void uploadRestoredState(DataItem* dataItem) const; // Replaces the given context's simulation state with the most recently requested restored state once the grids have its size; must be called with restoreMutex locked
 	
 	/* Constructors and destructors: */
 	public:
@@ -148,8 +253,6 @@ class WaterTable2:public GLObject
 	
 	/* Methods from GLObject: */
 	virtual void initContext(GLContextData& contextData) const;
-	float criticalHeight=0.0; // Snow Support
-	float meltRate=0.0; // Snow Support
 
 	/* New methods: */
 	const GLsizei* getSize(void) const // Returns the size of the water table
@@ -176,9 +279,17 @@ class WaterTable2:public GLObject
 		{
 		return dryBoundary;
 		}
-	IO::FileMonitor fileMonitor; // Monitor to watch the critical height external file
-	void snowConfigurationCallback(const IO::FileMonitor::Event& event);
+	GLfloat getCriticalHeight(void) const // Returns the elevation above which water freezes into snow
+		{
+		return criticalHeight;
+		}
+	GLfloat getMeltRate(void) const // Returns the rate at which snow below the critical height melts
+		{
+		return meltRate;
+		}
+	void setSnowParameters(GLfloat newCriticalHeight,GLfloat newMeltRate); // Sets the critical height and the snow melt rate
 
+	void setGridSize(GLsizei newWidth,GLsizei newHeight); // Changes the size of the water table in pixels while keeping its domain; each OpenGL context resamples its water and snow state to the new size on its next use; must not be called while simulation states are published
 	void setElevationRange(Scalar newMin,Scalar newMax); // Sets the range of possible elevations in the water table
 	void setAttenuation(GLfloat newAttenuation); // Sets the attenuation factor for partial discharges
 	void setMaxStepSize(GLfloat newMaxStepSize); // Sets the maximum step size for all subsequent integration steps
@@ -188,19 +299,63 @@ class WaterTable2:public GLObject
 		}
 	void addRenderFunction(const AddWaterFunction* newRenderFunction); // Adds a render function to the list; object remains owned by caller
 	void removeRenderFunction(const AddWaterFunction* removeRenderFunction); // Removes the given render function from the list but does not delete it
+	void updateWaterSources(void); // Notifies the water table that the geometry rendered by the render functions changed; each OpenGL context calls them again on its next simulation step instead of re-applying its previous water sources
 	GLfloat getWaterDeposit(void) const // Returns the current amount of water deposited on every simulation step
 		{
 		return waterDeposit;
 		}
 	void setWaterDeposit(GLfloat newWaterDeposit); // Sets the amount of deposited water
 	void setDryBoundary(bool newDryBoundary); // Enables or disables enforcement of dry boundaries
+	bool getSnowEnabled(void) const // Returns true if snow is updated during simulation steps
+		{
+		return snowEnabled;
+		}
+	void setSnowEnabled(bool newSnowEnabled); // Enables or disables the snow and freeze updates
+	unsigned int getSnowStepInterval(void) const // Returns the number of integration steps between snow updates
+		{
+		return snowStepInterval;
+		}
+	void setSnowStepInterval(unsigned int newSnowStepInterval); // Updates snow every given number of integration steps
+	double getSnowUpdateInterval(void) const // Returns the wall-clock time between snow updates, or zero if snow updates follow the step interval
+		{
+		return snowUpdateInterval;
+		}
+	void setSnowUpdateInterval(double newSnowUpdateInterval); // Updates snow at most once per given wall-clock time in seconds, or every snow step interval steps if not positive
+	bool getFuseSnowStep(void) const // Returns true if snow is updated in the same pass as the Runge-Kutta integration step where supported
+		{
+		return fuseSnowStep;
+		}
+	void setFuseSnowStep(bool newFuseSnowStep); // Updates snow in the same pass as the Runge-Kutta integration step where supported, or in separate snow and freeze passes
+	bool getUseComputeShaders(void) const // Returns true if the solver is requested to run on compute shaders
+		{
+		return useComputeShaders;
+		}
+	void setUseComputeShaders(bool newUseComputeShaders); // Requests running the solver on compute shaders where supported; must be called before the water table is initialized in any OpenGL context
+	bool isUsingComputeShaders(GLContextData& contextData) const; // Returns true if the solver runs on compute shaders in the given OpenGL context
+	StorageFormat getStorageFormat(void) const // Returns the storage format of the conserved quantity, temporal derivative, and snow grids
+		{
+		return storageFormat;
+		}
+	void setStorageFormat(StorageFormat newStorageFormat); // Sets the storage format of the conserved quantity, temporal derivative, and snow grids; must be called before the water table is initialized in any OpenGL context
+	bool getSparseSimulation(void) const // Returns true if the simulation skips dry tiles of cells
+		{
+		return sparseSimulation;
+		}
+	void setSparseSimulation(bool newSparseSimulation); // Enables or disables skipping dry tiles of cells that are not adjacent to water, snow, or added water
+	void setStageTimers(const StageTimers* newStageTimers); // Measures the GPU time of the simulation passes and bathymetry updates with the given timer set, or stops measuring if null
 	void updateBathymetry(GLContextData& contextData) const; // Prepares the water table for subsequent calls to the runSimulationStep() method
 	void updateBathymetry(const GLfloat* bathymetryGrid,GLContextData& contextData) const; // Updates the bathymetry directly with a vertex-centered elevation grid of grid size minus 1
 	void setWaterLevel(const GLfloat* waterGrid,GLContextData& contextData) const; // Sets the current water level to the given grid, and resets flux components to zero
+	void restoreState(const GLsizei stateSize[2],const GLfloat* bathymetryGrid,const GLfloat* quantityGrid,const GLfloat* snowGrid); // Copies a complete simulation state of the given grid size, which each OpenGL context uploads in place of its own state before its next bathymetry update
 	GLfloat runSimulationStep(bool forceStepSize,GLContextData& contextData) const; // Runs a water flow simulation step, always uses maxStepSize if flag is true (may lead to instability); returns step size taken by Runge-Kutta integration step
+	bool queueSimulationSteps(GLfloat totalTimeStep,unsigned int numSteps,GLContextData& contextData,GLfloat& lastRemainingTime,unsigned int& lastNumSteps) const; // Queues the given number of water flow simulation steps to advance by the given total time without waiting for the GPU; steps after the total time is used up do not advance; returns true and the time left over and number of advancing steps of the previous call if they were read back
+	bool queueVolumeReduction(GLContextData& contextData,GLfloat lastVolumes[3]) const; // Queues a reduction of the current total snowpack, melt water released by the last snow update, and free water volumes without waiting for the GPU; returns true and the volumes reduced by the previous call if they were read back
+	void publishState(GLContextData& contextData) const; // Copies the current bathymetry, conserved quantity, and snow grids of the given simulation context into the next published state; only one context may publish states
+	void lockNewPublishedState(GLContextData& contextData) const; // Releases the published state used by the given render context, which must share objects with the publishing context, and makes it bind the most recently published state from now on
 	void bindBathymetryTexture(GLContextData& contextData) const; // Binds the bathymetry texture object to the active texture unit
 	void bindQuantityTexture(GLContextData& contextData) const; // Binds the most recent conserved quantities texture object to the active texture unit
-	void bindSnowTexture(GLContextData& contextData) const; //Binds snow texture object, Snow Support
+	void bindSnowTexture(GLContextData& contextData) const; // Binds the most recent snow texture object to the active texture unit
+	bool bindActiveTileTexture(GLContextData& contextData) const; // Binds the active tile texture object, with one texel per 16x16 tile of cells that is non-zero for tiles that contain or are adjacent to water, snow, or added water, to the active texture unit; returns false and binds nothing if the given context does not run a sparse simulation itself
 	void uploadWaterTextureTransform(GLint location) const; // Uploads the water texture transformation into the GLSL 4x4 matrix at the given uniform location
 	GLsizei getBathymetrySize(int index) const // Returns the width or height of the bathymetry grid
 		{
@@ -0,0 +1,32 @@
+/***********************************************************************
+DepthExpandShader - Shader to expand a 16-bit fixed-point depth image
+into a floating-point depth image.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect fixedDepthSampler; // Fixed-point depth image, normalized to [0, 1]
+uniform float depthRange; // Depth value represented by the largest fixed-point value
+
+void main()
+	{
+	/* Scale the normalized fixed-point depth value back to the depth range: */
+	gl_FragColor=vec4(texture2DRect(fixedDepthSampler,gl_FragCoord.xy).r*depthRange,0.0,0.0,0.0);
+	}
@@ -0,0 +1,48 @@
+/***********************************************************************
+DepthSpatialFilterShader - Shader to run one pass of a separable 1-2-1
+low-pass filter over a depth image, along either rows or columns.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect depthSampler; // Depth image to be filtered
+uniform vec2 filterStep; // Offset to the next pixel along the filter direction; (1, 0) for rows, (0, 1) for columns
+uniform vec2 imageSize; // Size of the depth image in pixels
+
+void main()
+	{
+	/* Get the depth values of this pixel and its two neighbors along the filter direction: */
+	vec2 prevCoord=gl_FragCoord.xy-filterStep;
+	vec2 nextCoord=gl_FragCoord.xy+filterStep;
+	float center=texture2DRect(depthSampler,gl_FragCoord.xy).r;
+	bool havePrev=prevCoord.x>0.0&&prevCoord.y>0.0;
+	bool haveNext=nextCoord.x<imageSize.x&&nextCoord.y<imageSize.y;
+	
+	/* Apply the filter, renormalizing the weights at the image boundaries: */
+	float result=center;
+	if(havePrev&&haveNext)
+		result=(texture2DRect(depthSampler,prevCoord).r+center*2.0+texture2DRect(depthSampler,nextCoord).r)*0.25;
+	else if(haveNext)
+		result=(center*2.0+texture2DRect(depthSampler,nextCoord).r)/3.0;
+	else if(havePrev)
+		result=(texture2DRect(depthSampler,prevCoord).r+center*2.0)/3.0;
+	
+	gl_FragColor=vec4(result,0.0,0.0,0.0);
+	}
@@ -0,0 +1,105 @@
+/***********************************************************************
+DepthTemporalFilterShader - Shader to enter a new raw depth frame into
+per-pixel running averages, and to calculate a filtered depth image
+from all stable pixels.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect rawDepthSampler; // New raw depth frame as normalized 16-bit values
+uniform sampler2DRect depthCorrectionSampler; // Per-pixel depth correction scale and offset
+uniform sampler2DRect oldSampleSampler; // Averaging slot about to be replaced, as normalized 16-bit values
+uniform sampler2DRect statSampler; // Per-pixel number of samples, sum of samples, and split sum of squares
+uniform sampler2DRect validSampler; // Most recent stable depth value of each pixel
+uniform vec4 minPlane; // Plane equation of the lower bound of valid depth values in depth image space
+uniform vec4 maxPlane; // Plane equation of the upper bound of valid depth values in depth image space
+uniform float minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
+uniform float maxVariance; // Maximum variance to consider a pixel stable
+uniform float hysteresis; // Amount by which a new filtered value has to differ from the current value to update
+uniform bool retainValids; // Flag whether to retain previous stable values for instable pixels
+uniform float instableValue; // Value to assign to instable pixels if retainValids is false
+
+const float rawScale=65535.0; // Scale factor from normalized 16-bit values to raw depth values
+const float invalidSample=65535.0; // Marker for invalid samples in the averaging slots
+
+vec4 sampleStats(float value)
+	{
+	/* Split the sample's square into a multiple of 4096 and a remainder, so that sums of both stay exact in single precision: */
+	float a=floor(value/64.0);
+	float b=value-a*64.0;
+	float ab=a*b;
+	float abHigh=floor(ab/32.0);
+	return vec4(1.0,value,a*a+abHigh,(ab-abHigh*32.0)*128.0+b*b);
+	}
+
+void main()
+	{
+	/* Read and depth-correct the new raw depth value: */
+	float newVal=floor(texture2DRect(rawDepthSampler,gl_FragCoord.xy).r*rawScale+0.5);
+	vec2 dc=texture2DRect(depthCorrectionSampler,gl_FragCoord.xy).rg;
+	float newCVal=newVal*dc.x+dc.y;
+	
+	/* Read the averaging slot to be replaced and the pixel's statistics: */
+	float oldVal=floor(texture2DRect(oldSampleSampler,gl_FragCoord.xy).r*rawScale+0.5);
+	vec4 stats=texture2DRect(statSampler,gl_FragCoord.xy);
+	float slot=oldVal;
+	
+	/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
+	vec4 pixel=vec4(gl_FragCoord.xy,newCVal,1.0);
+	if(dot(minPlane,pixel)>=0.0&&dot(maxPlane,pixel)<=0.0)
+		{
+		/* Replace the old sample with the new one: */
+		if(oldVal!=invalidSample)
+			stats-=sampleStats(oldVal);
+		stats+=sampleStats(newVal);
+		slot=newVal;
+		}
+	else if(!retainValids)
+		{
+		/* Replace the old sample with an invalid one: */
+		if(oldVal!=invalidSample)
+			stats-=sampleStats(oldVal);
+		slot=invalidSample;
+		}
+	
+	/* Check if the pixel is considered "stable": */
+	float valid=texture2DRect(validSampler,gl_FragCoord.xy).r;
+	float result=valid;
+	float sumSquares=stats.z*4096.0+stats.w;
+	if(stats.x>=minNumSamples&&sumSquares*stats.x<=maxVariance*stats.x*stats.x+stats.y*stats.y)
+		{
+		/* Check if the new depth-corrected running mean is outside the previous value's envelope: */
+		float newFiltered=(stats.y/stats.x)*dc.x+dc.y;
+		if(abs(newFiltered-valid)>=hysteresis)
+			valid=newFiltered;
+		result=valid;
+		}
+	else if(!retainValids)
+		{
+		/* Assign default value to instable pixels: */
+		result=instableValue;
+		}
+	
+	/* Write the new averaging slot, statistics, stable value, and filtered depth value; bias the slot value to survive truncation: */
+	gl_FragData[0]=vec4((slot+0.25)/rawScale,0.0,0.0,0.0);
+	gl_FragData[1]=stats;
+	gl_FragData[2]=vec4(valid,0.0,0.0,0.0);
+	gl_FragData[3]=vec4(result,0.0,0.0,0.0);
+	}
@@ -0,0 +1,86 @@
+/***********************************************************************
+HillshadeMapShader - Shader to calculate the sun visibility and ambient
+occlusion of each pixel of the surface in depth image space.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect depthSampler; // Sampler for the depth image-space elevation texture
+uniform vec2 depthImageSize; // Width and height of the depth image
+uniform mat4 depthProjection; // Transformation from depth image space to camera space
+uniform mat4 depthProjectionInverse; // Transformation from camera space to depth image space
+uniform vec4 basePlane; // Plane equation of the base plane in camera space, with normalized normal vector
+uniform vec3 sunDirection; // Normalized direction towards the sun in camera space
+uniform float shadowDistance; // Maximum distance from a surface point to a shadow caster in camera-space units
+uniform float aoRadius; // Radius of the ambient occlusion neighborhood in depth image pixels
+
+vec3 surfacePoint(in vec2 dic)
+	{
+	/* Unproject the surface point at the given depth image-space position into camera space: */
+	vec4 pointCc=depthProjection*vec4(dic,texture2DRect(depthSampler,dic).r,1.0);
+	return pointCc.xyz/pointCc.w;
+	}
+
+void main()
+	{
+	/* Get the fragment's surface point: */
+	vec3 p=surfacePoint(gl_FragCoord.xy);
+	
+	/* March a ray towards the sun with increasing step sizes, and track how deeply it passes below the surface as a soft shadow term: */
+	float visibility=1.0;
+	for(int i=1;i<=24;++i)
+		{
+		/* Move the ray sample into depth image space and stop at the edge of the depth image: */
+		float t=shadowDistance*float(i*i)/576.0;
+		vec3 q=p+sunDirection*t;
+		vec4 qDic=depthProjectionInverse*vec4(q,1.0);
+		vec2 sDic=qDic.xy/qDic.w;
+		if(any(lessThan(sDic,vec2(0.0)))||any(greaterThan(sDic,depthImageSize)))
+			break;
+		
+		/* Compare the ray sample's elevation to the elevation of the surface below it: */
+		float clearance=dot(basePlane.xyz,q-surfacePoint(sDic));
+		visibility=min(visibility,smoothstep(-0.05*t,0.05*t,clearance));
+		}
+	
+	/* Find the horizon in eight directions around the surface point to estimate its ambient occlusion: */
+	float occlusion=0.0;
+	for(int d=0;d<8;++d)
+		{
+		float angle=float(d)*0.7853982;
+		vec2 dir=vec2(cos(angle),sin(angle))*(aoRadius*0.25);
+		float maxSlope=0.0;
+		for(int r=1;r<=4;++r)
+			{
+			/* Calculate the slope from the surface point to the neighbor: */
+			vec3 ds=surfacePoint(gl_FragCoord.xy+dir*float(r))-p;
+			float height=dot(basePlane.xyz,ds);
+			float distance=length(ds-basePlane.xyz*height);
+			if(distance>0.0)
+				maxSlope=max(maxSlope,height/distance);
+			}
+		
+		/* Accumulate the sine of the horizon angle: */
+		occlusion+=maxSlope*inversesqrt(1.0+maxSlope*maxSlope);
+		}
+	
+	/* Store the sun visibility and the unoccluded fraction of the sky: */
+	gl_FragColor=vec4(visibility,1.0-occlusion*0.125,0.0,1.0);
+	}
@@ -1,49 +1,83 @@
-/*Shader to add the amount of snow to the snow shader from the quantity shader*/
- 
+/***********************************************************************
+SnowShader - Shader to update the snow grid in a separate
+pass after a Runge-Kutta integration step, for OpenGL contexts that
+cannot write the snow grid together with the conserved quantities. It
+repeats the Runge-Kutta step, snow melt, and dry boundary calculations
+of FreezeShader, which writes the matching conserved quantities.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
 #extension GL_ARB_texture_rectangle : enable
 
+uniform sampler2DRect stepStateSampler;
+uniform sampler2DRect snowClockSampler;
 uniform float criticalHeight;
 uniform float meltRate;
-uniform sampler2DRect snowSampler;
+uniform bool dryBoundary;
+uniform vec2 gridSize;
 uniform sampler2DRect quantitySampler;
+uniform sampler2DRect quantityStarSampler;
+uniform sampler2DRect derivativeSampler;
+uniform sampler2DRect snowSampler;
 uniform sampler2DRect bathymetrySampler;
 
-
 void main()
 	{
-	/*Calculate if surface height is higher than a given value*/
-	vec3 snowAmt = (0.0,0.0,0.0);
-	//float holdMelt;
-
+	/* Retrieve the step size from the step state, and the simulation time advanced since the previous snow update from the snow clock: */
+	float stepSize=texture2DRect(stepStateSampler,vec2(0.5,0.5)).r;
+	float snowTime=texture2DRect(snowClockSampler,vec2(0.5,0.5)).g;
+	
+	/* Calculate the new water surface height of the Runge-Kutta step, keeping it in steps that do not advance: */
+	float newW=texture2DRect(quantitySampler,gl_FragCoord.xy).r;
+	if(stepSize>0.0)
+		newW=(newW+texture2DRect(quantityStarSampler,gl_FragCoord.xy).r+texture2DRect(derivativeSampler,gl_FragCoord.xy).r*stepSize)*0.5;
+	
+	/* Calculate the bathymetry elevation at the center of this cell: */
 	float B=(texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y-1.0)).r+
 	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x,gl_FragCoord.y-1.0)).r+
 	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y)).r+
 	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.xy)).r)*0.25;
 	
-	vec3 q=texture2DRect(quantitySampler,gl_FragCoord.xy).rgb;
-	float w = q.r;
-	vec3 snow = texture2DRect(snowSampler, gl_FragCoord.xy).rgb;
-	float snowMelt = meltRate/100000;
-
-	if(B >= criticalHeight){  // Above critical height
-		snowAmt.r = snow.r + (w-B);
-		}
-	else{  // Below critial height
-		snowAmt.r = snow.r; 
-
-		//Melt if statement
-		if(snowAmt.r > 0.0001)
+	/* Calculate the snow melted during the simulation time since the previous snow update; the melt rate is the fraction melting per unit of simulation time in units of 1/100000: */
+	float snow=texture2DRect(snowSampler,gl_FragCoord.xy).r;
+	float meltedSnow=snow-snow*pow(1.0-meltRate/100000.0,snowTime);
+	
+	/* Enforce dry boundaries on the outermost layer of cells: */
+	if(dryBoundary&&(gl_FragCoord.x<1.0||gl_FragCoord.y<1.0||gl_FragCoord.x>gridSize.x-1.0||gl_FragCoord.y>gridSize.y-1.0))
+		newW=B;
+	
+	/* Accumulate water above the critical height as snow, and melt snow below it, if the simulation advanced since the previous snow update: */
+	float newSnow=snow;
+	float newMelt=0.0;
+	if(snowTime>0.0)
 		{
-			snowAmt.b = snow.r *snowMelt; //0.00005;
-			snowAmt.g = snow.g + snowAmt.b;
-			snowAmt.r = snowAmt.r - snowAmt.g;
-		}
+		if(B>=criticalHeight)
+			newSnow=snow+(newW-B);
+		else if(snow>0.0001)
+			{
+			newSnow=snow-meltedSnow;
+			newMelt=meltedSnow;
+			}
 		else
-		{
-			snowAmt.r = 0.0; //sets to 0 to prevent infintely small snow
-			//snowAmt.g = 0.0;
-		}
+			newSnow=0.0; // Prevent infinitely small snow
 		}
 	
-	gl_FragColor=vec4(snowAmt,0.0);
-	}
\ No newline at end of file
+	/* Write the new snow amount with the melt water it released: */
+	gl_FragColor=vec4(newSnow,newMelt,0.0,0.0);
+	}
@@ -0,0 +1,32 @@
+/***********************************************************************
+Water2ActiveTileDepthShader - Shader to write the active tiles into a
+depth buffer, such that early depth tests restrict subsequent passes to
+cells of active tiles.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect activeTileSampler;
+
+void main()
+	{
+	/* Let passes rendered at mid depth through on active tiles only: */
+	gl_FragDepth=texture2DRect(activeTileSampler,floor(gl_FragCoord.xy/16.0)+vec2(0.5,0.5)).r>0.0?1.0:0.0;
+	}
@@ -0,0 +1,45 @@
+/***********************************************************************
+Water2ActiveTileShader - Shader to flag 16x16 tiles of cells as active
+if they or any of their eight neighbors contain an active 4x4 block of
+cells, so water cannot leave the active tiles between updates.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform vec2 blockSize;
+uniform sampler2DRect activitySampler;
+
+void main()
+	{
+	/* Calculate the base position of the 12x12 blocks covering this tile and its neighbors: */
+	vec2 base=floor(gl_FragCoord.xy)*4.0-vec2(3.5,3.5);
+	
+	/* Flag the tile if any of the blocks inside the block grid are active: */
+	float active=0.0;
+	for(int y=0;y<12;++y)
+		for(int x=0;x<12;++x)
+			{
+			vec2 block=base+vec2(float(x),float(y));
+			if(block.x>0.0&&block.y>0.0&&block.x<blockSize.x&&block.y<blockSize.y)
+				active=max(active,texture2DRect(activitySampler,block).r);
+			}
+	
+	gl_FragColor=vec4(active,0.0,0.0,0.0);
+	}
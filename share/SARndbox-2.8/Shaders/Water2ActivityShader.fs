@@ -0,0 +1,64 @@
+/***********************************************************************
+Water2ActivityShader - Shader to flag 4x4 blocks of cells containing
+water, snow, or water added by rain sources, as the first step of
+finding the active tiles of the water simulation.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform vec2 gridSize;
+uniform float wetThreshold;
+uniform bool useWaterSampler;
+uniform sampler2DRect bathymetrySampler;
+uniform sampler2DRect quantitySampler;
+uniform sampler2DRect snowSampler;
+uniform sampler2DRect waterSampler;
+
+bool isActive(vec2 cell)
+	{
+	/* Calculate the bathymetry elevation at the center of the cell: */
+	float b=(texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y-1.0)).r+
+	         texture2DRect(bathymetrySampler,vec2(cell.x,cell.y-1.0)).r+
+	         texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y)).r+
+	         texture2DRect(bathymetrySampler,cell).r)*0.25;
+	
+	/* Check for water, snow, or water being added to the cell: */
+	if(texture2DRect(quantitySampler,cell).r-b>wetThreshold||texture2DRect(snowSampler,cell).r>0.0001)
+		return true;
+	return useWaterSampler&&texture2DRect(waterSampler,cell).r>0.0;
+	}
+
+void main()
+	{
+	/* Calculate the base position of a 4x4 block of cells: */
+	vec2 base=floor(gl_FragCoord.xy)*4.0+vec2(0.5,0.5);
+	
+	/* Flag the block if any of its cells inside the grid are active: */
+	float active=0.0;
+	for(int y=0;y<4;++y)
+		for(int x=0;x<4;++x)
+			{
+			vec2 cell=base+vec2(float(x),float(y));
+			if(cell.x<gridSize.x&&cell.y<gridSize.y&&isActive(cell))
+				active=1.0;
+			}
+	
+	gl_FragColor=vec4(active,0.0,0.0,0.0);
+	}
@@ -0,0 +1,310 @@
+/***********************************************************************
+Water2EulerAndRungeKuttaStepShader - Compute shader to perform the
+tentative Euler step, the temporal derivative of its result, the final
+Runge-Kutta integration step, the dry boundary conditions, and
+optionally the snow accumulation, snow melt, and freeze updates in a
+single pass, by keeping 16x16 tiles of tentative quantities with
+two-cell halos in shared memory. Work groups on inactive tiles skip the
+temporal derivative of the tentative quantities.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#version 430
+
+layout(local_size_x=16,local_size_y=16) in;
+
+uniform vec2 cellSize;
+uniform float theta;
+uniform float g;
+uniform float epsilon;
+uniform ivec2 gridSize;
+uniform float attenuation;
+uniform bool dryBoundary;
+uniform bool updateSnow;
+uniform float criticalHeight;
+uniform float meltRate;
+uniform sampler2DRect bathymetrySampler;
+uniform sampler2DRect quantitySampler;
+uniform sampler2DRect derivativeSampler;
+uniform sampler2DRect stepStateSampler;
+uniform sampler2DRect snowSampler;
+uniform sampler2DRect snowClockSampler;
+uniform sampler2DRect activeTileSampler;
+uniform writeonly image2DRect quantityImage; // Writes take the storage format the image is bound with
+uniform writeonly image2DRect snowImage; // Ditto
+
+/* Work group's tiles of tentative cell-centered quantities after the Euler step and of vertex-centered bathymetry elevations, including halos: */
+shared vec3 qTile[20][20];
+shared float bTile[19][19];
+
+/* Access to tiles relative to the invocation's cell: */
+#define Q(dx,dy) qTile[cell.y+2+(dy)][cell.x+2+(dx)]
+#define B(dx,dy) bTile[cell.y+2+(dy)][cell.x+2+(dx)]
+
+vec3 calcSlope(in vec3 q0,in vec3 q1,in vec3 q2,in float cellSize,in float b0,in float b1)
+	{
+	/* Calculate the left, central, and right differences: */
+	vec3 d01=(q1-q0)*(theta/cellSize);
+	vec3 d02=(q2-q0)/(2.0*cellSize);
+	vec3 d12=(q2-q1)*(theta/cellSize);
+	
+	/* Calculate the component-wise intervals: */
+	vec3 dMin=min(min(d01,d02),d12);
+	vec3 dMax=max(max(d01,d02),d12);
+	
+	/* Calculate the minmod-limited slope: */
+	vec3 slope;
+	slope.x=dMin.x>0.0?dMin.x:dMax.x<0.0?dMax.x:0.0;
+	slope.y=dMin.y>0.0?dMin.y:dMax.y<0.0?dMax.y:0.0;
+	slope.z=dMin.z>0.0?dMin.z:dMax.z<0.0?dMax.z:0.0;
+	
+	/* Check the calculated slope against the left and right face-centered bathymetry values: */
+	if(q1.x-slope.x*cellSize*0.5<b0)
+		slope.x=(q1.x-b0)/(cellSize*0.5);
+	if(q1.x+slope.x*cellSize*0.5<b1)
+		slope.x=(b1-q1.x)/(cellSize*0.5);
+	
+	/* Return the adjusted slope: */
+	return slope;
+	}
+
+vec2 calcUv(inout vec3 q,in float h)
+	{
+	/* Calculate velocity using a desingularizing division operator: */
+	float h4=h*h*h*h;
+	vec2 uv=q.yz*(1.41421356237309*h/sqrt(h4+max(h4,epsilon)));
+	
+	/* Recalculate discharge based on desingularized velocity: */
+	q.yz=uv*h;
+	
+	return uv;
+	}
+
+float calcPartialFluxX(in vec3 qe,in vec3 qw,in float bew,out vec3 fluxX)
+	{
+	/* Calculate one-sided water column heights: */
+	float he=max(qe.x-bew,0.0);
+	float hw=max(qw.x-bew,0.0);
+	
+	/* Calculate one-sided velocities: */
+	vec2 uve=calcUv(qe,he);
+	vec2 uvw=calcUv(qw,hw);
+	
+	/* Calculate one-sided x-direction flux quadratures: */
+	vec3 fe=vec3(qe.y,uve.x*qe.y+0.5*g*he*he,uve.y*qe.y);
+	vec3 fw=vec3(qw.y,uvw.x*qw.y+0.5*g*hw*hw,uvw.y*qw.y);
+	
+	/* Calculate one-sided local speeds of propagation: */
+	float sghe=sqrt(g*he);
+	float sghw=sqrt(g*hw);
+	float ae=min(min(uve.x-sghe,uvw.x-sghw),0.0);
+	float aw=max(max(uve.x+sghe,uvw.x+sghw),0.0);
+	
+	/* Calculate complete x-direction flux: */
+	fluxX=aw-ae!=0.0?((fe*aw-fw*ae)+(qw-qe)*(aw*ae))/(aw-ae):vec3(0.0);
+	
+	/* Return maximum possible step size: */
+	return 0.5*cellSize.x/max(-ae,aw);
+	}
+
+float calcPartialFluxY(in vec3 qn,in vec3 qs,in float bns,out vec3 fluxY)
+	{
+	/* Calculate one-sided water column heights: */
+	float hn=max(qn.x-bns,0.0);
+	float hs=max(qs.x-bns,0.0);
+	
+	/* Calculate one-sided velocities: */
+	vec2 uvn=calcUv(qn,hn);
+	vec2 uvs=calcUv(qs,hs);
+	
+	/* Calculate one-sided y-direction flux quadratures: */
+	vec3 fn=vec3(qn.z,uvn.x*qn.z,uvn.y*qn.z+0.5*g*hn*hn);
+	vec3 fs=vec3(qs.z,uvs.x*qs.z,uvs.y*qs.z+0.5*g*hs*hs);
+	
+	/* Calculate one-sided local speeds of propagation: */
+	float sghn=sqrt(g*hn);
+	float sghs=sqrt(g*hs);
+	float an=min(min(uvn.y-sghn,uvs.y-sghs),0.0);
+	float as=max(max(uvn.y+sghn,uvs.y+sghs),0.0);
+	
+	/* Calculate complete y-direction flux: */
+	fluxY=as-an!=0.0?((fn*as-fs*an)+(qs-qn)*(as*an))/(as-an):vec3(0.0);
+	
+	/* Return maximum possible step size: */
+	return 0.5*cellSize.y/max(-an,as);
+	}
+
+float calcDerivative(in ivec2 cell,out vec3 derivative)
+	{
+	/* Calculate face-centered bathymetry elevations required for partial flux computations: */
+	float b0=(B(-1,-2)+B(0,-2))*0.5;
+	float b1=(B(-1,-1)+B(0,-1))*0.5;
+	float b2=(B(-2,-1)+B(-2,0))*0.5;
+	float b3=(B(-1,-1)+B(-1,0))*0.5;
+	float b4=(B(0,-1)+B(0,0))*0.5;
+	float b5=(B(1,-1)+B(1,0))*0.5;
+	float b6=(B(-1,0)+B(0,0))*0.5;
+	float b7=(B(-1,1)+B(0,1))*0.5;
+	
+	/* Get quantities required for partial flux computations: */
+	vec3 q1=Q(0,-1);
+	vec3 q3=Q(-1,0);
+	vec3 q4=Q(0,0);
+	vec3 q5=Q(1,0);
+	vec3 q7=Q(0,1);
+	
+	/* Calculate one-sided quantities required for partial flux computations: */
+	vec3 q1n=q1+calcSlope(Q(0,-2),q1,q4,cellSize.y,b0,b1)*(cellSize.y*0.5);
+	vec3 q3e=q3+calcSlope(Q(-2,0),q3,q4,cellSize.x,b2,b3)*(cellSize.x*0.5);
+	vec3 q4x=calcSlope(q3,q4,q5,cellSize.x,b3,b4)*(cellSize.x*0.5);
+	vec3 q4w=q4-q4x;
+	vec3 q4e=q4+q4x;
+	vec3 q4y=calcSlope(q1,q4,q7,cellSize.y,b1,b6)*(cellSize.y*0.5);
+	vec3 q4s=q4-q4y;
+	vec3 q4n=q4+q4y;
+	vec3 q5w=q5-calcSlope(q4,q5,Q(2,0),cellSize.x,b4,b5)*(cellSize.x*0.5);
+	vec3 q7s=q7-calcSlope(q4,q7,Q(0,2),cellSize.y,b6,b7)*(cellSize.y*0.5);
+	
+	/* Calculate partial fluxes across the cell's faces and the maximum possible step size for this cell: */
+	vec3 fluxXw,fluxXe,fluxYs,fluxYn;
+	float maxStepSize=min(min(calcPartialFluxX(q3e,q4w,b3,fluxXw),
+	                          calcPartialFluxX(q4e,q5w,b4,fluxXe)),
+	                      min(calcPartialFluxY(q1n,q4s,b1,fluxYs),
+	                          calcPartialFluxY(q4n,q7s,b6,fluxYn)));
+	
+	/* Calculate the water column height at the cell center: */
+	float h=max(q4.x-(b3+b4)*0.5,0.0);
+	
+	/* Calculate equation source terms at the cell center: */
+	vec3 source=vec3(0.0,-g*h*(b4-b3)/cellSize.x,-g*h*(b6-b1)/cellSize.y);
+	
+	/* Calculate the temporal derivative: */
+	derivative=source-(fluxXe-fluxXw)/cellSize.x-(fluxYn-fluxYs)/cellSize.y;
+	
+	return maxStepSize;
+	}
+
+void main()
+	{
+	/* Retrieve the step size from the step state: */
+	float stepSize=texelFetch(stepStateSampler,ivec2(0,0)).r;
+	float stepAttenuation=pow(attenuation,stepSize);
+	
+	/* Check whether the work group's tile is active, treating all tiles as inactive in steps that do not advance: */
+	bool activeTile=stepSize>0.0&&texelFetch(activeTileSampler,ivec2(gl_WorkGroupID.xy)).r>0.0;
+	
+	if(activeTile)
+		{
+		/* Perform the tentative Euler step on the work group's quantity tile, and load its bathymetry tile, clamping to the grids like texture lookups: */
+		ivec2 tileOrigin=ivec2(gl_WorkGroupID.xy)*16-ivec2(2,2);
+		for(int i=int(gl_LocalInvocationIndex);i<20*20;i+=256)
+			{
+			ivec2 t=ivec2(i%20,i/20);
+			ivec2 p=clamp(tileOrigin+t,ivec2(0,0),gridSize-ivec2(1,1));
+			vec3 qStar=texelFetch(quantitySampler,p).rgb+texelFetch(derivativeSampler,p).rgb*stepSize;
+			qStar.yz*=stepAttenuation;
+			qTile[t.y][t.x]=qStar;
+			}
+		for(int i=int(gl_LocalInvocationIndex);i<19*19;i+=256)
+			{
+			ivec2 t=ivec2(i%19,i/19);
+			bTile[t.y][t.x]=texelFetch(bathymetrySampler,clamp(tileOrigin+t,ivec2(0,0),gridSize-ivec2(2,2))).r;
+			}
+		}
+	barrier();
+	
+	/* Bail out if the invocation's cell is outside the grid: */
+	ivec2 cell=ivec2(gl_LocalInvocationID.xy);
+	ivec2 pos=ivec2(gl_GlobalInvocationID.xy);
+	if(pos.x>=gridSize.x||pos.y>=gridSize.y)
+		return;
+	
+	/* Perform the tentative Euler step on the invocation's cell: */
+	vec3 q=texelFetch(quantitySampler,pos).rgb;
+	vec3 qStar=q+texelFetch(derivativeSampler,pos).rgb*stepSize;
+	qStar.yz*=stepAttenuation;
+	
+	/* Calculate the temporal derivative of the tentative quantities and the bathymetry elevation at the center of this cell; cells of inactive tiles do not move: */
+	vec3 qtStar=vec3(0.0);
+	float b;
+	if(activeTile)
+		{
+		calcDerivative(cell,qtStar);
+		b=(B(-1,-1)+B(0,-1)+B(-1,0)+B(0,0))*0.25;
+		}
+	else
+		{
+		ivec2 maxB=gridSize-ivec2(2,2);
+		b=(texelFetch(bathymetrySampler,clamp(pos-ivec2(1,1),ivec2(0,0),maxB)).r+
+		   texelFetch(bathymetrySampler,clamp(pos-ivec2(0,1),ivec2(0,0),maxB)).r+
+		   texelFetch(bathymetrySampler,clamp(pos-ivec2(1,0),ivec2(0,0),maxB)).r+
+		   texelFetch(bathymetrySampler,clamp(pos,ivec2(0,0),maxB)).r)*0.25;
+		}
+	
+	/* Calculate the Runge-Kutta step: */
+	vec3 newQ=(q+qStar+qtStar*stepSize)*0.5;
+	
+	/* Add the snow melted during the simulation time since the previous snow update to the water below the critical height; the melt rate is the fraction melting per unit of simulation time in units of 1/100000: */
+	float snow=0.0;
+	float snowTime=0.0;
+	float meltedSnow=0.0;
+	if(updateSnow)
+		{
+		snow=texelFetch(snowSampler,pos).r;
+		snowTime=texelFetch(snowClockSampler,ivec2(0,0)).g;
+		meltedSnow=snow-snow*pow(1.0-meltRate/100000.0,snowTime);
+		if(b<criticalHeight&&snowTime>0.0&&snow>0.0001)
+			newQ.x+=meltedSnow;
+		}
+	
+	newQ.yz*=stepAttenuation;
+	
+	/* Enforce dry boundaries on the outermost layer of cells: */
+	if(dryBoundary&&(pos.x==0||pos.y==0||pos.x==gridSize.x-1||pos.y==gridSize.y-1))
+		newQ=vec3(b,0.0,0.0);
+	
+	if(updateSnow)
+		{
+		/* Accumulate water above the critical height as snow, and melt snow below it, if the simulation advanced since the previous snow update: */
+		float newSnow=snow;
+		float newMelt=0.0;
+		if(snowTime>0.0)
+			{
+			if(b>=criticalHeight)
+				newSnow=snow+(newQ.x-b);
+			else if(snow>0.0001)
+				{
+				newSnow=snow-meltedSnow;
+				newMelt=meltedSnow;
+				}
+			else
+				newSnow=0.0; // Prevent infinitely small snow
+			}
+		
+		/* Remove all water where snow is present: */
+		if(b>=criticalHeight)
+			newQ=vec3(b,0.0,0.0);
+		
+		/* Write the new snow amount with the melt water it released: */
+		imageStore(snowImage,pos,vec4(newSnow,newMelt,0.0,0.0));
+		}
+	
+	/* Write the new quantities: */
+	imageStore(quantityImage,pos,vec4(newQ,0.0));
+	}
@@ -21,17 +21,24 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #extension GL_ARB_texture_rectangle : enable
 
-uniform float stepSize;
+uniform sampler2DRect stepStateSampler;
 uniform float attenuation;
 uniform sampler2DRect quantitySampler;
 uniform sampler2DRect derivativeSampler;
 
 void main()
 	{
+	/* Retrieve the step size from the step state: */
+	float stepSize=texture2DRect(stepStateSampler,vec2(0.5,0.5)).r;
+	
+	/* Skip steps that do not advance; the Runge-Kutta step does not read their tentative quantities: */
+	if(stepSize==0.0)
+		discard;
+	
 	/* Calculate the Euler step: */
 	vec3 q=texture2DRect(quantitySampler,gl_FragCoord.xy).rgb;
 	vec3 qt=texture2DRect(derivativeSampler,gl_FragCoord.xy).rgb;
 	vec3 newQ=q+qt*stepSize;
-	newQ.yz*=attenuation;
+	newQ.yz*=pow(attenuation,stepSize);
 	gl_FragColor=vec4(newQ,0.0);
 	}
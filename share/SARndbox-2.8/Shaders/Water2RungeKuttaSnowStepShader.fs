@@ -0,0 +1,98 @@
+/***********************************************************************
+Water2RungeKuttaSnowStepShader - Shader to perform a Runge-Kutta
+integration step together with the snow accumulation, snow melt, and
+freeze updates, writing the new conserved quantities and the new snow
+amounts into two render targets in a single pass. Snow melt is scaled by
+the simulation time advanced since the previous snow update, so snow
+can be updated less often than water flows.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect stepStateSampler;
+uniform sampler2DRect snowClockSampler;
+uniform float attenuation;
+uniform float criticalHeight;
+uniform float meltRate;
+uniform bool dryBoundary;
+uniform vec2 gridSize;
+uniform sampler2DRect quantitySampler;
+uniform sampler2DRect quantityStarSampler;
+uniform sampler2DRect derivativeSampler;
+uniform sampler2DRect snowSampler;
+uniform sampler2DRect bathymetrySampler;
+
+void main()
+	{
+	/* Retrieve the step size from the step state, and the simulation time advanced since the previous snow update from the snow clock: */
+	float stepSize=texture2DRect(stepStateSampler,vec2(0.5,0.5)).r;
+	float snowTime=texture2DRect(snowClockSampler,vec2(0.5,0.5)).g;
+	
+	/* Calculate the Runge-Kutta step, keeping the quantities in steps that do not advance, as their tentative quantities were never written: */
+	vec3 newQ=texture2DRect(quantitySampler,gl_FragCoord.xy).rgb;
+	if(stepSize>0.0)
+		{
+		vec3 qStar=texture2DRect(quantityStarSampler,gl_FragCoord.xy).rgb;
+		vec3 qt=texture2DRect(derivativeSampler,gl_FragCoord.xy).rgb;
+		newQ=(newQ+qStar+qt*stepSize)*0.5;
+		}
+	
+	/* Calculate the bathymetry elevation at the center of this cell once for all updates: */
+	float B=(texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y-1.0)).r+
+	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x,gl_FragCoord.y-1.0)).r+
+	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y)).r+
+	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.xy)).r)*0.25;
+	
+	/* Add the snow melted during the simulation time since the previous snow update to the water below the critical height; the melt rate is the fraction melting per unit of simulation time in units of 1/100000: */
+	float snow=texture2DRect(snowSampler,gl_FragCoord.xy).r;
+	float meltedSnow=snow-snow*pow(1.0-meltRate/100000.0,snowTime);
+	if(B<criticalHeight&&snowTime>0.0&&snow>0.0001)
+		newQ.x+=meltedSnow;
+	
+	newQ.yz*=pow(attenuation,stepSize);
+	
+	/* Enforce dry boundaries on the outermost layer of cells: */
+	if(dryBoundary&&(gl_FragCoord.x<1.0||gl_FragCoord.y<1.0||gl_FragCoord.x>gridSize.x-1.0||gl_FragCoord.y>gridSize.y-1.0))
+		newQ=vec3(B,0.0,0.0);
+	
+	/* Accumulate water above the critical height as snow, and melt snow below it, if the simulation advanced since the previous snow update: */
+	float newSnow=snow;
+	float newMelt=0.0;
+	if(snowTime>0.0)
+		{
+		if(B>=criticalHeight)
+			newSnow=snow+(newQ.x-B);
+		else if(snow>0.0001)
+			{
+			newSnow=snow-meltedSnow;
+			newMelt=meltedSnow;
+			}
+		else
+			newSnow=0.0; // Prevent infinitely small snow
+		}
+	
+	/* Remove all water where snow is present: */
+	if(B>=criticalHeight)
+		newQ=vec3(B,0.0,0.0);
+	
+	/* Write the new quantities, and the new snow amount with the melt water it released: */
+	gl_FragData[0]=vec4(newQ,0.0);
+	gl_FragData[1]=vec4(newSnow,newMelt,0.0,0.0);
+	}
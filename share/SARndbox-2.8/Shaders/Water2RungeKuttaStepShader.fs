@@ -22,45 +22,30 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #extension GL_ARB_texture_rectangle : enable
 
-uniform float stepSize;
+uniform sampler2DRect stepStateSampler;
 uniform float attenuation;
-uniform float criticalHeight;
-uniform float meltRate;
 uniform sampler2DRect quantitySampler;
 uniform sampler2DRect quantityStarSampler;
 uniform sampler2DRect derivativeSampler;
-uniform sampler2DRect snowSampler;
-uniform sampler2DRect bathymetrySampler;
 
 void main()
 	{
-	/* Calculate the Runge-Kutta step: */
+	/* Retrieve the step size from the step state: */
+	float stepSize=texture2DRect(stepStateSampler,vec2(0.5,0.5)).r;
+	
+	/* Copy the quantities through in steps that do not advance, as their tentative quantities were never written: */
 	vec3 q=texture2DRect(quantitySampler,gl_FragCoord.xy).rgb;
+	if(stepSize==0.0)
+		{
+		gl_FragColor=vec4(q,0.0);
+		return;
+		}
+	
+	/* Calculate the Runge-Kutta step: */
 	vec3 qStar=texture2DRect(quantityStarSampler,gl_FragCoord.xy).rgb;
 	vec3 qt=texture2DRect(derivativeSampler,gl_FragCoord.xy).rgb;
 	vec3 newQ=(q+qStar+qt*stepSize)*0.5;
 
-	// Snow Supporting: Adds 'melted' snow to quantity 
-	vec3 snow = texture2DRect(snowSampler,gl_FragCoord.xy).rgb;
-	vec3 holdMelt = vec3(0.0,0.0,0.0);
-	float B=(texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y-1.0)).r+
-	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x,gl_FragCoord.y-1.0)).r+
-	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y)).r+
-	         texture2DRect(bathymetrySampler,vec2(gl_FragCoord.xy)).r)*0.25;
-	float snowMelt = meltRate/100000;
-	//float snowMelt = meltRate/1000000;// Testing Rate
-
-	if(B<criticalHeight)
-	{
-		holdMelt.r = snow.r; 
-		if(holdMelt.r>0.0001)
-		{
-			holdMelt.g = holdMelt.g + holdMelt.r *snowMelt;//0.00005;
-			newQ.x = newQ.x + holdMelt.g;
-			holdMelt.r = holdMelt.r - holdMelt.g;
-		}
-	}
-
-	newQ.yz*=attenuation;
+	newQ.yz*=pow(attenuation,stepSize);
 	gl_FragColor=vec4(newQ,0.0);
 	}
@@ -0,0 +1,234 @@
+/***********************************************************************
+Water2SlopeAndFluxAndDerivativeShader - Compute shader to calculate the
+temporal derivative of the conserved quantities and the maximum step
+size of each work group in a single pass, by loading 16x16 tiles of
+cells with two-cell halos into shared memory. Work groups on inactive
+tiles only write zero derivatives.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#version 430
+
+layout(local_size_x=16,local_size_y=16) in;
+
+uniform vec2 cellSize;
+uniform float theta;
+uniform float g;
+uniform float epsilon;
+uniform ivec2 gridSize;
+uniform sampler2DRect bathymetrySampler;
+uniform sampler2DRect quantitySampler;
+uniform sampler2DRect activeTileSampler;
+uniform sampler2DRect stepStateSampler;
+uniform writeonly image2DRect derivativeImage; // Writes take the storage format the image is bound with
+layout(r32f) uniform writeonly image2DRect maxStepSizeImage;
+
+/* Work group's tiles of cell-centered quantities and of vertex-centered bathymetry elevations, including halos: */
+shared vec3 qTile[20][20];
+shared float bTile[19][19];
+shared uint groupStepSize; // Bit pattern of the work group's non-negative maximum step size, which orders like the value
+
+/* Access to tiles relative to the invocation's cell: */
+#define Q(dx,dy) qTile[cell.y+2+(dy)][cell.x+2+(dx)]
+#define B(dx,dy) bTile[cell.y+2+(dy)][cell.x+2+(dx)]
+
+vec3 calcSlope(in vec3 q0,in vec3 q1,in vec3 q2,in float cellSize,in float b0,in float b1)
+	{
+	/* Calculate the left, central, and right differences: */
+	vec3 d01=(q1-q0)*(theta/cellSize);
+	vec3 d02=(q2-q0)/(2.0*cellSize);
+	vec3 d12=(q2-q1)*(theta/cellSize);
+	
+	/* Calculate the component-wise intervals: */
+	vec3 dMin=min(min(d01,d02),d12);
+	vec3 dMax=max(max(d01,d02),d12);
+	
+	/* Calculate the minmod-limited slope: */
+	vec3 slope;
+	slope.x=dMin.x>0.0?dMin.x:dMax.x<0.0?dMax.x:0.0;
+	slope.y=dMin.y>0.0?dMin.y:dMax.y<0.0?dMax.y:0.0;
+	slope.z=dMin.z>0.0?dMin.z:dMax.z<0.0?dMax.z:0.0;
+	
+	/* Check the calculated slope against the left and right face-centered bathymetry values: */
+	if(q1.x-slope.x*cellSize*0.5<b0)
+		slope.x=(q1.x-b0)/(cellSize*0.5);
+	if(q1.x+slope.x*cellSize*0.5<b1)
+		slope.x=(b1-q1.x)/(cellSize*0.5);
+	
+	/* Return the adjusted slope: */
+	return slope;
+	}
+
+vec2 calcUv(inout vec3 q,in float h)
+	{
+	/* Calculate velocity using a desingularizing division operator: */
+	float h4=h*h*h*h;
+	vec2 uv=q.yz*(1.41421356237309*h/sqrt(h4+max(h4,epsilon)));
+	
+	/* Recalculate discharge based on desingularized velocity: */
+	q.yz=uv*h;
+	
+	return uv;
+	}
+
+float calcPartialFluxX(in vec3 qe,in vec3 qw,in float bew,out vec3 fluxX)
+	{
+	/* Calculate one-sided water column heights: */
+	float he=max(qe.x-bew,0.0);
+	float hw=max(qw.x-bew,0.0);
+	
+	/* Calculate one-sided velocities: */
+	vec2 uve=calcUv(qe,he);
+	vec2 uvw=calcUv(qw,hw);
+	
+	/* Calculate one-sided x-direction flux quadratures: */
+	vec3 fe=vec3(qe.y,uve.x*qe.y+0.5*g*he*he,uve.y*qe.y);
+	vec3 fw=vec3(qw.y,uvw.x*qw.y+0.5*g*hw*hw,uvw.y*qw.y);
+	
+	/* Calculate one-sided local speeds of propagation: */
+	float sghe=sqrt(g*he);
+	float sghw=sqrt(g*hw);
+	float ae=min(min(uve.x-sghe,uvw.x-sghw),0.0);
+	float aw=max(max(uve.x+sghe,uvw.x+sghw),0.0);
+	
+	/* Calculate complete x-direction flux: */
+	fluxX=aw-ae!=0.0?((fe*aw-fw*ae)+(qw-qe)*(aw*ae))/(aw-ae):vec3(0.0);
+	
+	/* Return maximum possible step size: */
+	return 0.5*cellSize.x/max(-ae,aw);
+	}
+
+float calcPartialFluxY(in vec3 qn,in vec3 qs,in float bns,out vec3 fluxY)
+	{
+	/* Calculate one-sided water column heights: */
+	float hn=max(qn.x-bns,0.0);
+	float hs=max(qs.x-bns,0.0);
+	
+	/* Calculate one-sided velocities: */
+	vec2 uvn=calcUv(qn,hn);
+	vec2 uvs=calcUv(qs,hs);
+	
+	/* Calculate one-sided y-direction flux quadratures: */
+	vec3 fn=vec3(qn.z,uvn.x*qn.z,uvn.y*qn.z+0.5*g*hn*hn);
+	vec3 fs=vec3(qs.z,uvs.x*qs.z,uvs.y*qs.z+0.5*g*hs*hs);
+	
+	/* Calculate one-sided local speeds of propagation: */
+	float sghn=sqrt(g*hn);
+	float sghs=sqrt(g*hs);
+	float an=min(min(uvn.y-sghn,uvs.y-sghs),0.0);
+	float as=max(max(uvn.y+sghn,uvs.y+sghs),0.0);
+	
+	/* Calculate complete y-direction flux: */
+	fluxY=as-an!=0.0?((fn*as-fs*an)+(qs-qn)*(as*an))/(as-an):vec3(0.0);
+	
+	/* Return maximum possible step size: */
+	return 0.5*cellSize.y/max(-an,as);
+	}
+
+float calcDerivative(in ivec2 cell,out vec3 derivative)
+	{
+	/* Calculate face-centered bathymetry elevations required for partial flux computations: */
+	float b0=(B(-1,-2)+B(0,-2))*0.5;
+	float b1=(B(-1,-1)+B(0,-1))*0.5;
+	float b2=(B(-2,-1)+B(-2,0))*0.5;
+	float b3=(B(-1,-1)+B(-1,0))*0.5;
+	float b4=(B(0,-1)+B(0,0))*0.5;
+	float b5=(B(1,-1)+B(1,0))*0.5;
+	float b6=(B(-1,0)+B(0,0))*0.5;
+	float b7=(B(-1,1)+B(0,1))*0.5;
+	
+	/* Get quantities required for partial flux computations: */
+	vec3 q1=Q(0,-1);
+	vec3 q3=Q(-1,0);
+	vec3 q4=Q(0,0);
+	vec3 q5=Q(1,0);
+	vec3 q7=Q(0,1);
+	
+	/* Calculate one-sided quantities required for partial flux computations: */
+	vec3 q1n=q1+calcSlope(Q(0,-2),q1,q4,cellSize.y,b0,b1)*(cellSize.y*0.5);
+	vec3 q3e=q3+calcSlope(Q(-2,0),q3,q4,cellSize.x,b2,b3)*(cellSize.x*0.5);
+	vec3 q4x=calcSlope(q3,q4,q5,cellSize.x,b3,b4)*(cellSize.x*0.5);
+	vec3 q4w=q4-q4x;
+	vec3 q4e=q4+q4x;
+	vec3 q4y=calcSlope(q1,q4,q7,cellSize.y,b1,b6)*(cellSize.y*0.5);
+	vec3 q4s=q4-q4y;
+	vec3 q4n=q4+q4y;
+	vec3 q5w=q5-calcSlope(q4,q5,Q(2,0),cellSize.x,b4,b5)*(cellSize.x*0.5);
+	vec3 q7s=q7-calcSlope(q4,q7,Q(0,2),cellSize.y,b6,b7)*(cellSize.y*0.5);
+	
+	/* Calculate partial fluxes across the cell's faces and the maximum possible step size for this cell: */
+	vec3 fluxXw,fluxXe,fluxYs,fluxYn;
+	float maxStepSize=min(min(calcPartialFluxX(q3e,q4w,b3,fluxXw),
+	                          calcPartialFluxX(q4e,q5w,b4,fluxXe)),
+	                      min(calcPartialFluxY(q1n,q4s,b1,fluxYs),
+	                          calcPartialFluxY(q4n,q7s,b6,fluxYn)));
+	
+	/* Calculate the water column height at the cell center: */
+	float h=max(q4.x-(b3+b4)*0.5,0.0);
+	
+	/* Calculate equation source terms at the cell center: */
+	vec3 source=vec3(0.0,-g*h*(b4-b3)/cellSize.x,-g*h*(b6-b1)/cellSize.y);
+	
+	/* Calculate the temporal derivative: */
+	derivative=source-(fluxXe-fluxXw)/cellSize.x-(fluxYn-fluxYs)/cellSize.y;
+	
+	return maxStepSize;
+	}
+
+void main()
+	{
+	/* Check whether the work group's tile is active, treating all tiles as inactive in steps queued beyond the time budget: */
+	bool activeTile=texelFetch(stepStateSampler,ivec2(0,0)).g>1.0e-8&&texelFetch(activeTileSampler,ivec2(gl_WorkGroupID.xy)).r>0.0;
+	uint index=gl_LocalInvocationIndex;
+	if(index==0u)
+		groupStepSize=floatBitsToUint(10000.0);
+	
+	if(activeTile)
+		{
+		/* Load the work group's quantity and bathymetry tiles, clamping to the grids like texture lookups: */
+		ivec2 tileOrigin=ivec2(gl_WorkGroupID.xy)*16-ivec2(2,2);
+		for(int i=int(index);i<20*20;i+=256)
+			{
+			ivec2 t=ivec2(i%20,i/20);
+			qTile[t.y][t.x]=texelFetch(quantitySampler,clamp(tileOrigin+t,ivec2(0,0),gridSize-ivec2(1,1))).rgb;
+			}
+		for(int i=int(index);i<19*19;i+=256)
+			{
+			ivec2 t=ivec2(i%19,i/19);
+			bTile[t.y][t.x]=texelFetch(bathymetrySampler,clamp(tileOrigin+t,ivec2(0,0),gridSize-ivec2(2,2))).r;
+			}
+		}
+	barrier();
+	
+	/* Calculate the temporal derivative and maximum step size of the invocation's cell if it is inside the grid; cells of inactive tiles do not move: */
+	ivec2 cell=ivec2(gl_LocalInvocationID.xy);
+	ivec2 pos=ivec2(gl_GlobalInvocationID.xy);
+	if(pos.x<gridSize.x&&pos.y<gridSize.y)
+		{
+		vec3 derivative=vec3(0.0);
+		if(activeTile)
+			atomicMin(groupStepSize,floatBitsToUint(calcDerivative(cell,derivative)));
+		imageStore(derivativeImage,pos,vec4(derivative,0.0));
+		}
+	barrier();
+	
+	/* Write the work group's maximum step size: */
+	if(index==0u)
+		imageStore(maxStepSizeImage,ivec2(gl_WorkGroupID.xy),vec4(uintBitsToFloat(groupStepSize),0.0,0.0,0.0));
+	}
@@ -30,6 +30,7 @@ uniform float g;
 uniform float epsilon;
 uniform sampler2DRect bathymetrySampler;
 uniform sampler2DRect quantitySampler;
+uniform sampler2DRect stepStateSampler;
 
 vec3 calcSlope(in vec3 q0,in vec3 q1,in vec3 q2,in float cellSize,in float b0,in float b1)
 	{
@@ -126,6 +127,11 @@ float calcPartialFluxY(in vec3 qn,in vec3 qs,in float bns,out vec3 fluxY)
 
 void main()
 	{
+	/* Skip steps queued beyond the time budget; once a step did not advance and no time remains, neither will this one, and the cleared derivative and maximum step size textures keep it from moving: */
+	vec2 stepState=texture2DRect(stepStateSampler,vec2(0.5,0.5)).rg;
+	if(stepState.r==0.0&&stepState.g<=1.0e-8)
+		discard;
+	
 	/* Calculate face-centered bathymetry elevations required for partial flux computations: */
 	float b00=texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y-1.0)).r;
 	float b10=texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x,gl_FragCoord.y-1.0)).r;
@@ -0,0 +1,73 @@
+/***********************************************************************
+Water2StepSizeShader - Compute shader to reduce the maximum step sizes
+of all work groups, select the step size of the next Runge-Kutta
+integration step from it and the remaining time budget, and advance the
+step state and the snow clock accordingly, in a single work group.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#version 430
+
+layout(local_size_x=256) in;
+
+uniform float maxStepSize;
+uniform bool useReducedStepSize;
+uniform ivec2 reducedSize;
+uniform sampler2DRect reducedStepSizeSampler;
+uniform sampler2DRect stepStateSampler;
+uniform bool resetSnowClock;
+uniform sampler2DRect snowClockSampler;
+layout(rgba32f) uniform writeonly image2DRect stepStateImage;
+layout(rgba32f) uniform writeonly image2DRect snowClockImage;
+
+shared uint minStepSize; // Bit pattern of the minimum non-negative step size, which orders like the value
+
+void main()
+	{
+	uint index=gl_LocalInvocationIndex;
+	if(index==0u)
+		minStepSize=floatBitsToUint(maxStepSize);
+	barrier();
+	
+	/* Gather the minimum of a strided subset of the work groups' maximum step sizes: */
+	float stepSize=maxStepSize;
+	if(useReducedStepSize)
+		for(int i=int(index);i<reducedSize.x*reducedSize.y;i+=256)
+			stepSize=min(stepSize,texelFetch(reducedStepSizeSampler,ivec2(i%reducedSize.x,i/reducedSize.x)).r);
+	
+	/* Reduce the gathered step sizes in shared memory: */
+	atomicMin(minStepSize,floatBitsToUint(stepSize));
+	barrier();
+	
+	if(index==0u)
+		{
+		/* Get the previous step state (step size, remaining time, advanced time, number of advancing steps): */
+		vec4 state=texelFetch(stepStateSampler,ivec2(0,0));
+		
+		/* Limit the step size to the remaining time: */
+		stepSize=state.g>1.0e-8?min(uintBitsToFloat(minStepSize),state.g):0.0;
+		
+		/* Write the new step state: */
+		imageStore(stepStateImage,ivec2(0,0),vec4(stepSize,state.g-stepSize,state.b+stepSize,stepSize>0.0?state.a+1.0:state.a));
+		
+		/* Count the advancing steps and the simulation time advanced since the last snow update: */
+		vec4 snowClock=resetSnowClock?vec4(0.0,0.0,0.0,0.0):texelFetch(snowClockSampler,ivec2(0,0));
+		imageStore(snowClockImage,ivec2(0,0),vec4(stepSize>0.0?snowClock.r+1.0:snowClock.r,snowClock.g+stepSize,0.0,0.0));
+		}
+	}
@@ -0,0 +1,51 @@
+/***********************************************************************
+Water2StepSizeShader - Shader to select the step size of the next
+Runge-Kutta integration step from the reduced maximum step size and the
+remaining time budget, and to advance the step state and the snow clock
+accordingly.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform float maxStepSize;
+uniform bool useReducedStepSize;
+uniform sampler2DRect reducedStepSizeSampler;
+uniform sampler2DRect stepStateSampler;
+uniform bool resetSnowClock;
+uniform sampler2DRect snowClockSampler;
+
+void main()
+	{
+	/* Get the previous step state (step size, remaining time, advanced time, number of advancing steps): */
+	vec4 state=texture2DRect(stepStateSampler,vec2(0.5,0.5));
+
+	/* Limit the step size to the client-specified maximum, the stable step size, and the remaining time: */
+	float stepSize=maxStepSize;
+	if(useReducedStepSize)
+		stepSize=min(stepSize,texture2DRect(reducedStepSizeSampler,vec2(0.5,0.5)).r);
+	stepSize=state.g>1.0e-8?min(stepSize,state.g):0.0;
+
+	/* Write the new step state: */
+	gl_FragData[0]=vec4(stepSize,state.g-stepSize,state.b+stepSize,stepSize>0.0?state.a+1.0:state.a);
+	
+	/* Count the advancing steps and the simulation time advanced since the last snow update: */
+	vec4 snowClock=resetSnowClock?vec4(0.0,0.0,0.0,0.0):texture2DRect(snowClockSampler,vec2(0.5,0.5));
+	gl_FragData[1]=vec4(stepSize>0.0?snowClock.r+1.0:snowClock.r,snowClock.g+stepSize,0.0,0.0);
+	}
@@ -0,0 +1,43 @@
+/***********************************************************************
+Water2VolumeReductionShader - Shader to sum the gathered snow, melt
+water, and free water amounts of 2x2 tiles of pixels.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform vec2 fullTextureSize;
+uniform sampler2DRect volumeSampler;
+
+void main()
+	{
+	/* Calculate the base position of a 2x2 tile of pixels: */
+	vec2 frag=gl_FragCoord.xy*2.0-vec2(0.5,0.5);
+	
+	/* Accumulate the sums of the 2x2 tile: */
+	vec3 amounts=texture2DRect(volumeSampler,frag).rgb;
+	if(frag.x<fullTextureSize.x)
+		amounts+=texture2DRect(volumeSampler,vec2(frag.x+1.0,frag.y)).rgb;
+	if(frag.y<fullTextureSize.y)
+		amounts+=texture2DRect(volumeSampler,vec2(frag.x,frag.y+1.0)).rgb;
+	if(frag.x<fullTextureSize.x&&frag.y<fullTextureSize.y)
+		amounts+=texture2DRect(volumeSampler,vec2(frag.x+1.0,frag.y+1.0)).rgb;
+	
+	gl_FragData[0]=vec4(amounts,0.0);
+	}
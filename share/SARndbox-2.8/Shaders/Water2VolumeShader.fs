@@ -0,0 +1,59 @@
+/***********************************************************************
+Water2VolumeShader - Shader to gather the snow, melt water, and free
+water amounts of 2x2 tiles of cells as the first step of reducing them
+to grid totals.
+Copyright (c) 2026 The SARndbox contributors
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform vec2 fullTextureSize;
+uniform sampler2DRect snowSampler;
+uniform sampler2DRect quantitySampler;
+uniform sampler2DRect bathymetrySampler;
+
+vec3 getAmounts(vec2 cell)
+	{
+	/* Calculate the bathymetry elevation at the center of the cell: */
+	float b=(texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y-1.0)).r+
+	         texture2DRect(bathymetrySampler,vec2(cell.x,cell.y-1.0)).r+
+	         texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y)).r+
+	         texture2DRect(bathymetrySampler,cell).r)*0.25;
+	
+	/* Return the cell's snow amount, melt water released by the last snow update, and free water height: */
+	vec2 snow=texture2DRect(snowSampler,cell).rg;
+	return vec3(snow,max(texture2DRect(quantitySampler,cell).r-b,0.0));
+	}
+
+void main()
+	{
+	/* Calculate the base position of a 2x2 tile of cells: */
+	vec2 frag=gl_FragCoord.xy*2.0-vec2(0.5,0.5);
+	
+	/* Accumulate the amounts of the 2x2 tile: */
+	vec3 amounts=getAmounts(frag);
+	if(frag.x<fullTextureSize.x)
+		amounts+=getAmounts(vec2(frag.x+1.0,frag.y));
+	if(frag.y<fullTextureSize.y)
+		amounts+=getAmounts(vec2(frag.x,frag.y+1.0));
+	if(frag.x<fullTextureSize.x&&frag.y<fullTextureSize.y)
+		amounts+=getAmounts(vec2(frag.x+1.0,frag.y+1.0));
+	
+	gl_FragData[0]=vec4(amounts,0.0);
+	}
@@ -27,6 +27,9 @@ uniform sampler2DRect bathymetrySampler; // Sampler for the bathymetry texture
 uniform mat4 modelviewGridMatrix; // Vertex transformation from grid space to eye space
 uniform mat4 tangentModelviewGridMatrix; // Tangend plane transformation from grid space to eye space
 uniform mat4 projectionModelviewGridMatrix; // Vertex transformation from grid space to clip space
+uniform vec2 gridMax; // Grid-space position of the last water grid cell center
+uniform vec2 tileOrigins[MAX_TILES]; // Grid-space origins of the drawn tiles
+uniform vec4 tileEdgeStrides[MAX_TILES]; // Vertex strides along the drawn tiles' left, right, bottom, and top edges
 
 varying vec4 color; // Color value for Goraud shading
 
@@ -71,11 +74,36 @@ void accumulateLight0(in vec4 vertexEc,in vec3 normalEc,in vec4 ambient,in vec4
 		}
 	}
 
+float waterLevel(in vec2 tilePos)
+	{
+	/* Sample the water level at the cell center of the given grid vertex, clamped to the grid: */
+	return texture2DRect(quantitySampler,min(tilePos+vec2(0.5,0.5),gridMax)).r;
+	}
+
+float edgeWaterLevel(in vec2 tilePos,in vec2 edgeDir,in float along,in float edgeStride)
+	{
+	/* Interpolate the water level between the edge's vertices at the given stride: */
+	float along0=floor(along/edgeStride)*edgeStride;
+	vec2 edgePos0=tilePos+edgeDir*(along0-along);
+	return mix(waterLevel(edgePos0),waterLevel(edgePos0+edgeDir*edgeStride),(along-along0)/edgeStride);
+	}
+
 void main()
 	{
-	/* Get the vertex' grid-space z coordinate from the quantity texture: */
-	vec4 vertexGc=gl_Vertex;
-	vertexGc.z=texture2DRect(quantitySampler,vertexGc.xy).r;
+	/* Get the vertex' grid-space position from the tile template vertex and the tile origin: */
+	vec2 tilePos=tileOrigins[TILE_INDEX]+gl_Vertex.xy;
+	vec4 vertexGc=vec4(min(tilePos+vec2(0.5,0.5),gridMax),0.0,1.0);
+	
+	/* Get the vertex' grid-space z coordinate from the quantity texture, or from the edge of a coarser neighboring tile: */
+	vec4 edgeStrides=tileEdgeStrides[TILE_INDEX];
+	float xEdgeStride=gl_Vertex.x==0.0?edgeStrides.x:gl_Vertex.x==TILE_SIZE?edgeStrides.y:1.0;
+	float yEdgeStride=gl_Vertex.y==0.0?edgeStrides.z:gl_Vertex.y==TILE_SIZE?edgeStrides.w:1.0;
+	if(xEdgeStride>1.0)
+		vertexGc.z=edgeWaterLevel(tilePos,vec2(0.0,1.0),gl_Vertex.y,xEdgeStride);
+	else if(yEdgeStride>1.0)
+		vertexGc.z=edgeWaterLevel(tilePos,vec2(1.0,0.0),gl_Vertex.x,yEdgeStride);
+	else
+		vertexGc.z=waterLevel(tilePos);
 	
 	/* Get the bathymetry elevation at the same location: */
 	float bathy=(texture2DRect(bathymetrySampler,vertexGc.xy-vec2(1.0,1.0)).r